@@ -7,11 +7,16 @@
  */
 
 #include "01-api-client.h"
+#include "19-endpoint-pool.h"
+#include "20-circuit-breaker.h"
+#include "21-response-memo.h"
+#include "../net/09-http-pool.h"
 #include "../../libs/cJSON.h"
 #include <curl/curl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 // Default configuration values
@@ -99,11 +104,72 @@ LLMConfig* llm_config_create(void) {
     config->model = strdup_safe(DEFAULT_MODEL);
     config->timeout_ms = DEFAULT_TIMEOUT_MS;
     config->max_retries = DEFAULT_MAX_RETRIES;
+    config->cache_prompt = false;
+    config->slot_id = -1;
+    config->endpoints = NULL;
+    config->affinity = 0;
+    config->breaker = NULL;
+    config->temperature = -1.0f;
+    config->memoize_sampled = false;
 
     return config;
 }
 // }}}
 
+// {{{ llm_config_set_session
+void llm_config_set_session(LLMConfig* config, const char* session_id,
+                            int slot_count) {
+    if (config == NULL) {
+        return;
+    }
+
+    config->cache_prompt = true;
+    config->slot_id = -1;
+    config->affinity = 0;
+    if (session_id == NULL) {
+        return;
+    }
+
+    // FNV-1a keeps the mapping stable across restarts
+    unsigned long hash = 2166136261UL;
+    for (const unsigned char* p = (const unsigned char*)session_id; *p; p++) {
+        hash = ((hash ^ *p) * 16777619UL) & 0xffffffffUL;
+    }
+    config->affinity = hash != 0 ? hash : 1;
+    if (slot_count > 0) {
+        config->slot_id = (int)(hash % (unsigned long)slot_count);
+    }
+}
+// }}}
+
+// {{{ llm_config_for_session
+LLMConfig* llm_config_for_session(const LLMConfig* base, const char* session_id,
+                                  int slot_count) {
+    if (base == NULL) {
+        return NULL;
+    }
+
+    LLMConfig* config = malloc(sizeof(LLMConfig));
+    if (config == NULL) {
+        return NULL;
+    }
+
+    *config = *base;
+    config->endpoint = strdup_safe(base->endpoint);
+    config->api_key = strdup_safe(base->api_key);
+    config->model = strdup_safe(base->model);
+    if ((base->endpoint != NULL && config->endpoint == NULL) ||
+        (base->api_key != NULL && config->api_key == NULL) ||
+        (base->model != NULL && config->model == NULL)) {
+        llm_config_free(config);
+        return NULL;
+    }
+
+    llm_config_set_session(config, session_id, slot_count);
+    return config;
+}
+// }}}
+
 // {{{ llm_config_free
 void llm_config_free(LLMConfig* config) {
     if (config == NULL) {
@@ -120,21 +186,31 @@ void llm_config_free(LLMConfig* config) {
 // {{{ llm_init
 bool llm_init(void) {
     CURLcode res = curl_global_init(CURL_GLOBAL_DEFAULT);
-    return res == CURLE_OK;
+    if (res != CURLE_OK) {
+        return false;
+    }
+    http_pool_init(NULL);
+    return true;
 }
 // }}}
 
 // {{{ llm_cleanup
 void llm_cleanup(void) {
+    http_pool_shutdown();
     curl_global_cleanup();
 }
 // }}}
 
-// {{{ build_request_json
-// Builds the JSON request body for chat completion.
-static char* build_request_json(const LLMConfig* config,
-                                 const LLMMessage* messages,
-                                 size_t message_count) {
+// {{{ build_body
+// Serializes the chat completion request, optionally asking for SSE.
+static char* build_body(const LLMConfig* config,
+                        const LLMMessage* messages,
+                        size_t message_count,
+                        bool stream) {
+    if (config == NULL || messages == NULL) {
+        return NULL;
+    }
+
     cJSON* root = cJSON_CreateObject();
     if (root == NULL) {
         return NULL;
@@ -151,6 +227,21 @@ static char* build_request_json(const LLMConfig* config,
     }
     cJSON_AddItemToObject(root, "messages", msgs_array);
 
+    if (config->temperature >= 0.0f) {
+        cJSON_AddNumberToObject(root, "temperature", config->temperature);
+    }
+
+    if (stream) {
+        cJSON_AddBoolToObject(root, "stream", true);
+    }
+
+    if (config->cache_prompt) {
+        cJSON_AddBoolToObject(root, "cache_prompt", true);
+        if (config->slot_id >= 0) {
+            cJSON_AddNumberToObject(root, "id_slot", config->slot_id);
+        }
+    }
+
     char* json_str = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
 
@@ -158,9 +249,59 @@ static char* build_request_json(const LLMConfig* config,
 }
 // }}}
 
-// {{{ parse_response_json
-// Parses the JSON response from the LLM API.
-static LLMResponse* parse_response_json(const char* json_str) {
+// {{{ llm_build_request_body
+char* llm_build_request_body(const LLMConfig* config,
+                              const LLMMessage* messages,
+                              size_t message_count) {
+    return build_body(config, messages, message_count, false);
+}
+// }}}
+
+// {{{ llm_build_stream_request_body
+char* llm_build_stream_request_body(const LLMConfig* config,
+                                     const LLMMessage* messages,
+                                     size_t message_count) {
+    return build_body(config, messages, message_count, true);
+}
+// }}}
+
+// {{{ llm_build_url
+char* llm_build_url(const LLMConfig* config) {
+    if (config == NULL || config->endpoint == NULL) {
+        return NULL;
+    }
+
+    size_t url_len = strlen(config->endpoint) + strlen("/v1/chat/completions") + 1;
+    char* url = malloc(url_len);
+    if (url == NULL) {
+        return NULL;
+    }
+    snprintf(url, url_len, "%s/v1/chat/completions", config->endpoint);
+    return url;
+}
+// }}}
+
+// {{{ llm_build_headers
+struct curl_slist* llm_build_headers(const LLMConfig* config) {
+    struct curl_slist* headers = NULL;
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+
+    if (config != NULL && config->api_key != NULL && strlen(config->api_key) > 0) {
+        size_t auth_len = strlen("Authorization: Bearer ") + strlen(config->api_key) + 1;
+        char* auth_header = malloc(auth_len);
+        if (auth_header != NULL) {
+            snprintf(auth_header, auth_len, "Authorization: Bearer %s", config->api_key);
+            headers = curl_slist_append(headers, auth_header);
+            free(auth_header);
+        }
+    }
+
+    return headers;
+}
+// }}}
+
+// {{{ llm_response_create_error
+LLMResponse* llm_response_create_error(const char* error) {
     LLMResponse* response = malloc(sizeof(LLMResponse));
     if (response == NULL) {
         return NULL;
@@ -169,7 +310,20 @@ static LLMResponse* parse_response_json(const char* json_str) {
     response->text = NULL;
     response->tokens_used = 0;
     response->success = false;
-    response->error = NULL;
+    response->error = strdup_safe(error);
+    response->http_status = 0;
+
+    return response;
+}
+// }}}
+
+// {{{ parse_response_json
+// Parses the JSON response from the LLM API.
+static LLMResponse* parse_response_json(const char* json_str) {
+    LLMResponse* response = llm_response_create_error(NULL);
+    if (response == NULL) {
+        return NULL;
+    }
 
     cJSON* root = cJSON_Parse(json_str);
     if (root == NULL) {
@@ -224,26 +378,346 @@ static LLMResponse* parse_response_json(const char* json_str) {
 }
 // }}}
 
+// {{{ llm_response_from_http
+LLMResponse* llm_response_from_http(long http_status, const char* body) {
+    LLMResponse* response;
+
+    if (http_status >= 200 && http_status < 300) {
+        response = parse_response_json(body != NULL ? body : "");
+        if (response != NULL) {
+            response->http_status = http_status;
+        }
+        return response;
+    }
+
+    response = llm_response_create_error(NULL);
+    if (response == NULL) {
+        return NULL;
+    }
+    response->http_status = http_status;
+
+    // Try to parse error from response body
+    cJSON* error_json = body != NULL ? cJSON_Parse(body) : NULL;
+    if (error_json != NULL) {
+        cJSON* error = cJSON_GetObjectItem(error_json, "error");
+        if (error != NULL) {
+            cJSON* message = cJSON_GetObjectItem(error, "message");
+            if (message != NULL && cJSON_IsString(message)) {
+                response->error = strdup_safe(message->valuestring);
+            }
+        }
+        cJSON_Delete(error_json);
+    }
+
+    if (response->error == NULL) {
+        char error_buf[64];
+        snprintf(error_buf, sizeof(error_buf), "HTTP error %ld", http_status);
+        response->error = strdup_safe(error_buf);
+    }
+
+    return response;
+}
+// }}}
+
+// {{{ llm_response_is_retryable
+bool llm_response_is_retryable(const LLMResponse* response) {
+    if (response == NULL || response->success) {
+        return false;
+    }
+
+    // Don't retry on client errors (4xx)
+    // Only retry on server errors (5xx) or network issues
+    if (response->http_status >= 400 && response->http_status < 500) {
+        return false;
+    }
+
+    return true;
+}
+// }}}
+
+// {{{ grow_string
+// Ensures *data can hold needed bytes, doubling its capacity.
+static bool grow_string(char** data, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = *capacity > 0 ? *capacity * 2 : 128;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    char* new_data = realloc(*data, new_capacity);
+    if (new_data == NULL) {
+        return false;
+    }
+    *data = new_data;
+    *capacity = new_capacity;
+    return true;
+}
+// }}}
+
+// {{{ llm_stream_parser_init
+void llm_stream_parser_init(LLMStreamParser* parser,
+                            LLMStreamCallback on_delta, void* user) {
+    if (parser == NULL) {
+        return;
+    }
+
+    memset(parser, 0, sizeof(LLMStreamParser));
+    parser->on_delta = on_delta;
+    parser->user = user;
+}
+// }}}
+
+// {{{ stream_handle_line
+// Processes one complete SSE line. Only "data:" fields carry content;
+// comments, event names and blank separators are ignored.
+static bool stream_handle_line(LLMStreamParser* parser, char* line, size_t len) {
+    if (len > 0 && line[len - 1] == '\r') {
+        line[--len] = '\0';
+    }
+    if (strncmp(line, "data:", 5) != 0) {
+        return true;
+    }
+
+    const char* payload = line + 5;
+    while (*payload == ' ') {
+        payload++;
+    }
+
+    if (strcmp(payload, "[DONE]") == 0) {
+        parser->done = true;
+        return true;
+    }
+
+    cJSON* root = cJSON_Parse(payload);
+    if (root == NULL) {
+        return true;
+    }
+
+    cJSON* error = cJSON_GetObjectItem(root, "error");
+    if (error != NULL && parser->error == NULL) {
+        cJSON* message = cJSON_GetObjectItem(error, "message");
+        parser->error = strdup_safe(cJSON_IsString(message) ?
+                                    message->valuestring : "Unknown API error");
+    }
+
+    bool ok = true;
+    cJSON* choices = cJSON_GetObjectItem(root, "choices");
+    cJSON* first_choice = cJSON_IsArray(choices) ? cJSON_GetArrayItem(choices, 0) : NULL;
+    cJSON* delta = first_choice != NULL ? cJSON_GetObjectItem(first_choice, "delta") : NULL;
+    cJSON* content = delta != NULL ? cJSON_GetObjectItem(delta, "content") : NULL;
+    if (cJSON_IsString(content) && content->valuestring[0] != '\0') {
+        size_t add = strlen(content->valuestring);
+        if (grow_string(&parser->text, &parser->text_cap, parser->text_len + add + 1)) {
+            memcpy(parser->text + parser->text_len, content->valuestring, add + 1);
+            parser->text_len += add;
+            parser->chunks++;
+            if (parser->on_delta != NULL) {
+                parser->on_delta(content->valuestring, parser->user);
+            }
+        } else {
+            ok = false;
+        }
+    }
+
+    cJSON* usage = cJSON_GetObjectItem(root, "usage");
+    cJSON* total = usage != NULL ? cJSON_GetObjectItem(usage, "total_tokens") : NULL;
+    if (cJSON_IsNumber(total)) {
+        parser->tokens_used = total->valueint;
+    }
+
+    cJSON_Delete(root);
+    return ok;
+}
+// }}}
+
+// {{{ llm_stream_parser_feed
+bool llm_stream_parser_feed(LLMStreamParser* parser,
+                            const char* data, size_t len) {
+    if (parser == NULL || data == NULL) {
+        return false;
+    }
+
+    size_t pos = 0;
+    while (pos < len && !parser->done) {
+        const char* newline = memchr(data + pos, '\n', len - pos);
+        size_t seg = newline != NULL ? (size_t)(newline - (data + pos)) : len - pos;
+
+        if (!grow_string(&parser->line, &parser->line_cap, parser->line_len + seg + 1)) {
+            return false;
+        }
+        memcpy(parser->line + parser->line_len, data + pos, seg);
+        parser->line_len += seg;
+        parser->line[parser->line_len] = '\0';
+        pos += seg;
+
+        if (newline == NULL) {
+            break;  // Incomplete line; wait for more data
+        }
+
+        pos++;  // Skip the newline
+        size_t line_len = parser->line_len;
+        parser->line_len = 0;
+        if (!stream_handle_line(parser, parser->line, line_len)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+// }}}
+
+// {{{ llm_stream_parser_finish
+LLMResponse* llm_stream_parser_finish(LLMStreamParser* parser) {
+    if (parser == NULL) {
+        return llm_response_create_error("Invalid arguments");
+    }
+
+    // A final line without a trailing newline still counts
+    if (parser->line_len > 0 && !parser->done) {
+        size_t line_len = parser->line_len;
+        parser->line_len = 0;
+        stream_handle_line(parser, parser->line, line_len);
+    }
+
+    if (parser->error != NULL) {
+        return llm_response_create_error(parser->error);
+    }
+    if (parser->text_len == 0) {
+        return llm_response_create_error("No content in response");
+    }
+
+    LLMResponse* response = llm_response_create_error(NULL);
+    if (response == NULL) {
+        return NULL;
+    }
+    response->text = strdup_safe(parser->text);
+    response->tokens_used = parser->tokens_used;
+    response->success = response->text != NULL;
+    return response;
+}
+// }}}
+
+// {{{ llm_stream_parser_free
+void llm_stream_parser_free(LLMStreamParser* parser) {
+    if (parser == NULL) {
+        return;
+    }
+
+    free(parser->line);
+    free(parser->text);
+    free(parser->error);
+    memset(parser, 0, sizeof(LLMStreamParser));
+}
+// }}}
+
+// {{{ elapsed_ms
+static double elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+// }}}
+
+// {{{ attempt_timeout_ms
+// config->timeout_ms, capped by an attached breaker so a slow model
+// cannot hold the caller past its budget.
+static long attempt_timeout_ms(const LLMConfig* config) {
+    long timeout = config->timeout_ms;
+    long cap = llm_breaker_attempt_timeout(config->breaker);
+    if (cap > 0 && (timeout <= 0 || timeout > cap)) {
+        timeout = cap;
+    }
+    return timeout;
+}
+// }}}
+
+// {{{ retry_limit
+// With a breaker attached the breaker, not retries, deals with a failing
+// model: a request at most fails over to another pool endpoint.
+static int retry_limit(const LLMConfig* config) {
+    if (config->breaker == NULL) {
+        return config->max_retries;
+    }
+    int failover = llm_breaker_max_retries(config->breaker);
+    return config->max_retries < failover ? config->max_retries : failover;
+}
+// }}}
+
+// {{{ retry_wait
+// Sleeps before a retry, doubling *backoff_ms. A failover under a
+// breaker goes to another endpoint at once.
+static void retry_wait(const LLMConfig* config, int* backoff_ms) {
+    if (config->breaker != NULL) {
+        return;
+    }
+    usleep(*backoff_ms * 1000);
+    *backoff_ms *= 2;
+    if (*backoff_ms > MAX_BACKOFF_MS) {
+        *backoff_ms = MAX_BACKOFF_MS;
+    }
+}
+// }}}
+
+// {{{ route_attempt
+// Returns the URL for one attempt: config->endpoint, or an endpoint
+// acquired from config->endpoints, whose index is stored in *endpoint
+// (-1 without a pool). On entry *endpoint is the endpoint to avoid.
+static char* route_attempt(const LLMConfig* config, int* endpoint) {
+    int avoid = *endpoint;
+    *endpoint = -1;
+    if (config->endpoints == NULL) {
+        return llm_build_url(config);
+    }
+
+    long timeout = attempt_timeout_ms(config);
+    int wait_ms = timeout > 0 ? (int)timeout : DEFAULT_TIMEOUT_MS;
+    *endpoint = llm_endpoint_pool_acquire(config->endpoints, config->affinity,
+                                          avoid, wait_ms);
+    if (*endpoint < 0) {
+        return NULL;
+    }
+
+    LLMConfig routed = *config;
+    routed.endpoint = (char*)llm_endpoint_pool_url(config->endpoints, *endpoint);
+    char* url = llm_build_url(&routed);
+    if (url == NULL) {
+        llm_endpoint_pool_release(config->endpoints, *endpoint, NULL, 0.0);
+        *endpoint = -1;
+    }
+    return url;
+}
+// }}}
+
 // {{{ perform_request
 // Performs a single HTTP request with given JSON body.
-static LLMResponse* perform_request(const LLMConfig* config, const char* json_body) {
-    CURL* curl = curl_easy_init();
+// The handle comes from the shared pool so consecutive requests reuse
+// the endpoint's keep-alive connection. *endpoint is as for
+// route_attempt; the attempt is reported back to the endpoint pool
+// and the breaker.
+static LLMResponse* perform_request(const LLMConfig* config, const char* json_body,
+                                    int* endpoint) {
+    char* url = route_attempt(config, endpoint);
+    if (url == NULL) {
+        return llm_response_create_error(config->endpoints != NULL
+                                         ? "No LLM endpoint available"
+                                         : "Failed to build URL");
+    }
+    CURL* curl = http_pool_acquire(url);
     if (curl == NULL) {
-        LLMResponse* response = malloc(sizeof(LLMResponse));
-        response->text = NULL;
-        response->tokens_used = 0;
-        response->success = false;
-        response->error = strdup_safe("Failed to initialize curl");
-        return response;
+        llm_endpoint_pool_release(config->endpoints, *endpoint, NULL, 0.0);
+        free(url);
+        return llm_response_create_error("Failed to initialize curl");
     }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     WriteBuffer buffer;
     buffer_init(&buffer);
 
-    // Build URL
-    size_t url_len = strlen(config->endpoint) + strlen("/v1/chat/completions") + 1;
-    char* url = malloc(url_len);
-    snprintf(url, url_len, "%s/v1/chat/completions", config->endpoint);
+    struct curl_slist* headers = llm_build_headers(config);
 
     // Set curl options
     curl_easy_setopt(curl, CURLOPT_URL, url);
@@ -251,20 +725,7 @@ static LLMResponse* perform_request(const LLMConfig* config, const char* json_bo
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_body);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)config->timeout_ms);
-
-    // Set headers
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    if (config->api_key != NULL && strlen(config->api_key) > 0) {
-        size_t auth_len = strlen("Authorization: Bearer ") + strlen(config->api_key) + 1;
-        char* auth_header = malloc(auth_len);
-        snprintf(auth_header, auth_len, "Authorization: Bearer %s", config->api_key);
-        headers = curl_slist_append(headers, auth_header);
-        free(auth_header);
-    }
-
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, attempt_timeout_ms(config));
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
     // Perform request
@@ -272,47 +733,19 @@ static LLMResponse* perform_request(const LLMConfig* config, const char* json_bo
 
     LLMResponse* response;
     if (res != CURLE_OK) {
-        response = malloc(sizeof(LLMResponse));
-        response->text = NULL;
-        response->tokens_used = 0;
-        response->success = false;
-        response->error = strdup_safe(curl_easy_strerror(res));
+        response = llm_response_create_error(curl_easy_strerror(res));
     } else {
         long http_code = 0;
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-
-        if (http_code >= 200 && http_code < 300) {
-            response = parse_response_json(buffer.data);
-        } else {
-            response = malloc(sizeof(LLMResponse));
-            response->text = NULL;
-            response->tokens_used = 0;
-            response->success = false;
-
-            // Try to parse error from response body
-            cJSON* error_json = cJSON_Parse(buffer.data);
-            if (error_json != NULL) {
-                cJSON* error = cJSON_GetObjectItem(error_json, "error");
-                if (error != NULL) {
-                    cJSON* message = cJSON_GetObjectItem(error, "message");
-                    if (message != NULL && cJSON_IsString(message)) {
-                        response->error = strdup_safe(message->valuestring);
-                    }
-                }
-                cJSON_Delete(error_json);
-            }
-
-            if (response->error == NULL) {
-                char error_buf[64];
-                snprintf(error_buf, sizeof(error_buf), "HTTP error %ld", http_code);
-                response->error = strdup_safe(error_buf);
-            }
-        }
+        response = llm_response_from_http(http_code, buffer.data);
     }
+    double latency_ms = elapsed_ms(&start);
+    llm_endpoint_pool_release(config->endpoints, *endpoint, response, latency_ms);
+    llm_breaker_record(config->breaker, *endpoint, response, latency_ms);
 
-    // Cleanup
+    // Cleanup (release resets the handle before headers are freed)
+    http_pool_release(curl);
     curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
     buffer_free(&buffer);
     free(url);
 
@@ -325,36 +758,36 @@ LLMResponse* llm_request_messages(const LLMConfig* config,
                                    const LLMMessage* messages,
                                    size_t message_count) {
     if (config == NULL || messages == NULL || message_count == 0) {
-        LLMResponse* response = malloc(sizeof(LLMResponse));
-        response->text = NULL;
-        response->tokens_used = 0;
-        response->success = false;
-        response->error = strdup_safe("Invalid arguments");
-        return response;
+        return llm_response_create_error("Invalid arguments");
+    }
+
+    // An exact repeat of a deterministic request needs no model call
+    LLMMemoKey memo_key;
+    bool memoized = llm_memo_key(config, messages, message_count, &memo_key);
+    if (memoized) {
+        LLMResponse* hit = llm_memo_get(&memo_key);
+        if (hit != NULL) {
+            return hit;
+        }
     }
 
-    char* json_body = build_request_json(config, messages, message_count);
+    if (!llm_breaker_allow(config->breaker)) {
+        return llm_response_create_error("LLM circuit open");
+    }
+
+    char* json_body = llm_build_request_body(config, messages, message_count);
     if (json_body == NULL) {
-        LLMResponse* response = malloc(sizeof(LLMResponse));
-        response->text = NULL;
-        response->tokens_used = 0;
-        response->success = false;
-        response->error = strdup_safe("Failed to build request JSON");
-        return response;
+        return llm_response_create_error("Failed to build request JSON");
     }
 
     LLMResponse* response = NULL;
     int backoff_ms = INITIAL_BACKOFF_MS;
+    int endpoint = -1;
 
     // Retry loop with exponential backoff
-    for (int attempt = 0; attempt <= config->max_retries; attempt++) {
+    for (int attempt = 0; attempt <= retry_limit(config); attempt++) {
         if (attempt > 0) {
-            // Wait before retry
-            usleep(backoff_ms * 1000);
-            backoff_ms *= 2;
-            if (backoff_ms > MAX_BACKOFF_MS) {
-                backoff_ms = MAX_BACKOFF_MS;
-            }
+            retry_wait(config, &backoff_ms);
 
             // Free previous failed response
             if (response != NULL) {
@@ -362,16 +795,168 @@ LLMResponse* llm_request_messages(const LLMConfig* config,
             }
         }
 
-        response = perform_request(config, json_body);
+        // A retry goes to a different endpoint when the pool has one
+        response = perform_request(config, json_body, &endpoint);
 
-        if (response->success) {
+        // No failover once every endpoint's circuit is open
+        if (response == NULL || !llm_response_is_retryable(response) ||
+            llm_breaker_is_open(config->breaker)) {
             break;
         }
+    }
+
+    if (memoized) {
+        llm_memo_put(&memo_key, response);
+    }
+    free(json_body);
+    return response;
+}
+// }}}
+
+// {{{ StreamContext
+// Per-attempt state for a streaming transfer. The first body chunk
+// decides whether the reply is an SSE stream or a plain JSON body
+// (error statuses, or servers that ignore "stream": true).
+typedef struct {
+    CURL* curl;
+    LLMStreamParser* parser;
+    WriteBuffer raw;
+    bool decided;
+    bool is_sse;
+} StreamContext;
+// }}}
+
+// {{{ stream_write_callback
+static size_t stream_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    StreamContext* ctx = (StreamContext*)userp;
 
-        // Don't retry on client errors (4xx)
-        // Only retry on server errors (5xx) or network issues
-        if (response->error != NULL &&
-            (strstr(response->error, "HTTP error 4") != NULL)) {
+    if (!ctx->decided) {
+        long http_code = 0;
+        char* content_type = NULL;
+        curl_easy_getinfo(ctx->curl, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_easy_getinfo(ctx->curl, CURLINFO_CONTENT_TYPE, &content_type);
+        ctx->is_sse = http_code >= 200 && http_code < 300 &&
+                      content_type != NULL &&
+                      strstr(content_type, "text/event-stream") != NULL;
+        ctx->decided = true;
+    }
+
+    if (ctx->is_sse) {
+        return llm_stream_parser_feed(ctx->parser, contents, realsize) ? realsize : 0;
+    }
+    return write_callback(contents, size, nmemb, &ctx->raw);
+}
+// }}}
+
+// {{{ perform_stream_request
+// Performs a single streaming HTTP request, feeding parser as data
+// arrives.
+static LLMResponse* perform_stream_request(const LLMConfig* config,
+                                           const char* json_body,
+                                           LLMStreamParser* parser,
+                                           int* endpoint) {
+    char* url = route_attempt(config, endpoint);
+    if (url == NULL) {
+        return llm_response_create_error(config->endpoints != NULL
+                                         ? "No LLM endpoint available"
+                                         : "Failed to build URL");
+    }
+    CURL* curl = http_pool_acquire(url);
+    if (curl == NULL) {
+        llm_endpoint_pool_release(config->endpoints, *endpoint, NULL, 0.0);
+        free(url);
+        return llm_response_create_error("Failed to initialize curl");
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    StreamContext ctx = { curl, parser, { NULL, 0, 0 }, false, false };
+    buffer_init(&ctx.raw);
+
+    struct curl_slist* headers = llm_build_headers(config);
+    headers = curl_slist_append(headers, "Accept: text/event-stream");
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, stream_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, attempt_timeout_ms(config));
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    CURLcode res = curl_easy_perform(curl);
+
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+    LLMResponse* response;
+    if (res != CURLE_OK) {
+        response = llm_response_create_error(curl_easy_strerror(res));
+    } else if (ctx.is_sse) {
+        response = llm_stream_parser_finish(parser);
+    } else {
+        // Whole body at once; hand it to the caller as a single delta
+        response = llm_response_from_http(http_code, ctx.raw.data);
+        if (response != NULL && response->success && parser->on_delta != NULL) {
+            parser->chunks++;
+            parser->on_delta(response->text, parser->user);
+        }
+    }
+    if (response != NULL) {
+        response->http_status = http_code;
+    }
+    double latency_ms = elapsed_ms(&start);
+    llm_endpoint_pool_release(config->endpoints, *endpoint, response, latency_ms);
+    llm_breaker_record(config->breaker, *endpoint, response, latency_ms);
+
+    http_pool_release(curl);
+    curl_slist_free_all(headers);
+    buffer_free(&ctx.raw);
+    free(url);
+
+    return response;
+}
+// }}}
+
+// {{{ llm_request_stream
+LLMResponse* llm_request_stream(const LLMConfig* config,
+                                 const LLMMessage* messages,
+                                 size_t message_count,
+                                 LLMStreamCallback on_delta,
+                                 void* user) {
+    if (config == NULL || messages == NULL || message_count == 0) {
+        return llm_response_create_error("Invalid arguments");
+    }
+    if (!llm_breaker_allow(config->breaker)) {
+        return llm_response_create_error("LLM circuit open");
+    }
+
+    char* json_body = llm_build_stream_request_body(config, messages, message_count);
+    if (json_body == NULL) {
+        return llm_response_create_error("Failed to build request JSON");
+    }
+
+    LLMResponse* response = NULL;
+    int backoff_ms = INITIAL_BACKOFF_MS;
+    int endpoint = -1;
+
+    for (int attempt = 0; attempt <= retry_limit(config); attempt++) {
+        if (attempt > 0) {
+            retry_wait(config, &backoff_ms);
+            llm_response_free(response);
+        }
+
+        LLMStreamParser parser;
+        llm_stream_parser_init(&parser, on_delta, user);
+        response = perform_stream_request(config, json_body, &parser, &endpoint);
+        int delivered = parser.chunks;
+        llm_stream_parser_free(&parser);
+
+        // Once text has reached the caller a retry would repeat it
+        if (response == NULL || delivered > 0 ||
+            !llm_response_is_retryable(response) ||
+            llm_breaker_is_open(config->breaker)) {
             break;
         }
     }
@@ -386,12 +971,7 @@ LLMResponse* llm_request(const LLMConfig* config,
                           const char* system_prompt,
                           const char* user_prompt) {
     if (config == NULL || user_prompt == NULL) {
-        LLMResponse* response = malloc(sizeof(LLMResponse));
-        response->text = NULL;
-        response->tokens_used = 0;
-        response->success = false;
-        response->error = strdup_safe("Invalid arguments");
-        return response;
+        return llm_response_create_error("Invalid arguments");
     }
 
     // Build messages array
@@ -426,6 +1006,25 @@ void llm_response_free(LLMResponse* response) {
 }
 // }}}
 
+// {{{ llm_response_copy
+LLMResponse* llm_response_copy(const LLMResponse* response) {
+    if (response == NULL) {
+        return NULL;
+    }
+
+    LLMResponse* copy = llm_response_create_error(response->error);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    copy->text = strdup_safe(response->text);
+    copy->tokens_used = response->tokens_used;
+    copy->success = response->success;
+    copy->http_status = response->http_status;
+    return copy;
+}
+// }}}
+
 // {{{ llm_message_create
 LLMMessage* llm_message_create(const char* role, const char* content) {
     LLMMessage* message = malloc(sizeof(LLMMessage));
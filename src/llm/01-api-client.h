@@ -3,7 +3,14 @@
  *
  * HTTP client for LLM API calls (OpenAI-compatible endpoints).
  * Sends JSON requests with prompts and parses responses.
- * Supports retry logic with exponential backoff.
+ * Supports retry logic with exponential backoff and SSE streaming with
+ * per-delta callbacks. Requests go through the shared connection pool
+ * (net/09-http-pool) to reuse keep-alive connections.
+ *
+ * Local servers such as llama.cpp keep the KV cache of a slot's last
+ * prompt and only evaluate what follows the shared prefix. With
+ * cache_prompt set, requests ask for that reuse and may pin a session
+ * to one slot so its prompts keep landing on their own cache.
  */
 
 #ifndef LLM_API_CLIENT_H
@@ -12,6 +19,10 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+struct curl_slist;
+struct LLMEndpointPool;
+struct LLMBreaker;
+
 // {{{ LLMConfig
 typedef struct {
     char* endpoint;      // Base URL (e.g., "http://localhost:5000")
@@ -19,6 +30,15 @@ typedef struct {
     char* model;         // Model name (e.g., "llama3", "gpt-4")
     int timeout_ms;      // Request timeout in milliseconds
     int max_retries;     // Max retry attempts on failure
+    bool cache_prompt;   // Send "cache_prompt" (and "id_slot" if slot_id >= 0)
+    int slot_id;         // Server slot for this session; -1 = server picks
+    struct LLMEndpointPool* endpoints; // Routes each attempt instead of
+                                       // endpoint (see 19-endpoint-pool); borrowed
+    unsigned long affinity;            // Session routing key; 0 = none
+    struct LLMBreaker* breaker;        // Fails fast while the model is unwell
+                                       // (see 20-circuit-breaker); borrowed
+    float temperature;   // Sampling temperature; < 0 = server default (not sent)
+    bool memoize_sampled; // Memoize replies even when sampled (see 21-response-memo)
 } LLMConfig;
 // }}}
 
@@ -28,6 +48,7 @@ typedef struct {
     int tokens_used;     // Total tokens consumed
     bool success;        // True if request succeeded
     char* error;         // Error message if failed
+    long http_status;    // HTTP status code (0 if no response received)
 } LLMResponse;
 // }}}
 
@@ -38,6 +59,32 @@ typedef struct {
 } LLMMessage;
 // }}}
 
+// {{{ LLMStreamCallback
+// Receives each piece of generated text as it arrives during a
+// streaming request. delta is only valid for the duration of the call.
+typedef void (*LLMStreamCallback)(const char* delta, void* user);
+// }}}
+
+// {{{ LLMStreamParser
+// Incremental parser for server-sent event (SSE) chat completion
+// streams. Splits arbitrary network chunks into "data:" lines, passes
+// each content delta to on_delta, and accumulates the full text.
+typedef struct {
+    char* line;              // Partial line carried between chunks
+    size_t line_len;
+    size_t line_cap;
+    char* text;              // Concatenation of all deltas so far
+    size_t text_len;
+    size_t text_cap;
+    int chunks;              // Number of non-empty deltas delivered
+    int tokens_used;         // From a usage block, if the server sends one
+    bool done;               // "data: [DONE]" received
+    char* error;             // Error reported inside the stream, if any
+    LLMStreamCallback on_delta;
+    void* user;
+} LLMStreamParser;
+// }}}
+
 // {{{ llm_config_create
 // Creates an LLMConfig with default values.
 LLMConfig* llm_config_create(void);
@@ -48,6 +95,24 @@ LLMConfig* llm_config_create(void);
 void llm_config_free(LLMConfig* config);
 // }}}
 
+// {{{ llm_config_set_session
+// Enables prompt caching and pins session_id to one of slot_count
+// server slots. The same session always maps to the same slot, and,
+// with an endpoint pool, preferably to the same server (affinity).
+// slot_count <= 0 or a NULL session_id leaves slot choice to the server.
+void llm_config_set_session(LLMConfig* config, const char* session_id,
+                            int slot_count);
+// }}}
+
+// {{{ llm_config_for_session
+// Returns a copy of base for one game session, set up with
+// llm_config_set_session(session_id, slot_count); slot_count is the
+// server config's llm_cache_slots. The pool and breaker stay borrowed.
+// Free with llm_config_free. Returns NULL on allocation failure.
+LLMConfig* llm_config_for_session(const LLMConfig* base, const char* session_id,
+                                  int slot_count);
+// }}}
+
 // {{{ llm_init
 // Initializes the LLM client. Call once at startup.
 // Returns true on success, false on failure.
@@ -55,7 +120,8 @@ bool llm_init(void);
 // }}}
 
 // {{{ llm_cleanup
-// Cleans up the LLM client. Call once at shutdown.
+// Cleans up the LLM client. Call once at shutdown. Pooled connections
+// are only closed once no other client holds the pool (http_pool_shutdown).
 void llm_cleanup(void);
 // }}}
 
@@ -68,18 +134,111 @@ LLMResponse* llm_request(const LLMConfig* config,
 // }}}
 
 // {{{ llm_request_messages
-// Sends a request with an array of messages.
+// Sends a request with an array of messages. Once llm_memo_init has
+// run, a deterministic request repeated exactly is answered from the
+// response memo without contacting the server.
 // Caller must free the response with llm_response_free.
 LLMResponse* llm_request_messages(const LLMConfig* config,
                                    const LLMMessage* messages,
                                    size_t message_count);
 // }}}
 
+// {{{ llm_request_stream
+// Sends a streaming request ("stream": true) and invokes on_delta for
+// each piece of text as it arrives, on the calling thread. Returns the
+// complete response once the stream ends. Attempts are only retried
+// while no text has been delivered, so on_delta never sees duplicates.
+// Caller must free the response with llm_response_free.
+LLMResponse* llm_request_stream(const LLMConfig* config,
+                                 const LLMMessage* messages,
+                                 size_t message_count,
+                                 LLMStreamCallback on_delta,
+                                 void* user);
+// }}}
+
 // {{{ llm_response_free
 // Frees all memory associated with response.
 void llm_response_free(LLMResponse* response);
 // }}}
 
+// {{{ llm_response_copy
+// Returns a deep copy of response, or NULL on allocation failure.
+// Caller must free with llm_response_free.
+LLMResponse* llm_response_copy(const LLMResponse* response);
+// }}}
+
+// {{{ llm_response_create_error
+// Creates a failed response carrying the given error message.
+// Caller must free with llm_response_free.
+LLMResponse* llm_response_create_error(const char* error);
+// }}}
+
+// {{{ llm_response_from_http
+// Builds a response from a completed HTTP exchange.
+// Parses the body on 2xx, otherwise extracts the API error message.
+// Caller must free with llm_response_free.
+LLMResponse* llm_response_from_http(long http_status, const char* body);
+// }}}
+
+// {{{ llm_response_is_retryable
+// Returns true if a failed response is worth retrying.
+// Client errors (4xx) are not retried; server and network errors are.
+bool llm_response_is_retryable(const LLMResponse* response);
+// }}}
+
+// {{{ llm_build_request_body
+// Builds the JSON chat completion request body.
+// Caller must free the returned string.
+char* llm_build_request_body(const LLMConfig* config,
+                              const LLMMessage* messages,
+                              size_t message_count);
+// }}}
+
+// {{{ llm_build_stream_request_body
+// Builds the request body with "stream": true set.
+// Caller must free the returned string.
+char* llm_build_stream_request_body(const LLMConfig* config,
+                                     const LLMMessage* messages,
+                                     size_t message_count);
+// }}}
+
+// {{{ llm_stream_parser_init
+// Prepares parser to deliver deltas to on_delta (which may be NULL).
+void llm_stream_parser_init(LLMStreamParser* parser,
+                            LLMStreamCallback on_delta, void* user);
+// }}}
+
+// {{{ llm_stream_parser_feed
+// Consumes len bytes of stream data. Returns false on allocation
+// failure. Data after [DONE] is ignored.
+bool llm_stream_parser_feed(LLMStreamParser* parser,
+                            const char* data, size_t len);
+// }}}
+
+// {{{ llm_stream_parser_finish
+// Builds the final response from everything parsed so far. The stream
+// is successful if it produced text and reported no error.
+// Caller must free with llm_response_free.
+LLMResponse* llm_stream_parser_finish(LLMStreamParser* parser);
+// }}}
+
+// {{{ llm_stream_parser_free
+// Releases the parser's buffers (the parser itself is caller-owned).
+void llm_stream_parser_free(LLMStreamParser* parser);
+// }}}
+
+// {{{ llm_build_url
+// Builds the chat completions URL for the configured endpoint.
+// Caller must free the returned string.
+char* llm_build_url(const LLMConfig* config);
+// }}}
+
+// {{{ llm_build_headers
+// Builds the HTTP header list (content type and optional bearer token).
+// Returns a struct curl_slist*; caller frees with curl_slist_free_all.
+struct curl_slist* llm_build_headers(const LLMConfig* config);
+// }}}
+
 // {{{ llm_message_create
 // Creates a message with the given role and content.
 // Caller must free with llm_message_free.
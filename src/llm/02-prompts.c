@@ -7,10 +7,14 @@
  */
 
 #include "02-prompts.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Most variables any built-in template uses
+#define PROMPT_MAX_VARS 16
+
 // {{{ System Prompt
 // Sets the narrative tone for all LLM responses.
 static const char* SYSTEM_PROMPT =
@@ -290,78 +294,249 @@ bool prompt_validate_vars(PromptType type, const PromptVars* vars,
 }
 // }}}
 
-// {{{ replace_var
-// Helper to replace a single {var} placeholder with its value.
-static char* replace_var(const char* text, const char* name, const char* value) {
-    // Build placeholder string: {name}
-    size_t placeholder_len = strlen(name) + 2;
-    char* placeholder = malloc(placeholder_len + 1);
-    snprintf(placeholder, placeholder_len + 1, "{%s}", name);
-
-    // Find placeholder in text
-    const char* pos = strstr(text, placeholder);
-    if (pos == NULL) {
-        free(placeholder);
-        return strdup(text);
-    }
-
-    // Calculate new string size
-    size_t text_len = strlen(text);
-    size_t value_len = strlen(value);
-    size_t new_len = text_len - placeholder_len + value_len;
-
-    char* result = malloc(new_len + 1);
-    if (result == NULL) {
-        free(placeholder);
+// {{{ prompt_buffer_init
+void prompt_buffer_init(PromptBuffer* buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+// }}}
+
+// {{{ prompt_buffer_free
+void prompt_buffer_free(PromptBuffer* buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    free(buffer->data);
+    prompt_buffer_init(buffer);
+}
+// }}}
+
+// {{{ add_segment
+// Appends a segment, merging adjacent literals.
+static bool add_segment(CompiledPrompt* compiled, int* capacity,
+                        const char* text, size_t length, int var) {
+    if (var < 0) {
+        if (length == 0) {
+            return true;
+        }
+        compiled->literal_length += length;
+        if (compiled->segment_count > 0) {
+            PromptSegment* last = &compiled->segments[compiled->segment_count - 1];
+            if (last->var < 0 && last->text + last->length == text) {
+                last->length += length;
+                return true;
+            }
+        }
+    }
+
+    if (compiled->segment_count >= *capacity) {
+        int new_capacity = *capacity * 2;
+        PromptSegment* grown = realloc(compiled->segments,
+                                       sizeof(PromptSegment) * new_capacity);
+        if (grown == NULL) {
+            return false;
+        }
+        compiled->segments = grown;
+        *capacity = new_capacity;
+    }
+
+    PromptSegment* segment = &compiled->segments[compiled->segment_count++];
+    segment->text = text;
+    segment->length = length;
+    segment->var = var;
+    return true;
+}
+// }}}
+
+// {{{ find_var_index
+static int find_var_index(const char** var_names, int var_count,
+                          const char* name, size_t length) {
+    for (int i = 0; i < var_count; i++) {
+        if (strncmp(var_names[i], name, length) == 0 && var_names[i][length] == '\0') {
+            return i;
+        }
+    }
+    return -1;
+}
+// }}}
+
+// {{{ prompt_compile
+CompiledPrompt* prompt_compile(const char* template_text,
+                               const char** var_names, int var_count) {
+    if (template_text == NULL || var_count < 0 ||
+        (var_count > 0 && var_names == NULL)) {
+        return NULL;
+    }
+
+    CompiledPrompt* compiled = calloc(1, sizeof(CompiledPrompt));
+    if (compiled == NULL) {
         return NULL;
     }
 
-    // Copy parts: before placeholder, value, after placeholder
-    size_t before_len = pos - text;
-    memcpy(result, text, before_len);
-    memcpy(result + before_len, value, value_len);
-    strcpy(result + before_len + value_len, pos + placeholder_len);
+    int capacity = 8;
+    compiled->template_text = strdup(template_text);
+    compiled->segments = malloc(sizeof(PromptSegment) * capacity);
+    compiled->var_names = var_names;
+    compiled->var_count = var_count;
+    if (compiled->template_text == NULL || compiled->segments == NULL) {
+        prompt_compiled_free(compiled);
+        return NULL;
+    }
+
+    const char* literal = compiled->template_text;
+    const char* cursor = literal;
+    while ((cursor = strchr(cursor, '{')) != NULL) {
+        const char* close = strchr(cursor + 1, '}');
+        if (close == NULL) {
+            break;
+        }
+
+        int var = find_var_index(var_names, var_count, cursor + 1,
+                                 (size_t)(close - cursor - 1));
+        if (var < 0) {
+            cursor++;  // Not a slot; the brace stays literal
+            continue;
+        }
+
+        if (!add_segment(compiled, &capacity, literal, (size_t)(cursor - literal), -1) ||
+            !add_segment(compiled, &capacity, NULL, 0, var)) {
+            prompt_compiled_free(compiled);
+            return NULL;
+        }
+        literal = close + 1;
+        cursor = literal;
+    }
+
+    if (!add_segment(compiled, &capacity, literal, strlen(literal), -1)) {
+        prompt_compiled_free(compiled);
+        return NULL;
+    }
 
-    free(placeholder);
+    return compiled;
+}
+// }}}
 
-    // Recursively replace if there are more occurrences
-    char* temp = replace_var(result, name, value);
-    free(result);
-    return temp;
+// {{{ prompt_compiled_free
+void prompt_compiled_free(CompiledPrompt* compiled) {
+    if (compiled == NULL) {
+        return;
+    }
+    free(compiled->template_text);
+    free(compiled->segments);
+    free(compiled);
 }
 // }}}
 
-// {{{ prompt_build
-char* prompt_build(PromptType type, const PromptVars* vars) {
-    const PromptTemplate* tmpl = prompt_get_template(type);
-    if (tmpl == NULL || vars == NULL) {
+// {{{ prompt_get_compiled
+static CompiledPrompt* compiled_templates[PROMPT_COUNT];
+static pthread_once_t compiled_once = PTHREAD_ONCE_INIT;
+
+static void compile_templates(void) {
+    for (int i = 0; i < PROMPT_COUNT; i++) {
+        compiled_templates[i] = prompt_compile(TEMPLATES[i].template_text,
+                                               TEMPLATES[i].required_vars,
+                                               TEMPLATES[i].var_count);
+    }
+}
+
+const CompiledPrompt* prompt_get_compiled(PromptType type) {
+    if (type < 0 || type >= PROMPT_COUNT) {
         return NULL;
     }
+    pthread_once(&compiled_once, compile_templates);
+    return compiled_templates[type];
+}
+// }}}
 
-    // Validate all required vars are present
-    const char* missing = NULL;
-    if (!prompt_validate_vars(type, vars, &missing)) {
+// {{{ prompt_render
+const char* prompt_render(const CompiledPrompt* compiled, const char** values,
+                          PromptBuffer* buffer) {
+    if (compiled == NULL || buffer == NULL ||
+        (compiled->var_count > 0 && values == NULL)) {
         return NULL;
     }
 
-    // Start with the template
-    char* result = strdup(tmpl->template_text);
-    if (result == NULL) {
+    // Size the output once so the copy pass never reallocates
+    size_t length = compiled->literal_length;
+    for (int i = 0; i < compiled->segment_count; i++) {
+        int var = compiled->segments[i].var;
+        if (var >= 0) {
+            if (values[var] == NULL) {
+                return NULL;
+            }
+            length += strlen(values[var]);
+        }
+    }
+
+    if (length + 1 > buffer->capacity) {
+        size_t new_capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+        while (new_capacity < length + 1) {
+            new_capacity *= 2;
+        }
+        char* grown = realloc(buffer->data, new_capacity);
+        if (grown == NULL) {
+            return NULL;
+        }
+        buffer->data = grown;
+        buffer->capacity = new_capacity;
+    }
+
+    char* out = buffer->data;
+    for (int i = 0; i < compiled->segment_count; i++) {
+        const PromptSegment* segment = &compiled->segments[i];
+        if (segment->var < 0) {
+            memcpy(out, segment->text, segment->length);
+            out += segment->length;
+        } else {
+            size_t value_len = strlen(values[segment->var]);
+            memcpy(out, values[segment->var], value_len);
+            out += value_len;
+        }
+    }
+    *out = '\0';
+    buffer->length = length;
+
+    return buffer->data;
+}
+// }}}
+
+// {{{ prompt_build_into
+const char* prompt_build_into(PromptType type, const PromptVars* vars,
+                              PromptBuffer* buffer) {
+    const CompiledPrompt* compiled = prompt_get_compiled(type);
+    if (compiled == NULL || vars == NULL || compiled->var_count > PROMPT_MAX_VARS) {
         return NULL;
     }
 
-    // Replace each variable
-    for (int i = 0; i < tmpl->var_count; i++) {
-        const char* value = prompt_vars_get(vars, tmpl->required_vars[i]);
-        char* temp = replace_var(result, tmpl->required_vars[i], value);
-        free(result);
-        result = temp;
-        if (result == NULL) {
+    // One lookup per variable, however often it appears
+    const char* values[PROMPT_MAX_VARS];
+    for (int i = 0; i < compiled->var_count; i++) {
+        values[i] = prompt_vars_get(vars, compiled->var_names[i]);
+        if (values[i] == NULL) {
             return NULL;
         }
     }
 
-    return result;
+    return prompt_render(compiled, values, buffer);
+}
+// }}}
+
+// {{{ prompt_build
+char* prompt_build(PromptType type, const PromptVars* vars) {
+    PromptBuffer buffer;
+    prompt_buffer_init(&buffer);
+
+    if (prompt_build_into(type, vars, &buffer) == NULL) {
+        prompt_buffer_free(&buffer);
+        return NULL;
+    }
+
+    // Hand the buffer's memory to the caller
+    return buffer.data;
 }
 // }}}
 
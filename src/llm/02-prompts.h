@@ -59,6 +59,37 @@ typedef struct {
 } PromptChain;
 // }}}
 
+// {{{ PromptSegment
+// One piece of a compiled template: literal text or a variable slot.
+typedef struct {
+    const char* text;           // Literal text (points into the template copy)
+    size_t length;              // Literal length
+    int var;                    // Variable index, or -1 for literal text
+} PromptSegment;
+// }}}
+
+// {{{ CompiledPrompt
+// A template parsed once into segments, with each {var} resolved to
+// an index into var_names so rendering never searches the text.
+typedef struct {
+    char* template_text;        // Owned copy the literal segments point into
+    PromptSegment* segments;
+    int segment_count;
+    const char** var_names;     // Slot names, not owned
+    int var_count;
+    size_t literal_length;      // Total length of the literal segments
+} CompiledPrompt;
+// }}}
+
+// {{{ PromptBuffer
+// Output buffer reused across renders; grows as needed.
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} PromptBuffer;
+// }}}
+
 // {{{ prompt_vars_create
 // Creates a new empty PromptVars container.
 PromptVars* prompt_vars_create(void);
@@ -94,6 +125,51 @@ const PromptTemplate* prompt_get_template(PromptType type);
 char* prompt_build(PromptType type, const PromptVars* vars);
 // }}}
 
+// {{{ prompt_build_into
+// Like prompt_build but renders into buffer, reusing its memory.
+// Returns buffer->data (owned by the buffer), or NULL on error.
+const char* prompt_build_into(PromptType type, const PromptVars* vars,
+                              PromptBuffer* buffer);
+// }}}
+
+// {{{ prompt_compile
+// Parses template_text into literal and slot segments. Placeholders
+// naming one of var_names become slots; any other braces stay literal.
+// var_names must outlive the compiled prompt.
+// Caller must free with prompt_compiled_free. Returns NULL on error.
+CompiledPrompt* prompt_compile(const char* template_text,
+                               const char** var_names, int var_count);
+// }}}
+
+// {{{ prompt_compiled_free
+void prompt_compiled_free(CompiledPrompt* compiled);
+// }}}
+
+// {{{ prompt_get_compiled
+// Returns the compiled form of a built-in template, compiled on first
+// use and kept for the life of the process. NULL for invalid types.
+const CompiledPrompt* prompt_get_compiled(PromptType type);
+// }}}
+
+// {{{ prompt_render
+// Renders compiled in one pass, sized up front, into buffer.
+// values[i] is the value for var_names[i]. Values are copied verbatim:
+// placeholders inside a value are not expanded.
+// Returns buffer->data, or NULL if a value is NULL or on allocation
+// failure.
+const char* prompt_render(const CompiledPrompt* compiled, const char** values,
+                          PromptBuffer* buffer);
+// }}}
+
+// {{{ prompt_buffer_init
+void prompt_buffer_init(PromptBuffer* buffer);
+// }}}
+
+// {{{ prompt_buffer_free
+// Frees the buffer's memory (the buffer itself is caller-owned).
+void prompt_buffer_free(PromptBuffer* buffer);
+// }}}
+
 // {{{ prompt_validate_vars
 // Checks if all required variables are present.
 // Returns true if valid, false if missing vars.
@@ -3,7 +3,9 @@
  *
  * Tracks game narrative context for LLM prompt generation.
  * Updates automatically based on game events to maintain
- * coherent narrative across the session.
+ * coherent narrative across the session. Changes are detected by
+ * comparing a few scalars with their last seen values or reported by the
+ * event listeners; nothing here walks the players' cards.
  */
 
 #include "03-world-state.h"
@@ -24,9 +26,19 @@ static const char* FACTION_NAMES[FACTION_COUNT] = {
 // }}}
 
 // {{{ Initial Descriptions
-static const char* INITIAL_BATTLEFIELD =
+// Battlefield by tension band, calm first; the game opens on the first
+static const char* BATTLEFIELD_TIERS[] = {
     "The contested realm of Symbeline stretches before two rival commanders, "
-    "each seeking dominion over these mystical lands.";
+    "each seeking dominion over these mystical lands.",
+    "The battle lines are drawn as both forces marshal their strength. "
+    "Skirmishes break out as commanders test each other's defenses.",
+    "Signs of battle mark the contested ground. "
+    "Neither commander has yet secured the upper hand, "
+    "but the struggle intensifies with each turn.",
+    "The battlefield is scarred from prolonged conflict. "
+    "The air crackles with tension as both sides prepare for "
+    "what may be the decisive clash."
+};
 
 static const char* INITIAL_FORCES =
     "A small band of scouts and vipers, awaiting orders.";
@@ -41,6 +53,24 @@ static char* strdup_safe(const char* str) {
 }
 // }}}
 
+// {{{ bases_in_play
+static int bases_in_play(const Player* player) {
+    if (player == NULL || player->deck == NULL) {
+        return 0;
+    }
+    return player->deck->frontier_base_count + player->deck->interior_base_count;
+}
+// }}}
+
+// {{{ cards_in_hand
+static int cards_in_hand(const Player* player) {
+    if (player == NULL || player->deck == NULL) {
+        return 0;
+    }
+    return player->deck->hand_count;
+}
+// }}}
+
 // {{{ game_event_create
 static GameEvent* game_event_create(const char* event_type,
                                      const char* description,
@@ -78,7 +108,7 @@ WorldState* world_state_create(void) {
         return NULL;
     }
 
-    state->battlefield_description = strdup_safe(INITIAL_BATTLEFIELD);
+    state->battlefield_description = strdup_safe(BATTLEFIELD_TIERS[0]);
     state->turn_number = 0;
     state->last_update_turn = 0;
     state->dominant_faction = FACTION_NEUTRAL;
@@ -86,6 +116,13 @@ WorldState* world_state_create(void) {
     state->event_cursor = 0;
     state->tension = 0.0f;
 
+    state->dirty = WORLD_DIRTY_ALL;
+    state->phase = PHASE_NOT_STARTED;
+    state->battlefield_tier = 0;
+    state->session_context = NULL;
+    state->session_game = NULL;
+    state->turn_context = NULL;
+
     // Initialize faction counts
     for (int i = 0; i < FACTION_COUNT; i++) {
         state->faction_card_counts[i] = 0;
@@ -94,6 +131,10 @@ WorldState* world_state_create(void) {
     // Initialize player forces
     for (int i = 0; i < MAX_PLAYERS; i++) {
         state->player_forces[i] = NULL;
+        state->forces_prompt[i] = NULL;
+        state->authority[i] = 0;
+        state->base_count[i] = 0;
+        state->hand_count[i] = 0;
     }
 
     // Initialize event array
@@ -112,9 +153,12 @@ void world_state_free(WorldState* state) {
     }
 
     free(state->battlefield_description);
+    free(state->session_context);
+    free(state->turn_context);
 
     for (int i = 0; i < MAX_PLAYERS; i++) {
         free(state->player_forces[i]);
+        free(state->forces_prompt[i]);
     }
 
     for (int i = 0; i < WORLD_STATE_MAX_EVENTS; i++) {
@@ -146,6 +190,17 @@ void world_state_init_from_game(WorldState* state, Game* game) {
     }
 
     state->tension = 0.0f;
+
+    // Start the change tracking from this game
+    state->phase = game->phase;
+    for (int i = 0; i < game->player_count && i < MAX_PLAYERS; i++) {
+        if (game->players[i] != NULL) {
+            state->authority[i] = game->players[i]->authority;
+        }
+        state->base_count[i] = bases_in_play(game->players[i]);
+        state->hand_count[i] = cards_in_hand(game->players[i]);
+    }
+    state->dirty = WORLD_DIRTY_ALL;
 }
 // }}}
 
@@ -191,51 +246,225 @@ float world_state_calculate_tension(WorldState* state, Game* game) {
 }
 // }}}
 
+// {{{ world_state_refresh
+// A few comparisons per player, cheap enough to run before every build.
+void world_state_refresh(WorldState* state, Game* game) {
+    if (state == NULL || game == NULL) {
+        return;
+    }
+
+    if (game->turn_number != state->turn_number) {
+        // A new turn means new hands as well
+        state->dirty |= WORLD_DIRTY_TENSION | WORLD_DIRTY_TURN |
+                        WORLD_DIRTY_ALL_FORCES;
+        state->turn_number = game->turn_number;
+    }
+
+    if (game->phase != state->phase) {
+        state->dirty |= WORLD_DIRTY_TURN;
+        state->phase = game->phase;
+    }
+
+    for (int i = 0; i < game->player_count && i < MAX_PLAYERS; i++) {
+        Player* player = game->players[i];
+        if (player != NULL && player->authority != state->authority[i]) {
+            state->dirty |= WORLD_DIRTY_TENSION | WORLD_DIRTY_TURN;
+            state->authority[i] = player->authority;
+        }
+
+        // Catches bases destroyed or scrapped, which no listener reports
+        int bases = bases_in_play(player);
+        if (bases != state->base_count[i]) {
+            state->dirty |= WORLD_DIRTY_FORCES(i);
+            state->base_count[i] = bases;
+        }
+
+        // Likewise discards and cards scrapped from hand
+        int hand = cards_in_hand(player);
+        if (hand != state->hand_count[i]) {
+            state->dirty |= WORLD_DIRTY_FORCES(i);
+            state->hand_count[i] = hand;
+        }
+    }
+}
+// }}}
+
+// {{{ battlefield_tier
+static int battlefield_tier(float tension) {
+    if (tension > 0.8f) return 3;
+    if (tension > 0.5f) return 2;
+    if (tension > 0.2f) return 1;
+    return 0;
+}
+// }}}
+
+// {{{ apply_tension
+// Recomputes tension and replaces the battlefield description only when
+// tension crossed into another band.
+static void apply_tension(WorldState* state, Game* game) {
+    world_state_calculate_tension(state, game);
+    state->dirty &= ~WORLD_DIRTY_TENSION;
+
+    int tier = battlefield_tier(state->tension);
+    if (tier == state->battlefield_tier && state->battlefield_description != NULL) {
+        return;
+    }
+
+    char* description = strdup_safe(BATTLEFIELD_TIERS[tier]);
+    if (description == NULL) {
+        return;
+    }
+    free(state->battlefield_description);
+    state->battlefield_description = description;
+    state->battlefield_tier = tier;
+    state->dirty |= WORLD_DIRTY_TURN;
+}
+// }}}
+
 // {{{ world_state_update
 void world_state_update(WorldState* state, Game* game) {
     if (state == NULL || game == NULL) {
         return;
     }
 
-    state->turn_number = game->turn_number;
+    world_state_refresh(state, game);
 
-    // Update tension
-    world_state_calculate_tension(state, game);
+    if (state->dirty & WORLD_DIRTY_TENSION) {
+        apply_tension(state, game);
+    }
 
     // Update dominant faction based on cards played
-    int max_count = 0;
-    Faction dominant = FACTION_NEUTRAL;
-    for (int i = 1; i < FACTION_COUNT; i++) {  // Skip neutral
-        if (state->faction_card_counts[i] > max_count) {
-            max_count = state->faction_card_counts[i];
-            dominant = (Faction)i;
+    if (state->dirty & WORLD_DIRTY_FACTIONS) {
+        int max_count = 0;
+        Faction dominant = FACTION_NEUTRAL;
+        for (int i = 1; i < FACTION_COUNT; i++) {  // Skip neutral
+            if (state->faction_card_counts[i] > max_count) {
+                max_count = state->faction_card_counts[i];
+                dominant = (Faction)i;
+            }
         }
+        state->dominant_faction = dominant;
+        state->dirty &= ~WORLD_DIRTY_FACTIONS;
     }
-    state->dominant_faction = dominant;
 
-    // Update battlefield description based on tension
-    free(state->battlefield_description);
-    if (state->tension > 0.8f) {
-        state->battlefield_description = strdup_safe(
-            "The battlefield is scarred from prolonged conflict. "
-            "The air crackles with tension as both sides prepare for "
-            "what may be the decisive clash.");
-    } else if (state->tension > 0.5f) {
-        state->battlefield_description = strdup_safe(
-            "Signs of battle mark the contested ground. "
-            "Neither commander has yet secured the upper hand, "
-            "but the struggle intensifies with each turn.");
-    } else if (state->tension > 0.2f) {
-        state->battlefield_description = strdup_safe(
-            "The battle lines are drawn as both forces marshal their strength. "
-            "Skirmishes break out as commanders test each other's defenses.");
-    } else {
-        state->battlefield_description = strdup_safe(
-            "The contested realm of Symbeline stretches before two rival commanders, "
-            "each seeking dominion over these mystical lands.");
+    state->last_update_turn = game->turn_number;
+}
+// }}}
+
+// {{{ world_state_mark_dirty
+void world_state_mark_dirty(WorldState* state, unsigned int flags) {
+    if (state == NULL) {
+        return;
     }
+    state->dirty |= flags;
+}
+// }}}
 
-    state->last_update_turn = game->turn_number;
+// {{{ world_state_note_card_played
+void world_state_note_card_played(WorldState* state, int player_index,
+                                  CardInstance* card) {
+    if (state == NULL || card == NULL || card->type == NULL) {
+        return;
+    }
+
+    Faction faction = card->type->faction;
+    if (faction >= 0 && faction < FACTION_COUNT) {
+        state->faction_card_counts[faction]++;
+        state->dirty |= WORLD_DIRTY_FACTIONS;
+    }
+    if (player_index >= 0 && player_index < MAX_PLAYERS) {
+        state->dirty |= WORLD_DIRTY_FORCES(player_index);
+    }
+}
+// }}}
+
+// {{{ world_state_note_base
+void world_state_note_base(WorldState* state, int player_index,
+                           CardInstance* base, bool added) {
+    if (state == NULL || base == NULL) {
+        return;
+    }
+    if (player_index >= 0 && player_index < MAX_PLAYERS) {
+        // Keep the count world_state_refresh compares with, so the change is
+        // not seen twice
+        int count = state->base_count[player_index] + (added ? 1 : -1);
+        state->base_count[player_index] = count > 0 ? count : 0;
+        state->dirty |= WORLD_DIRTY_FORCES(player_index);
+    }
+}
+// }}}
+
+// {{{ world_state_note_authority
+void world_state_note_authority(WorldState* state, Game* game) {
+    if (state == NULL || game == NULL) {
+        return;
+    }
+
+    world_state_refresh(state, game);
+    if (state->dirty & WORLD_DIRTY_TENSION) {
+        apply_tension(state, game);
+    }
+}
+// }}}
+
+// {{{ player_index
+static int player_index(Game* game, Player* player) {
+    for (int i = 0; player != NULL && i < game->player_count && i < MAX_PLAYERS; i++) {
+        if (game->players[i] == player) {
+            return i;
+        }
+    }
+    return -1;
+}
+// }}}
+
+// {{{ world_state_effect_listener
+void world_state_effect_listener(Game* game, Player* player,
+                                 CardInstance* source, Effect* effect,
+                                 void* context) {
+    WorldState* state = context;
+    if (state == NULL || game == NULL || effect == NULL) {
+        return;
+    }
+
+    int index = player_index(game, player);
+
+    // A card's first primary effect fires once, as it enters play
+    CardType* type = source != NULL ? source->type : NULL;
+    if (type != NULL && type->effect_count > 0 && effect == &type->effects[0]) {
+        world_state_note_card_played(state, index, source);
+        if (type->kind == CARD_KIND_BASE) {
+            world_state_note_base(state, index, source, true);
+        }
+    }
+
+    switch (effect->type) {
+        case EFFECT_AUTHORITY:
+            world_state_note_authority(state, game);
+            break;
+        case EFFECT_DRAW:
+            if (index >= 0) {
+                state->dirty |= WORLD_DIRTY_FORCES(index);
+            }
+            break;
+        default:
+            break;
+    }
+}
+// }}}
+
+// {{{ world_state_autodraw_listener
+void world_state_autodraw_listener(Game* game, Player* player,
+                                   AutoDrawEvent* event, void* context) {
+    WorldState* state = context;
+    if (state == NULL || game == NULL || event == NULL) {
+        return;
+    }
+
+    int index = player_index(game, player);
+    if (event->type == AUTODRAW_EVENT_CARD && index >= 0) {
+        state->dirty |= WORLD_DIRTY_FORCES(index);
+    }
 }
 // }}}
 
@@ -259,6 +488,8 @@ void world_state_record_event(WorldState* state, const char* event_type,
     if (state->event_count < WORLD_STATE_MAX_EVENTS) {
         state->event_count++;
     }
+
+    state->dirty |= WORLD_DIRTY_TURN;
 }
 // }}}
 
@@ -342,12 +573,78 @@ void world_state_to_prompt_vars(WorldState* state, Game* game, PromptVars* vars)
 }
 // }}}
 
-// {{{ world_state_build_context
-char* world_state_build_context(WorldState* state, Game* game) {
+// {{{ world_state_build_session_context
+char* world_state_build_session_context(Game* game) {
+    if (game == NULL) {
+        return NULL;
+    }
+
+    const char* names[2] = { "Player 1", "Player 2" };
+    for (int i = 0; i < 2 && i < game->player_count; i++) {
+        if (game->players[i] != NULL && game->players[i]->name != NULL) {
+            names[i] = game->players[i]->name;
+        }
+    }
+
+    // Size the catalog: each card appears once, plus one line per faction
+    size_t total = strlen(names[0]) + strlen(names[1]) + 512;
+    for (int f = 0; f < FACTION_COUNT; f++) {
+        total += strlen(FACTION_NAMES[f]) + 8;
+    }
+    for (int i = 0; i < game->card_type_count; i++) {
+        CardType* type = game->card_types[i];
+        if (type != NULL && type->name != NULL) {
+            total += strlen(type->name) + 2;
+        }
+    }
+
+    char* context = malloc(total);
+    if (context == NULL) {
+        return NULL;
+    }
+
+    int len = snprintf(context, total,
+                       "The battle for Symbeline. %s and %s contend for the realm.\n"
+                       "Factions:",
+                       names[0], names[1]);
+    for (int f = 0; f < FACTION_COUNT; f++) {
+        len += snprintf(context + len, total - len, "%s %s",
+                        f == 0 ? "" : ",", FACTION_NAMES[f]);
+    }
+
+    // Card catalog, grouped by faction in database order
+    for (int f = 0; f < FACTION_COUNT; f++) {
+        bool first = true;
+        for (int i = 0; i < game->card_type_count; i++) {
+            CardType* type = game->card_types[i];
+            if (type == NULL || type->name == NULL || (int)type->faction != f) {
+                continue;
+            }
+            if (first) {
+                len += snprintf(context + len, total - len, "\nCards of %s: %s",
+                                FACTION_NAMES[f], type->name);
+                first = false;
+            } else {
+                len += snprintf(context + len, total - len, ", %s", type->name);
+            }
+        }
+    }
+
+    return context;
+}
+// }}}
+
+// {{{ world_state_build_turn_context
+char* world_state_build_turn_context(WorldState* state, Game* game) {
     if (state == NULL || game == NULL) {
         return NULL;
     }
 
+    world_state_refresh(state, game);
+    if (!(state->dirty & WORLD_DIRTY_TURN) && state->turn_context != NULL) {
+        return strdup_safe(state->turn_context);
+    }
+
     // Build prompt vars
     PromptVars* vars = prompt_vars_create();
     if (vars == NULL) {
@@ -390,6 +687,48 @@ char* world_state_build_context(WorldState* state, Game* game) {
     free(world_prompt);
     free(events);
 
+    char* cached = strdup_safe(context);
+    if (cached != NULL) {
+        free(state->turn_context);
+        state->turn_context = cached;
+        state->dirty &= ~WORLD_DIRTY_TURN;
+    }
+
+    return context;
+}
+// }}}
+
+// {{{ world_state_build_context
+char* world_state_build_context(WorldState* state, Game* game) {
+    if (state == NULL || game == NULL) {
+        return NULL;
+    }
+
+    // The session text only changes with the game
+    if ((state->dirty & WORLD_DIRTY_SESSION) || state->session_game != game ||
+        state->session_context == NULL) {
+        char* session = world_state_build_session_context(game);
+        if (session == NULL) {
+            return NULL;
+        }
+        free(state->session_context);
+        state->session_context = session;
+        state->session_game = game;
+        state->dirty &= ~WORLD_DIRTY_SESSION;
+    }
+
+    char* turn = world_state_build_turn_context(state, game);
+    if (turn == NULL) {
+        return NULL;
+    }
+
+    size_t total = strlen(state->session_context) + strlen(turn) + 3;
+    char* context = malloc(total);
+    if (context != NULL) {
+        snprintf(context, total, "%s\n\n%s", state->session_context, turn);
+    }
+
+    free(turn);
     return context;
 }
 // }}}
@@ -4,12 +4,18 @@
  * Maintains persistent narrative context for LLM prompts.
  * Tracks game progress, faction dominance, battlefield conditions,
  * and recent events to provide coherent narrative generation.
+ *
+ * The state is maintained incrementally: the effect and auto-draw
+ * listeners below (or the world_state_note_* calls) record what a game
+ * action changed as dirty flags, and the builders only regenerate the
+ * sections that are dirty, returning copies of cached text otherwise.
  */
 
 #ifndef LLM_WORLD_STATE_H
 #define LLM_WORLD_STATE_H
 
 #include "../core/05-game.h"
+#include "../core/08-auto-draw.h"
 #include "02-prompts.h"
 #include <stdbool.h>
 
@@ -19,6 +25,19 @@
 /* Maximum description length */
 #define WORLD_STATE_MAX_DESC 512
 
+// {{{ WorldStateDirty
+// Sections of the world state that changed since they were last built.
+#define WORLD_DIRTY_TENSION         (1u << 0)   // Authority or turn moved
+#define WORLD_DIRTY_FACTIONS        (1u << 1)   // Faction counts changed
+#define WORLD_DIRTY_TURN            (1u << 2)   // Turn context text is stale
+#define WORLD_DIRTY_SESSION         (1u << 3)   // Session context text is stale
+#define WORLD_DIRTY_FORCES(player)  (1u << (8 + (player)))  // A player's forces
+#define WORLD_DIRTY_ALL_FORCES      (((1u << MAX_PLAYERS) - 1) << 8)
+#define WORLD_DIRTY_ALL             (WORLD_DIRTY_TENSION | WORLD_DIRTY_FACTIONS | \
+                                     WORLD_DIRTY_TURN | WORLD_DIRTY_SESSION | \
+                                     WORLD_DIRTY_ALL_FORCES)
+// }}}
+
 // {{{ GameEvent
 // Represents a significant game event for narrative tracking.
 typedef struct {
@@ -51,6 +70,18 @@ typedef struct {
 
     // Game tension (0.0 = calm, 1.0 = climactic)
     float tension;
+
+    // Incremental maintenance
+    unsigned int dirty;                 // WORLD_DIRTY_* sections to rebuild
+    int authority[MAX_PLAYERS];         // Authority the tension was computed from
+    int base_count[MAX_PLAYERS];        // Bases in play when forces were last checked
+    int hand_count[MAX_PLAYERS];        // Cards in hand when forces were last checked
+    GamePhase phase;                    // Phase the turn context was built for
+    int battlefield_tier;               // Tension band of battlefield_description
+    char* session_context;              // Cached session context
+    const Game* session_game;           // Game session_context was built for
+    char* turn_context;                 // Cached turn context
+    char* forces_prompt[MAX_PLAYERS];   // Cached force description prompts
 } WorldState;
 // }}}
 
@@ -72,10 +103,61 @@ void world_state_init_from_game(WorldState* state, Game* game);
 
 // {{{ world_state_update
 // Updates world state based on current game state.
-// Called after each significant game action.
+// Called after each significant game action. Runs world_state_refresh
+// and recomputes only what the changes and the noted events affect.
 void world_state_update(WorldState* state, Game* game);
 // }}}
 
+// {{{ world_state_refresh
+// Marks what changed since the state last looked at game: turn, phase,
+// authority, and each player's bases in play and cards in hand. Run by
+// the update and the builders; call it before testing dirty flags directly.
+void world_state_refresh(WorldState* state, Game* game);
+// }}}
+
+// {{{ world_state_mark_dirty
+// Marks sections for regeneration, e.g. WORLD_DIRTY_ALL after the state
+// was rebuilt from scratch.
+void world_state_mark_dirty(WorldState* state, unsigned int flags);
+// }}}
+
+// {{{ world_state_note_card_played
+// Records a card entering play for player_index: counts its faction and
+// dirties that player's forces.
+void world_state_note_card_played(WorldState* state, int player_index,
+                                  CardInstance* card);
+// }}}
+
+// {{{ world_state_note_base
+// Records a base entering (added = true) or leaving play for player_index.
+// Bases leaving play without a report, e.g. destroyed in combat, are
+// caught by world_state_refresh comparing each player's base count.
+void world_state_note_base(WorldState* state, int player_index,
+                           CardInstance* base, bool added);
+// }}}
+
+// {{{ world_state_note_authority
+// Records an authority change. Tension is recomputed now; the battlefield
+// and turn context only when they are affected.
+void world_state_note_authority(WorldState* state, Game* game);
+// }}}
+
+// {{{ world_state_effect_listener
+// EffectEventFunc for effects_register_callback, with the WorldState as
+// context. Notes cards played, bases added, authority gained and draws.
+// No effect fires when a base is destroyed; see world_state_note_base.
+void world_state_effect_listener(Game* game, Player* player,
+                                 CardInstance* source, Effect* effect,
+                                 void* context);
+// }}}
+
+// {{{ world_state_autodraw_listener
+// AutoDrawListener for autodraw_register_listener, with the WorldState as
+// context. Cards drawn dirty the drawing player's forces.
+void world_state_autodraw_listener(Game* game, Player* player,
+                                   AutoDrawEvent* event, void* context);
+// }}}
+
 // {{{ world_state_record_event
 // Records a significant game event for narrative context.
 void world_state_record_event(WorldState* state, const char* event_type,
@@ -94,9 +176,28 @@ char* world_state_get_recent_events(WorldState* state, int max_events);
 void world_state_to_prompt_vars(WorldState* state, Game* game, PromptVars* vars);
 // }}}
 
+// {{{ world_state_build_session_context
+// Builds the part of the context that is fixed for a game: setting,
+// commanders, faction themes and the card catalog. Identical on every
+// call for the same game, so it can lead each prompt as a cacheable
+// prefix. Caller must free returned string.
+char* world_state_build_session_context(Game* game);
+// }}}
+
+// {{{ world_state_build_turn_context
+// Builds the part of the context that changes as play goes on: turn,
+// authority, phase, battlefield and recent events. Returns a copy of the
+// cached text unless one of those changed. Caller must free returned string.
+char* world_state_build_turn_context(WorldState* state, Game* game);
+// }}}
+
 // {{{ world_state_build_context
-// Builds complete LLM context from world state.
-// Caller must free returned string.
+// Builds complete LLM context from world state: the session context
+// followed by the turn context, so prompts for one game share their
+// leading text. Both parts are cached in state and rebuilt only when
+// dirty. Caller must free returned string. With a context manager, set
+// the two parts as PRIORITY_SESSION and PRIORITY_WORLD_STATE entries
+// instead, so the session context stays ahead of the event rings.
 char* world_state_build_context(WorldState* state, Game* game);
 // }}}
 
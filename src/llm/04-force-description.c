@@ -296,6 +296,34 @@ char* force_desc_build_player_forces(Player* player, Game* game) {
 }
 // }}}
 
+// {{{ force_desc_build_player_forces_cached
+char* force_desc_build_player_forces_cached(WorldState* state, Game* game,
+                                            int player_index) {
+    if (state == NULL || game == NULL || player_index < 0 ||
+        player_index >= game->player_count || player_index >= MAX_PLAYERS) {
+        return NULL;
+    }
+
+    // Bases destroyed and cards discarded fire no listener
+    world_state_refresh(state, game);
+
+    unsigned int flag = WORLD_DIRTY_FORCES(player_index);
+    if (!(state->dirty & flag) && state->forces_prompt[player_index] != NULL) {
+        return strdup_safe(state->forces_prompt[player_index]);
+    }
+
+    char* prompt = force_desc_build_player_forces(game->players[player_index], game);
+    char* cached = strdup_safe(prompt);
+    if (cached != NULL) {
+        free(state->forces_prompt[player_index]);
+        state->forces_prompt[player_index] = cached;
+        state->dirty &= ~flag;
+    }
+
+    return prompt;
+}
+// }}}
+
 // {{{ force_desc_build_card_played
 char* force_desc_build_card_played(CardInstance* card, Player* player) {
     if (card == NULL || card->type == NULL) {
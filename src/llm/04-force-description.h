@@ -11,6 +11,7 @@
 
 #include "../core/05-game.h"
 #include "02-prompts.h"
+#include "03-world-state.h"
 #include <stdbool.h>
 
 /* Maximum cached descriptions per player */
@@ -78,6 +79,15 @@ const FactionTheme* force_desc_get_theme(Faction faction);
 char* force_desc_build_player_forces(Player* player, Game* game);
 // }}}
 
+// {{{ force_desc_build_player_forces_cached
+// Like force_desc_build_player_forces for game->players[player_index],
+// but only regenerates the prompt when world_state_refresh finds that
+// player's forces dirty; otherwise returns a copy of the one cached in state.
+// Caller must free returned string.
+char* force_desc_build_player_forces_cached(WorldState* state, Game* game,
+                                            int player_index);
+// }}}
+
 // {{{ force_desc_build_card_played
 // Builds a description prompt for a card being played.
 // Caller must free returned string.
@@ -366,6 +366,156 @@ char* event_narration_build_game_over(Player* winner, Player* loser,
 }
 // }}}
 
+// {{{ local_seed
+// Hashes what identifies an event (FNV-1a) so its local narration
+// picks the same theme words every time.
+static unsigned long local_seed(const NarrationEvent* event) {
+    unsigned long hash = 2166136261UL;
+    const char* parts[3] = {
+        event->actor != NULL ? event->actor->name : NULL,
+        event->card != NULL && event->card->type != NULL ? event->card->type->name : NULL,
+        event->base != NULL && event->base->type != NULL ? event->base->type->name : NULL
+    };
+    for (int i = 0; i < 3; i++) {
+        for (const char* p = parts[i]; p != NULL && *p != '\0'; p++) {
+            hash = (hash ^ (unsigned char)*p) * 16777619UL;
+        }
+    }
+    hash = (hash ^ (unsigned long)event->type) * 16777619UL;
+    hash = (hash ^ (unsigned long)event->turn) * 16777619UL;
+    return hash;
+}
+// }}}
+
+// {{{ local_pick
+// One of a theme's four words, chosen by seed; salt keeps the picks
+// within one sentence independent.
+static const char* local_pick(const char* const words[4], unsigned long seed, int salt) {
+    unsigned long mixed = (seed >> (salt * 5)) ^ (seed * (unsigned long)(salt + 1));
+    return words[mixed % 4];
+}
+// }}}
+
+// {{{ local_card_theme
+static const FactionTheme* local_card_theme(const CardInstance* card) {
+    return force_desc_get_theme(card != NULL && card->type != NULL
+                                ? card->type->faction : FACTION_NEUTRAL);
+}
+// }}}
+
+// {{{ event_narration_build_local
+char* event_narration_build_local(NarrationEvent* event) {
+    if (event == NULL) {
+        return strdup_safe("The battle goes on.");
+    }
+
+    const char* actor = event->actor != NULL && event->actor->name != NULL
+                        ? event->actor->name : "A commander";
+    const char* target = event->target != NULL && event->target->name != NULL
+                         ? event->target->name : "their opponent";
+    const char* card = event->card != NULL && event->card->type != NULL &&
+                       event->card->type->name != NULL
+                       ? event->card->type->name : "a card";
+    const char* base = event->base != NULL && event->base->type != NULL &&
+                       event->base->type->name != NULL
+                       ? event->base->type->name : "a base";
+    const char* how = event_narration_get_intensity_word(event->intensity);
+    unsigned long seed = local_seed(event);
+
+    size_t buffer_size = 512;
+    char* text = malloc(buffer_size);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    const FactionTheme* theme;
+    switch (event->type) {
+        case GAME_EVENT_CARD_PLAYED:
+            theme = local_card_theme(event->card);
+            snprintf(text, buffer_size,
+                     "%s plays %s, and %s %s rise to %s.",
+                     actor, card,
+                     local_pick(theme->adjectives, seed, 0),
+                     local_pick(theme->nouns, seed, 1),
+                     local_pick(theme->verbs, seed, 2));
+            break;
+
+        case GAME_EVENT_CARD_PURCHASED:
+            theme = local_card_theme(event->card);
+            snprintf(text, buffer_size,
+                     "%s acquires %s for %d trade; %s %s swell their ranks.",
+                     actor, card, event->cost,
+                     local_pick(theme->adjectives, seed, 0),
+                     local_pick(theme->nouns, seed, 1));
+            break;
+
+        case GAME_EVENT_ATTACK_PLAYER:
+            theme = force_desc_get_theme(force_desc_get_dominant_faction(event->actor));
+            snprintf(text, buffer_size,
+                     "%s's %s %s strike %s %s for %d damage, leaving %d authority.",
+                     actor, local_pick(theme->adjectives, seed, 0),
+                     local_pick(theme->nouns, seed, 1), target, how,
+                     event->damage,
+                     event->target != NULL ? event->target->authority : 0);
+            break;
+
+        case GAME_EVENT_ATTACK_BASE:
+            theme = force_desc_get_theme(force_desc_get_dominant_faction(event->actor));
+            snprintf(text, buffer_size,
+                     "%s's %s %s assault %s's %s %s, dealing %d damage.",
+                     actor, local_pick(theme->adjectives, seed, 0),
+                     local_pick(theme->nouns, seed, 1), target, base, how,
+                     event->damage);
+            break;
+
+        case GAME_EVENT_BASE_DESTROYED:
+            theme = local_card_theme(event->base);
+            snprintf(text, buffer_size,
+                     "The %s %s of %s falls, and its %s are scattered.",
+                     local_pick(theme->adjectives, seed, 0), base, target,
+                     local_pick(theme->nouns, seed, 1));
+            break;
+
+        case GAME_EVENT_TURN_START:
+            theme = force_desc_get_theme(force_desc_get_dominant_faction(event->actor));
+            snprintf(text, buffer_size,
+                     "Turn %d begins as %s prepares to %s.",
+                     event->turn, actor, local_pick(theme->verbs, seed, 2));
+            break;
+
+        case GAME_EVENT_TURN_END:
+            snprintf(text, buffer_size,
+                     "%s ends the turn, %d trade spent and %d damage dealt.",
+                     actor, event->cost, event->damage);
+            break;
+
+        case GAME_EVENT_GAME_OVER:
+            snprintf(text, buffer_size,
+                     "%s triumphs over %s with %d authority remaining. "
+                     "The battle for Symbeline is decided.",
+                     actor, target, event->damage);
+            break;
+
+        case GAME_EVENT_ALLY_TRIGGERED:
+            theme = local_card_theme(event->card);
+            snprintf(text, buffer_size,
+                     "The %s allies of %s answer %s's call.",
+                     theme->name, card, actor);
+            break;
+
+        case GAME_EVENT_SCRAP:
+            snprintf(text, buffer_size, "%s scraps %s.", actor, card);
+            break;
+
+        default:
+            snprintf(text, buffer_size, "The battle goes on.");
+            break;
+    }
+
+    return text;
+}
+// }}}
+
 // {{{ event_narration_build
 char* event_narration_build(NarrationEvent* event) {
     if (event == NULL) {
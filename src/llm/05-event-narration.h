@@ -130,6 +130,14 @@ char* event_narration_build_game_over(Player* winner, Player* loser,
                                        int final_authority);
 // }}}
 
+// {{{ event_narration_build_local
+// Writes finished narration for an event without the model: a short
+// sentence per event type in the words of the faction themes. The same
+// event always reads the same. Used while the model is unavailable
+// (see 20-circuit-breaker). Caller must free returned string.
+char* event_narration_build_local(NarrationEvent* event);
+// }}}
+
 // {{{ event_narration_calculate_intensity
 // Calculates appropriate intensity based on game state.
 NarrationIntensity event_narration_calculate_intensity(WorldState* state,
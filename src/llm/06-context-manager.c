@@ -3,8 +3,13 @@
  *
  * Manages the context window for LLM calls. Tracks token usage,
  * handles entry priorities, and provides statistics for monitoring.
+ *
+ * Rings are indexed modulo max_entries; every ring can hold every
+ * slot, so adding to a ring never overflows it.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "06-context-manager.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,6 +19,107 @@
 // {{{ Constants
 #define DEFAULT_MAX_ENTRIES 100
 #define CHARS_PER_TOKEN 4  // Rough estimate for English text
+#define NO_SLOT -1
+#define PROMPT_SEPARATOR "\n\n"
+#define PROMPT_SEPARATOR_LEN 2
+// }}}
+
+// {{{ PROMPT_LAYOUT
+// Order of priorities in the prompt, least likely to change first.
+static const ContextPriority PROMPT_LAYOUT[CONTEXT_PRIORITY_LEVELS] = {
+    PRIORITY_SYSTEM,
+    PRIORITY_SESSION,
+    PRIORITY_OLD_EVENTS,
+    PRIORITY_RECENT_EVENTS,
+    PRIORITY_FORCE_DESC,
+    PRIORITY_WORLD_STATE,
+    PRIORITY_CURRENT_TURN
+};
+// }}}
+
+// {{{ ring_slot
+// Returns the slot at position pos (0 = oldest) of ring.
+static int ring_slot(ContextManager* cm, ContextRing* ring, int pos) {
+    return ring->slots[(ring->head + pos) % cm->max_entries];
+}
+// }}}
+
+// {{{ ring_push
+static void ring_push(ContextManager* cm, ContextRing* ring, int slot) {
+    ring->slots[(ring->head + ring->count) % cm->max_entries] = slot;
+    ring->count++;
+    ring->tokens += cm->entries[slot].token_count;
+}
+// }}}
+
+// {{{ ring_remove
+// Removes position pos from ring, closing the gap from whichever end
+// is nearer (the head for eviction, so that is O(1)).
+static int ring_remove(ContextManager* cm, ContextRing* ring, int pos) {
+    int cap = cm->max_entries;
+    int slot = ring_slot(cm, ring, pos);
+
+    if (pos < ring->count - 1 - pos) {
+        for (int i = pos; i > 0; i--) {
+            ring->slots[(ring->head + i) % cap] = ring->slots[(ring->head + i - 1) % cap];
+        }
+        ring->head = (ring->head + 1) % cap;
+    } else {
+        for (int i = pos; i < ring->count - 1; i++) {
+            ring->slots[(ring->head + i) % cap] = ring->slots[(ring->head + i + 1) % cap];
+        }
+    }
+    ring->count--;
+    ring->tokens -= cm->entries[slot].token_count;
+    return slot;
+}
+// }}}
+
+// {{{ release_slot
+// Frees an entry already removed from its ring and returns its slot to
+// the free stack.
+static void release_slot(ContextManager* cm, int slot) {
+    ContextEntry* entry = &cm->entries[slot];
+
+    cm->current_tokens -= entry->token_count;
+    cm->text_bytes -= entry->length;
+    free(entry->text);
+    memset(entry, 0, sizeof(ContextEntry));
+
+    cm->free_slots[cm->free_count++] = slot;
+    cm->entry_count--;
+    if (cm->last_added == slot) {
+        cm->last_added = NO_SLOT;
+    }
+}
+// }}}
+
+// {{{ locate
+// Maps a priority-order index to its priority ring and position.
+static bool locate(ContextManager* cm, int index, int* priority, int* pos) {
+    if (index < 0 || index >= cm->entry_count) {
+        return false;
+    }
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        if (index < cm->rings[p].count) {
+            *priority = p;
+            *pos = index;
+            return true;
+        }
+        index -= cm->rings[p].count;
+    }
+    return false;
+}
+// }}}
+
+// {{{ entry_at
+static ContextEntry* entry_at(ContextManager* cm, int index) {
+    int priority, pos;
+    if (!locate(cm, index, &priority, &pos)) {
+        return NULL;
+    }
+    return &cm->entries[ring_slot(cm, &cm->rings[priority], pos)];
+}
 // }}}
 
 // {{{ context_init
@@ -22,23 +128,32 @@ ContextManager* context_init(int max_tokens) {
         return NULL;
     }
 
-    ContextManager* cm = malloc(sizeof(ContextManager));
+    ContextManager* cm = calloc(1, sizeof(ContextManager));
     if (cm == NULL) {
         return NULL;
     }
 
-    cm->entries = calloc(DEFAULT_MAX_ENTRIES, sizeof(ContextEntry));
-    if (cm->entries == NULL) {
-        free(cm);
+    cm->max_entries = DEFAULT_MAX_ENTRIES;
+    cm->max_tokens = max_tokens;
+    cm->last_added = NO_SLOT;
+
+    cm->entries = calloc(cm->max_entries, sizeof(ContextEntry));
+    cm->free_slots = malloc(sizeof(int) * cm->max_entries);
+    bool ok = cm->entries != NULL && cm->free_slots != NULL;
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS && ok; p++) {
+        cm->rings[p].slots = malloc(sizeof(int) * cm->max_entries);
+        ok = cm->rings[p].slots != NULL;
+    }
+    if (!ok) {
+        context_free(cm);
         return NULL;
     }
 
-    cm->entry_count = 0;
-    cm->max_entries = DEFAULT_MAX_ENTRIES;
-    cm->max_tokens = max_tokens;
-    cm->current_tokens = 0;
-    cm->eviction_count = 0;
-    cm->summary_count = 0;
+    // Lowest slots are handed out first
+    for (int i = 0; i < cm->max_entries; i++) {
+        cm->free_slots[i] = cm->max_entries - 1 - i;
+    }
+    cm->free_count = cm->max_entries;
 
     return cm;
 }
@@ -51,10 +166,16 @@ void context_free(ContextManager* cm) {
     }
 
     // Free all entry text
-    for (int i = 0; i < cm->entry_count; i++) {
-        free(cm->entries[i].text);
+    if (cm->entries != NULL) {
+        for (int i = 0; i < cm->max_entries; i++) {
+            free(cm->entries[i].text);
+        }
     }
 
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        free(cm->rings[p].slots);
+    }
+    free(cm->free_slots);
     free(cm->entries);
     free(cm);
 }
@@ -72,6 +193,42 @@ int context_estimate_tokens(const char* text) {
 }
 // }}}
 
+// {{{ context_count_tokens
+int context_count_tokens(ContextManager* cm, const char* text) {
+    if (cm == NULL || cm->tokenizer == NULL) {
+        return context_estimate_tokens(text);
+    }
+    return tokenizer_count(cm->tokenizer, text);
+}
+// }}}
+
+// {{{ context_set_tokenizer
+void context_set_tokenizer(ContextManager* cm, Tokenizer* tokenizer) {
+    if (cm == NULL) {
+        return;
+    }
+
+    cm->tokenizer = tokenizer;
+    cm->current_tokens = 0;
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        ContextRing* ring = &cm->rings[p];
+        ring->tokens = 0;
+        for (int pos = 0; pos < ring->count; pos++) {
+            ContextEntry* entry = &cm->entries[ring_slot(cm, ring, pos)];
+            entry->token_count = context_count_tokens(cm, entry->text);
+            ring->tokens += entry->token_count;
+        }
+        cm->current_tokens += ring->tokens;
+    }
+
+    while (cm->current_tokens > cm->max_tokens) {
+        if (!context_evict_lowest(cm)) {
+            break;  // Only system entries remain
+        }
+    }
+}
+// }}}
+
 // {{{ context_get_stats
 ContextManagerStats context_get_stats(ContextManager* cm) {
     ContextManagerStats stats = {0};
@@ -128,65 +285,23 @@ void context_clear(ContextManager* cm) {
         return;
     }
 
-    // Free all entry text
-    for (int i = 0; i < cm->entry_count; i++) {
-        free(cm->entries[i].text);
-        cm->entries[i].text = NULL;
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        context_clear_priority(cm, (ContextPriority)p);
     }
-
-    cm->entry_count = 0;
-    cm->current_tokens = 0;
 }
 // }}}
 
 // {{{ context_clear_priority
 void context_clear_priority(ContextManager* cm, ContextPriority priority) {
-    if (cm == NULL) {
+    if (cm == NULL || priority < 0 || priority >= CONTEXT_PRIORITY_LEVELS) {
         return;
     }
 
-    int write_idx = 0;
-
-    // Compact the array, removing entries with matching priority
-    for (int read_idx = 0; read_idx < cm->entry_count; read_idx++) {
-        if (cm->entries[read_idx].priority == priority) {
-            // Free this entry and update token count
-            cm->current_tokens -= cm->entries[read_idx].token_count;
-            free(cm->entries[read_idx].text);
-        } else {
-            // Keep this entry
-            if (write_idx != read_idx) {
-                cm->entries[write_idx] = cm->entries[read_idx];
-            }
-            write_idx++;
-        }
-    }
-
-    // Clear remaining slots
-    for (int i = write_idx; i < cm->entry_count; i++) {
-        cm->entries[i].text = NULL;
-        cm->entries[i].token_count = 0;
+    ContextRing* ring = &cm->rings[priority];
+    while (ring->count > 0) {
+        release_slot(cm, ring_remove(cm, ring, 0));
     }
-
-    cm->entry_count = write_idx;
-}
-// }}}
-
-// {{{ compare_entries_by_priority
-// Comparison function for qsort - sorts by priority (ascending = highest priority first)
-static int compare_entries_by_priority(const void* a, const void* b) {
-    const ContextEntry* entry_a = (const ContextEntry*)a;
-    const ContextEntry* entry_b = (const ContextEntry*)b;
-
-    // Lower priority number = higher priority, should come first
-    if (entry_a->priority != entry_b->priority) {
-        return entry_a->priority - entry_b->priority;
-    }
-
-    // Same priority: older entries (lower timestamp) come first
-    if (entry_a->added_at < entry_b->added_at) return -1;
-    if (entry_a->added_at > entry_b->added_at) return 1;
-    return 0;
+    ring->head = 0;
 }
 // }}}
 
@@ -196,64 +311,31 @@ bool context_evict_lowest(ContextManager* cm) {
         return false;
     }
 
-    // Find lowest priority (highest number) non-system entry
-    int lowest_idx = -1;
-    ContextPriority lowest_priority = PRIORITY_SYSTEM;  // Start with highest priority
-    time_t oldest_time = 0;
-    bool found_candidate = false;
-
-    for (int i = 0; i < cm->entry_count; i++) {
-        // Never evict system entries
-        if (cm->entries[i].priority == PRIORITY_SYSTEM) {
-            continue;
-        }
-
-        // Found first evictable candidate or a lower priority entry
-        if (!found_candidate || cm->entries[i].priority > lowest_priority) {
-            lowest_priority = cm->entries[i].priority;
-            lowest_idx = i;
-            oldest_time = cm->entries[i].added_at;
-            found_candidate = true;
-        }
-        // Same priority: prefer to evict older entries
-        else if (cm->entries[i].priority == lowest_priority &&
-                 cm->entries[i].added_at < oldest_time) {
-            lowest_idx = i;
-            oldest_time = cm->entries[i].added_at;
+    // Oldest entry of the lowest priority; system entries are never evicted
+    for (int p = CONTEXT_PRIORITY_LEVELS - 1; p > PRIORITY_SYSTEM; p--) {
+        ContextRing* ring = &cm->rings[p];
+        if (ring->count > 0) {
+            release_slot(cm, ring_remove(cm, ring, 0));
+            cm->eviction_count++;
+            return true;
         }
     }
 
-    // No evictable entry found
-    if (lowest_idx < 0) {
-        return false;
-    }
-
-    // Remove the entry
-    cm->current_tokens -= cm->entries[lowest_idx].token_count;
-    free(cm->entries[lowest_idx].text);
-    cm->eviction_count++;
-
-    // Shift remaining entries down
-    for (int i = lowest_idx; i < cm->entry_count - 1; i++) {
-        cm->entries[i] = cm->entries[i + 1];
-    }
-    cm->entry_count--;
-
-    // Clear the now-unused slot
-    cm->entries[cm->entry_count].text = NULL;
-    cm->entries[cm->entry_count].token_count = 0;
-
-    return true;
+    return false;
 }
 // }}}
 
 // {{{ context_add
 bool context_add(ContextManager* cm, const char* text, ContextPriority priority) {
-    if (cm == NULL || text == NULL) {
+    if (cm == NULL || text == NULL ||
+        priority < 0 || priority >= CONTEXT_PRIORITY_LEVELS) {
         return false;
     }
 
-    int tokens = context_estimate_tokens(text);
+    // System prompts repeat turn after turn; the tokenizer caches them
+    int tokens = priority == PRIORITY_SYSTEM && cm->tokenizer != NULL
+        ? tokenizer_count_prefixed(cm->tokenizer, text, strlen(text))
+        : context_count_tokens(cm, text);
 
     // Check if entry would exceed max_tokens even in an empty context
     if (tokens > cm->max_tokens) {
@@ -267,122 +349,196 @@ bool context_add(ContextManager* cm, const char* text, ContextPriority priority)
         }
     }
 
-    // Check if we have room in the entries array
-    if (cm->entry_count >= cm->max_entries) {
-        // Need to evict to make room in array
+    // Check if we have a free slot
+    if (cm->free_count == 0) {
         if (!context_evict_lowest(cm)) {
             return false;
         }
     }
 
-    // Add the new entry
-    ContextEntry* entry = &cm->entries[cm->entry_count];
-    entry->text = strdup(text);
-    if (entry->text == NULL) {
+    char* copy = strdup(text);
+    if (copy == NULL) {
         return false;  // Allocation failed
     }
 
+    int slot = cm->free_slots[--cm->free_count];
+    ContextEntry* entry = &cm->entries[slot];
+    entry->text = copy;
+    entry->length = strlen(copy);
     entry->token_count = tokens;
     entry->priority = priority;
     entry->added_at = time(NULL);
     entry->is_summary = false;
+    entry->sequence = cm->next_sequence++;
 
+    ring_push(cm, &cm->rings[priority], slot);
     cm->current_tokens += tokens;
+    cm->text_bytes += entry->length;
     cm->entry_count++;
+    cm->last_added = slot;
 
     return true;
 }
 // }}}
 
-// {{{ context_build_prompt
-char* context_build_prompt(ContextManager* cm) {
-    if (cm == NULL || cm->entry_count == 0) {
-        char* empty = strdup("");
-        return empty;
+// {{{ context_set
+bool context_set(ContextManager* cm, const char* text, ContextPriority priority) {
+    if (cm == NULL || text == NULL ||
+        priority < 0 || priority >= CONTEXT_PRIORITY_LEVELS) {
+        return false;
+    }
+
+    ContextRing* ring = &cm->rings[priority];
+    if (ring->count == 1 &&
+        strcmp(cm->entries[ring_slot(cm, ring, 0)].text, text) == 0) {
+        return true;
     }
 
-    // Sort entries by priority (creates a stable order)
-    qsort(cm->entries, cm->entry_count, sizeof(ContextEntry),
-          compare_entries_by_priority);
+    context_clear_priority(cm, priority);
+    return context_add(cm, text, priority);
+}
+// }}}
+
+// {{{ context_get_prompt_length
+size_t context_get_prompt_length(ContextManager* cm) {
+    if (cm == NULL || cm->entry_count == 0) {
+        return 0;
+    }
+    return cm->text_bytes + (size_t)(cm->entry_count - 1) * PROMPT_SEPARATOR_LEN;
+}
+// }}}
 
-    // Calculate total size needed
-    size_t total_size = 1;  // For null terminator
-    for (int i = 0; i < cm->entry_count; i++) {
-        total_size += strlen(cm->entries[i].text) + 2;  // +2 for "\n\n"
+// {{{ gather_prompt
+// Copies every entry, in layout order, into out (which must hold
+// context_get_prompt_length + 1 bytes).
+static void gather_prompt(ContextManager* cm, char* out) {
+    bool first = true;
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        ContextRing* ring = &cm->rings[PROMPT_LAYOUT[p]];
+        for (int i = 0; i < ring->count; i++) {
+            ContextEntry* entry = &cm->entries[ring_slot(cm, ring, i)];
+            if (!first) {
+                memcpy(out, PROMPT_SEPARATOR, PROMPT_SEPARATOR_LEN);
+                out += PROMPT_SEPARATOR_LEN;
+            }
+            memcpy(out, entry->text, entry->length);
+            out += entry->length;
+            first = false;
+        }
     }
+    *out = '\0';
+}
+// }}}
 
-    // Allocate and build the prompt
-    char* prompt = malloc(total_size);
+// {{{ context_build_prompt
+char* context_build_prompt(ContextManager* cm) {
+    size_t length = context_get_prompt_length(cm);
+    char* prompt = malloc(length + 1);
     if (prompt == NULL) {
         return NULL;
     }
 
-    prompt[0] = '\0';
-    for (int i = 0; i < cm->entry_count; i++) {
-        strcat(prompt, cm->entries[i].text);
-        if (i < cm->entry_count - 1) {
-            strcat(prompt, "\n\n");
+    if (cm == NULL) {
+        prompt[0] = '\0';
+    } else {
+        gather_prompt(cm, prompt);
+    }
+    return prompt;
+}
+// }}}
+
+// {{{ context_build_prompt_into
+const char* context_build_prompt_into(ContextManager* cm, PromptBuffer* buffer) {
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    size_t length = context_get_prompt_length(cm);
+    if (length + 1 > buffer->capacity) {
+        char* grown = realloc(buffer->data, length + 1);
+        if (grown == NULL) {
+            return NULL;
         }
+        buffer->data = grown;
+        buffer->capacity = length + 1;
     }
 
-    return prompt;
+    if (cm == NULL) {
+        buffer->data[0] = '\0';
+    } else {
+        gather_prompt(cm, buffer->data);
+    }
+    buffer->length = length;
+    return buffer->data;
 }
 // }}}
 
 // {{{ context_get_entry_count
 int context_get_entry_count(ContextManager* cm, ContextPriority priority) {
-    if (cm == NULL) {
+    if (cm == NULL || priority < 0 || priority >= CONTEXT_PRIORITY_LEVELS) {
         return 0;
     }
 
-    int count = 0;
-    for (int i = 0; i < cm->entry_count; i++) {
-        if (cm->entries[i].priority == priority) {
-            count++;
-        }
-    }
-
-    return count;
+    return cm->rings[priority].count;
 }
 // }}}
 
 // {{{ context_update_priority
 void context_update_priority(ContextManager* cm, ContextPriority old_priority,
                               ContextPriority new_priority) {
-    if (cm == NULL) {
+    if (cm == NULL || old_priority == new_priority ||
+        old_priority < 0 || old_priority >= CONTEXT_PRIORITY_LEVELS ||
+        new_priority < 0 || new_priority >= CONTEXT_PRIORITY_LEVELS) {
+        return;
+    }
+
+    ContextRing* from = &cm->rings[old_priority];
+    ContextRing* to = &cm->rings[new_priority];
+    if (from->count == 0) {
+        return;
+    }
+
+    // Merge both rings by order of addition into a fresh ring
+    int* merged = malloc(sizeof(int) * cm->max_entries);
+    if (merged == NULL) {
         return;
     }
 
-    for (int i = 0; i < cm->entry_count; i++) {
-        if (cm->entries[i].priority == old_priority) {
-            cm->entries[i].priority = new_priority;
+    int i = 0, j = 0, n = 0;
+    while (i < from->count || j < to->count) {
+        int a = i < from->count ? ring_slot(cm, from, i) : NO_SLOT;
+        int b = j < to->count ? ring_slot(cm, to, j) : NO_SLOT;
+        if (b == NO_SLOT ||
+            (a != NO_SLOT && cm->entries[a].sequence < cm->entries[b].sequence)) {
+            cm->entries[a].priority = new_priority;
+            merged[n++] = a;
+            i++;
+        } else {
+            merged[n++] = b;
+            j++;
         }
     }
+
+    free(to->slots);
+    to->slots = merged;
+    to->head = 0;
+    to->count = n;
+    to->tokens += from->tokens;
+
+    from->head = 0;
+    from->count = 0;
+    from->tokens = 0;
 }
 // }}}
 
 // {{{ context_remove_at
 bool context_remove_at(ContextManager* cm, int index) {
-    if (cm == NULL || index < 0 || index >= cm->entry_count) {
+    int priority, pos;
+    if (cm == NULL || !locate(cm, index, &priority, &pos)) {
         return false;
     }
 
-    // Update token count
-    cm->current_tokens -= cm->entries[index].token_count;
-
-    // Free the entry text
-    free(cm->entries[index].text);
-
-    // Shift remaining entries down
-    for (int i = index; i < cm->entry_count - 1; i++) {
-        cm->entries[i] = cm->entries[i + 1];
-    }
-    cm->entry_count--;
-
-    // Clear the now-unused slot
-    cm->entries[cm->entry_count].text = NULL;
-    cm->entries[cm->entry_count].token_count = 0;
-
+    release_slot(cm, ring_remove(cm, &cm->rings[priority], pos));
     return true;
 }
 // }}}
@@ -395,12 +551,17 @@ int context_find_summarizable(ContextManager* cm, int* indices, int max_count) {
 
     int count = 0;
 
-    // Find old, low-priority, non-summary entries
-    for (int i = 0; i < cm->entry_count && count < max_count; i++) {
-        // Only summarize old events and force descriptions
-        if (cm->entries[i].priority >= PRIORITY_FORCE_DESC &&
-            !cm->entries[i].is_summary) {
-            indices[count++] = i;
+    // Only summarize old events and force descriptions
+    int index = 0;
+    for (int p = 0; p < PRIORITY_FORCE_DESC; p++) {
+        index += cm->rings[p].count;
+    }
+    for (int p = PRIORITY_FORCE_DESC; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        ContextRing* ring = &cm->rings[p];
+        for (int i = 0; i < ring->count && count < max_count; i++, index++) {
+            if (!cm->entries[ring_slot(cm, ring, i)].is_summary) {
+                indices[count++] = index;
+            }
         }
     }
 
@@ -417,28 +578,31 @@ char* context_get_entries_text(ContextManager* cm, int* indices, int count) {
     // Calculate total length needed
     size_t total_len = 1;  // For null terminator
     for (int i = 0; i < count; i++) {
-        int idx = indices[i];
-        if (idx >= 0 && idx < cm->entry_count && cm->entries[idx].text != NULL) {
-            total_len += strlen(cm->entries[idx].text) + 1;  // +1 for newline
+        ContextEntry* entry = entry_at(cm, indices[i]);
+        if (entry != NULL) {
+            total_len += entry->length + 1;  // +1 for newline
         }
     }
 
-    // Allocate and build combined text
+    // Allocate and gather combined text
     char* combined = malloc(total_len);
     if (combined == NULL) {
         return NULL;
     }
 
-    combined[0] = '\0';
+    char* out = combined;
     for (int i = 0; i < count; i++) {
-        int idx = indices[i];
-        if (idx >= 0 && idx < cm->entry_count && cm->entries[idx].text != NULL) {
-            strcat(combined, cm->entries[idx].text);
-            if (i < count - 1) {
-                strcat(combined, "\n");
-            }
+        ContextEntry* entry = entry_at(cm, indices[i]);
+        if (entry == NULL) {
+            continue;
+        }
+        if (out != combined) {
+            *out++ = '\n';
         }
+        memcpy(out, entry->text, entry->length);
+        out += entry->length;
     }
+    *out = '\0';
 
     return combined;
 }
@@ -484,10 +648,40 @@ bool context_needs_summarization(ContextManager* cm, float threshold) {
 
 // {{{ context_mark_as_summary
 void context_mark_as_summary(ContextManager* cm) {
-    if (cm == NULL || cm->entry_count == 0) {
+    if (cm == NULL || cm->last_added == NO_SLOT) {
         return;
     }
 
-    cm->entries[cm->entry_count - 1].is_summary = true;
+    cm->entries[cm->last_added].is_summary = true;
+}
+// }}}
+
+// {{{ context_get_sequence
+bool context_get_sequence(ContextManager* cm, int index, unsigned long* sequence) {
+    ContextEntry* entry = cm != NULL ? entry_at(cm, index) : NULL;
+    if (entry == NULL || sequence == NULL) {
+        return false;
+    }
+    *sequence = entry->sequence;
+    return true;
+}
+// }}}
+
+// {{{ context_find_sequence
+int context_find_sequence(ContextManager* cm, unsigned long sequence) {
+    if (cm == NULL) {
+        return -1;
+    }
+
+    int index = 0;
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        ContextRing* ring = &cm->rings[p];
+        for (int i = 0; i < ring->count; i++, index++) {
+            if (cm->entries[ring_slot(cm, ring, i)].sequence == sequence) {
+                return index;
+            }
+        }
+    }
+    return -1;
 }
 // }}}
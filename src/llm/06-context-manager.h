@@ -3,12 +3,37 @@
  *
  * Manages the context window for LLM calls, tracking token usage,
  * managing entry priorities, and preventing context overflow.
+ *
+ * Entries live in a fixed slab of slots. Each priority level keeps a
+ * ring buffer of its slots, oldest first, so the prompt is the rings
+ * read in priority order, and eviction takes the head of the lowest
+ * priority ring. Token and byte totals are updated on every add and
+ * removal, so the prompt is built in one gather into a buffer sized
+ * up front.
+ *
+ * Entry indices used by the API are positions in priority order:
+ * priority first, then age within a priority.
+ *
+ * The prompt is laid out by stability rather than priority so that
+ * consecutive prompts share the longest possible prefix, which servers
+ * with prompt caching do not evaluate again: system entries, the
+ * session context (setting and card catalog), old events, recent
+ * events, force descriptions, world state and the current turn last.
+ * Demoting recent events to old events leaves the prompt text
+ * unchanged.
+ *
+ * With a tokenizer attached, entries are counted with the model's own
+ * vocabulary; otherwise context_estimate_tokens is used. Each entry is
+ * counted on its own, so the separators between entries are not.
  */
 
 #ifndef LLM_CONTEXT_MANAGER_H
 #define LLM_CONTEXT_MANAGER_H
 
+#include "02-prompts.h"
+#include "14-tokenizer.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
 // {{{ ContextPriority
@@ -16,25 +41,40 @@
 // Lower number = higher priority (won't be evicted first).
 typedef enum {
     PRIORITY_SYSTEM = 0,        // Highest: system prompts, never evicted
-    PRIORITY_CURRENT_TURN = 1,  // Current turn events
-    PRIORITY_WORLD_STATE = 2,   // World state context
-    PRIORITY_RECENT_EVENTS = 3, // Events from last 3 turns
-    PRIORITY_FORCE_DESC = 4,    // Force descriptions
-    PRIORITY_OLD_EVENTS = 5     // Lowest: old events, evicted first
+    PRIORITY_SESSION = 1,       // Session context, fixed for a game
+    PRIORITY_CURRENT_TURN = 2,  // Current turn events
+    PRIORITY_WORLD_STATE = 3,   // World state context
+    PRIORITY_RECENT_EVENTS = 4, // Events from last 3 turns
+    PRIORITY_FORCE_DESC = 5,    // Force descriptions
+    PRIORITY_OLD_EVENTS = 6     // Lowest: old events, evicted first
 } ContextPriority;
+
+#define CONTEXT_PRIORITY_LEVELS 7
 // }}}
 
 // {{{ ContextEntry
 // A single entry in the context window.
 typedef struct {
     char* text;         // The context text
-    int token_count;    // Estimated tokens for this entry
+    int token_count;    // Tokens for this entry
     ContextPriority priority;
     time_t added_at;    // When this entry was added
     bool is_summary;    // True if this is a summarized entry
+    size_t length;      // strlen(text)
+    unsigned long sequence;  // Order of addition
 } ContextEntry;
 // }}}
 
+// {{{ ContextRing
+// Slots of one priority level, oldest at head.
+typedef struct {
+    int* slots;         // Ring of slot indices (capacity max_entries)
+    int head;
+    int count;
+    int tokens;         // Running token total of these entries
+} ContextRing;
+// }}}
+
 // {{{ ContextManagerStats
 // Statistics about context usage.
 typedef struct {
@@ -50,13 +90,20 @@ typedef struct {
 // {{{ ContextManager
 // Manages the context window for LLM calls.
 typedef struct {
-    ContextEntry* entries;
+    ContextEntry* entries;      // Slab of max_entries slots
     int entry_count;
     int max_entries;
     int max_tokens;
     int current_tokens;
     int eviction_count;
     int summary_count;
+    ContextRing rings[CONTEXT_PRIORITY_LEVELS];
+    int* free_slots;            // Stack of unused slots
+    int free_count;
+    size_t text_bytes;          // Total length of all entry text
+    unsigned long next_sequence;
+    int last_added;             // Slot of the newest entry, or -1
+    Tokenizer* tokenizer;       // Not owned; NULL = estimate tokens
 } ContextManager;
 // }}}
 
@@ -78,6 +125,20 @@ void context_free(ContextManager* cm);
 int context_estimate_tokens(const char* text);
 // }}}
 
+// {{{ context_set_tokenizer
+// Counts entries with tokenizer from now on (NULL reverts to
+// estimation). Existing entries are recounted, evicting the lowest
+// priority ones if they no longer fit. The tokenizer is not owned and
+// must outlive the context manager or be detached first.
+void context_set_tokenizer(ContextManager* cm, Tokenizer* tokenizer);
+// }}}
+
+// {{{ context_count_tokens
+// Counts text the way context_add will: with the attached tokenizer,
+// or by estimation.
+int context_count_tokens(ContextManager* cm, const char* text);
+// }}}
+
 // {{{ context_get_stats
 // Gets current statistics about context usage.
 ContextManagerStats context_get_stats(ContextManager* cm);
@@ -106,11 +167,18 @@ void context_clear_priority(ContextManager* cm, ContextPriority priority);
 
 // {{{ context_add
 // Adds a new entry to the context.
-// Automatically estimates token count and evicts lowest priority entries if needed.
+// Automatically counts tokens and evicts lowest priority entries if needed.
 // Returns true if entry was added, false if it couldn't fit (even after eviction).
 bool context_add(ContextManager* cm, const char* text, ContextPriority priority);
 // }}}
 
+// {{{ context_set
+// Makes text the only entry of a priority, for parts rebuilt whole such
+// as the session context and the world state. Leaves the entry alone
+// when its text is unchanged. Returns false if text couldn't be added.
+bool context_set(ContextManager* cm, const char* text, ContextPriority priority);
+// }}}
+
 // {{{ context_evict_lowest
 // Removes the lowest priority entry from the context.
 // If multiple entries have the same priority, removes the oldest one.
@@ -119,21 +187,34 @@ bool context_evict_lowest(ContextManager* cm);
 // }}}
 
 // {{{ context_build_prompt
-// Builds the final prompt string from all entries.
-// Entries are sorted by priority (highest priority first).
+// Builds the final prompt string from all entries in layout order
+// (most stable first) and oldest first within a priority, separated
+// by blank lines.
 // Caller must free the returned string.
 // Returns NULL on allocation failure.
 char* context_build_prompt(ContextManager* cm);
 // }}}
 
+// {{{ context_build_prompt_into
+// Like context_build_prompt but writes into buffer, reusing its memory
+// across turns. Returns buffer->data, or NULL on allocation failure.
+const char* context_build_prompt_into(ContextManager* cm, PromptBuffer* buffer);
+// }}}
+
+// {{{ context_get_prompt_length
+// Returns the length of the prompt context_build_prompt would return.
+size_t context_get_prompt_length(ContextManager* cm);
+// }}}
+
 // {{{ context_get_entry_count
 // Returns the number of entries at a specific priority level.
 int context_get_entry_count(ContextManager* cm, ContextPriority priority);
 // }}}
 
 // {{{ context_update_priority
-// Updates the priority of entries matching a text prefix.
-// Useful for demoting recent events to old events as time passes.
+// Moves every entry of old_priority to new_priority, keeping entries
+// in order of addition. Useful for demoting recent events to old
+// events as time passes.
 void context_update_priority(ContextManager* cm, ContextPriority old_priority,
                               ContextPriority new_priority);
 // }}}
@@ -180,4 +261,17 @@ bool context_needs_summarization(ContextManager* cm, float threshold);
 void context_mark_as_summary(ContextManager* cm);
 // }}}
 
+// {{{ context_get_sequence
+// Stores the order-of-addition number of the entry at index, which
+// stays with the entry while indices shift. Returns false if index is
+// out of bounds.
+bool context_get_sequence(ContextManager* cm, int index, unsigned long* sequence);
+// }}}
+
+// {{{ context_find_sequence
+// Returns the current index of the entry with sequence, or -1 if it
+// has been removed.
+int context_find_sequence(ContextManager* cm, unsigned long sequence);
+// }}}
+
 #endif /* LLM_CONTEXT_MANAGER_H */
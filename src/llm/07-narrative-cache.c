@@ -3,15 +3,31 @@
  *
  * Caches generated narratives to reduce LLM API calls.
  * Uses LRU eviction when cache is full.
+ *
+ * Slots are addressed by index, so the table, the free list and both
+ * intrusive lists are plain ints into the entries slab.
  */
 
 #include "07-narrative-cache.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // {{{ Constants
 #define SIGNATURE_BUFFER_SIZE 256
+#define NO_SLOT (-1)
+// }}}
+
+// {{{ narrative_cache_hash_signature
+uint64_t narrative_cache_hash_signature(const char* signature) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*)signature; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
 // }}}
 
 // {{{ narrative_cache_init
@@ -25,15 +41,40 @@ NarrativeCache* narrative_cache_init(int max_entries, int ttl_seconds) {
         return NULL;
     }
 
+    // Power-of-two bucket count with load factor at most 1
+    int bucket_count = 16;
+    while (bucket_count < max_entries && bucket_count < (1 << 30)) {
+        bucket_count <<= 1;
+    }
+
     cache->entries = calloc(max_entries, sizeof(NarrativeCacheEntry));
-    if (cache->entries == NULL) {
+    cache->buckets = malloc(sizeof(int) * bucket_count);
+    if (cache->entries == NULL || cache->buckets == NULL) {
+        free(cache->entries);
+        free(cache->buckets);
         free(cache);
         return NULL;
     }
 
+    for (int i = 0; i < bucket_count; i++) {
+        cache->buckets[i] = NO_SLOT;
+    }
+    // Free list in slot order so the first entry lands in slot 0
+    for (int i = 0; i < max_entries; i++) {
+        cache->entries[i].hash_next = (i + 1 < max_entries) ? i + 1 : NO_SLOT;
+    }
+
     cache->count = 0;
     cache->max_entries = max_entries;
     cache->ttl_seconds = ttl_seconds;
+    cache->bytes = 0;
+    cache->max_bytes = 0;
+    cache->bucket_mask = bucket_count - 1;
+    cache->free_head = 0;
+    cache->lru_head = NO_SLOT;
+    cache->lru_tail = NO_SLOT;
+    cache->age_head = NO_SLOT;
+    cache->age_tail = NO_SLOT;
     cache->hits = 0;
     cache->misses = 0;
     cache->evictions = 0;
@@ -49,84 +90,176 @@ void narrative_cache_free(NarrativeCache* cache) {
         return;
     }
 
-    // Free all entry strings
-    for (int i = 0; i < cache->count; i++) {
-        free(cache->entries[i].signature);
-        free(cache->entries[i].narrative);
-    }
-
+    narrative_cache_clear(cache);
+    free(cache->buckets);
     free(cache->entries);
     free(cache);
 }
 // }}}
 
+// {{{ List helpers
+// Intrusive doubly linked lists over slot indices. Each list is named
+// by its head/tail fields and the entry's prev/next fields.
+#define LIST_UNLINK(cache, slot, head, tail, prev, next) \
+    do { \
+        NarrativeCacheEntry* e_ = &(cache)->entries[slot]; \
+        if (e_->prev != NO_SLOT) { \
+            (cache)->entries[e_->prev].next = e_->next; \
+        } else { \
+            (cache)->head = e_->next; \
+        } \
+        if (e_->next != NO_SLOT) { \
+            (cache)->entries[e_->next].prev = e_->prev; \
+        } else { \
+            (cache)->tail = e_->prev; \
+        } \
+        e_->prev = NO_SLOT; \
+        e_->next = NO_SLOT; \
+    } while (0)
+
+#define LIST_PUSH_FRONT(cache, slot, head, tail, prev, next) \
+    do { \
+        NarrativeCacheEntry* e_ = &(cache)->entries[slot]; \
+        e_->prev = NO_SLOT; \
+        e_->next = (cache)->head; \
+        if ((cache)->head != NO_SLOT) { \
+            (cache)->entries[(cache)->head].prev = (slot); \
+        } else { \
+            (cache)->tail = (slot); \
+        } \
+        (cache)->head = (slot); \
+    } while (0)
+
+#define LIST_PUSH_BACK(cache, slot, head, tail, prev, next) \
+    do { \
+        NarrativeCacheEntry* e_ = &(cache)->entries[slot]; \
+        e_->next = NO_SLOT; \
+        e_->prev = (cache)->tail; \
+        if ((cache)->tail != NO_SLOT) { \
+            (cache)->entries[(cache)->tail].next = (slot); \
+        } else { \
+            (cache)->head = (slot); \
+        } \
+        (cache)->tail = (slot); \
+    } while (0)
+
+// Marks a slot most recently used
+static void touch_entry(NarrativeCache* cache, int slot) {
+    LIST_UNLINK(cache, slot, lru_head, lru_tail, lru_prev, lru_next);
+    LIST_PUSH_FRONT(cache, slot, lru_head, lru_tail, lru_prev, lru_next);
+}
+
+// Marks a slot newest in generation (expiry) order
+static void renew_entry(NarrativeCache* cache, int slot) {
+    LIST_UNLINK(cache, slot, age_head, age_tail, age_prev, age_next);
+    LIST_PUSH_BACK(cache, slot, age_head, age_tail, age_prev, age_next);
+}
+// }}}
+
+// {{{ entry_bytes
+// Memory charged for an entry: both strings plus its slot.
+static size_t entry_bytes(const char* signature, const char* narrative) {
+    return strlen(signature) + strlen(narrative) + 2 + sizeof(NarrativeCacheEntry);
+}
+// }}}
+
 // {{{ find_entry_index
-// Finds the index of an entry by signature.
+// Finds the slot of an entry by signature.
 // Returns -1 if not found.
 static int find_entry_index(NarrativeCache* cache, const char* signature) {
-    for (int i = 0; i < cache->count; i++) {
-        if (strcmp(cache->entries[i].signature, signature) == 0) {
-            return i;
+    uint64_t hash = narrative_cache_hash_signature(signature);
+    int slot = cache->buckets[hash & (uint64_t)cache->bucket_mask];
+
+    while (slot != NO_SLOT) {
+        NarrativeCacheEntry* entry = &cache->entries[slot];
+        if (entry->hash == hash && strcmp(entry->signature, signature) == 0) {
+            return slot;
         }
+        slot = entry->hash_next;
     }
-    return -1;
+    return NO_SLOT;
 }
 // }}}
 
 // {{{ is_entry_expired
 // Checks if an entry has expired based on TTL.
-static bool is_entry_expired(NarrativeCache* cache, NarrativeCacheEntry* entry) {
+static bool is_entry_expired(NarrativeCache* cache, NarrativeCacheEntry* entry,
+                             time_t now) {
     if (cache->ttl_seconds <= 0) {
         return false;  // No expiration
     }
 
-    time_t now = time(NULL);
     return (now - entry->generated_at) >= cache->ttl_seconds;
 }
 // }}}
 
-// {{{ find_lru_index
-// Finds the least recently used entry index.
-static int find_lru_index(NarrativeCache* cache) {
-    if (cache->count == 0) {
-        return -1;
+// {{{ remove_entry_at
+// Unlinks the entry in slot from the table and both lists, frees its
+// strings and returns the slot to the free list.
+static void remove_entry_at(NarrativeCache* cache, int slot) {
+    if (slot < 0 || slot >= cache->max_entries ||
+        cache->entries[slot].signature == NULL) {
+        return;
     }
 
-    int lru_idx = 0;
-    time_t oldest_time = cache->entries[0].last_used;
+    NarrativeCacheEntry* entry = &cache->entries[slot];
 
-    for (int i = 1; i < cache->count; i++) {
-        if (cache->entries[i].last_used < oldest_time) {
-            oldest_time = cache->entries[i].last_used;
-            lru_idx = i;
-        }
+    int* link = &cache->buckets[entry->hash & (uint64_t)cache->bucket_mask];
+    while (*link != slot) {
+        link = &cache->entries[*link].hash_next;
     }
+    *link = entry->hash_next;
 
-    return lru_idx;
+    LIST_UNLINK(cache, slot, lru_head, lru_tail, lru_prev, lru_next);
+    LIST_UNLINK(cache, slot, age_head, age_tail, age_prev, age_next);
+
+    free(entry->signature);
+    free(entry->narrative);
+    cache->bytes -= entry->bytes;
+    memset(entry, 0, sizeof(NarrativeCacheEntry));
+
+    entry->hash_next = cache->free_head;
+    cache->free_head = slot;
+    cache->count--;
 }
 // }}}
 
-// {{{ remove_entry_at
-// Removes entry at index and shifts remaining entries.
-static void remove_entry_at(NarrativeCache* cache, int index) {
-    if (index < 0 || index >= cache->count) {
-        return;
-    }
-
-    // Free strings
-    free(cache->entries[index].signature);
-    free(cache->entries[index].narrative);
+// {{{ evict_to_fit
+// Evicts least recently used entries, never the one in slot keep, until
+// the cache is within its limits once incoming more bytes (and, when
+// adding, one more entry) are stored.
+static void evict_to_fit(NarrativeCache* cache, size_t incoming, bool adding,
+                         int keep) {
+    for (;;) {
+        int needed = cache->count + (adding ? 1 : 0);
+        bool over_count = needed > cache->max_entries;
+        bool over_bytes = cache->max_bytes > 0 &&
+                          cache->bytes + incoming > cache->max_bytes;
+        if (!over_count && !over_bytes) {
+            return;
+        }
 
-    // Shift remaining entries
-    for (int i = index; i < cache->count - 1; i++) {
-        cache->entries[i] = cache->entries[i + 1];
+        int victim = cache->lru_tail;
+        if (victim != NO_SLOT && victim == keep) {
+            victim = cache->entries[victim].lru_prev;
+        }
+        if (victim == NO_SLOT) {
+            return;
+        }
+        remove_entry_at(cache, victim);
+        cache->evictions++;
     }
+}
+// }}}
 
-    cache->count--;
+// {{{ narrative_cache_set_max_bytes
+void narrative_cache_set_max_bytes(NarrativeCache* cache, size_t max_bytes) {
+    if (cache == NULL) {
+        return;
+    }
 
-    // Clear the now-unused slot
-    cache->entries[cache->count].signature = NULL;
-    cache->entries[cache->count].narrative = NULL;
+    cache->max_bytes = max_bytes;
+    evict_to_fit(cache, 0, false, NO_SLOT);
 }
 // }}}
 
@@ -143,9 +276,10 @@ const char* narrative_cache_get(NarrativeCache* cache, const char* signature) {
     }
 
     NarrativeCacheEntry* entry = &cache->entries[idx];
+    time_t now = time(NULL);
 
     // Check if expired
-    if (is_entry_expired(cache, entry)) {
+    if (is_entry_expired(cache, entry, now)) {
         remove_entry_at(cache, idx);
         cache->expirations++;
         cache->misses++;
@@ -153,18 +287,34 @@ const char* narrative_cache_get(NarrativeCache* cache, const char* signature) {
     }
 
     // Update access info
-    entry->last_used = time(NULL);
+    entry->last_used = now;
     entry->use_count++;
+    touch_entry(cache, idx);
     cache->hits++;
 
     return entry->narrative;
 }
 // }}}
 
-// {{{ narrative_cache_set
-bool narrative_cache_set(NarrativeCache* cache, const char* signature,
-                          const char* narrative) {
-    if (cache == NULL || signature == NULL || narrative == NULL) {
+// {{{ narrative_cache_contains
+bool narrative_cache_contains(NarrativeCache* cache, const char* signature) {
+    if (cache == NULL || signature == NULL) {
+        return false;
+    }
+
+    int idx = find_entry_index(cache, signature);
+    return idx != NO_SLOT &&
+           !is_entry_expired(cache, &cache->entries[idx], time(NULL));
+}
+// }}}
+
+// {{{ store_entry
+// Inserts or updates an entry generated at now (which must not precede
+// the newest entry's generation time, keeping the age list sorted).
+static bool store_entry(NarrativeCache* cache, const char* signature,
+                        const char* narrative, time_t now) {
+    size_t bytes = entry_bytes(signature, narrative);
+    if (cache->max_bytes > 0 && bytes > cache->max_bytes) {
         return false;
     }
 
@@ -172,44 +322,94 @@ bool narrative_cache_set(NarrativeCache* cache, const char* signature,
     int existing_idx = find_entry_index(cache, signature);
     if (existing_idx >= 0) {
         // Update existing entry
-        free(cache->entries[existing_idx].narrative);
-        cache->entries[existing_idx].narrative = strdup(narrative);
-        cache->entries[existing_idx].generated_at = time(NULL);
-        cache->entries[existing_idx].last_used = time(NULL);
-        return cache->entries[existing_idx].narrative != NULL;
-    }
-
-    // Need to add new entry - check if we need to evict
-    if (cache->count >= cache->max_entries) {
-        int lru_idx = find_lru_index(cache);
-        if (lru_idx >= 0) {
-            remove_entry_at(cache, lru_idx);
-            cache->evictions++;
+        NarrativeCacheEntry* entry = &cache->entries[existing_idx];
+        char* copy = strdup(narrative);
+        if (copy == NULL) {
+            return false;
         }
+        free(entry->narrative);
+        entry->narrative = copy;
+        cache->bytes = cache->bytes - entry->bytes + bytes;
+        entry->bytes = bytes;
+        entry->generated_at = now;
+        entry->last_used = now;
+        touch_entry(cache, existing_idx);
+        renew_entry(cache, existing_idx);
+        evict_to_fit(cache, 0, false, existing_idx);
+        return true;
     }
 
-    // Add new entry
-    NarrativeCacheEntry* entry = &cache->entries[cache->count];
-    entry->signature = strdup(signature);
-    entry->narrative = strdup(narrative);
+    // Need to add new entry - evict until it fits
+    evict_to_fit(cache, bytes, true, NO_SLOT);
 
-    if (entry->signature == NULL || entry->narrative == NULL) {
-        free(entry->signature);
-        free(entry->narrative);
-        entry->signature = NULL;
-        entry->narrative = NULL;
+    char* sig_copy = strdup(signature);
+    char* narrative_copy = strdup(narrative);
+    if (sig_copy == NULL || narrative_copy == NULL) {
+        free(sig_copy);
+        free(narrative_copy);
         return false;
     }
 
-    entry->generated_at = time(NULL);
-    entry->last_used = time(NULL);
+    // Add new entry
+    int slot = cache->free_head;
+    NarrativeCacheEntry* entry = &cache->entries[slot];
+    cache->free_head = entry->hash_next;
+
+    entry->signature = sig_copy;
+    entry->narrative = narrative_copy;
+    entry->generated_at = now;
+    entry->last_used = now;
     entry->use_count = 0;
+    entry->hash = narrative_cache_hash_signature(signature);
+    entry->bytes = bytes;
+
+    int* bucket = &cache->buckets[entry->hash & (uint64_t)cache->bucket_mask];
+    entry->hash_next = *bucket;
+    *bucket = slot;
+
+    entry->lru_prev = entry->lru_next = NO_SLOT;
+    entry->age_prev = entry->age_next = NO_SLOT;
+    LIST_PUSH_FRONT(cache, slot, lru_head, lru_tail, lru_prev, lru_next);
+    LIST_PUSH_BACK(cache, slot, age_head, age_tail, age_prev, age_next);
 
+    cache->bytes += bytes;
     cache->count++;
     return true;
 }
 // }}}
 
+// {{{ narrative_cache_set
+bool narrative_cache_set(NarrativeCache* cache, const char* signature,
+                          const char* narrative) {
+    if (cache == NULL || signature == NULL || narrative == NULL) {
+        return false;
+    }
+
+    return store_entry(cache, signature, narrative, time(NULL));
+}
+// }}}
+
+// {{{ narrative_cache_restore
+bool narrative_cache_restore(NarrativeCache* cache, const char* signature,
+                             const char* narrative, time_t generated_at) {
+    if (cache == NULL || signature == NULL || narrative == NULL) {
+        return false;
+    }
+
+    // Expired already, or older than what is cached: nothing to restore
+    time_t now = time(NULL);
+    if (cache->ttl_seconds > 0 && now - generated_at >= cache->ttl_seconds) {
+        return false;
+    }
+    if (cache->age_tail != NO_SLOT &&
+        generated_at < cache->entries[cache->age_tail].generated_at) {
+        generated_at = cache->entries[cache->age_tail].generated_at;
+    }
+
+    return store_entry(cache, signature, narrative, generated_at);
+}
+// }}}
+
 // {{{ narrative_cache_remove
 bool narrative_cache_remove(NarrativeCache* cache, const char* signature) {
     if (cache == NULL || signature == NULL) {
@@ -233,14 +433,9 @@ void narrative_cache_clear(NarrativeCache* cache) {
     }
 
     // Free all entries
-    for (int i = 0; i < cache->count; i++) {
-        free(cache->entries[i].signature);
-        free(cache->entries[i].narrative);
-        cache->entries[i].signature = NULL;
-        cache->entries[i].narrative = NULL;
+    while (cache->lru_head != NO_SLOT) {
+        remove_entry_at(cache, cache->lru_head);
     }
-
-    cache->count = 0;
 }
 // }}}
 
@@ -388,6 +583,264 @@ char* event_build_signature(NarrationEvent* event) {
 }
 // }}}
 
+// {{{ amount_bucket
+// Coarse label for a damage, cost or authority value.
+static const char* amount_bucket(int amount) {
+    if (amount <= 0) return "none";
+    if (amount <= 2) return "light";
+    if (amount <= 5) return "solid";
+    if (amount <= 9) return "heavy";
+    return "massive";
+}
+// }}}
+
+// {{{ turn_bucket
+static const char* turn_bucket(int turn) {
+    if (turn <= 3) return "early";
+    if (turn <= 10) return "mid";
+    return "late";
+}
+// }}}
+
+// {{{ event_build_template_signature
+char* event_build_template_signature(NarrationEvent* event) {
+    if (event == NULL) {
+        return NULL;
+    }
+
+    char buffer[SIGNATURE_BUFFER_SIZE];
+    const char* type_str = event_type_to_string(event->type);
+    const char* intensity = event_narration_get_intensity_word(event->intensity);
+
+    // The card or base the moment is about, if any
+    CardInstance* subject = NULL;
+    switch (event->type) {
+        case GAME_EVENT_ATTACK_BASE:
+        case GAME_EVENT_BASE_DESTROYED:
+            subject = event->base;
+            break;
+        case GAME_EVENT_ATTACK_PLAYER:
+        case GAME_EVENT_TURN_START:
+        case GAME_EVENT_TURN_END:
+        case GAME_EVENT_GAME_OVER:
+            break;
+        default:
+            subject = event->card;
+            break;
+    }
+
+    int len;
+    if (subject != NULL && subject->type != NULL) {
+        len = snprintf(buffer, sizeof(buffer), "%s:%s:%s:%s", type_str,
+                       subject->type->name ? subject->type->name : "unknown",
+                       faction_to_string(subject->type->faction), intensity);
+    } else {
+        len = snprintf(buffer, sizeof(buffer), "%s:%s", type_str, intensity);
+    }
+    if (len < 0 || (size_t)len >= sizeof(buffer)) {
+        len = (int)strlen(buffer);
+    }
+
+    // Numbers only matter to the narration in broad strokes
+    switch (event->type) {
+        case GAME_EVENT_ATTACK_PLAYER:
+        case GAME_EVENT_ATTACK_BASE:
+        case GAME_EVENT_GAME_OVER:  // final_authority stored in damage
+            snprintf(buffer + len, sizeof(buffer) - len, ":%s",
+                     amount_bucket(event->damage));
+            break;
+        case GAME_EVENT_TURN_START:
+        case GAME_EVENT_TURN_END:
+            snprintf(buffer + len, sizeof(buffer) - len, ":%s",
+                     turn_bucket(event->turn));
+            break;
+        default:
+            break;
+    }
+
+    return strdup(buffer);
+}
+// }}}
+
+// {{{ is_word_byte
+// Letters, digits, underscores and UTF-8 bytes continue a word.
+static bool is_word_byte(char c) {
+    unsigned char u = (unsigned char)c;
+    return isalnum(u) || u == '_' || u >= 0x80;
+}
+// }}}
+
+// {{{ match_at
+// Returns the length of needle if it occurs at text + pos, and, with
+// whole_words, does not run into a word on either side; 0 otherwise.
+// Edges of needle that are not word bytes need no boundary.
+static size_t match_at(const char* text, size_t pos, const char* needle,
+                       bool whole_words) {
+    size_t len = strlen(needle);
+    if (len == 0 || strncmp(text + pos, needle, len) != 0) {
+        return 0;
+    }
+    if (whole_words) {
+        if (pos > 0 && is_word_byte(needle[0]) && is_word_byte(text[pos - 1])) {
+            return 0;
+        }
+        if (is_word_byte(needle[len - 1]) && is_word_byte(text[pos + len])) {
+            return 0;
+        }
+    }
+    return len;
+}
+// }}}
+
+// {{{ substitute
+// Returns a copy of text with each occurrence of needles[i] replaced by
+// replacements[i], in one pass over text: replacements are never
+// searched again. At any position the longer needle wins, so a name
+// containing the other survives intact. NULL or empty needles are
+// skipped.
+static char* substitute(const char* text, const char* needles[2],
+                        const char* replacements[2], bool whole_words) {
+    int order[2] = { 0, 1 };
+    if (needles[0] != NULL && needles[1] != NULL &&
+        strlen(needles[1]) > strlen(needles[0])) {
+        order[0] = 1;
+        order[1] = 0;
+    }
+
+    // First pass sizes the output, second writes it
+    char* out = NULL;
+    size_t out_len = 0;
+    for (int write = 0; write < 2; write++) {
+        size_t w = 0;
+        size_t pos = 0;
+        while (text[pos] != '\0') {
+            size_t matched = 0;
+            int which = 0;
+            for (int k = 0; k < 2 && matched == 0; k++) {
+                which = order[k];
+                if (needles[which] != NULL) {
+                    matched = match_at(text, pos, needles[which], whole_words);
+                }
+            }
+
+            if (matched > 0) {
+                size_t len = strlen(replacements[which]);
+                if (write) {
+                    memcpy(out + w, replacements[which], len);
+                }
+                w += len;
+                pos += matched;
+            } else {
+                if (write) {
+                    out[w] = text[pos];
+                }
+                w++;
+                pos++;
+            }
+        }
+
+        if (!write) {
+            out_len = w;
+            out = malloc(out_len + 1);
+            if (out == NULL) {
+                return NULL;
+            }
+        }
+    }
+    out[out_len] = '\0';
+
+    return out;
+}
+// }}}
+
+// {{{ player_name
+// Returns the player's name, or NULL for a missing or empty one.
+static const char* player_name(const Player* player) {
+    if (player == NULL || player->name == NULL || player->name[0] == '\0') {
+        return NULL;
+    }
+    return player->name;
+}
+// }}}
+
+// {{{ narrative_templatize
+char* narrative_templatize(const char* narrative, const NarrationEvent* event) {
+    if (narrative == NULL) {
+        return NULL;
+    }
+    if (event == NULL) {
+        return strdup(narrative);
+    }
+
+    // Whole words only, so "Al" leaves "Always" alone
+    const char* names[2] = { player_name(event->actor), player_name(event->target) };
+    const char* placeholders[2] = {
+        NARRATIVE_ACTOR_PLACEHOLDER, NARRATIVE_TARGET_PLACEHOLDER
+    };
+    return substitute(narrative, names, placeholders, true);
+}
+// }}}
+
+// {{{ narrative_fill_template
+char* narrative_fill_template(const char* template_text, const NarrationEvent* event) {
+    if (template_text == NULL) {
+        return NULL;
+    }
+
+    const char* actor = "someone";
+    const char* target = "someone";
+    if (event != NULL && event->actor != NULL && event->actor->name != NULL) {
+        actor = event->actor->name;
+    }
+    if (event != NULL && event->target != NULL && event->target->name != NULL) {
+        target = event->target->name;
+    }
+
+    // One pass, so a name that looks like a placeholder stays a name
+    const char* placeholders[2] = {
+        NARRATIVE_ACTOR_PLACEHOLDER, NARRATIVE_TARGET_PLACEHOLDER
+    };
+    const char* names[2] = { actor, target };
+    return substitute(template_text, placeholders, names, false);
+}
+// }}}
+
+// {{{ narrative_cache_get_event
+char* narrative_cache_get_event(NarrativeCache* cache, NarrationEvent* event) {
+    if (cache == NULL || event == NULL) {
+        return NULL;
+    }
+
+    char* signature = event_build_template_signature(event);
+    if (signature == NULL) {
+        return NULL;
+    }
+
+    const char* template_text = narrative_cache_get(cache, signature);
+    free(signature);
+
+    return template_text != NULL ? narrative_fill_template(template_text, event) : NULL;
+}
+// }}}
+
+// {{{ narrative_cache_set_event
+bool narrative_cache_set_event(NarrativeCache* cache, NarrationEvent* event,
+                               const char* narrative) {
+    if (cache == NULL || event == NULL || narrative == NULL) {
+        return false;
+    }
+
+    char* signature = event_build_template_signature(event);
+    char* template_text = narrative_templatize(narrative, event);
+    bool ok = signature != NULL && template_text != NULL &&
+              narrative_cache_set(cache, signature, template_text);
+
+    free(signature);
+    free(template_text);
+    return ok;
+}
+// }}}
+
 // {{{ narrative_cache_cleanup_expired
 int narrative_cache_cleanup_expired(NarrativeCache* cache) {
     if (cache == NULL || cache->ttl_seconds <= 0) {
@@ -395,14 +848,14 @@ int narrative_cache_cleanup_expired(NarrativeCache* cache) {
     }
 
     int removed = 0;
+    time_t now = time(NULL);
 
-    // Iterate backwards to safely remove entries
-    for (int i = cache->count - 1; i >= 0; i--) {
-        if (is_entry_expired(cache, &cache->entries[i])) {
-            remove_entry_at(cache, i);
-            cache->expirations++;
-            removed++;
-        }
+    // Oldest generation first; stop at the first live entry
+    while (cache->age_head != NO_SLOT &&
+           is_entry_expired(cache, &cache->entries[cache->age_head], now)) {
+        remove_entry_at(cache, cache->age_head);
+        cache->expirations++;
+        removed++;
     }
 
     return removed;
@@ -3,12 +3,21 @@
  *
  * Caches generated narratives by event signature to avoid
  * redundant LLM calls. Supports TTL expiration and LRU eviction.
+ *
+ * Entries live in a fixed slab of max_entries slots. A hash table on
+ * the 64-bit signature hash gives O(1) lookup, and two intrusive lists
+ * thread through the slots: one in recency order for LRU eviction and
+ * one in generation order for expiry. Because every entry shares the
+ * cache's TTL, generation order is expiry order, so expired entries
+ * are always at the head of that list.
  */
 
 #ifndef LLM_NARRATIVE_CACHE_H
 #define LLM_NARRATIVE_CACHE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include "05-event-narration.h"
 
@@ -20,6 +29,13 @@ typedef struct {
     time_t generated_at;  // When this narrative was generated
     time_t last_used;     // When this entry was last accessed
     int use_count;        // Number of cache hits
+    uint64_t hash;        // Signature hash
+    size_t bytes;         // Memory charged against max_bytes
+    int hash_next;        // Next slot in the bucket chain (or free list)
+    int lru_prev;         // Recency list, most recently used at head
+    int lru_next;
+    int age_prev;         // Generation list, oldest at head
+    int age_next;
 } NarrativeCacheEntry;
 // }}}
 
@@ -38,10 +54,19 @@ typedef struct {
 // {{{ NarrativeCache
 // The narrative cache manager.
 typedef struct {
-    NarrativeCacheEntry* entries;
+    NarrativeCacheEntry* entries;  // Slab of max_entries slots
     int count;
     int max_entries;
     int ttl_seconds;      // Time-to-live for entries (0 = no expiration)
+    size_t bytes;         // Memory used by live entries
+    size_t max_bytes;     // Memory budget (0 = bounded by max_entries only)
+    int* buckets;         // Hash buckets holding slot indices (-1 = empty)
+    int bucket_mask;
+    int free_head;        // First unused slot
+    int lru_head;
+    int lru_tail;
+    int age_head;
+    int age_tail;
     int hits;
     int misses;
     int evictions;
@@ -62,20 +87,43 @@ NarrativeCache* narrative_cache_init(int max_entries, int ttl_seconds);
 void narrative_cache_free(NarrativeCache* cache);
 // }}}
 
+// {{{ narrative_cache_set_max_bytes
+// Bounds the memory held by entries (signature, narrative and slot).
+// Evicts least recently used entries until the cache fits.
+// max_bytes: Budget in bytes (0 = no byte limit).
+void narrative_cache_set_max_bytes(NarrativeCache* cache, size_t max_bytes);
+// }}}
+
 // {{{ narrative_cache_get
 // Retrieves a cached narrative by signature.
 // Returns the narrative string (do NOT free), or NULL if not found/expired.
 const char* narrative_cache_get(NarrativeCache* cache, const char* signature);
 // }}}
 
+// {{{ narrative_cache_contains
+// Returns true if a live entry exists for signature, without counting
+// a hit or miss or refreshing its recency.
+bool narrative_cache_contains(NarrativeCache* cache, const char* signature);
+// }}}
+
 // {{{ narrative_cache_set
 // Stores a narrative in the cache.
-// If the cache is full, evicts the least recently used entry.
-// Returns true on success, false on failure.
+// If the cache is full (entries or bytes), evicts least recently used
+// entries. Returns true on success, false on failure or if the entry
+// alone exceeds max_bytes.
 bool narrative_cache_set(NarrativeCache* cache, const char* signature,
                           const char* narrative);
 // }}}
 
+// {{{ narrative_cache_restore
+// Stores an entry generated earlier, e.g. when replaying a saved cache.
+// generated_at is kept (so the TTL runs from the original generation),
+// clamped so it never precedes the newest cached entry; restore in
+// generation order. Returns false if the entry has already expired.
+bool narrative_cache_restore(NarrativeCache* cache, const char* signature,
+                             const char* narrative, time_t generated_at);
+// }}}
+
 // {{{ narrative_cache_remove
 // Removes an entry from the cache by signature.
 // Returns true if entry was found and removed.
@@ -104,6 +152,59 @@ void narrative_cache_reset_stats(NarrativeCache* cache);
 char* event_build_signature(NarrationEvent* event);
 // }}}
 
+// {{{ Template placeholders
+// Stand-ins for player names in narration stored under a template
+// signature; filled back in at delivery time.
+#define NARRATIVE_ACTOR_PLACEHOLDER "{actor}"
+#define NARRATIVE_TARGET_PLACEHOLDER "{target}"
+// }}}
+
+// {{{ event_build_template_signature
+// Builds a signature that does not depend on who is playing, so the
+// same moment in different games shares one cache entry. Player names
+// are reduced to their roles, damage, cost and turn are bucketed, and
+// the card's faction and the event's intensity are included.
+// e.g. "card played:Dire Bear:wilds:medium"
+// Caller must free the returned string.
+// Returns NULL on allocation failure.
+char* event_build_template_signature(NarrationEvent* event);
+// }}}
+
+// {{{ narrative_templatize
+// Replaces the event's actor and target names in narrative with
+// placeholders, ready to be stored under a template signature. Names
+// match as whole words only, in one pass over narrative.
+// Caller must free the returned string.
+char* narrative_templatize(const char* narrative, const NarrationEvent* event);
+// }}}
+
+// {{{ narrative_fill_template
+// Replaces placeholders in a templated narrative with the event's actor
+// and target names (missing players read as "someone").
+// Caller must free the returned string.
+char* narrative_fill_template(const char* template_text, const NarrationEvent* event);
+// }}}
+
+// {{{ narrative_cache_get_event
+// Looks up the event under its template signature and returns the
+// narrative with this event's names filled in. Caller must free.
+// Returns NULL on a miss.
+char* narrative_cache_get_event(NarrativeCache* cache, NarrationEvent* event);
+// }}}
+
+// {{{ narrative_cache_set_event
+// Templatizes narrative and stores it under the event's template
+// signature. Returns true on success.
+bool narrative_cache_set_event(NarrativeCache* cache, NarrationEvent* event,
+                               const char* narrative);
+// }}}
+
+// {{{ narrative_cache_hash_signature
+// Returns the 64-bit hash the cache uses for a signature (FNV-1a).
+// Exposed so callers can shard on the same hash.
+uint64_t narrative_cache_hash_signature(const char* signature);
+// }}}
+
 // {{{ narrative_cache_cleanup_expired
 // Removes all expired entries from the cache.
 // Returns the number of entries removed.
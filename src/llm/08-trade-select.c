@@ -6,11 +6,17 @@
  * narrative fit to create interesting marketplace situations.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "08-trade-select.h"
+#include "16-scheduler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 /* Scoring weights for candidate selection */
 #define WEIGHT_FACTION_NEED  0.30f
@@ -28,6 +34,21 @@ static const char* TRADE_SELECT_SYSTEM =
     "- Narrative drama (exciting cards at climactic moments)\n"
     "Respond with ONLY the card name, nothing else.";
 
+/* {{{ TradeSelectPending
+ * One background LLM request, shared by the context and the async
+ * callback. Whichever drops the last reference frees it.
+ */
+struct TradeSelectPending {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int refs;
+    bool done;
+    bool scheduled;          /* Handle belongs to the scheduler */
+    LLMRequestHandle handle;
+    char* text;              /* Response text, NULL if the request failed */
+};
+/* }}} */
+
 /* {{{ trade_select_context_create */
 TradeSelectContext* trade_select_context_create(Game* game,
                                                   WorldState* world_state,
@@ -40,15 +61,57 @@ TradeSelectContext* trade_select_context_create(Game* game,
     ctx->llm_config = llm_config;
     ctx->use_llm = (llm_config != NULL);
     ctx->llm_weight = WEIGHT_NARRATIVE;
+    ctx->llm_budget_ms = TRADE_SELECT_DEFAULT_BUDGET_MS;
+    ctx->pending = NULL;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
 
     return ctx;
 }
 /* }}} */
 
+/* {{{ pending_release
+ * Helper: drops one reference to a background request.
+ */
+static void pending_release(TradeSelectPending* pending) {
+    pthread_mutex_lock(&pending->lock);
+    int refs = --pending->refs;
+    pthread_mutex_unlock(&pending->lock);
+    if (refs > 0) return;
+
+    pthread_cond_destroy(&pending->cond);
+    pthread_mutex_destroy(&pending->lock);
+    free(pending->text);
+    free(pending);
+}
+/* }}} */
+
+/* {{{ pending_cancel
+ * Helper: cancels a background request if it is still running and
+ * drops the context's reference.
+ */
+static void pending_cancel(TradeSelectPending* pending) {
+    pthread_mutex_lock(&pending->lock);
+    bool done = pending->done;
+    LLMRequestHandle handle = pending->handle;
+    pthread_mutex_unlock(&pending->lock);
+
+    /* Cancelling may run the callback on this thread */
+    if (!done) {
+        if (pending->scheduled) {
+            llm_scheduler_cancel(handle);
+        } else {
+            llm_async_cancel(handle);
+        }
+    }
+    pending_release(pending);
+}
+/* }}} */
+
 /* {{{ trade_select_context_free */
 void trade_select_context_free(TradeSelectContext* ctx) {
     if (!ctx) return;
     /* Note: Does NOT free game, world_state, or llm_config */
+    if (ctx->pending) pending_cancel(ctx->pending);
     free(ctx);
 }
 /* }}} */
@@ -380,6 +443,164 @@ int trade_select_best_candidate(CandidateCard* candidates, int count) {
 }
 /* }}} */
 
+/* {{{ on_llm_choice
+ * Async callback: stores the model's answer for the selector.
+ */
+static void on_llm_choice(LLMResponse* response, void* user) {
+    TradeSelectPending* pending = (TradeSelectPending*)user;
+
+    pthread_mutex_lock(&pending->lock);
+    if (response && response->success && response->text) {
+        pending->text = strdup(response->text);
+    }
+    pending->done = true;
+    pthread_cond_broadcast(&pending->cond);
+    pthread_mutex_unlock(&pending->lock);
+
+    llm_response_free(response);
+    pending_release(pending);
+}
+/* }}} */
+
+/* {{{ pending_start
+ * Helper: asks the LLM to choose among candidates in the background.
+ * Returns NULL if neither the scheduler nor the async engine took it.
+ */
+static TradeSelectPending* pending_start(TradeSelectContext* ctx,
+                                         CandidateCard* candidates, int count) {
+    if (count <= 0) return NULL;
+
+    char* prompt = trade_select_build_prompt(candidates, count, ctx);
+    if (!prompt) return NULL;
+
+    TradeSelectPending* pending = calloc(1, sizeof(TradeSelectPending));
+    if (!pending) {
+        free(prompt);
+        return NULL;
+    }
+    pthread_mutex_init(&pending->lock, NULL);
+    pthread_cond_init(&pending->cond, NULL);
+    pending->refs = 2;  /* Context and callback */
+
+    LLMMessage messages[2] = {
+        { "system", (char*)TRADE_SELECT_SYSTEM },
+        { "user", prompt }
+    };
+
+    /* The callback may run before these return (e.g. a request the
+     * scheduler could not queue), so no lock is held here; only this
+     * thread reads handle */
+    if (llm_scheduler_running()) {
+        LLMScheduleOptions options = {
+            .request_class = LLM_CLASS_TRADE_SELECT,
+            .session = ctx->game,
+            .turn = -1
+        };
+        pending->scheduled = true;
+        pending->handle = llm_schedule(ctx->llm_config, messages, 2,
+                                       &options, on_llm_choice, pending);
+    } else {
+        pending->handle = llm_request_async(ctx->llm_config, messages, 2,
+                                            on_llm_choice, pending);
+    }
+    free(prompt);
+
+    if (pending->handle == LLM_REQUEST_INVALID) {
+        /* Not queued, so the callback will never run */
+        pending->refs = 1;
+        pending_release(pending);
+        return NULL;
+    }
+    return pending;
+}
+/* }}} */
+
+/* {{{ pending_wait
+ * Helper: waits up to budget_ms for the answer. Returns true if done.
+ */
+static bool pending_wait(TradeSelectPending* pending, int budget_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (budget_ms > 0) {
+        deadline.tv_sec += budget_ms / 1000;
+        deadline.tv_nsec += (long)(budget_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&pending->lock);
+    int rc = 0;
+    while (!pending->done && budget_ms > 0 && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&pending->cond, &pending->lock, &deadline);
+    }
+    bool done = pending->done;
+    pthread_mutex_unlock(&pending->lock);
+    return done;
+}
+/* }}} */
+
+/* {{{ pending_choice
+ * Helper: parses a finished answer against the current candidates.
+ * Sets *answered if the model gave any answer at all.
+ */
+static int pending_choice(TradeSelectPending* pending,
+                          CandidateCard* candidates, int count,
+                          bool* answered) {
+    /* done is set, so the callback no longer writes text */
+    *answered = (pending->text != NULL);
+    return trade_select_parse_response(pending->text, candidates, count);
+}
+/* }}} */
+
+/* {{{ trade_select_consult_llm
+ * Helper: returns the LLM's pick among candidates, or -1 to fall back
+ * to the heuristic scores. A choice that missed the previous refill's
+ * budget is used first; otherwise a new request gets llm_budget_ms.
+ */
+static int trade_select_consult_llm(TradeSelectContext* ctx,
+                                    CandidateCard* candidates, int count) {
+    int choice = -1;
+
+    if (ctx->pending) {
+        if (!pending_wait(ctx->pending, 0)) {
+            return -1;  /* Still answering an earlier refill */
+        }
+        bool answered = false;
+        choice = pending_choice(ctx->pending, candidates, count, &answered);
+        pending_release(ctx->pending);
+        ctx->pending = NULL;
+        if (choice >= 0) {
+            ctx->stats.llm_precomputed++;
+        } else if (answered) {
+            ctx->stats.llm_discarded++;
+        }
+    }
+
+    if (choice >= 0) {
+        /* Pre-compute the next refill without the card placed now */
+        CandidateCard rest[TRADE_SELECT_MAX_CANDIDATES];
+        int rest_count = 0;
+        for (int i = 0; i < count; i++) {
+            if (i != choice) rest[rest_count++] = candidates[i];
+        }
+        ctx->pending = pending_start(ctx, rest, rest_count);
+        return choice;
+    }
+
+    ctx->pending = pending_start(ctx, candidates, count);
+    if (ctx->pending && pending_wait(ctx->pending, ctx->llm_budget_ms)) {
+        bool answered = false;
+        choice = pending_choice(ctx->pending, candidates, count, &answered);
+        pending_release(ctx->pending);
+        ctx->pending = NULL;
+        if (choice >= 0) ctx->stats.llm_in_budget++;
+    }
+    return choice;
+}
+/* }}} */
+
 /* {{{ trade_select_dm_callback */
 CardType* trade_select_dm_callback(TradeRow* row, void* context) {
     TradeSelectContext* ctx = (TradeSelectContext*)context;
@@ -397,32 +618,23 @@ CardType* trade_select_dm_callback(TradeRow* row, void* context) {
         trade_select_score_candidate(&candidates[i], row, ctx);
     }
 
-    /* Try LLM selection if enabled */
+    /* Try LLM selection if enabled; never waits past the budget */
+    int llm_choice = -1;
     if (ctx->use_llm && ctx->llm_config) {
-        char* prompt = trade_select_build_prompt(candidates, count, ctx);
-        if (prompt) {
-            LLMResponse* response = llm_request(ctx->llm_config,
-                                                 TRADE_SELECT_SYSTEM,
-                                                 prompt);
-            free(prompt);
-
-            if (response && response->success && response->text) {
-                int llm_choice = trade_select_parse_response(response->text,
-                                                              candidates, count);
-                if (llm_choice >= 0) {
-                    /* LLM made a valid selection */
-                    candidates[llm_choice].score.narrative_fit = 1.0f;
-                    /* Recalculate total with narrative boost */
-                    candidates[llm_choice].score.total =
-                        candidates[llm_choice].score.faction_need * WEIGHT_FACTION_NEED +
-                        candidates[llm_choice].score.singleton_bonus * WEIGHT_SINGLETON +
-                        candidates[llm_choice].score.cost_variety * WEIGHT_COST_VARIETY +
-                        1.0f * ctx->llm_weight;  /* Full narrative bonus */
-                }
-            }
+        llm_choice = trade_select_consult_llm(ctx, candidates, count);
+    }
 
-            if (response) llm_response_free(response);
-        }
+    if (llm_choice >= 0) {
+        /* LLM made a valid selection */
+        candidates[llm_choice].score.narrative_fit = 1.0f;
+        /* Recalculate total with narrative boost */
+        candidates[llm_choice].score.total =
+            candidates[llm_choice].score.faction_need * WEIGHT_FACTION_NEED +
+            candidates[llm_choice].score.singleton_bonus * WEIGHT_SINGLETON +
+            candidates[llm_choice].score.cost_variety * WEIGHT_COST_VARIETY +
+            1.0f * ctx->llm_weight;  /* Full narrative bonus */
+    } else {
+        ctx->stats.heuristic++;
     }
 
     /* Select best candidate by total score */
@@ -4,6 +4,11 @@
  * Implements LLM-guided trade row card selection. When a slot opens
  * in the trade row, the DM can select which card to place based on
  * game state, faction balance, and narrative considerations.
+ *
+ * Refills never block on the model. Candidates are scored with the
+ * local heuristics at once while the LLM is asked in the background;
+ * its choice is used if it arrives within llm_budget_ms, otherwise it
+ * is kept and applied to the next refill if the card is still on offer.
  */
 
 #ifndef LLM_TRADE_SELECT_H
@@ -18,6 +23,9 @@
 /* Maximum candidates to consider per selection */
 #define TRADE_SELECT_MAX_CANDIDATES 10
 
+/* Default time a refill waits for the LLM choice */
+#define TRADE_SELECT_DEFAULT_BUDGET_MS 150
+
 /* {{{ FactionBalance
  * Tracks faction representation in the current trade row
  * for balanced card selection.
@@ -53,6 +61,19 @@ typedef struct {
 } CandidateCard;
 /* }}} */
 
+/* {{{ TradeSelectStats
+ * How refills were decided since the context was created.
+ */
+typedef struct {
+    int llm_in_budget;       /* LLM choice arrived within the budget */
+    int llm_precomputed;     /* Late LLM choice applied to a later refill */
+    int heuristic;           /* Decided by local scoring alone */
+    int llm_discarded;       /* Late choice no longer among the candidates */
+} TradeSelectStats;
+/* }}} */
+
+typedef struct TradeSelectPending TradeSelectPending;
+
 /* {{{ TradeSelectContext
  * Context passed to the DM selection callback.
  * Contains game state and LLM configuration.
@@ -63,6 +84,9 @@ typedef struct {
     LLMConfig* llm_config;   /* LLM API configuration */
     bool use_llm;            /* True to use LLM, false for scoring only */
     float llm_weight;        /* Weight for LLM narrative score (0.0-1.0) */
+    int llm_budget_ms;       /* Longest a refill waits for the LLM (0 = never) */
+    TradeSelectPending* pending; /* Background LLM request, if any */
+    TradeSelectStats stats;
 } TradeSelectContext;
 /* }}} */
 
@@ -78,7 +102,7 @@ TradeSelectContext* trade_select_context_create(Game* game,
 /* }}} */
 
 /* {{{ trade_select_context_free
- * Frees selection context memory.
+ * Frees selection context memory and cancels a pending LLM request.
  * Does NOT free game, world_state, or llm_config.
  */
 void trade_select_context_free(TradeSelectContext* ctx);
@@ -87,6 +111,9 @@ void trade_select_context_free(TradeSelectContext* ctx);
 /* {{{ trade_select_dm_callback
  * DM callback function for trade row selection.
  * Install with trade_row_set_dm(row, trade_select_dm_callback, context).
+ * The LLM is asked through the scheduler, or the async engine when the
+ * scheduler is not running; without either, selection is heuristic.
+ * Waits at most ctx->llm_budget_ms for the model.
  * @param row - The trade row
  * @param context - TradeSelectContext pointer
  * @return Selected card type, or NULL for random selection
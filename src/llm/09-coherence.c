@@ -4,9 +4,15 @@
  * Detects and recovers from narrative inconsistencies by comparing
  * LLM output against game state. Uses pattern matching for detection
  * and world state rebuild for recovery.
+ *
+ * Pattern ids pack a kind in the low bits and an index (player, card)
+ * above them, so one scan callback can sort every match.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "09-coherence.h"
+#include "16-scheduler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,6 +38,48 @@ static const char* FACTION_KEYWORDS[] = {
 };
 static const int FACTION_KEYWORD_COUNT = 12;
 
+/* Faction pairings that cannot name a single faction */
+static const char* FACTION_CONFLICTS[] = {
+    "merchant wilds", "kingdom artificer", "wilds kingdom"
+};
+static const int FACTION_CONFLICT_COUNT = 3;
+
+/* {{{ PatternKind
+ * What a compiled pattern stands for.
+ */
+typedef enum {
+    PATTERN_PLAYER_NAME,
+    PATTERN_PLAYER_REF,
+    PATTERN_FACTION_WORD,
+    PATTERN_FACTION_CONFLICT,
+    PATTERN_CARD_NAME,
+    PATTERN_TURN,
+    PATTERN_AUTHORITY,
+    PATTERN_HEALTH
+} PatternKind;
+
+#define PATTERN_KIND_BITS 4
+#define PATTERN_ID(kind, index) (((index) << PATTERN_KIND_BITS) | (kind))
+#define PATTERN_KIND(id) ((PatternKind)((id) & ((1 << PATTERN_KIND_BITS) - 1)))
+#define PATTERN_INDEX(id) ((id) >> PATTERN_KIND_BITS)
+/* }}} */
+
+/* {{{ CoherenceScan
+ * Everything one pass over a narrative found.
+ */
+typedef struct {
+    const char* text;
+    bool player_name[MAX_PLAYERS];
+    bool player_ref[MAX_PLAYERS];
+    bool faction_word;
+    bool faction_conflict;
+    int card_mentions;
+    long turn_pos;             /* First "turn", exact case, or -1 */
+    long authority_pos;        /* First "authority", exact case, or -1 */
+    long health_pos;           /* First "health", exact case, or -1 */
+} CoherenceScan;
+/* }}} */
+
 /* {{{ strdup_safe */
 static char* strdup_safe(const char* str) {
     if (str == NULL) return NULL;
@@ -63,17 +111,12 @@ static bool str_contains_ignore_case(const char* haystack, const char* needle) {
 }
 /* }}} */
 
-/* {{{ extract_number_near
- * Extracts a number that appears near a keyword in text.
+/* {{{ extract_number_at
+ * Extracts a number that appears near the keyword at pos in text.
  * Looks both before and after the keyword.
  * Returns -1 if not found.
  */
-static int extract_number_near(const char* text, const char* keyword) {
-    if (!text || !keyword) return -1;
-
-    const char* pos = strstr(text, keyword);
-    if (!pos) return -1;
-
+static int extract_number_at(const char* text, const char* pos, size_t keyword_len) {
     /* Look for number BEFORE keyword (within 20 chars) */
     const char* search_start = pos - 20;
     if (search_start < text) search_start = text;
@@ -85,7 +128,7 @@ static int extract_number_near(const char* text, const char* keyword) {
     }
 
     /* Look for number AFTER keyword */
-    pos += strlen(keyword);
+    pos += keyword_len;
     while (*pos && (isspace(*pos) || ispunct(*pos))) {
         pos++;
     }
@@ -97,6 +140,20 @@ static int extract_number_near(const char* text, const char* keyword) {
 }
 /* }}} */
 
+/* {{{ extract_number_near
+ * Extracts a number near the first occurrence of keyword in text.
+ * Returns -1 if not found.
+ */
+static int extract_number_near(const char* text, const char* keyword) {
+    if (!text || !keyword) return -1;
+
+    const char* pos = strstr(text, keyword);
+    if (!pos) return -1;
+
+    return extract_number_at(text, pos, strlen(keyword));
+}
+/* }}} */
+
 /* {{{ coherence_log_entry_free */
 static void coherence_log_entry_free(CoherenceLogEntry* entry) {
     if (!entry) return;
@@ -122,6 +179,8 @@ CoherenceManager* coherence_manager_create(LLMConfig* llm_config) {
     manager->total_recoveries = 0;
     manager->consecutive_issues = 0;
     manager->llm_config = llm_config;
+    manager->patterns = NULL;
+    manager->patterns_key = 0;
 
     return manager;
 }
@@ -135,6 +194,7 @@ void coherence_manager_free(CoherenceManager* manager) {
         coherence_log_entry_free(&manager->log[i]);
     }
     free(manager->log);
+    pattern_set_free(manager->patterns);
     /* Note: Does NOT free llm_config */
     free(manager);
 }
@@ -187,10 +247,10 @@ bool coherence_check_factions(const char* narrative) {
     /* If faction words present but we find impossible combinations */
     if (has_faction_word) {
         /* Check for contradictory pairings */
-        if (str_contains_ignore_case(narrative, "merchant wilds") ||
-            str_contains_ignore_case(narrative, "kingdom artificer") ||
-            str_contains_ignore_case(narrative, "wilds kingdom")) {
-            return false;
+        for (int i = 0; i < FACTION_CONFLICT_COUNT; i++) {
+            if (str_contains_ignore_case(narrative, FACTION_CONFLICTS[i])) {
+                return false;
+            }
         }
     }
 
@@ -198,13 +258,10 @@ bool coherence_check_factions(const char* narrative) {
 }
 /* }}} */
 
-/* {{{ coherence_check_timeline */
-bool coherence_check_timeline(const char* narrative, WorldState* world_state) {
-    if (!narrative || !world_state) return true;
-
-    /* Look for turn references in narrative */
-    int mentioned_turn = extract_number_near(narrative, "turn");
-
+/* {{{ turn_plausible
+ * Whether a turn number mentioned in a narrative fits the world state.
+ */
+static bool turn_number_plausible(int mentioned_turn, WorldState* world_state) {
     if (mentioned_turn > 0) {
         /* Turn mentioned should be close to actual turn */
         int diff = abs(mentioned_turn - world_state->turn_number);
@@ -218,16 +275,20 @@ bool coherence_check_timeline(const char* narrative, WorldState* world_state) {
 }
 /* }}} */
 
-/* {{{ coherence_check_authority */
-bool coherence_check_authority(const char* narrative, Game* game) {
-    if (!narrative || !game) return true;
+/* {{{ coherence_check_timeline */
+bool coherence_check_timeline(const char* narrative, WorldState* world_state) {
+    if (!narrative || !world_state) return true;
 
-    /* Look for authority references */
-    int mentioned_auth = extract_number_near(narrative, "authority");
-    if (mentioned_auth < 0) {
-        mentioned_auth = extract_number_near(narrative, "health");
-    }
+    /* Look for turn references in narrative */
+    return turn_number_plausible(extract_number_near(narrative, "turn"), world_state);
+}
+/* }}} */
 
+/* {{{ authority_plausible
+ * Whether an authority value mentioned in a narrative could belong to
+ * a player.
+ */
+static bool authority_value_plausible(int mentioned_auth, Game* game) {
     if (mentioned_auth > 0) {
         /* Check if any player is close to this value */
         bool plausible = false;
@@ -252,6 +313,210 @@ bool coherence_check_authority(const char* narrative, Game* game) {
 }
 /* }}} */
 
+/* {{{ coherence_check_authority */
+bool coherence_check_authority(const char* narrative, Game* game) {
+    if (!narrative || !game) return true;
+
+    /* Look for authority references */
+    int mentioned_auth = extract_number_near(narrative, "authority");
+    if (mentioned_auth < 0) {
+        mentioned_auth = extract_number_near(narrative, "health");
+    }
+
+    return authority_value_plausible(mentioned_auth, game);
+}
+/* }}} */
+
+/* {{{ hash_mix
+ * FNV-1a 64-bit over text and its terminator, so names do not run
+ * together.
+ */
+static uint64_t hash_mix(uint64_t hash, const char* text) {
+    const unsigned char* p = (const unsigned char*)(text ? text : "");
+    do {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    } while (*p++ != '\0');
+    return hash;
+}
+/* }}} */
+
+/* {{{ coherence_names_key
+ * Hashes everything coherence_build_patterns takes from game: player
+ * names in seat order and card names.
+ */
+static uint64_t coherence_names_key(Game* game) {
+    uint64_t hash = 14695981039346656037ULL;
+    if (!game) return hash;
+
+    char count[32];
+    snprintf(count, sizeof(count), "%d/%d", game->player_count, game->card_type_count);
+    hash = hash_mix(hash, count);
+    for (int i = 0; i < game->player_count && i < MAX_PLAYERS; i++) {
+        Player* player = game->players[i];
+        hash = hash_mix(hash, player ? player->name : NULL);
+    }
+    for (int i = 0; i < game->card_type_count; i++) {
+        CardType* type = game->card_types[i];
+        hash = hash_mix(hash, type ? type->name : NULL);
+    }
+    return hash;
+}
+/* }}} */
+
+/* {{{ coherence_build_patterns
+ * Builds and compiles the pattern set for game (NULL = no names).
+ */
+static PatternSet* coherence_build_patterns(Game* game) {
+    PatternSet* set = pattern_set_create();
+    if (!set) return NULL;
+
+    bool ok = true;
+    for (int i = 0; i < FACTION_KEYWORD_COUNT; i++) {
+        ok = ok && pattern_set_add(set, FACTION_KEYWORDS[i],
+                                   PATTERN_ID(PATTERN_FACTION_WORD, i));
+    }
+    for (int f = 0; f < FACTION_COUNT; f++) {
+        ok = ok && pattern_set_add(set, world_state_get_faction_name(f),
+                                   PATTERN_ID(PATTERN_FACTION_WORD, f));
+    }
+    for (int i = 0; i < FACTION_CONFLICT_COUNT; i++) {
+        ok = ok && pattern_set_add(set, FACTION_CONFLICTS[i],
+                                   PATTERN_ID(PATTERN_FACTION_CONFLICT, i));
+    }
+    ok = ok && pattern_set_add(set, "turn", PATTERN_ID(PATTERN_TURN, 0));
+    ok = ok && pattern_set_add(set, "authority", PATTERN_ID(PATTERN_AUTHORITY, 0));
+    ok = ok && pattern_set_add(set, "health", PATTERN_ID(PATTERN_HEALTH, 0));
+
+    if (game) {
+        for (int i = 0; i < game->player_count && i < MAX_PLAYERS && ok; i++) {
+            Player* player = game->players[i];
+            if (!player || !player->name) continue;
+
+            char player_ref[32];
+            snprintf(player_ref, sizeof(player_ref), "player %d", i + 1);
+            ok = pattern_set_add(set, player_ref, PATTERN_ID(PATTERN_PLAYER_REF, i));
+            /* An empty name is always "present"; see coherence_scan */
+            if (ok && player->name[0] != '\0') {
+                ok = pattern_set_add(set, player->name,
+                                     PATTERN_ID(PATTERN_PLAYER_NAME, i));
+            }
+        }
+        for (int i = 0; i < game->card_type_count && ok; i++) {
+            CardType* type = game->card_types[i];
+            if (type && type->name && type->name[0] != '\0') {
+                ok = pattern_set_add(set, type->name, PATTERN_ID(PATTERN_CARD_NAME, i));
+            }
+        }
+    }
+
+    if (!ok || !pattern_set_compile(set)) {
+        pattern_set_free(set);
+        return NULL;
+    }
+    return set;
+}
+/* }}} */
+
+/* {{{ coherence_compile_patterns */
+bool coherence_compile_patterns(CoherenceManager* manager, Game* game) {
+    if (!manager) return false;
+
+    PatternSet* set = coherence_build_patterns(game);
+    if (!set) return false;
+
+    pattern_set_free(manager->patterns);
+    manager->patterns = set;
+    manager->patterns_key = coherence_names_key(game);
+    return true;
+}
+/* }}} */
+
+/* {{{ coherence_on_match
+ * Records one match into a CoherenceScan. Markers keep the exact-case
+ * first occurrence that extract_number_near would find.
+ */
+static bool coherence_on_match(int id, size_t start, size_t length, void* user_data) {
+    CoherenceScan* scan = user_data;
+    const char* at = scan->text + start;
+    int index = PATTERN_INDEX(id);
+
+    switch (PATTERN_KIND(id)) {
+        case PATTERN_PLAYER_NAME:
+            scan->player_name[index] = true;
+            break;
+        case PATTERN_PLAYER_REF:
+            scan->player_ref[index] = true;
+            break;
+        case PATTERN_FACTION_WORD:
+            scan->faction_word = true;
+            break;
+        case PATTERN_FACTION_CONFLICT:
+            scan->faction_conflict = true;
+            break;
+        case PATTERN_CARD_NAME:
+            scan->card_mentions++;
+            break;
+        case PATTERN_TURN:
+            if (scan->turn_pos < 0 && memcmp(at, "turn", length) == 0) {
+                scan->turn_pos = (long)start;
+            }
+            break;
+        case PATTERN_AUTHORITY:
+            if (scan->authority_pos < 0 && memcmp(at, "authority", length) == 0) {
+                scan->authority_pos = (long)start;
+            }
+            break;
+        case PATTERN_HEALTH:
+            if (scan->health_pos < 0 && memcmp(at, "health", length) == 0) {
+                scan->health_pos = (long)start;
+            }
+            break;
+    }
+    return true;
+}
+/* }}} */
+
+/* {{{ coherence_scan
+ * Scans narrative once with the manager's patterns, compiling them
+ * first unless they were built from the same names as game's. Without a manager a temporary set is used.
+ */
+static bool coherence_scan(CoherenceManager* manager, const char* narrative,
+                           Game* game, CoherenceScan* scan) {
+    memset(scan, 0, sizeof(*scan));
+    scan->text = narrative;
+    scan->turn_pos = -1;
+    scan->authority_pos = -1;
+    scan->health_pos = -1;
+
+    if (game) {
+        for (int i = 0; i < game->player_count && i < MAX_PLAYERS; i++) {
+            Player* player = game->players[i];
+            scan->player_name[i] = player && player->name && player->name[0] == '\0';
+        }
+    }
+
+    PatternSet* set;
+    if (manager) {
+        if (!manager->patterns ||
+            manager->patterns_key != coherence_names_key(game)) {
+            if (!coherence_compile_patterns(manager, game)) return false;
+        }
+        set = manager->patterns;
+    } else {
+        set = coherence_build_patterns(game);
+        if (!set) return false;
+    }
+
+    pattern_set_scan(set, narrative, coherence_on_match, scan);
+
+    if (!manager) {
+        pattern_set_free(set);
+    }
+    return true;
+}
+/* }}} */
+
 /* {{{ coherence_calculate_score */
 static float coherence_calculate_score(CoherenceCheck* check) {
     float score = 0.0f;
@@ -339,11 +604,43 @@ CoherenceCheck* coherence_check(CoherenceManager* manager,
     CoherenceCheck* check = malloc(sizeof(CoherenceCheck));
     if (!check) return NULL;
 
-    /* Perform individual checks */
-    check->names_consistent = coherence_check_names(narrative, game);
-    check->faction_consistent = coherence_check_factions(narrative);
-    check->timeline_consistent = coherence_check_timeline(narrative, world_state);
-    check->authority_plausible = coherence_check_authority(narrative, game);
+    /* One pass finds every pattern; fall back to individual checks */
+    CoherenceScan scan;
+    if (narrative && coherence_scan(manager, narrative, game, &scan)) {
+        check->names_consistent = true;
+        for (int i = 0; game && i < game->player_count && i < MAX_PLAYERS; i++) {
+            if (scan.player_ref[i] && !scan.player_name[i]) {
+                check->names_consistent = false;
+            }
+        }
+        check->faction_consistent = !(scan.faction_word && scan.faction_conflict);
+        int mentioned_turn = -1;
+        if (scan.turn_pos >= 0) {
+            mentioned_turn = extract_number_at(narrative, narrative + scan.turn_pos,
+                                               strlen("turn"));
+        }
+        check->timeline_consistent = !world_state ||
+                                     turn_number_plausible(mentioned_turn, world_state);
+
+        int mentioned_auth = -1;
+        if (scan.authority_pos >= 0) {
+            mentioned_auth = extract_number_at(narrative, narrative + scan.authority_pos,
+                                               strlen("authority"));
+        }
+        if (mentioned_auth < 0 && scan.health_pos >= 0) {
+            mentioned_auth = extract_number_at(narrative, narrative + scan.health_pos,
+                                               strlen("health"));
+        }
+        check->authority_plausible = !game ||
+                                     authority_value_plausible(mentioned_auth, game);
+        check->card_mentions = scan.card_mentions;
+    } else {
+        check->names_consistent = coherence_check_names(narrative, game);
+        check->faction_consistent = coherence_check_factions(narrative);
+        check->timeline_consistent = coherence_check_timeline(narrative, world_state);
+        check->authority_plausible = coherence_check_authority(narrative, game);
+        check->card_mentions = 0;
+    }
     check->event_referenced = true;  /* Assume OK for now */
 
     /* Calculate overall score */
@@ -432,7 +729,8 @@ void coherence_rebuild_world_state(WorldState* world_state, Game* game) {
     world_state->last_update_turn = game->turn_number;
     world_state_calculate_tension(world_state, game);
 
-    /* Force battlefield description update */
+    /* Everything was rebuilt: regenerate every cached section */
+    world_state_mark_dirty(world_state, WORLD_DIRTY_ALL);
     world_state_update(world_state, game);
 }
 /* }}} */
@@ -476,10 +774,15 @@ char* coherence_generate_recovery_narrative(CoherenceManager* manager,
              coherence_get_tension_description(world_state->tension),
              world_state_get_faction_name(world_state->dominant_faction));
 
-    /* Call LLM */
-    LLMResponse* response = llm_request(manager->llm_config,
-                                         RECOVERY_SYSTEM_PROMPT,
-                                         prompt);
+    /* Call LLM, behind player-facing requests */
+    LLMScheduleOptions options = {
+        .request_class = LLM_CLASS_RECOVERY,
+        .session = game,
+        .turn = -1
+    };
+    LLMResponse* response = llm_schedule_request(manager->llm_config,
+                                                  RECOVERY_SYSTEM_PROMPT,
+                                                  prompt, &options);
 
     if (!response || !response->success || !response->text) {
         llm_response_free(response);
@@ -4,6 +4,10 @@
  * Detects narrative inconsistencies in LLM-generated content and
  * recovers by rebuilding world state from game data. Ensures smooth
  * transitions after recovery to maintain immersion.
+ *
+ * coherence_check finds everything it looks for (player names and
+ * references, faction words, card names, turn and authority markers)
+ * in a single pass, using a pattern set compiled once per game.
  */
 
 #ifndef LLM_COHERENCE_H
@@ -12,7 +16,9 @@
 #include "../core/05-game.h"
 #include "03-world-state.h"
 #include "01-api-client.h"
+#include "15-pattern-set.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Thresholds for coherence levels */
 #define COHERENCE_THRESHOLD_MINOR 0.7f
@@ -42,6 +48,7 @@ typedef struct {
     bool timeline_consistent;  /* Turn numbers make sense */
     bool authority_plausible;  /* Authority values are plausible */
     bool event_referenced;     /* Recent events properly referenced */
+    int card_mentions;         /* Card names mentioned in the narrative */
 
     float overall_score;       /* Combined coherence score 0.0-1.0 */
     CoherenceLevel level;      /* Determined coherence level */
@@ -76,6 +83,9 @@ typedef struct {
     int consecutive_issues;    /* Consecutive issues without OK */
 
     LLMConfig* llm_config;     /* Config for recovery narration (optional) */
+
+    PatternSet* patterns;      /* Compiled for the names in patterns_key */
+    uint64_t patterns_key;     /* Hash of the player and card names compiled */
 } CoherenceManager;
 /* }}} */
 
@@ -93,6 +103,21 @@ CoherenceManager* coherence_manager_create(LLMConfig* llm_config);
 void coherence_manager_free(CoherenceManager* manager);
 /* }}} */
 
+/* {{{ coherence_compile_patterns
+ * Compiles the patterns coherence_check scans for: player names and
+ * "player N" references, faction names and keywords, card names, and
+ * turn and authority markers. coherence_check compiles them on first
+ * use and again whenever the player or card names differ from those
+ * compiled, so a new game at a freed game's address is not matched
+ * against stale names. Call this at session start to keep the cost off
+ * the first check.
+ * @param manager - The coherence manager
+ * @param game - Game to take names from (may be NULL)
+ * @return true on success
+ */
+bool coherence_compile_patterns(CoherenceManager* manager, Game* game);
+/* }}} */
+
 /* {{{ coherence_check
  * Checks a narrative for coherence with game state.
  * @param manager - The coherence manager
@@ -161,7 +186,9 @@ char* coherence_recover(CoherenceManager* manager,
 /* }}} */
 
 /* {{{ coherence_rebuild_world_state
- * Rebuilds world state from current game state.
+ * Rebuilds world state from current game state. This is the recovery
+ * path: it rescans every player's cards, where normal play keeps the
+ * state current through the world state's event listeners.
  * @param world_state - World state to rebuild
  * @param game - Current game state to rebuild from
  */
@@ -0,0 +1,733 @@
+/*
+ * 10-async-client.c - Asynchronous LLM API Client Implementation
+ *
+ * One I/O thread owns a curl multi handle and every transfer in it.
+ * Other threads only append to the request list or flag cancellations
+ * under the engine lock, then wake the I/O thread with
+ * curl_multi_wakeup. Retries wait on a per-request deadline that feeds
+ * the poll timeout, so no thread ever sleeps on backoff.
+ *
+ * Non-streaming requests consult the response memo at submission. A
+ * hit is still finished by the I/O thread, like any other request, so
+ * callers that submit while holding their own lock (the scheduler)
+ * never see the callback run inside the submit call.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "10-async-client.h"
+#include "19-endpoint-pool.h"
+#include "20-circuit-breaker.h"
+#include "21-response-memo.h"
+#include "../net/09-http-pool.h"
+#include <curl/curl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Retry backoff matches the synchronous client
+#define INITIAL_BACKOFF_MS 1000
+#define MAX_BACKOFF_MS 16000
+
+// Upper bound on a single poll so shutdown and clock drift are noticed
+#define MAX_POLL_MS 1000
+
+// Recheck interval while the connection pool has no handle to spare
+#define POOL_RECHECK_MS 20
+
+// {{{ WriteBuffer
+// Buffer for accumulating HTTP response data.
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} WriteBuffer;
+// }}}
+
+// {{{ AsyncState
+typedef enum {
+    ASYNC_QUEUED,            // Waiting for its first attempt
+    ASYNC_ACTIVE,            // Transfer attached to the multi handle
+    ASYNC_WAITING_RETRY      // Failed attempt, waiting for backoff timer
+} AsyncState;
+// }}}
+
+// {{{ AsyncRequest
+typedef struct AsyncRequest {
+    LLMRequestHandle handle;
+    AsyncState state;
+    bool cancelled;
+
+    char* url;               // Rebuilt per attempt when routed by a pool
+    char* body;
+    struct curl_slist* headers;
+    long timeout_ms;
+    int max_retries;
+
+    LLMEndpointPool* endpoints;  // NULL = url is fixed
+    unsigned long affinity;
+    int endpoint;            // Pool endpoint of the active attempt, or -1
+    int last_endpoint;       // Endpoint of the previous attempt, or -1
+    uint64_t started_ms;
+
+    LLMBreaker* breaker;
+    bool rejected;           // Breaker was open at submission
+
+    bool memoized;           // Deterministic: the reply goes to the memo
+    LLMMemoKey memo_key;
+    LLMResponse* memo_hit;   // Memoized reply, finished without a transfer
+
+    int attempt;
+    int backoff_ms;
+    uint64_t next_attempt_ms;
+
+    CURL* easy;
+    WriteBuffer buffer;
+
+    // Streaming requests only
+    bool streaming;
+    bool decided;            // First chunk seen; is_sse is valid
+    bool is_sse;
+    LLMStreamParser parser;
+
+    LLMAsyncCallback callback;
+    void* user;
+    LLMResponse* result;     // Set when the request is finished
+
+    struct AsyncRequest* next;
+} AsyncRequest;
+// }}}
+
+// {{{ AsyncEngine
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    CURLM* multi;
+    AsyncRequest* requests;
+    LLMRequestHandle next_handle;
+    LLMAsyncStats stats;
+    bool running;
+} AsyncEngine;
+
+static AsyncEngine engine = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .multi = NULL,
+    .requests = NULL,
+    .next_handle = 1,
+    .running = false
+};
+// }}}
+
+// {{{ now_ms
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+// }}}
+
+// {{{ buffer_reset
+static void buffer_reset(WriteBuffer* buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+// }}}
+
+// {{{ write_callback
+// libcurl write callback to accumulate response data.
+static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    WriteBuffer* buf = (WriteBuffer*)userp;
+
+    size_t needed = buf->size + realsize + 1;
+    if (needed > buf->capacity) {
+        size_t new_capacity = buf->capacity > 0 ? buf->capacity * 2 : 256;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        char* new_data = realloc(buf->data, new_capacity);
+        if (new_data == NULL) {
+            return 0; // Signal error to curl
+        }
+        buf->data = new_data;
+        buf->capacity = new_capacity;
+    }
+
+    memcpy(buf->data + buf->size, contents, realsize);
+    buf->size += realsize;
+    buf->data[buf->size] = '\0';
+
+    return realsize;
+}
+// }}}
+
+// {{{ stream_write_callback
+// Write callback for streaming requests. The first chunk decides
+// whether the body is an SSE stream or a plain JSON reply.
+static size_t stream_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    AsyncRequest* req = (AsyncRequest*)userp;
+
+    if (!req->decided) {
+        long http_code = 0;
+        char* content_type = NULL;
+        curl_easy_getinfo(req->easy, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_easy_getinfo(req->easy, CURLINFO_CONTENT_TYPE, &content_type);
+        req->is_sse = http_code >= 200 && http_code < 300 &&
+                      content_type != NULL &&
+                      strstr(content_type, "text/event-stream") != NULL;
+        req->decided = true;
+    }
+
+    if (req->is_sse) {
+        return llm_stream_parser_feed(&req->parser, contents, realsize) ? realsize : 0;
+    }
+    return write_callback(contents, size, nmemb, &req->buffer);
+}
+// }}}
+
+// {{{ request_free
+static void request_free(AsyncRequest* req) {
+    if (req == NULL) {
+        return;
+    }
+
+    if (req->easy != NULL) {
+        http_pool_release(req->easy);
+    }
+    llm_endpoint_pool_release(req->endpoints, req->endpoint, NULL, 0.0);
+    curl_slist_free_all(req->headers);
+    buffer_reset(&req->buffer);
+    llm_stream_parser_free(&req->parser);
+    llm_response_free(req->memo_hit);
+    free(req->url);
+    free(req->body);
+    free(req);
+}
+// }}}
+
+// {{{ request_detach
+// Removes the transfer (if any) from the multi handle.
+// Must be called from the I/O thread.
+static void request_detach(AsyncRequest* req) {
+    if (req->easy != NULL) {
+        curl_multi_remove_handle(engine.multi, req->easy);
+        http_pool_release(req->easy);
+        req->easy = NULL;
+    }
+    if (req->endpoint >= 0) {
+        // Never reported: the attempt was cut short
+        llm_endpoint_pool_release(req->endpoints, req->endpoint, NULL, 0.0);
+        req->endpoint = -1;
+    }
+    buffer_reset(&req->buffer);
+}
+// }}}
+
+// {{{ route_request
+// Points the next attempt at an endpoint from the request's pool,
+// avoiding the one the last attempt used. Returns false when every
+// endpoint is at its concurrency limit.
+static bool route_request(AsyncRequest* req) {
+    int index = llm_endpoint_pool_acquire(req->endpoints, req->affinity,
+                                          req->last_endpoint, 0);
+    if (index < 0) {
+        return false;
+    }
+
+    LLMConfig routed;
+    memset(&routed, 0, sizeof(routed));
+    routed.endpoint = (char*)llm_endpoint_pool_url(req->endpoints, index);
+    char* url = llm_build_url(&routed);
+    if (url == NULL) {
+        llm_endpoint_pool_release(req->endpoints, index, NULL, 0.0);
+        return false;
+    }
+
+    free(req->url);
+    req->url = url;
+    req->endpoint = index;
+    return true;
+}
+// }}}
+
+// {{{ request_start
+// Attaches a new transfer for the request's next attempt.
+// Returns false (leaving the request queued) when every pool endpoint
+// is busy or the endpoint's connection pool is at its per-host limit.
+// Must be called from the I/O thread with the engine lock held.
+static bool request_start(AsyncRequest* req) {
+    if (req->endpoints != NULL && !route_request(req)) {
+        return false;
+    }
+
+    req->easy = http_pool_try_acquire(req->url);
+    if (req->easy == NULL) {
+        llm_endpoint_pool_release(req->endpoints, req->endpoint, NULL, 0.0);
+        req->endpoint = -1;
+        return false;
+    }
+
+    curl_easy_setopt(req->easy, CURLOPT_URL, req->url);
+    curl_easy_setopt(req->easy, CURLOPT_POST, 1L);
+    curl_easy_setopt(req->easy, CURLOPT_POSTFIELDS, req->body);
+    curl_easy_setopt(req->easy, CURLOPT_HTTPHEADER, req->headers);
+    if (req->streaming) {
+        // Retries only happen before any delta was delivered, so each
+        // attempt starts from an empty parser
+        LLMStreamCallback on_delta = req->parser.on_delta;
+        void* user = req->parser.user;
+        llm_stream_parser_free(&req->parser);
+        llm_stream_parser_init(&req->parser, on_delta, user);
+        req->decided = false;
+        req->is_sse = false;
+
+        curl_easy_setopt(req->easy, CURLOPT_WRITEFUNCTION, stream_write_callback);
+        curl_easy_setopt(req->easy, CURLOPT_WRITEDATA, req);
+    } else {
+        curl_easy_setopt(req->easy, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(req->easy, CURLOPT_WRITEDATA, &req->buffer);
+    }
+    curl_easy_setopt(req->easy, CURLOPT_TIMEOUT_MS, req->timeout_ms);
+    curl_easy_setopt(req->easy, CURLOPT_PRIVATE, req);
+    curl_easy_setopt(req->easy, CURLOPT_NOSIGNAL, 1L);
+
+    if (curl_multi_add_handle(engine.multi, req->easy) != CURLM_OK) {
+        http_pool_release(req->easy);
+        req->easy = NULL;
+        llm_endpoint_pool_release(req->endpoints, req->endpoint, NULL, 0.0);
+        req->endpoint = -1;
+        return false;
+    }
+
+    req->started_ms = now_ms();
+    req->state = ASYNC_ACTIVE;
+    req->attempt++;
+    return true;
+}
+// }}}
+
+// {{{ unlink_request
+// Removes req from the engine list. Caller holds the engine lock.
+static void unlink_request(AsyncRequest* req) {
+    AsyncRequest** link = &engine.requests;
+    while (*link != NULL) {
+        if (*link == req) {
+            *link = req->next;
+            req->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+// }}}
+
+// {{{ finish_request
+// Moves req from the engine list onto the finished list with result.
+// Caller holds the engine lock.
+static void finish_request(AsyncRequest* req, LLMResponse* result,
+                           AsyncRequest** finished) {
+    unlink_request(req);
+    req->result = result;
+    req->next = *finished;
+    *finished = req;
+
+    engine.stats.in_flight--;
+    if (req->cancelled) {
+        engine.stats.cancelled++;
+    } else if (result != NULL && result->success) {
+        engine.stats.completed++;
+    } else {
+        engine.stats.failed++;
+    }
+}
+// }}}
+
+// {{{ schedule_pending
+// Starts due attempts, reaps cancellations, and returns the number of
+// milliseconds until the next retry timer fires.
+static long schedule_pending(AsyncRequest** finished) {
+    uint64_t now = now_ms();
+    long wait_ms = MAX_POLL_MS;
+
+    pthread_mutex_lock(&engine.lock);
+
+    AsyncRequest* req = engine.requests;
+    while (req != NULL) {
+        AsyncRequest* next = req->next;
+
+        if (req->cancelled) {
+            request_detach(req);
+            finish_request(req, llm_response_create_error("Request cancelled"),
+                           finished);
+        } else if (req->memo_hit != NULL) {
+            LLMResponse* hit = req->memo_hit;
+            req->memo_hit = NULL;
+            finish_request(req, hit, finished);
+        } else if (req->rejected) {
+            // Failed here rather than in submit so the callback still
+            // runs on the I/O thread
+            finish_request(req, llm_response_create_error("LLM circuit open"),
+                           finished);
+        } else if (req->state == ASYNC_QUEUED ||
+                   (req->state == ASYNC_WAITING_RETRY &&
+                    req->next_attempt_ms <= now)) {
+            if (!request_start(req) && wait_ms > POOL_RECHECK_MS) {
+                // Pool is saturated; try again shortly
+                wait_ms = POOL_RECHECK_MS;
+            }
+        } else if (req->state == ASYNC_WAITING_RETRY) {
+            long remaining = (long)(req->next_attempt_ms - now);
+            if (remaining < wait_ms) {
+                wait_ms = remaining;
+            }
+        }
+
+        req = next;
+    }
+
+    pthread_mutex_unlock(&engine.lock);
+    return wait_ms;
+}
+// }}}
+
+// {{{ collect_completed
+// Reads finished transfers from the multi handle and either schedules
+// a timed retry or moves the request to the finished list.
+static void collect_completed(AsyncRequest** finished) {
+    CURLMsg* msg;
+    int remaining = 0;
+
+    while ((msg = curl_multi_info_read(engine.multi, &remaining)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        AsyncRequest* req = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&req);
+        if (req == NULL) {
+            continue;
+        }
+
+        long http_code = 0;
+        curl_easy_getinfo(req->easy, CURLINFO_RESPONSE_CODE, &http_code);
+
+        LLMResponse* response;
+        if (msg->data.result != CURLE_OK) {
+            response = llm_response_create_error(curl_easy_strerror(msg->data.result));
+        } else if (req->streaming && req->is_sse) {
+            response = llm_stream_parser_finish(&req->parser);
+        } else {
+            response = llm_response_from_http(http_code, req->buffer.data);
+            if (req->streaming && response != NULL && response->success &&
+                req->parser.on_delta != NULL) {
+                // Server ignored "stream": deliver the whole text at once
+                req->parser.chunks++;
+                req->parser.on_delta(response->text, req->parser.user);
+            }
+        }
+        if (response != NULL) {
+            response->http_status = http_code;
+        }
+        double latency_ms = (double)(now_ms() - req->started_ms);
+        llm_breaker_record(req->breaker, req->endpoint, response, latency_ms);
+        if (req->endpoint >= 0) {
+            llm_endpoint_pool_release(req->endpoints, req->endpoint, response,
+                                      latency_ms);
+            req->last_endpoint = req->endpoint;
+            req->endpoint = -1;
+        }
+
+        request_detach(req);
+
+        // No failover once every endpoint's circuit is open
+        bool retry = req->attempt <= req->max_retries &&
+                     req->parser.chunks == 0 && llm_response_is_retryable(response) &&
+                     !llm_breaker_is_open(req->breaker);
+
+        // cancelled is written by llm_async_cancel under the lock
+        pthread_mutex_lock(&engine.lock);
+        if (retry && !req->cancelled) {
+            // Timer-based retry: no thread blocks on the backoff, and a
+            // failover under a breaker goes to another endpoint at once
+            llm_response_free(response);
+            req->state = ASYNC_WAITING_RETRY;
+            req->next_attempt_ms = now_ms() +
+                (req->breaker != NULL ? 0 : (uint64_t)req->backoff_ms);
+            req->backoff_ms *= 2;
+            if (req->backoff_ms > MAX_BACKOFF_MS) {
+                req->backoff_ms = MAX_BACKOFF_MS;
+            }
+            engine.stats.retries++;
+        } else {
+            if (req->cancelled) {
+                llm_response_free(response);
+                response = llm_response_create_error("Request cancelled");
+            } else if (req->memoized) {
+                llm_memo_put(&req->memo_key, response);
+            }
+            finish_request(req, response, finished);
+        }
+        pthread_mutex_unlock(&engine.lock);
+    }
+}
+// }}}
+
+// {{{ deliver_finished
+// Invokes callbacks outside the engine lock and frees the requests.
+static void deliver_finished(AsyncRequest* finished) {
+    while (finished != NULL) {
+        AsyncRequest* next = finished->next;
+        if (finished->callback != NULL) {
+            finished->callback(finished->result, finished->user);
+        } else {
+            llm_response_free(finished->result);
+        }
+        request_free(finished);
+        finished = next;
+    }
+}
+// }}}
+
+// {{{ io_thread_main
+static void* io_thread_main(void* arg) {
+    (void)arg;
+
+    for (;;) {
+        AsyncRequest* finished = NULL;
+
+        pthread_mutex_lock(&engine.lock);
+        bool running = engine.running;
+        if (!running) {
+            // Shutdown: everything still listed is cancelled
+            for (AsyncRequest* req = engine.requests; req != NULL; req = req->next) {
+                req->cancelled = true;
+            }
+        }
+        pthread_mutex_unlock(&engine.lock);
+
+        long wait_ms = schedule_pending(&finished);
+        deliver_finished(finished);
+
+        if (!running) {
+            break;
+        }
+
+        int still_running = 0;
+        curl_multi_perform(engine.multi, &still_running);
+
+        finished = NULL;
+        collect_completed(&finished);
+        deliver_finished(finished);
+
+        curl_multi_poll(engine.multi, NULL, 0, (int)wait_ms, NULL);
+    }
+
+    return NULL;
+}
+// }}}
+
+// {{{ llm_async_init
+bool llm_async_init(void) {
+    pthread_mutex_lock(&engine.lock);
+    if (engine.running) {
+        pthread_mutex_unlock(&engine.lock);
+        return true;
+    }
+    pthread_mutex_unlock(&engine.lock);
+
+    if (!llm_init()) {
+        return false;
+    }
+
+    engine.multi = curl_multi_init();
+    if (engine.multi == NULL) {
+        llm_cleanup();
+        return false;
+    }
+
+    memset(&engine.stats, 0, sizeof(engine.stats));
+    engine.requests = NULL;
+    engine.running = true;
+
+    if (pthread_create(&engine.thread, NULL, io_thread_main, NULL) != 0) {
+        engine.running = false;
+        curl_multi_cleanup(engine.multi);
+        engine.multi = NULL;
+        llm_cleanup();
+        return false;
+    }
+
+    return true;
+}
+// }}}
+
+// {{{ llm_async_cleanup
+void llm_async_cleanup(void) {
+    pthread_mutex_lock(&engine.lock);
+    if (!engine.running) {
+        pthread_mutex_unlock(&engine.lock);
+        return;
+    }
+    engine.running = false;
+    curl_multi_wakeup(engine.multi);
+    pthread_mutex_unlock(&engine.lock);
+
+    pthread_join(engine.thread, NULL);
+
+    curl_multi_cleanup(engine.multi);
+    engine.multi = NULL;
+    llm_cleanup();
+}
+// }}}
+
+// {{{ submit_request
+// Copies the request and queues it for the I/O thread.
+static LLMRequestHandle submit_request(const LLMConfig* config,
+                                      const LLMMessage* messages,
+                                      size_t message_count,
+                                      LLMStreamCallback on_delta,
+                                      bool streaming,
+                                      LLMAsyncCallback callback,
+                                      void* user) {
+    if (config == NULL || messages == NULL || message_count == 0) {
+        return LLM_REQUEST_INVALID;
+    }
+
+    AsyncRequest* req = calloc(1, sizeof(AsyncRequest));
+    if (req == NULL) {
+        return LLM_REQUEST_INVALID;
+    }
+
+    req->endpoints = config->endpoints;
+    req->affinity = config->affinity;
+    req->endpoint = -1;
+    req->last_endpoint = -1;
+    req->url = req->endpoints == NULL ? llm_build_url(config) : NULL;
+    req->body = streaming ?
+        llm_build_stream_request_body(config, messages, message_count) :
+        llm_build_request_body(config, messages, message_count);
+    req->headers = llm_build_headers(config);
+    if (streaming) {
+        req->headers = curl_slist_append(req->headers, "Accept: text/event-stream");
+    }
+    if ((req->url == NULL && req->endpoints == NULL) ||
+        req->body == NULL || req->headers == NULL) {
+        request_free(req);
+        return LLM_REQUEST_INVALID;
+    }
+
+    // An exact repeat of a deterministic request needs no model call
+    if (!streaming) {
+        req->memoized = llm_memo_key(config, messages, message_count, &req->memo_key);
+        if (req->memoized) {
+            req->memo_hit = llm_memo_get(&req->memo_key);
+        }
+    }
+
+    req->state = ASYNC_QUEUED;
+    req->timeout_ms = config->timeout_ms;
+    req->max_retries = config->max_retries > 0 ? config->max_retries : 0;
+    req->breaker = config->breaker;
+    if (req->breaker != NULL) {
+        // Attempts within the breaker's budget and at most a failover to
+        // another endpoint, as in the sync client
+        long cap = llm_breaker_attempt_timeout(req->breaker);
+        if (req->timeout_ms <= 0 || req->timeout_ms > cap) {
+            req->timeout_ms = cap;
+        }
+        int failover = llm_breaker_max_retries(req->breaker);
+        if (req->max_retries > failover) {
+            req->max_retries = failover;
+        }
+        req->rejected = req->memo_hit == NULL && !llm_breaker_allow(req->breaker);
+    }
+    req->backoff_ms = INITIAL_BACKOFF_MS;
+    req->streaming = streaming;
+    llm_stream_parser_init(&req->parser, on_delta, user);
+    req->callback = callback;
+    req->user = user;
+
+    pthread_mutex_lock(&engine.lock);
+    if (!engine.running) {
+        pthread_mutex_unlock(&engine.lock);
+        request_free(req);
+        return LLM_REQUEST_INVALID;
+    }
+
+    req->handle = engine.next_handle++;
+    req->next = engine.requests;
+    engine.requests = req;
+    engine.stats.submitted++;
+    engine.stats.in_flight++;
+    LLMRequestHandle handle = req->handle;
+
+    // Woken under the lock so the multi handle cannot be torn down
+    // between the running check and the wakeup
+    curl_multi_wakeup(engine.multi);
+    pthread_mutex_unlock(&engine.lock);
+
+    return handle;
+}
+// }}}
+
+// {{{ llm_request_async
+LLMRequestHandle llm_request_async(const LLMConfig* config,
+                                    const LLMMessage* messages,
+                                    size_t message_count,
+                                    LLMAsyncCallback callback,
+                                    void* user) {
+    return submit_request(config, messages, message_count,
+                          NULL, false, callback, user);
+}
+// }}}
+
+// {{{ llm_request_async_stream
+LLMRequestHandle llm_request_async_stream(const LLMConfig* config,
+                                           const LLMMessage* messages,
+                                           size_t message_count,
+                                           LLMStreamCallback on_delta,
+                                           LLMAsyncCallback callback,
+                                           void* user) {
+    return submit_request(config, messages, message_count,
+                          on_delta, true, callback, user);
+}
+// }}}
+
+// {{{ llm_async_cancel
+bool llm_async_cancel(LLMRequestHandle handle) {
+    if (handle == LLM_REQUEST_INVALID) {
+        return false;
+    }
+
+    bool found = false;
+
+    pthread_mutex_lock(&engine.lock);
+    for (AsyncRequest* req = engine.requests; req != NULL; req = req->next) {
+        if (req->handle == handle && !req->cancelled) {
+            req->cancelled = true;
+            found = true;
+            break;
+        }
+    }
+    if (found && engine.running) {
+        curl_multi_wakeup(engine.multi);
+    }
+    pthread_mutex_unlock(&engine.lock);
+
+    return found;
+}
+// }}}
+
+// {{{ llm_async_get_stats
+LLMAsyncStats llm_async_get_stats(void) {
+    pthread_mutex_lock(&engine.lock);
+    LLMAsyncStats stats = engine.stats;
+    pthread_mutex_unlock(&engine.lock);
+    return stats;
+}
+// }}}
@@ -0,0 +1,99 @@
+/*
+ * 10-async-client.h - Asynchronous LLM API Client
+ *
+ * Non-blocking request engine built on libcurl's multi interface.
+ * A dedicated I/O thread drives all transfers, schedules retries on
+ * timers instead of sleeping, and reports results through callbacks
+ * so game actions never wait on the model.
+ */
+
+#ifndef LLM_ASYNC_CLIENT_H
+#define LLM_ASYNC_CLIENT_H
+
+#include "01-api-client.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returned by llm_request_async when a request could not be queued */
+#define LLM_REQUEST_INVALID 0
+
+// {{{ LLMRequestHandle
+// Identifies an in-flight asynchronous request.
+// Handles are never reused, so cancelling a finished request is safe.
+typedef uint64_t LLMRequestHandle;
+// }}}
+
+// {{{ LLMAsyncCallback
+// Invoked exactly once per request from the I/O thread.
+// The callback takes ownership of response and must free it with
+// llm_response_free. Cancelled requests receive a failed response
+// whose error is "Request cancelled".
+typedef void (*LLMAsyncCallback)(LLMResponse* response, void* user);
+// }}}
+
+// {{{ LLMAsyncStats
+// Counters describing the engine's activity since llm_async_init.
+typedef struct {
+    int submitted;           // Requests accepted by llm_request_async
+    int completed;           // Requests that finished successfully
+    int failed;              // Requests that failed after all retries
+    int cancelled;           // Requests cancelled before completion
+    int retries;             // Retry attempts scheduled
+    int in_flight;           // Requests queued, waiting to retry, or active
+} LLMAsyncStats;
+// }}}
+
+// {{{ llm_async_init
+// Starts the asynchronous engine and its I/O thread.
+// Calls llm_init internally. Returns true on success.
+bool llm_async_init(void);
+// }}}
+
+// {{{ llm_async_cleanup
+// Stops the I/O thread. Outstanding requests are cancelled and their
+// callbacks invoked before this returns.
+void llm_async_cleanup(void);
+// }}}
+
+// {{{ llm_request_async
+// Queues a chat completion request and returns immediately.
+// The config and messages are copied; the caller may free them at once.
+// Returns LLM_REQUEST_INVALID if the engine is not running or the
+// arguments are invalid (the callback is not invoked in that case).
+// As with llm_request_messages, a memoized reply is delivered (still
+// from the I/O thread) without contacting the server.
+LLMRequestHandle llm_request_async(const LLMConfig* config,
+                                    const LLMMessage* messages,
+                                    size_t message_count,
+                                    LLMAsyncCallback callback,
+                                    void* user);
+// }}}
+
+// {{{ llm_request_async_stream
+// Like llm_request_async but asks for an SSE stream and calls on_delta
+// from the I/O thread for each piece of text as it arrives, before the
+// final callback, passing the same user pointer to both. Keep on_delta
+// short; it runs on the I/O thread.
+// Retries only happen while no delta has been delivered.
+LLMRequestHandle llm_request_async_stream(const LLMConfig* config,
+                                           const LLMMessage* messages,
+                                           size_t message_count,
+                                           LLMStreamCallback on_delta,
+                                           LLMAsyncCallback callback,
+                                           void* user);
+// }}}
+
+// {{{ llm_async_cancel
+// Cancels a queued or in-flight request.
+// Returns true if the request was still pending, false if it had
+// already completed or the handle is unknown.
+bool llm_async_cancel(LLMRequestHandle handle);
+// }}}
+
+// {{{ llm_async_get_stats
+// Returns a snapshot of the engine counters.
+LLMAsyncStats llm_async_get_stats(void);
+// }}}
+
+#endif /* LLM_ASYNC_CLIENT_H */
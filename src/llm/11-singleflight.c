@@ -0,0 +1,395 @@
+/*
+ * 11-singleflight.c - Coalescing of Identical LLM Requests Implementation
+ *
+ * In-flight requests live in a small hash table keyed by the normalized
+ * prompt. Each flight is reference counted: the party that lands it
+ * (a synchronous leader or the async completion callback) and every
+ * synchronous follower hold a reference, so the shared result stays
+ * valid until the last follower has copied it. Flights leave the table
+ * as soon as they land, so later callers start a fresh request.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "11-singleflight.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLIGHT_BUCKETS 64
+
+// Separators that cannot appear in normalized text
+#define KEY_FIELD_SEP '\x1f'
+#define KEY_RECORD_SEP '\x1e'
+
+// {{{ Waiter
+// An asynchronous caller waiting on a flight.
+typedef struct Waiter {
+    LLMAsyncCallback callback;
+    void* user;
+    struct Waiter* next;
+} Waiter;
+// }}}
+
+// {{{ Flight
+typedef struct Flight {
+    char* key;
+    uint64_t hash;
+    int callers;             // Everyone sharing this call, leader included
+    int refs;                // Parties that still read the flight
+    bool landed;
+    LLMResponse* result;     // Owned by the flight once landed
+    Waiter* waiters;
+    pthread_cond_t landed_cond;
+    struct Flight* next;
+} Flight;
+// }}}
+
+// {{{ Singleflight state
+static pthread_mutex_t sf_lock = PTHREAD_MUTEX_INITIALIZER;
+static Flight* flights[FLIGHT_BUCKETS];
+static LLMSingleflightStats sf_stats;
+// }}}
+
+// {{{ hash_key
+// FNV-1a 64-bit.
+static uint64_t hash_key(const char* key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*)key; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+// }}}
+
+// {{{ append_normalized
+// Appends text to out with whitespace runs collapsed to one space and
+// the ends trimmed. out must have room for strlen(text) more bytes.
+static size_t append_normalized(char* out, size_t pos, const char* text) {
+    bool pending_space = false;
+    bool wrote = false;
+
+    for (const char* p = text != NULL ? text : ""; *p != '\0'; p++) {
+        char c = *p;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+            c == '\f' || c == '\v') {
+            pending_space = wrote;
+            continue;
+        }
+        if (c == KEY_FIELD_SEP || c == KEY_RECORD_SEP) {
+            c = ' ';
+        }
+        if (pending_space) {
+            out[pos++] = ' ';
+            pending_space = false;
+        }
+        out[pos++] = c;
+        wrote = true;
+    }
+
+    return pos;
+}
+// }}}
+
+// {{{ llm_singleflight_key
+char* llm_singleflight_key(const LLMConfig* config,
+                           const LLMMessage* messages,
+                           size_t message_count) {
+    if (config == NULL || messages == NULL || message_count == 0) {
+        return NULL;
+    }
+
+    size_t cap = 3;
+    cap += config->endpoint != NULL ? strlen(config->endpoint) : 0;
+    cap += config->model != NULL ? strlen(config->model) : 0;
+    for (size_t i = 0; i < message_count; i++) {
+        cap += (messages[i].role != NULL ? strlen(messages[i].role) : 0) + 2;
+        cap += messages[i].content != NULL ? strlen(messages[i].content) : 0;
+    }
+
+    char* key = malloc(cap);
+    if (key == NULL) {
+        return NULL;
+    }
+
+    size_t pos = append_normalized(key, 0, config->endpoint);
+    key[pos++] = KEY_FIELD_SEP;
+    pos = append_normalized(key, pos, config->model);
+    for (size_t i = 0; i < message_count; i++) {
+        key[pos++] = KEY_RECORD_SEP;
+        pos = append_normalized(key, pos, messages[i].role);
+        key[pos++] = KEY_FIELD_SEP;
+        pos = append_normalized(key, pos, messages[i].content);
+    }
+    key[pos] = '\0';
+
+    return key;
+}
+// }}}
+
+// {{{ find_flight
+// Caller holds sf_lock.
+static Flight* find_flight(const char* key, uint64_t hash) {
+    for (Flight* f = flights[hash % FLIGHT_BUCKETS]; f != NULL; f = f->next) {
+        if (f->hash == hash && strcmp(f->key, key) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+// }}}
+
+// {{{ insert_flight
+// Creates and registers a flight owning key. Caller holds sf_lock.
+static Flight* insert_flight(char* key, uint64_t hash) {
+    Flight* f = calloc(1, sizeof(Flight));
+    if (f == NULL) {
+        return NULL;
+    }
+
+    f->key = key;
+    f->hash = hash;
+    f->callers = 1;
+    f->refs = 1;
+    pthread_cond_init(&f->landed_cond, NULL);
+
+    size_t bucket = hash % FLIGHT_BUCKETS;
+    f->next = flights[bucket];
+    flights[bucket] = f;
+
+    sf_stats.upstream++;
+    sf_stats.in_flight++;
+    if (sf_stats.max_waiters < 1) {
+        sf_stats.max_waiters = 1;
+    }
+    return f;
+}
+// }}}
+
+// {{{ unlink_flight
+// Removes f from the table. Caller holds sf_lock.
+static void unlink_flight(Flight* f) {
+    Flight** link = &flights[f->hash % FLIGHT_BUCKETS];
+    while (*link != NULL) {
+        if (*link == f) {
+            *link = f->next;
+            f->next = NULL;
+            sf_stats.in_flight--;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+// }}}
+
+// {{{ flight_release
+// Drops one reference; frees the flight when none remain.
+// Caller holds sf_lock.
+static void flight_release(Flight* f) {
+    if (--f->refs > 0) {
+        return;
+    }
+
+    llm_response_free(f->result);
+    pthread_cond_destroy(&f->landed_cond);
+    free(f->key);
+    free(f);
+}
+// }}}
+
+// {{{ join_flight
+// Records another caller on an in-flight request. Caller holds sf_lock.
+static void join_flight(Flight* f) {
+    f->callers++;
+    sf_stats.coalesced++;
+    if (f->callers > sf_stats.max_waiters) {
+        sf_stats.max_waiters = f->callers;
+    }
+}
+// }}}
+
+// {{{ land_flight
+// Publishes result, wakes synchronous followers and delivers copies to
+// asynchronous waiters (outside the lock). Drops the lander's reference.
+static void land_flight(Flight* f, LLMResponse* result) {
+    pthread_mutex_lock(&sf_lock);
+    f->result = result;
+    f->landed = true;
+    unlink_flight(f);
+    Waiter* waiters = f->waiters;
+    f->waiters = NULL;
+    pthread_cond_broadcast(&f->landed_cond);
+    pthread_mutex_unlock(&sf_lock);
+
+    while (waiters != NULL) {
+        Waiter* next = waiters->next;
+        LLMResponse* copy = llm_response_copy(result);
+        if (copy == NULL) {
+            copy = llm_response_create_error("Out of memory");
+        }
+        waiters->callback(copy, waiters->user);
+        free(waiters);
+        waiters = next;
+    }
+
+    pthread_mutex_lock(&sf_lock);
+    flight_release(f);
+    pthread_mutex_unlock(&sf_lock);
+}
+// }}}
+
+// {{{ resolve_key
+// Returns an owned copy of the explicit key or the derived prompt key.
+static char* resolve_key(const LLMConfig* config, const LLMMessage* messages,
+                         size_t message_count, const char* key) {
+    if (key != NULL) {
+        return strdup(key);
+    }
+    return llm_singleflight_key(config, messages, message_count);
+}
+// }}}
+
+// {{{ llm_request_shared
+LLMResponse* llm_request_shared(const LLMConfig* config,
+                                const LLMMessage* messages,
+                                size_t message_count,
+                                const char* key) {
+    if (config == NULL || messages == NULL || message_count == 0) {
+        return llm_response_create_error("Invalid arguments");
+    }
+
+    char* flight_key = resolve_key(config, messages, message_count, key);
+    if (flight_key == NULL) {
+        return llm_request_messages(config, messages, message_count);
+    }
+    uint64_t hash = hash_key(flight_key);
+
+    pthread_mutex_lock(&sf_lock);
+    sf_stats.requests++;
+
+    Flight* f = find_flight(flight_key, hash);
+    if (f != NULL) {
+        // Follower: wait for the leader's result and copy it
+        join_flight(f);
+        f->refs++;
+        while (!f->landed) {
+            pthread_cond_wait(&f->landed_cond, &sf_lock);
+        }
+        LLMResponse* copy = llm_response_copy(f->result);
+        flight_release(f);
+        pthread_mutex_unlock(&sf_lock);
+        free(flight_key);
+        return copy != NULL ? copy : llm_response_create_error("Out of memory");
+    }
+
+    f = insert_flight(flight_key, hash);
+    pthread_mutex_unlock(&sf_lock);
+    if (f == NULL) {
+        free(flight_key);
+        return llm_request_messages(config, messages, message_count);
+    }
+
+    // Leader: perform the call and share the result
+    LLMResponse* response = llm_request_messages(config, messages, message_count);
+    LLMResponse* mine = llm_response_copy(response);
+    land_flight(f, response);
+
+    return mine != NULL ? mine : llm_response_create_error("Out of memory");
+}
+// }}}
+
+// {{{ async_landed
+// llm_request_async completion for an async-led flight.
+static void async_landed(LLMResponse* response, void* user) {
+    land_flight((Flight*)user, response);
+}
+// }}}
+
+// {{{ llm_request_async_shared
+bool llm_request_async_shared(const LLMConfig* config,
+                              const LLMMessage* messages,
+                              size_t message_count,
+                              const char* key,
+                              LLMAsyncCallback callback,
+                              void* user) {
+    if (config == NULL || messages == NULL || message_count == 0 ||
+        callback == NULL) {
+        return false;
+    }
+
+    Waiter* waiter = calloc(1, sizeof(Waiter));
+    char* flight_key = resolve_key(config, messages, message_count, key);
+    if (waiter == NULL || flight_key == NULL) {
+        free(waiter);
+        free(flight_key);
+        return false;
+    }
+    waiter->callback = callback;
+    waiter->user = user;
+    uint64_t hash = hash_key(flight_key);
+
+    pthread_mutex_lock(&sf_lock);
+
+    Flight* f = find_flight(flight_key, hash);
+    if (f != NULL) {
+        sf_stats.requests++;
+        join_flight(f);
+        waiter->next = f->waiters;
+        f->waiters = waiter;
+        pthread_mutex_unlock(&sf_lock);
+        free(flight_key);
+        return true;
+    }
+
+    f = insert_flight(flight_key, hash);
+    if (f == NULL) {
+        pthread_mutex_unlock(&sf_lock);
+        free(flight_key);
+        free(waiter);
+        return false;
+    }
+    f->waiters = waiter;
+
+    // Submitted under the lock so nobody can join a flight that then
+    // fails to start; the completion callback simply waits for the lock
+    LLMRequestHandle handle = llm_request_async(config, messages, message_count,
+                                                async_landed, f);
+    if (handle == LLM_REQUEST_INVALID) {
+        unlink_flight(f);
+        sf_stats.upstream--;
+        f->waiters = NULL;
+        flight_release(f);
+        pthread_mutex_unlock(&sf_lock);
+        free(waiter);
+        return false;
+    }
+
+    sf_stats.requests++;
+    pthread_mutex_unlock(&sf_lock);
+    return true;
+}
+// }}}
+
+// {{{ llm_singleflight_get_stats
+LLMSingleflightStats llm_singleflight_get_stats(void) {
+    pthread_mutex_lock(&sf_lock);
+    LLMSingleflightStats stats = sf_stats;
+    pthread_mutex_unlock(&sf_lock);
+
+    stats.hit_rate = stats.requests > 0 ?
+        (float)stats.coalesced / (float)stats.requests : 0.0f;
+    return stats;
+}
+// }}}
+
+// {{{ llm_singleflight_reset_stats
+void llm_singleflight_reset_stats(void) {
+    pthread_mutex_lock(&sf_lock);
+    int in_flight = sf_stats.in_flight;
+    memset(&sf_stats, 0, sizeof(sf_stats));
+    sf_stats.in_flight = in_flight;
+    pthread_mutex_unlock(&sf_lock);
+}
+// }}}
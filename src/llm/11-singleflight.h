@@ -0,0 +1,81 @@
+/*
+ * 11-singleflight.h - Coalescing of Identical LLM Requests
+ *
+ * Sits in front of the LLM client so that concurrent requests for the
+ * same prompt share one upstream call. The first caller for a key
+ * (the leader) performs the request; callers arriving while it is in
+ * flight wait for it and each receive their own copy of the result.
+ * Nothing is cached once the flight lands; see 07-narrative-cache for
+ * that.
+ */
+
+#ifndef LLM_SINGLEFLIGHT_H
+#define LLM_SINGLEFLIGHT_H
+
+#include "01-api-client.h"
+#include "10-async-client.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// {{{ LLMSingleflightStats
+// Counters since start or the last llm_singleflight_reset_stats.
+typedef struct {
+    int requests;            // Calls made through this layer
+    int upstream;            // Calls that reached the LLM client
+    int coalesced;           // Calls that joined an in-flight request
+    int in_flight;           // Distinct keys currently in flight
+    int max_waiters;         // Largest number of callers sharing one call
+    float hit_rate;          // coalesced / requests (0.0-1.0)
+} LLMSingleflightStats;
+// }}}
+
+// {{{ llm_singleflight_key
+// Builds the normalized key for a request: endpoint, model and every
+// message's role and content, with runs of whitespace collapsed and
+// leading/trailing whitespace dropped, so prompts that differ only in
+// formatting share a flight. Caller must free the returned string.
+char* llm_singleflight_key(const LLMConfig* config,
+                           const LLMMessage* messages,
+                           size_t message_count);
+// }}}
+
+// {{{ llm_request_shared
+// Synchronous request that coalesces with identical in-flight requests.
+// key overrides the derived prompt key when non-NULL (for example an
+// event signature from event_build_signature); callers using their own
+// keys must ensure equal keys mean interchangeable results.
+// Caller must free the response with llm_response_free.
+LLMResponse* llm_request_shared(const LLMConfig* config,
+                                const LLMMessage* messages,
+                                size_t message_count,
+                                const char* key);
+// }}}
+
+// {{{ llm_request_async_shared
+// Asynchronous variant built on llm_request_async. If a request with
+// the same key is already in flight (sync or async), callback is
+// attached to it; otherwise a new async request is started. callback
+// receives its own response copy, on the async I/O thread or, when it
+// joins a synchronous leader, on the leader's thread.
+// Returns false if the request could not be queued (callback is not
+// invoked in that case).
+bool llm_request_async_shared(const LLMConfig* config,
+                              const LLMMessage* messages,
+                              size_t message_count,
+                              const char* key,
+                              LLMAsyncCallback callback,
+                              void* user);
+// }}}
+
+// {{{ llm_singleflight_get_stats
+// Returns a snapshot of the coalescing counters.
+LLMSingleflightStats llm_singleflight_get_stats(void);
+// }}}
+
+// {{{ llm_singleflight_reset_stats
+// Zeroes the counters (in_flight is preserved).
+void llm_singleflight_reset_stats(void);
+// }}}
+
+#endif /* LLM_SINGLEFLIGHT_H */
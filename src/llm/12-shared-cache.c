@@ -0,0 +1,525 @@
+/*
+ * 12-shared-cache.c - Process-wide Persistent Narrative Cache Implementation
+ *
+ * Lock order is shard locks (ascending) before log_lock. Stores append
+ * their log record while still holding the shard lock, so the log
+ * order for a signature always matches the order the shard saw.
+ * Compaction takes every shard lock, then the log lock.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "12-shared-cache.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHARED_CACHE_SHARDS 16
+#define COMPACT_MIN_RECORDS 1024
+#define LOG_HEADER_MAX 96
+
+// {{{ Shard
+typedef struct {
+    pthread_mutex_t lock;
+    NarrativeCache* cache;
+} Shard;
+// }}}
+
+// {{{ Shared state
+static Shard shards[SHARED_CACHE_SHARDS];
+static bool ready = false;
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* log_file = NULL;
+static char* log_path = NULL;
+static int log_records = 0;
+static int compact_at = COMPACT_MIN_RECORDS;   // log_records that triggers a rewrite
+static int loaded = 0;
+static int compactions = 0;
+// }}}
+
+// {{{ shard_for
+static Shard* shard_for(const char* signature) {
+    uint64_t hash = narrative_cache_hash_signature(signature);
+    // High bits pick the shard; the cache buckets use the low bits
+    return &shards[(hash >> 56) % SHARED_CACHE_SHARDS];
+}
+// }}}
+
+// {{{ write_set_record
+static bool write_set_record(FILE* f, const char* signature,
+                             const char* narrative, time_t generated_at) {
+    size_t sig_len = strlen(signature);
+    size_t text_len = strlen(narrative);
+
+    return fprintf(f, "S %lld %zu %zu\n", (long long)generated_at,
+                   sig_len, text_len) > 0 &&
+           fwrite(signature, 1, sig_len, f) == sig_len &&
+           fwrite(narrative, 1, text_len, f) == text_len &&
+           fputc('\n', f) != EOF;
+}
+// }}}
+
+// {{{ write_remove_record
+static bool write_remove_record(FILE* f, const char* signature) {
+    size_t sig_len = strlen(signature);
+
+    return fprintf(f, "R %zu\n", sig_len) > 0 &&
+           fwrite(signature, 1, sig_len, f) == sig_len &&
+           fputc('\n', f) != EOF;
+}
+// }}}
+
+// {{{ read_exact
+// Reads len bytes plus a terminating NUL into a new buffer.
+static char* read_exact(FILE* f, size_t len) {
+    char* buffer = malloc(len + 1);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    if (fread(buffer, 1, len, f) != len) {
+        free(buffer);
+        return NULL;
+    }
+    buffer[len] = '\0';
+    return buffer;
+}
+// }}}
+
+// {{{ replay_log
+// Applies every well-formed record in the log at path.
+// Returns the number of records applied; sets *damaged if replay
+// stopped at a malformed record.
+static int replay_log(const char* path, bool* damaged) {
+    *damaged = false;
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+
+    int records = 0;
+    char header[LOG_HEADER_MAX];
+
+    while (fgets(header, sizeof(header), f) != NULL) {
+        long long generated_at = 0;
+        size_t sig_len = 0;
+        size_t text_len = 0;
+        char* signature = NULL;
+        char* narrative = NULL;
+        bool ok = false;
+
+        if (sscanf(header, "S %lld %zu %zu", &generated_at, &sig_len, &text_len) == 3) {
+            signature = read_exact(f, sig_len);
+            narrative = signature != NULL ? read_exact(f, text_len) : NULL;
+            ok = narrative != NULL && fgetc(f) == '\n';
+            if (ok) {
+                Shard* shard = shard_for(signature);
+                if (!narrative_cache_restore(shard->cache, signature, narrative,
+                                             (time_t)generated_at)) {
+                    // Expired on disk: make sure an older copy is not kept
+                    narrative_cache_remove(shard->cache, signature);
+                }
+            }
+        } else if (sscanf(header, "R %zu", &sig_len) == 1) {
+            signature = read_exact(f, sig_len);
+            ok = signature != NULL && fgetc(f) == '\n';
+            if (ok) {
+                narrative_cache_remove(shard_for(signature)->cache, signature);
+            }
+        }
+
+        free(signature);
+        free(narrative);
+        if (!ok) {
+            *damaged = true;
+            break;
+        }
+        records++;
+    }
+
+    fclose(f);
+    return records;
+}
+// }}}
+
+// {{{ live_entries
+// Caller holds every shard lock (or is the only thread running).
+static int live_entries(void) {
+    int count = 0;
+    for (int i = 0; i < SHARED_CACHE_SHARDS; i++) {
+        count += shards[i].cache->count;
+    }
+    return count;
+}
+// }}}
+
+// {{{ rewrite_log
+// Writes every live entry, oldest generation first, to a temporary
+// file and renames it over the log. Caller holds every shard lock and
+// log_lock.
+static bool rewrite_log(void) {
+    size_t tmp_len = strlen(log_path) + 5;
+    char* tmp_path = malloc(tmp_len);
+    if (tmp_path == NULL) {
+        return false;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", log_path);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        free(tmp_path);
+        return false;
+    }
+
+    bool ok = true;
+    int records = 0;
+    for (int i = 0; i < SHARED_CACHE_SHARDS && ok; i++) {
+        NarrativeCache* cache = shards[i].cache;
+        narrative_cache_cleanup_expired(cache);
+        for (int slot = cache->age_head; slot >= 0 && ok;
+             slot = cache->entries[slot].age_next) {
+            NarrativeCacheEntry* entry = &cache->entries[slot];
+            ok = write_set_record(f, entry->signature, entry->narrative,
+                                  entry->generated_at);
+            records++;
+        }
+    }
+
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp_path, log_path) != 0) {
+        remove(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+    free(tmp_path);
+
+    if (log_file != NULL) {
+        fclose(log_file);
+    }
+    log_file = fopen(log_path, "ab");
+
+    log_records = records;
+    compact_at = records * 2 > COMPACT_MIN_RECORDS ? records * 2 : COMPACT_MIN_RECORDS;
+    compactions++;
+    return log_file != NULL;
+}
+// }}}
+
+// {{{ make_parent_directory
+// Creates the directory holding path if it does not exist (one level).
+static bool make_parent_directory(const char* path) {
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL || slash == path) {
+        return true;
+    }
+
+    size_t len = (size_t)(slash - path);
+    char* dir = malloc(len + 1);
+    if (dir == NULL) {
+        return false;
+    }
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+
+    bool ok = mkdir(dir, 0755) == 0 || errno == EEXIST;
+    free(dir);
+    return ok;
+}
+// }}}
+
+// {{{ lock_all / unlock_all
+static void lock_all(void) {
+    for (int i = 0; i < SHARED_CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+    }
+    pthread_mutex_lock(&log_lock);
+}
+
+static void unlock_all(void) {
+    pthread_mutex_unlock(&log_lock);
+    for (int i = SHARED_CACHE_SHARDS - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+}
+// }}}
+
+// {{{ append_record
+// Appends a record to the log. Caller holds the signature's shard lock.
+// Returns true if the log has grown enough to need compacting.
+static bool append_record(const char* signature, const char* narrative,
+                          time_t generated_at) {
+    bool compact = false;
+
+    pthread_mutex_lock(&log_lock);
+    if (log_file != NULL) {
+        bool ok = narrative != NULL
+            ? write_set_record(log_file, signature, narrative, generated_at)
+            : write_remove_record(log_file, signature);
+        if (ok && fflush(log_file) == 0) {
+            log_records++;
+        }
+        compact = log_records >= compact_at;
+    }
+    pthread_mutex_unlock(&log_lock);
+
+    return compact;
+}
+// }}}
+
+// {{{ maybe_compact
+// Rewrites the log if it is still at least twice the live set.
+static void maybe_compact(void) {
+    lock_all();
+    if (log_file != NULL && log_records >= compact_at) {
+        if (log_records >= live_entries() * 2) {
+            rewrite_log();
+        } else {
+            compact_at = log_records * 2;
+        }
+    }
+    unlock_all();
+}
+// }}}
+
+// {{{ shared_cache_init
+bool shared_cache_init(const SharedCacheConfig* config) {
+    if (ready || config == NULL || config->max_entries <= 0) {
+        return false;
+    }
+
+    int per_shard = (config->max_entries + SHARED_CACHE_SHARDS - 1) / SHARED_CACHE_SHARDS;
+    for (int i = 0; i < SHARED_CACHE_SHARDS; i++) {
+        shards[i].cache = narrative_cache_init(per_shard, config->ttl_seconds);
+        if (shards[i].cache == NULL) {
+            for (int j = 0; j < i; j++) {
+                narrative_cache_free(shards[j].cache);
+                shards[j].cache = NULL;
+            }
+            return false;
+        }
+        narrative_cache_set_max_bytes(shards[i].cache,
+                                      config->max_bytes / SHARED_CACHE_SHARDS);
+        pthread_mutex_init(&shards[i].lock, NULL);
+    }
+
+    log_records = 0;
+    compact_at = COMPACT_MIN_RECORDS;
+    loaded = 0;
+    compactions = 0;
+    ready = true;
+
+    if (config->path == NULL || config->path[0] == '\0') {
+        return true;
+    }
+
+    log_path = strdup(config->path);
+    if (log_path == NULL || !make_parent_directory(log_path)) {
+        shared_cache_cleanup();
+        return false;
+    }
+
+    // Warm start
+    bool damaged = false;
+    log_records = replay_log(log_path, &damaged);
+    loaded = live_entries();
+    for (int i = 0; i < SHARED_CACHE_SHARDS; i++) {
+        narrative_cache_reset_stats(shards[i].cache);
+    }
+
+    // Start from a clean log if the old one carried dead or damaged records
+    if (damaged || log_records > loaded) {
+        if (!rewrite_log()) {
+            shared_cache_cleanup();
+            return false;
+        }
+        compactions = 0;
+    } else {
+        log_file = fopen(log_path, "ab");
+        if (log_file == NULL) {
+            shared_cache_cleanup();
+            return false;
+        }
+        compact_at = log_records * 2 > COMPACT_MIN_RECORDS ?
+                     log_records * 2 : COMPACT_MIN_RECORDS;
+    }
+
+    return true;
+}
+// }}}
+
+// {{{ shared_cache_cleanup
+void shared_cache_cleanup(void) {
+    if (!ready) {
+        return;
+    }
+
+    if (log_file != NULL) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+    free(log_path);
+    log_path = NULL;
+
+    for (int i = 0; i < SHARED_CACHE_SHARDS; i++) {
+        narrative_cache_free(shards[i].cache);
+        shards[i].cache = NULL;
+        pthread_mutex_destroy(&shards[i].lock);
+    }
+
+    ready = false;
+}
+// }}}
+
+// {{{ shared_cache_is_ready
+bool shared_cache_is_ready(void) {
+    return ready;
+}
+// }}}
+
+// {{{ shared_cache_get
+char* shared_cache_get(const char* signature) {
+    if (!ready || signature == NULL) {
+        return NULL;
+    }
+
+    Shard* shard = shard_for(signature);
+    pthread_mutex_lock(&shard->lock);
+    const char* narrative = narrative_cache_get(shard->cache, signature);
+    char* copy = narrative != NULL ? strdup(narrative) : NULL;
+    pthread_mutex_unlock(&shard->lock);
+
+    return copy;
+}
+// }}}
+
+// {{{ shared_cache_contains
+bool shared_cache_contains(const char* signature) {
+    if (!ready || signature == NULL) {
+        return false;
+    }
+
+    Shard* shard = shard_for(signature);
+    pthread_mutex_lock(&shard->lock);
+    bool found = narrative_cache_contains(shard->cache, signature);
+    pthread_mutex_unlock(&shard->lock);
+
+    return found;
+}
+// }}}
+
+// {{{ shared_cache_set
+bool shared_cache_set(const char* signature, const char* narrative) {
+    if (!ready || signature == NULL || narrative == NULL) {
+        return false;
+    }
+
+    Shard* shard = shard_for(signature);
+    pthread_mutex_lock(&shard->lock);
+    bool ok = narrative_cache_set(shard->cache, signature, narrative);
+    bool compact = ok && append_record(signature, narrative, time(NULL));
+    pthread_mutex_unlock(&shard->lock);
+
+    if (compact) {
+        maybe_compact();
+    }
+    return ok;
+}
+// }}}
+
+// {{{ shared_cache_remove
+bool shared_cache_remove(const char* signature) {
+    if (!ready || signature == NULL) {
+        return false;
+    }
+
+    Shard* shard = shard_for(signature);
+    pthread_mutex_lock(&shard->lock);
+    bool removed = narrative_cache_remove(shard->cache, signature);
+    bool compact = removed && append_record(signature, NULL, 0);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (compact) {
+        maybe_compact();
+    }
+    return removed;
+}
+// }}}
+
+// {{{ shared_cache_get_event
+char* shared_cache_get_event(NarrationEvent* event) {
+    char* signature = event_build_template_signature(event);
+    if (signature == NULL) {
+        return NULL;
+    }
+
+    char* template_text = shared_cache_get(signature);
+    char* filled = narrative_fill_template(template_text, event);
+    free(signature);
+    free(template_text);
+    return filled;
+}
+// }}}
+
+// {{{ shared_cache_set_event
+bool shared_cache_set_event(NarrationEvent* event, const char* narrative) {
+    char* signature = event_build_template_signature(event);
+    char* template_text = narrative_templatize(narrative, event);
+    bool ok = signature != NULL && template_text != NULL &&
+              shared_cache_set(signature, template_text);
+
+    free(signature);
+    free(template_text);
+    return ok;
+}
+// }}}
+
+// {{{ shared_cache_compact
+bool shared_cache_compact(void) {
+    if (!ready) {
+        return false;
+    }
+
+    lock_all();
+    bool ok = log_path != NULL && rewrite_log();
+    unlock_all();
+    return ok;
+}
+// }}}
+
+// {{{ shared_cache_get_stats
+SharedCacheStats shared_cache_get_stats(void) {
+    SharedCacheStats stats = {0};
+    if (!ready) {
+        return stats;
+    }
+
+    for (int i = 0; i < SHARED_CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        NarrativeCacheStats s = narrative_cache_get_stats(shards[i].cache);
+        pthread_mutex_unlock(&shards[i].lock);
+
+        stats.cache.total_entries += s.total_entries;
+        stats.cache.hits += s.hits;
+        stats.cache.misses += s.misses;
+        stats.cache.evictions += s.evictions;
+        stats.cache.expirations += s.expirations;
+    }
+
+    int lookups = stats.cache.hits + stats.cache.misses;
+    stats.cache.hit_rate = lookups > 0 ? (float)stats.cache.hits / (float)lookups : 0.0f;
+
+    pthread_mutex_lock(&log_lock);
+    stats.loaded = loaded;
+    stats.log_records = log_records;
+    stats.compactions = compactions;
+    pthread_mutex_unlock(&log_lock);
+
+    return stats;
+}
+// }}}
@@ -0,0 +1,113 @@
+/*
+ * 12-shared-cache.h - Process-wide Persistent Narrative Cache
+ *
+ * One narrative cache shared by every session in the process. The
+ * signature space is split across independently locked shards, each a
+ * NarrativeCache, so sessions narrating different events do not
+ * contend. Every store and removal is appended to a log file; on
+ * startup the log is replayed so narrations generated by earlier runs
+ * are served without an LLM call from the first turn. The log is
+ * rewritten with only live entries whenever it grows to twice the
+ * live set.
+ *
+ * Log format, one record after another:
+ *   S <generated_at> <signature_len> <narrative_len>\n<signature><narrative>\n
+ *   R <signature_len>\n<signature>\n
+ * Replay stops at the first malformed record (e.g. a write cut short
+ * by a crash) and the next compaction drops the damaged tail.
+ */
+
+#ifndef LLM_SHARED_CACHE_H
+#define LLM_SHARED_CACHE_H
+
+#include "07-narrative-cache.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// {{{ SharedCacheConfig
+typedef struct {
+    int max_entries;         // Across all shards
+    int ttl_seconds;         // Time-to-live (0 = no expiration)
+    size_t max_bytes;        // Memory budget across all shards (0 = none)
+    const char* path;        // Log file; NULL or "" keeps the cache in memory
+} SharedCacheConfig;
+// }}}
+
+// {{{ SharedCacheStats
+typedef struct {
+    NarrativeCacheStats cache;   // Summed over shards
+    int loaded;                  // Entries restored by the last warm start
+    int log_records;             // Records in the log file
+    int compactions;             // Log rewrites since init
+} SharedCacheStats;
+// }}}
+
+// {{{ shared_cache_init
+// Creates the shared cache and, if config->path names an existing log,
+// replays it. A missing log (and its directory) is created.
+// Must not race with other shared_cache calls.
+// Returns false on invalid config, allocation failure or if the log
+// cannot be opened for appending.
+bool shared_cache_init(const SharedCacheConfig* config);
+// }}}
+
+// {{{ shared_cache_cleanup
+// Flushes and closes the log and frees the cache.
+// Must not race with other shared_cache calls.
+void shared_cache_cleanup(void);
+// }}}
+
+// {{{ shared_cache_is_ready
+// Returns true between shared_cache_init and shared_cache_cleanup.
+bool shared_cache_is_ready(void);
+// }}}
+
+// {{{ shared_cache_get
+// Thread-safe lookup. Returns a copy of the narrative (caller frees)
+// or NULL if absent, expired or the cache is not initialized.
+char* shared_cache_get(const char* signature);
+// }}}
+
+// {{{ shared_cache_contains
+// Thread-safe check for a live entry; leaves hit/miss counters and
+// recency untouched.
+bool shared_cache_contains(const char* signature);
+// }}}
+
+// {{{ shared_cache_set
+// Thread-safe store; the record is appended to the log before
+// returning. Returns false on failure.
+bool shared_cache_set(const char* signature, const char* narrative);
+// }}}
+
+// {{{ shared_cache_remove
+// Thread-safe removal. Returns true if the entry was present.
+bool shared_cache_remove(const char* signature);
+// }}}
+
+// {{{ shared_cache_get_event
+// Template lookup (see narrative_cache_get_event): returns the cached
+// narration for the event with its player names filled in, or NULL.
+// Caller frees.
+char* shared_cache_get_event(NarrationEvent* event);
+// }}}
+
+// {{{ shared_cache_set_event
+// Templatizes narrative and stores it under the event's template
+// signature (see narrative_cache_set_event).
+bool shared_cache_set_event(NarrationEvent* event, const char* narrative);
+// }}}
+
+// {{{ shared_cache_compact
+// Drops expired entries and rewrites the log with only live entries
+// (written to a temporary file, then renamed over the log).
+// Runs automatically as the log grows; callable for periodic upkeep.
+// Returns false if there is no log or the rewrite failed.
+bool shared_cache_compact(void);
+// }}}
+
+// {{{ shared_cache_get_stats
+SharedCacheStats shared_cache_get_stats(void);
+// }}}
+
+#endif /* LLM_SHARED_CACHE_H */
@@ -0,0 +1,669 @@
+/*
+ * 13-prefetch.c - Speculative Narration Prefetch Implementation
+ *
+ * Predicted events become slots: a queued slot holds the prompt for
+ * its event, a running slot is a request in the scheduler's prefetch
+ * class (or on the async engine when no scheduler runs). Completed
+ * narration is templatized with the names the prompt was built from
+ * and stored in the shared cache, and its signature is remembered so a
+ * later action that uses it counts as a hit.
+ *
+ * Requests are submitted and cancelled with the lock released, since
+ * the scheduler may run a callback, which takes the lock, on the
+ * calling thread. A slot is marked issuing while its submission is
+ * under way so an early callback leaves freeing it to the issuer, and
+ * busy counts threads working outside the lock so that
+ * prefetch_free waits for them.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "13-prefetch.h"
+#include "02-prompts.h"
+#include "07-narrative-cache.h"
+#include "12-shared-cache.h"
+#include "16-scheduler.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PREFETCH_DEFAULT_IN_FLIGHT 2
+#define PREFETCH_DEFAULT_PER_WINDOW 6
+#define PREFETCH_MAX_CANDIDATES 16
+#define PREFETCH_HISTORY 64
+
+// {{{ PrefetchSlot
+typedef struct PrefetchSlot {
+    NarrationPrefetcher* owner;
+    LLMRequestHandle handle;
+    char* signature;         // Template signature the narration is stored under
+    char* prompt;            // Event prompt, until issued
+    char* actor_name;        // Names in the prompt, replaced by placeholders
+    char* target_name;
+    const void* session;     // Game the event was predicted for
+    bool scheduled;          // handle is the scheduler's, not the async engine's
+    bool issuing;            // Being submitted; the issuer frees it if finished
+    bool finished;           // Callback ran while issuing
+    bool cancelled;
+    struct PrefetchSlot* next;
+    struct PrefetchSlot* issue_next;  // Batch taken by one issue call
+} PrefetchSlot;
+// }}}
+
+// {{{ NarrationPrefetcher
+struct NarrationPrefetcher {
+    LLMConfig llm;
+    PrefetchConfig config;
+    CardInstance explorer;   // Stands in for the explorer in predicted purchases
+
+    pthread_mutex_t lock;
+    pthread_cond_t idle;     // Signalled when nothing is running or busy
+    PrefetchSlot* queued;    // FIFO, most likely event first
+    PrefetchSlot* queued_tail;
+    PrefetchSlot* running;
+    int running_count;
+    int busy;                // Issuers and callbacks working unlocked
+
+    // Signatures of prefetched narration not yet matched by an action
+    char* prefetched[PREFETCH_HISTORY];
+    int prefetched_next;
+
+    PrefetchStats stats;
+};
+// }}}
+
+// {{{ copy_string
+static char* copy_string(const char* s) {
+    return s != NULL ? strdup(s) : NULL;
+}
+// }}}
+
+// {{{ slot_free
+static void slot_free(PrefetchSlot* slot) {
+    if (slot == NULL) {
+        return;
+    }
+    free(slot->signature);
+    free(slot->prompt);
+    free(slot->actor_name);
+    free(slot->target_name);
+    free(slot);
+}
+// }}}
+
+// {{{ budget_exhausted_locked
+static bool budget_exhausted_locked(NarrationPrefetcher* p) {
+    return p->config.token_budget > 0 &&
+           p->stats.tokens_used >= p->config.token_budget;
+}
+// }}}
+
+// {{{ cancel_handle
+static void cancel_handle(LLMRequestHandle handle, bool scheduled) {
+    if (scheduled) {
+        llm_scheduler_cancel(handle);
+    } else {
+        llm_async_cancel(handle);
+    }
+}
+// }}}
+
+// {{{ cancel_all
+// Drops queued slots and cancels running ones; their callbacks unlink
+// them. A slot still being issued is cancelled by its issuer.
+static void cancel_all(NarrationPrefetcher* p) {
+    pthread_mutex_lock(&p->lock);
+    while (p->queued != NULL) {
+        PrefetchSlot* slot = p->queued;
+        p->queued = slot->next;
+        slot_free(slot);
+        p->stats.cancelled++;
+    }
+    p->queued_tail = NULL;
+
+    int count = 0;
+    LLMRequestHandle* handles = NULL;
+    bool* scheduled = NULL;
+    if (p->running_count > 0) {
+        handles = malloc(sizeof(LLMRequestHandle) * p->running_count);
+        scheduled = malloc(sizeof(bool) * p->running_count);
+    }
+    for (PrefetchSlot* slot = p->running; slot != NULL; slot = slot->next) {
+        if (slot->cancelled) {
+            continue;
+        }
+        slot->cancelled = true;
+        if (!slot->issuing && handles != NULL && scheduled != NULL) {
+            handles[count] = slot->handle;
+            scheduled[count] = slot->scheduled;
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    // Cancelling may run callbacks, which take the lock, right here
+    for (int i = 0; i < count; i++) {
+        cancel_handle(handles[i], scheduled[i]);
+    }
+    free(handles);
+    free(scheduled);
+}
+// }}}
+
+// {{{ unlink_running_locked
+static void unlink_running_locked(NarrationPrefetcher* p, PrefetchSlot* slot) {
+    PrefetchSlot** link = &p->running;
+    while (*link != NULL && *link != slot) {
+        link = &(*link)->next;
+    }
+    if (*link == slot) {
+        *link = slot->next;
+        p->running_count--;
+    }
+}
+// }}}
+
+// {{{ leave_busy
+// Ends a stretch of work outside the lock and wakes prefetch_free once
+// nothing is left.
+static void leave_busy(NarrationPrefetcher* p) {
+    pthread_mutex_lock(&p->lock);
+    p->busy--;
+    if (p->running_count == 0 && p->busy == 0) {
+        pthread_cond_broadcast(&p->idle);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+// }}}
+
+// {{{ remember_locked
+// Records a prefetched signature, overwriting the oldest if full.
+static void remember_locked(NarrationPrefetcher* p, const char* signature) {
+    for (int i = 0; i < PREFETCH_HISTORY; i++) {
+        if (p->prefetched[i] != NULL && strcmp(p->prefetched[i], signature) == 0) {
+            return;
+        }
+    }
+    free(p->prefetched[p->prefetched_next]);
+    p->prefetched[p->prefetched_next] = strdup(signature);
+    p->prefetched_next = (p->prefetched_next + 1) % PREFETCH_HISTORY;
+}
+// }}}
+
+// {{{ claim_locked
+// Forgets signature if it was prefetched; returns true if it was.
+static bool claim_locked(NarrationPrefetcher* p, const char* signature) {
+    for (int i = 0; i < PREFETCH_HISTORY; i++) {
+        if (p->prefetched[i] != NULL && strcmp(p->prefetched[i], signature) == 0) {
+            free(p->prefetched[i]);
+            p->prefetched[i] = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+// }}}
+
+static void issue(NarrationPrefetcher* p);
+
+// {{{ on_prefetch_done
+// Async callback: stores the narration and starts the next queued slot.
+static void on_prefetch_done(LLMResponse* response, void* user) {
+    PrefetchSlot* slot = (PrefetchSlot*)user;
+    NarrationPrefetcher* p = slot->owner;
+
+    bool success = response != NULL && response->success && response->text != NULL;
+    bool stored = false;
+    if (success) {
+        Player actor = { .name = slot->actor_name };
+        Player target = { .name = slot->target_name };
+        NarrationEvent event = {
+            .actor = slot->actor_name != NULL ? &actor : NULL,
+            .target = slot->target_name != NULL ? &target : NULL
+        };
+        char* template_text = narrative_templatize(response->text, &event);
+        stored = template_text != NULL && shared_cache_set(slot->signature, template_text);
+        free(template_text);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    unlink_running_locked(p, slot);
+
+    if (response != NULL) {
+        p->stats.tokens_used += response->tokens_used;
+    }
+    if (stored) {
+        p->stats.completed++;
+        remember_locked(p, slot->signature);
+    } else if (!success && slot->cancelled) {
+        p->stats.cancelled++;
+    } else {
+        p->stats.failed++;
+    }
+
+    bool exhausted = budget_exhausted_locked(p);
+    bool owned = !slot->issuing;
+    if (!owned) {
+        slot->finished = true;
+    }
+    p->busy++;
+    pthread_mutex_unlock(&p->lock);
+
+    if (exhausted) {
+        cancel_all(p);
+    } else {
+        issue(p);
+    }
+    leave_busy(p);
+
+    if (owned) {
+        slot_free(slot);
+    }
+    llm_response_free(response);
+}
+// }}}
+
+// {{{ submit
+// Sends slot's prompt to the model. The callback may run before this
+// returns.
+static LLMRequestHandle submit(NarrationPrefetcher* p, PrefetchSlot* slot) {
+    LLMMessage messages[2] = {
+        { "system", (char*)prompt_get_system_prompt() },
+        { "user", slot->prompt }
+    };
+
+    // Speculation goes in the lowest class, behind every real request
+    if (llm_scheduler_running()) {
+        LLMScheduleOptions options = {
+            .request_class = LLM_CLASS_PREFETCH,
+            .session = slot->session,
+            .turn = -1
+        };
+        slot->scheduled = true;
+        return llm_schedule(&p->llm, messages, 2, &options, on_prefetch_done, slot);
+    }
+    slot->scheduled = false;
+    return llm_request_async(&p->llm, messages, 2, on_prefetch_done, slot);
+}
+// }}}
+
+// {{{ issue
+// Starts queued slots while there is room in flight and budget left.
+// Slots are counted as running under the lock, then submitted without
+// it.
+static void issue(NarrationPrefetcher* p) {
+    PrefetchSlot* batch = NULL;
+    PrefetchSlot** batch_tail = &batch;
+
+    pthread_mutex_lock(&p->lock);
+    while (p->queued != NULL && p->running_count < p->config.max_in_flight &&
+           !budget_exhausted_locked(p)) {
+        PrefetchSlot* slot = p->queued;
+        p->queued = slot->next;
+        if (p->queued == NULL) {
+            p->queued_tail = NULL;
+        }
+
+        slot->issuing = true;
+        slot->next = p->running;
+        p->running = slot;
+        p->running_count++;
+
+        slot->issue_next = NULL;
+        *batch_tail = slot;
+        batch_tail = &slot->issue_next;
+    }
+    if (batch == NULL) {
+        pthread_mutex_unlock(&p->lock);
+        return;
+    }
+    p->busy++;
+    pthread_mutex_unlock(&p->lock);
+
+    while (batch != NULL) {
+        PrefetchSlot* slot = batch;
+        batch = slot->issue_next;
+
+        LLMRequestHandle handle = submit(p, slot);
+        bool scheduled = slot->scheduled;
+        free(slot->prompt);
+        slot->prompt = NULL;
+
+        pthread_mutex_lock(&p->lock);
+        slot->issuing = false;
+        bool release = slot->finished;
+        bool cancel = false;
+        if (!release && handle == LLM_REQUEST_INVALID) {
+            // Not queued, so the callback will never run
+            unlink_running_locked(p, slot);
+            p->stats.failed++;
+            release = true;
+        } else if (!release) {
+            slot->handle = handle;
+            cancel = slot->cancelled;
+        }
+        if (handle != LLM_REQUEST_INVALID) {
+            p->stats.issued++;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        // Cancelled while being submitted: cancel_all left it to us
+        if (cancel) {
+            cancel_handle(handle, scheduled);
+        }
+        if (release) {
+            slot_free(slot);
+        }
+    }
+    leave_busy(p);
+}
+// }}}
+
+// {{{ prefetch_create
+NarrationPrefetcher* prefetch_create(const LLMConfig* llm, const PrefetchConfig* config) {
+    if (llm == NULL || llm->endpoint == NULL) {
+        return NULL;
+    }
+
+    NarrationPrefetcher* p = calloc(1, sizeof(NarrationPrefetcher));
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p->llm = *llm;
+    p->llm.endpoint = copy_string(llm->endpoint);
+    p->llm.api_key = copy_string(llm->api_key);
+    p->llm.model = copy_string(llm->model);
+    if (p->llm.endpoint == NULL) {
+        free(p->llm.api_key);
+        free(p->llm.model);
+        free(p);
+        return NULL;
+    }
+
+    p->config.max_in_flight = PREFETCH_DEFAULT_IN_FLIGHT;
+    p->config.max_per_window = PREFETCH_DEFAULT_PER_WINDOW;
+    if (config != NULL) {
+        p->config = *config;
+        if (p->config.max_in_flight < 1) {
+            p->config.max_in_flight = 1;
+        }
+        if (p->config.max_per_window < 0) {
+            p->config.max_per_window = 0;
+        }
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->idle, NULL);
+    return p;
+}
+// }}}
+
+// {{{ prefetch_free
+void prefetch_free(NarrationPrefetcher* p) {
+    if (p == NULL) {
+        return;
+    }
+
+    cancel_all(p);
+    pthread_mutex_lock(&p->lock);
+    while (p->running_count > 0 || p->busy > 0) {
+        pthread_cond_wait(&p->idle, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    for (int i = 0; i < PREFETCH_HISTORY; i++) {
+        free(p->prefetched[i]);
+    }
+    free(p->llm.endpoint);
+    free(p->llm.api_key);
+    free(p->llm.model);
+    pthread_cond_destroy(&p->idle);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
+// }}}
+
+// {{{ prefetch_predict
+int prefetch_predict(NarrationPrefetcher* p, Game* game, WorldState* state,
+                     NarrationEvent* out, int max) {
+    if (p == NULL || game == NULL || out == NULL || max <= 0 ||
+        game->phase != PHASE_MAIN) {
+        return 0;
+    }
+
+    Player* player = game_get_active_player(game);
+    if (player == NULL || player->deck == NULL) {
+        return 0;
+    }
+    Player* opponent = game_get_opponent(game, 0);
+    Deck* deck = player->deck;
+    int count = 0;
+
+    // What the hand can raise if it is all played
+    int trade = player->trade;
+    int combat = player->combat;
+    for (int i = 0; i < deck->hand_count; i++) {
+        trade += card_instance_total_trade(deck->hand[i]);
+        combat += card_instance_total_combat(deck->hand[i]);
+    }
+
+    // Cards in hand: almost certainly played this turn
+    for (int i = 0; i < deck->hand_count && count < max; i++) {
+        CardInstance* card = deck->hand[i];
+        if (card == NULL || card->type == NULL) {
+            continue;
+        }
+        bool seen = false;
+        for (int j = 0; j < count && !seen; j++) {
+            seen = out[j].card->type == card->type;
+        }
+        if (seen) {
+            continue;
+        }
+        out[count] = (NarrationEvent){ .type = GAME_EVENT_CARD_PLAYED,
+                                       .actor = player, .card = card,
+                                       .turn = game->turn_number };
+        count++;
+    }
+
+    // Spending the combat on the next opponent
+    if (combat > 0 && opponent != NULL && count < max) {
+        out[count] = (NarrationEvent){ .type = GAME_EVENT_ATTACK_PLAYER,
+                                       .actor = player, .target = opponent,
+                                       .damage = combat,
+                                       .turn = game->turn_number };
+        count++;
+    }
+
+    // Affordable purchases, dearest first
+    if (game->trade_row != NULL) {
+        int order[TRADE_ROW_SLOTS];
+        int slots = 0;
+        for (int s = 0; s < TRADE_ROW_SLOTS; s++) {
+            int cost = trade_row_get_cost(game->trade_row, s);
+            if (cost < 0 || cost > trade) {
+                continue;
+            }
+            int at = slots++;
+            while (at > 0 && trade_row_get_cost(game->trade_row, order[at - 1]) < cost) {
+                order[at] = order[at - 1];
+                at--;
+            }
+            order[at] = s;
+        }
+        for (int i = 0; i < slots && count < max; i++) {
+            out[count] = (NarrationEvent){ .type = GAME_EVENT_CARD_PURCHASED,
+                                           .actor = player,
+                                           .card = game->trade_row->slots[order[i]],
+                                           .cost = trade_row_get_cost(game->trade_row, order[i]),
+                                           .turn = game->turn_number };
+            count++;
+        }
+
+        CardType* explorer = game->trade_row->explorer_type;
+        if (explorer != NULL && trade >= EXPLORER_COST && count < max) {
+            p->explorer.type = explorer;
+            out[count] = (NarrationEvent){ .type = GAME_EVENT_CARD_PURCHASED,
+                                           .actor = player, .card = &p->explorer,
+                                           .cost = EXPLORER_COST,
+                                           .turn = game->turn_number };
+            count++;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        out[i].intensity = event_narration_calculate_intensity(state, &out[i]);
+    }
+    return count;
+}
+// }}}
+
+// {{{ prefetch_begin
+int prefetch_begin(NarrationPrefetcher* p, Game* game, WorldState* state) {
+    if (p == NULL) {
+        return 0;
+    }
+
+    prefetch_cancel(p);
+    if (game == NULL || !shared_cache_is_ready()) {
+        return 0;
+    }
+
+    NarrationEvent events[PREFETCH_MAX_CANDIDATES];
+    int count = prefetch_predict(p, game, state, events, PREFETCH_MAX_CANDIDATES);
+
+    // Build slots outside the lock; prompts are the expensive part
+    PrefetchSlot* head = NULL;
+    PrefetchSlot* tail = NULL;
+    int queued = 0;
+    int cached = 0;
+    for (int i = 0; i < count && queued < p->config.max_per_window; i++) {
+        char* signature = event_build_template_signature(&events[i]);
+        if (signature == NULL) {
+            continue;
+        }
+
+        bool duplicate = shared_cache_contains(signature);
+        if (duplicate) {
+            cached++;
+        }
+        for (PrefetchSlot* s = head; s != NULL && !duplicate; s = s->next) {
+            duplicate = strcmp(s->signature, signature) == 0;
+        }
+        if (duplicate) {
+            free(signature);
+            continue;
+        }
+
+        PrefetchSlot* slot = calloc(1, sizeof(PrefetchSlot));
+        if (slot == NULL) {
+            free(signature);
+            break;
+        }
+        slot->owner = p;
+        slot->session = game;
+        slot->signature = signature;
+        slot->prompt = event_narration_build(&events[i]);
+        slot->actor_name = events[i].actor != NULL ? copy_string(events[i].actor->name) : NULL;
+        slot->target_name = events[i].target != NULL ? copy_string(events[i].target->name) : NULL;
+        if (slot->prompt == NULL) {
+            slot_free(slot);
+            continue;
+        }
+
+        if (tail != NULL) {
+            tail->next = slot;
+        } else {
+            head = slot;
+        }
+        tail = slot;
+        queued++;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->stats.predicted += count;
+    p->stats.already_cached += cached;
+    if (budget_exhausted_locked(p)) {
+        while (head != NULL) {
+            PrefetchSlot* next = head->next;
+            slot_free(head);
+            head = next;
+        }
+        queued = 0;
+    }
+    if (queued > 0) {
+        p->stats.windows++;
+        if (p->queued_tail != NULL) {
+            p->queued_tail->next = head;
+        } else {
+            p->queued = head;
+        }
+        p->queued_tail = tail;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    issue(p);
+
+    return queued;
+}
+// }}}
+
+// {{{ prefetch_on_action
+char* prefetch_on_action(NarrationPrefetcher* p, NarrationEvent* event) {
+    if (p == NULL || event == NULL) {
+        return NULL;
+    }
+
+    prefetch_cancel(p);
+
+    char* narrative = shared_cache_get_event(event);
+    char* signature = event_build_template_signature(event);
+
+    pthread_mutex_lock(&p->lock);
+    p->stats.actions++;
+    if (narrative != NULL && signature != NULL && claim_locked(p, signature)) {
+        p->stats.hits++;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    free(signature);
+    return narrative;
+}
+// }}}
+
+// {{{ prefetch_cancel
+void prefetch_cancel(NarrationPrefetcher* p) {
+    if (p == NULL) {
+        return;
+    }
+
+    cancel_all(p);
+}
+// }}}
+
+// {{{ prefetch_get_stats
+PrefetchStats prefetch_get_stats(NarrationPrefetcher* p) {
+    PrefetchStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (p == NULL) {
+        return stats;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    stats = p->stats;
+    pthread_mutex_unlock(&p->lock);
+
+    if (stats.completed > 0) {
+        stats.accuracy = (float)stats.hits / (float)stats.completed;
+    }
+    if (stats.actions > 0) {
+        stats.hit_rate = (float)stats.hits / (float)stats.actions;
+    }
+    int submitted = llm_async_get_stats().submitted;
+    if (submitted > 0) {
+        stats.capacity_share = (float)stats.issued / (float)submitted;
+    }
+    return stats;
+}
+// }}}
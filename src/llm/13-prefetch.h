@@ -0,0 +1,115 @@
+/*
+ * 13-prefetch.h - Speculative Narration Prefetch
+ *
+ * Takes LLM latency off the critical path of a card play. While the
+ * active player deliberates in PHASE_MAIN, the prefetcher predicts the
+ * events they are likely to cause next (playing a card from hand,
+ * buying an affordable trade-row card, attacking with the combat they
+ * can raise) and generates narration for them in the background into
+ * the shared narrative cache, under template signatures, so the real
+ * action finds its narration already waiting.
+ *
+ * Speculation yields to real work: only a few prefetches run at once,
+ * each deliberation window has a request budget, and a token budget
+ * caps the total. Everything outstanding is cancelled as soon as the
+ * real action arrives.
+ */
+
+#ifndef LLM_PREFETCH_H
+#define LLM_PREFETCH_H
+
+#include "01-api-client.h"
+#include "03-world-state.h"
+#include "05-event-narration.h"
+#include "10-async-client.h"
+#include "../core/05-game.h"
+#include <stdbool.h>
+
+// {{{ PrefetchConfig
+typedef struct {
+    int max_in_flight;       // Speculative requests running at once
+    int max_per_window;      // Requests per deliberation window
+    int token_budget;        // Total tokens prefetch may spend (0 = no limit)
+} PrefetchConfig;
+// }}}
+
+// {{{ PrefetchStats
+// Counters since prefetch_create.
+typedef struct {
+    int windows;             // Deliberation windows that issued requests
+    int predicted;           // Candidate events considered
+    int already_cached;      // Candidates whose narration was cached already
+    int issued;              // Speculative requests sent to the model
+    int completed;           // Narrations stored in the shared cache
+    int cancelled;           // Dropped by a real action, a new window or the budget
+    int failed;              // Requests that failed
+    int tokens_used;         // Tokens spent on speculation
+    int actions;             // Real actions reported via prefetch_on_action
+    int hits;                // Actions served by a prefetched narration
+    float accuracy;          // hits / completed: share of speculation used
+    float hit_rate;          // hits / actions: share of actions that skipped the model
+    float capacity_share;    // issued / async requests submitted process-wide
+} PrefetchStats;
+// }}}
+
+// {{{ NarrationPrefetcher
+// Opaque prefetch state for one game session.
+typedef struct NarrationPrefetcher NarrationPrefetcher;
+// }}}
+
+// {{{ prefetch_create
+// Creates a prefetcher that sends requests with a copy of llm.
+// config may be NULL for defaults (2 in flight, 6 per window, no
+// token budget). Requires the async engine (llm_async_init) and the
+// shared cache (shared_cache_init) to be running when prefetching.
+// While the scheduler runs, requests go through it in the
+// LLM_CLASS_PREFETCH class, behind every real request.
+// Returns NULL on invalid arguments or allocation failure.
+NarrationPrefetcher* prefetch_create(const LLMConfig* llm, const PrefetchConfig* config);
+// }}}
+
+// {{{ prefetch_free
+// Cancels outstanding prefetches, waits for their callbacks and frees
+// the prefetcher.
+void prefetch_free(NarrationPrefetcher* prefetcher);
+// }}}
+
+// {{{ prefetch_predict
+// Predicts the active player's likely next events, most likely first:
+// cards in hand (one per card type), an attack on the next opponent
+// with the combat the hand can raise, then trade-row cards affordable
+// with the trade the hand can raise (dearest first) and the explorer.
+// Fills at most max events and returns the count; 0 outside PHASE_MAIN.
+// Events point into game and the prefetcher, and stay valid until the
+// next predict or begin call while the game is unchanged.
+int prefetch_predict(NarrationPrefetcher* prefetcher, Game* game,
+                     WorldState* state, NarrationEvent* out, int max);
+// }}}
+
+// {{{ prefetch_begin
+// Starts a deliberation window: cancels what the previous window left
+// outstanding, predicts events and queues narration requests for those
+// not already cached, within the window and token budgets.
+// Call when the active player starts deliberating (turn start, after
+// each action). Returns the number of requests queued.
+int prefetch_begin(NarrationPrefetcher* prefetcher, Game* game, WorldState* state);
+// }}}
+
+// {{{ prefetch_on_action
+// Reports the real event: cancels outstanding prefetches and returns
+// the cached narration for it with names filled in (caller frees), or
+// NULL if the caller must generate it.
+char* prefetch_on_action(NarrationPrefetcher* prefetcher, NarrationEvent* event);
+// }}}
+
+// {{{ prefetch_cancel
+// Cancels queued and in-flight prefetches. Callbacks of in-flight
+// requests still run on the async I/O thread.
+void prefetch_cancel(NarrationPrefetcher* prefetcher);
+// }}}
+
+// {{{ prefetch_get_stats
+PrefetchStats prefetch_get_stats(NarrationPrefetcher* prefetcher);
+// }}}
+
+#endif /* LLM_PREFETCH_H */
@@ -0,0 +1,573 @@
+/*
+ * 14-tokenizer.c - Byte-level BPE Tokenizer Implementation
+ *
+ * Token bytes live in one arena, indexed by an open-addressing hash
+ * table from byte string to rank. Each piece is merged with the usual
+ * byte-pair loop: keep the rank of every adjacent pair, merge the
+ * lowest, and re-rank only its neighbours.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "14-tokenizer.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_RANK INT_MAX
+#define PREFIX_CACHE_SLOTS 64
+#define STACK_PARTS 128
+
+// {{{ TokenSlot
+typedef struct {
+    uint64_t hash;
+    uint32_t offset;         // Into the byte arena
+    uint32_t length;         // 0 = empty slot
+    int rank;
+} TokenSlot;
+// }}}
+
+// {{{ PrefixCacheEntry
+typedef struct {
+    uint64_t hash;
+    size_t prefix_len;
+    size_t resume;           // Offset of the first uncounted piece
+    int count;               // Tokens before resume
+} PrefixCacheEntry;
+// }}}
+
+// {{{ Tokenizer
+struct Tokenizer {
+    unsigned char* bytes;
+    size_t bytes_len;
+    size_t bytes_cap;
+    TokenSlot* slots;
+    size_t mask;
+    int count;
+    int byte_rank[256];      // Rank of each single byte
+
+    pthread_mutex_t cache_lock;
+    PrefixCacheEntry cache[PREFIX_CACHE_SLOTS];
+};
+// }}}
+
+// {{{ hash_bytes
+// FNV-1a.
+static uint64_t hash_bytes(const unsigned char* data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+// }}}
+
+// {{{ lookup_rank
+static int lookup_rank(const Tokenizer* tok, const unsigned char* data, size_t len) {
+    if (len == 1) {
+        return tok->byte_rank[data[0]];
+    }
+
+    uint64_t hash = hash_bytes(data, len);
+    for (size_t i = hash & tok->mask;; i = (i + 1) & tok->mask) {
+        const TokenSlot* slot = &tok->slots[i];
+        if (slot->length == 0) {
+            return NO_RANK;
+        }
+        if (slot->hash == hash && slot->length == len &&
+            memcmp(tok->bytes + slot->offset, data, len) == 0) {
+            return slot->rank;
+        }
+    }
+}
+// }}}
+
+// {{{ insert_token
+static bool insert_token(Tokenizer* tok, const unsigned char* data, size_t len, int rank) {
+    if (len == 0 || len > UINT32_MAX) {
+        return false;
+    }
+    if (len == 1) {
+        tok->byte_rank[data[0]] = rank;
+    }
+
+    if (tok->bytes_len + len > tok->bytes_cap) {
+        size_t cap = tok->bytes_cap > 0 ? tok->bytes_cap * 2 : 4096;
+        while (cap < tok->bytes_len + len) {
+            cap *= 2;
+        }
+        unsigned char* grown = realloc(tok->bytes, cap);
+        if (grown == NULL) {
+            return false;
+        }
+        tok->bytes = grown;
+        tok->bytes_cap = cap;
+    }
+
+    // Keep the table at most half full
+    if ((size_t)(tok->count + 1) * 2 > tok->mask + 1) {
+        size_t new_size = (tok->mask + 1) * 2;
+        TokenSlot* grown = calloc(new_size, sizeof(TokenSlot));
+        if (grown == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i <= tok->mask; i++) {
+            TokenSlot* old = &tok->slots[i];
+            if (old->length == 0) {
+                continue;
+            }
+            size_t j = old->hash & (new_size - 1);
+            while (grown[j].length != 0) {
+                j = (j + 1) & (new_size - 1);
+            }
+            grown[j] = *old;
+        }
+        free(tok->slots);
+        tok->slots = grown;
+        tok->mask = new_size - 1;
+    }
+
+    uint64_t hash = hash_bytes(data, len);
+    size_t i = hash & tok->mask;
+    while (tok->slots[i].length != 0) {
+        TokenSlot* slot = &tok->slots[i];
+        if (slot->hash == hash && slot->length == len &&
+            memcmp(tok->bytes + slot->offset, data, len) == 0) {
+            return false;  // Duplicate token
+        }
+        i = (i + 1) & tok->mask;
+    }
+
+    memcpy(tok->bytes + tok->bytes_len, data, len);
+    tok->slots[i] = (TokenSlot){ hash, (uint32_t)tok->bytes_len, (uint32_t)len, rank };
+    tok->bytes_len += len;
+    tok->count++;
+    return true;
+}
+// }}}
+
+// {{{ base64_decode
+// Decodes standard base64 into out (at least 3/4 of len bytes).
+// Returns the decoded length, or -1 on invalid input.
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+static long base64_decode(const char* in, size_t len, unsigned char* out) {
+    while (len > 0 && in[len - 1] == '=') {
+        len--;
+    }
+    if (len % 4 == 1) {
+        return -1;
+    }
+
+    long n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; i++) {
+        int v = base64_value(in[i]);
+        if (v < 0) {
+            return -1;
+        }
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (unsigned char)((acc >> bits) & 0xFF);
+        }
+    }
+    return n;
+}
+// }}}
+
+// {{{ tokenizer_load
+Tokenizer* tokenizer_load(const char* path) {
+    if (path == NULL) {
+        return NULL;
+    }
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    Tokenizer* tok = calloc(1, sizeof(Tokenizer));
+    if (tok == NULL) {
+        fclose(f);
+        return NULL;
+    }
+    tok->mask = 1023;
+    tok->slots = calloc(tok->mask + 1, sizeof(TokenSlot));
+    for (int i = 0; i < 256; i++) {
+        tok->byte_rank[i] = NO_RANK;
+    }
+    pthread_mutex_init(&tok->cache_lock, NULL);
+
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    unsigned char* decoded = NULL;
+    size_t decoded_cap = 0;
+    bool ok = tok->slots != NULL;
+
+    while (ok && (line_len = getline(&line, &line_cap, f)) != -1) {
+        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
+            line[--line_len] = '\0';
+        }
+        if (line_len == 0) {
+            continue;
+        }
+
+        char* space = strchr(line, ' ');
+        char* end = NULL;
+        long rank = space != NULL ? strtol(space + 1, &end, 10) : -1;
+        if (space == NULL || end == space + 1 || *end != '\0' || rank < 0 || rank >= INT_MAX) {
+            ok = false;
+            break;
+        }
+
+        size_t encoded_len = (size_t)(space - line);
+        if (encoded_len > decoded_cap) {
+            decoded_cap = encoded_len;
+            unsigned char* grown = realloc(decoded, decoded_cap);
+            if (grown == NULL) {
+                ok = false;
+                break;
+            }
+            decoded = grown;
+        }
+        long len = base64_decode(line, encoded_len, decoded);
+        ok = len > 0 && insert_token(tok, decoded, (size_t)len, (int)rank);
+    }
+
+    free(line);
+    free(decoded);
+    fclose(f);
+
+    for (int i = 0; i < 256 && ok; i++) {
+        ok = tok->byte_rank[i] != NO_RANK;
+    }
+    if (!ok) {
+        tokenizer_free(tok);
+        return NULL;
+    }
+    return tok;
+}
+// }}}
+
+// {{{ tokenizer_load_for_model
+Tokenizer* tokenizer_load_for_model(const char* dir, const char* model) {
+    if (dir == NULL || dir[0] == '\0' || model == NULL || model[0] == '\0' ||
+        strchr(model, '/') != NULL) {
+        return NULL;
+    }
+
+    size_t len = strlen(dir) + strlen(model) + sizeof("/.tiktoken");
+    char* path = malloc(len);
+    if (path == NULL) {
+        return NULL;
+    }
+    snprintf(path, len, "%s/%s.tiktoken", dir, model);
+
+    Tokenizer* tok = tokenizer_load(path);
+    free(path);
+    return tok;
+}
+// }}}
+
+// {{{ tokenizer_free
+void tokenizer_free(Tokenizer* tok) {
+    if (tok == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&tok->cache_lock);
+    free(tok->bytes);
+    free(tok->slots);
+    free(tok);
+}
+// }}}
+
+// {{{ tokenizer_vocab_size
+int tokenizer_vocab_size(const Tokenizer* tok) {
+    return tok != NULL ? tok->count : 0;
+}
+// }}}
+
+// {{{ Character classes
+// Bytes of multi-byte UTF-8 sequences count as letters.
+static bool is_letter(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+static bool is_digit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_newline(unsigned char c) {
+    return c == '\n' || c == '\r';
+}
+
+static bool is_punct(unsigned char c) {
+    return !is_letter(c) && !is_digit(c) && !is_space(c);
+}
+// }}}
+
+// {{{ next_piece
+// Returns the end of the piece starting at i. Mirrors the GPT-4 style
+// split: contractions, a word with one leading non-letter, 1-3 digits,
+// punctuation with trailing newlines, newline runs, then whitespace
+// (leaving a final space to lead the next word).
+static size_t next_piece(const unsigned char* s, size_t i, size_t n) {
+    unsigned char c = s[i];
+
+    if (c == '\'' && i + 1 < n) {
+        unsigned char a = (unsigned char)(s[i + 1] | 0x20);
+        unsigned char b = i + 2 < n ? (unsigned char)(s[i + 2] | 0x20) : 0;
+        if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') || (a == 'l' && b == 'l')) {
+            return i + 3;
+        }
+        if (a == 's' || a == 't' || a == 'm' || a == 'd') {
+            return i + 2;
+        }
+    }
+
+    size_t j = i;
+    if (!is_letter(c) && !is_digit(c) && !is_newline(c) && j + 1 < n && is_letter(s[j + 1])) {
+        j++;
+    }
+    if (is_letter(s[j])) {
+        while (j < n && is_letter(s[j])) {
+            j++;
+        }
+        return j;
+    }
+
+    if (is_digit(c)) {
+        j = i;
+        while (j < n && j < i + 3 && is_digit(s[j])) {
+            j++;
+        }
+        return j;
+    }
+
+    j = i;
+    if (c == ' ' && j + 1 < n && is_punct(s[j + 1])) {
+        j++;
+    }
+    if (is_punct(s[j])) {
+        while (j < n && is_punct(s[j])) {
+            j++;
+        }
+        while (j < n && is_newline(s[j])) {
+            j++;
+        }
+        return j;
+    }
+
+    // Whitespace run
+    j = i;
+    size_t last_newline = 0;
+    while (j < n && is_space(s[j])) {
+        if (is_newline(s[j])) {
+            last_newline = j + 1;
+        }
+        j++;
+    }
+    if (last_newline > 0) {
+        return last_newline;
+    }
+    if (j < n && j - i > 1) {
+        return j - 1;
+    }
+    return j;
+}
+// }}}
+
+// {{{ merge_piece
+// Byte-pair merges one piece. Writes up to max ids (ids may be NULL)
+// and returns the number of tokens.
+static int merge_piece(const Tokenizer* tok, const unsigned char* piece, size_t len,
+                       int* ids, int max) {
+    if (len == 1 || (len > 1 && lookup_rank(tok, piece, len) != NO_RANK)) {
+        if (ids != NULL && max > 0) {
+            ids[0] = lookup_rank(tok, piece, len);
+        }
+        return 1;
+    }
+
+    // parts[k] = start of the k-th part; ranks[k] = rank of merging
+    // parts k and k+1
+    size_t stack_starts[STACK_PARTS + 1];
+    int stack_ranks[STACK_PARTS + 1];
+    size_t* starts = stack_starts;
+    int* ranks = stack_ranks;
+    if (len > STACK_PARTS) {
+        starts = malloc(sizeof(size_t) * (len + 1));
+        ranks = malloc(sizeof(int) * (len + 1));
+        if (starts == NULL || ranks == NULL) {
+            free(starts);
+            free(ranks);
+            return (int)len;  // One token per byte as a fallback
+        }
+    }
+
+    size_t parts = len;
+    for (size_t k = 0; k <= len; k++) {
+        starts[k] = k;
+    }
+    for (size_t k = 0; k + 1 < parts; k++) {
+        ranks[k] = lookup_rank(tok, piece + k, 2);
+    }
+    ranks[parts - 1] = NO_RANK;
+
+    while (parts > 1) {
+        size_t best = 0;
+        int best_rank = NO_RANK;
+        for (size_t k = 0; k + 1 < parts; k++) {
+            if (ranks[k] < best_rank) {
+                best_rank = ranks[k];
+                best = k;
+            }
+        }
+        if (best_rank == NO_RANK) {
+            break;
+        }
+
+        // Merge parts best and best+1
+        memmove(&starts[best + 1], &starts[best + 2], sizeof(size_t) * (parts - best - 1));
+        memmove(&ranks[best + 1], &ranks[best + 2], sizeof(int) * (parts - best - 2));
+        parts--;
+
+        ranks[best] = best + 1 < parts
+            ? lookup_rank(tok, piece + starts[best], starts[best + 2] - starts[best])
+            : NO_RANK;
+        if (best > 0) {
+            ranks[best - 1] = lookup_rank(tok, piece + starts[best - 1],
+                                          starts[best + 1] - starts[best - 1]);
+        }
+    }
+
+    if (ids != NULL) {
+        for (size_t k = 0; k < parts && (int)k < max; k++) {
+            ids[k] = lookup_rank(tok, piece + starts[k], starts[k + 1] - starts[k]);
+        }
+    }
+
+    if (starts != stack_starts) {
+        free(starts);
+        free(ranks);
+    }
+    return (int)parts;
+}
+// }}}
+
+// {{{ encode_range
+// Tokenizes s[from, n), writing up to max ids when ids is non-NULL.
+static int encode_range(const Tokenizer* tok, const unsigned char* s, size_t from, size_t n,
+                        int* ids, int max) {
+    int total = 0;
+    size_t i = from;
+    while (i < n) {
+        size_t end = next_piece(s, i, n);
+        int room = ids != NULL && total < max ? max - total : 0;
+        total += merge_piece(tok, s + i, end - i, room > 0 ? ids + total : NULL, room);
+        i = end;
+    }
+    return total;
+}
+// }}}
+
+// {{{ tokenizer_count
+int tokenizer_count(Tokenizer* tok, const char* text) {
+    if (tok == NULL || text == NULL) {
+        return 0;
+    }
+    return encode_range(tok, (const unsigned char*)text, 0, strlen(text), NULL, 0);
+}
+// }}}
+
+// {{{ tokenizer_encode
+int tokenizer_encode(Tokenizer* tok, const char* text, int* ids, int max) {
+    if (tok == NULL || text == NULL) {
+        return 0;
+    }
+    return encode_range(tok, (const unsigned char*)text, 0, strlen(text),
+                        max > 0 ? ids : NULL, max);
+}
+// }}}
+
+// {{{ count_safe_prefix
+// Counts the pieces of s[0, prefix_len) whose boundaries cannot change
+// whatever follows the prefix: pieces ending before the prefix's
+// trailing whitespace, with one byte to spare for lookahead.
+static void count_safe_prefix(const Tokenizer* tok, const unsigned char* s,
+                              size_t prefix_len, PrefixCacheEntry* entry) {
+    size_t limit = prefix_len;
+    while (limit > 0 && is_space(s[limit - 1])) {
+        limit--;
+    }
+    limit = limit > 0 ? limit - 1 : 0;
+
+    entry->resume = 0;
+    entry->count = 0;
+    size_t i = 0;
+    while (i < prefix_len) {
+        size_t end = next_piece(s, i, prefix_len);
+        if (end > limit) {
+            break;
+        }
+        entry->count += merge_piece(tok, s + i, end - i, NULL, 0);
+        i = end;
+        entry->resume = i;
+    }
+}
+// }}}
+
+// {{{ tokenizer_count_prefixed
+int tokenizer_count_prefixed(Tokenizer* tok, const char* text, size_t prefix_len) {
+    if (tok == NULL || text == NULL) {
+        return 0;
+    }
+
+    const unsigned char* s = (const unsigned char*)text;
+    size_t n = strlen(text);
+    if (prefix_len > n) {
+        prefix_len = n;
+    }
+    if (prefix_len == 0) {
+        return encode_range(tok, s, 0, n, NULL, 0);
+    }
+
+    uint64_t hash = hash_bytes(s, prefix_len);
+    PrefixCacheEntry* slot = &tok->cache[hash % PREFIX_CACHE_SLOTS];
+
+    pthread_mutex_lock(&tok->cache_lock);
+    PrefixCacheEntry entry = *slot;
+    pthread_mutex_unlock(&tok->cache_lock);
+
+    if (entry.hash != hash || entry.prefix_len != prefix_len) {
+        entry.hash = hash;
+        entry.prefix_len = prefix_len;
+        count_safe_prefix(tok, s, prefix_len, &entry);
+
+        pthread_mutex_lock(&tok->cache_lock);
+        *slot = entry;
+        pthread_mutex_unlock(&tok->cache_lock);
+    }
+
+    return entry.count + encode_range(tok, s, entry.resume, n, NULL, 0);
+}
+// }}}
@@ -0,0 +1,69 @@
+/*
+ * 14-tokenizer.h - Byte-level BPE Tokenizer
+ *
+ * Counts tokens the way the model does, so context budgets are exact
+ * instead of estimated. Loads a rank file in the tiktoken format: one
+ * token per line, its bytes in base64 followed by its rank. A token's
+ * rank is both its id and its merge priority; the file must include
+ * all 256 single bytes.
+ *
+ * Text is first split into pieces (words with their leading space,
+ * runs of up to three digits, punctuation, whitespace), in the style
+ * of the GPT pre-tokenizers, then each piece is merged pairwise by
+ * lowest rank.
+ */
+
+#ifndef LLM_TOKENIZER_H
+#define LLM_TOKENIZER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// {{{ Tokenizer
+// Opaque loaded vocabulary. Counting and encoding are thread-safe.
+typedef struct Tokenizer Tokenizer;
+// }}}
+
+// {{{ tokenizer_load
+// Loads a tiktoken-format rank file.
+// Returns NULL if the file is missing, malformed or lacks a single
+// byte token. Caller must free with tokenizer_free.
+Tokenizer* tokenizer_load(const char* path);
+// }}}
+
+// {{{ tokenizer_load_for_model
+// Loads "<dir>/<model>.tiktoken", the vocabulary for the configured
+// llm_model. Returns NULL if there is none; callers then fall back to
+// context_estimate_tokens.
+Tokenizer* tokenizer_load_for_model(const char* dir, const char* model);
+// }}}
+
+// {{{ tokenizer_free
+void tokenizer_free(Tokenizer* tokenizer);
+// }}}
+
+// {{{ tokenizer_vocab_size
+int tokenizer_vocab_size(const Tokenizer* tokenizer);
+// }}}
+
+// {{{ tokenizer_count
+// Returns the number of tokens in text (0 for NULL).
+int tokenizer_count(Tokenizer* tokenizer, const char* text);
+// }}}
+
+// {{{ tokenizer_count_prefixed
+// Counts text whose first prefix_len bytes are a stable section (e.g.
+// the system prompt) seen before. The count of the prefix, up to its
+// last safe piece boundary, is cached, so only the rest is tokenized.
+// The result always equals tokenizer_count(text).
+int tokenizer_count_prefixed(Tokenizer* tokenizer, const char* text,
+                             size_t prefix_len);
+// }}}
+
+// {{{ tokenizer_encode
+// Writes up to max token ids for text into ids and returns the total
+// number of tokens (which may exceed max).
+int tokenizer_encode(Tokenizer* tokenizer, const char* text, int* ids, int max);
+// }}}
+
+#endif /* LLM_TOKENIZER_H */
@@ -0,0 +1,260 @@
+/*
+ * 15-pattern-set.c - Case-Folded Multi-Pattern Matcher Implementation
+ *
+ * The trie is built directly in the transition table; a breadth-first
+ * pass then fills each missing transition from the node's failure link,
+ * turning the trie into a DFA. Bytes are mapped to classes first (one
+ * per folded byte that occurs in a pattern, plus one for all others),
+ * which keeps the table small.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "15-pattern-set.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_NODE -1
+#define NO_PATTERN -1
+
+// {{{ PatternSet
+struct PatternSet {
+    char** patterns;
+    size_t* lengths;
+    int* ids;
+    int count;
+    int capacity;
+    bool compiled;
+
+    unsigned char byte_class[256];
+    int class_count;
+    int node_count;
+    int* delta;              // node_count * class_count transitions
+    int* first_output;       // Per node: first pattern ending here
+    int* next_output;        // Per pattern: next pattern ending at its node
+    int* dict_link;          // Per node: nearest suffix node with output
+};
+// }}}
+
+// {{{ fold
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+// }}}
+
+// {{{ pattern_set_create
+PatternSet* pattern_set_create(void) {
+    return calloc(1, sizeof(PatternSet));
+}
+// }}}
+
+// {{{ pattern_set_free
+void pattern_set_free(PatternSet* set) {
+    if (set == NULL) {
+        return;
+    }
+    for (int i = 0; i < set->count; i++) {
+        free(set->patterns[i]);
+    }
+    free(set->patterns);
+    free(set->lengths);
+    free(set->ids);
+    free(set->delta);
+    free(set->first_output);
+    free(set->next_output);
+    free(set->dict_link);
+    free(set);
+}
+// }}}
+
+// {{{ pattern_set_add
+bool pattern_set_add(PatternSet* set, const char* pattern, int id) {
+    if (set == NULL || pattern == NULL || pattern[0] == '\0' || set->compiled) {
+        return false;
+    }
+
+    if (set->count == set->capacity) {
+        int capacity = set->capacity > 0 ? set->capacity * 2 : 16;
+        char** patterns = realloc(set->patterns, sizeof(char*) * capacity);
+        if (patterns == NULL) {
+            return false;
+        }
+        set->patterns = patterns;
+        size_t* lengths = realloc(set->lengths, sizeof(size_t) * capacity);
+        if (lengths == NULL) {
+            return false;
+        }
+        set->lengths = lengths;
+        int* ids = realloc(set->ids, sizeof(int) * capacity);
+        if (ids == NULL) {
+            return false;
+        }
+        set->ids = ids;
+        set->capacity = capacity;
+    }
+
+    char* copy = strdup(pattern);
+    if (copy == NULL) {
+        return false;
+    }
+    set->patterns[set->count] = copy;
+    set->lengths[set->count] = strlen(copy);
+    set->ids[set->count] = id;
+    set->count++;
+    return true;
+}
+// }}}
+
+// {{{ pattern_set_compile
+bool pattern_set_compile(PatternSet* set) {
+    if (set == NULL || set->compiled) {
+        return false;
+    }
+
+    // Byte classes; class 0 is every byte no pattern uses
+    memset(set->byte_class, 0, sizeof(set->byte_class));
+    set->class_count = 1;
+    size_t max_nodes = 1;
+    for (int i = 0; i < set->count; i++) {
+        for (size_t j = 0; j < set->lengths[i]; j++) {
+            unsigned char c = fold((unsigned char)set->patterns[i][j]);
+            if (set->byte_class[c] == 0) {
+                set->byte_class[c] = (unsigned char)set->class_count++;
+                if (c >= 'a' && c <= 'z') {
+                    set->byte_class[c - 'a' + 'A'] = set->byte_class[c];
+                }
+            }
+        }
+        max_nodes += set->lengths[i];
+    }
+
+    int classes = set->class_count;
+    set->delta = malloc(sizeof(int) * max_nodes * classes);
+    set->first_output = malloc(sizeof(int) * max_nodes);
+    set->dict_link = malloc(sizeof(int) * max_nodes);
+    set->next_output = malloc(sizeof(int) * (set->count > 0 ? set->count : 1));
+    int* fail = malloc(sizeof(int) * max_nodes);
+    int* queue = malloc(sizeof(int) * max_nodes);
+    if (set->delta == NULL || set->first_output == NULL || set->dict_link == NULL ||
+        set->next_output == NULL || fail == NULL || queue == NULL) {
+        free(fail);
+        free(queue);
+        free(set->delta);
+        free(set->first_output);
+        free(set->dict_link);
+        free(set->next_output);
+        set->delta = set->first_output = set->dict_link = set->next_output = NULL;
+        return false;
+    }
+
+    // Trie
+    set->node_count = 1;
+    for (int c = 0; c < classes; c++) {
+        set->delta[c] = NO_NODE;
+    }
+    set->first_output[0] = NO_PATTERN;
+    for (int i = 0; i < set->count; i++) {
+        int node = 0;
+        for (size_t j = 0; j < set->lengths[i]; j++) {
+            int c = set->byte_class[(unsigned char)set->patterns[i][j]];
+            int* next = &set->delta[node * classes + c];
+            if (*next == NO_NODE) {
+                int child = set->node_count++;
+                for (int k = 0; k < classes; k++) {
+                    set->delta[child * classes + k] = NO_NODE;
+                }
+                set->first_output[child] = NO_PATTERN;
+                *next = child;
+            }
+            node = *next;
+        }
+        set->next_output[i] = set->first_output[node];
+        set->first_output[node] = i;
+    }
+
+    // Failure links in breadth-first order, filling missing transitions
+    int head = 0;
+    int tail = 0;
+    fail[0] = 0;
+    set->dict_link[0] = NO_NODE;
+    for (int c = 0; c < classes; c++) {
+        int child = set->delta[c];
+        if (child == NO_NODE) {
+            set->delta[c] = 0;
+        } else {
+            fail[child] = 0;
+            set->dict_link[child] = NO_NODE;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail) {
+        int node = queue[head++];
+        int* row = &set->delta[node * classes];
+        const int* fail_row = &set->delta[fail[node] * classes];
+        for (int c = 0; c < classes; c++) {
+            int child = row[c];
+            if (child == NO_NODE) {
+                row[c] = fail_row[c];
+                continue;
+            }
+            int link = fail_row[c];
+            fail[child] = link;
+            set->dict_link[child] = set->first_output[link] != NO_PATTERN
+                ? link : set->dict_link[link];
+            queue[tail++] = child;
+        }
+    }
+
+    free(fail);
+    free(queue);
+
+    int* shrunk = realloc(set->delta, sizeof(int) * set->node_count * classes);
+    if (shrunk != NULL) {
+        set->delta = shrunk;
+    }
+    set->compiled = true;
+    return true;
+}
+// }}}
+
+// {{{ pattern_set_count
+int pattern_set_count(const PatternSet* set) {
+    return set != NULL ? set->count : 0;
+}
+// }}}
+
+// {{{ pattern_set_scan
+int pattern_set_scan(const PatternSet* set, const char* text,
+                     PatternMatchFunc on_match, void* user_data) {
+    if (set == NULL || !set->compiled) {
+        return -1;
+    }
+    if (text == NULL) {
+        return 0;
+    }
+
+    const int* delta = set->delta;
+    int classes = set->class_count;
+    int matches = 0;
+    int state = 0;
+
+    for (size_t i = 0; text[i] != '\0'; i++) {
+        state = delta[state * classes + set->byte_class[(unsigned char)text[i]]];
+
+        int node = set->first_output[state] != NO_PATTERN ? state : set->dict_link[state];
+        while (node != NO_NODE) {
+            for (int p = set->first_output[node]; p != NO_PATTERN; p = set->next_output[p]) {
+                matches++;
+                size_t length = set->lengths[p];
+                if (on_match != NULL &&
+                    !on_match(set->ids[p], i + 1 - length, length, user_data)) {
+                    return matches;
+                }
+            }
+            node = set->dict_link[node];
+        }
+    }
+
+    return matches;
+}
+// }}}
@@ -0,0 +1,63 @@
+/*
+ * 15-pattern-set.h - Case-Folded Multi-Pattern Matcher
+ *
+ * Finds every occurrence of many patterns in one pass over the text.
+ * Patterns are compiled into an Aho-Corasick automaton whose failure
+ * transitions are resolved into a full transition table, so scanning
+ * costs one table lookup per input byte however many patterns there
+ * are. Matching ignores ASCII case.
+ */
+
+#ifndef LLM_PATTERN_SET_H
+#define LLM_PATTERN_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// {{{ PatternSet
+// Opaque set of patterns. Scanning a compiled set is thread-safe.
+typedef struct PatternSet PatternSet;
+// }}}
+
+// {{{ PatternMatchFunc
+// Called for each match, in order of match end. start and length give
+// the matched bytes in the scanned text. Return false to stop the scan.
+typedef bool (*PatternMatchFunc)(int id, size_t start, size_t length, void* user_data);
+// }}}
+
+// {{{ pattern_set_create
+// Returns NULL on allocation failure.
+PatternSet* pattern_set_create(void);
+// }}}
+
+// {{{ pattern_set_free
+void pattern_set_free(PatternSet* set);
+// }}}
+
+// {{{ pattern_set_add
+// Adds a pattern reported with id when it matches. Patterns may repeat
+// with different ids. Returns false for an empty pattern, after
+// pattern_set_compile, or on allocation failure.
+bool pattern_set_add(PatternSet* set, const char* pattern, int id);
+// }}}
+
+// {{{ pattern_set_compile
+// Builds the automaton. Must be called once, after the last add and
+// before scanning. Returns false on allocation failure.
+bool pattern_set_compile(PatternSet* set);
+// }}}
+
+// {{{ pattern_set_count
+// Returns the number of patterns added.
+int pattern_set_count(const PatternSet* set);
+// }}}
+
+// {{{ pattern_set_scan
+// Scans text and calls on_match for every match, overlapping ones
+// included. Returns the number of matches reported, or -1 if the set
+// is not compiled.
+int pattern_set_scan(const PatternSet* set, const char* text,
+                     PatternMatchFunc on_match, void* user_data);
+// }}}
+
+#endif /* LLM_PATTERN_SET_H */
@@ -0,0 +1,651 @@
+/*
+ * 16-scheduler.c - LLM Request Scheduler Implementation
+ *
+ * Each class keeps a list of per-session FIFO queues and a cursor to
+ * the session served next. Everything runs under one lock: submits,
+ * completions (called back from the async I/O thread) and supersedes
+ * all end in pump(), which drops expired requests and dispatches
+ * while there is room. Callbacks of dropped requests are collected
+ * and run after the lock is released.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "16-scheduler.h"
+#include "22-token-usage.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_MAX_IN_FLIGHT 4
+
+// {{{ ScheduledRequest
+typedef struct ScheduledRequest {
+    LLMRequestHandle handle;
+    LLMRequestHandle upstream;   // Async engine handle once dispatched
+    LLMScheduleOptions options;
+    LLMConfig config;
+    LLMMessage* messages;
+    size_t message_count;
+    LLMAsyncCallback callback;
+    void* user;
+    uint64_t enqueued_ms;
+    const char* drop_reason;     // Error reported when dropped unsent
+    struct ScheduledRequest* next;
+} ScheduledRequest;
+// }}}
+
+// {{{ SessionQueue
+typedef struct SessionQueue {
+    const void* session;
+    ScheduledRequest* head;
+    ScheduledRequest* tail;
+    struct SessionQueue* next;
+} SessionQueue;
+// }}}
+
+// {{{ ClassQueue
+typedef struct {
+    SessionQueue* sessions;
+    SessionQueue* cursor;        // Session served next
+    LLMClassStats stats;
+    double total_wait_ms;
+} ClassQueue;
+// }}}
+
+// {{{ Scheduler
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    bool running;
+    int max_in_flight;
+    int in_flight;
+    int delivering;              // Completion callbacks still running
+    LLMRequestHandle next_handle;
+    ClassQueue classes[LLM_CLASS_COUNT];
+    ScheduledRequest* dispatched;
+} scheduler = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+    .next_handle = 1
+};
+// }}}
+
+// {{{ now_ms
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+// }}}
+
+// {{{ copy_string
+static char* copy_string(const char* s) {
+    return s != NULL ? strdup(s) : NULL;
+}
+// }}}
+
+// {{{ request_free
+static void request_free(ScheduledRequest* req) {
+    if (req == NULL) {
+        return;
+    }
+    free(req->config.endpoint);
+    free(req->config.api_key);
+    free(req->config.model);
+    for (size_t i = 0; i < req->message_count; i++) {
+        free(req->messages[i].role);
+        free(req->messages[i].content);
+    }
+    free(req->messages);
+    free(req);
+}
+// }}}
+
+// {{{ request_create
+static ScheduledRequest* request_create(const LLMConfig* config,
+                                        const LLMMessage* messages,
+                                        size_t message_count,
+                                        const LLMScheduleOptions* options) {
+    ScheduledRequest* req = calloc(1, sizeof(ScheduledRequest));
+    if (req == NULL) {
+        return NULL;
+    }
+
+    req->config = *config;
+    req->config.endpoint = copy_string(config->endpoint);
+    req->config.api_key = copy_string(config->api_key);
+    req->config.model = copy_string(config->model);
+    req->messages = calloc(message_count, sizeof(LLMMessage));
+    bool ok = req->messages != NULL &&
+              (config->endpoint == NULL || req->config.endpoint != NULL) &&
+              (config->api_key == NULL || req->config.api_key != NULL) &&
+              (config->model == NULL || req->config.model != NULL);
+    if (ok) {
+        req->message_count = message_count;
+        for (size_t i = 0; i < message_count && ok; i++) {
+            req->messages[i].role = copy_string(messages[i].role);
+            req->messages[i].content = copy_string(messages[i].content);
+            ok = req->messages[i].role != NULL && req->messages[i].content != NULL;
+        }
+    }
+    if (!ok) {
+        request_free(req);
+        return NULL;
+    }
+
+    if (options != NULL) {
+        req->options = *options;
+    } else {
+        req->options.request_class = LLM_CLASS_NARRATION;
+        req->options.turn = -1;
+    }
+    return req;
+}
+// }}}
+
+// {{{ enqueue
+static bool enqueue(ScheduledRequest* req) {
+    ClassQueue* cq = &scheduler.classes[req->options.request_class];
+
+    SessionQueue* sq = cq->sessions;
+    while (sq != NULL && sq->session != req->options.session) {
+        sq = sq->next;
+    }
+    if (sq == NULL) {
+        sq = calloc(1, sizeof(SessionQueue));
+        if (sq == NULL) {
+            return false;
+        }
+        sq->session = req->options.session;
+        sq->next = cq->sessions;
+        cq->sessions = sq;
+        if (cq->cursor == NULL) {
+            cq->cursor = sq;
+        }
+    }
+
+    if (sq->tail != NULL) {
+        sq->tail->next = req;
+    } else {
+        sq->head = req;
+    }
+    sq->tail = req;
+    cq->stats.queued++;
+    return true;
+}
+// }}}
+
+// {{{ remove_session
+// Unlinks an empty session queue, moving the cursor past it.
+static void remove_session(ClassQueue* cq, SessionQueue* sq) {
+    SessionQueue** link = &cq->sessions;
+    while (*link != sq) {
+        link = &(*link)->next;
+    }
+    *link = sq->next;
+
+    if (cq->cursor == sq) {
+        cq->cursor = sq->next != NULL ? sq->next : cq->sessions;
+    }
+    free(sq);
+}
+// }}}
+
+// {{{ drop_matching
+// Moves queued requests for which match returns true onto *dropped
+// with reason. Returns the number moved.
+typedef bool (*RequestMatch)(const ScheduledRequest* req, const void* arg);
+
+static int drop_matching(RequestMatch match, const void* arg, const char* reason,
+                         ScheduledRequest** dropped) {
+    int count = 0;
+    for (int c = 0; c < LLM_CLASS_COUNT; c++) {
+        ClassQueue* cq = &scheduler.classes[c];
+        SessionQueue* sq = cq->sessions;
+        while (sq != NULL) {
+            SessionQueue* next_session = sq->next;
+            ScheduledRequest** link = &sq->head;
+            ScheduledRequest* prev = NULL;
+            while (*link != NULL) {
+                ScheduledRequest* req = *link;
+                if (!match(req, arg)) {
+                    prev = req;
+                    link = &req->next;
+                    continue;
+                }
+                *link = req->next;
+                if (sq->tail == req) {
+                    sq->tail = prev;
+                }
+                req->drop_reason = reason;
+                req->next = *dropped;
+                *dropped = req;
+                cq->stats.queued--;
+                count++;
+            }
+            if (sq->head == NULL) {
+                remove_session(cq, sq);
+            }
+            sq = next_session;
+        }
+    }
+    return count;
+}
+// }}}
+
+// {{{ Drop predicates
+static bool match_expired(const ScheduledRequest* req, const void* arg) {
+    uint64_t now = *(const uint64_t*)arg;
+    return req->options.deadline_ms > 0 &&
+           now - req->enqueued_ms >= (uint64_t)req->options.deadline_ms;
+}
+
+typedef struct {
+    const void* session;
+    int turn;
+} SupersedeArg;
+
+static bool match_superseded(const ScheduledRequest* req, const void* arg) {
+    const SupersedeArg* s = arg;
+    return req->options.session == s->session &&
+           req->options.turn >= 0 && req->options.turn < s->turn;
+}
+
+static bool match_handle(const ScheduledRequest* req, const void* arg) {
+    return req->handle == *(const LLMRequestHandle*)arg;
+}
+
+static bool match_any(const ScheduledRequest* req, const void* arg) {
+    (void)req;
+    (void)arg;
+    return true;
+}
+// }}}
+
+// {{{ dequeue
+// Pops the next request: highest class first, sessions round-robin.
+static ScheduledRequest* dequeue(void) {
+    for (int c = 0; c < LLM_CLASS_COUNT; c++) {
+        ClassQueue* cq = &scheduler.classes[c];
+        SessionQueue* sq = cq->cursor;
+        if (sq == NULL) {
+            continue;
+        }
+
+        ScheduledRequest* req = sq->head;
+        sq->head = req->next;
+        if (sq->head == NULL) {
+            sq->tail = NULL;
+        }
+        req->next = NULL;
+        cq->stats.queued--;
+
+        cq->cursor = sq->next != NULL ? sq->next : cq->sessions;
+        if (sq->head == NULL) {
+            remove_session(cq, sq);
+        }
+        return req;
+    }
+    return NULL;
+}
+// }}}
+
+static void on_upstream_done(LLMResponse* response, void* user);
+
+// {{{ pump
+// Drops expired requests and dispatches while there is room. Requests
+// that end here are appended to *dropped.
+static void pump(ScheduledRequest** dropped) {
+    uint64_t now = now_ms();
+    ScheduledRequest* expired = NULL;
+    drop_matching(match_expired, &now, "Request expired", &expired);
+    while (expired != NULL) {
+        ScheduledRequest* next = expired->next;
+        scheduler.classes[expired->options.request_class].stats.expired++;
+        expired->next = *dropped;
+        *dropped = expired;
+        expired = next;
+    }
+
+    while (scheduler.in_flight < scheduler.max_in_flight) {
+        ScheduledRequest* req = dequeue();
+        if (req == NULL) {
+            break;
+        }
+
+        ClassQueue* cq = &scheduler.classes[req->options.request_class];
+        double wait = (double)(now - req->enqueued_ms);
+        cq->stats.dispatched++;
+        cq->total_wait_ms += wait;
+        if (wait > cq->stats.max_wait_ms) {
+            cq->stats.max_wait_ms = (float)wait;
+        }
+
+        // The completion callback needs the lock we hold, so it cannot
+        // run before the request is on the dispatched list
+        req->upstream = llm_request_async(&req->config, req->messages,
+                                          req->message_count, on_upstream_done, req);
+        if (req->upstream == LLM_REQUEST_INVALID) {
+            req->drop_reason = "Request could not be queued";
+            req->next = *dropped;
+            *dropped = req;
+            continue;
+        }
+        req->next = scheduler.dispatched;
+        scheduler.dispatched = req;
+        scheduler.in_flight++;
+    }
+}
+// }}}
+
+// {{{ deliver_dropped
+// Runs the callbacks of dropped requests; call without the lock.
+static void deliver_dropped(ScheduledRequest* dropped) {
+    while (dropped != NULL) {
+        ScheduledRequest* next = dropped->next;
+        if (dropped->callback != NULL) {
+            dropped->callback(llm_response_create_error(dropped->drop_reason),
+                              dropped->user);
+        }
+        request_free(dropped);
+        dropped = next;
+    }
+}
+// }}}
+
+// {{{ on_upstream_done
+static void on_upstream_done(LLMResponse* response, void* user) {
+    ScheduledRequest* req = user;
+    ScheduledRequest* dropped = NULL;
+
+    pthread_mutex_lock(&scheduler.lock);
+    ScheduledRequest** link = &scheduler.dispatched;
+    while (*link != NULL && *link != req) {
+        link = &(*link)->next;
+    }
+    if (*link == req) {
+        *link = req->next;
+    }
+    scheduler.in_flight--;
+    scheduler.delivering++;
+    scheduler.classes[req->options.request_class].stats.completed++;
+    if (scheduler.running) {
+        pump(&dropped);
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+
+    llm_usage_record(req->options.session, req->options.request_class, response);
+    if (req->callback != NULL) {
+        req->callback(response, req->user);
+    } else {
+        llm_response_free(response);
+    }
+    request_free(req);
+    deliver_dropped(dropped);
+
+    pthread_mutex_lock(&scheduler.lock);
+    scheduler.delivering--;
+    if (scheduler.in_flight == 0 && scheduler.delivering == 0) {
+        pthread_cond_broadcast(&scheduler.idle);
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+}
+// }}}
+
+// {{{ llm_scheduler_init
+bool llm_scheduler_init(const LLMSchedulerConfig* config) {
+    pthread_mutex_lock(&scheduler.lock);
+    if (scheduler.running) {
+        pthread_mutex_unlock(&scheduler.lock);
+        return false;
+    }
+
+    memset(scheduler.classes, 0, sizeof(scheduler.classes));
+    scheduler.max_in_flight = config != NULL && config->max_in_flight > 0
+        ? config->max_in_flight : DEFAULT_MAX_IN_FLIGHT;
+    scheduler.running = true;
+    pthread_mutex_unlock(&scheduler.lock);
+    return true;
+}
+// }}}
+
+// {{{ llm_scheduler_cleanup
+void llm_scheduler_cleanup(void) {
+    ScheduledRequest* dropped = NULL;
+
+    pthread_mutex_lock(&scheduler.lock);
+    if (!scheduler.running) {
+        pthread_mutex_unlock(&scheduler.lock);
+        return;
+    }
+    scheduler.running = false;
+
+    drop_matching(match_any, NULL, "Request cancelled", &dropped);
+    for (ScheduledRequest* req = dropped; req != NULL; req = req->next) {
+        scheduler.classes[req->options.request_class].stats.cancelled++;
+    }
+
+    for (ScheduledRequest* req = scheduler.dispatched; req != NULL; req = req->next) {
+        llm_async_cancel(req->upstream);
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+
+    deliver_dropped(dropped);
+
+    pthread_mutex_lock(&scheduler.lock);
+    while (scheduler.in_flight > 0 || scheduler.delivering > 0) {
+        pthread_cond_wait(&scheduler.idle, &scheduler.lock);
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+}
+// }}}
+
+// {{{ llm_scheduler_running
+bool llm_scheduler_running(void) {
+    pthread_mutex_lock(&scheduler.lock);
+    bool running = scheduler.running;
+    pthread_mutex_unlock(&scheduler.lock);
+    return running;
+}
+// }}}
+
+// {{{ llm_schedule
+LLMRequestHandle llm_schedule(const LLMConfig* config,
+                              const LLMMessage* messages,
+                              size_t message_count,
+                              const LLMScheduleOptions* options,
+                              LLMAsyncCallback callback,
+                              void* user) {
+    if (config == NULL || messages == NULL || message_count == 0 ||
+        (options != NULL && (options->request_class < 0 ||
+                             options->request_class >= LLM_CLASS_COUNT))) {
+        return LLM_REQUEST_INVALID;
+    }
+
+    ScheduledRequest* req = request_create(config, messages, message_count, options);
+    if (req == NULL) {
+        return LLM_REQUEST_INVALID;
+    }
+    req->callback = callback;
+    req->user = user;
+    req->enqueued_ms = now_ms();
+
+    ScheduledRequest* dropped = NULL;
+
+    pthread_mutex_lock(&scheduler.lock);
+    if (!scheduler.running || !enqueue(req)) {
+        pthread_mutex_unlock(&scheduler.lock);
+        request_free(req);
+        return LLM_REQUEST_INVALID;
+    }
+    req->handle = scheduler.next_handle++;
+    LLMRequestHandle handle = req->handle;
+    scheduler.classes[req->options.request_class].stats.submitted++;
+    pump(&dropped);
+    pthread_mutex_unlock(&scheduler.lock);
+
+    deliver_dropped(dropped);
+    return handle;
+}
+// }}}
+
+// {{{ Blocking wait
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    bool done;
+    LLMResponse* response;
+} ScheduleWait;
+
+static void on_wait_done(LLMResponse* response, void* user) {
+    ScheduleWait* wait = user;
+    pthread_mutex_lock(&wait->lock);
+    wait->response = response;
+    wait->done = true;
+    pthread_cond_signal(&wait->done_cond);
+    pthread_mutex_unlock(&wait->lock);
+}
+// }}}
+
+// {{{ request_direct
+// Sends a request without queuing, counting its tokens like a
+// scheduled one.
+static LLMResponse* request_direct(const LLMConfig* config,
+                                   const char* system_prompt,
+                                   const char* user_prompt,
+                                   const LLMScheduleOptions* options) {
+    LLMResponse* response = llm_request(config, system_prompt, user_prompt);
+    llm_usage_record(options != NULL ? options->session : NULL,
+                     options != NULL ? options->request_class : LLM_CLASS_NARRATION,
+                     response);
+    return response;
+}
+// }}}
+
+// {{{ llm_schedule_request
+LLMResponse* llm_schedule_request(const LLMConfig* config,
+                                  const char* system_prompt,
+                                  const char* user_prompt,
+                                  const LLMScheduleOptions* options) {
+    if (config == NULL || user_prompt == NULL) {
+        return llm_response_create_error("Invalid arguments");
+    }
+    if (!llm_scheduler_running()) {
+        return request_direct(config, system_prompt, user_prompt, options);
+    }
+
+    LLMMessage messages[2];
+    size_t count = 0;
+    if (system_prompt != NULL) {
+        messages[count++] = (LLMMessage){ "system", (char*)system_prompt };
+    }
+    messages[count++] = (LLMMessage){ "user", (char*)user_prompt };
+
+    ScheduleWait wait = { .done = false, .response = NULL };
+    pthread_mutex_init(&wait.lock, NULL);
+    pthread_cond_init(&wait.done_cond, NULL);
+
+    LLMResponse* response;
+    if (llm_schedule(config, messages, count, options, on_wait_done, &wait) ==
+        LLM_REQUEST_INVALID) {
+        // Stopped between the check and the submit
+        response = request_direct(config, system_prompt, user_prompt, options);
+    } else {
+        pthread_mutex_lock(&wait.lock);
+        while (!wait.done) {
+            pthread_cond_wait(&wait.done_cond, &wait.lock);
+        }
+        pthread_mutex_unlock(&wait.lock);
+        response = wait.response;
+    }
+
+    pthread_cond_destroy(&wait.done_cond);
+    pthread_mutex_destroy(&wait.lock);
+    return response;
+}
+// }}}
+
+// {{{ llm_scheduler_cancel
+bool llm_scheduler_cancel(LLMRequestHandle handle) {
+    if (handle == LLM_REQUEST_INVALID) {
+        return false;
+    }
+
+    ScheduledRequest* dropped = NULL;
+    bool found = false;
+
+    pthread_mutex_lock(&scheduler.lock);
+    if (drop_matching(match_handle, &handle, "Request cancelled", &dropped) > 0) {
+        scheduler.classes[dropped->options.request_class].stats.cancelled++;
+        found = true;
+    } else {
+        for (ScheduledRequest* req = scheduler.dispatched; req != NULL; req = req->next) {
+            if (req->handle == handle) {
+                found = llm_async_cancel(req->upstream);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+
+    deliver_dropped(dropped);
+    return found;
+}
+// }}}
+
+// {{{ llm_scheduler_supersede
+int llm_scheduler_supersede(const void* session, int turn) {
+    ScheduledRequest* dropped = NULL;
+    SupersedeArg arg = { session, turn };
+
+    pthread_mutex_lock(&scheduler.lock);
+    int count = drop_matching(match_superseded, &arg, "Request superseded", &dropped);
+    for (ScheduledRequest* req = dropped; req != NULL; req = req->next) {
+        scheduler.classes[req->options.request_class].stats.superseded++;
+    }
+    if (scheduler.running) {
+        pump(&dropped);
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+
+    deliver_dropped(dropped);
+    return count;
+}
+// }}}
+
+// {{{ llm_scheduler_get_stats
+LLMSchedulerStats llm_scheduler_get_stats(void) {
+    LLMSchedulerStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    pthread_mutex_lock(&scheduler.lock);
+    for (int c = 0; c < LLM_CLASS_COUNT; c++) {
+        ClassQueue* cq = &scheduler.classes[c];
+        stats.classes[c] = cq->stats;
+        if (cq->stats.dispatched > 0) {
+            stats.classes[c].avg_wait_ms = (float)(cq->total_wait_ms / cq->stats.dispatched);
+        }
+    }
+    stats.in_flight = scheduler.in_flight;
+    stats.max_in_flight = scheduler.max_in_flight;
+    pthread_mutex_unlock(&scheduler.lock);
+
+    return stats;
+}
+// }}}
+
+// {{{ llm_request_class_name
+const char* llm_request_class_name(LLMRequestClass request_class) {
+    switch (request_class) {
+        case LLM_CLASS_NARRATION: return "narration";
+        case LLM_CLASS_TRADE_SELECT: return "trade_select";
+        case LLM_CLASS_RECOVERY: return "recovery";
+        case LLM_CLASS_SUMMARY: return "summary";
+        case LLM_CLASS_PREFETCH: return "prefetch";
+        default: return "unknown";
+    }
+}
+// }}}
@@ -0,0 +1,143 @@
+/*
+ * 16-scheduler.h - LLM Request Scheduler
+ *
+ * Orders the requests that compete for one model endpoint. Requests
+ * carry a class (narration before DM trade selection, recovery,
+ * summarization and speculative prefetch), a session and optionally a
+ * turn and a deadline. The scheduler keeps at most max_in_flight of
+ * them at the async engine, matched to the model server's slots, and
+ * queues the rest.
+ *
+ * Dispatch takes the highest class with work; within a class, sessions
+ * take turns so one busy game cannot starve another. Queued requests
+ * are dropped when their deadline passes or when the game moves past
+ * their turn (llm_scheduler_supersede). Deadlines are checked whenever
+ * the scheduler runs: on every submit, completion and supersede.
+ * Completed requests are counted against their session's token budget
+ * (see 22-token-usage).
+ */
+
+#ifndef LLM_SCHEDULER_H
+#define LLM_SCHEDULER_H
+
+#include "01-api-client.h"
+#include "10-async-client.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// {{{ LLMRequestClass
+// Priority classes, highest first.
+typedef enum {
+    LLM_CLASS_NARRATION = 0,     // Narration a player is waiting for
+    LLM_CLASS_TRADE_SELECT,      // DM trade-row selection
+    LLM_CLASS_RECOVERY,          // Coherence recovery narration
+    LLM_CLASS_SUMMARY,           // Context summarization
+    LLM_CLASS_PREFETCH,          // Speculative narration
+    LLM_CLASS_COUNT
+} LLMRequestClass;
+// }}}
+
+// {{{ LLMScheduleOptions
+typedef struct {
+    LLMRequestClass request_class;
+    const void* session;         // Fair-queuing key, e.g. the Game (may be NULL)
+    int turn;                    // Turn the request is for; < 0 = not turn bound
+    int deadline_ms;             // Longest time to wait in the queue; 0 = no limit
+} LLMScheduleOptions;
+// }}}
+
+// {{{ LLMSchedulerConfig
+typedef struct {
+    int max_in_flight;           // Requests at the model at once
+} LLMSchedulerConfig;
+// }}}
+
+// {{{ LLMClassStats
+// Counters for one class since llm_scheduler_init.
+typedef struct {
+    int queued;                  // Waiting now
+    int submitted;               // Accepted by llm_schedule
+    int dispatched;              // Sent to the async engine
+    int completed;               // Dispatched requests that finished
+    int expired;                 // Dropped at their deadline
+    int superseded;              // Dropped by llm_scheduler_supersede
+    int cancelled;               // Cancelled while queued
+    float avg_wait_ms;           // Mean queue wait of dispatched requests
+    float max_wait_ms;           // Longest queue wait of a dispatched request
+} LLMClassStats;
+// }}}
+
+// {{{ LLMSchedulerStats
+typedef struct {
+    LLMClassStats classes[LLM_CLASS_COUNT];
+    int in_flight;
+    int max_in_flight;
+} LLMSchedulerStats;
+// }}}
+
+// {{{ llm_scheduler_init
+// Starts the scheduler. config may be NULL for the default of 4 in
+// flight. Requires the async engine (llm_async_init). Returns false if
+// already running.
+bool llm_scheduler_init(const LLMSchedulerConfig* config);
+// }}}
+
+// {{{ llm_scheduler_cleanup
+// Stops accepting requests, fails queued ones with "Request cancelled",
+// cancels dispatched ones and waits for their callbacks. Call before
+// llm_async_cleanup.
+void llm_scheduler_cleanup(void);
+// }}}
+
+// {{{ llm_scheduler_running
+bool llm_scheduler_running(void);
+// }}}
+
+// {{{ llm_schedule
+// Queues a request. config and messages are copied. options may be
+// NULL (narration, no session, no turn, no deadline). callback is
+// invoked exactly once, on the async I/O thread or the thread that
+// dropped the request; dropped requests receive a failed response
+// whose error is "Request expired", "Request superseded" or "Request
+// cancelled". Returns LLM_REQUEST_INVALID if the scheduler is not
+// running or the arguments are invalid (callback is not invoked).
+LLMRequestHandle llm_schedule(const LLMConfig* config,
+                              const LLMMessage* messages,
+                              size_t message_count,
+                              const LLMScheduleOptions* options,
+                              LLMAsyncCallback callback,
+                              void* user);
+// }}}
+
+// {{{ llm_schedule_request
+// Blocking counterpart of llm_request that waits its turn in the
+// scheduler. Calls llm_request directly when the scheduler is not
+// running. Caller must free the response with llm_response_free.
+LLMResponse* llm_schedule_request(const LLMConfig* config,
+                                  const char* system_prompt,
+                                  const char* user_prompt,
+                                  const LLMScheduleOptions* options);
+// }}}
+
+// {{{ llm_scheduler_cancel
+// Cancels a scheduled request, queued or dispatched. Returns false if
+// it already finished or the handle is unknown.
+bool llm_scheduler_cancel(LLMRequestHandle handle);
+// }}}
+
+// {{{ llm_scheduler_supersede
+// Drops queued requests of session bound to a turn before turn, e.g.
+// narration for a turn that has ended. Dispatched requests run on.
+// Returns the number dropped.
+int llm_scheduler_supersede(const void* session, int turn);
+// }}}
+
+// {{{ llm_scheduler_get_stats
+LLMSchedulerStats llm_scheduler_get_stats(void);
+// }}}
+
+// {{{ llm_request_class_name
+const char* llm_request_class_name(LLMRequestClass request_class);
+// }}}
+
+#endif /* LLM_SCHEDULER_H */
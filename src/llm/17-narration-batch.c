@@ -0,0 +1,464 @@
+/*
+ * 17-narration-batch.c - Batched Event Narration Implementation
+ *
+ * Pending events are detached from the batcher before a flush talks to
+ * the model, so a delivery callback may add events for the next batch.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "17-narration-batch.h"
+#include "16-scheduler.h"
+#include "20-circuit-breaker.h"
+#include "22-token-usage.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// {{{ Constants
+#define BATCH_INSTRUCTIONS \
+    "Narrate each of the following game events, in order. Answer with " \
+    "one section per event: a line holding only its marker, such as [1], " \
+    "followed by that event's narration. Do not merge or skip events.\n\n"
+#define MARKER_MAX 16
+// }}}
+
+// {{{ PendingEvent
+typedef struct {
+    char* prompt;
+    char* local;                    // Local narration; with a breaker or
+                                    // when the model is not asked
+    bool ask_model;                 // False if the budget rules it out
+    GameEventType type;
+    int turn;
+    unsigned long sequence;
+} PendingEvent;
+// }}}
+
+// {{{ NarrationBatcher
+struct NarrationBatcher {
+    LLMConfig config;
+    NarrationBatchConfig options;
+    const void* session;
+    NarrationDeliverFunc deliver;
+    void* user;
+
+    PendingEvent* pending;          // options.max_events slots
+    int pending_count;
+    long first_pending_ms;          // When the oldest pending event arrived
+    unsigned long next_sequence;
+
+    NarrationBatchStats stats;
+};
+// }}}
+
+// {{{ now_ms
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+// }}}
+
+// {{{ copy_string
+static char* copy_string(const char* str) {
+    return str != NULL ? strdup(str) : NULL;
+}
+// }}}
+
+// {{{ narration_batcher_create
+NarrationBatcher* narration_batcher_create(const LLMConfig* config,
+                                           const NarrationBatchConfig* options,
+                                           const void* session,
+                                           NarrationDeliverFunc deliver,
+                                           void* user) {
+    if (config == NULL || deliver == NULL) {
+        return NULL;
+    }
+
+    NarrationBatcher* batcher = calloc(1, sizeof(NarrationBatcher));
+    if (batcher == NULL) {
+        return NULL;
+    }
+
+    batcher->config = *config;
+    batcher->config.endpoint = copy_string(config->endpoint);
+    batcher->config.api_key = copy_string(config->api_key);
+    batcher->config.model = copy_string(config->model);
+
+    batcher->options.max_events = NARRATION_BATCH_DEFAULT_MAX_EVENTS;
+    batcher->options.window_ms = NARRATION_BATCH_DEFAULT_WINDOW_MS;
+    if (options != NULL) {
+        batcher->options = *options;
+        if (batcher->options.max_events < 1) {
+            batcher->options.max_events = 1;
+        }
+    }
+    batcher->session = session;
+    batcher->deliver = deliver;
+    batcher->user = user;
+
+    batcher->pending = calloc(batcher->options.max_events, sizeof(PendingEvent));
+    if (batcher->pending == NULL || batcher->config.endpoint == NULL) {
+        narration_batcher_free(batcher);
+        return NULL;
+    }
+
+    return batcher;
+}
+// }}}
+
+// {{{ narration_batcher_free
+void narration_batcher_free(NarrationBatcher* batcher) {
+    if (batcher == NULL) {
+        return;
+    }
+
+    if (batcher->pending != NULL) {
+        narration_batcher_flush(batcher);
+    }
+
+    free(batcher->pending);
+    free(batcher->config.endpoint);
+    free(batcher->config.api_key);
+    free(batcher->config.model);
+    free(batcher);
+}
+// }}}
+
+// {{{ narration_batch_build_prompt
+char* narration_batch_build_prompt(const char** prompts, int count) {
+    if (prompts == NULL || count <= 0) {
+        return NULL;
+    }
+
+    size_t total = strlen(BATCH_INSTRUCTIONS) + 1;
+    for (int i = 0; i < count; i++) {
+        total += MARKER_MAX + (prompts[i] != NULL ? strlen(prompts[i]) : 0) + 2;
+    }
+
+    char* prompt = malloc(total);
+    if (prompt == NULL) {
+        return NULL;
+    }
+
+    size_t len = (size_t)snprintf(prompt, total, "%s", BATCH_INSTRUCTIONS);
+    for (int i = 0; i < count; i++) {
+        len += (size_t)snprintf(prompt + len, total - len, "[%d] %s\n",
+                                i + 1, prompts[i] != NULL ? prompts[i] : "");
+    }
+
+    return prompt;
+}
+// }}}
+
+// {{{ trimmed_copy
+// Copies text[start, end) without surrounding whitespace, or NULL if
+// nothing is left.
+static char* trimmed_copy(const char* text, size_t start, size_t end) {
+    while (start < end && isspace((unsigned char)text[start])) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)text[end - 1])) {
+        end--;
+    }
+    if (start == end) {
+        return NULL;
+    }
+
+    char* copy = malloc(end - start + 1);
+    if (copy != NULL) {
+        memcpy(copy, text + start, end - start);
+        copy[end - start] = '\0';
+    }
+    return copy;
+}
+// }}}
+
+// {{{ narration_batch_parse
+int narration_batch_parse(const char* reply, int count, char** segments) {
+    if (segments == NULL || count <= 0) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        segments[i] = NULL;
+    }
+    if (reply == NULL) {
+        return 0;
+    }
+
+    // Markers must appear in order; a missing one leaves its event out
+    size_t* starts = malloc(sizeof(size_t) * count);
+    size_t* ends = malloc(sizeof(size_t) * count);
+    if (starts == NULL || ends == NULL) {
+        free(starts);
+        free(ends);
+        return 0;
+    }
+
+    size_t length = strlen(reply);
+    size_t pos = 0;
+    for (int i = 0; i < count; i++) {
+        char marker[MARKER_MAX];
+        snprintf(marker, sizeof(marker), "[%d]", i + 1);
+        const char* found = strstr(reply + pos, marker);
+        if (found == NULL) {
+            starts[i] = ends[i] = (size_t)-1;
+            continue;
+        }
+        starts[i] = (size_t)(found - reply);
+        ends[i] = starts[i] + strlen(marker);
+        pos = ends[i];
+    }
+
+    int found_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (starts[i] == (size_t)-1) {
+            continue;
+        }
+        size_t stop = length;
+        for (int j = i + 1; j < count; j++) {
+            if (starts[j] != (size_t)-1) {
+                stop = starts[j];
+                break;
+            }
+        }
+        segments[i] = trimmed_copy(reply, ends[i], stop);
+        if (segments[i] != NULL) {
+            found_count++;
+        }
+    }
+
+    free(starts);
+    free(ends);
+    return found_count;
+}
+// }}}
+
+// {{{ worth_model
+// Whether an event of this intensity still goes to the model at level.
+static bool worth_model(LLMUsageLevel level, NarrationIntensity intensity) {
+    switch (level) {
+        case LLM_USAGE_NORMAL: return true;
+        case LLM_USAGE_REDUCED: return intensity >= INTENSITY_MEDIUM;
+        case LLM_USAGE_MINIMAL: return intensity >= INTENSITY_HIGH;
+        default: return false;
+    }
+}
+// }}}
+
+// {{{ request_text
+// One blocking model call through the scheduler; returns the text or
+// NULL on failure.
+static char* request_text(NarrationBatcher* batcher, const char* prompt) {
+    LLMScheduleOptions options = {
+        .request_class = LLM_CLASS_NARRATION,
+        .session = batcher->session,
+        .turn = -1
+    };
+    batcher->stats.model_calls++;
+
+    // A session short of budget takes a remembered reply over a new one
+    LLMConfig config = batcher->config;
+    if (llm_usage_level(batcher->session) != LLM_USAGE_NORMAL) {
+        config.memoize_sampled = true;
+    }
+
+    LLMResponse* response = llm_schedule_request(&config, prompt_get_system_prompt(),
+                                                 prompt, &options);
+    char* text = NULL;
+    if (response != NULL && response->success && response->text != NULL) {
+        text = strdup(response->text);
+    }
+    llm_response_free(response);
+    return text;
+}
+// }}}
+
+// {{{ deliver
+// Delivers text, or the event's local narration in its place.
+static void deliver(NarrationBatcher* batcher, const PendingEvent* event,
+                    const char* text, bool batched) {
+    bool local = text == NULL && event->local != NULL;
+    NarrationSegment segment = {
+        .sequence = event->sequence,
+        .type = event->type,
+        .turn = event->turn,
+        .prompt = event->prompt,
+        .text = local ? event->local : text,
+        .batched = batched,
+        .local = local
+    };
+    if (local) {
+        batcher->stats.local++;
+    }
+    batcher->stats.delivered++;
+    batcher->deliver(&segment, batcher->user);
+}
+// }}}
+
+// {{{ narration_batcher_flush
+int narration_batcher_flush(NarrationBatcher* batcher) {
+    if (batcher == NULL || batcher->pending_count == 0) {
+        return 0;
+    }
+
+    // Detach the batch so deliveries can queue the next one
+    int count = batcher->pending_count;
+    PendingEvent* events = malloc(sizeof(PendingEvent) * count);
+    const char** prompts = malloc(sizeof(char*) * count);
+    int* asked = malloc(sizeof(int) * count);
+    char** replies = calloc(count, sizeof(char*));
+    char** segments = calloc(count, sizeof(char*));
+    if (events == NULL || prompts == NULL || asked == NULL || replies == NULL ||
+        segments == NULL) {
+        free(events);
+        free(prompts);
+        free(asked);
+        free(replies);
+        free(segments);
+        return 0;
+    }
+    memcpy(events, batcher->pending, sizeof(PendingEvent) * count);
+    batcher->pending_count = 0;
+
+    // Only the events the budget allows are put to the model
+    int asked_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (events[i].ask_model) {
+            prompts[asked_count] = events[i].prompt;
+            asked[asked_count++] = i;
+        }
+    }
+
+    // While the breaker is open the model is not asked at all and every
+    // event gets its local narration
+    bool batch_failed = llm_breaker_is_open(batcher->config.breaker);
+    if (!batch_failed && asked_count == 1) {
+        batcher->stats.batches++;
+        replies[0] = request_text(batcher, prompts[0]);
+        batch_failed = replies[0] == NULL;
+    } else if (!batch_failed && asked_count > 1) {
+        batcher->stats.batches++;
+        char* prompt = narration_batch_build_prompt(prompts, asked_count);
+        char* reply = prompt != NULL ? request_text(batcher, prompt) : NULL;
+        batch_failed = reply == NULL;
+        narration_batch_parse(reply, asked_count, replies);
+        free(reply);
+        free(prompt);
+    }
+    for (int j = 0; j < asked_count; j++) {
+        segments[asked[j]] = replies[j];
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!events[i].ask_model) {
+            batcher->stats.budgeted++;
+            deliver(batcher, &events[i], NULL, false);
+        } else if (segments[i] != NULL) {
+            deliver(batcher, &events[i], segments[i], asked_count > 1);
+        } else if (batch_failed) {
+            // The model is failing; asking again per event would not help,
+            // so this is the local narration (or NULL without a breaker)
+            deliver(batcher, &events[i], NULL, false);
+        } else {
+            batcher->stats.fallbacks++;
+            char* text = request_text(batcher, events[i].prompt);
+            deliver(batcher, &events[i], text, false);
+            free(text);
+        }
+        free(segments[i]);
+        free(events[i].prompt);
+        free(events[i].local);
+    }
+
+    free(segments);
+    free(replies);
+    free(asked);
+    free(prompts);
+    free(events);
+    return count;
+}
+// }}}
+
+// {{{ narration_batcher_add
+bool narration_batcher_add(NarrationBatcher* batcher, NarrationEvent* event) {
+    if (batcher == NULL || event == NULL) {
+        return false;
+    }
+
+    // A flush that ran out of memory leaves the batch full
+    if (batcher->pending_count >= batcher->options.max_events) {
+        narration_batcher_flush(batcher);
+        if (batcher->pending_count >= batcher->options.max_events) {
+            return false;
+        }
+    }
+
+    char* prompt = event_narration_build(event);
+    if (prompt == NULL) {
+        return false;
+    }
+    LLMUsageLevel level = llm_usage_level(batcher->session);
+    bool ask_model = worth_model(level, event->intensity);
+    char* local = NULL;
+    if (batcher->config.breaker != NULL || !ask_model) {
+        local = event_narration_build_local(event);
+        if (local == NULL) {
+            free(prompt);
+            return false;
+        }
+    }
+
+    if (batcher->pending_count == 0) {
+        batcher->first_pending_ms = now_ms();
+    }
+    PendingEvent* pending = &batcher->pending[batcher->pending_count++];
+    pending->prompt = prompt;
+    pending->local = local;
+    pending->ask_model = ask_model;
+    pending->type = event->type;
+    pending->turn = event->turn;
+    pending->sequence = batcher->next_sequence++;
+    batcher->stats.events++;
+
+    // A session short of budget lets a batch run on past a turn end; an
+    // exhausted one asks the model nothing, so it need not wait
+    bool stretch = level == LLM_USAGE_REDUCED || level == LLM_USAGE_MINIMAL;
+    if ((event->type == GAME_EVENT_TURN_END && !stretch) ||
+        event->type == GAME_EVENT_GAME_OVER ||
+        batcher->pending_count >= batcher->options.max_events) {
+        narration_batcher_flush(batcher);
+    }
+    return true;
+}
+// }}}
+
+// {{{ narration_batcher_poll
+int narration_batcher_poll(NarrationBatcher* batcher) {
+    if (batcher == NULL || batcher->pending_count == 0 ||
+        batcher->options.window_ms <= 0 ||
+        now_ms() - batcher->first_pending_ms < batcher->options.window_ms) {
+        return 0;
+    }
+    return narration_batcher_flush(batcher);
+}
+// }}}
+
+// {{{ narration_batcher_pending
+int narration_batcher_pending(NarrationBatcher* batcher) {
+    return batcher != NULL ? batcher->pending_count : 0;
+}
+// }}}
+
+// {{{ narration_batcher_get_stats
+NarrationBatchStats narration_batcher_get_stats(NarrationBatcher* batcher) {
+    NarrationBatchStats stats = {0};
+    if (batcher != NULL) {
+        stats = batcher->stats;
+    }
+    return stats;
+}
+// }}}
@@ -0,0 +1,133 @@
+/*
+ * 17-narration-batch.h - Batched Event Narration
+ *
+ * Gathers the events of a turn and narrates them with one model call
+ * instead of one per event. Each event's prompt is built when it is
+ * added (event_narration_build), so later changes to the game do not
+ * leak into it. A flush sends the pending prompts as one numbered
+ * request, splits the reply into per-event segments and delivers them
+ * in order of addition.
+ *
+ * A batch is flushed when a turn or the game ends, when max_events are
+ * pending, or by narration_batcher_poll once window_ms have passed
+ * since its first event. Events the reply does not cover are narrated
+ * one request each, so every event is delivered exactly once.
+ *
+ * With a circuit breaker on the config, each event's local narration
+ * (event_narration_build_local) is written when it is added too. While
+ * the breaker is open a flush delivers those without asking the model,
+ * and they stand in for any narration the model fails to give.
+ *
+ * The session's token budget (see 22-token-usage) decides how much goes
+ * to the model. Once a session runs low, a turn end no longer flushes,
+ * so batches grow; events below the level's intensity are narrated
+ * locally; and replies are memoized even when sampled.
+ */
+
+#ifndef LLM_NARRATION_BATCH_H
+#define LLM_NARRATION_BATCH_H
+
+#include "01-api-client.h"
+#include "05-event-narration.h"
+#include <stdbool.h>
+
+#define NARRATION_BATCH_DEFAULT_MAX_EVENTS 16
+#define NARRATION_BATCH_DEFAULT_WINDOW_MS 1500
+
+// {{{ NarrationSegment
+// One delivered narration. Pointers are valid during the callback only.
+typedef struct {
+    unsigned long sequence;  // Order of addition, from 0
+    GameEventType type;
+    int turn;
+    const char* prompt;      // The event's own prompt
+    const char* text;        // Narration, or NULL if the model failed
+                             // and no breaker is attached
+    bool batched;            // True if taken from a batched reply
+    bool local;              // Written locally: the model was unavailable
+                             // or the session's budget ruled it out
+} NarrationSegment;
+// }}}
+
+// {{{ NarrationDeliverFunc
+typedef void (*NarrationDeliverFunc)(const NarrationSegment* segment, void* user);
+// }}}
+
+// {{{ NarrationBatchConfig
+typedef struct {
+    int max_events;          // Flush once this many are pending
+    int window_ms;           // Oldest pending event may wait this long; 0 = no limit
+} NarrationBatchConfig;
+// }}}
+
+// {{{ NarrationBatchStats
+typedef struct {
+    int events;              // Events added
+    int delivered;           // Segments delivered
+    int batches;             // Flushes that sent a request
+    int model_calls;         // Requests made, batched and single
+    int fallbacks;           // Events narrated on their own after a bad reply
+    int local;               // Segments written locally
+    int budgeted;            // Events kept from the model by the session's budget
+} NarrationBatchStats;
+// }}}
+
+typedef struct NarrationBatcher NarrationBatcher;
+
+// {{{ narration_batcher_create
+// config is copied. options may be NULL for the defaults. session is
+// the scheduler's fair-queuing key (e.g. the Game) and may be NULL.
+NarrationBatcher* narration_batcher_create(const LLMConfig* config,
+                                           const NarrationBatchConfig* options,
+                                           const void* session,
+                                           NarrationDeliverFunc deliver,
+                                           void* user);
+// }}}
+
+// {{{ narration_batcher_free
+// Flushes pending events, then frees the batcher.
+void narration_batcher_free(NarrationBatcher* batcher);
+// }}}
+
+// {{{ narration_batcher_add
+// Queues an event. Flushes (blocking on the model) when the event ends
+// a turn or the game, or when max_events are pending.
+// Returns false if the event could not be queued, including when a full
+// batch still cannot be flushed.
+bool narration_batcher_add(NarrationBatcher* batcher, NarrationEvent* event);
+// }}}
+
+// {{{ narration_batcher_poll
+// Flushes if the oldest pending event has waited window_ms.
+// Returns the number of segments delivered.
+int narration_batcher_poll(NarrationBatcher* batcher);
+// }}}
+
+// {{{ narration_batcher_flush
+// Narrates every pending event now. Returns the number of segments
+// delivered.
+int narration_batcher_flush(NarrationBatcher* batcher);
+// }}}
+
+// {{{ narration_batcher_pending
+int narration_batcher_pending(NarrationBatcher* batcher);
+// }}}
+
+// {{{ narration_batcher_get_stats
+NarrationBatchStats narration_batcher_get_stats(NarrationBatcher* batcher);
+// }}}
+
+// {{{ narration_batch_build_prompt
+// Builds the numbered request for count event prompts.
+// Caller must free returned string.
+char* narration_batch_build_prompt(const char** prompts, int count);
+// }}}
+
+// {{{ narration_batch_parse
+// Splits a reply into count segments by their "[n]" markers. segments
+// receives a malloc'd string per event found and NULL for the rest.
+// Returns the number of events found.
+int narration_batch_parse(const char* reply, int count, char** segments);
+// }}}
+
+#endif /* LLM_NARRATION_BATCH_H */
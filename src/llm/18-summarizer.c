@@ -0,0 +1,333 @@
+/*
+ * 18-summarizer.c - Background Context Summarization Implementation
+ *
+ * A summary job is shared by the summarizer and the async callback and
+ * freed by whichever lets go last. Entries are tracked by their
+ * sequence number, so evictions and new entries while the model is
+ * writing do not confuse the swap.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "18-summarizer.h"
+#include "16-scheduler.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// {{{ Constants
+#define DEFAULT_TRIGGER_THRESHOLD 0.6f
+#define DEFAULT_EVICT_THRESHOLD 0.9f
+#define DEFAULT_MAX_ENTRIES 8
+#define DEFAULT_MIN_ENTRIES 2
+
+static const char* SUMMARY_SYSTEM =
+    "You keep the chronicle of a fantasy card game. Condense the events "
+    "you are given into a few sentences. Keep every commander, faction, "
+    "card name and outcome; drop flourishes.";
+// }}}
+
+// {{{ SummaryJob
+typedef struct {
+    pthread_mutex_t lock;
+    int refs;
+    bool done;
+    bool scheduled;              // Handle belongs to the scheduler
+    LLMRequestHandle handle;
+    char* text;                  // Summary, NULL if the request failed
+    unsigned long* sequences;    // Entries the summary replaces
+    int count;
+} SummaryJob;
+// }}}
+
+// {{{ ContextSummarizer
+struct ContextSummarizer {
+    ContextManager* cm;
+    LLMConfig config;
+    SummarizerConfig options;
+    const void* session;
+    SummaryJob* job;             // Summary in flight or waiting to apply
+    SummarizerStats stats;
+};
+// }}}
+
+// {{{ copy_string
+static char* copy_string(const char* str) {
+    return str != NULL ? strdup(str) : NULL;
+}
+// }}}
+
+// {{{ job_release
+static void job_release(SummaryJob* job) {
+    pthread_mutex_lock(&job->lock);
+    int refs = --job->refs;
+    pthread_mutex_unlock(&job->lock);
+    if (refs > 0) {
+        return;
+    }
+
+    pthread_mutex_destroy(&job->lock);
+    free(job->text);
+    free(job->sequences);
+    free(job);
+}
+// }}}
+
+// {{{ on_summary
+static void on_summary(LLMResponse* response, void* user) {
+    SummaryJob* job = user;
+
+    pthread_mutex_lock(&job->lock);
+    if (response != NULL && response->success && response->text != NULL) {
+        job->text = strdup(response->text);
+    }
+    job->done = true;
+    pthread_mutex_unlock(&job->lock);
+
+    llm_response_free(response);
+    job_release(job);
+}
+// }}}
+
+// {{{ context_summarizer_default_config
+SummarizerConfig context_summarizer_default_config(void) {
+    SummarizerConfig config = {
+        .trigger_threshold = DEFAULT_TRIGGER_THRESHOLD,
+        .evict_threshold = DEFAULT_EVICT_THRESHOLD,
+        .max_entries = DEFAULT_MAX_ENTRIES,
+        .min_entries = DEFAULT_MIN_ENTRIES
+    };
+    return config;
+}
+// }}}
+
+// {{{ context_summarizer_create
+ContextSummarizer* context_summarizer_create(ContextManager* cm,
+                                             const LLMConfig* config,
+                                             const SummarizerConfig* options,
+                                             const void* session) {
+    if (cm == NULL || config == NULL) {
+        return NULL;
+    }
+
+    ContextSummarizer* summarizer = calloc(1, sizeof(ContextSummarizer));
+    if (summarizer == NULL) {
+        return NULL;
+    }
+
+    summarizer->cm = cm;
+    summarizer->config = *config;
+    summarizer->config.endpoint = copy_string(config->endpoint);
+    summarizer->config.api_key = copy_string(config->api_key);
+    summarizer->config.model = copy_string(config->model);
+    summarizer->options = options != NULL ? *options
+                                          : context_summarizer_default_config();
+    if (summarizer->options.max_entries < 1) {
+        summarizer->options.max_entries = 1;
+    }
+    summarizer->session = session;
+
+    if (config->endpoint != NULL && summarizer->config.endpoint == NULL) {
+        context_summarizer_free(summarizer);
+        return NULL;
+    }
+    return summarizer;
+}
+// }}}
+
+// {{{ context_summarizer_free
+void context_summarizer_free(ContextSummarizer* summarizer) {
+    if (summarizer == NULL) {
+        return;
+    }
+
+    SummaryJob* job = summarizer->job;
+    if (job != NULL) {
+        pthread_mutex_lock(&job->lock);
+        bool done = job->done;
+        pthread_mutex_unlock(&job->lock);
+
+        // Cancelling may run the callback on this thread
+        if (!done) {
+            if (job->scheduled) {
+                llm_scheduler_cancel(job->handle);
+            } else {
+                llm_async_cancel(job->handle);
+            }
+        }
+        job_release(job);
+    }
+
+    free(summarizer->config.endpoint);
+    free(summarizer->config.api_key);
+    free(summarizer->config.model);
+    free(summarizer);
+}
+// }}}
+
+// {{{ start_summary
+// Snapshots the summarizable entries and asks the model about them.
+static void start_summary(ContextSummarizer* summarizer) {
+    ContextManager* cm = summarizer->cm;
+    int max = summarizer->options.max_entries;
+
+    int* indices = malloc(sizeof(int) * max);
+    if (indices == NULL) {
+        return;
+    }
+    int count = context_find_summarizable(cm, indices, max);
+    if (count < summarizer->options.min_entries || count == 0) {
+        free(indices);
+        return;
+    }
+
+    SummaryJob* job = calloc(1, sizeof(SummaryJob));
+    char* entries = context_get_entries_text(cm, indices, count);
+    if (job == NULL || entries == NULL ||
+        (job->sequences = malloc(sizeof(unsigned long) * count)) == NULL) {
+        free(job);
+        free(entries);
+        free(indices);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        context_get_sequence(cm, indices[i], &job->sequences[i]);
+    }
+    job->count = count;
+    free(indices);
+
+    pthread_mutex_init(&job->lock, NULL);
+    job->refs = 2;  // Summarizer and callback
+
+    LLMMessage messages[2] = {
+        { "system", (char*)SUMMARY_SYSTEM },
+        { "user", entries }
+    };
+
+    // The callback may run before these return, so no lock is held;
+    // only this thread reads handle
+    if (llm_scheduler_running()) {
+        LLMScheduleOptions options = {
+            .request_class = LLM_CLASS_SUMMARY,
+            .session = summarizer->session,
+            .turn = -1
+        };
+        job->scheduled = true;
+        job->handle = llm_schedule(&summarizer->config, messages, 2, &options,
+                                   on_summary, job);
+    } else {
+        job->handle = llm_request_async(&summarizer->config, messages, 2,
+                                        on_summary, job);
+    }
+    free(entries);
+
+    if (job->handle == LLM_REQUEST_INVALID) {
+        // Not queued, so the callback will never run
+        job->refs = 1;
+        job_release(job);
+        return;
+    }
+
+    summarizer->job = job;
+    summarizer->stats.started++;
+}
+// }}}
+
+// {{{ compare_ints
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+// }}}
+
+// {{{ apply_summary
+// Swaps a finished summary in for whatever of its entries remain.
+// Returns true if the context changed.
+static bool apply_summary(ContextSummarizer* summarizer) {
+    SummaryJob* job = summarizer->job;
+    summarizer->job = NULL;
+
+    // done is set, so the callback no longer writes text
+    bool changed = false;
+    if (job->text == NULL) {
+        summarizer->stats.failed++;
+    } else {
+        int* indices = malloc(sizeof(int) * job->count);
+        int count = 0;
+        for (int i = 0; indices != NULL && i < job->count; i++) {
+            int index = context_find_sequence(summarizer->cm, job->sequences[i]);
+            if (index >= 0) {
+                indices[count++] = index;
+            }
+        }
+
+        if (count == 0) {
+            summarizer->stats.discarded++;
+        } else {
+            qsort(indices, count, sizeof(int), compare_ints);
+            changed = context_replace_with_summary(summarizer->cm, indices,
+                                                   count, job->text);
+            if (changed) {
+                summarizer->stats.applied++;
+            }
+        }
+        free(indices);
+    }
+
+    job_release(job);
+    return changed;
+}
+// }}}
+
+// {{{ context_summarizer_maintain
+bool context_summarizer_maintain(ContextSummarizer* summarizer) {
+    if (summarizer == NULL) {
+        return false;
+    }
+
+    bool changed = false;
+    SummaryJob* job = summarizer->job;
+    if (job != NULL) {
+        pthread_mutex_lock(&job->lock);
+        bool done = job->done;
+        pthread_mutex_unlock(&job->lock);
+        if (done) {
+            changed = apply_summary(summarizer);
+        }
+    }
+
+    ContextManager* cm = summarizer->cm;
+    if (summarizer->job == NULL &&
+        context_needs_summarization(cm, summarizer->options.trigger_threshold)) {
+        start_summary(summarizer);
+    }
+
+    // Summaries are not keeping up: drop the oldest events instead
+    while (context_needs_summarization(cm, summarizer->options.evict_threshold) &&
+           context_get_entry_count(cm, PRIORITY_OLD_EVENTS) > 0 &&
+           context_evict_lowest(cm)) {
+        summarizer->stats.evicted++;
+        changed = true;
+    }
+
+    return changed;
+}
+// }}}
+
+// {{{ context_summarizer_get_stats
+SummarizerStats context_summarizer_get_stats(ContextSummarizer* summarizer) {
+    SummarizerStats stats = {0};
+    if (summarizer != NULL) {
+        stats = summarizer->stats;
+        SummaryJob* job = summarizer->job;
+        if (job != NULL) {
+            pthread_mutex_lock(&job->lock);
+            stats.in_flight = !job->done;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    return stats;
+}
+// }}}
@@ -0,0 +1,80 @@
+/*
+ * 18-summarizer.h - Background Context Summarization
+ *
+ * Keeps a context manager under its token budget by summarizing old
+ * entries off the narration path. Once utilization reaches
+ * trigger_threshold, the summarizable entries (context_find_summarizable)
+ * are copied and sent to the model at summary priority; the context
+ * stays usable meanwhile. When the summary arrives, the next
+ * context_summarizer_maintain replaces the entries that are still
+ * present with it in one step.
+ *
+ * The context manager is not thread-safe, so it is only touched from
+ * the caller of context_summarizer_maintain; the model's answer is
+ * handed over under the summarizer's own lock. If summarization falls
+ * behind and utilization reaches evict_threshold, PRIORITY_OLD_EVENTS
+ * entries are evicted, oldest first, until it is below again.
+ */
+
+#ifndef LLM_SUMMARIZER_H
+#define LLM_SUMMARIZER_H
+
+#include "01-api-client.h"
+#include "06-context-manager.h"
+#include <stdbool.h>
+
+// {{{ SummarizerConfig
+typedef struct {
+    float trigger_threshold;     // Start a summary at this utilization
+    float evict_threshold;       // Evict old events at this utilization
+    int max_entries;             // Entries folded into one summary
+    int min_entries;             // Fewer candidates than this are left alone
+} SummarizerConfig;
+// }}}
+
+// {{{ SummarizerStats
+typedef struct {
+    int started;                 // Summaries requested
+    int applied;                 // Summaries swapped into the context
+    int discarded;               // Finished after all their entries were gone
+    int failed;                  // Model errors
+    int evicted;                 // Old events evicted as the fallback
+    bool in_flight;              // A summary is being written now
+} SummarizerStats;
+// }}}
+
+typedef struct ContextSummarizer ContextSummarizer;
+
+// {{{ context_summarizer_default_config
+SummarizerConfig context_summarizer_default_config(void);
+// }}}
+
+// {{{ context_summarizer_create
+// cm must outlive the summarizer; config is copied. options may be
+// NULL for the defaults. session is the scheduler's fair-queuing key.
+// Requests go through the scheduler when it runs, otherwise through the
+// async engine; without either only the eviction fallback applies.
+ContextSummarizer* context_summarizer_create(ContextManager* cm,
+                                             const LLMConfig* config,
+                                             const SummarizerConfig* options,
+                                             const void* session);
+// }}}
+
+// {{{ context_summarizer_free
+// Cancels a summary in flight and frees the summarizer.
+void context_summarizer_free(ContextSummarizer* summarizer);
+// }}}
+
+// {{{ context_summarizer_maintain
+// Call from the thread that owns the context manager, e.g. after adding
+// a turn's entries. Applies a finished summary, starts a new one when
+// utilization calls for it, and evicts old events if it is still too
+// high. Never waits for the model. Returns true if the context changed.
+bool context_summarizer_maintain(ContextSummarizer* summarizer);
+// }}}
+
+// {{{ context_summarizer_get_stats
+SummarizerStats context_summarizer_get_stats(ContextSummarizer* summarizer);
+// }}}
+
+#endif /* LLM_SUMMARIZER_H */
@@ -0,0 +1,438 @@
+/*
+ * 19-endpoint-pool.c - Multi-Endpoint LLM Routing Implementation
+ *
+ * One lock guards every endpoint's counters. Acquire scans the
+ * endpoints (a handful) for the least loaded one with room, starting
+ * from a rotating cursor so ties spread out, then checks whether the
+ * session's own endpoint is close enough to take the request instead.
+ * A weighted rendezvous score is the highest of weight hash draws, so
+ * an endpoint of weight w wins a w-proportional share of sessions
+ * without any floating-point maths. Release wakes blocked acquirers.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "19-endpoint-pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FAILURE_THRESHOLD 3
+#define DEFAULT_EJECT_MS 10000
+#define DEFAULT_MAX_EJECT_MS 120000
+#define DEFAULT_AFFINITY_SLACK 2
+
+// Rendezvous draws per endpoint are capped so a huge weight stays cheap
+#define MAX_RENDEZVOUS_WEIGHT 64
+
+// Weight of the newest sample in the latency moving average
+#define LATENCY_EWMA_ALPHA 0.2
+
+// {{{ Endpoint
+typedef struct {
+    char* url;
+    uint64_t url_hash;
+    int weight;
+    int max_concurrent;
+    int outstanding;
+    int consecutive_failures;
+    bool ejected;
+    uint64_t ejected_until_ms;
+    bool held;                   // By the circuit breaker
+    double latency_total_ms;
+    int latency_samples;
+    LLMEndpointStats stats;
+} Endpoint;
+// }}}
+
+// {{{ LLMEndpointPool
+struct LLMEndpointPool {
+    pthread_mutex_t lock;
+    pthread_cond_t freed;
+    LLMEndpointPoolConfig config;
+    Endpoint* endpoints;
+    int count;
+    int cursor;                  // First endpoint looked at by the next pick
+};
+// }}}
+
+// {{{ now_ms
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+// }}}
+
+// {{{ mix64
+// splitmix64 finalizer.
+static uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+// }}}
+
+// {{{ hash_string
+// FNV-1a, stable across restarts so sessions keep their endpoint.
+static uint64_t hash_string(const char* s) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+// }}}
+
+// {{{ rendezvous_score
+// Highest of weight draws for (affinity, endpoint).
+static uint64_t rendezvous_score(const Endpoint* e, unsigned long affinity) {
+    int draws = e->weight < MAX_RENDEZVOUS_WEIGHT ? e->weight : MAX_RENDEZVOUS_WEIGHT;
+    uint64_t best = 0;
+    for (int i = 0; i < draws; i++) {
+        uint64_t draw = mix64(e->url_hash ^ mix64((uint64_t)affinity + (uint64_t)i));
+        if (draw > best) {
+            best = draw;
+        }
+    }
+    return best;
+}
+// }}}
+
+// {{{ has_room
+static bool has_room(const Endpoint* e) {
+    return e->max_concurrent == 0 || e->outstanding < e->max_concurrent;
+}
+// }}}
+
+// {{{ is_out
+// True if e is ejected or held. Caller holds the lock.
+static bool is_out(const Endpoint* e) {
+    return e->ejected || e->held;
+}
+// }}}
+
+// {{{ pick_endpoint
+// Chooses an endpoint with room or returns -1. Caller holds the lock.
+static int pick_endpoint(LLMEndpointPool* pool, unsigned long affinity, int avoid) {
+    uint64_t now = now_ms();
+
+    // Ejections that have run out are lifted here, not on a timer
+    int healthy = 0;
+    for (int i = 0; i < pool->count; i++) {
+        Endpoint* e = &pool->endpoints[i];
+        if (e->ejected && now >= e->ejected_until_ms) {
+            e->ejected = false;
+        }
+        if (!is_out(e)) {
+            healthy++;
+        }
+    }
+    bool panic = healthy == 0;
+
+    // Least outstanding per unit of weight; avoid only if there is a choice
+    int best = -1;
+    double best_load = 0.0;
+    for (int pass = 0; pass < 2 && best < 0; pass++) {
+        for (int n = 0; n < pool->count; n++) {
+            int i = (pool->cursor + n) % pool->count;
+            Endpoint* e = &pool->endpoints[i];
+            if ((is_out(e) && !panic) || !has_room(e) || (pass == 0 && i == avoid)) {
+                continue;
+            }
+            double load = (double)(e->outstanding + 1) / e->weight;
+            if (best < 0 || load < best_load) {
+                best = i;
+                best_load = load;
+            }
+        }
+    }
+    if (best < 0) {
+        return -1;
+    }
+    pool->cursor = (pool->cursor + 1) % pool->count;
+
+    if (affinity == 0) {
+        return best;
+    }
+
+    // The session's own endpoint among the healthy ones
+    int home = -1;
+    uint64_t home_score = 0;
+    for (int i = 0; i < pool->count; i++) {
+        Endpoint* e = &pool->endpoints[i];
+        if (is_out(e) && !panic) {
+            continue;
+        }
+        uint64_t score = rendezvous_score(e, affinity);
+        if (home < 0 || score > home_score) {
+            home = i;
+            home_score = score;
+        }
+    }
+
+    Endpoint* h = &pool->endpoints[home];
+    if (home != avoid && has_room(h) &&
+        h->outstanding + 1 <= best_load * h->weight + pool->config.affinity_slack) {
+        h->stats.affinity_hits++;
+        return home;
+    }
+    return best;
+}
+// }}}
+
+// {{{ llm_endpoint_pool_create
+LLMEndpointPool* llm_endpoint_pool_create(const LLMEndpointSpec* specs, int count,
+                                          const LLMEndpointPoolConfig* config) {
+    if (specs == NULL || count < 1) {
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        if (specs[i].url == NULL || specs[i].url[0] == '\0') {
+            return NULL;
+        }
+    }
+
+    LLMEndpointPool* pool = calloc(1, sizeof(LLMEndpointPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->endpoints = calloc(count, sizeof(Endpoint));
+    if (pool->endpoints == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->count = count;
+
+    pool->config.failure_threshold = DEFAULT_FAILURE_THRESHOLD;
+    pool->config.eject_ms = DEFAULT_EJECT_MS;
+    pool->config.max_eject_ms = DEFAULT_MAX_EJECT_MS;
+    pool->config.affinity_slack = DEFAULT_AFFINITY_SLACK;
+    if (config != NULL) {
+        if (config->failure_threshold > 0) {
+            pool->config.failure_threshold = config->failure_threshold;
+        }
+        if (config->eject_ms > 0) {
+            pool->config.eject_ms = config->eject_ms;
+        }
+        if (config->max_eject_ms > 0) {
+            pool->config.max_eject_ms = config->max_eject_ms;
+        }
+        if (config->affinity_slack >= 0) {
+            pool->config.affinity_slack = config->affinity_slack;
+        }
+    }
+    if (pool->config.max_eject_ms < pool->config.eject_ms) {
+        pool->config.max_eject_ms = pool->config.eject_ms;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Endpoint* e = &pool->endpoints[i];
+        e->url = strdup(specs[i].url);
+        if (e->url == NULL) {
+            pool->count = i;
+            llm_endpoint_pool_free(pool);
+            return NULL;
+        }
+        e->url_hash = hash_string(e->url);
+        e->weight = specs[i].weight > 0 ? specs[i].weight : 1;
+        e->max_concurrent = specs[i].max_concurrent > 0 ? specs[i].max_concurrent : 0;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->freed, NULL);
+    return pool;
+}
+// }}}
+
+// {{{ llm_endpoint_pool_free
+void llm_endpoint_pool_free(LLMEndpointPool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        free(pool->endpoints[i].url);
+    }
+    free(pool->endpoints);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->freed);
+    free(pool);
+}
+// }}}
+
+// {{{ llm_endpoint_pool_acquire
+int llm_endpoint_pool_acquire(LLMEndpointPool* pool, unsigned long affinity,
+                              int avoid, int wait_ms) {
+    if (pool == NULL) {
+        return -1;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (wait_ms > 0) {
+        deadline.tv_sec += wait_ms / 1000;
+        deadline.tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    int index = pick_endpoint(pool, affinity, avoid);
+    int rc = 0;
+    while (index < 0 && wait_ms > 0 && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&pool->freed, &pool->lock, &deadline);
+        index = pick_endpoint(pool, affinity, avoid);
+    }
+    if (index >= 0) {
+        Endpoint* e = &pool->endpoints[index];
+        e->outstanding++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return index;
+}
+// }}}
+
+// {{{ llm_endpoint_pool_release
+void llm_endpoint_pool_release(LLMEndpointPool* pool, int index,
+                               const LLMResponse* response, double latency_ms) {
+    if (pool == NULL || index < 0 || index >= pool->count) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    Endpoint* e = &pool->endpoints[index];
+    if (e->outstanding > 0) {
+        e->outstanding--;
+    }
+
+    if (response != NULL) {
+        e->stats.requests++;
+        e->stats.tokens += response->tokens_used;
+
+        // Client errors (4xx other than 429) are the request's fault
+        long status = response->http_status;
+        bool failed = !response->success &&
+                      (status == 0 || status == 429 || status >= 500);
+        if (failed) {
+            e->stats.failures++;
+            e->consecutive_failures++;
+            if (e->consecutive_failures >= pool->config.failure_threshold &&
+                !e->ejected) {
+                // Each repeat ejection lasts twice as long as the last
+                long long length = pool->config.eject_ms;
+                for (int i = 0; i < e->stats.ejections &&
+                     length < pool->config.max_eject_ms; i++) {
+                    length *= 2;
+                }
+                if (length > pool->config.max_eject_ms) {
+                    length = pool->config.max_eject_ms;
+                }
+                e->ejected = true;
+                e->ejected_until_ms = now_ms() + (uint64_t)length;
+                e->consecutive_failures = 0;
+                e->stats.ejections++;
+            }
+        } else {
+            e->consecutive_failures = 0;
+        }
+
+        if (response->success) {
+            e->latency_total_ms += latency_ms;
+            e->latency_samples++;
+            e->stats.ewma_latency_ms = e->latency_samples == 1
+                ? (float)latency_ms
+                : (float)(LATENCY_EWMA_ALPHA * latency_ms +
+                          (1.0 - LATENCY_EWMA_ALPHA) * e->stats.ewma_latency_ms);
+            if (latency_ms > e->stats.max_latency_ms) {
+                e->stats.max_latency_ms = (float)latency_ms;
+            }
+        }
+    }
+
+    pthread_cond_broadcast(&pool->freed);
+    pthread_mutex_unlock(&pool->lock);
+}
+// }}}
+
+// {{{ llm_endpoint_pool_hold
+void llm_endpoint_pool_hold(LLMEndpointPool* pool, int index, bool held) {
+    if (pool == NULL || index < 0 || index >= pool->count) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->endpoints[index].held = held;
+    if (!held) {
+        pthread_cond_broadcast(&pool->freed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+// }}}
+
+// {{{ llm_endpoint_pool_url
+const char* llm_endpoint_pool_url(const LLMEndpointPool* pool, int index) {
+    if (pool == NULL || index < 0 || index >= pool->count) {
+        return NULL;
+    }
+    return pool->endpoints[index].url;
+}
+// }}}
+
+// {{{ llm_endpoint_pool_count
+int llm_endpoint_pool_count(const LLMEndpointPool* pool) {
+    return pool != NULL ? pool->count : 0;
+}
+// }}}
+
+// {{{ llm_endpoint_pool_capacity
+int llm_endpoint_pool_capacity(const LLMEndpointPool* pool) {
+    if (pool == NULL) {
+        return 0;
+    }
+
+    int capacity = 0;
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->endpoints[i].max_concurrent == 0) {
+            return 0;
+        }
+        capacity += pool->endpoints[i].max_concurrent;
+    }
+    return capacity;
+}
+// }}}
+
+// {{{ llm_endpoint_pool_get_stats
+LLMEndpointStats llm_endpoint_pool_get_stats(LLMEndpointPool* pool, int index) {
+    LLMEndpointStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (pool == NULL || index < 0 || index >= pool->count) {
+        return stats;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    Endpoint* e = &pool->endpoints[index];
+    if (e->ejected && now_ms() >= e->ejected_until_ms) {
+        e->ejected = false;
+    }
+    stats = e->stats;
+    stats.url = e->url;
+    stats.weight = e->weight;
+    stats.max_concurrent = e->max_concurrent;
+    stats.outstanding = e->outstanding;
+    stats.ejected = e->ejected;
+    stats.held = e->held;
+    stats.avg_latency_ms = e->latency_samples > 0
+        ? (float)(e->latency_total_ms / e->latency_samples) : 0.0f;
+    pthread_mutex_unlock(&pool->lock);
+
+    return stats;
+}
+// }}}
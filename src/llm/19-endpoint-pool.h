@@ -0,0 +1,132 @@
+/*
+ * 19-endpoint-pool.h - Multi-Endpoint LLM Routing
+ *
+ * Spreads requests over several model servers. Each endpoint has a
+ * weight (its share of the work) and a concurrency limit (its slots).
+ * A request goes to the endpoint with the fewest outstanding requests
+ * per unit of weight, except that a session sticks to the endpoint its
+ * key hashes to (weighted rendezvous hashing) while that endpoint is
+ * not much busier than the rest, so its prompts keep hitting the same
+ * server's KV cache.
+ *
+ * Health is checked passively: an endpoint whose attempts fail
+ * failure_threshold times in a row (transport errors, 429 and 5xx) is
+ * ejected for eject_ms, doubling on each repeat ejection up to
+ * max_eject_ms, then tried again. Ejecting one endpoint only moves the
+ * sessions hashed to it. A circuit breaker (see 20-circuit-breaker) can
+ * also hold an endpoint out of routing while its circuit is open. If
+ * every endpoint is ejected or held, requests are routed as if none
+ * were rather than refused.
+ *
+ * Attach a pool to an LLMConfig (config->endpoints) and the sync and
+ * async clients pick an endpoint for every attempt, so a retry can land
+ * on a different server. The pool must outlive the requests using it.
+ * With the scheduler, set its max_in_flight to llm_endpoint_pool_capacity.
+ */
+
+#ifndef LLM_ENDPOINT_POOL_H
+#define LLM_ENDPOINT_POOL_H
+
+#include "01-api-client.h"
+#include <stdbool.h>
+
+// {{{ LLMEndpointSpec
+typedef struct {
+    const char* url;             // Base URL (e.g., "http://gpu1:5000")
+    int weight;                  // Relative capacity; < 1 = 1
+    int max_concurrent;          // Requests served at once; 0 = unlimited
+} LLMEndpointSpec;
+// }}}
+
+// {{{ LLMEndpointPoolConfig
+typedef struct {
+    int failure_threshold;       // Consecutive failures that eject (default 3)
+    int eject_ms;                // First ejection length (default 10000)
+    int max_eject_ms;            // Longest ejection (default 120000)
+    int affinity_slack;          // Extra requests a session's endpoint may
+                                 // carry before it spills over (default 2;
+                                 // 0 = none, < 0 = default)
+} LLMEndpointPoolConfig;
+// }}}
+
+// {{{ LLMEndpointStats
+// Counters for one endpoint since the pool was created.
+typedef struct {
+    const char* url;             // Valid while the pool lives
+    int weight;
+    int max_concurrent;
+    int outstanding;             // Requests at the endpoint now
+    bool ejected;
+    bool held;                   // Kept out by llm_endpoint_pool_hold
+    int requests;                // Attempts finished
+    int failures;                // Attempts that counted against health
+    int ejections;
+    int affinity_hits;           // Routed to the session's own endpoint
+    long tokens;                 // Tokens its replies reported using
+    float avg_latency_ms;        // Mean latency of successful attempts
+    float ewma_latency_ms;       // Recent latency (weight 0.2 per attempt)
+    float max_latency_ms;
+} LLMEndpointStats;
+// }}}
+
+typedef struct LLMEndpointPool LLMEndpointPool;
+
+// {{{ llm_endpoint_pool_create
+// Creates a pool over count endpoints. config may be NULL for the
+// defaults; fields <= 0 take their default except where noted. The
+// URLs are copied. Returns NULL if count < 1 or a URL is missing.
+LLMEndpointPool* llm_endpoint_pool_create(const LLMEndpointSpec* specs, int count,
+                                          const LLMEndpointPoolConfig* config);
+// }}}
+
+// {{{ llm_endpoint_pool_free
+// Frees the pool. No request may still be using it.
+void llm_endpoint_pool_free(LLMEndpointPool* pool);
+// }}}
+
+// {{{ llm_endpoint_pool_acquire
+// Picks an endpoint for one attempt and counts it as outstanding.
+// affinity is the session key (0 = none, see LLMConfig.affinity); avoid
+// is an endpoint to skip if another can take the request, e.g. the one
+// that just failed (-1 = none). When every endpoint is at its limit,
+// waits up to wait_ms for one to free. Returns the endpoint index, or
+// -1 if none freed in time. Release every index acquired.
+int llm_endpoint_pool_acquire(LLMEndpointPool* pool, unsigned long affinity,
+                              int avoid, int wait_ms);
+// }}}
+
+// {{{ llm_endpoint_pool_release
+// Ends an attempt on endpoint index. response is the attempt's outcome
+// and feeds the health check and latency metrics; NULL means the
+// attempt was never made (cancelled, no connection to spare) and only
+// frees its place.
+void llm_endpoint_pool_release(LLMEndpointPool* pool, int index,
+                               const LLMResponse* response, double latency_ms);
+// }}}
+
+// {{{ llm_endpoint_pool_hold
+// Keeps endpoint index out of routing, like an ejection, until called
+// again with held false. Used by the circuit breaker for endpoints
+// whose circuit is open.
+void llm_endpoint_pool_hold(LLMEndpointPool* pool, int index, bool held);
+// }}}
+
+// {{{ llm_endpoint_pool_url
+// Base URL of endpoint index; valid while the pool lives.
+const char* llm_endpoint_pool_url(const LLMEndpointPool* pool, int index);
+// }}}
+
+// {{{ llm_endpoint_pool_count
+int llm_endpoint_pool_count(const LLMEndpointPool* pool);
+// }}}
+
+// {{{ llm_endpoint_pool_capacity
+// Sum of the endpoints' concurrency limits, or 0 if any is unlimited.
+int llm_endpoint_pool_capacity(const LLMEndpointPool* pool);
+// }}}
+
+// {{{ llm_endpoint_pool_get_stats
+LLMEndpointStats llm_endpoint_pool_get_stats(LLMEndpointPool* pool, int index);
+// }}}
+
+#endif /* LLM_ENDPOINT_POOL_H */
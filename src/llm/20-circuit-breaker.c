@@ -0,0 +1,603 @@
+/*
+ * 20-circuit-breaker.c - LLM Circuit Breaker Implementation
+ *
+ * One lock guards every circuit: its state and a ring of the last
+ * window attempts at its endpoint. A window is judged after every
+ * attempt while closed; it is cleared on each transition, so a
+ * recovered backend starts with a clean record. Background probes
+ * share the breaker with their async callbacks, and whichever lets go
+ * last frees it. Pool holds are set under the breaker lock, so the
+ * pool's view follows the circuits' in order.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "20-circuit-breaker.h"
+#include "10-async-client.h"
+#include "19-endpoint-pool.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_WINDOW 20
+#define DEFAULT_MIN_SAMPLES 5
+#define DEFAULT_MAX_ERROR_RATE 0.5f
+#define DEFAULT_LATENCY_BUDGET_MS 4000
+#define DEFAULT_OPEN_MS 5000
+
+#define PROBE_PROMPT "Reply with OK."
+
+// {{{ Sample
+typedef struct {
+    bool failed;
+    double latency_ms;
+} Sample;
+// }}}
+
+// {{{ Circuit
+// The state of one endpoint.
+typedef struct {
+    LLMBreaker* owner;
+    int index;                   // Pool endpoint, or 0 without a pool
+    LLMConfig probe;             // Copy aimed at this endpoint alone
+
+    LLMBreakerState state;
+    Sample samples[LLM_BREAKER_MAX_WINDOW];
+    int sample_count;
+    int sample_next;             // Ring position of the next sample
+    uint64_t next_probe_ms;      // When an open circuit checks again
+    bool probing;                // Background probe in flight
+    uint64_t probe_started_ms;   // Of the background probe or half-open request
+    LLMRequestHandle probe_handle;
+
+    LLMBreakerStats stats;
+} Circuit;
+// }}}
+
+// {{{ LLMBreaker
+struct LLMBreaker {
+    pthread_mutex_t lock;
+    LLMBreakerConfig config;
+    LLMEndpointPool* pool;       // Borrowed; NULL = one endpoint
+    Circuit* circuits;
+    int count;
+    int refs;                    // Owner, plus each probe in flight
+    int rejected;
+};
+// }}}
+
+// {{{ now_ms
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+// }}}
+
+// {{{ copy_string
+static char* copy_string(const char* str) {
+    return str != NULL ? strdup(str) : NULL;
+}
+// }}}
+
+// {{{ breaker_destroy
+static void breaker_destroy(LLMBreaker* breaker) {
+    for (int i = 0; i < breaker->count; i++) {
+        LLMConfig* probe = &breaker->circuits[i].probe;
+        free(probe->endpoint);
+        free(probe->api_key);
+        free(probe->model);
+    }
+    free(breaker->circuits);
+    pthread_mutex_destroy(&breaker->lock);
+    free(breaker);
+}
+// }}}
+
+// {{{ breaker_unref
+// Drops one reference; the last frees the breaker. Caller holds the
+// lock, which is released.
+static void breaker_unref(LLMBreaker* breaker) {
+    int refs = --breaker->refs;
+    pthread_mutex_unlock(&breaker->lock);
+    if (refs == 0) {
+        breaker_destroy(breaker);
+    }
+}
+// }}}
+
+// {{{ init_probe
+// Aims circuit's probe at url: single short attempts that bypass the
+// pool, the response memo and the breaker itself. Returns false on
+// allocation failure.
+static bool init_probe(LLMBreaker* breaker, Circuit* circuit,
+                       const LLMConfig* config, const char* url) {
+    circuit->probe = *config;
+    circuit->probe.endpoint = copy_string(url);
+    circuit->probe.api_key = copy_string(config->api_key);
+    circuit->probe.model = copy_string(config->model);
+    circuit->probe.timeout_ms = breaker->config.attempt_timeout_ms;
+    circuit->probe.max_retries = 0;
+    circuit->probe.cache_prompt = false;
+    circuit->probe.slot_id = -1;
+    circuit->probe.endpoints = NULL;
+    circuit->probe.affinity = 0;
+    circuit->probe.breaker = NULL;
+    circuit->probe.temperature = -1.0f;  // Never answered from the memo
+    circuit->probe.memoize_sampled = false;
+    return circuit->probe.endpoint != NULL &&
+           (config->api_key == NULL || circuit->probe.api_key != NULL) &&
+           (config->model == NULL || circuit->probe.model != NULL);
+}
+// }}}
+
+// {{{ llm_breaker_create
+LLMBreaker* llm_breaker_create(const LLMConfig* config,
+                               const LLMBreakerConfig* options) {
+    if (config == NULL) {
+        return NULL;
+    }
+
+    LLMBreaker* breaker = calloc(1, sizeof(LLMBreaker));
+    if (breaker == NULL) {
+        return NULL;
+    }
+
+    if (options != NULL) {
+        breaker->config = *options;
+    }
+    LLMBreakerConfig* c = &breaker->config;
+    if (c->window <= 0) {
+        c->window = DEFAULT_WINDOW;
+    }
+    if (c->window > LLM_BREAKER_MAX_WINDOW) {
+        c->window = LLM_BREAKER_MAX_WINDOW;
+    }
+    if (c->min_samples <= 0) {
+        c->min_samples = DEFAULT_MIN_SAMPLES;
+    }
+    if (c->min_samples > c->window) {
+        c->min_samples = c->window;
+    }
+    if (c->max_error_rate <= 0.0f) {
+        c->max_error_rate = DEFAULT_MAX_ERROR_RATE;
+    }
+    if (c->latency_budget_ms <= 0) {
+        c->latency_budget_ms = DEFAULT_LATENCY_BUDGET_MS;
+    }
+    if (c->attempt_timeout_ms <= 0) {
+        c->attempt_timeout_ms = c->latency_budget_ms * 2;
+    }
+    if (c->open_ms <= 0) {
+        c->open_ms = DEFAULT_OPEN_MS;
+    }
+
+    breaker->pool = config->endpoints;
+    breaker->count = breaker->pool != NULL ? llm_endpoint_pool_count(breaker->pool) : 1;
+    breaker->circuits = calloc((size_t)breaker->count, sizeof(Circuit));
+    if (breaker->circuits == NULL) {
+        free(breaker);
+        return NULL;
+    }
+
+    pthread_mutex_init(&breaker->lock, NULL);
+    breaker->refs = 1;
+    for (int i = 0; i < breaker->count; i++) {
+        Circuit* circuit = &breaker->circuits[i];
+        circuit->owner = breaker;
+        circuit->index = i;
+        circuit->state = LLM_BREAKER_CLOSED;
+        circuit->probe_handle = LLM_REQUEST_INVALID;
+        const char* url = breaker->pool != NULL
+            ? llm_endpoint_pool_url(breaker->pool, i) : config->endpoint;
+        if (!init_probe(breaker, circuit, config, url)) {
+            breaker->count = i + 1;
+            breaker_destroy(breaker);
+            return NULL;
+        }
+    }
+    return breaker;
+}
+// }}}
+
+// {{{ llm_breaker_free
+void llm_breaker_free(LLMBreaker* breaker) {
+    if (breaker == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&breaker->lock);
+    int count = breaker->count;
+    LLMRequestHandle* handles = calloc((size_t)count, sizeof(LLMRequestHandle));
+    for (int i = 0; i < count && handles != NULL; i++) {
+        Circuit* circuit = &breaker->circuits[i];
+        handles[i] = circuit->probing ? circuit->probe_handle : LLM_REQUEST_INVALID;
+    }
+    breaker_unref(breaker);
+
+    // Cancelling may run a callback, and free the breaker, right here
+    for (int i = 0; i < count && handles != NULL; i++) {
+        if (handles[i] != LLM_REQUEST_INVALID) {
+            llm_async_cancel(handles[i]);
+        }
+    }
+    free(handles);
+}
+// }}}
+
+// {{{ clear_window
+static void clear_window(Circuit* circuit) {
+    circuit->sample_count = 0;
+    circuit->sample_next = 0;
+}
+// }}}
+
+// {{{ open_circuit
+// Caller holds the lock.
+static void open_circuit(Circuit* circuit, uint64_t now) {
+    LLMBreaker* breaker = circuit->owner;
+    circuit->state = LLM_BREAKER_OPEN;
+    circuit->next_probe_ms = now + (uint64_t)breaker->config.open_ms;
+    clear_window(circuit);
+    llm_endpoint_pool_hold(breaker->pool, circuit->index, true);
+}
+// }}}
+
+// {{{ close_circuit
+// Caller holds the lock.
+static void close_circuit(Circuit* circuit) {
+    circuit->state = LLM_BREAKER_CLOSED;
+    circuit->stats.recoveries++;
+    clear_window(circuit);
+    llm_endpoint_pool_hold(circuit->owner->pool, circuit->index, false);
+}
+// }}}
+
+// {{{ probe_passed
+// A probe must succeed within the latency budget to close the circuit.
+static bool probe_passed(const LLMBreaker* breaker, const LLMResponse* response,
+                         double latency_ms) {
+    return response != NULL && response->success &&
+           latency_ms <= breaker->config.latency_budget_ms;
+}
+// }}}
+
+// {{{ window_summary
+// Failure share and p95 latency of a circuit's window. Caller holds
+// the lock.
+static void window_summary(const Circuit* circuit, float* error_rate,
+                           float* p95_ms) {
+    int count = circuit->sample_count;
+    *error_rate = 0.0f;
+    *p95_ms = 0.0f;
+    if (count == 0) {
+        return;
+    }
+
+    // Insertion sort: the window holds at most LLM_BREAKER_MAX_WINDOW
+    double sorted[LLM_BREAKER_MAX_WINDOW];
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        const Sample* s = &circuit->samples[i];
+        if (s->failed) {
+            failures++;
+        }
+        int j = i;
+        while (j > 0 && sorted[j - 1] > s->latency_ms) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = s->latency_ms;
+    }
+
+    // Nearest rank: the smallest latency at or above 95% of the samples
+    int rank = (count * 95 + 99) / 100;
+    *error_rate = (float)failures / count;
+    *p95_ms = (float)sorted[rank - 1];
+}
+// }}}
+
+// {{{ probe_done
+static void probe_done(LLMResponse* response, void* user) {
+    Circuit* circuit = user;
+    LLMBreaker* breaker = circuit->owner;
+
+    pthread_mutex_lock(&breaker->lock);
+    double latency_ms = (double)(now_ms() - circuit->probe_started_ms);
+    bool cancelled = response != NULL && response->error != NULL &&
+                     strcmp(response->error, "Request cancelled") == 0;
+    circuit->probing = false;
+    circuit->probe_handle = LLM_REQUEST_INVALID;
+    if (!cancelled && circuit->state == LLM_BREAKER_OPEN) {
+        if (probe_passed(breaker, response, latency_ms)) {
+            close_circuit(circuit);
+        } else {
+            circuit->stats.probe_failures++;
+            circuit->next_probe_ms = now_ms() + (uint64_t)breaker->config.open_ms;
+        }
+    }
+    breaker_unref(breaker);
+
+    llm_response_free(response);
+}
+// }}}
+
+// {{{ start_probe
+// Sends a background probe to circuit's endpoint if one is due. Returns
+// false when the async engine could not take it, leaving the check to
+// a half-open request.
+static bool start_probe(Circuit* circuit) {
+    LLMBreaker* breaker = circuit->owner;
+
+    pthread_mutex_lock(&breaker->lock);
+    uint64_t now = now_ms();
+    if (circuit->state != LLM_BREAKER_OPEN || circuit->probing ||
+        now < circuit->next_probe_ms) {
+        pthread_mutex_unlock(&breaker->lock);
+        return true;
+    }
+    circuit->probing = true;
+    circuit->probe_started_ms = now;
+    breaker->refs++;  // Held by the callback
+    pthread_mutex_unlock(&breaker->lock);
+
+    // The callback may run before this returns, so no lock is held
+    LLMMessage message = { "user", PROBE_PROMPT };
+    LLMRequestHandle handle = llm_request_async(&circuit->probe, &message, 1,
+                                                probe_done, circuit);
+
+    pthread_mutex_lock(&breaker->lock);
+    if (handle == LLM_REQUEST_INVALID) {
+        // Not queued, so the callback will never run
+        circuit->probing = false;
+        breaker->refs--;
+        pthread_mutex_unlock(&breaker->lock);
+        return false;
+    }
+    circuit->stats.probes++;
+    if (circuit->probing) {
+        circuit->probe_handle = handle;
+    }
+    pthread_mutex_unlock(&breaker->lock);
+    return true;
+}
+// }}}
+
+// {{{ start_probes
+// Starts the due background probes. Returns false if the async engine
+// could not take one.
+static bool start_probes(LLMBreaker* breaker) {
+    bool async_probe = true;
+    for (int i = 0; i < breaker->count; i++) {
+        if (!start_probe(&breaker->circuits[i])) {
+            async_probe = false;
+        }
+    }
+    return async_probe;
+}
+// }}}
+
+// {{{ expire_half_open
+// A half-open request that never reported back (cancelled, or routed
+// elsewhere) counts as a failed probe once it has had its full attempt.
+// Caller holds the lock.
+static void expire_half_open(LLMBreaker* breaker, uint64_t now) {
+    for (int i = 0; i < breaker->count; i++) {
+        Circuit* circuit = &breaker->circuits[i];
+        if (circuit->state == LLM_BREAKER_HALF_OPEN &&
+            now - circuit->probe_started_ms >
+                (uint64_t)breaker->config.attempt_timeout_ms) {
+            circuit->stats.probe_failures++;
+            circuit->state = LLM_BREAKER_OPEN;
+            circuit->next_probe_ms = now;
+            llm_endpoint_pool_hold(breaker->pool, circuit->index, true);
+        }
+    }
+}
+// }}}
+
+// {{{ any_closed
+// Caller holds the lock.
+static bool any_closed(const LLMBreaker* breaker) {
+    for (int i = 0; i < breaker->count; i++) {
+        if (breaker->circuits[i].state == LLM_BREAKER_CLOSED) {
+            return true;
+        }
+    }
+    return false;
+}
+// }}}
+
+// {{{ due_for_half_open
+// Returns the open circuit a request could probe now, or NULL. Caller
+// holds the lock.
+static Circuit* due_for_half_open(LLMBreaker* breaker, uint64_t now) {
+    for (int i = 0; i < breaker->count; i++) {
+        Circuit* circuit = &breaker->circuits[i];
+        if (circuit->state == LLM_BREAKER_OPEN && !circuit->probing &&
+            now >= circuit->next_probe_ms) {
+            return circuit;
+        }
+    }
+    return NULL;
+}
+// }}}
+
+// {{{ llm_breaker_allow
+bool llm_breaker_allow(LLMBreaker* breaker) {
+    if (breaker == NULL) {
+        return true;
+    }
+
+    bool async_probe = start_probes(breaker);
+
+    pthread_mutex_lock(&breaker->lock);
+    uint64_t now = now_ms();
+    expire_half_open(breaker, now);
+
+    bool allowed = any_closed(breaker);
+    Circuit* due = async_probe ? NULL : due_for_half_open(breaker, now);
+    if (due != NULL) {
+        // No async engine: this request is the probe. Released from the
+        // pool's hold so that, with every other circuit open, it lands here.
+        due->state = LLM_BREAKER_HALF_OPEN;
+        due->probe_started_ms = now;
+        due->stats.probes++;
+        llm_endpoint_pool_hold(breaker->pool, due->index, false);
+        allowed = true;
+    }
+    if (!allowed) {
+        breaker->rejected++;
+    }
+    pthread_mutex_unlock(&breaker->lock);
+    return allowed;
+}
+// }}}
+
+// {{{ llm_breaker_is_open
+bool llm_breaker_is_open(LLMBreaker* breaker) {
+    if (breaker == NULL) {
+        return false;
+    }
+
+    bool async_probe = start_probes(breaker);
+
+    pthread_mutex_lock(&breaker->lock);
+    uint64_t now = now_ms();
+    expire_half_open(breaker, now);
+
+    // A due circuit would admit the next request as its probe
+    bool open = !any_closed(breaker) &&
+                (async_probe || due_for_half_open(breaker, now) == NULL);
+    pthread_mutex_unlock(&breaker->lock);
+    return open;
+}
+// }}}
+
+// {{{ llm_breaker_record
+void llm_breaker_record(LLMBreaker* breaker, int endpoint,
+                        const LLMResponse* response, double latency_ms) {
+    if (breaker == NULL || response == NULL) {
+        return;
+    }
+    if (endpoint < 0 || endpoint >= breaker->count) {
+        if (breaker->count != 1) {
+            return;  // Not routed through the pool the circuits watch
+        }
+        endpoint = 0;
+    }
+
+    // Client errors (4xx other than 429) are the request's fault
+    long status = response->http_status;
+    bool failed = !response->success &&
+                  (status == 0 || status == 429 || status >= 500);
+
+    pthread_mutex_lock(&breaker->lock);
+    Circuit* circuit = &breaker->circuits[endpoint];
+    uint64_t now = now_ms();
+
+    if (circuit->state == LLM_BREAKER_HALF_OPEN) {
+        if (probe_passed(breaker, response, latency_ms)) {
+            close_circuit(circuit);
+        } else {
+            circuit->stats.probe_failures++;
+            open_circuit(circuit, now);
+        }
+    } else if (circuit->state == LLM_BREAKER_CLOSED) {
+        Sample* s = &circuit->samples[circuit->sample_next];
+        s->failed = failed;
+        s->latency_ms = latency_ms;
+        circuit->sample_next = (circuit->sample_next + 1) % breaker->config.window;
+        if (circuit->sample_count < breaker->config.window) {
+            circuit->sample_count++;
+        }
+
+        if (circuit->sample_count >= breaker->config.min_samples) {
+            float error_rate, p95_ms;
+            window_summary(circuit, &error_rate, &p95_ms);
+            if (error_rate >= breaker->config.max_error_rate ||
+                p95_ms > breaker->config.latency_budget_ms) {
+                circuit->stats.trips++;
+                open_circuit(circuit, now);
+            }
+        }
+    }
+    // While open, attempts admitted before the trip are ignored
+
+    pthread_mutex_unlock(&breaker->lock);
+}
+// }}}
+
+// {{{ llm_breaker_attempt_timeout
+int llm_breaker_attempt_timeout(const LLMBreaker* breaker) {
+    return breaker != NULL ? breaker->config.attempt_timeout_ms : 0;
+}
+// }}}
+
+// {{{ llm_breaker_max_retries
+int llm_breaker_max_retries(const LLMBreaker* breaker) {
+    return breaker != NULL && breaker->count > 1 ? 1 : 0;
+}
+// }}}
+
+// {{{ circuit_stats
+// Caller holds the lock.
+static LLMBreakerStats circuit_stats(const Circuit* circuit) {
+    LLMBreakerStats stats = circuit->stats;
+    stats.state = circuit->state;
+    stats.samples = circuit->sample_count;
+    stats.open_endpoints = circuit->state != LLM_BREAKER_CLOSED ? 1 : 0;
+    window_summary(circuit, &stats.error_rate, &stats.p95_latency_ms);
+    return stats;
+}
+// }}}
+
+// {{{ llm_breaker_get_stats
+LLMBreakerStats llm_breaker_get_stats(LLMBreaker* breaker) {
+    LLMBreakerStats stats = {0};
+    if (breaker == NULL) {
+        return stats;
+    }
+
+    pthread_mutex_lock(&breaker->lock);
+    stats.state = LLM_BREAKER_OPEN;
+    float failures = 0.0f;
+    for (int i = 0; i < breaker->count; i++) {
+        LLMBreakerStats one = circuit_stats(&breaker->circuits[i]);
+        if (one.state == LLM_BREAKER_CLOSED ||
+            (one.state == LLM_BREAKER_HALF_OPEN && stats.state == LLM_BREAKER_OPEN)) {
+            stats.state = one.state;
+        }
+        stats.trips += one.trips;
+        stats.probes += one.probes;
+        stats.probe_failures += one.probe_failures;
+        stats.recoveries += one.recoveries;
+        stats.samples += one.samples;
+        stats.open_endpoints += one.open_endpoints;
+        failures += one.error_rate * one.samples;
+        if (one.p95_latency_ms > stats.p95_latency_ms) {
+            stats.p95_latency_ms = one.p95_latency_ms;
+        }
+    }
+    stats.error_rate = stats.samples > 0 ? failures / stats.samples : 0.0f;
+    stats.rejected = breaker->rejected;
+    pthread_mutex_unlock(&breaker->lock);
+    return stats;
+}
+// }}}
+
+// {{{ llm_breaker_get_endpoint_stats
+LLMBreakerStats llm_breaker_get_endpoint_stats(LLMBreaker* breaker, int index) {
+    LLMBreakerStats stats = {0};
+    if (breaker == NULL || index < 0 || index >= breaker->count) {
+        return stats;
+    }
+
+    pthread_mutex_lock(&breaker->lock);
+    stats = circuit_stats(&breaker->circuits[index]);
+    pthread_mutex_unlock(&breaker->lock);
+    return stats;
+}
+// }}}
@@ -0,0 +1,130 @@
+/*
+ * 20-circuit-breaker.h - LLM Circuit Breaker
+ *
+ * Stops callers from waiting on a model server that is down or too
+ * slow. The breaker watches the outcome and latency of the last window
+ * attempts at each endpoint and opens that endpoint's circuit when too
+ * many fail (transport errors, 429 and 5xx) or when their p95 latency
+ * exceeds the budget. With an endpoint pool every backend has its own
+ * circuit; an open one is held out of the pool's routing (see
+ * llm_endpoint_pool_hold), so one failing backend does not stop the
+ * others. The breaker as a whole is open only once every circuit is.
+ *
+ * While open, requests fail at once with "LLM circuit open" and
+ * narration is written locally (event_narration_build_local). Every
+ * open_ms a probe checks each open backend in the background on the
+ * async engine; one that succeeds within the budget closes that
+ * circuit. When the async engine is not running, the next request
+ * after open_ms is let through as the probe instead (half-open).
+ *
+ * Attach a breaker to an LLMConfig (config->breaker) and the sync and
+ * async clients consult it. Each attempt is capped at
+ * attempt_timeout_ms, and instead of retrying with backoff a request
+ * makes at most llm_breaker_max_retries immediate failovers to another
+ * backend, so no caller waits long on a failing model. The breaker
+ * must outlive the requests using it.
+ */
+
+#ifndef LLM_CIRCUIT_BREAKER_H
+#define LLM_CIRCUIT_BREAKER_H
+
+#include "01-api-client.h"
+#include <stdbool.h>
+
+#define LLM_BREAKER_MAX_WINDOW 128
+
+// {{{ LLMBreakerState
+typedef enum {
+    LLM_BREAKER_CLOSED,          // Requests go to the model
+    LLM_BREAKER_OPEN,            // Requests fail fast; probing in background
+    LLM_BREAKER_HALF_OPEN        // One request is probing the model
+} LLMBreakerState;
+// }}}
+
+// {{{ LLMBreakerConfig
+typedef struct {
+    int window;                  // Recent attempts judged (default 20, max 128)
+    int min_samples;             // Attempts needed before tripping (default 5)
+    float max_error_rate;        // Failure share that trips (default 0.5)
+    int latency_budget_ms;       // p95 latency that trips (default 4000)
+    int attempt_timeout_ms;      // Longest single attempt (default 2x budget)
+    int open_ms;                 // Wait between probes while open (default 5000)
+} LLMBreakerConfig;
+// }}}
+
+// {{{ LLMBreakerStats
+typedef struct {
+    LLMBreakerState state;
+    int trips;                   // Times the breaker opened
+    int rejected;                // Requests failed fast while open
+    int probes;                  // Recovery checks made
+    int probe_failures;          // Checks that found the model still unwell
+    int recoveries;              // Times the breaker closed again
+    int samples;                 // Attempts in the current window
+    float error_rate;            // Failure share of the window
+    float p95_latency_ms;        // Over the window (worst endpoint's overall)
+    int open_endpoints;          // Endpoints whose circuit is not closed
+} LLMBreakerStats;
+// }}}
+
+typedef struct LLMBreaker LLMBreaker;
+
+// {{{ llm_breaker_create
+// Creates a closed breaker for config's endpoint, or one circuit per
+// endpoint of config's pool, which probes use. config is copied; the
+// pool is borrowed and must outlive the breaker. options may be NULL
+// for the defaults; fields <= 0 take their default.
+LLMBreaker* llm_breaker_create(const LLMConfig* config,
+                               const LLMBreakerConfig* options);
+// }}}
+
+// {{{ llm_breaker_free
+// Frees the breaker once no request is using it. A probe in flight is
+// cancelled.
+void llm_breaker_free(LLMBreaker* breaker);
+// }}}
+
+// {{{ llm_breaker_allow
+// Returns true if a request may go to the model now: some circuit is
+// closed, or, in half-open state, this is the probing request. Counts
+// a rejection otherwise.
+bool llm_breaker_allow(LLMBreaker* breaker);
+// }}}
+
+// {{{ llm_breaker_is_open
+// Returns true while requests would be failed fast, without admitting
+// or counting one. Lets callers skip building a request at all.
+bool llm_breaker_is_open(LLMBreaker* breaker);
+// }}}
+
+// {{{ llm_breaker_record
+// Reports one attempt's outcome and latency at endpoint, the pool index
+// the attempt was routed to (-1 without a pool).
+void llm_breaker_record(LLMBreaker* breaker, int endpoint,
+                        const LLMResponse* response, double latency_ms);
+// }}}
+
+// {{{ llm_breaker_attempt_timeout
+// Longest an attempt may take while the breaker is attached.
+int llm_breaker_attempt_timeout(const LLMBreaker* breaker);
+// }}}
+
+// {{{ llm_breaker_max_retries
+// Retries a request may make while the breaker is attached: one
+// failover to another backend when the breaker watches a pool of
+// several, none otherwise.
+int llm_breaker_max_retries(const LLMBreaker* breaker);
+// }}}
+
+// {{{ llm_breaker_get_stats
+// Totals over every circuit; state is closed while any circuit is.
+LLMBreakerStats llm_breaker_get_stats(LLMBreaker* breaker);
+// }}}
+
+// {{{ llm_breaker_get_endpoint_stats
+// Stats of one endpoint's circuit (index 0 without a pool). rejected is
+// only counted for the breaker as a whole.
+LLMBreakerStats llm_breaker_get_endpoint_stats(LLMBreaker* breaker, int index);
+// }}}
+
+#endif /* LLM_CIRCUIT_BREAKER_H */
@@ -0,0 +1,533 @@
+/*
+ * 21-response-memo.c - Exact-Prompt Response Memoization Implementation
+ *
+ * One lock guards a chained hash table of replies threaded on a
+ * recency list (most recent at the head). Keys are two 64-bit hashes
+ * of the request computed with different seeds; both must match. The
+ * hash folds the input eight bytes at a time through the splitmix64
+ * finalizer, which is fast enough that hashing a prompt costs far less
+ * than serializing it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "21-response-memo.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIN_BUCKETS 64
+#define SNAPSHOT_MAGIC "LLMMEMO 1\n"
+#define RECORD_HEADER_MAX 96
+
+// Seeds for the two halves of a key
+#define SEED_HI 0x6a09e667f3bcc908ULL
+#define SEED_LO 0xbb67ae8584caa73bULL
+
+// {{{ MemoEntry
+typedef struct MemoEntry {
+    LLMMemoKey key;
+    char* text;
+    int tokens;                  // Upstream tokens the reply cost
+    size_t bytes;                // Charged against max_bytes
+    struct MemoEntry* hash_next;
+    struct MemoEntry* lru_prev;
+    struct MemoEntry* lru_next;
+} MemoEntry;
+// }}}
+
+// {{{ Memo state
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool ready = false;
+static LLMMemoConfig memo_config;
+static char* memo_path = NULL;
+static MemoEntry** buckets = NULL;
+static size_t bucket_mask = 0;
+static MemoEntry* lru_head = NULL;
+static MemoEntry* lru_tail = NULL;
+static LLMMemoStats stats;
+// }}}
+
+// {{{ mix64
+// splitmix64 finalizer.
+static uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+// }}}
+
+// {{{ hash_bytes
+// Folds len bytes of data into h. The length goes in too, so adjacent
+// fields cannot trade bytes and collide.
+static uint64_t hash_bytes(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = data;
+    size_t left = len;
+    while (left >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = mix64(h ^ word);
+        p += 8;
+        left -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, left);
+    return mix64(h ^ tail ^ ((uint64_t)len << 3));
+}
+// }}}
+
+// {{{ hash_string
+static uint64_t hash_string(uint64_t h, const char* s) {
+    return s != NULL ? hash_bytes(h, s, strlen(s)) : mix64(h ^ 0xff);
+}
+// }}}
+
+// {{{ request_hash
+static uint64_t request_hash(uint64_t seed, const LLMConfig* config,
+                             const LLMMessage* messages, size_t message_count) {
+    uint64_t h = hash_string(seed, config->model);
+    h = hash_bytes(h, &config->temperature, sizeof(config->temperature));
+    for (size_t i = 0; i < message_count; i++) {
+        h = hash_string(h, messages[i].role);
+        h = hash_string(h, messages[i].content);
+    }
+    return h;
+}
+// }}}
+
+// {{{ bucket_for
+static MemoEntry** bucket_for(const LLMMemoKey* key) {
+    return &buckets[key->lo & bucket_mask];
+}
+// }}}
+
+// {{{ find_entry
+// Caller holds memo_lock.
+static MemoEntry* find_entry(const LLMMemoKey* key) {
+    for (MemoEntry* e = *bucket_for(key); e != NULL; e = e->hash_next) {
+        if (e->key.hi == key->hi && e->key.lo == key->lo) {
+            return e;
+        }
+    }
+    return NULL;
+}
+// }}}
+
+// {{{ lru_unlink / lru_push
+// Caller holds memo_lock.
+static void lru_unlink(MemoEntry* e) {
+    if (e->lru_prev != NULL) {
+        e->lru_prev->lru_next = e->lru_next;
+    } else {
+        lru_head = e->lru_next;
+    }
+    if (e->lru_next != NULL) {
+        e->lru_next->lru_prev = e->lru_prev;
+    } else {
+        lru_tail = e->lru_prev;
+    }
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push(MemoEntry* e) {
+    e->lru_prev = NULL;
+    e->lru_next = lru_head;
+    if (lru_head != NULL) {
+        lru_head->lru_prev = e;
+    }
+    lru_head = e;
+    if (lru_tail == NULL) {
+        lru_tail = e;
+    }
+}
+// }}}
+
+// {{{ remove_entry
+// Unlinks and frees e. Caller holds memo_lock.
+static void remove_entry(MemoEntry* e) {
+    MemoEntry** link = bucket_for(&e->key);
+    while (*link != e) {
+        link = &(*link)->hash_next;
+    }
+    *link = e->hash_next;
+    lru_unlink(e);
+
+    stats.entries--;
+    stats.bytes -= e->bytes;
+    free(e->text);
+    free(e);
+}
+// }}}
+
+// {{{ over_budget
+// Caller holds memo_lock.
+static bool over_budget(size_t adding) {
+    return stats.entries + 1 > memo_config.max_entries ||
+           (memo_config.max_bytes > 0 && stats.bytes + adding > memo_config.max_bytes);
+}
+// }}}
+
+// {{{ insert_entry
+// Stores text under key as the most recent entry, evicting the least
+// recently used until it fits. Caller holds memo_lock.
+static bool insert_entry(const LLMMemoKey* key, const char* text, int tokens) {
+    MemoEntry* existing = find_entry(key);
+    if (existing != NULL) {
+        remove_entry(existing);
+    }
+
+    size_t text_len = strlen(text);
+    size_t bytes = sizeof(MemoEntry) + text_len + 1;
+    if (memo_config.max_bytes > 0 && bytes > memo_config.max_bytes) {
+        return false;
+    }
+    while (lru_tail != NULL && over_budget(bytes)) {
+        remove_entry(lru_tail);
+        stats.evictions++;
+    }
+
+    MemoEntry* e = calloc(1, sizeof(MemoEntry));
+    char* copy = malloc(text_len + 1);
+    if (e == NULL || copy == NULL) {
+        free(e);
+        free(copy);
+        return false;
+    }
+    memcpy(copy, text, text_len + 1);
+    e->key = *key;
+    e->text = copy;
+    e->tokens = tokens;
+    e->bytes = bytes;
+
+    MemoEntry** bucket = bucket_for(key);
+    e->hash_next = *bucket;
+    *bucket = e;
+    lru_push(e);
+    stats.entries++;
+    stats.bytes += bytes;
+    return true;
+}
+// }}}
+
+// {{{ clear_entries
+// Caller holds memo_lock.
+static void clear_entries(void) {
+    while (lru_head != NULL) {
+        remove_entry(lru_head);
+    }
+}
+// }}}
+
+// {{{ read_exact
+// Reads len bytes plus a terminating NUL into a new buffer.
+static char* read_exact(FILE* f, size_t len) {
+    char* buffer = malloc(len + 1);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    if (fread(buffer, 1, len, f) != len) {
+        free(buffer);
+        return NULL;
+    }
+    buffer[len] = '\0';
+    return buffer;
+}
+// }}}
+
+// {{{ load_snapshot
+// Restores every well-formed record; the file lists the least recently
+// used first, so inserting in order rebuilds the recency list.
+// Caller holds memo_lock.
+static int load_snapshot(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+
+    int loaded = 0;
+    char header[RECORD_HEADER_MAX];
+    if (fgets(header, sizeof(header), f) == NULL ||
+        strcmp(header, SNAPSHOT_MAGIC) != 0) {
+        fclose(f);
+        return 0;
+    }
+
+    while (fgets(header, sizeof(header), f) != NULL) {
+        LLMMemoKey key;
+        int tokens = 0;
+        size_t text_len = 0;
+        if (sscanf(header, "%" SCNx64 " %" SCNx64 " %d %zu",
+                   &key.hi, &key.lo, &tokens, &text_len) != 4) {
+            break;
+        }
+        char* text = read_exact(f, text_len);
+        if (text == NULL || fgetc(f) != '\n') {
+            free(text);
+            break;
+        }
+        if (insert_entry(&key, text, tokens)) {
+            loaded++;
+        }
+        free(text);
+    }
+
+    fclose(f);
+    return loaded;
+}
+// }}}
+
+// {{{ make_parent_directory
+// Creates the directory holding path if it does not exist (one level).
+static bool make_parent_directory(const char* path) {
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL || slash == path) {
+        return true;
+    }
+
+    size_t len = (size_t)(slash - path);
+    char* dir = malloc(len + 1);
+    if (dir == NULL) {
+        return false;
+    }
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+
+    bool ok = mkdir(dir, 0755) == 0 || errno == EEXIST;
+    free(dir);
+    return ok;
+}
+// }}}
+
+// {{{ write_snapshot
+// Writes every entry to a temporary file and renames it over the
+// snapshot. Caller holds memo_lock.
+static bool write_snapshot(void) {
+    if (memo_path == NULL || !make_parent_directory(memo_path)) {
+        return false;
+    }
+
+    size_t tmp_len = strlen(memo_path) + 5;
+    char* tmp_path = malloc(tmp_len);
+    if (tmp_path == NULL) {
+        return false;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", memo_path);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        free(tmp_path);
+        return false;
+    }
+
+    bool ok = fputs(SNAPSHOT_MAGIC, f) != EOF;
+    for (MemoEntry* e = lru_tail; e != NULL && ok; e = e->lru_prev) {
+        size_t text_len = strlen(e->text);
+        ok = fprintf(f, "%016" PRIx64 " %016" PRIx64 " %d %zu\n",
+                     e->key.hi, e->key.lo, e->tokens, text_len) > 0 &&
+             fwrite(e->text, 1, text_len, f) == text_len &&
+             fputc('\n', f) != EOF;
+    }
+
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp_path, memo_path) != 0) {
+        remove(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+    free(tmp_path);
+    return true;
+}
+// }}}
+
+// {{{ llm_memo_init
+bool llm_memo_init(const LLMMemoConfig* config) {
+    if (ready) {
+        return false;
+    }
+
+    memset(&memo_config, 0, sizeof(memo_config));
+    if (config != NULL) {
+        memo_config = *config;
+    }
+    if (memo_config.max_entries <= 0) {
+        memo_config.max_entries = LLM_MEMO_DEFAULT_MAX_ENTRIES;
+    }
+
+    size_t bucket_count = MIN_BUCKETS;
+    while (bucket_count < (size_t)memo_config.max_entries) {
+        bucket_count *= 2;
+    }
+    buckets = calloc(bucket_count, sizeof(MemoEntry*));
+    memo_path = memo_config.path != NULL && memo_config.path[0] != '\0'
+                ? strdup(memo_config.path) : NULL;
+    memo_config.path = NULL;  // Not owned; memo_path is the copy
+    if (buckets == NULL || (config != NULL && config->path != NULL &&
+                            config->path[0] != '\0' && memo_path == NULL)) {
+        free(buckets);
+        buckets = NULL;
+        free(memo_path);
+        memo_path = NULL;
+        return false;
+    }
+    bucket_mask = bucket_count - 1;
+    lru_head = lru_tail = NULL;
+
+    pthread_mutex_lock(&memo_lock);
+    memset(&stats, 0, sizeof(stats));
+    if (memo_path != NULL) {
+        stats.loaded = load_snapshot(memo_path);
+    }
+    ready = true;
+    pthread_mutex_unlock(&memo_lock);
+    return true;
+}
+// }}}
+
+// {{{ llm_memo_cleanup
+void llm_memo_cleanup(void) {
+    pthread_mutex_lock(&memo_lock);
+    if (!ready) {
+        pthread_mutex_unlock(&memo_lock);
+        return;
+    }
+
+    write_snapshot();
+    clear_entries();
+    free(buckets);
+    buckets = NULL;
+    free(memo_path);
+    memo_path = NULL;
+    ready = false;
+    pthread_mutex_unlock(&memo_lock);
+}
+// }}}
+
+// {{{ llm_memo_is_ready
+bool llm_memo_is_ready(void) {
+    pthread_mutex_lock(&memo_lock);
+    bool is_ready = ready;
+    pthread_mutex_unlock(&memo_lock);
+    return is_ready;
+}
+// }}}
+
+// {{{ llm_memo_key
+bool llm_memo_key(const LLMConfig* config, const LLMMessage* messages,
+                  size_t message_count, LLMMemoKey* key) {
+    if (config == NULL || messages == NULL || message_count == 0 || key == NULL ||
+        !llm_memo_is_ready()) {
+        return false;
+    }
+
+    // Only a reply the model would give again is worth keeping
+    if (config->temperature != 0.0f && !config->memoize_sampled) {
+        pthread_mutex_lock(&memo_lock);
+        stats.bypassed++;
+        pthread_mutex_unlock(&memo_lock);
+        return false;
+    }
+
+    key->hi = request_hash(SEED_HI, config, messages, message_count);
+    key->lo = request_hash(SEED_LO, config, messages, message_count);
+    return true;
+}
+// }}}
+
+// {{{ llm_memo_get
+LLMResponse* llm_memo_get(const LLMMemoKey* key) {
+    if (key == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&memo_lock);
+    if (!ready) {
+        pthread_mutex_unlock(&memo_lock);
+        return NULL;
+    }
+
+    stats.lookups++;
+    MemoEntry* e = find_entry(key);
+    LLMResponse* response = NULL;
+    if (e != NULL) {
+        response = llm_response_create_error(NULL);
+        if (response != NULL) {
+            response->text = strdup(e->text);
+            response->success = response->text != NULL;
+            response->http_status = 200;
+        }
+        stats.hits++;
+        stats.tokens_saved += e->tokens;
+        lru_unlink(e);
+        lru_push(e);
+    } else {
+        stats.misses++;
+    }
+    pthread_mutex_unlock(&memo_lock);
+    return response;
+}
+// }}}
+
+// {{{ llm_memo_put
+void llm_memo_put(const LLMMemoKey* key, const LLMResponse* response) {
+    if (key == NULL || response == NULL || !response->success ||
+        response->text == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&memo_lock);
+    if (ready && insert_entry(key, response->text, response->tokens_used)) {
+        stats.stored++;
+    }
+    pthread_mutex_unlock(&memo_lock);
+}
+// }}}
+
+// {{{ llm_memo_save
+bool llm_memo_save(void) {
+    pthread_mutex_lock(&memo_lock);
+    bool ok = ready && write_snapshot();
+    pthread_mutex_unlock(&memo_lock);
+    return ok;
+}
+// }}}
+
+// {{{ llm_memo_clear
+void llm_memo_clear(void) {
+    pthread_mutex_lock(&memo_lock);
+    if (ready) {
+        clear_entries();
+    }
+    pthread_mutex_unlock(&memo_lock);
+}
+// }}}
+
+// {{{ llm_memo_get_stats
+LLMMemoStats llm_memo_get_stats(void) {
+    pthread_mutex_lock(&memo_lock);
+    LLMMemoStats snapshot = stats;
+    pthread_mutex_unlock(&memo_lock);
+
+    snapshot.hit_rate = snapshot.lookups > 0
+                        ? (float)snapshot.hits / snapshot.lookups : 0.0f;
+    return snapshot;
+}
+// }}}
+
+// {{{ llm_memo_reset_stats
+void llm_memo_reset_stats(void) {
+    pthread_mutex_lock(&memo_lock);
+    int entries = stats.entries;
+    size_t bytes = stats.bytes;
+    memset(&stats, 0, sizeof(stats));
+    stats.entries = entries;
+    stats.bytes = bytes;
+    pthread_mutex_unlock(&memo_lock);
+}
+// }}}
@@ -0,0 +1,129 @@
+/*
+ * 21-response-memo.h - Exact-Prompt Response Memoization
+ *
+ * A process-wide, content-addressed cache of model replies consulted
+ * by llm_request_messages and llm_request_async, and so by everything
+ * sent through the scheduler. The key is a 128-bit hash of the model, the
+ * sampling temperature and every message's role and content, so only
+ * byte-identical requests share a reply (the endpoint is left out:
+ * every server of a pool runs the same model). Coherence recovery,
+ * trade selection and force descriptions repeat whole prompts often
+ * enough for this to save real model time on top of the event-level
+ * narrative cache.
+ *
+ * A reply is only reused when the request is deterministic: a config
+ * whose temperature is above zero, or left to the server (< 0), is
+ * passed through unless it sets memoize_sampled. Only successful
+ * replies are stored. Streaming requests are not memoized.
+ *
+ * Memory is bounded by entry count and bytes, evicting the least
+ * recently used reply. With a path, the memo is loaded at init and
+ * written back by llm_memo_save and at cleanup, so a restarted server
+ * keeps its replies.
+ *
+ * Snapshot format: a "LLMMEMO 1" line, then one record per reply from
+ * least to most recently used:
+ *   <hash hi> <hash lo> <tokens> <text_len>\n<text>\n
+ * Loading stops at the first malformed record.
+ */
+
+#ifndef LLM_RESPONSE_MEMO_H
+#define LLM_RESPONSE_MEMO_H
+
+#include "01-api-client.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LLM_MEMO_DEFAULT_MAX_ENTRIES 1024
+
+// {{{ LLMMemoConfig
+typedef struct {
+    int max_entries;         // Replies kept (<= 0 = default)
+    size_t max_bytes;        // Memory budget (0 = bounded by max_entries only)
+    const char* path;        // Snapshot file; NULL or "" keeps it in memory
+} LLMMemoConfig;
+// }}}
+
+// {{{ LLMMemoKey
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} LLMMemoKey;
+// }}}
+
+// {{{ LLMMemoStats
+// Counters since init or the last llm_memo_reset_stats.
+typedef struct {
+    int entries;             // Replies held now
+    size_t bytes;            // Memory they are charged
+    int lookups;             // Deterministic requests checked
+    int hits;                // Served from the memo
+    int misses;
+    int bypassed;            // Sampled requests passed straight through
+    int stored;
+    int evictions;
+    int loaded;              // Replies restored by init
+    long tokens_saved;       // Upstream tokens the hits would have cost
+    float hit_rate;          // hits / lookups (0.0-1.0)
+} LLMMemoStats;
+// }}}
+
+// {{{ llm_memo_init
+// Creates the memo and, if config->path names a snapshot, loads it.
+// config may be NULL for an in-memory memo with the defaults.
+// Must not race with other llm_memo calls. Returns false on invalid
+// config or allocation failure; a missing snapshot is not an error.
+bool llm_memo_init(const LLMMemoConfig* config);
+// }}}
+
+// {{{ llm_memo_cleanup
+// Writes the snapshot (if a path was given) and frees the memo.
+// Must not race with other llm_memo calls.
+void llm_memo_cleanup(void);
+// }}}
+
+// {{{ llm_memo_is_ready
+bool llm_memo_is_ready(void);
+// }}}
+
+// {{{ llm_memo_key
+// Computes the key for a request. Returns false, counting a bypass,
+// if the memo is not initialized or the request is sampled.
+bool llm_memo_key(const LLMConfig* config, const LLMMessage* messages,
+                  size_t message_count, LLMMemoKey* key);
+// }}}
+
+// {{{ llm_memo_get
+// Returns a copy of the memoized reply for key, or NULL. A hit's
+// tokens_used is 0: no upstream tokens were spent on it.
+// Caller must free the response with llm_response_free.
+LLMResponse* llm_memo_get(const LLMMemoKey* key);
+// }}}
+
+// {{{ llm_memo_put
+// Stores a successful reply under key; anything else is ignored.
+void llm_memo_put(const LLMMemoKey* key, const LLMResponse* response);
+// }}}
+
+// {{{ llm_memo_save
+// Writes the snapshot now (atomically, through a temporary file).
+// Returns false without a path or if the file cannot be written.
+bool llm_memo_save(void);
+// }}}
+
+// {{{ llm_memo_clear
+// Drops every reply; counters are kept.
+void llm_memo_clear(void);
+// }}}
+
+// {{{ llm_memo_get_stats
+LLMMemoStats llm_memo_get_stats(void);
+// }}}
+
+// {{{ llm_memo_reset_stats
+// Zeroes the counters (entries and bytes are preserved).
+void llm_memo_reset_stats(void);
+// }}}
+
+#endif /* LLM_RESPONSE_MEMO_H */
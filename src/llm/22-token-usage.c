@@ -0,0 +1,297 @@
+/*
+ * 22-token-usage.c - Token Accounting and Session Budgets Implementation
+ *
+ * Sessions live in a list under one lock, most recently created first.
+ * A game server holds a few dozen sessions at most, and each record is
+ * a short walk, so nothing faster is needed. Levels are not stored:
+ * they follow from the tokens used and the budget whenever asked.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "22-token-usage.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_REDUCE_AT 0.6f
+#define DEFAULT_MINIMAL_AT 0.85f
+
+// {{{ SessionUsage
+typedef struct SessionUsage {
+    const void* session;
+    LLMUsageCounts total;
+    long class_tokens[LLM_CLASS_COUNT];
+    long budget;                 // < 0 = the configured session_budget
+    struct SessionUsage* next;
+} SessionUsage;
+// }}}
+
+// {{{ Usage
+static struct {
+    pthread_mutex_t lock;
+    bool running;
+    LLMUsageConfig config;
+    LLMUsageCounts total;
+    LLMUsageCounts classes[LLM_CLASS_COUNT];
+    SessionUsage* sessions;
+    int session_count;
+} usage = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+// }}}
+
+// {{{ find_session
+// Returns the record for session, creating it if asked. Caller holds
+// usage.lock.
+static SessionUsage* find_session(const void* session, bool create) {
+    for (SessionUsage* s = usage.sessions; s != NULL; s = s->next) {
+        if (s->session == session) {
+            return s;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    SessionUsage* s = calloc(1, sizeof(SessionUsage));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->session = session;
+    s->budget = -1;
+    s->next = usage.sessions;
+    usage.sessions = s;
+    usage.session_count++;
+    return s;
+}
+// }}}
+
+// {{{ effective_budget
+// Caller holds usage.lock.
+static long effective_budget(const SessionUsage* s) {
+    return s->budget >= 0 ? s->budget : usage.config.session_budget;
+}
+// }}}
+
+// {{{ share_of
+// Tokens in share of budget, rounded so 0.6 of 1000 is exactly 600.
+static long share_of(long budget, float share) {
+    return (long)((double)budget * share + 0.5);
+}
+// }}}
+
+// {{{ session_level
+// Caller holds usage.lock.
+static LLMUsageLevel session_level(const SessionUsage* s) {
+    long budget = effective_budget(s);
+    if (budget <= 0) {
+        return LLM_USAGE_NORMAL;
+    }
+
+    long used = s->total.tokens;
+    if (used >= budget) {
+        return LLM_USAGE_EXHAUSTED;
+    }
+    if (used >= share_of(budget, usage.config.minimal_at)) {
+        return LLM_USAGE_MINIMAL;
+    }
+    if (used >= share_of(budget, usage.config.reduce_at)) {
+        return LLM_USAGE_REDUCED;
+    }
+    return LLM_USAGE_NORMAL;
+}
+// }}}
+
+// {{{ add_counts
+static void add_counts(LLMUsageCounts* counts, bool failed, long tokens) {
+    counts->requests++;
+    if (failed) {
+        counts->failures++;
+    }
+    counts->tokens += tokens;
+}
+// }}}
+
+// {{{ llm_usage_init
+bool llm_usage_init(const LLMUsageConfig* config) {
+    pthread_mutex_lock(&usage.lock);
+    if (usage.running) {
+        pthread_mutex_unlock(&usage.lock);
+        return false;
+    }
+
+    memset(&usage.config, 0, sizeof(usage.config));
+    if (config != NULL) {
+        usage.config = *config;
+    }
+    if (usage.config.session_budget < 0) {
+        usage.config.session_budget = 0;
+    }
+    if (usage.config.reduce_at <= 0.0f) {
+        usage.config.reduce_at = DEFAULT_REDUCE_AT;
+    }
+    if (usage.config.minimal_at <= 0.0f) {
+        usage.config.minimal_at = DEFAULT_MINIMAL_AT;
+    }
+    if (usage.config.minimal_at < usage.config.reduce_at) {
+        usage.config.minimal_at = usage.config.reduce_at;
+    }
+
+    memset(&usage.total, 0, sizeof(usage.total));
+    memset(usage.classes, 0, sizeof(usage.classes));
+    usage.running = true;
+    pthread_mutex_unlock(&usage.lock);
+    return true;
+}
+// }}}
+
+// {{{ llm_usage_cleanup
+void llm_usage_cleanup(void) {
+    pthread_mutex_lock(&usage.lock);
+    usage.running = false;
+    while (usage.sessions != NULL) {
+        SessionUsage* next = usage.sessions->next;
+        free(usage.sessions);
+        usage.sessions = next;
+    }
+    usage.session_count = 0;
+    pthread_mutex_unlock(&usage.lock);
+}
+// }}}
+
+// {{{ llm_usage_running
+bool llm_usage_running(void) {
+    pthread_mutex_lock(&usage.lock);
+    bool running = usage.running;
+    pthread_mutex_unlock(&usage.lock);
+    return running;
+}
+// }}}
+
+// {{{ llm_usage_record
+void llm_usage_record(const void* session, LLMRequestClass request_class,
+                      const LLMResponse* response) {
+    if (request_class < 0 || request_class >= LLM_CLASS_COUNT) {
+        return;
+    }
+
+    bool failed = response == NULL || !response->success;
+    long tokens = response != NULL && response->tokens_used > 0
+                  ? response->tokens_used : 0;
+
+    pthread_mutex_lock(&usage.lock);
+    if (usage.running) {
+        add_counts(&usage.total, failed, tokens);
+        add_counts(&usage.classes[request_class], failed, tokens);
+        SessionUsage* s = session != NULL ? find_session(session, true) : NULL;
+        if (s != NULL) {
+            add_counts(&s->total, failed, tokens);
+            s->class_tokens[request_class] += tokens;
+        }
+    }
+    pthread_mutex_unlock(&usage.lock);
+}
+// }}}
+
+// {{{ llm_usage_set_budget
+bool llm_usage_set_budget(const void* session, long budget) {
+    if (session == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&usage.lock);
+    SessionUsage* s = usage.running ? find_session(session, true) : NULL;
+    if (s != NULL) {
+        s->budget = budget < 0 ? -1 : budget;
+    }
+    pthread_mutex_unlock(&usage.lock);
+    return s != NULL;
+}
+// }}}
+
+// {{{ llm_usage_level
+LLMUsageLevel llm_usage_level(const void* session) {
+    if (session == NULL) {
+        return LLM_USAGE_NORMAL;
+    }
+
+    pthread_mutex_lock(&usage.lock);
+    LLMUsageLevel level = LLM_USAGE_NORMAL;
+    SessionUsage* s = usage.running ? find_session(session, false) : NULL;
+    if (s != NULL) {
+        level = session_level(s);
+    }
+    pthread_mutex_unlock(&usage.lock);
+    return level;
+}
+// }}}
+
+// {{{ llm_usage_get_session
+LLMSessionUsage llm_usage_get_session(const void* session) {
+    LLMSessionUsage result;
+    memset(&result, 0, sizeof(result));
+
+    pthread_mutex_lock(&usage.lock);
+    if (usage.running) {
+        result.budget = usage.config.session_budget;
+        SessionUsage* s = session != NULL ? find_session(session, false) : NULL;
+        if (s != NULL) {
+            result.total = s->total;
+            memcpy(result.class_tokens, s->class_tokens, sizeof(result.class_tokens));
+            result.budget = effective_budget(s);
+            result.level = session_level(s);
+        }
+    }
+    pthread_mutex_unlock(&usage.lock);
+    return result;
+}
+// }}}
+
+// {{{ llm_usage_end_session
+void llm_usage_end_session(const void* session) {
+    pthread_mutex_lock(&usage.lock);
+    SessionUsage** link = &usage.sessions;
+    while (*link != NULL && (*link)->session != session) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        SessionUsage* s = *link;
+        *link = s->next;
+        free(s);
+        usage.session_count--;
+    }
+    pthread_mutex_unlock(&usage.lock);
+}
+// }}}
+
+// {{{ llm_usage_get_stats
+LLMUsageStats llm_usage_get_stats(void) {
+    LLMUsageStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    pthread_mutex_lock(&usage.lock);
+    stats.total = usage.total;
+    memcpy(stats.classes, usage.classes, sizeof(stats.classes));
+    stats.sessions = usage.session_count;
+    for (SessionUsage* s = usage.sessions; s != NULL; s = s->next) {
+        if (session_level(s) != LLM_USAGE_NORMAL) {
+            stats.sessions_limited++;
+        }
+    }
+    pthread_mutex_unlock(&usage.lock);
+    return stats;
+}
+// }}}
+
+// {{{ llm_usage_level_name
+const char* llm_usage_level_name(LLMUsageLevel level) {
+    switch (level) {
+        case LLM_USAGE_NORMAL: return "normal";
+        case LLM_USAGE_REDUCED: return "reduced";
+        case LLM_USAGE_MINIMAL: return "minimal";
+        case LLM_USAGE_EXHAUSTED: return "exhausted";
+        default: return "unknown";
+    }
+}
+// }}}
@@ -0,0 +1,132 @@
+/*
+ * 22-token-usage.h - Token Accounting and Session Budgets
+ *
+ * Adds up the tokens the model reports (LLMResponse.tokens_used) per
+ * session and per request class. The scheduler records every request
+ * it completes under the session and class it was queued with; the
+ * endpoint pool keeps the per-endpoint totals (LLMEndpointStats.tokens).
+ * Replies served from the response memo cost nothing and count as 0.
+ *
+ * A session may have a token budget. As the budget is used up, the
+ * session's level steps down and the narration batcher spends less:
+ *   NORMAL     below reduce_at of the budget: narrate as usual
+ *   REDUCED    batches run across turn ends, only medium intensity
+ *              events and up go to the model, and replies are memoized
+ *              even when sampled
+ *   MINIMAL    from minimal_at: only high and epic events go to the model
+ *   EXHAUSTED  budget spent: every event is narrated locally
+ * Events kept from the model get their local narration
+ * (event_narration_build_local). Requests already sent are never cut
+ * off, so a session may overshoot its budget by those in flight.
+ *
+ * With a budget per session, operators can hold the total model load
+ * of many concurrent games within a fixed capacity: each game narrates
+ * fully while it is cheap and degrades gracefully as it grows costly.
+ */
+
+#ifndef LLM_TOKEN_USAGE_H
+#define LLM_TOKEN_USAGE_H
+
+#include "01-api-client.h"
+#include "16-scheduler.h"
+#include <stdbool.h>
+
+// {{{ LLMUsageLevel
+// How much a session may still spend, most generous first.
+typedef enum {
+    LLM_USAGE_NORMAL,
+    LLM_USAGE_REDUCED,
+    LLM_USAGE_MINIMAL,
+    LLM_USAGE_EXHAUSTED
+} LLMUsageLevel;
+// }}}
+
+// {{{ LLMUsageConfig
+typedef struct {
+    long session_budget;         // Tokens per session; 0 = unlimited
+    float reduce_at;             // Budget share that reduces narration (default 0.6)
+    float minimal_at;            // Budget share that keeps only dramatic
+                                 // events (default 0.85)
+} LLMUsageConfig;
+// }}}
+
+// {{{ LLMUsageCounts
+typedef struct {
+    int requests;                // Requests completed
+    int failures;                // Of which failed
+    long tokens;                 // Tokens reported
+} LLMUsageCounts;
+// }}}
+
+// {{{ LLMSessionUsage
+typedef struct {
+    LLMUsageCounts total;
+    long class_tokens[LLM_CLASS_COUNT];
+    long budget;                 // 0 = unlimited
+    LLMUsageLevel level;
+} LLMSessionUsage;
+// }}}
+
+// {{{ LLMUsageStats
+// Counters since llm_usage_init.
+typedef struct {
+    LLMUsageCounts total;        // Every request, with or without a session
+    LLMUsageCounts classes[LLM_CLASS_COUNT];
+    int sessions;                // Sessions tracked now
+    int sessions_limited;        // Of which below LLM_USAGE_NORMAL
+} LLMUsageStats;
+// }}}
+
+// {{{ llm_usage_init
+// Starts accounting. config may be NULL for no budgets; fields <= 0
+// take their default. Returns false if already running.
+bool llm_usage_init(const LLMUsageConfig* config);
+// }}}
+
+// {{{ llm_usage_cleanup
+// Stops accounting and forgets every session.
+void llm_usage_cleanup(void);
+// }}}
+
+// {{{ llm_usage_running
+bool llm_usage_running(void);
+// }}}
+
+// {{{ llm_usage_record
+// Adds a finished request to its session (may be NULL) and class.
+// Does nothing unless accounting is running.
+void llm_usage_record(const void* session, LLMRequestClass request_class,
+                      const LLMResponse* response);
+// }}}
+
+// {{{ llm_usage_set_budget
+// Gives session its own budget in place of session_budget (0 =
+// unlimited, < 0 = back to the default). Returns false if accounting
+// is not running or session is NULL.
+bool llm_usage_set_budget(const void* session, long budget);
+// }}}
+
+// {{{ llm_usage_level
+// Current level of session. LLM_USAGE_NORMAL without accounting, for
+// a NULL session and for sessions without a budget.
+LLMUsageLevel llm_usage_level(const void* session);
+// }}}
+
+// {{{ llm_usage_get_session
+LLMSessionUsage llm_usage_get_session(const void* session);
+// }}}
+
+// {{{ llm_usage_end_session
+// Forgets session, e.g. when its game ends. Totals are kept.
+void llm_usage_end_session(const void* session);
+// }}}
+
+// {{{ llm_usage_get_stats
+LLMUsageStats llm_usage_get_stats(void);
+// }}}
+
+// {{{ llm_usage_level_name
+const char* llm_usage_level_name(LLMUsageLevel level);
+// }}}
+
+#endif /* LLM_TOKEN_USAGE_H */
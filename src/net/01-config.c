@@ -24,10 +24,22 @@
 #define DEFAULT_LLM_MODEL "llama3"
 #define DEFAULT_LLM_TIMEOUT_MS 30000
 #define DEFAULT_LLM_MAX_RETRIES 3
+#define DEFAULT_LLM_TOKENIZER_DIR "data/tokenizers"
+#define DEFAULT_LLM_MAX_IN_FLIGHT 4
+#define DEFAULT_LLM_TRADE_SELECT_BUDGET_MS 150
+#define DEFAULT_LLM_CACHE_SLOTS 0
+#define DEFAULT_LLM_ENDPOINT_WEIGHT 1
+#define DEFAULT_LLM_EJECT_FAILURES 3
+#define DEFAULT_LLM_EJECT_MS 10000
 #define DEFAULT_COMFYUI_ENDPOINT "localhost"
 #define DEFAULT_COMFYUI_PORT 8188
 #define DEFAULT_COMFYUI_TIMEOUT_MS 60000
 #define DEFAULT_COMFYUI_POLL_INTERVAL_MS 500
+#define DEFAULT_HTTP_MAX_CONNECTIONS_PER_HOST 4
+#define DEFAULT_HTTP_IDLE_TIMEOUT_MS 60000
+#define DEFAULT_NARRATIVE_CACHE_PATH "data/narrative-cache.log"
+#define DEFAULT_NARRATIVE_CACHE_MAX_ENTRIES 4096
+#define DEFAULT_NARRATIVE_CACHE_TTL_SECONDS 604800
 #define DEFAULT_MAX_PLAYERS 4
 #define DEFAULT_MAX_SESSIONS 10
 #define DEFAULT_STARTING_AUTHORITY 50
@@ -87,6 +99,14 @@ void config_set_defaults(ServerConfig* config) {
     config->llm_model = strdup_safe(DEFAULT_LLM_MODEL);
     config->llm_timeout_ms = DEFAULT_LLM_TIMEOUT_MS;
     config->llm_max_retries = DEFAULT_LLM_MAX_RETRIES;
+    config->llm_tokenizer_dir = strdup_safe(DEFAULT_LLM_TOKENIZER_DIR);
+    config->llm_max_in_flight = DEFAULT_LLM_MAX_IN_FLIGHT;
+    config->llm_trade_select_budget_ms = DEFAULT_LLM_TRADE_SELECT_BUDGET_MS;
+    config->llm_cache_slots = DEFAULT_LLM_CACHE_SLOTS;
+    config->llm_endpoints = NULL;
+    config->llm_endpoint_count = 0;
+    config->llm_eject_failures = DEFAULT_LLM_EJECT_FAILURES;
+    config->llm_eject_ms = DEFAULT_LLM_EJECT_MS;
 
     // ComfyUI defaults
     config->comfyui_endpoint = strdup_safe(DEFAULT_COMFYUI_ENDPOINT);
@@ -94,6 +114,15 @@ void config_set_defaults(ServerConfig* config) {
     config->comfyui_timeout_ms = DEFAULT_COMFYUI_TIMEOUT_MS;
     config->comfyui_poll_interval_ms = DEFAULT_COMFYUI_POLL_INTERVAL_MS;
 
+    // Outbound connection pool defaults
+    config->http_max_connections_per_host = DEFAULT_HTTP_MAX_CONNECTIONS_PER_HOST;
+    config->http_idle_timeout_ms = DEFAULT_HTTP_IDLE_TIMEOUT_MS;
+
+    // Shared narrative cache defaults
+    config->narrative_cache_path = strdup_safe(DEFAULT_NARRATIVE_CACHE_PATH);
+    config->narrative_cache_max_entries = DEFAULT_NARRATIVE_CACHE_MAX_ENTRIES;
+    config->narrative_cache_ttl_seconds = DEFAULT_NARRATIVE_CACHE_TTL_SECONDS;
+
     // Server limits
     config->max_players = DEFAULT_MAX_PLAYERS;
     config->max_sessions = DEFAULT_MAX_SESSIONS;
@@ -137,6 +166,49 @@ static void parse_game_rules(cJSON* rules_json, GameRules* rules) {
 }
 // }}}
 
+// {{{ parse_llm_endpoints
+// Parses the llm_endpoints array. Entries without a url are skipped.
+static void parse_llm_endpoints(cJSON* array, ServerConfig* config) {
+    if (array == NULL || !cJSON_IsArray(array)) {
+        return;
+    }
+
+    int size = cJSON_GetArraySize(array);
+    if (size == 0) {
+        return;
+    }
+    config->llm_endpoints = calloc(size, sizeof(LLMEndpointEntry));
+    if (config->llm_endpoints == NULL) {
+        return;
+    }
+
+    cJSON* entry;
+    cJSON_ArrayForEach(entry, array) {
+        cJSON* url = cJSON_GetObjectItem(entry, "url");
+        if (url == NULL || !cJSON_IsString(url)) {
+            continue;
+        }
+
+        LLMEndpointEntry* e = &config->llm_endpoints[config->llm_endpoint_count];
+        e->url = strdup_safe(url->valuestring);
+        e->weight = DEFAULT_LLM_ENDPOINT_WEIGHT;
+        e->max_concurrent = 0;
+
+        cJSON* item = cJSON_GetObjectItem(entry, "weight");
+        if (item != NULL && cJSON_IsNumber(item)) {
+            e->weight = item->valueint;
+        }
+
+        item = cJSON_GetObjectItem(entry, "max_concurrent");
+        if (item != NULL && cJSON_IsNumber(item)) {
+            e->max_concurrent = item->valueint;
+        }
+
+        config->llm_endpoint_count++;
+    }
+}
+// }}}
+
 // {{{ config_load
 ServerConfig* config_load(const char* path) {
     ServerConfig* config = malloc(sizeof(ServerConfig));
@@ -210,6 +282,39 @@ ServerConfig* config_load(const char* path) {
         config->llm_max_retries = item->valueint;
     }
 
+    item = cJSON_GetObjectItem(json, "llm_tokenizer_dir");
+    if (item != NULL && cJSON_IsString(item)) {
+        free(config->llm_tokenizer_dir);
+        config->llm_tokenizer_dir = strdup_safe(item->valuestring);
+    }
+
+    item = cJSON_GetObjectItem(json, "llm_max_in_flight");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->llm_max_in_flight = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, "llm_trade_select_budget_ms");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->llm_trade_select_budget_ms = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, "llm_cache_slots");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->llm_cache_slots = item->valueint;
+    }
+
+    parse_llm_endpoints(cJSON_GetObjectItem(json, "llm_endpoints"), config);
+
+    item = cJSON_GetObjectItem(json, "llm_eject_failures");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->llm_eject_failures = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, "llm_eject_ms");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->llm_eject_ms = item->valueint;
+    }
+
     // Parse ComfyUI settings
     item = cJSON_GetObjectItem(json, "comfyui_endpoint");
     if (item != NULL && cJSON_IsString(item)) {
@@ -232,6 +337,34 @@ ServerConfig* config_load(const char* path) {
         config->comfyui_poll_interval_ms = item->valueint;
     }
 
+    // Parse outbound connection pool settings
+    item = cJSON_GetObjectItem(json, "http_max_connections_per_host");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->http_max_connections_per_host = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, "http_idle_timeout_ms");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->http_idle_timeout_ms = item->valueint;
+    }
+
+    // Parse shared narrative cache settings
+    item = cJSON_GetObjectItem(json, "narrative_cache_path");
+    if (item != NULL && cJSON_IsString(item)) {
+        free(config->narrative_cache_path);
+        config->narrative_cache_path = strdup_safe(item->valuestring);
+    }
+
+    item = cJSON_GetObjectItem(json, "narrative_cache_max_entries");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->narrative_cache_max_entries = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, "narrative_cache_ttl_seconds");
+    if (item != NULL && cJSON_IsNumber(item)) {
+        config->narrative_cache_ttl_seconds = item->valueint;
+    }
+
     // Parse server limits
     item = cJSON_GetObjectItem(json, "max_players");
     if (item != NULL && cJSON_IsNumber(item)) {
@@ -261,7 +394,13 @@ void config_free(ServerConfig* config) {
     free(config->llm_endpoint);
     free(config->llm_api_key);
     free(config->llm_model);
+    free(config->llm_tokenizer_dir);
+    for (int i = 0; i < config->llm_endpoint_count; i++) {
+        free(config->llm_endpoints[i].url);
+    }
+    free(config->llm_endpoints);
     free(config->comfyui_endpoint);
+    free(config->narrative_cache_path);
     free(config);
 }
 // }}}
@@ -305,6 +444,84 @@ bool config_validate(const ServerConfig* config, char** error_msg) {
         return false;
     }
 
+    if (config->llm_max_in_flight < 1) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("llm_max_in_flight must be at least 1");
+        }
+        return false;
+    }
+
+    if (config->llm_trade_select_budget_ms < 0) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("llm_trade_select_budget_ms must be non-negative");
+        }
+        return false;
+    }
+
+    if (config->llm_cache_slots < 0) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("llm_cache_slots must be non-negative");
+        }
+        return false;
+    }
+
+    for (int i = 0; i < config->llm_endpoint_count; i++) {
+        if (config->llm_endpoints[i].weight < 1) {
+            if (error_msg != NULL) {
+                *error_msg = strdup("llm_endpoints weight must be at least 1");
+            }
+            return false;
+        }
+        if (config->llm_endpoints[i].max_concurrent < 0) {
+            if (error_msg != NULL) {
+                *error_msg = strdup("llm_endpoints max_concurrent must be non-negative");
+            }
+            return false;
+        }
+    }
+
+    if (config->llm_eject_failures < 1) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("llm_eject_failures must be at least 1");
+        }
+        return false;
+    }
+
+    if (config->llm_eject_ms < 1) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("llm_eject_ms must be at least 1");
+        }
+        return false;
+    }
+
+    if (config->http_max_connections_per_host < 1) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("http_max_connections_per_host must be at least 1");
+        }
+        return false;
+    }
+
+    if (config->http_idle_timeout_ms < 0) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("http_idle_timeout_ms must be non-negative");
+        }
+        return false;
+    }
+
+    if (config->narrative_cache_max_entries < 1) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("narrative_cache_max_entries must be at least 1");
+        }
+        return false;
+    }
+
+    if (config->narrative_cache_ttl_seconds < 0) {
+        if (error_msg != NULL) {
+            *error_msg = strdup("narrative_cache_ttl_seconds must be non-negative");
+        }
+        return false;
+    }
+
     // Validate game rules
     if (config->game_rules.starting_authority < 1) {
         if (error_msg != NULL) {
@@ -327,29 +544,48 @@ bool config_validate(const ServerConfig* config, char** error_msg) {
 }
 // }}}
 
-// {{{ config_get_llm_endpoint
-char* config_get_llm_endpoint(const ServerConfig* config) {
-    if (config == NULL || config->llm_endpoint == NULL) {
+// {{{ format_http_url
+// Prefixes endpoint with http:// unless it already has a protocol.
+static char* format_http_url(const char* endpoint) {
+    if (endpoint == NULL) {
         return NULL;
     }
 
     // Check if endpoint already contains protocol
-    if (strncmp(config->llm_endpoint, "http://", 7) == 0 ||
-        strncmp(config->llm_endpoint, "https://", 8) == 0) {
-        return strdup(config->llm_endpoint);
+    if (strncmp(endpoint, "http://", 7) == 0 ||
+        strncmp(endpoint, "https://", 8) == 0) {
+        return strdup(endpoint);
     }
 
     // Format as http://endpoint
-    size_t len = strlen("http://") + strlen(config->llm_endpoint) + 1;
+    size_t len = strlen("http://") + strlen(endpoint) + 1;
     char* url = malloc(len);
     if (url == NULL) {
         return NULL;
     }
-    snprintf(url, len, "http://%s", config->llm_endpoint);
+    snprintf(url, len, "http://%s", endpoint);
     return url;
 }
 // }}}
 
+// {{{ config_get_llm_endpoint
+char* config_get_llm_endpoint(const ServerConfig* config) {
+    if (config == NULL) {
+        return NULL;
+    }
+    return format_http_url(config->llm_endpoint);
+}
+// }}}
+
+// {{{ config_get_llm_endpoint_at
+char* config_get_llm_endpoint_at(const ServerConfig* config, int index) {
+    if (config == NULL || index < 0 || index >= config->llm_endpoint_count) {
+        return NULL;
+    }
+    return format_http_url(config->llm_endpoints[index].url);
+}
+// }}}
+
 // {{{ config_get_comfyui_endpoint
 char* config_get_comfyui_endpoint(const ServerConfig* config) {
     if (config == NULL || config->comfyui_endpoint == NULL) {
@@ -20,6 +20,15 @@ typedef struct {
 } GameRules;
 // }}}
 
+// {{{ LLMEndpointEntry
+// One model server to balance narration over (see llm/19-endpoint-pool).
+typedef struct {
+    char* url;                       // host:port or http(s)://host:port
+    int weight;                      // Share of the work (default 1)
+    int max_concurrent;              // Server slots; 0 = unlimited
+} LLMEndpointEntry;
+// }}}
+
 // {{{ ServerConfig
 typedef struct {
     // Network settings
@@ -32,6 +41,14 @@ typedef struct {
     char* llm_model;
     int llm_timeout_ms;
     int llm_max_retries;
+    char* llm_tokenizer_dir;         // Holds <llm_model>.tiktoken (see llm/14-tokenizer)
+    int llm_max_in_flight;           // Scheduler limit; match the model server's slots
+    int llm_trade_select_budget_ms;  // Longest a trade row refill waits for the DM model
+    int llm_cache_slots;             // Server slots to pin games to (llm_config_for_session); 0 = off
+    LLMEndpointEntry* llm_endpoints; // Servers to balance over; none = llm_endpoint alone
+    int llm_endpoint_count;
+    int llm_eject_failures;          // Consecutive failures that take an endpoint out
+    int llm_eject_ms;                // First ejection length; doubles on repeats
 
     // ComfyUI settings
     char* comfyui_endpoint;
@@ -39,6 +56,15 @@ typedef struct {
     int comfyui_timeout_ms;
     int comfyui_poll_interval_ms;
 
+    // Outbound HTTP connection pool (LLM and ComfyUI)
+    int http_max_connections_per_host;
+    int http_idle_timeout_ms;
+
+    // Shared narrative cache (see llm/12-shared-cache)
+    char* narrative_cache_path;      // Append-only log; NULL or "" = memory only
+    int narrative_cache_max_entries;
+    int narrative_cache_ttl_seconds; // 0 = no expiration
+
     // Server limits
     int max_players;
     int max_sessions;
@@ -76,6 +102,12 @@ bool config_validate(const ServerConfig* config, char** error_msg);
 char* config_get_llm_endpoint(const ServerConfig* config);
 // }}}
 
+// {{{ config_get_llm_endpoint_at
+// Returns the formatted URL of llm_endpoints[index], or NULL if out of
+// range. Caller must free returned string.
+char* config_get_llm_endpoint_at(const ServerConfig* config, int index);
+// }}}
+
 // {{{ config_get_comfyui_endpoint
 // Returns formatted ComfyUI endpoint URL.
 // Caller must free returned string.
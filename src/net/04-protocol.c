@@ -34,7 +34,8 @@ static const char* MESSAGE_TYPE_STRINGS[] = {
     [MSG_PLAYER_LEFT] = "player_left",
     [MSG_DRAW_ORDER_REQUEST] = "draw_order_request",
     [MSG_CHOICE_REQUEST] = "choice_request",
-    [MSG_GAME_OVER] = "game_over"
+    [MSG_GAME_OVER] = "game_over",
+    [MSG_IMAGE_PROGRESS] = "image_progress"
 };
 /* }}} */
 
@@ -370,6 +371,21 @@ Message* protocol_create_narrative(const char* text) {
 }
 /* }}} */
 
+/* {{{ protocol_create_narrative_chunk */
+Message* protocol_create_narrative_chunk(int stream_id, int sequence,
+                                         const char* text, bool final) {
+    Message* msg = message_create(MSG_NARRATIVE);
+    if (!msg) return NULL;
+
+    cJSON_AddStringToObject(msg->payload, "text", text ? text : "");
+    cJSON_AddNumberToObject(msg->payload, "stream_id", stream_id);
+    cJSON_AddNumberToObject(msg->payload, "seq", sequence);
+    cJSON_AddBoolToObject(msg->payload, "final", final);
+
+    return msg;
+}
+/* }}} */
+
 /* {{{ protocol_create_error */
 Message* protocol_create_error(ProtocolError error, const char* details) {
     Message* msg = message_create(MSG_ERROR);
@@ -451,6 +467,21 @@ Message* protocol_create_game_over(int winner_id, const char* reason) {
 }
 /* }}} */
 
+/* {{{ protocol_create_image_progress */
+Message* protocol_create_image_progress(const char* image_id, int percent) {
+    Message* msg = message_create(MSG_IMAGE_PROGRESS);
+    if (!msg) return NULL;
+
+    if (image_id) {
+        cJSON_AddStringToObject(msg->payload, "image_id", image_id);
+    }
+    cJSON_AddNumberToObject(msg->payload, "percent",
+                            percent < 0 ? 0 : percent > 100 ? 100 : percent);
+
+    return msg;
+}
+/* }}} */
+
 /* ========================================================================== */
 /*                         Client Message Handlers                            */
 /* ========================================================================== */
@@ -479,7 +510,8 @@ static MessageHandler CLIENT_HANDLERS[MSG_TYPE_COUNT] = {
     [MSG_PLAYER_LEFT] = NULL,
     [MSG_DRAW_ORDER_REQUEST] = NULL,
     [MSG_CHOICE_REQUEST] = NULL,
-    [MSG_GAME_OVER] = NULL
+    [MSG_GAME_OVER] = NULL,
+    [MSG_IMAGE_PROGRESS] = NULL
 };
 /* }}} */
 
@@ -49,6 +49,7 @@ typedef enum {
     MSG_DRAW_ORDER_REQUEST, /* Request draw order from player */
     MSG_CHOICE_REQUEST,     /* Request a choice (scrap, discard, etc.) */
     MSG_GAME_OVER,          /* Game has ended */
+    MSG_IMAGE_PROGRESS,     /* Progress of an image being generated */
 
     MSG_TYPE_COUNT          /* Sentinel for array sizing */
 } MessageType;
@@ -238,6 +239,16 @@ Message* protocol_create_gamestate(Game* game, int player_id);
 Message* protocol_create_narrative(const char* text);
 /* }}} */
 
+/* {{{ protocol_create_narrative_chunk
+ * Creates a MSG_NARRATIVE message carrying one piece of a streamed
+ * narration. Chunks of the same narration share stream_id and are
+ * numbered from 0 by sequence; the last one has final set (its text
+ * may be empty). Clients append chunk text until final arrives.
+ */
+Message* protocol_create_narrative_chunk(int stream_id, int sequence,
+                                         const char* text, bool final);
+/* }}} */
+
 /* {{{ protocol_create_error
  * Creates a MSG_ERROR message with code and description.
  */
@@ -275,6 +286,13 @@ Message* protocol_create_choice_request(ChoiceType type, cJSON* options);
 Message* protocol_create_game_over(int winner_id, const char* reason);
 /* }}} */
 
+/* {{{ protocol_create_image_progress
+ * Creates a MSG_IMAGE_PROGRESS message: image_id is generating and
+ * percent (0-100) done, as reported by the image server.
+ */
+Message* protocol_create_image_progress(const char* image_id, int percent);
+/* }}} */
+
 /* ========================================================================== */
 /*                         Client Message Handling                            */
 /* ========================================================================== */
@@ -356,6 +374,11 @@ ProtocolError protocol_dispatch(Game* game, int player_id,
  * MSG_NARRATIVE:
  *   {"type": "narrative", "text": "The dire bear charges..."}
  *
+ * MSG_NARRATIVE (streamed chunk):
+ *   {"type": "narrative", "text": "The dire", "stream_id": 3, "seq": 0, "final": false}
+ *   {"type": "narrative", "text": " bear charges...", "stream_id": 3, "seq": 1, "final": false}
+ *   {"type": "narrative", "text": "", "stream_id": 3, "seq": 2, "final": true}
+ *
  * MSG_ERROR:
  *   {"type": "error", "code": "not_your_turn", "message": "It's not your turn"}
  *
@@ -373,6 +396,9 @@ ProtocolError protocol_dispatch(Game* game, int player_id,
  *
  * MSG_GAME_OVER:
  *   {"type": "game_over", "winner_id": 0, "reason": "Player 2 has no authority"}
+ *
+ * MSG_IMAGE_PROGRESS:
+ *   {"type": "image_progress", "image_id": "card_dire_bear", "percent": 40}
  */
 
 #endif /* SYMBELINE_PROTOCOL_H */
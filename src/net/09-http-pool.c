@@ -0,0 +1,545 @@
+/* 09-http-pool.c - Outbound HTTP Connection Pool Implementation
+ *
+ * Endpoints live on a single list guarded by the pool lock. Each one
+ * tracks every handle it has created; idle handles keep their live
+ * connection, so the next transfer to the same host skips connection
+ * setup. A per-endpoint curl share object holds the DNS cache and TLS
+ * session IDs, which are safe to share across threads (libcurl does not
+ * support sharing the connection cache itself between threads).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "09-http-pool.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ========================================================================== */
+/*                              Type Definitions                               */
+/* ========================================================================== */
+
+/* {{{ PooledHandle */
+typedef struct PooledHandle {
+    CURL* easy;
+    bool in_use;
+    uint64_t idle_since_ms;         /* When the handle was last released */
+    struct PooledHandle* next;
+} PooledHandle;
+/* }}} */
+
+/* {{{ Endpoint */
+typedef struct Endpoint {
+    char* key;                      /* scheme://host:port */
+    CURLSH* share;
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+    PooledHandle* handles;
+    HttpPoolStats stats;
+    struct Endpoint* next;
+} Endpoint;
+/* }}} */
+
+/* {{{ Pool state */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_released = PTHREAD_COND_INITIALIZER;
+static Endpoint* endpoints = NULL;
+static int pool_users = 0;          /* References taken by http_pool_init */
+static HttpPoolConfig pool_config = {
+    HTTP_POOL_DEFAULT_MAX_PER_HOST,
+    HTTP_POOL_DEFAULT_IDLE_TIMEOUT_MS
+};
+/* }}} */
+
+/* ========================================================================== */
+/*                              Helpers                                        */
+/* ========================================================================== */
+
+/* {{{ now_ms */
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+/* }}} */
+
+/* {{{ endpoint_key
+ * Extracts "scheme://host:port" from url. Caller frees.
+ */
+static char* endpoint_key(const char* url) {
+    if (url == NULL || url[0] == '\0') {
+        return NULL;
+    }
+
+    const char* host = strstr(url, "://");
+    host = host != NULL ? host + 3 : url;
+
+    const char* end = strchr(host, '/');
+    size_t len = end != NULL ? (size_t)(end - url) : strlen(url);
+    if (len == (size_t)(host - url)) {
+        return NULL;
+    }
+
+    char* key = malloc(len + 1);
+    if (key == NULL) {
+        return NULL;
+    }
+    memcpy(key, url, len);
+    key[len] = '\0';
+    return key;
+}
+/* }}} */
+
+/* {{{ share_lock / share_unlock
+ * libcurl lock callbacks; one mutex per shared data kind.
+ */
+static void share_lock(CURL* handle, curl_lock_data data,
+                       curl_lock_access access, void* userptr) {
+    (void)handle;
+    (void)access;
+    Endpoint* ep = (Endpoint*)userptr;
+    pthread_mutex_lock(&ep->share_locks[data]);
+}
+
+static void share_unlock(CURL* handle, curl_lock_data data, void* userptr) {
+    (void)handle;
+    Endpoint* ep = (Endpoint*)userptr;
+    pthread_mutex_unlock(&ep->share_locks[data]);
+}
+/* }}} */
+
+/* {{{ endpoint_create */
+static Endpoint* endpoint_create(char* key) {
+    Endpoint* ep = calloc(1, sizeof(Endpoint));
+    if (ep == NULL) {
+        return NULL;
+    }
+
+    ep->share = curl_share_init();
+    if (ep->share == NULL) {
+        free(ep);
+        return NULL;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&ep->share_locks[i], NULL);
+    }
+
+    curl_share_setopt(ep->share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(ep->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(ep->share, CURLSHOPT_USERDATA, ep);
+    curl_share_setopt(ep->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(ep->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    ep->key = key;
+    return ep;
+}
+/* }}} */
+
+/* {{{ endpoint_destroy
+ * Caller guarantees no handle is in use.
+ */
+static void endpoint_destroy(Endpoint* ep) {
+    PooledHandle* ph = ep->handles;
+    while (ph != NULL) {
+        PooledHandle* next = ph->next;
+        curl_easy_cleanup(ph->easy);
+        free(ph);
+        ph = next;
+    }
+
+    curl_share_cleanup(ep->share);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&ep->share_locks[i]);
+    }
+    free(ep->key);
+    free(ep);
+}
+/* }}} */
+
+/* {{{ endpoint_find
+ * Looks up (or creates) the endpoint for url. Caller holds pool_lock.
+ */
+static Endpoint* endpoint_find(const char* url, bool create) {
+    char* key = endpoint_key(url);
+    if (key == NULL) {
+        return NULL;
+    }
+
+    for (Endpoint* ep = endpoints; ep != NULL; ep = ep->next) {
+        if (strcmp(ep->key, key) == 0) {
+            free(key);
+            return ep;
+        }
+    }
+
+    if (!create) {
+        free(key);
+        return NULL;
+    }
+
+    Endpoint* ep = endpoint_create(key);
+    if (ep == NULL) {
+        free(key);
+        return NULL;
+    }
+    ep->next = endpoints;
+    endpoints = ep;
+    return ep;
+}
+/* }}} */
+
+/* {{{ apply_pool_options
+ * Options every pooled handle carries; reapplied after each reset.
+ */
+static void apply_pool_options(Endpoint* ep, CURL* easy) {
+    long max_age_s = pool_config.idle_timeout_ms / 1000;
+    if (max_age_s < 1) {
+        max_age_s = 1;
+    }
+
+    curl_easy_setopt(easy, CURLOPT_SHARE, ep->share);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_MAXAGE_CONN, max_age_s);
+}
+/* }}} */
+
+/* {{{ expire_idle_locked
+ * Closes idle handles past the timeout. Caller holds pool_lock.
+ */
+static void expire_idle_locked(Endpoint* ep, uint64_t now) {
+    PooledHandle** link = &ep->handles;
+    while (*link != NULL) {
+        PooledHandle* ph = *link;
+        if (!ph->in_use &&
+            now - ph->idle_since_ms >= (uint64_t)pool_config.idle_timeout_ms) {
+            *link = ph->next;
+            curl_easy_cleanup(ph->easy);
+            free(ph);
+            ep->stats.idle_expired++;
+        } else {
+            link = &ph->next;
+        }
+    }
+}
+/* }}} */
+
+/* {{{ checkout_locked
+ * Hands out an idle handle or creates one if the endpoint is below its
+ * cap. Returns NULL when at the cap (or on allocation failure, in which
+ * case *failed is set). Caller holds pool_lock.
+ */
+static CURL* checkout_locked(Endpoint* ep, bool* failed) {
+    expire_idle_locked(ep, now_ms());
+
+    if (ep->stats.in_use >= pool_config.max_connections_per_host) {
+        return NULL;
+    }
+
+    /* Most recently released first: its connection is least likely stale */
+    PooledHandle* best = NULL;
+    for (PooledHandle* ph = ep->handles; ph != NULL; ph = ph->next) {
+        if (!ph->in_use && (best == NULL || ph->idle_since_ms > best->idle_since_ms)) {
+            best = ph;
+        }
+    }
+
+    if (best != NULL) {
+        ep->stats.handles_reused++;
+    } else {
+        best = calloc(1, sizeof(PooledHandle));
+        if (best != NULL) {
+            best->easy = curl_easy_init();
+        }
+        if (best == NULL || best->easy == NULL) {
+            free(best);
+            *failed = true;
+            return NULL;
+        }
+        apply_pool_options(ep, best->easy);
+        best->next = ep->handles;
+        ep->handles = best;
+        ep->stats.handles_created++;
+    }
+
+    best->in_use = true;
+    ep->stats.in_use++;
+    ep->stats.acquired++;
+    return best->easy;
+}
+/* }}} */
+
+/* {{{ record_transfer
+ * Classifies the handle's last transfer as a new or reused connection.
+ */
+static void record_transfer(Endpoint* ep, CURL* easy) {
+    long new_connections = 0;
+    long http_code = 0;
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &new_connections);
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_code);
+
+    if (new_connections > 0) {
+        curl_off_t connect_us = 0;
+        curl_off_t appconnect_us = 0;
+        curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect_us);
+        curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &appconnect_us);
+
+        /* TLS handshake completes after TCP connect when present */
+        curl_off_t setup_us = appconnect_us > connect_us ? appconnect_us : connect_us;
+        ep->stats.connections_opened++;
+        ep->stats.connect_ms_total += (double)setup_us / 1000.0;
+    } else if (http_code > 0) {
+        ep->stats.connections_reused++;
+    }
+}
+/* }}} */
+
+/* {{{ finalize_stats
+ * Derives the estimated setup time saved from the averages.
+ */
+static void finalize_stats(HttpPoolStats* stats) {
+    stats->connect_ms_saved = 0.0;
+    if (stats->connections_opened > 0) {
+        double avg = stats->connect_ms_total / stats->connections_opened;
+        stats->connect_ms_saved = avg * stats->connections_reused;
+    }
+}
+/* }}} */
+
+/* ========================================================================== */
+/*                              Public API                                     */
+/* ========================================================================== */
+
+/* {{{ http_pool_config_from_server */
+HttpPoolConfig http_pool_config_from_server(const ServerConfig* config) {
+    HttpPoolConfig pool = {
+        HTTP_POOL_DEFAULT_MAX_PER_HOST,
+        HTTP_POOL_DEFAULT_IDLE_TIMEOUT_MS
+    };
+    if (config != NULL) {
+        pool.max_connections_per_host = config->http_max_connections_per_host;
+        pool.idle_timeout_ms = config->http_idle_timeout_ms;
+    }
+    return pool;
+}
+/* }}} */
+
+/* {{{ http_pool_init */
+void http_pool_init(const HttpPoolConfig* config) {
+    pthread_mutex_lock(&pool_lock);
+    pool_users++;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (config != NULL) {
+        http_pool_configure(config);
+    }
+}
+/* }}} */
+
+/* {{{ http_pool_shutdown */
+void http_pool_shutdown(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (pool_users > 0) {
+        pool_users--;
+    }
+    bool last = pool_users == 0;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (last) {
+        http_pool_cleanup();
+    }
+}
+/* }}} */
+
+/* {{{ http_pool_configure */
+void http_pool_configure(const HttpPoolConfig* config) {
+    pthread_mutex_lock(&pool_lock);
+
+    pool_config.max_connections_per_host = HTTP_POOL_DEFAULT_MAX_PER_HOST;
+    pool_config.idle_timeout_ms = HTTP_POOL_DEFAULT_IDLE_TIMEOUT_MS;
+    if (config != NULL) {
+        if (config->max_connections_per_host >= 1) {
+            pool_config.max_connections_per_host = config->max_connections_per_host;
+        }
+        if (config->idle_timeout_ms >= 0) {
+            pool_config.idle_timeout_ms = config->idle_timeout_ms;
+        }
+    }
+
+    /* A raised cap may unblock waiters */
+    pthread_cond_broadcast(&pool_released);
+    pthread_mutex_unlock(&pool_lock);
+}
+/* }}} */
+
+/* {{{ http_pool_acquire */
+CURL* http_pool_acquire(const char* url) {
+    pthread_mutex_lock(&pool_lock);
+
+    Endpoint* ep = endpoint_find(url, true);
+    if (ep == NULL) {
+        pthread_mutex_unlock(&pool_lock);
+        return NULL;
+    }
+
+    bool failed = false;
+    bool waited = false;
+    CURL* easy;
+    while ((easy = checkout_locked(ep, &failed)) == NULL && !failed) {
+        if (!waited) {
+            ep->stats.waits++;
+            waited = true;
+        }
+        pthread_cond_wait(&pool_released, &pool_lock);
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+    return easy;
+}
+/* }}} */
+
+/* {{{ http_pool_try_acquire */
+CURL* http_pool_try_acquire(const char* url) {
+    pthread_mutex_lock(&pool_lock);
+
+    CURL* easy = NULL;
+    Endpoint* ep = endpoint_find(url, true);
+    if (ep != NULL) {
+        bool failed = false;
+        easy = checkout_locked(ep, &failed);
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+    return easy;
+}
+/* }}} */
+
+/* {{{ http_pool_release */
+void http_pool_release(CURL* handle) {
+    if (handle == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+
+    for (Endpoint* ep = endpoints; ep != NULL; ep = ep->next) {
+        for (PooledHandle* ph = ep->handles; ph != NULL; ph = ph->next) {
+            if (ph->easy != handle || !ph->in_use) {
+                continue;
+            }
+
+            record_transfer(ep, handle);
+
+            /* Reset drops request options but keeps the live connection */
+            curl_easy_reset(handle);
+            apply_pool_options(ep, handle);
+
+            ph->in_use = false;
+            ph->idle_since_ms = now_ms();
+            ep->stats.in_use--;
+            expire_idle_locked(ep, ph->idle_since_ms);
+
+            pthread_cond_broadcast(&pool_released);
+            pthread_mutex_unlock(&pool_lock);
+            return;
+        }
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+
+    /* Not ours */
+    curl_easy_cleanup(handle);
+}
+/* }}} */
+
+/* {{{ http_pool_expire_idle */
+void http_pool_expire_idle(void) {
+    pthread_mutex_lock(&pool_lock);
+    uint64_t now = now_ms();
+    for (Endpoint* ep = endpoints; ep != NULL; ep = ep->next) {
+        expire_idle_locked(ep, now);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+/* }}} */
+
+/* {{{ http_pool_get_stats */
+HttpPoolStats http_pool_get_stats(const char* url) {
+    HttpPoolStats total;
+    memset(&total, 0, sizeof(total));
+
+    pthread_mutex_lock(&pool_lock);
+
+    if (url != NULL) {
+        Endpoint* ep = endpoint_find(url, false);
+        if (ep != NULL) {
+            total = ep->stats;
+        }
+    } else {
+        for (Endpoint* ep = endpoints; ep != NULL; ep = ep->next) {
+            total.acquired += ep->stats.acquired;
+            total.handles_created += ep->stats.handles_created;
+            total.handles_reused += ep->stats.handles_reused;
+            total.connections_opened += ep->stats.connections_opened;
+            total.connections_reused += ep->stats.connections_reused;
+            total.idle_expired += ep->stats.idle_expired;
+            total.waits += ep->stats.waits;
+            total.in_use += ep->stats.in_use;
+            total.connect_ms_total += ep->stats.connect_ms_total;
+        }
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+
+    finalize_stats(&total);
+    return total;
+}
+/* }}} */
+
+/* {{{ http_pool_reuse_rate */
+float http_pool_reuse_rate(const HttpPoolStats* stats) {
+    if (stats == NULL) {
+        return 0.0f;
+    }
+
+    int transfers = stats->connections_opened + stats->connections_reused;
+    if (transfers == 0) {
+        return 0.0f;
+    }
+    return (float)stats->connections_reused / (float)transfers;
+}
+/* }}} */
+
+/* {{{ http_pool_cleanup */
+void http_pool_cleanup(void) {
+    pthread_mutex_lock(&pool_lock);
+
+    Endpoint** link = &endpoints;
+    while (*link != NULL) {
+        Endpoint* ep = *link;
+        if (ep->stats.in_use == 0) {
+            *link = ep->next;
+            endpoint_destroy(ep);
+        } else {
+            /* Keep the endpoint for its outstanding handles; drop idle ones */
+            PooledHandle** hlink = &ep->handles;
+            while (*hlink != NULL) {
+                PooledHandle* ph = *hlink;
+                if (!ph->in_use) {
+                    *hlink = ph->next;
+                    curl_easy_cleanup(ph->easy);
+                    free(ph);
+                } else {
+                    hlink = &ph->next;
+                }
+            }
+            link = &ep->next;
+        }
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+}
+/* }}} */
@@ -0,0 +1,144 @@
+/*
+ * 09-http-pool.h - Outbound HTTP Connection Pool
+ *
+ * Keeps libcurl easy handles warm per endpoint (scheme://host:port) so
+ * repeated LLM and ComfyUI requests reuse an established keep-alive
+ * connection instead of paying DNS, TCP and TLS setup on every call.
+ * Each endpoint owns a curl share object holding its DNS cache and TLS
+ * session IDs, caps the number of handles checked out at once, and
+ * closes handles that sit idle longer than the configured timeout.
+ * The pool is process-wide: the LLM and ComfyUI clients each hold a
+ * reference, and it is only torn down when the last one lets go.
+ *
+ * Dependencies: libcurl, pthread
+ */
+
+#ifndef SYMBELINE_HTTP_POOL_H
+#define SYMBELINE_HTTP_POOL_H
+
+#include "01-config.h"
+#include <curl/curl.h>
+#include <stdbool.h>
+
+/* {{{ Constants */
+#define HTTP_POOL_DEFAULT_MAX_PER_HOST 4
+#define HTTP_POOL_DEFAULT_IDLE_TIMEOUT_MS 60000
+/* }}} */
+
+/* {{{ HttpPoolConfig
+ * Pool limits. Values below 1 (or below 0 for the timeout) fall back
+ * to the defaults.
+ */
+typedef struct {
+    int max_connections_per_host;   /* Handles checked out at once per endpoint */
+    int idle_timeout_ms;            /* Idle handles older than this are closed */
+} HttpPoolConfig;
+/* }}} */
+
+/* {{{ HttpPoolStats
+ * Counters for one endpoint, or summed over all endpoints.
+ */
+typedef struct {
+    int acquired;               /* Handles handed out */
+    int handles_created;        /* Acquisitions that needed a fresh handle */
+    int handles_reused;         /* Acquisitions served from the idle list */
+    int connections_opened;     /* Transfers that opened a new connection */
+    int connections_reused;     /* Transfers that rode an existing connection */
+    int idle_expired;           /* Idle handles closed by the timeout */
+    int waits;                  /* Acquisitions that blocked on the per-host cap */
+    int in_use;                 /* Handles currently checked out */
+    double connect_ms_total;    /* Time spent establishing new connections */
+    double connect_ms_saved;    /* Estimated setup time avoided by reuse */
+} HttpPoolStats;
+/* }}} */
+
+/* {{{ HTTP Pool API */
+
+/*
+ * http_pool_config_from_server
+ * Returns the pool limits set in config (http_max_connections_per_host,
+ * http_idle_timeout_ms), or the defaults when config is NULL.
+ */
+HttpPoolConfig http_pool_config_from_server(const ServerConfig* config);
+
+/*
+ * http_pool_init
+ * Takes a reference on the pool and applies config unless it is NULL.
+ * llm_init and comfyui_init take one each; a server calls it first with
+ * its configured limits (http_pool_config_from_server) and keeps that
+ * reference until exit.
+ */
+void http_pool_init(const HttpPoolConfig* config);
+
+/*
+ * http_pool_shutdown
+ * Drops a reference taken by http_pool_init. The last one runs
+ * http_pool_cleanup, so one client shutting down leaves the pooled
+ * connections of the others alone.
+ */
+void http_pool_shutdown(void);
+
+/*
+ * http_pool_configure
+ * Applies limits to every endpoint, existing and future.
+ * Passing NULL restores the defaults.
+ */
+void http_pool_configure(const HttpPoolConfig* config);
+
+/*
+ * http_pool_acquire
+ * Returns an easy handle bound to the endpoint of url, blocking while
+ * that endpoint already has max_connections_per_host handles out.
+ * The handle has only pool options set (share, keep-alive); callers
+ * set the URL and request options as usual.
+ * Returns NULL if url is invalid or allocation fails.
+ */
+CURL* http_pool_acquire(const char* url);
+
+/*
+ * http_pool_try_acquire
+ * Like http_pool_acquire but returns NULL instead of blocking when
+ * the endpoint is at its cap. Used by the asynchronous engine.
+ */
+CURL* http_pool_try_acquire(const char* url);
+
+/*
+ * http_pool_release
+ * Returns a handle to its endpoint's idle list after recording whether
+ * its last transfer reused a connection. The handle is reset, so any
+ * header lists or buffers it referenced may be freed afterwards.
+ * Handles not obtained from the pool are cleaned up.
+ */
+void http_pool_release(CURL* handle);
+
+/*
+ * http_pool_expire_idle
+ * Closes idle handles older than the idle timeout on every endpoint.
+ * Also done lazily on acquire and release.
+ */
+void http_pool_expire_idle(void);
+
+/*
+ * http_pool_get_stats
+ * Returns counters for the endpoint of url, or totals when url is NULL.
+ * Unknown endpoints report all zeroes.
+ */
+HttpPoolStats http_pool_get_stats(const char* url);
+
+/*
+ * http_pool_reuse_rate
+ * Fraction of completed transfers that reused a connection (0.0-1.0).
+ */
+float http_pool_reuse_rate(const HttpPoolStats* stats);
+
+/*
+ * http_pool_cleanup
+ * Run by the last http_pool_shutdown. Closes all idle handles and releases endpoints with nothing checked
+ * out. Endpoints with handles still in use are kept (with their stats)
+ * so those handles can be released normally.
+ */
+void http_pool_cleanup(void);
+
+/* }}} */
+
+#endif /* SYMBELINE_HTTP_POOL_H */
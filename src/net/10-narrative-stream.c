@@ -0,0 +1,292 @@
+/* 10-narrative-stream.c - Streamed Narrative Delivery Implementation
+ *
+ * Deltas are numbered when appended and kept on a FIFO under the
+ * stream lock; flush detaches the queue and sends outside the lock so
+ * producers are never blocked on client sockets.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "10-narrative-stream.h"
+#include "04-protocol.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================================== */
+/*                              Type Definitions                               */
+/* ========================================================================== */
+
+/* {{{ StreamChunk */
+typedef struct StreamChunk {
+    int sequence;
+    char* text;
+    bool final;
+    struct StreamChunk* next;
+} StreamChunk;
+/* }}} */
+
+/* {{{ NarrativeStream */
+struct NarrativeStream {
+    ConnectionRegistry* registry;
+    int game_id;
+    int stream_id;
+
+    pthread_mutex_t lock;
+    StreamChunk* head;              /* Oldest queued chunk */
+    StreamChunk* tail;
+    int next_sequence;
+    bool finish_queued;
+    bool complete;                  /* Final marker flushed */
+
+    char* text;                     /* Everything appended so far */
+    size_t text_len;
+    size_t text_cap;
+};
+/* }}} */
+
+/* {{{ Stream IDs */
+static pthread_mutex_t id_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_stream_id = 1;
+/* }}} */
+
+/* ========================================================================== */
+/*                              Helpers                                        */
+/* ========================================================================== */
+
+/* {{{ queue_chunk
+ * Appends a chunk to the FIFO. Caller holds the stream lock.
+ */
+static bool queue_chunk(NarrativeStream* stream, const char* text, bool final) {
+    StreamChunk* chunk = calloc(1, sizeof(StreamChunk));
+    if (chunk == NULL) {
+        return false;
+    }
+
+    chunk->text = strdup(text != NULL ? text : "");
+    if (chunk->text == NULL) {
+        free(chunk);
+        return false;
+    }
+    chunk->sequence = stream->next_sequence++;
+    chunk->final = final;
+
+    if (stream->tail != NULL) {
+        stream->tail->next = chunk;
+    } else {
+        stream->head = chunk;
+    }
+    stream->tail = chunk;
+    return true;
+}
+/* }}} */
+
+/* {{{ send_chunk
+ * Delivers one chunk to every connection in the game, formatted for
+ * its transport.
+ */
+static void send_chunk(NarrativeStream* stream, const StreamChunk* chunk) {
+    Message* msg = protocol_create_narrative_chunk(stream->stream_id,
+                                                   chunk->sequence,
+                                                   chunk->text, chunk->final);
+    char* json = msg != NULL ? protocol_serialize(msg) : NULL;
+    message_free(msg);
+
+    for (int i = 0; i < CONN_MAX_CONNECTIONS; i++) {
+        Connection* conn = &stream->registry->connections[i];
+        if (!conn->active || conn->game_id != stream->game_id) {
+            continue;
+        }
+
+        if (conn->type == CONN_TYPE_WEBSOCKET) {
+            if (json != NULL) {
+                conn_send(stream->registry, conn->id, json);
+            }
+        } else if (chunk->text[0] != '\0') {
+            conn_send(stream->registry, conn->id, chunk->text);
+        } else if (chunk->final) {
+            conn_send(stream->registry, conn->id, "\r\n");
+        }
+    }
+
+    free(json);
+}
+/* }}} */
+
+/* ========================================================================== */
+/*                              Public API                                     */
+/* ========================================================================== */
+
+/* {{{ narrative_stream_begin */
+NarrativeStream* narrative_stream_begin(ConnectionRegistry* registry, int game_id) {
+    if (registry == NULL || game_id < 0) {
+        return NULL;
+    }
+
+    NarrativeStream* stream = calloc(1, sizeof(NarrativeStream));
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    stream->registry = registry;
+    stream->game_id = game_id;
+    pthread_mutex_init(&stream->lock, NULL);
+
+    pthread_mutex_lock(&id_lock);
+    stream->stream_id = next_stream_id++;
+    pthread_mutex_unlock(&id_lock);
+
+    return stream;
+}
+/* }}} */
+
+/* {{{ narrative_stream_append */
+bool narrative_stream_append(NarrativeStream* stream, const char* delta) {
+    if (stream == NULL || delta == NULL) {
+        return false;
+    }
+
+    size_t len = strlen(delta);
+
+    pthread_mutex_lock(&stream->lock);
+
+    if (stream->finish_queued) {
+        pthread_mutex_unlock(&stream->lock);
+        return false;
+    }
+    if (len == 0) {
+        pthread_mutex_unlock(&stream->lock);
+        return true;
+    }
+
+    size_t needed = stream->text_len + len + 1;
+    if (needed > stream->text_cap) {
+        size_t new_cap = stream->text_cap > 0 ? stream->text_cap * 2 : 256;
+        while (new_cap < needed) {
+            new_cap *= 2;
+        }
+        char* new_text = realloc(stream->text, new_cap);
+        if (new_text == NULL) {
+            pthread_mutex_unlock(&stream->lock);
+            return false;
+        }
+        stream->text = new_text;
+        stream->text_cap = new_cap;
+    }
+
+    bool ok = queue_chunk(stream, delta, false);
+    if (ok) {
+        memcpy(stream->text + stream->text_len, delta, len + 1);
+        stream->text_len += len;
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+    return ok;
+}
+/* }}} */
+
+/* {{{ narrative_stream_on_delta */
+void narrative_stream_on_delta(const char* delta, void* user) {
+    narrative_stream_append((NarrativeStream*)user, delta);
+}
+/* }}} */
+
+/* {{{ narrative_stream_finish */
+void narrative_stream_finish(NarrativeStream* stream) {
+    if (stream == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    if (!stream->finish_queued && queue_chunk(stream, "", true)) {
+        stream->finish_queued = true;
+    }
+    pthread_mutex_unlock(&stream->lock);
+}
+/* }}} */
+
+/* {{{ narrative_stream_flush */
+int narrative_stream_flush(NarrativeStream* stream) {
+    if (stream == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    StreamChunk* chunk = stream->head;
+    stream->head = NULL;
+    stream->tail = NULL;
+    pthread_mutex_unlock(&stream->lock);
+
+    int sent = 0;
+    bool final_sent = false;
+    while (chunk != NULL) {
+        StreamChunk* next = chunk->next;
+        send_chunk(stream, chunk);
+        final_sent = final_sent || chunk->final;
+        sent++;
+        free(chunk->text);
+        free(chunk);
+        chunk = next;
+    }
+
+    if (final_sent) {
+        pthread_mutex_lock(&stream->lock);
+        stream->complete = true;
+        pthread_mutex_unlock(&stream->lock);
+    }
+
+    return sent;
+}
+/* }}} */
+
+/* {{{ narrative_stream_is_complete */
+bool narrative_stream_is_complete(NarrativeStream* stream) {
+    if (stream == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    bool complete = stream->complete;
+    pthread_mutex_unlock(&stream->lock);
+    return complete;
+}
+/* }}} */
+
+/* {{{ narrative_stream_id */
+int narrative_stream_id(const NarrativeStream* stream) {
+    return stream != NULL ? stream->stream_id : 0;
+}
+/* }}} */
+
+/* {{{ narrative_stream_copy_text */
+char* narrative_stream_copy_text(NarrativeStream* stream) {
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    char* copy = strdup(stream->text != NULL ? stream->text : "");
+    pthread_mutex_unlock(&stream->lock);
+    return copy;
+}
+/* }}} */
+
+/* {{{ narrative_stream_free */
+void narrative_stream_free(NarrativeStream* stream) {
+    if (stream == NULL) {
+        return;
+    }
+
+    StreamChunk* chunk = stream->head;
+    while (chunk != NULL) {
+        StreamChunk* next = chunk->next;
+        free(chunk->text);
+        free(chunk);
+        chunk = next;
+    }
+
+    pthread_mutex_destroy(&stream->lock);
+    free(stream->text);
+    free(stream);
+}
+/* }}} */
@@ -0,0 +1,89 @@
+/* 10-narrative-stream.h - Streamed Narrative Delivery
+ *
+ * Forwards LLM narration to a game's players while it is still being
+ * generated. Text deltas are queued as they arrive (from any thread,
+ * typically the async LLM I/O thread) and flushed by the thread that
+ * owns the connection registry:
+ * - WebSocket clients receive MSG_NARRATIVE chunks carrying stream_id,
+ *   seq and a final marker (see protocol_create_narrative_chunk)
+ * - SSH clients receive the raw text so it appears in the terminal as
+ *   it is written, followed by a line break when the stream ends
+ *
+ * Dependencies: 04-protocol, 06-connections
+ */
+
+#ifndef SYMBELINE_NARRATIVE_STREAM_H
+#define SYMBELINE_NARRATIVE_STREAM_H
+
+#include "06-connections.h"
+#include <stdbool.h>
+
+/* {{{ NarrativeStream
+ * Opaque stream state; one per narration.
+ */
+typedef struct NarrativeStream NarrativeStream;
+/* }}} */
+
+/* {{{ narrative_stream_begin
+ * Starts a new narration for every connection in game_id.
+ * Each stream gets a process-unique stream_id.
+ * Returns NULL on invalid arguments or allocation failure.
+ */
+NarrativeStream* narrative_stream_begin(ConnectionRegistry* registry, int game_id);
+/* }}} */
+
+/* {{{ narrative_stream_append
+ * Queues a text delta. Thread-safe. Empty deltas are ignored.
+ * Returns false if the stream is already finished or allocation fails.
+ */
+bool narrative_stream_append(NarrativeStream* stream, const char* delta);
+/* }}} */
+
+/* {{{ narrative_stream_on_delta
+ * Adapter with the LLMStreamCallback shape; user is the stream.
+ * Lets a stream be passed directly to llm_request_stream or
+ * llm_request_async_stream.
+ */
+void narrative_stream_on_delta(const char* delta, void* user);
+/* }}} */
+
+/* {{{ narrative_stream_finish
+ * Queues the final marker. Thread-safe. Further appends are rejected.
+ */
+void narrative_stream_finish(NarrativeStream* stream);
+/* }}} */
+
+/* {{{ narrative_stream_flush
+ * Sends all queued chunks, in order, to the game's connections.
+ * Call from the thread that owns the registry.
+ * Returns the number of chunks sent.
+ */
+int narrative_stream_flush(NarrativeStream* stream);
+/* }}} */
+
+/* {{{ narrative_stream_is_complete
+ * Returns true once the final marker has been flushed.
+ */
+bool narrative_stream_is_complete(NarrativeStream* stream);
+/* }}} */
+
+/* {{{ narrative_stream_id
+ * Returns the stream_id carried by this stream's chunks.
+ */
+int narrative_stream_id(const NarrativeStream* stream);
+/* }}} */
+
+/* {{{ narrative_stream_copy_text
+ * Returns a copy of all text appended so far. Caller frees.
+ */
+char* narrative_stream_copy_text(NarrativeStream* stream);
+/* }}} */
+
+/* {{{ narrative_stream_free
+ * Frees the stream. Unflushed chunks are dropped.
+ * Safe to call with NULL.
+ */
+void narrative_stream_free(NarrativeStream* stream);
+/* }}} */
+
+#endif /* SYMBELINE_NARRATIVE_STREAM_H */
@@ -0,0 +1,724 @@
+/*
+ * llm-bench.c - Offline Narration Pipeline Benchmark
+ *
+ * Runs the LLM and ComfyUI clients against the local stub servers and
+ * reports latency and throughput, so changes to the narration pipeline
+ * can be measured without a model:
+ * - throughput: concurrent narration requests
+ * - stream:     time to first token against total time
+ * - retry:      injected failures, retries and what they cost
+ * - cache:      skewed repeat prompts through the narrative cache
+ * - comfyui:    image jobs submitted and polled to completion, by
+ *               blocking client threads and by the job engine
+ *
+ * With --serve it only runs the stubs, for pointing a game server at.
+ * With --config the connection pool uses a server config's limits.
+ *
+ * Build with: gcc -o bin/llm-bench src/tools/llm-bench.c src/tools/stub-server.c
+ *             src/llm/[0-9]*.c src/visual/[0-9]*.c src/core/0[1-8]-*.c
+ *             src/net/01-config.c src/net/09-http-pool.c libs/cJSON.c
+ *             -lcurl -lm -lpthread
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stub-server.h"
+#include "../llm/01-api-client.h"
+#include "../llm/07-narrative-cache.h"
+#include "../visual/01-comfyui-client.h"
+#include "../visual/04-comfyui-jobs.h"
+#include "../net/09-http-pool.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* {{{ BenchOptions */
+typedef struct {
+    int requests;               /* Requests per scenario */
+    int concurrency;            /* Client threads */
+    int latency_ms;             /* Stub time to first token / job run time */
+    int jitter_ms;              /* Mean of the exponential latency tail */
+    int tokens_per_second;
+    int reply_tokens;
+    double failure_rate;        /* For the retry scenario */
+    int slots;                  /* Stub concurrency slots */
+    unsigned int seed;
+    int distinct_prompts;       /* For the cache scenario */
+    const char* scenario;       /* NULL = all */
+    bool serve;
+    int llm_port;
+    int comfy_port;
+    const char* config_path;    /* Server config for the pool limits */
+} BenchOptions;
+/* }}} */
+
+/* {{{ now_ms */
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+/* }}} */
+
+/* {{{ compare_doubles */
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+/* }}} */
+
+/* {{{ print_latencies
+ * Prints p50/p95/max of count samples, sorting them in place.
+ */
+static void print_latencies(const char* label, double* samples, int count) {
+    if (count == 0) {
+        printf("  %-22s no samples\n", label);
+        return;
+    }
+    qsort(samples, count, sizeof(double), compare_doubles);
+    printf("  %-22s p50 %7.1f ms   p95 %7.1f ms   max %7.1f ms\n", label,
+           samples[count / 2], samples[(count * 95) / 100 < count ? (count * 95) / 100 : count - 1],
+           samples[count - 1]);
+}
+/* }}} */
+
+/* {{{ stub_config
+ * LLM or ComfyUI stub configured from the command line.
+ */
+static StubServerConfig stub_config(const BenchOptions* options, StubServerKind kind) {
+    StubServerConfig config = stub_server_default_config(kind);
+    config.seed = options->seed;
+    config.latency.base_ms = options->latency_ms;
+    config.latency.spread_ms = options->jitter_ms;
+    config.latency.kind = options->jitter_ms > 0 ? STUB_LATENCY_EXPONENTIAL
+                                                 : STUB_LATENCY_FIXED;
+    config.tokens_per_second = options->tokens_per_second;
+    config.reply_tokens = options->reply_tokens;
+    config.slots = options->slots;
+    return config;
+}
+/* }}} */
+
+/* {{{ llm_config_for
+ * Client config pointing at a stub.
+ */
+static LLMConfig* llm_config_for(StubServer* server, int max_retries) {
+    LLMConfig* config = llm_config_create();
+    if (config == NULL) {
+        return NULL;
+    }
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(server));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->max_retries = max_retries;
+    config->timeout_ms = 60000;
+    return config;
+}
+/* }}} */
+
+/* {{{ narration_prompt
+ * The index-th narration prompt; the cache scenario repeats them.
+ */
+static void narration_prompt(char* buffer, size_t size, int index) {
+    snprintf(buffer, size,
+             "Narrate in one sentence: on turn %d the Dire Bear of the Wilds "
+             "attacks Lord Theron for %d damage.", index / 7 + 1, index % 7 + 2);
+}
+/* }}} */
+
+/* {{{ Worker pool
+ * Client threads pull request numbers from a shared counter and record
+ * each request's latency.
+ */
+typedef struct {
+    const BenchOptions* options;
+    LLMConfig* config;
+    pthread_mutex_t lock;
+    int next;
+    int total;
+    double* latencies;
+    int succeeded;
+} WorkerPool;
+
+static void* narration_worker(void* arg) {
+    WorkerPool* pool = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next < pool->total ? pool->next++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if (index < 0) {
+            return NULL;
+        }
+
+        char prompt[256];
+        narration_prompt(prompt, sizeof(prompt), index);
+        double start = now_ms();
+        LLMResponse* response = llm_request(pool->config, "You narrate a card game.",
+                                            prompt);
+        double elapsed = now_ms() - start;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->latencies[index] = elapsed;
+        if (response != NULL && response->success) {
+            pool->succeeded++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        llm_response_free(response);
+    }
+}
+
+/* Runs options->requests narration requests; returns wall time in ms. */
+static double run_pool(WorkerPool* pool) {
+    int threads = pool->options->concurrency > 0 ? pool->options->concurrency : 1;
+    pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+    if (workers == NULL) {
+        return 0.0;
+    }
+
+    double start = now_ms();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, narration_worker, pool);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double wall = now_ms() - start;
+
+    free(workers);
+    return wall;
+}
+/* }}} */
+
+/* {{{ bench_throughput */
+static void bench_throughput(const BenchOptions* options) {
+    printf("== throughput: %d requests, %d clients ==\n",
+           options->requests, options->concurrency);
+
+    StubServerConfig stub = stub_config(options, STUB_SERVER_LLM);
+    StubServer* server = stub_server_start(&stub);
+    if (server == NULL) {
+        fprintf(stderr, "  could not start LLM stub\n");
+        return;
+    }
+
+    WorkerPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.options = options;
+    pool.config = llm_config_for(server, 0);
+    pool.total = options->requests;
+    pool.latencies = calloc(options->requests, sizeof(double));
+    pthread_mutex_init(&pool.lock, NULL);
+
+    double wall = run_pool(&pool);
+    StubServerStats stats = stub_server_get_stats(server);
+
+    printf("  completed              %d/%d in %.0f ms (%.1f req/s)\n",
+           pool.succeeded, pool.total, wall,
+           wall > 0 ? pool.total * 1000.0 / wall : 0.0);
+    printf("  server peak in flight  %d\n", stats.peak_active);
+    print_latencies("request latency", pool.latencies, pool.total);
+
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.latencies);
+    llm_config_free(pool.config);
+    stub_server_stop(server);
+}
+/* }}} */
+
+/* {{{ Streaming */
+typedef struct {
+    double start;
+    double first;
+} StreamTiming;
+
+static void on_delta(const char* delta, void* user) {
+    (void)delta;
+    StreamTiming* timing = user;
+    if (timing->first == 0.0) {
+        timing->first = now_ms() - timing->start;
+    }
+}
+
+static void bench_stream(const BenchOptions* options) {
+    int count = options->requests < 20 ? options->requests : 20;
+    printf("== stream: %d sequential streamed requests ==\n", count);
+
+    StubServerConfig stub = stub_config(options, STUB_SERVER_LLM);
+    StubServer* server = stub_server_start(&stub);
+    if (server == NULL) {
+        fprintf(stderr, "  could not start LLM stub\n");
+        return;
+    }
+    LLMConfig* config = llm_config_for(server, 0);
+
+    double* first = calloc(count, sizeof(double));
+    double* total = calloc(count, sizeof(double));
+    for (int i = 0; i < count; i++) {
+        char prompt[256];
+        narration_prompt(prompt, sizeof(prompt), i);
+        LLMMessage messages[2] = {
+            { "system", "You narrate a card game." },
+            { "user", prompt }
+        };
+        StreamTiming timing = { now_ms(), 0.0 };
+        LLMResponse* response = llm_request_stream(config, messages, 2,
+                                                   on_delta, &timing);
+        first[i] = timing.first;
+        total[i] = now_ms() - timing.start;
+        llm_response_free(response);
+    }
+
+    print_latencies("time to first token", first, count);
+    print_latencies("time to last token", total, count);
+
+    free(first);
+    free(total);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+/* }}} */
+
+/* {{{ bench_retry */
+static void bench_retry(const BenchOptions* options) {
+    int count = options->requests / 2 > 0 ? options->requests / 2 : 1;
+    printf("== retry: %d requests, %.0f%% injected failures, 2 retries ==\n",
+           count, options->failure_rate * 100.0);
+
+    StubServerConfig stub = stub_config(options, STUB_SERVER_LLM);
+    stub.failure_rate = options->failure_rate;
+    StubServer* server = stub_server_start(&stub);
+    if (server == NULL) {
+        fprintf(stderr, "  could not start LLM stub\n");
+        return;
+    }
+
+    WorkerPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.options = options;
+    pool.config = llm_config_for(server, 2);
+    pool.total = count;
+    pool.latencies = calloc(count, sizeof(double));
+    pthread_mutex_init(&pool.lock, NULL);
+
+    double wall = run_pool(&pool);
+    StubServerStats stats = stub_server_get_stats(server);
+
+    printf("  succeeded              %d/%d in %.0f ms\n", pool.succeeded, count, wall);
+    printf("  server attempts        %d (%.2f per request, %d refused)\n",
+           stats.requests, (double)stats.requests / count, stats.failures);
+    print_latencies("request latency", pool.latencies, count);
+
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.latencies);
+    llm_config_free(pool.config);
+    stub_server_stop(server);
+}
+/* }}} */
+
+/* {{{ bench_cache
+ * Prompts are drawn with a skew towards the first few, the way a handful
+ * of common events dominate a game.
+ */
+static void bench_cache(const BenchOptions* options) {
+    int distinct = options->distinct_prompts > 0 ? options->distinct_prompts : 1;
+    printf("== cache: %d requests over %d distinct prompts ==\n",
+           options->requests, distinct);
+
+    StubServerConfig stub = stub_config(options, STUB_SERVER_LLM);
+    StubServer* server = stub_server_start(&stub);
+    if (server == NULL) {
+        fprintf(stderr, "  could not start LLM stub\n");
+        return;
+    }
+    LLMConfig* config = llm_config_for(server, 0);
+    NarrativeCache* cache = narrative_cache_init(distinct, 0);
+
+    double* latencies = calloc(options->requests, sizeof(double));
+    unsigned int state = options->seed != 0 ? options->seed : 1;
+    double start = now_ms();
+    for (int i = 0; i < options->requests; i++) {
+        /* Square of a uniform draw: low indices come up most */
+        state = state * 1103515245u + 12345u;
+        double u = (double)((state >> 8) & 0xFFFF) / 65536.0;
+        int index = (int)(u * u * distinct);
+
+        char prompt[256];
+        narration_prompt(prompt, sizeof(prompt), index);
+        double request_start = now_ms();
+        if (narrative_cache_get(cache, prompt) == NULL) {
+            LLMResponse* response = llm_request(config, "You narrate a card game.",
+                                                prompt);
+            if (response != NULL && response->success) {
+                narrative_cache_set(cache, prompt, response->text);
+            }
+            llm_response_free(response);
+        }
+        latencies[i] = now_ms() - request_start;
+    }
+    double wall = now_ms() - start;
+
+    NarrativeCacheStats cache_stats = narrative_cache_get_stats(cache);
+    StubServerStats stats = stub_server_get_stats(server);
+    printf("  hit rate               %.1f%% (%d hits, %d model calls)\n",
+           cache_stats.hit_rate * 100.0, cache_stats.hits, stats.requests);
+    printf("  wall time              %.0f ms\n", wall);
+    print_latencies("narration latency", latencies, options->requests);
+
+    free(latencies);
+    narrative_cache_free(cache);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+/* }}} */
+
+/* {{{ Image jobs */
+typedef struct {
+    ComfyUIConfig* config;
+    pthread_mutex_t lock;
+    int next;
+    int total;
+    double* latencies;
+    int succeeded;
+} ImagePool;
+
+static void* image_worker(void* arg) {
+    ImagePool* pool = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next < pool->total ? pool->next++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if (index < 0) {
+            return NULL;
+        }
+
+        char workflow[128];
+        snprintf(workflow, sizeof(workflow),
+                 "{\"3\":{\"class_type\":\"KSampler\",\"inputs\":{\"seed\":%d}}}", index);
+        double start = now_ms();
+        ComfyUIResponse* response = comfyui_wait_for_completion(pool->config, workflow);
+        double elapsed = now_ms() - start;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->latencies[index] = elapsed;
+        if (response != NULL && response->status == COMFYUI_STATUS_COMPLETED &&
+            response->image_data != NULL) {
+            pool->succeeded++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        comfyui_response_free(response);
+    }
+}
+
+static void on_engine_job(ComfyUIResponse* response, void* user) {
+    ImagePool* pool = user;
+    if (response != NULL && response->status == COMFYUI_STATUS_COMPLETED &&
+        response->image_data != NULL) {
+        pool->succeeded++;
+    }
+    comfyui_response_free(response);
+}
+
+static void bench_comfyui_engine(ImagePool* pool, int max_in_flight, bool poll_only) {
+    printf("  -- job engine: %d in flight, 1 thread, %s --\n", max_in_flight,
+           poll_only ? "status polling" : "progress socket");
+    ComfyUIJobOptions engine_options = { .max_in_flight = max_in_flight,
+                                         .poll_only = poll_only };
+    ComfyUIJobEngine* engine = comfyui_jobs_create(pool->config, &engine_options);
+    if (engine == NULL) {
+        fprintf(stderr, "  could not start the job engine\n");
+        return;
+    }
+
+    pool->succeeded = 0;
+    double start = now_ms();
+    for (int i = 0; i < pool->total; i++) {
+        char workflow[128];
+        snprintf(workflow, sizeof(workflow),
+                 "{\"3\":{\"class_type\":\"KSampler\",\"inputs\":{\"seed\":%d}}}", i);
+        comfyui_jobs_submit(engine, workflow, on_engine_job, pool);
+    }
+    comfyui_jobs_wait(engine, -1);
+    double wall = now_ms() - start;
+
+    ComfyUIJobStats stats = comfyui_jobs_get_stats(engine);
+    printf("  completed              %d/%d in %.0f ms\n", pool->succeeded, pool->total, wall);
+    printf("  peak in flight         %d\n", stats.peak_in_flight);
+    printf("  status checks          %d (%.1f per job)\n", stats.polls,
+           pool->total > 0 ? (double)stats.polls / pool->total : 0.0);
+    if (!poll_only) {
+        printf("  socket events          %d\n", stats.socket_events);
+    }
+    comfyui_jobs_free(engine);
+}
+
+static void bench_comfyui(const BenchOptions* options) {
+    int count = options->requests / 4 > 0 ? options->requests / 4 : 1;
+    printf("== comfyui: %d jobs, %d clients ==\n", count, options->concurrency);
+
+    StubServerConfig stub = stub_config(options, STUB_SERVER_COMFYUI);
+    stub.latency.base_ms = options->latency_ms * 4;
+    StubServer* server = stub_server_start(&stub);
+    if (server == NULL) {
+        fprintf(stderr, "  could not start ComfyUI stub\n");
+        return;
+    }
+
+    ImagePool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.config = comfyui_config_create();
+    free(pool.config->server_url);
+    pool.config->server_url = strdup("127.0.0.1");
+    pool.config->port = stub_server_port(server);
+    pool.config->poll_interval_ms = 25;
+    pool.total = count;
+    pool.latencies = calloc(count, sizeof(double));
+    pthread_mutex_init(&pool.lock, NULL);
+
+    int threads = options->concurrency > 0 ? options->concurrency : 1;
+    pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+    double start = now_ms();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, image_worker, &pool);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double wall = now_ms() - start;
+
+    StubServerStats stats = stub_server_get_stats(server);
+    printf("  completed              %d/%d in %.0f ms\n", pool.succeeded, count, wall);
+    printf("  polls per job          %.1f\n", (double)stats.polls / count);
+    print_latencies("job latency", pool.latencies, count);
+
+    // The same jobs from one thread through the job engine, polling
+    // and then following the progress socket
+    bench_comfyui_engine(&pool, threads, true);
+    bench_comfyui_engine(&pool, threads, false);
+
+    free(workers);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.latencies);
+    comfyui_config_free(pool.config);
+    stub_server_stop(server);
+}
+/* }}} */
+
+/* {{{ serve */
+static volatile sig_atomic_t s_stop = 0;
+
+static void on_signal(int signum) {
+    (void)signum;
+    s_stop = 1;
+}
+
+static int serve(const BenchOptions* options) {
+    StubServerConfig llm = stub_config(options, STUB_SERVER_LLM);
+    llm.port = options->llm_port;
+    llm.failure_rate = options->failure_rate;
+    StubServerConfig comfy = stub_config(options, STUB_SERVER_COMFYUI);
+    comfy.port = options->comfy_port;
+    comfy.failure_rate = options->failure_rate;
+
+    StubServer* llm_server = stub_server_start(&llm);
+    StubServer* comfy_server = stub_server_start(&comfy);
+    if (llm_server == NULL || comfy_server == NULL) {
+        fprintf(stderr, "Error: could not bind ports %d and %d\n",
+                options->llm_port, options->comfy_port);
+        stub_server_stop(llm_server);
+        stub_server_stop(comfy_server);
+        return 1;
+    }
+
+    printf("LLM stub on http://127.0.0.1:%d, ComfyUI stub on http://127.0.0.1:%d\n",
+           stub_server_port(llm_server), stub_server_port(comfy_server));
+    printf("Press Ctrl-C to stop.\n");
+    fflush(stdout);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    while (!s_stop) {
+        pause();
+    }
+
+    StubServerStats stats = stub_server_get_stats(llm_server);
+    printf("\nLLM: %d requests (%d streamed, %d failed)\n",
+           stats.requests, stats.streamed, stats.failures);
+    stats = stub_server_get_stats(comfy_server);
+    printf("ComfyUI: %d jobs, %d polls, %d images\n",
+           stats.requests, stats.polls, stats.images);
+
+    stub_server_stop(llm_server);
+    stub_server_stop(comfy_server);
+    return 0;
+}
+/* }}} */
+
+/* {{{ print_usage */
+static void print_usage(const char* program) {
+    printf("Usage: %s [options] [scenario]\n", program);
+    printf("\nScenarios: throughput, stream, retry, cache, comfyui (default: all)\n");
+    printf("\nOptions:\n");
+    printf("  -n, --requests N        Requests per scenario (default 40)\n");
+    printf("  -c, --concurrency N     Client threads (default 8)\n");
+    printf("  --latency-ms N          Stub time to first token (default 50)\n");
+    printf("  --jitter-ms N           Mean exponential latency tail (default 0)\n");
+    printf("  --tokens-per-sec N      Stub generation rate (default 200)\n");
+    printf("  --reply-tokens N        Words per reply (default 24)\n");
+    printf("  --failure-rate F        Injected failures for retry/serve (default 0.3)\n");
+    printf("  --slots N               Requests the stub serves at once (default 4)\n");
+    printf("  --distinct N            Distinct prompts for cache (default 12)\n");
+    printf("  --seed N                Seed for every random choice (default 1)\n");
+    printf("  --serve                 Only run the stubs until interrupted\n");
+    printf("  --llm-port N            Port of the LLM stub with --serve (default 5000)\n");
+    printf("  --comfy-port N          Port of the ComfyUI stub with --serve (default 8188)\n");
+    printf("  --config PATH           Server config whose http_* pool limits apply\n");
+    printf("  -h, --help              Show this help message\n");
+}
+/* }}} */
+
+/* {{{ main */
+int main(int argc, char** argv) {
+    BenchOptions options = {
+        .requests = 40,
+        .concurrency = 8,
+        .latency_ms = 50,
+        .jitter_ms = 0,
+        .tokens_per_second = 200,
+        .reply_tokens = 24,
+        .failure_rate = 0.3,
+        .slots = 4,
+        .seed = 1,
+        .distinct_prompts = 12,
+        .scenario = NULL,
+        .serve = false,
+        .llm_port = 5000,
+        .comfy_port = 8188,
+        .config_path = NULL
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool takes_value = true;
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(arg, "--serve") == 0) {
+            options.serve = true;
+            takes_value = false;
+        } else if (arg[0] != '-') {
+            options.scenario = arg;
+            takes_value = false;
+        } else if (value == NULL) {
+            fprintf(stderr, "Error: %s needs a value\n", arg);
+            return 1;
+        } else if (strcmp(arg, "-n") == 0 || strcmp(arg, "--requests") == 0) {
+            options.requests = atoi(value);
+        } else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--concurrency") == 0) {
+            options.concurrency = atoi(value);
+        } else if (strcmp(arg, "--latency-ms") == 0) {
+            options.latency_ms = atoi(value);
+        } else if (strcmp(arg, "--jitter-ms") == 0) {
+            options.jitter_ms = atoi(value);
+        } else if (strcmp(arg, "--tokens-per-sec") == 0) {
+            options.tokens_per_second = atoi(value);
+        } else if (strcmp(arg, "--reply-tokens") == 0) {
+            options.reply_tokens = atoi(value);
+        } else if (strcmp(arg, "--failure-rate") == 0) {
+            options.failure_rate = atof(value);
+        } else if (strcmp(arg, "--slots") == 0) {
+            options.slots = atoi(value);
+        } else if (strcmp(arg, "--distinct") == 0) {
+            options.distinct_prompts = atoi(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            options.seed = (unsigned int)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--llm-port") == 0) {
+            options.llm_port = atoi(value);
+        } else if (strcmp(arg, "--comfy-port") == 0) {
+            options.comfy_port = atoi(value);
+        } else if (strcmp(arg, "--config") == 0) {
+            options.config_path = value;
+        } else {
+            fprintf(stderr, "Error: unknown option %s\n", arg);
+            return 1;
+        }
+        if (takes_value) {
+            i++;
+        }
+    }
+
+    if (options.requests < 1) {
+        options.requests = 1;
+    }
+
+    if (options.serve) {
+        return serve(&options);
+    }
+
+    // Held until exit, so the pool outlives both clients like in a server
+    ServerConfig* server_config = NULL;
+    if (options.config_path != NULL) {
+        server_config = config_load(options.config_path);
+        char* error = NULL;
+        if (server_config == NULL || !config_validate(server_config, &error)) {
+            fprintf(stderr, "Error: bad config %s: %s\n", options.config_path,
+                    error != NULL ? error : "parse error");
+            free(error);
+            config_free(server_config);
+            return 1;
+        }
+    }
+    HttpPoolConfig pool = http_pool_config_from_server(server_config);
+    config_free(server_config);
+    http_pool_init(&pool);
+
+    if (!llm_init() || !comfyui_init()) {
+        fprintf(stderr, "Error: could not initialize HTTP clients\n");
+        http_pool_shutdown();
+        return 1;
+    }
+
+    const char* scenario = options.scenario;
+    bool all = scenario == NULL || strcmp(scenario, "all") == 0;
+    bool ran = false;
+    if (all || strcmp(scenario, "throughput") == 0) {
+        bench_throughput(&options);
+        ran = true;
+    }
+    if (all || strcmp(scenario, "stream") == 0) {
+        bench_stream(&options);
+        ran = true;
+    }
+    if (all || strcmp(scenario, "retry") == 0) {
+        bench_retry(&options);
+        ran = true;
+    }
+    if (all || strcmp(scenario, "cache") == 0) {
+        bench_cache(&options);
+        ran = true;
+    }
+    if (all || strcmp(scenario, "comfyui") == 0) {
+        bench_comfyui(&options);
+        ran = true;
+    }
+
+    comfyui_cleanup();
+    llm_cleanup();
+    http_pool_shutdown();
+
+    if (!ran) {
+        fprintf(stderr, "Error: unknown scenario %s\n", scenario);
+        return 1;
+    }
+    return 0;
+}
+/* }}} */
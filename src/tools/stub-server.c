@@ -0,0 +1,1251 @@
+/*
+ * stub-server.c - Deterministic Local LLM and ComfyUI Stub Servers
+ *
+ * One thread accepts connections and each connection gets a thread of
+ * its own, so slow replies overlap the way they do on a real server.
+ * Connections are closed after one response unless keep_alive is set;
+ * streams and WebSockets always end theirs. ComfyUI jobs run on a
+ * virtual timeline: a job's finish time is fixed when it is submitted,
+ * from the slot it will run on and its sampled run time. A WebSocket
+ * connection keeps its thread and replays that timeline as events for
+ * its client's jobs.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stub-server.h"
+#include "../../libs/cJSON.h"
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* {{{ Constants */
+#define REQUEST_MAX_BYTES (4 * 1024 * 1024)
+#define PROMPT_ID_MAX 48
+
+/* ComfyUI WebSocket: progress events per job, and how often an open
+ * socket looks for events to send */
+#define PROGRESS_STEPS 4
+#define SOCKET_TICK_MS 5
+static const char* WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static const char* REPLY_WORDS[] = {
+    "the", "banners", "of", "Symbeline", "rise", "over", "smoke", "and",
+    "iron", "while", "dire", "wolves", "circle", "a", "gilded", "caravan",
+    "knights", "charge", "through", "thornwood", "as", "arcane", "gears",
+    "turn", "beneath", "ancient", "towers", "scouts", "whisper", "of",
+    "victory", "ruin"
+};
+#define REPLY_WORD_COUNT (sizeof(REPLY_WORDS) / sizeof(REPLY_WORDS[0]))
+
+/* 1x1 transparent PNG */
+static const unsigned char STUB_PNG[] = {
+    0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+    0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0x15, 0xC4, 0x89, 0x00, 0x00, 0x00,
+    0x0A, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9C, 0x63, 0x00, 0x01, 0x00, 0x00,
+    0x05, 0x00, 0x01, 0x0D, 0x0A, 0x2D, 0xB4, 0x00, 0x00, 0x00, 0x00, 0x49,
+    0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82
+};
+
+/* Draws are salted so a request's latency and failure are independent */
+#define SALT_LATENCY 1
+#define SALT_FAILURE 2
+/* }}} */
+
+/* {{{ StubJob
+ * A submitted ComfyUI prompt.
+ */
+typedef struct {
+    unsigned long number;
+    long started_at_ms;
+    long done_at_ms;
+    bool failed;
+    char client_id[PROMPT_ID_MAX];  /* Whose WebSocket gets its events */
+} StubJob;
+/* }}} */
+
+/* {{{ StubServer */
+struct StubServer {
+    StubServerConfig config;
+    int listen_fd;
+    int port;
+    pthread_t accept_thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     /* A slot or connection was released */
+    int connections;            /* Connection threads still running */
+    int active;                 /* LLM requests holding a slot */
+    unsigned long next_sequence;
+    StubServerStats stats;
+
+    StubJob* jobs;
+    int job_count;
+    int job_cap;
+    long* slot_free_at_ms;      /* ComfyUI: when each slot next frees up */
+    bool stopping;
+    unsigned int socket_generation; /* Bumped to drop open WebSockets */
+};
+/* }}} */
+
+/* {{{ StubRequest */
+typedef struct {
+    char method[8];
+    char path[512];
+    char* body;
+    size_t body_len;
+    char ws_key[64];            /* Sec-WebSocket-Key, if any */
+    bool close;                 /* The response ends the connection */
+} StubRequest;
+/* }}} */
+
+/* {{{ now_ms */
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+/* }}} */
+
+/* {{{ sleep_ms */
+static void sleep_ms(long ms) {
+    if (ms <= 0) {
+        return;
+    }
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+/* }}} */
+
+/* {{{ mix64
+ * splitmix64 finalizer: a well-spread 64-bit value from any input.
+ */
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+/* }}} */
+
+/* {{{ draw_unit
+ * Deterministic draw in [0, 1) for one request and purpose.
+ */
+static double draw_unit(unsigned int seed, unsigned long sequence, int salt) {
+    uint64_t x = mix64(((uint64_t)seed << 32) ^ mix64(sequence * 4 + (uint64_t)salt));
+    return (double)(x >> 11) / 9007199254740992.0;
+}
+/* }}} */
+
+/* {{{ stub_latency_sample */
+int stub_latency_sample(const StubLatency* latency, unsigned int seed,
+                        unsigned long sequence) {
+    if (latency == NULL) {
+        return 0;
+    }
+
+    double u = draw_unit(seed, sequence, SALT_LATENCY);
+    double ms = latency->base_ms;
+    switch (latency->kind) {
+        case STUB_LATENCY_UNIFORM:
+            ms += u * latency->spread_ms;
+            break;
+        case STUB_LATENCY_EXPONENTIAL:
+            ms += -log(1.0 - u) * latency->spread_ms;
+            break;
+        case STUB_LATENCY_FIXED:
+        default:
+            break;
+    }
+    return ms > 0 ? (int)ms : 0;
+}
+/* }}} */
+
+/* {{{ stub_server_reply_text */
+char* stub_server_reply_text(unsigned int seed, const char* prompt,
+                             int reply_tokens) {
+    if (reply_tokens < 1) {
+        reply_tokens = 1;
+    }
+
+    /* FNV-1a of the prompt, so equal prompts get equal replies */
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const char* p = prompt != NULL ? prompt : ""; *p != '\0'; p++) {
+        hash = (hash ^ (unsigned char)*p) * 0x100000001B3ULL;
+    }
+    hash ^= seed;
+
+    size_t cap = (size_t)reply_tokens * 12 + 2;
+    char* text = malloc(cap);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < reply_tokens; i++) {
+        const char* word = REPLY_WORDS[mix64(hash + (uint64_t)i) % REPLY_WORD_COUNT];
+        len += (size_t)snprintf(text + len, cap - len, "%s%s",
+                                i == 0 ? "" : " ", word);
+    }
+    snprintf(text + len, cap - len, ".");
+    return text;
+}
+/* }}} */
+
+/* {{{ stub_server_default_config */
+StubServerConfig stub_server_default_config(StubServerKind kind) {
+    StubServerConfig config = {
+        .kind = kind,
+        .port = 0,
+        .seed = 1,
+        .latency = { STUB_LATENCY_FIXED, kind == STUB_SERVER_LLM ? 50 : 200, 0 },
+        .tokens_per_second = kind == STUB_SERVER_LLM ? 200 : 0,
+        .reply_tokens = 24,
+        .failure_rate = 0.0,
+        .failure_status = 503,
+        .slots = 0,
+        .websocket = kind == STUB_SERVER_COMFYUI,
+        .keep_alive = false,
+        .reply = NULL,
+        .reply_context = NULL
+    };
+    return config;
+}
+/* }}} */
+
+/* {{{ send_all
+ * Returns false once the client has gone away.
+ */
+static bool send_all(int fd, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        p += sent;
+        len -= (size_t)sent;
+    }
+    return true;
+}
+/* }}} */
+
+/* {{{ send_response */
+static bool send_response(const StubServer* server, int fd, int status,
+                          const char* content_type, const void* body,
+                          size_t body_len) {
+    const char* reason = status == 200 ? "OK" :
+                         status == 400 ? "Bad Request" :
+                         status == 404 ? "Not Found" :
+                         status == 429 ? "Too Many Requests" :
+                         status == 503 ? "Service Unavailable" : "Error";
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n"
+                       "Content-Length: %zu\r\nConnection: %s\r\n\r\n",
+                       status, reason, content_type, body_len,
+                       server->config.keep_alive ? "keep-alive" : "close");
+    return send_all(fd, header, (size_t)len) && send_all(fd, body, body_len);
+}
+/* }}} */
+
+/* {{{ send_json */
+static bool send_json(const StubServer* server, int fd, int status,
+                      const char* json) {
+    return send_response(server, fd, status, "application/json", json, strlen(json));
+}
+/* }}} */
+
+/* {{{ read_request
+ * Reads one request: the header block, then Content-Length bytes of body.
+ */
+static bool read_request(int fd, StubRequest* request) {
+    size_t cap = 8192;
+    size_t len = 0;
+    char* buffer = malloc(cap + 1);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    char* header_end = NULL;
+    size_t body_len = 0;
+    for (;;) {
+        if (header_end != NULL &&
+            len >= (size_t)(header_end - buffer) + 4 + body_len) {
+            break;
+        }
+        if (len == cap) {
+            if (cap >= REQUEST_MAX_BYTES) {
+                free(buffer);
+                return false;
+            }
+            size_t offset = header_end != NULL ? (size_t)(header_end - buffer) : 0;
+            char* grown = realloc(buffer, cap * 2 + 1);
+            if (grown == NULL) {
+                free(buffer);
+                return false;
+            }
+            buffer = grown;
+            cap *= 2;
+            if (header_end != NULL) {
+                header_end = buffer + offset;
+            }
+        }
+
+        ssize_t got = recv(fd, buffer + len, cap - len, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            free(buffer);
+            return false;
+        }
+        len += (size_t)got;
+        buffer[len] = '\0';
+
+        if (header_end == NULL && (header_end = strstr(buffer, "\r\n\r\n")) != NULL) {
+            *header_end = '\0';
+            for (char* line = strstr(buffer, "\r\n"); line != NULL;
+                 line = strstr(line + 2, "\r\n")) {
+                if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+                    body_len = strtoul(line + 17, NULL, 10);
+                } else if (strncasecmp(line + 2, "Sec-WebSocket-Key:", 18) == 0) {
+                    sscanf(line + 20, " %63[^\r\n ]", request->ws_key);
+                }
+            }
+            if (body_len > REQUEST_MAX_BYTES) {
+                free(buffer);
+                return false;
+            }
+        }
+    }
+
+    if (sscanf(buffer, "%7s %511s", request->method, request->path) != 2) {
+        free(buffer);
+        return false;
+    }
+
+    size_t body_start = (size_t)(header_end - buffer) + 4;
+    request->body = malloc(body_len + 1);
+    if (request->body == NULL) {
+        free(buffer);
+        return false;
+    }
+    memcpy(request->body, buffer + body_start, body_len);
+    request->body[body_len] = '\0';
+    request->body_len = body_len;
+
+    free(buffer);
+    return true;
+}
+/* }}} */
+
+/* {{{ take_sequence
+ * Numbers a request in arrival order and counts it.
+ */
+static unsigned long take_sequence(StubServer* server) {
+    pthread_mutex_lock(&server->lock);
+    unsigned long sequence = server->next_sequence++;
+    server->stats.requests++;
+    pthread_mutex_unlock(&server->lock);
+    return sequence;
+}
+/* }}} */
+
+/* {{{ acquire_slot */
+static void acquire_slot(StubServer* server) {
+    pthread_mutex_lock(&server->lock);
+    while (server->config.slots > 0 && server->active >= server->config.slots) {
+        pthread_cond_wait(&server->changed, &server->lock);
+    }
+    server->active++;
+    if (server->active > server->stats.peak_active) {
+        server->stats.peak_active = server->active;
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+/* }}} */
+
+/* {{{ release_slot */
+static void release_slot(StubServer* server) {
+    pthread_mutex_lock(&server->lock);
+    server->active--;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+}
+/* }}} */
+
+/* {{{ injected_failure */
+static bool injected_failure(StubServer* server, unsigned long sequence) {
+    if (draw_unit(server->config.seed, sequence, SALT_FAILURE) >=
+        server->config.failure_rate) {
+        return false;
+    }
+    pthread_mutex_lock(&server->lock);
+    server->stats.failures++;
+    pthread_mutex_unlock(&server->lock);
+    return true;
+}
+/* }}} */
+
+/* {{{ token_interval_ms */
+static long token_interval_ms(const StubServer* server) {
+    int rate = server->config.tokens_per_second;
+    return rate > 0 ? 1000L / rate : 0;
+}
+/* }}} */
+
+/* {{{ stream_reply
+ * Sends the reply as server-sent events, one word per chunk, token_ms
+ * apart.
+ */
+static void stream_reply(StubServer* server, int fd, const StubReply* reply) {
+    const char* header =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    if (!send_all(fd, header, strlen(header))) {
+        return;
+    }
+
+    const char* word = reply->text;
+    long sent = 0;
+    while (*word != '\0') {
+        const char* end = strchr(word, ' ');
+        size_t len = end != NULL ? (size_t)(end - word) + 1 : strlen(word);
+
+        char piece[64];
+        snprintf(piece, sizeof(piece), "%.*s", (int)len, word);
+        cJSON* chunk = cJSON_CreateObject();
+        cJSON* choices = cJSON_AddArrayToObject(chunk, "choices");
+        cJSON* choice = cJSON_CreateObject();
+        cJSON_AddNumberToObject(choice, "index", 0);
+        cJSON* delta = cJSON_AddObjectToObject(choice, "delta");
+        cJSON_AddStringToObject(delta, "content", piece);
+        cJSON_AddItemToArray(choices, choice);
+        char* json = cJSON_PrintUnformatted(chunk);
+        cJSON_Delete(chunk);
+
+        bool ok = json != NULL && send_all(fd, "data: ", 6) &&
+                  send_all(fd, json, strlen(json)) && send_all(fd, "\n\n", 2);
+        free(json);
+        if (!ok) {
+            break;
+        }
+        sent++;
+
+        word += len;
+        if (*word != '\0') {
+            sleep_ms(reply->token_ms);
+        }
+    }
+
+    char tail[256];
+    snprintf(tail, sizeof(tail),
+             "data: {\"choices\":[{\"index\":0,\"delta\":{},\"finish_reason\":\"stop\"}],"
+             "\"usage\":{\"prompt_tokens\":%d,\"completion_tokens\":%d,"
+             "\"total_tokens\":%d}}\n\ndata: [DONE]\n\n",
+             reply->prompt_tokens, reply->reply_tokens,
+             reply->prompt_tokens + reply->reply_tokens);
+
+    /* Counted before the stream ends so a client never sees stale stats */
+    pthread_mutex_lock(&server->lock);
+    server->stats.tokens += sent;
+    pthread_mutex_unlock(&server->lock);
+
+    send_all(fd, tail, strlen(tail));
+}
+/* }}} */
+
+/* {{{ send_reply
+ * Sends a whole reply as one chat.completion object, after the time the
+ * words after the first would take.
+ */
+static void send_reply(StubServer* server, int fd, const StubReply* reply,
+                       unsigned long sequence) {
+    sleep_ms((long)reply->token_ms * (reply->reply_tokens - 1));
+
+    cJSON* root = cJSON_CreateObject();
+    char id[PROMPT_ID_MAX];
+    snprintf(id, sizeof(id), "stub-%lu", sequence);
+    cJSON_AddStringToObject(root, "id", id);
+    cJSON_AddStringToObject(root, "object", "chat.completion");
+    cJSON_AddStringToObject(root, "model", "stub");
+    cJSON* choices = cJSON_AddArrayToObject(root, "choices");
+    cJSON* choice = cJSON_CreateObject();
+    cJSON_AddNumberToObject(choice, "index", 0);
+    cJSON* message = cJSON_AddObjectToObject(choice, "message");
+    cJSON_AddStringToObject(message, "role", "assistant");
+    cJSON_AddStringToObject(message, "content", reply->text);
+    cJSON_AddStringToObject(choice, "finish_reason", "stop");
+    cJSON_AddItemToArray(choices, choice);
+    cJSON* usage = cJSON_AddObjectToObject(root, "usage");
+    cJSON_AddNumberToObject(usage, "prompt_tokens", reply->prompt_tokens);
+    cJSON_AddNumberToObject(usage, "completion_tokens", reply->reply_tokens);
+    cJSON_AddNumberToObject(usage, "total_tokens",
+                            reply->prompt_tokens + reply->reply_tokens);
+    char* json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    pthread_mutex_lock(&server->lock);
+    server->stats.tokens += reply->reply_tokens;
+    pthread_mutex_unlock(&server->lock);
+
+    if (json != NULL) {
+        send_json(server, fd, 200, json);
+    }
+    free(json);
+}
+/* }}} */
+
+/* {{{ handle_chat */
+static void handle_chat(StubServer* server, int fd, StubRequest* request) {
+    unsigned long sequence = take_sequence(server);
+
+    cJSON* root = cJSON_Parse(request->body);
+    cJSON* messages = root != NULL ? cJSON_GetObjectItem(root, "messages") : NULL;
+    if (!cJSON_IsArray(messages) || cJSON_GetArraySize(messages) == 0) {
+        cJSON_Delete(root);
+        send_json(server, fd, 400, "{\"error\":{\"message\":\"messages required\"}}");
+        return;
+    }
+
+    /* Overloaded servers refuse at once rather than after the work */
+    if (injected_failure(server, sequence)) {
+        cJSON_Delete(root);
+        char body[128];
+        snprintf(body, sizeof(body),
+                 "{\"error\":{\"message\":\"stub: injected failure %lu\"}}", sequence);
+        send_json(server, fd, server->config.failure_status, body);
+        return;
+    }
+
+    cJSON* last = cJSON_GetArrayItem(messages, cJSON_GetArraySize(messages) - 1);
+    cJSON* content = cJSON_GetObjectItem(last, "content");
+    const char* prompt = cJSON_IsString(content) ? content->valuestring : "";
+
+    StubReply reply = {
+        .status = 200,
+        .prompt_tokens = (int)(request->body_len / 4),
+        .reply_tokens = server->config.reply_tokens > 0 ? server->config.reply_tokens : 1,
+        .delay_ms = stub_latency_sample(&server->config.latency, server->config.seed,
+                                        sequence),
+        .token_ms = (int)token_interval_ms(server),
+        .stream = cJSON_IsTrue(cJSON_GetObjectItem(root, "stream"))
+    };
+    reply.text = stub_server_reply_text(server->config.seed, prompt, reply.reply_tokens);
+    cJSON_Delete(root);
+    if (reply.text == NULL) {
+        send_json(server, fd, 500, "{\"error\":{\"message\":\"out of memory\"}}");
+        return;
+    }
+
+    acquire_slot(server);
+    if (server->config.reply != NULL) {
+        server->config.reply(request->body, &reply, server->config.reply_context);
+    }
+    sleep_ms(reply.delay_ms);
+
+    if (reply.status != 200 || reply.text == NULL) {
+        char body[128];
+        snprintf(body, sizeof(body),
+                 "{\"error\":{\"message\":\"stub: scripted status %d\"}}", reply.status);
+        send_json(server, fd, reply.status != 200 ? reply.status : 500, body);
+    } else if (reply.stream) {
+        pthread_mutex_lock(&server->lock);
+        server->stats.streamed++;
+        pthread_mutex_unlock(&server->lock);
+        stream_reply(server, fd, &reply);
+        request->close = true;
+    } else {
+        send_reply(server, fd, &reply, sequence);
+    }
+
+    release_slot(server);
+    free(reply.text);
+}
+/* }}} */
+
+/* {{{ handle_submit */
+static void handle_submit(StubServer* server, int fd, StubRequest* request) {
+    cJSON* root = cJSON_Parse(request->body);
+    bool valid = root != NULL;
+    char client_id[PROMPT_ID_MAX] = "";
+    cJSON* client = cJSON_GetObjectItem(root, "client_id");
+    if (cJSON_IsString(client)) {
+        snprintf(client_id, sizeof(client_id), "%s", client->valuestring);
+    }
+    cJSON_Delete(root);
+    if (!valid) {
+        send_json(server, fd, 400, "{\"error\":{\"message\":\"invalid prompt JSON\"}}");
+        return;
+    }
+
+    unsigned long sequence = take_sequence(server);
+    bool failed = injected_failure(server, sequence);
+    long run_ms = stub_latency_sample(&server->config.latency, server->config.seed,
+                                      sequence);
+    long now = now_ms();
+
+    pthread_mutex_lock(&server->lock);
+
+    /* Run on the slot that frees up first, after whatever it holds */
+    long start = now;
+    if (server->config.slots > 0) {
+        int slot = 0;
+        for (int i = 1; i < server->config.slots; i++) {
+            if (server->slot_free_at_ms[i] < server->slot_free_at_ms[slot]) {
+                slot = i;
+            }
+        }
+        if (server->slot_free_at_ms[slot] > start) {
+            start = server->slot_free_at_ms[slot];
+        }
+        server->slot_free_at_ms[slot] = start + run_ms;
+    }
+
+    bool stored = true;
+    if (server->job_count == server->job_cap) {
+        int cap = server->job_cap > 0 ? server->job_cap * 2 : 64;
+        StubJob* grown = realloc(server->jobs, sizeof(StubJob) * cap);
+        if (grown != NULL) {
+            server->jobs = grown;
+            server->job_cap = cap;
+        } else {
+            stored = false;
+        }
+    }
+    if (stored) {
+        StubJob* job = &server->jobs[server->job_count++];
+        job->number = sequence;
+        job->started_at_ms = start;
+        job->done_at_ms = start + run_ms;
+        job->failed = failed;
+        memcpy(job->client_id, client_id, sizeof(client_id));
+    }
+
+    int unfinished = 0;
+    for (int i = 0; i < server->job_count; i++) {
+        unfinished += server->jobs[i].done_at_ms > now;
+    }
+    if (server->config.slots > 0 && unfinished > server->config.slots) {
+        unfinished = server->config.slots;
+    }
+    if (unfinished > server->stats.peak_active) {
+        server->stats.peak_active = unfinished;
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    if (!stored) {
+        send_json(server, fd, 500, "{\"error\":{\"message\":\"out of memory\"}}");
+        return;
+    }
+
+    char body[128];
+    snprintf(body, sizeof(body),
+             "{\"prompt_id\":\"stub-%lu\",\"number\":%lu,\"node_errors\":{}}",
+             sequence, sequence);
+    send_json(server, fd, 200, body);
+}
+/* }}} */
+
+/* {{{ handle_history */
+static void handle_history(StubServer* server, int fd, const char* prompt_id) {
+    unsigned long number = 0;
+    bool known_form = sscanf(prompt_id, "stub-%lu", &number) == 1;
+    long now = now_ms();
+
+    pthread_mutex_lock(&server->lock);
+    server->stats.polls++;
+    StubJob job;
+    memset(&job, 0, sizeof(job));
+    bool found = false;
+    for (int i = 0; known_form && i < server->job_count; i++) {
+        if (server->jobs[i].number == number) {
+            job = server->jobs[i];
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    /* Queued, running and unknown prompts are all absent from history */
+    if (!found || job.done_at_ms > now) {
+        send_json(server, fd, 200, "{}");
+        return;
+    }
+
+    char body[512];
+    if (job.failed) {
+        snprintf(body, sizeof(body),
+                 "{\"%s\":{\"status\":{\"status_str\":\"error\",\"completed\":false,"
+                 "\"messages\":[[\"execution_error\",\"stub: injected failure %lu\"]]},"
+                 "\"outputs\":{}}}",
+                 prompt_id, job.number);
+    } else {
+        snprintf(body, sizeof(body),
+                 "{\"%s\":{\"status\":{\"status_str\":\"success\",\"completed\":true,"
+                 "\"messages\":[]},\"outputs\":{\"9\":{\"images\":[{\"filename\":"
+                 "\"stub-%lu.png\",\"subfolder\":\"\",\"type\":\"output\"}]}}}}",
+                 prompt_id, job.number);
+    }
+    send_json(server, fd, 200, body);
+}
+/* }}} */
+
+/* {{{ handle_view */
+static void handle_view(StubServer* server, int fd, const char* query) {
+    const char* filename = strstr(query, "filename=");
+    if (filename == NULL || strncmp(filename + 9, "stub-", 5) != 0) {
+        send_json(server, fd, 404, "{\"error\":{\"message\":\"no such image\"}}");
+        return;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stats.images++;
+    pthread_mutex_unlock(&server->lock);
+    send_response(server, fd, 200, "image/png", STUB_PNG, sizeof(STUB_PNG));
+}
+/* }}} */
+
+/* {{{ sha1
+ * SHA-1 digest, used only to answer the WebSocket handshake.
+ */
+static void sha1(const unsigned char* data, size_t len, unsigned char digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    unsigned char* message = calloc(total, 1);
+    if (message == NULL) {
+        memset(digest, 0, 20);
+        return;
+    }
+    memcpy(message, data, len);
+    message[len] = 0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) {
+        message[total - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    for (size_t block = 0; block < total; block += 64) {
+        const unsigned char* m = message + block;
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)m[4 * i] << 24 | (uint32_t)m[4 * i + 1] << 16 |
+                   (uint32_t)m[4 * i + 2] << 8 | (uint32_t)m[4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = x << 1 | x >> 31;
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = b << 30 | b >> 2;
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    free(message);
+
+    for (int i = 0; i < 20; i++) {
+        digest[i] = (unsigned char)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+/* }}} */
+
+/* {{{ base64_encode
+ * out must hold 4 * ((len + 2) / 3) + 1 bytes.
+ */
+static void base64_encode(const unsigned char* data, size_t len, char* out) {
+    static const char ALPHABET[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        out[o++] = ALPHABET[(v >> 18) & 63];
+        out[o++] = ALPHABET[(v >> 12) & 63];
+        out[o++] = i + 1 < len ? ALPHABET[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < len ? ALPHABET[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+/* }}} */
+
+/* {{{ send_event
+ * Sends one unmasked WebSocket text frame and counts it.
+ */
+static bool send_event(StubServer* server, int fd, const char* json) {
+    size_t len = strlen(json);
+    unsigned char header[4] = { 0x81, 0, 0, 0 };
+    size_t header_len = 2;
+    if (len < 126) {
+        header[1] = (unsigned char)len;
+    } else {
+        header[1] = 126;
+        header[2] = (unsigned char)(len >> 8);
+        header[3] = (unsigned char)len;
+        header_len = 4;
+    }
+    if (!send_all(fd, header, header_len) || !send_all(fd, json, len)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stats.events++;
+    pthread_mutex_unlock(&server->lock);
+    return true;
+}
+/* }}} */
+
+/* {{{ send_job_events
+ * Sends whatever job has done since *sent events went out: -1 nothing
+ * yet, 0 started, 1 to PROGRESS_STEPS progress, PROGRESS_STEPS + 1 done.
+ */
+static bool send_job_events(StubServer* server, int fd, const StubJob* job,
+                            long now, int* sent) {
+    if (now < job->started_at_ms) {
+        return true;
+    }
+
+    char event[512];
+    bool ok = true;
+    if (*sent < 0) {
+        snprintf(event, sizeof(event),
+                 "{\"type\":\"execution_start\",\"data\":{\"prompt_id\":\"stub-%lu\"}}",
+                 job->number);
+        ok = send_event(server, fd, event);
+        *sent = 0;
+    }
+
+    long run_ms = job->done_at_ms - job->started_at_ms;
+    bool done = now >= job->done_at_ms;
+    int steps = done || run_ms <= 0 ? PROGRESS_STEPS :
+                (int)((now - job->started_at_ms) * PROGRESS_STEPS / run_ms);
+    while (ok && *sent < steps) {
+        (*sent)++;
+        snprintf(event, sizeof(event),
+                 "{\"type\":\"progress\",\"data\":{\"value\":%d,\"max\":%d,"
+                 "\"prompt_id\":\"stub-%lu\",\"node\":\"3\"}}",
+                 *sent, PROGRESS_STEPS, job->number);
+        ok = send_event(server, fd, event);
+    }
+
+    if (ok && done && *sent == PROGRESS_STEPS) {
+        *sent = PROGRESS_STEPS + 1;
+        if (job->failed) {
+            snprintf(event, sizeof(event),
+                     "{\"type\":\"execution_error\",\"data\":{\"prompt_id\":\"stub-%lu\","
+                     "\"node_id\":\"3\",\"node_type\":\"KSampler\","
+                     "\"exception_message\":\"stub: injected failure %lu\"}}",
+                     job->number, job->number);
+            return send_event(server, fd, event);
+        }
+        snprintf(event, sizeof(event),
+                 "{\"type\":\"executed\",\"data\":{\"node\":\"9\",\"output\":{\"images\":"
+                 "[{\"filename\":\"stub-%lu.png\",\"subfolder\":\"\",\"type\":\"output\"}]},"
+                 "\"prompt_id\":\"stub-%lu\"}}",
+                 job->number, job->number);
+        ok = send_event(server, fd, event);
+        snprintf(event, sizeof(event),
+                 "{\"type\":\"execution_success\",\"data\":{\"prompt_id\":\"stub-%lu\"}}",
+                 job->number);
+        ok = ok && send_event(server, fd, event);
+        snprintf(event, sizeof(event),
+                 "{\"type\":\"executing\",\"data\":{\"node\":null,\"prompt_id\":\"stub-%lu\"}}",
+                 job->number);
+        ok = ok && send_event(server, fd, event);
+    }
+    return ok;
+}
+/* }}} */
+
+/* {{{ handle_socket
+ * Upgrades to a WebSocket and keeps it open, sending the events of the
+ * client's jobs, until the client leaves, the socket is dropped or the
+ * server stops.
+ */
+static void handle_socket(StubServer* server, int fd, StubRequest* request,
+                          const char* query) {
+    if (!server->config.websocket || request->ws_key[0] == '\0') {
+        send_json(server, fd, 404, "{\"error\":{\"message\":\"not found\"}}");
+        return;
+    }
+    request->close = true;
+
+    char client_id[PROMPT_ID_MAX] = "";
+    const char* id = query != NULL ? strstr(query, "clientId=") : NULL;
+    if (id != NULL) {
+        sscanf(id + 9, "%47[^&]", client_id);
+    }
+
+    char key[128];
+    snprintf(key, sizeof(key), "%s%s", request->ws_key, WS_GUID);
+    unsigned char digest[20];
+    sha1((const unsigned char*)key, strlen(key), digest);
+    char accept[32];
+    base64_encode(digest, sizeof(digest), accept);
+
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                       "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+    if (!send_all(fd, header, (size_t)len)) {
+        return;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stats.sockets++;
+    unsigned int generation = server->socket_generation;
+    pthread_mutex_unlock(&server->lock);
+
+    char status[256];
+    snprintf(status, sizeof(status),
+             "{\"type\":\"status\",\"data\":{\"status\":{\"exec_info\":"
+             "{\"queue_remaining\":0}},\"sid\":\"%s\"}}", client_id);
+    bool open = send_event(server, fd, status);
+
+    int* sent = NULL;
+    int tracked = 0;
+    while (open) {
+        /* Whatever the client sends (pongs, close) is read and dropped */
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, SOCKET_TICK_MS) > 0) {
+            char discard[512];
+            ssize_t got = recv(fd, discard, sizeof(discard), 0);
+            if (got == 0 || (got < 0 && errno != EINTR)) {
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&server->lock);
+        bool closing = server->stopping || server->socket_generation != generation;
+        int count = server->job_count;
+        StubJob* jobs = count > 0 ? malloc(sizeof(StubJob) * count) : NULL;
+        if (jobs != NULL) {
+            memcpy(jobs, server->jobs, sizeof(StubJob) * count);
+        }
+        pthread_mutex_unlock(&server->lock);
+        if (closing) {
+            free(jobs);
+            break;
+        }
+
+        if (jobs != NULL && count > tracked) {
+            int* grown = realloc(sent, sizeof(int) * count);
+            if (grown != NULL) {
+                sent = grown;
+                for (int i = tracked; i < count; i++) {
+                    sent[i] = -1;
+                }
+                tracked = count;
+            }
+        }
+
+        long now = now_ms();
+        for (int i = 0; open && i < tracked && jobs != NULL; i++) {
+            if (client_id[0] != '\0' && strcmp(jobs[i].client_id, client_id) == 0) {
+                open = send_job_events(server, fd, &jobs[i], now, &sent[i]);
+            }
+        }
+        free(jobs);
+    }
+    free(sent);
+}
+/* }}} */
+
+/* {{{ handle_request */
+static void handle_request(StubServer* server, int fd, StubRequest* request) {
+    bool post = strcmp(request->method, "POST") == 0;
+    bool get = strcmp(request->method, "GET") == 0;
+
+    if (server->config.kind == STUB_SERVER_LLM) {
+        if (post && strcmp(request->path, "/v1/chat/completions") == 0) {
+            handle_chat(server, fd, request);
+            return;
+        }
+    } else {
+        if (post && strcmp(request->path, "/prompt") == 0) {
+            handle_submit(server, fd, request);
+            return;
+        }
+        if (get && strncmp(request->path, "/history/", 9) == 0) {
+            handle_history(server, fd, request->path + 9);
+            return;
+        }
+        if (get && strncmp(request->path, "/view?", 6) == 0) {
+            handle_view(server, fd, request->path + 6);
+            return;
+        }
+        if (get && (strcmp(request->path, "/ws") == 0 ||
+                    strncmp(request->path, "/ws?", 4) == 0)) {
+            handle_socket(server, fd, request, strchr(request->path, '?'));
+            return;
+        }
+    }
+
+    send_json(server, fd, 404, "{\"error\":{\"message\":\"not found\"}}");
+}
+/* }}} */
+
+/* {{{ ConnectionArgs */
+typedef struct {
+    StubServer* server;
+    int fd;
+} ConnectionArgs;
+/* }}} */
+
+/* {{{ await_request
+ * Waits for the next request on a kept-alive connection. Returns false
+ * once the client has gone away or the server is stopping.
+ */
+static bool await_request(StubServer* server, int fd) {
+    for (;;) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, SOCKET_TICK_MS);
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+
+        pthread_mutex_lock(&server->lock);
+        bool stopping = server->stopping;
+        pthread_mutex_unlock(&server->lock);
+        if (stopping) {
+            return false;
+        }
+    }
+}
+/* }}} */
+
+/* {{{ connection_thread */
+static void* connection_thread(void* arg) {
+    ConnectionArgs* args = arg;
+    StubServer* server = args->server;
+
+    for (;;) {
+        StubRequest request;
+        memset(&request, 0, sizeof(request));
+        if (!read_request(args->fd, &request)) {
+            break;
+        }
+        handle_request(server, args->fd, &request);
+        free(request.body);
+        if (request.close || !server->config.keep_alive ||
+            !await_request(server, args->fd)) {
+            break;
+        }
+    }
+    close(args->fd);
+    free(args);
+
+    pthread_mutex_lock(&server->lock);
+    server->connections--;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+/* }}} */
+
+/* {{{ accept_thread */
+static void* accept_thread(void* arg) {
+    StubServer* server = arg;
+
+    for (;;) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NULL;  /* Listening socket shut down */
+        }
+
+        ConnectionArgs* args = malloc(sizeof(ConnectionArgs));
+        if (args == NULL) {
+            close(fd);
+            continue;
+        }
+        args->server = server;
+        args->fd = fd;
+
+        pthread_mutex_lock(&server->lock);
+        server->connections++;
+        server->stats.connections++;
+        pthread_mutex_unlock(&server->lock);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_thread, args) != 0) {
+            close(fd);
+            free(args);
+            pthread_mutex_lock(&server->lock);
+            server->connections--;
+            pthread_mutex_unlock(&server->lock);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+/* }}} */
+
+/* {{{ stub_server_start */
+StubServer* stub_server_start(const StubServerConfig* config) {
+    if (config == NULL) {
+        return NULL;
+    }
+
+    StubServer* server = calloc(1, sizeof(StubServer));
+    if (server == NULL) {
+        return NULL;
+    }
+    server->config = *config;
+    if (server->config.slots > 0) {
+        server->slot_free_at_ms = calloc(server->config.slots, sizeof(long));
+        if (server->slot_free_at_ms == NULL) {
+            free(server);
+            return NULL;
+        }
+    }
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->listen_fd < 0) {
+        free(server->slot_free_at_ms);
+        free(server);
+        return NULL;
+    }
+    int reuse = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)config->port);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(server->listen_fd, 128) != 0 ||
+        getsockname(server->listen_fd, (struct sockaddr*)&addr, &addr_len) != 0) {
+        close(server->listen_fd);
+        free(server->slot_free_at_ms);
+        free(server);
+        return NULL;
+    }
+    server->port = ntohs(addr.sin_port);
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->changed, NULL);
+    if (pthread_create(&server->accept_thread, NULL, accept_thread, server) != 0) {
+        close(server->listen_fd);
+        pthread_mutex_destroy(&server->lock);
+        pthread_cond_destroy(&server->changed);
+        free(server->slot_free_at_ms);
+        free(server);
+        return NULL;
+    }
+
+    return server;
+}
+/* }}} */
+
+/* {{{ stub_server_stop */
+void stub_server_stop(StubServer* server) {
+    if (server == NULL) {
+        return;
+    }
+
+    shutdown(server->listen_fd, SHUT_RDWR);
+    pthread_join(server->accept_thread, NULL);
+    close(server->listen_fd);
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    while (server->connections > 0) {
+        pthread_cond_wait(&server->changed, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->changed);
+    free(server->jobs);
+    free(server->slot_free_at_ms);
+    free(server);
+}
+/* }}} */
+
+/* {{{ stub_server_port */
+int stub_server_port(const StubServer* server) {
+    return server != NULL ? server->port : 0;
+}
+/* }}} */
+
+/* {{{ stub_server_get_stats */
+StubServerStats stub_server_get_stats(StubServer* server) {
+    StubServerStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (server != NULL) {
+        pthread_mutex_lock(&server->lock);
+        stats = server->stats;
+        pthread_mutex_unlock(&server->lock);
+    }
+    return stats;
+}
+/* }}} */
+
+/* {{{ stub_server_reset_stats */
+void stub_server_reset_stats(StubServer* server) {
+    if (server == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&server->lock);
+    memset(&server->stats, 0, sizeof(server->stats));
+    pthread_mutex_unlock(&server->lock);
+}
+/* }}} */
+
+/* {{{ stub_server_drop_sockets */
+void stub_server_drop_sockets(StubServer* server) {
+    if (server == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&server->lock);
+    server->socket_generation++;
+    pthread_mutex_unlock(&server->lock);
+}
+/* }}} */
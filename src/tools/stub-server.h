@@ -0,0 +1,139 @@
+/*
+ * stub-server.h - Deterministic Local LLM and ComfyUI Stub Servers
+ *
+ * In-process HTTP servers that stand in for a model server and an image
+ * server, so latency, retries and caching can be measured offline:
+ * - LLM: POST /v1/chat/completions, OpenAI-compatible, with or without
+ *   "stream": true (server-sent events)
+ * - ComfyUI: POST /prompt, GET /history/{prompt_id}, GET /view?filename=
+ *   and the /ws?clientId= WebSocket, which pushes execution_start,
+ *   progress and completion events for prompts submitted with that
+ *   client_id
+ *
+ * Latency, token rate, injected failures and the number of requests
+ * served at once are configurable, and tests can script the LLM's
+ * replies with a hook. Every random choice is drawn from
+ * the seed and the request's arrival number, and replies depend only on
+ * the seed and the prompt, so a run can be repeated exactly.
+ */
+
+#ifndef TOOLS_STUB_SERVER_H
+#define TOOLS_STUB_SERVER_H
+
+#include <stdbool.h>
+
+/* {{{ StubServerKind */
+typedef enum {
+    STUB_SERVER_LLM,            /* OpenAI-compatible chat completions */
+    STUB_SERVER_COMFYUI         /* ComfyUI prompt/history/view */
+} StubServerKind;
+/* }}} */
+
+/* {{{ StubLatencyKind
+ * Shape of the delay before a reply starts (LLM) or a job finishes
+ * (ComfyUI).
+ */
+typedef enum {
+    STUB_LATENCY_FIXED,         /* Always base_ms */
+    STUB_LATENCY_UNIFORM,       /* base_ms to base_ms + spread_ms */
+    STUB_LATENCY_EXPONENTIAL    /* base_ms plus an exponential tail, mean spread_ms */
+} StubLatencyKind;
+/* }}} */
+
+/* {{{ StubLatency */
+typedef struct {
+    StubLatencyKind kind;
+    int base_ms;
+    int spread_ms;
+} StubLatency;
+/* }}} */
+
+/* {{{ StubReply
+ * An LLM reply as a reply hook sees it. The server fills it in first:
+ * status 200, the seeded text, the usage estimate, the drawn latency,
+ * the configured token rate and the request's "stream" flag.
+ */
+typedef struct {
+    int status;                 /* Anything but 200 is sent as an error */
+    char* text;                 /* Message content; malloc'd, freed by the server */
+    int prompt_tokens;          /* Reported usage */
+    int reply_tokens;
+    int delay_ms;               /* Wait before the first word */
+    int token_ms;               /* Wait between words */
+    bool stream;                /* Answer with server-sent events */
+} StubReply;
+/* }}} */
+
+/* {{{ StubReplyFunc
+ * Rewrites reply for the chat request whose JSON body is body. Called on
+ * the request's thread, concurrently with other requests unless slots
+ * serializes them, while the request holds its slot.
+ */
+typedef void (*StubReplyFunc)(const char* body, StubReply* reply, void* context);
+/* }}} */
+
+/* {{{ StubServerConfig */
+typedef struct {
+    StubServerKind kind;
+    int port;                   /* 0 = any free port on 127.0.0.1 */
+    unsigned int seed;
+    StubLatency latency;        /* Time to first token, or job run time */
+    int tokens_per_second;      /* LLM generation rate; 0 = instant */
+    int reply_tokens;           /* Words in each LLM reply */
+    double failure_rate;        /* Fraction of requests that fail, 0.0 - 1.0 */
+    int failure_status;         /* HTTP status of an injected LLM failure */
+    int slots;                  /* Requests or jobs served at once; 0 = unlimited */
+    bool websocket;             /* ComfyUI: serve /ws (on by default) */
+    bool keep_alive;            /* Serve further requests on a connection */
+    StubReplyFunc reply;        /* LLM: scripts replies; NULL = seeded replies */
+    void* reply_context;
+} StubServerConfig;
+/* }}} */
+
+/* {{{ StubServerStats */
+typedef struct {
+    int requests;               /* Chat requests, or prompts submitted */
+    int streamed;               /* Chat requests answered as a stream */
+    int failures;               /* Injected failures */
+    int polls;                  /* ComfyUI history requests */
+    int images;                 /* ComfyUI images served */
+    int peak_active;            /* Most requests or jobs running at once */
+    int sockets;                /* ComfyUI WebSockets accepted */
+    int events;                 /* ComfyUI WebSocket messages sent */
+    long tokens;                /* LLM reply words sent */
+    int connections;            /* TCP connections accepted */
+} StubServerStats;
+/* }}} */
+
+typedef struct StubServer StubServer;
+
+/* {{{ Function Prototypes */
+StubServerConfig stub_server_default_config(StubServerKind kind);
+
+/* Starts listening and serving on background threads. Returns NULL if
+ * the port cannot be bound. */
+StubServer* stub_server_start(const StubServerConfig* config);
+
+/* Stops accepting, waits for requests in progress, closes idle
+ * keep-alive connections and frees the server. */
+void stub_server_stop(StubServer* server);
+
+int stub_server_port(const StubServer* server);
+StubServerStats stub_server_get_stats(StubServer* server);
+void stub_server_reset_stats(StubServer* server);
+
+/* Closes every open ComfyUI WebSocket, as a restarting server would.
+ * Clients may connect again at once. */
+void stub_server_drop_sockets(StubServer* server);
+
+/* Draws the delay for request number sequence, in milliseconds. */
+int stub_latency_sample(const StubLatency* latency, unsigned int seed,
+                        unsigned long sequence);
+
+/* Builds the reply the LLM stub gives for prompt: reply_tokens words
+ * chosen by the seed and the prompt. Caller must free. */
+char* stub_server_reply_text(unsigned int seed, const char* prompt,
+                             int reply_tokens);
+/* }}} */
+
+#endif /* TOOLS_STUB_SERVER_H */
@@ -7,6 +7,7 @@
  */
 
 #include "01-comfyui-client.h"
+#include "../net/09-http-pool.h"
 #include "../../libs/cJSON.h"
 #include <curl/curl.h>
 #include <stdio.h>
@@ -117,12 +118,17 @@ void comfyui_config_free(ComfyUIConfig* config) {
 // {{{ comfyui_init
 bool comfyui_init(void) {
     CURLcode res = curl_global_init(CURL_GLOBAL_DEFAULT);
-    return res == CURLE_OK;
+    if (res != CURLE_OK) {
+        return false;
+    }
+    http_pool_init(NULL);
+    return true;
 }
 // }}}
 
 // {{{ comfyui_cleanup
 void comfyui_cleanup(void) {
+    http_pool_shutdown();
     curl_global_cleanup();
 }
 // }}}
@@ -177,7 +183,7 @@ void comfyui_response_free(ComfyUIResponse* response) {
 // {{{ http_get
 // Performs HTTP GET request and returns response body.
 static char* http_get(const char* url, int timeout_ms, long* http_code) {
-    CURL* curl = curl_easy_init();
+    CURL* curl = http_pool_acquire(url);
     if (curl == NULL) {
         return NULL;
     }
@@ -196,7 +202,7 @@ static char* http_get(const char* url, int timeout_ms, long* http_code) {
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_code);
     }
 
-    curl_easy_cleanup(curl);
+    http_pool_release(curl);
 
     if (res != CURLE_OK) {
         buffer_free(&buffer);
@@ -210,7 +216,7 @@ static char* http_get(const char* url, int timeout_ms, long* http_code) {
 // {{{ http_get_binary
 // Performs HTTP GET request and returns binary response.
 static unsigned char* http_get_binary(const char* url, int timeout_ms, size_t* size) {
-    CURL* curl = curl_easy_init();
+    CURL* curl = http_pool_acquire(url);
     if (curl == NULL) {
         return NULL;
     }
@@ -224,7 +230,7 @@ static unsigned char* http_get_binary(const char* url, int timeout_ms, size_t* s
     curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout_ms);
 
     CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
+    http_pool_release(curl);
 
     if (res != CURLE_OK) {
         buffer_free(&buffer);
@@ -240,7 +246,7 @@ static unsigned char* http_get_binary(const char* url, int timeout_ms, size_t* s
 // Performs HTTP POST with JSON body.
 static char* http_post_json(const char* url, const char* json_body,
                              int timeout_ms, long* http_code) {
-    CURL* curl = curl_easy_init();
+    CURL* curl = http_pool_acquire(url);
     if (curl == NULL) {
         return NULL;
     }
@@ -265,8 +271,8 @@ static char* http_post_json(const char* url, const char* json_body,
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_code);
     }
 
+    http_pool_release(curl);
     curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
 
     if (res != CURLE_OK) {
         buffer_free(&buffer);
@@ -277,6 +283,51 @@ static char* http_post_json(const char* url, const char* json_body,
 }
 // }}}
 
+// {{{ comfyui_build_prompt_request
+char* comfyui_build_prompt_request(const char* workflow_json, const char* client_id) {
+    if (workflow_json == NULL) {
+        return NULL;
+    }
+
+    // Build request body with workflow as "prompt" field
+    cJSON* prompt = cJSON_Parse(workflow_json);
+    if (prompt == NULL) {
+        return NULL;
+    }
+    cJSON* request = cJSON_CreateObject();
+    cJSON_AddItemToObject(request, "prompt", prompt);
+    if (client_id != NULL) {
+        cJSON_AddStringToObject(request, "client_id", client_id);
+    }
+
+    char* request_json = cJSON_PrintUnformatted(request);
+    cJSON_Delete(request);
+    return request_json;
+}
+// }}}
+
+// {{{ comfyui_parse_prompt_id
+char* comfyui_parse_prompt_id(const char* body) {
+    if (body == NULL) {
+        return NULL;
+    }
+
+    cJSON* response_json = cJSON_Parse(body);
+    if (response_json == NULL) {
+        return NULL;
+    }
+
+    cJSON* prompt_id = cJSON_GetObjectItem(response_json, "prompt_id");
+    char* result = NULL;
+    if (prompt_id != NULL && cJSON_IsString(prompt_id)) {
+        result = strdup_safe(prompt_id->valuestring);
+    }
+
+    cJSON_Delete(response_json);
+    return result;
+}
+// }}}
+
 // {{{ comfyui_submit_workflow
 char* comfyui_submit_workflow(const ComfyUIConfig* config,
                                const char* workflow_json) {
@@ -295,18 +346,11 @@ char* comfyui_submit_workflow(const ComfyUIConfig* config,
     snprintf(url, url_len, "%s/prompt", base_url);
     free(base_url);
 
-    // Build request body with workflow as "prompt" field
-    cJSON* request = cJSON_CreateObject();
-    cJSON* prompt = cJSON_Parse(workflow_json);
-    if (prompt == NULL) {
+    char* request_json = comfyui_build_prompt_request(workflow_json, NULL);
+    if (request_json == NULL) {
         free(url);
-        cJSON_Delete(request);
         return NULL;
     }
-    cJSON_AddItemToObject(request, "prompt", prompt);
-
-    char* request_json = cJSON_PrintUnformatted(request);
-    cJSON_Delete(request);
 
     // Submit workflow
     long http_code = 0;
@@ -319,30 +363,16 @@ char* comfyui_submit_workflow(const ComfyUIConfig* config,
         return NULL;
     }
 
-    // Parse prompt_id from response
-    cJSON* response_json = cJSON_Parse(response);
+    char* result = comfyui_parse_prompt_id(response);
     free(response);
-
-    if (response_json == NULL) {
-        return NULL;
-    }
-
-    cJSON* prompt_id = cJSON_GetObjectItem(response_json, "prompt_id");
-    char* result = NULL;
-    if (prompt_id != NULL && cJSON_IsString(prompt_id)) {
-        result = strdup_safe(prompt_id->valuestring);
-    }
-
-    cJSON_Delete(response_json);
     return result;
 }
 // }}}
 
-// {{{ comfyui_get_status
-ComfyUIResponse* comfyui_get_status(const ComfyUIConfig* config,
-                                     const char* prompt_id) {
+// {{{ comfyui_parse_history
+ComfyUIResponse* comfyui_parse_history(const char* prompt_id, const char* history) {
     ComfyUIResponse* response = comfyui_response_create();
-    if (response == NULL || config == NULL || prompt_id == NULL) {
+    if (response == NULL || prompt_id == NULL || history == NULL) {
         if (response != NULL) {
             response->status = COMFYUI_STATUS_ERROR;
             response->error_message = strdup_safe("Invalid arguments");
@@ -352,33 +382,7 @@ ComfyUIResponse* comfyui_get_status(const ComfyUIConfig* config,
 
     response->prompt_id = strdup_safe(prompt_id);
 
-    char* base_url = comfyui_get_endpoint(config);
-    if (base_url == NULL) {
-        response->status = COMFYUI_STATUS_ERROR;
-        response->error_message = strdup_safe("Failed to build endpoint URL");
-        return response;
-    }
-
-    // Build history URL
-    size_t url_len = strlen(base_url) + strlen("/history/") + strlen(prompt_id) + 1;
-    char* url = malloc(url_len);
-    snprintf(url, url_len, "%s/history/%s", base_url, prompt_id);
-    free(base_url);
-
-    long http_code = 0;
-    char* history = http_get(url, config->timeout_ms, &http_code);
-    free(url);
-
-    if (history == NULL) {
-        response->status = COMFYUI_STATUS_ERROR;
-        response->error_message = strdup_safe("Failed to get history");
-        return response;
-    }
-
-    // Parse history response
     cJSON* history_json = cJSON_Parse(history);
-    free(history);
-
     if (history_json == NULL) {
         response->status = COMFYUI_STATUS_ERROR;
         response->error_message = strdup_safe("Failed to parse history JSON");
@@ -435,7 +439,7 @@ ComfyUIResponse* comfyui_get_status(const ComfyUIConfig* config,
                         cJSON* filename = cJSON_GetObjectItem(first_image, "filename");
                         if (filename != NULL && cJSON_IsString(filename)) {
                             // Found output filename - store in error_message temporarily
-                            // (will be used by wait_for_completion to fetch image)
+                            // (the caller fetches the image with it)
                             response->error_message = strdup_safe(filename->valuestring);
                             break;
                         }
@@ -451,11 +455,53 @@ ComfyUIResponse* comfyui_get_status(const ComfyUIConfig* config,
 }
 // }}}
 
-// {{{ comfyui_get_image
-unsigned char* comfyui_get_image(const ComfyUIConfig* config,
-                                  const char* filename,
-                                  size_t* size) {
-    if (config == NULL || filename == NULL || size == NULL) {
+// {{{ comfyui_get_status
+ComfyUIResponse* comfyui_get_status(const ComfyUIConfig* config,
+                                     const char* prompt_id) {
+    ComfyUIResponse* response = comfyui_response_create();
+    if (response == NULL || config == NULL || prompt_id == NULL) {
+        if (response != NULL) {
+            response->status = COMFYUI_STATUS_ERROR;
+            response->error_message = strdup_safe("Invalid arguments");
+        }
+        return response;
+    }
+
+    response->prompt_id = strdup_safe(prompt_id);
+
+    char* base_url = comfyui_get_endpoint(config);
+    if (base_url == NULL) {
+        response->status = COMFYUI_STATUS_ERROR;
+        response->error_message = strdup_safe("Failed to build endpoint URL");
+        return response;
+    }
+
+    // Build history URL
+    size_t url_len = strlen(base_url) + strlen("/history/") + strlen(prompt_id) + 1;
+    char* url = malloc(url_len);
+    snprintf(url, url_len, "%s/history/%s", base_url, prompt_id);
+    free(base_url);
+
+    long http_code = 0;
+    char* history = http_get(url, config->timeout_ms, &http_code);
+    free(url);
+
+    if (history == NULL) {
+        response->status = COMFYUI_STATUS_ERROR;
+        response->error_message = strdup_safe("Failed to get history");
+        return response;
+    }
+
+    comfyui_response_free(response);
+    response = comfyui_parse_history(prompt_id, history);
+    free(history);
+    return response;
+}
+// }}}
+
+// {{{ comfyui_get_image_url
+char* comfyui_get_image_url(const ComfyUIConfig* config, const char* filename) {
+    if (config == NULL || filename == NULL) {
         return NULL;
     }
 
@@ -468,14 +514,36 @@ unsigned char* comfyui_get_image(const ComfyUIConfig* config,
     CURL* curl = curl_easy_init();
     char* encoded_filename = curl_easy_escape(curl, filename, 0);
     curl_easy_cleanup(curl);
+    if (encoded_filename == NULL) {
+        free(base_url);
+        return NULL;
+    }
 
     // Build view URL
     size_t url_len = strlen(base_url) + strlen("/view?filename=") +
                      strlen(encoded_filename) + 1;
     char* url = malloc(url_len);
-    snprintf(url, url_len, "%s/view?filename=%s", base_url, encoded_filename);
+    if (url != NULL) {
+        snprintf(url, url_len, "%s/view?filename=%s", base_url, encoded_filename);
+    }
     free(base_url);
     curl_free(encoded_filename);
+    return url;
+}
+// }}}
+
+// {{{ comfyui_get_image
+unsigned char* comfyui_get_image(const ComfyUIConfig* config,
+                                  const char* filename,
+                                  size_t* size) {
+    if (config == NULL || filename == NULL || size == NULL) {
+        return NULL;
+    }
+
+    char* url = comfyui_get_image_url(config, filename);
+    if (url == NULL) {
+        return NULL;
+    }
 
     unsigned char* data = http_get_binary(url, config->timeout_ms, size);
     free(url);
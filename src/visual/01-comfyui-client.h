@@ -58,7 +58,8 @@ bool comfyui_init(void);
 // }}}
 
 // {{{ comfyui_cleanup
-// Cleans up the ComfyUI client. Call once at shutdown.
+// Cleans up the ComfyUI client. Call once at shutdown. Pooled connections
+// are only closed once no other client holds the pool (http_pool_shutdown).
 void comfyui_cleanup(void);
 // }}}
 
@@ -94,6 +95,34 @@ unsigned char* comfyui_get_image(const ComfyUIConfig* config,
                                   size_t* size);
 // }}}
 
+// {{{ comfyui_get_image_url
+// Returns the URL that serves a generated image.
+// Caller must free returned string.
+char* comfyui_get_image_url(const ComfyUIConfig* config, const char* filename);
+// }}}
+
+// {{{ comfyui_build_prompt_request
+// Wraps a workflow in the body POST /prompt expects. With a client_id
+// (may be NULL), the server sends the job's events to the WebSocket
+// opened as /ws?clientId=client_id.
+// Returns NULL if workflow_json is not valid JSON.
+// Caller must free returned string.
+char* comfyui_build_prompt_request(const char* workflow_json, const char* client_id);
+// }}}
+
+// {{{ comfyui_parse_prompt_id
+// Extracts the prompt_id from a POST /prompt reply, or NULL.
+// Caller must free returned string.
+char* comfyui_parse_prompt_id(const char* body);
+// }}}
+
+// {{{ comfyui_parse_history
+// Reads a job's status from a GET /history/{prompt_id} reply. A
+// completed job's output filename is left in error_message.
+// Caller must free with comfyui_response_free.
+ComfyUIResponse* comfyui_parse_history(const char* prompt_id, const char* history);
+// }}}
+
 // {{{ comfyui_response_free
 // Frees all memory associated with response.
 void comfyui_response_free(ComfyUIResponse* response);
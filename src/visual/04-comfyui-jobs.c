@@ -0,0 +1,1518 @@
+/*
+ * 04-comfyui-jobs.c - Asynchronous ComfyUI Job Engine Implementation
+ *
+ * One driver thread owns a curl multi handle and every transfer in it.
+ * A job moves through submit, status checks and an image fetch, with at
+ * most one transfer of its own attached at a time. Between checks a job
+ * holds no connection, so the next check's time feeds the poll timeout
+ * instead of a sleep. Other threads only append jobs, flag
+ * cancellations or take finished jobs under the engine lock.
+ *
+ * The progress socket is a small WebSocket client on a non-blocking
+ * descriptor that the same curl_multi_poll waits on (libcurl's own
+ * WebSocket support is still optional in distribution builds). Its
+ * events only move a job's next check forward (or record its output);
+ * the checks and the fetch still run through the same state machine, so
+ * a lost socket leaves every job in a state polling can finish.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "04-comfyui-jobs.h"
+#include "../net/09-http-pool.h"
+#include "../../libs/cJSON.h"
+#include <curl/curl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// Upper bound on a single poll so shutdown and clock drift are noticed
+#define MAX_POLL_MS 1000
+
+// Recheck interval while the connection pool has no handle to spare
+#define POOL_RECHECK_MS 20
+
+// Reconnect backoff for the progress socket
+#define SOCKET_RETRY_MS 1000
+#define SOCKET_RETRY_MAX_MS 30000
+
+// With the socket up a job is still checked every this many poll
+// intervals, in case an event went missing
+#define SOCKET_CHECK_FACTOR 20
+
+// Largest frame read from the socket; preview images stay well below
+#define SOCKET_MAX_FRAME (16 * 1024 * 1024)
+
+// Prompts the socket reported finished before their submit reply was read
+#define RECENT_FINISHED 32
+
+// {{{ WriteBuffer
+// Buffer for accumulating HTTP response data.
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} WriteBuffer;
+// }}}
+
+// {{{ JobState
+typedef enum {
+    JOB_QUEUED,              // Waiting for a place at the server
+    JOB_SUBMITTING,          // POST /prompt attached
+    JOB_WAITING,             // At the server, waiting for its next check
+    JOB_POLLING,             // GET /history/{prompt_id} attached
+    JOB_FETCHING             // GET /view for the output image attached
+} JobState;
+// }}}
+
+// {{{ SocketState
+typedef enum {
+    SOCKET_DOWN,             // Not connected; jobs are polled
+    SOCKET_CONNECTING,       // TCP connect in progress
+    SOCKET_HANDSHAKE,        // Upgrade sent, waiting for the 101
+    SOCKET_UP                // Events arriving
+} SocketState;
+// }}}
+
+// {{{ Job
+typedef struct Job {
+    ComfyUIJobHandle handle;
+    JobState state;
+    bool cancelled;
+
+    char* body;              // POST /prompt request
+    char* prompt_id;
+    char* filename;          // Output image, once the job has completed
+    uint64_t deadline_ms;    // Set when the job reaches the server
+    uint64_t next_check_ms;
+
+    // From the progress socket
+    bool finished_seen;      // The server said the job finished
+    bool catch_up;           // Socket (re)connected; events may be missed
+    char* failure;           // Error the server reported
+    int progress;            // Percent, -1 before the job started
+    bool progress_dirty;     // Changed since last delivered
+
+    CURL* easy;
+    char* url;
+    struct curl_slist* headers;
+    WriteBuffer buffer;
+
+    // Jobs from comfyui_jobs_submit_to_cache only
+    ImageCache* cache;
+    char* prompt_hash;
+    char* source_prompt;
+    uint32_t width;
+    uint32_t height;
+
+    ComfyUIJobCallback callback;
+    void* user;
+    ComfyUIResponse* result; // Set when the job is finished
+
+    struct Job* next;
+} Job;
+// }}}
+
+// {{{ ComfyUIJobEngine
+struct ComfyUIJobEngine {
+    ComfyUIConfig config;    // server_url owned
+    int max_in_flight;
+    uint64_t timeout_ms;
+    bool poll_only;
+    ComfyUIJobProgressCallback on_progress;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t finished_cond;
+    CURLM* multi;
+
+    Job* jobs;               // Unfinished, in order of submission
+    Job* finished;           // Awaiting delivery, in order finished
+    Job* finished_tail;
+    int outstanding;
+    int progress_pending;    // Jobs with progress_dirty set
+
+    // Progress socket; touched by the driver thread only, except the
+    // state, which is changed under the lock
+    char client_id[64];
+    int socket_fd;
+    SocketState socket_state;
+    uint64_t socket_deadline_ms;  // For connecting and the handshake
+    WriteBuffer socket_in;        // Received, not yet parsed
+    WriteBuffer socket_message;   // Text message being reassembled
+    bool socket_text;             // Continuation frames belong to it
+    uint64_t socket_retry_ms;
+    int socket_backoff_ms;
+    char* recent_finished[RECENT_FINISHED];
+    int recent_next;
+
+    ComfyUIJobHandle next_handle;
+    ComfyUIJobStats stats;
+    bool running;
+};
+// }}}
+
+// {{{ now_ms
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+// }}}
+
+// {{{ buffer_reset
+static void buffer_reset(WriteBuffer* buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+}
+// }}}
+
+// {{{ write_callback
+// libcurl write callback to accumulate response data.
+static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    WriteBuffer* buf = (WriteBuffer*)userp;
+
+    size_t needed = buf->size + realsize + 1;
+    if (needed > buf->capacity) {
+        size_t new_capacity = buf->capacity > 0 ? buf->capacity * 2 : 256;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        unsigned char* new_data = realloc(buf->data, new_capacity);
+        if (new_data == NULL) {
+            return 0; // Signal error to curl
+        }
+        buf->data = new_data;
+        buf->capacity = new_capacity;
+    }
+
+    memcpy(buf->data + buf->size, contents, realsize);
+    buf->size += realsize;
+    buf->data[buf->size] = '\0';
+
+    return realsize;
+}
+// }}}
+
+// {{{ strdup_safe
+static char* strdup_safe(const char* str) {
+    if (str == NULL) {
+        return NULL;
+    }
+    return strdup(str);
+}
+// }}}
+
+// {{{ job_response
+// Creates the response a job finishes with.
+static ComfyUIResponse* job_response(const Job* job, ComfyUIStatus status,
+                                     const char* error_message) {
+    ComfyUIResponse* response = calloc(1, sizeof(ComfyUIResponse));
+    if (response == NULL) {
+        return NULL;
+    }
+    response->prompt_id = strdup_safe(job->prompt_id);
+    response->status = status;
+    response->error_message = strdup_safe(error_message);
+    return response;
+}
+// }}}
+
+// {{{ job_free
+static void job_free(Job* job) {
+    if (job == NULL) {
+        return;
+    }
+
+    if (job->easy != NULL) {
+        http_pool_release(job->easy);
+    }
+    curl_slist_free_all(job->headers);
+    buffer_reset(&job->buffer);
+    free(job->url);
+    free(job->body);
+    free(job->prompt_id);
+    free(job->filename);
+    free(job->prompt_hash);
+    free(job->source_prompt);
+    free(job->failure);
+    free(job);
+}
+// }}}
+
+// {{{ job_detach
+// Removes the job's transfer (if any) from the multi handle.
+// Must be called from the driver thread.
+static void job_detach(ComfyUIJobEngine* engine, Job* job) {
+    if (job->easy != NULL) {
+        curl_multi_remove_handle(engine->multi, job->easy);
+        http_pool_release(job->easy);
+        job->easy = NULL;
+    }
+    curl_slist_free_all(job->headers);
+    job->headers = NULL;
+    free(job->url);
+    job->url = NULL;
+    buffer_reset(&job->buffer);
+}
+// }}}
+
+// {{{ job_start_transfer
+// Attaches a GET of url, or a JSON POST of post_body when it is not
+// NULL. Takes ownership of url. Returns false (leaving the job as it
+// was) when the connection pool has no handle to spare.
+// Must be called from the driver thread with the engine lock held.
+static bool job_start_transfer(ComfyUIJobEngine* engine, Job* job,
+                               char* url, const char* post_body) {
+    if (url == NULL) {
+        return false;
+    }
+
+    CURL* easy = http_pool_try_acquire(url);
+    if (easy == NULL) {
+        free(url);
+        return false;
+    }
+
+    job->easy = easy;
+    job->url = url;
+    curl_easy_setopt(easy, CURLOPT_URL, url);
+    if (post_body != NULL) {
+        job->headers = curl_slist_append(NULL, "Content-Type: application/json");
+        curl_easy_setopt(easy, CURLOPT_POST, 1L);
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, post_body);
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, job->headers);
+    } else {
+        curl_easy_setopt(easy, CURLOPT_HTTPGET, 1L);
+    }
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &job->buffer);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, (long)engine->config.timeout_ms);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, job);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+
+    if (curl_multi_add_handle(engine->multi, easy) != CURLM_OK) {
+        job_detach(engine, job);
+        return false;
+    }
+    return true;
+}
+// }}}
+
+// {{{ job_start_submit
+// Sends a queued job to the server, taking one of its places.
+// Caller holds the engine lock.
+static bool job_start_submit(ComfyUIJobEngine* engine, Job* job) {
+    char* base_url = comfyui_get_endpoint(&engine->config);
+    if (base_url == NULL) {
+        return false;
+    }
+    size_t len = strlen(base_url) + strlen("/prompt") + 1;
+    char* url = malloc(len);
+    if (url != NULL) {
+        snprintf(url, len, "%s/prompt", base_url);
+    }
+    free(base_url);
+
+    if (!job_start_transfer(engine, job, url, job->body)) {
+        return false;
+    }
+
+    job->state = JOB_SUBMITTING;
+    job->deadline_ms = now_ms() + engine->timeout_ms;
+    engine->stats.queued--;
+    engine->stats.in_flight++;
+    if (engine->stats.in_flight > engine->stats.peak_in_flight) {
+        engine->stats.peak_in_flight = engine->stats.in_flight;
+    }
+    return true;
+}
+// }}}
+
+// {{{ job_start_check
+// Checks on a waiting job: fetches its image once the filename is
+// known, asks for its history otherwise. Caller holds the engine lock.
+static bool job_start_check(ComfyUIJobEngine* engine, Job* job) {
+    if (job->filename != NULL) {
+        char* url = comfyui_get_image_url(&engine->config, job->filename);
+        if (!job_start_transfer(engine, job, url, NULL)) {
+            return false;
+        }
+        job->state = JOB_FETCHING;
+        return true;
+    }
+
+    char* base_url = comfyui_get_endpoint(&engine->config);
+    if (base_url == NULL) {
+        return false;
+    }
+    size_t len = strlen(base_url) + strlen("/history/") + strlen(job->prompt_id) + 1;
+    char* url = malloc(len);
+    if (url != NULL) {
+        snprintf(url, len, "%s/history/%s", base_url, job->prompt_id);
+    }
+    free(base_url);
+
+    if (!job_start_transfer(engine, job, url, NULL)) {
+        return false;
+    }
+    job->state = JOB_POLLING;
+    job->catch_up = false;
+    engine->stats.polls++;
+    return true;
+}
+// }}}
+
+// {{{ next_check_at
+// When a waiting job should next be checked: at once if the socket
+// said something about it, rarely while the socket is up, every
+// poll_interval_ms otherwise. Caller holds the engine lock.
+static uint64_t next_check_at(const ComfyUIJobEngine* engine, const Job* job,
+                              uint64_t now) {
+    if (job->failure != NULL || job->finished_seen || job->catch_up) {
+        return now;
+    }
+    uint64_t interval = (uint64_t)engine->config.poll_interval_ms;
+    return engine->socket_state == SOCKET_UP ? now + interval * SOCKET_CHECK_FACTOR
+                                             : now + interval;
+}
+// }}}
+
+// {{{ unlink_job
+// Removes job from the engine list. Caller holds the engine lock.
+static void unlink_job(ComfyUIJobEngine* engine, Job* job) {
+    Job** link = &engine->jobs;
+    while (*link != NULL) {
+        if (*link == job) {
+            *link = job->next;
+            job->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+// }}}
+
+// {{{ finish_job
+// Moves job to the finished list with result, freeing its place at the
+// server. Must be called from the driver thread with the engine lock held.
+static void finish_job(ComfyUIJobEngine* engine, Job* job, ComfyUIResponse* result) {
+    job_detach(engine, job);
+    unlink_job(engine, job);
+
+    if (job->state == JOB_QUEUED) {
+        engine->stats.queued--;
+    } else {
+        engine->stats.in_flight--;
+    }
+    if (job->cancelled) {
+        engine->stats.cancelled++;
+    } else if (result != NULL && result->status == COMFYUI_STATUS_COMPLETED) {
+        engine->stats.completed++;
+    } else {
+        engine->stats.failed++;
+    }
+
+    if (job->progress_dirty) {
+        // The result supersedes any progress not yet delivered
+        job->progress_dirty = false;
+        engine->progress_pending--;
+    }
+
+    job->result = result;
+    if (engine->finished_tail != NULL) {
+        engine->finished_tail->next = job;
+    } else {
+        engine->finished = job;
+    }
+    engine->finished_tail = job;
+    pthread_cond_broadcast(&engine->finished_cond);
+}
+// }}}
+
+// {{{ set_progress
+// Records a job's progress for the next comfyui_jobs_poll.
+// Caller holds the engine lock.
+static void set_progress(ComfyUIJobEngine* engine, Job* job, int percent) {
+    if (engine->on_progress == NULL || job->state == JOB_QUEUED ||
+        job->progress == percent) {
+        return;
+    }
+    job->progress = percent;
+    if (!job->progress_dirty) {
+        job->progress_dirty = true;
+        engine->progress_pending++;
+    }
+    pthread_cond_broadcast(&engine->finished_cond);
+}
+// }}}
+
+// {{{ remember_finished
+// Keeps the id of a prompt that finished before its submit reply was
+// read, so the job skips straight to its check. Caller holds the lock.
+static void remember_finished(ComfyUIJobEngine* engine, const char* prompt_id) {
+    char* copy = strdup(prompt_id);
+    if (copy == NULL) {
+        return;
+    }
+    free(engine->recent_finished[engine->recent_next]);
+    engine->recent_finished[engine->recent_next] = copy;
+    engine->recent_next = (engine->recent_next + 1) % RECENT_FINISHED;
+}
+// }}}
+
+// {{{ socket_up
+// First event on a new connection. Anything that happened while the
+// socket was down went unseen, so waiting jobs get one check at once.
+// Caller holds the engine lock.
+static void socket_up(ComfyUIJobEngine* engine) {
+    engine->socket_state = SOCKET_UP;
+    engine->socket_backoff_ms = SOCKET_RETRY_MS;
+    engine->stats.socket_connects++;
+
+    uint64_t now = now_ms();
+    for (Job* job = engine->jobs; job != NULL; job = job->next) {
+        if (job->state == JOB_QUEUED || job->state == JOB_SUBMITTING) {
+            continue;
+        }
+        job->catch_up = true;
+        if (job->state == JOB_WAITING) {
+            job->next_check_ms = now;
+        }
+    }
+}
+// }}}
+
+// {{{ handle_socket_message
+// Applies one event from the progress socket. Events only record what
+// the server said and bring the job's next check forward.
+static void handle_socket_message(ComfyUIJobEngine* engine, const char* text) {
+    cJSON* root = cJSON_Parse(text);
+    if (root == NULL) {
+        return;
+    }
+
+    const cJSON* type = cJSON_GetObjectItem(root, "type");
+    const cJSON* data = cJSON_GetObjectItem(root, "data");
+    const cJSON* prompt = cJSON_GetObjectItem(data, "prompt_id");
+    const char* kind = cJSON_IsString(type) ? type->valuestring : "";
+    const cJSON* node = cJSON_GetObjectItem(data, "node");
+    bool terminal = strcmp(kind, "execution_success") == 0 ||
+                    strcmp(kind, "execution_error") == 0 ||
+                    strcmp(kind, "execution_interrupted") == 0 ||
+                    (strcmp(kind, "executing") == 0 && cJSON_IsNull(node));
+
+    pthread_mutex_lock(&engine->lock);
+    engine->stats.socket_events++;
+
+    Job* job = NULL;
+    if (cJSON_IsString(prompt)) {
+        for (Job* it = engine->jobs; it != NULL; it = it->next) {
+            if (it->prompt_id != NULL && strcmp(it->prompt_id, prompt->valuestring) == 0) {
+                job = it;
+                break;
+            }
+        }
+        if (job == NULL && terminal) {
+            remember_finished(engine, prompt->valuestring);
+        }
+    }
+
+    if (job != NULL) {
+        if (strcmp(kind, "execution_start") == 0) {
+            set_progress(engine, job, 0);
+        } else if (strcmp(kind, "progress") == 0) {
+            int value = cJSON_GetObjectItem(data, "value") != NULL ?
+                        cJSON_GetObjectItem(data, "value")->valueint : 0;
+            int max = cJSON_GetObjectItem(data, "max") != NULL ?
+                      cJSON_GetObjectItem(data, "max")->valueint : 0;
+            if (max > 0 && value >= 0 && value <= max) {
+                set_progress(engine, job, value * 100 / max);
+            }
+        } else if (strcmp(kind, "executed") == 0 && job->filename == NULL) {
+            const cJSON* images = cJSON_GetObjectItem(cJSON_GetObjectItem(data, "output"),
+                                                      "images");
+            const cJSON* file = cJSON_GetObjectItem(cJSON_GetArrayItem(images, 0),
+                                                    "filename");
+            if (cJSON_IsString(file)) {
+                job->filename = strdup(file->valuestring);
+            }
+        } else if (strcmp(kind, "execution_error") == 0 && job->failure == NULL) {
+            const cJSON* message = cJSON_GetObjectItem(data, "exception_message");
+            job->failure = strdup(cJSON_IsString(message) ? message->valuestring
+                                                          : "Job failed");
+        } else if (strcmp(kind, "execution_interrupted") == 0 && job->failure == NULL) {
+            job->failure = strdup("Job interrupted");
+        }
+
+        if (terminal) {
+            job->finished_seen = true;
+            if (job->state == JOB_WAITING) {
+                job->next_check_ms = now_ms();
+            }
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    cJSON_Delete(root);
+}
+// }}}
+
+// {{{ schedule_jobs
+// Reaps cancellations and timeouts, sends queued jobs while the server
+// has room and starts due checks. Returns the number of milliseconds
+// until the next check or deadline.
+static long schedule_jobs(ComfyUIJobEngine* engine) {
+    uint64_t now = now_ms();
+    long wait_ms = MAX_POLL_MS;
+
+    pthread_mutex_lock(&engine->lock);
+
+    Job* job = engine->jobs;
+    while (job != NULL) {
+        Job* next = job->next;
+
+        if (job->cancelled) {
+            finish_job(engine, job,
+                       job_response(job, COMFYUI_STATUS_ERROR, "Job cancelled"));
+        } else if (job->state != JOB_QUEUED && job->deadline_ms <= now) {
+            engine->stats.timeouts++;
+            finish_job(engine, job,
+                       job_response(job, COMFYUI_STATUS_ERROR,
+                                    "Timeout waiting for completion"));
+        } else {
+            bool blocked = false;
+            if (job->state == JOB_QUEUED) {
+                blocked = engine->stats.in_flight < engine->max_in_flight &&
+                          !job_start_submit(engine, job);
+            } else if (job->state == JOB_WAITING) {
+                if (job->failure != NULL) {
+                    finish_job(engine, job,
+                               job_response(job, COMFYUI_STATUS_ERROR, job->failure));
+                    job = next;
+                    continue;
+                }
+                if (job->next_check_ms <= now) {
+                    blocked = !job_start_check(engine, job);
+                } else if ((long)(job->next_check_ms - now) < wait_ms) {
+                    wait_ms = (long)(job->next_check_ms - now);
+                }
+            }
+            if (blocked && wait_ms > POOL_RECHECK_MS) {
+                // Pool is saturated; try again shortly
+                wait_ms = POOL_RECHECK_MS;
+            }
+            if (job->state != JOB_QUEUED && (long)(job->deadline_ms - now) < wait_ms) {
+                wait_ms = (long)(job->deadline_ms - now);
+            }
+        }
+
+        job = next;
+    }
+
+    pthread_mutex_unlock(&engine->lock);
+    return wait_ms;
+}
+// }}}
+
+// {{{ advance_job
+// Moves a job on after its transfer finished with body (NULL when the
+// transfer failed). Caller holds the engine lock.
+static void advance_job(ComfyUIJobEngine* engine, Job* job, WriteBuffer* body) {
+    const char* text = body != NULL ? (const char*)body->data : NULL;
+
+    switch (job->state) {
+        case JOB_SUBMITTING:
+            job->prompt_id = comfyui_parse_prompt_id(text);
+            if (job->prompt_id == NULL) {
+                finish_job(engine, job, job_response(job, COMFYUI_STATUS_ERROR,
+                                                     "Failed to submit workflow"));
+                return;
+            }
+            for (int i = 0; i < RECENT_FINISHED; i++) {
+                if (engine->recent_finished[i] != NULL &&
+                    strcmp(engine->recent_finished[i], job->prompt_id) == 0) {
+                    job->finished_seen = true;
+                }
+            }
+            job->state = JOB_WAITING;
+            job->next_check_ms = next_check_at(engine, job, now_ms());
+            return;
+
+        case JOB_POLLING: {
+            if (job->failure != NULL) {
+                finish_job(engine, job, job_response(job, COMFYUI_STATUS_ERROR,
+                                                     job->failure));
+                return;
+            }
+            if (text == NULL) {
+                finish_job(engine, job, job_response(job, COMFYUI_STATUS_ERROR,
+                                                     "Failed to get history"));
+                return;
+            }
+            ComfyUIResponse* status = comfyui_parse_history(job->prompt_id, text);
+            if (status == NULL) {
+                finish_job(engine, job, NULL);
+                return;
+            }
+            if (status->status == COMFYUI_STATUS_COMPLETED && status->error_message != NULL) {
+                // Output filename; fetch the image straight away
+                free(job->filename);
+                job->filename = status->error_message;
+                status->error_message = NULL;
+                job->state = JOB_WAITING;
+                job->next_check_ms = now_ms();
+                comfyui_response_free(status);
+            } else if (status->status == COMFYUI_STATUS_COMPLETED) {
+                finish_job(engine, job, status);
+            } else if (status->status == COMFYUI_STATUS_ERROR) {
+                if (status->error_message == NULL) {
+                    status->error_message = strdup_safe("Job failed");
+                }
+                finish_job(engine, job, status);
+            } else {
+                // Not in the history yet, even if the socket said it
+                // finished: check again after the usual interval
+                uint64_t now = now_ms();
+                job->state = JOB_WAITING;
+                job->next_check_ms = job->filename != NULL ? now :
+                    job->finished_seen ? now + (uint64_t)engine->config.poll_interval_ms :
+                    next_check_at(engine, job, now);
+                comfyui_response_free(status);
+            }
+            return;
+        }
+
+        case JOB_FETCHING: {
+            if (body == NULL || body->size == 0) {
+                finish_job(engine, job, job_response(job, COMFYUI_STATUS_ERROR,
+                                                     "Failed to retrieve image"));
+                return;
+            }
+            ComfyUIResponse* response = job_response(job, COMFYUI_STATUS_COMPLETED, NULL);
+            if (response != NULL) {
+                response->image_data = body->data;
+                response->image_size = body->size;
+                body->data = NULL;
+            }
+            finish_job(engine, job, response);
+            return;
+        }
+
+        default:
+            return;
+    }
+}
+// }}}
+
+// {{{ collect_completed
+// Reads finished transfers from the multi handle and moves their jobs on.
+static void collect_completed(ComfyUIJobEngine* engine) {
+    CURLMsg* msg;
+    int remaining = 0;
+
+    while ((msg = curl_multi_info_read(engine->multi, &remaining)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        Job* job = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&job);
+        if (job == NULL) {
+            continue;
+        }
+
+        long http_code = 0;
+        curl_easy_getinfo(job->easy, CURLINFO_RESPONSE_CODE, &http_code);
+        bool ok = msg->data.result == CURLE_OK && http_code == 200;
+
+        // Keep the body; detaching resets the job's buffer
+        WriteBuffer body = job->buffer;
+        memset(&job->buffer, 0, sizeof(job->buffer));
+
+        pthread_mutex_lock(&engine->lock);
+        job_detach(engine, job);
+        if (job->cancelled) {
+            finish_job(engine, job,
+                       job_response(job, COMFYUI_STATUS_ERROR, "Job cancelled"));
+        } else {
+            advance_job(engine, job, ok && body.data != NULL ? &body : NULL);
+        }
+        pthread_mutex_unlock(&engine->lock);
+
+        buffer_reset(&body);
+    }
+}
+// }}}
+
+// {{{ socket_retry_later
+// Schedules the next connection attempt, backing off while attempts
+// keep failing. Caller holds the engine lock.
+static void socket_retry_later(ComfyUIJobEngine* engine, uint64_t now) {
+    engine->socket_retry_ms = now + (uint64_t)engine->socket_backoff_ms;
+    engine->socket_backoff_ms *= 2;
+    if (engine->socket_backoff_ms > SOCKET_RETRY_MAX_MS) {
+        engine->socket_backoff_ms = SOCKET_RETRY_MAX_MS;
+    }
+}
+// }}}
+
+// {{{ socket_close
+// Closes the progress socket and schedules a reconnect. Waiting jobs go
+// back to being checked every poll_interval_ms.
+// Must be called from the driver thread.
+static void socket_close(ComfyUIJobEngine* engine) {
+    close(engine->socket_fd);
+    engine->socket_fd = -1;
+    buffer_reset(&engine->socket_in);
+    buffer_reset(&engine->socket_message);
+
+    pthread_mutex_lock(&engine->lock);
+    bool was_up = engine->socket_state == SOCKET_UP;
+    uint64_t now = now_ms();
+    engine->socket_state = SOCKET_DOWN;
+    socket_retry_later(engine, now);
+
+    if (was_up) {
+        uint64_t next = now + (uint64_t)engine->config.poll_interval_ms;
+        for (Job* job = engine->jobs; job != NULL; job = job->next) {
+            if (job->state == JOB_WAITING && job->next_check_ms > next) {
+                job->next_check_ms = next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
+// }}}
+
+// {{{ socket_connect
+// Starts a non-blocking connect to the server.
+// Must be called from the driver thread.
+static void socket_connect(ComfyUIJobEngine* engine) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", engine->config.port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int fd = -1;
+    struct addrinfo* addrs = NULL;
+    if (getaddrinfo(engine->config.server_url, port, &hints, &addrs) == 0) {
+        fd = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+        if (fd >= 0 && (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0 ||
+                        (connect(fd, addrs->ai_addr, addrs->ai_addrlen) != 0 &&
+                         errno != EINPROGRESS))) {
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(addrs);
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    uint64_t now = now_ms();
+    if (fd < 0) {
+        socket_retry_later(engine, now);
+    } else {
+        engine->socket_fd = fd;
+        engine->socket_state = SOCKET_CONNECTING;
+        engine->socket_deadline_ms = now + (uint64_t)engine->config.timeout_ms;
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
+// }}}
+
+// {{{ socket_send_upgrade
+// Sends the WebSocket handshake once the connection is made. The reply's
+// accept key is not checked: the server is our configured backend.
+static bool socket_send_upgrade(ComfyUIJobEngine* engine) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned int seed = (unsigned int)(now_ms() ^ (uint64_t)(uintptr_t)engine);
+    char key[25];
+    for (int i = 0; i < 22; i++) {
+        key[i] = alphabet[rand_r(&seed) % 64];
+    }
+    key[21] = alphabet[(rand_r(&seed) % 4) * 16];  // Holds the last 2 of 128 bits
+    memcpy(key + 22, "==", 3);
+
+    char request[512];
+    int len = snprintf(request, sizeof(request),
+                       "GET /ws?clientId=%s HTTP/1.1\r\n"
+                       "Host: %s:%d\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Key: %s\r\n"
+                       "Sec-WebSocket-Version: 13\r\n\r\n",
+                       engine->client_id, engine->config.server_url,
+                       engine->config.port, key);
+    if (len <= 0 || (size_t)len >= sizeof(request)) {
+        return false;
+    }
+    // Small enough to go out in one send on a fresh connection
+    return send(engine->socket_fd, request, (size_t)len, MSG_NOSIGNAL) == len;
+}
+// }}}
+
+// {{{ socket_send_pong
+// Answers a ping. Frames from a client are always masked.
+static void socket_send_pong(ComfyUIJobEngine* engine, const unsigned char* payload,
+                             size_t len) {
+    unsigned char frame[2 + 4 + 125];
+    if (len > 125) {
+        return;
+    }
+    uint32_t mask = (uint32_t)now_ms() * 2654435761u;
+    frame[0] = 0x8A;
+    frame[1] = (unsigned char)(0x80 | len);
+    memcpy(frame + 2, &mask, 4);
+    for (size_t i = 0; i < len; i++) {
+        frame[6 + i] = payload[i] ^ frame[2 + i % 4];
+    }
+    send(engine->socket_fd, frame, 6 + len, MSG_NOSIGNAL);
+}
+// }}}
+
+// {{{ socket_read_frames
+// Handles every complete frame in the input buffer: text messages are
+// gathered across fragments, binary ones (ComfyUI's preview images)
+// skipped, pings answered. Returns false when the socket should close.
+static bool socket_read_frames(ComfyUIJobEngine* engine) {
+    WriteBuffer* in = &engine->socket_in;
+    size_t pos = 0;
+    bool open = true;
+
+    while (open && in->size - pos >= 2) {
+        unsigned char* frame = in->data + pos;
+        size_t available = in->size - pos;
+        bool fin = (frame[0] & 0x80) != 0;
+        int opcode = frame[0] & 0x0F;
+        bool masked = (frame[1] & 0x80) != 0;
+        uint64_t len = frame[1] & 0x7F;
+        size_t header = 2;
+        if (len == 126) {
+            if (available < 4) {
+                break;
+            }
+            len = ((uint64_t)frame[2] << 8) | frame[3];
+            header = 4;
+        } else if (len == 127) {
+            if (available < 10) {
+                break;
+            }
+            len = 0;
+            for (int i = 0; i < 8; i++) {
+                len = (len << 8) | frame[2 + i];
+            }
+            header = 10;
+        }
+        if (len > SOCKET_MAX_FRAME) {
+            return false;
+        }
+        size_t mask_at = header;
+        header += masked ? 4 : 0;
+        if (available < header + len) {
+            break;
+        }
+
+        unsigned char* payload = frame + header;
+        if (masked) {
+            for (uint64_t i = 0; i < len; i++) {
+                payload[i] ^= frame[mask_at + i % 4];
+            }
+        }
+
+        switch (opcode) {
+            case 0x1:  // Text
+            case 0x0:  // Continuation
+                if (opcode == 0x1) {
+                    buffer_reset(&engine->socket_message);
+                    engine->socket_text = true;
+                }
+                if (!engine->socket_text) {
+                    break;
+                }
+                if (write_callback(payload, 1, (size_t)len, &engine->socket_message) !=
+                    (size_t)len) {
+                    return false;
+                }
+                if (fin) {
+                    if (engine->socket_message.data != NULL) {
+                        handle_socket_message(engine,
+                                              (const char*)engine->socket_message.data);
+                    }
+                    buffer_reset(&engine->socket_message);
+                    engine->socket_text = false;
+                }
+                break;
+            case 0x2:  // Binary
+                engine->socket_text = false;
+                break;
+            case 0x8:  // Close
+                open = false;
+                break;
+            case 0x9:  // Ping
+                socket_send_pong(engine, payload, (size_t)len);
+                break;
+            default:
+                break;
+        }
+        pos += header + (size_t)len;
+    }
+
+    memmove(in->data, in->data + pos, in->size - pos);
+    in->size -= pos;
+    return open;
+}
+// }}}
+
+// {{{ socket_service
+// Moves the progress socket along without blocking: connects when a
+// retry is due, sends the handshake once connected, reads its reply and
+// then events. Fills waitfd with what to wait for on the socket and
+// returns the longest the driver may sleep on its account.
+// Must be called from the driver thread.
+static long socket_service(ComfyUIJobEngine* engine, struct curl_waitfd* waitfd) {
+    uint64_t now = now_ms();
+    waitfd->fd = -1;
+    waitfd->events = 0;
+    waitfd->revents = 0;
+    if (engine->poll_only) {
+        return MAX_POLL_MS;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    SocketState state = engine->socket_state;
+    uint64_t retry_ms = engine->socket_retry_ms;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (state == SOCKET_DOWN) {
+        if (retry_ms > now) {
+            return (long)(retry_ms - now);
+        }
+        socket_connect(engine);
+        if (engine->socket_fd < 0) {
+            return SOCKET_RETRY_MS;
+        }
+        state = SOCKET_CONNECTING;
+    }
+
+    if (state != SOCKET_UP && engine->socket_deadline_ms <= now) {
+        socket_close(engine);
+        return SOCKET_RETRY_MS;
+    }
+
+    if (state == SOCKET_CONNECTING) {
+        struct pollfd pfd = { .fd = engine->socket_fd, .events = POLLOUT };
+        if (poll(&pfd, 1, 0) == 0) {
+            waitfd->fd = engine->socket_fd;
+            waitfd->events = CURL_WAIT_POLLOUT;
+            return (long)(engine->socket_deadline_ms - now);
+        }
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (getsockopt(engine->socket_fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 ||
+            error != 0 || !socket_send_upgrade(engine)) {
+            socket_close(engine);
+            return SOCKET_RETRY_MS;
+        }
+        pthread_mutex_lock(&engine->lock);
+        engine->socket_state = state = SOCKET_HANDSHAKE;
+        pthread_mutex_unlock(&engine->lock);
+    }
+
+    // Read whatever has arrived
+    unsigned char chunk[4096];
+    for (;;) {
+        ssize_t got = recv(engine->socket_fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (got > 0) {
+            if (write_callback(chunk, 1, (size_t)got, &engine->socket_in) != (size_t)got) {
+                socket_close(engine);
+                return SOCKET_RETRY_MS;
+            }
+            continue;
+        }
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        socket_close(engine);  // Closed by the server, or failed
+        return SOCKET_RETRY_MS;
+    }
+
+    if (state == SOCKET_HANDSHAKE && engine->socket_in.data != NULL) {
+        const char* text = (const char*)engine->socket_in.data;
+        const char* end = strstr(text, "\r\n\r\n");
+        if (end != NULL) {
+            if (strncmp(text, "HTTP/1.1 101", 12) != 0) {
+                socket_close(engine);  // No /ws at this server
+                return SOCKET_RETRY_MS;
+            }
+            size_t used = (size_t)(end + 4 - text);
+            memmove(engine->socket_in.data, engine->socket_in.data + used,
+                    engine->socket_in.size - used);
+            engine->socket_in.size -= used;
+            pthread_mutex_lock(&engine->lock);
+            socket_up(engine);
+            pthread_mutex_unlock(&engine->lock);
+            state = SOCKET_UP;
+        }
+    }
+
+    if (state == SOCKET_UP && !socket_read_frames(engine)) {
+        socket_close(engine);
+        return SOCKET_RETRY_MS;
+    }
+
+    waitfd->fd = engine->socket_fd;
+    waitfd->events = CURL_WAIT_POLLIN;
+    return state == SOCKET_UP ? MAX_POLL_MS : (long)(engine->socket_deadline_ms - now);
+}
+// }}}
+
+// {{{ driver_main
+static void* driver_main(void* arg) {
+    ComfyUIJobEngine* engine = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&engine->lock);
+        bool running = engine->running;
+        if (!running) {
+            // Shutdown: everything still listed is cancelled
+            for (Job* job = engine->jobs; job != NULL; job = job->next) {
+                job->cancelled = true;
+            }
+        }
+        pthread_mutex_unlock(&engine->lock);
+
+        int still_running = 0;
+        curl_multi_perform(engine->multi, &still_running);
+        collect_completed(engine);
+        struct curl_waitfd waitfd;
+        long socket_wait_ms = running ? socket_service(engine, &waitfd) : MAX_POLL_MS;
+
+        // Scheduled after collecting and reading events so a job whose
+        // transfer just finished, or whose output the socket announced,
+        // starts its next step without waiting out the poll
+        long wait_ms = schedule_jobs(engine);
+        if (!running) {
+            break;
+        }
+
+        if (socket_wait_ms < wait_ms) {
+            wait_ms = socket_wait_ms;
+        }
+        curl_multi_poll(engine->multi, &waitfd, waitfd.fd >= 0 ? 1 : 0,
+                        (int)wait_ms, NULL);
+    }
+
+    if (engine->socket_fd >= 0) {
+        close(engine->socket_fd);
+        engine->socket_fd = -1;
+    }
+    return NULL;
+}
+// }}}
+
+// {{{ comfyui_jobs_create
+ComfyUIJobEngine* comfyui_jobs_create(const ComfyUIConfig* config,
+                                      const ComfyUIJobOptions* options) {
+    if (config == NULL || config->server_url == NULL) {
+        return NULL;
+    }
+
+    ComfyUIJobEngine* engine = calloc(1, sizeof(ComfyUIJobEngine));
+    if (engine == NULL) {
+        return NULL;
+    }
+
+    engine->config = *config;
+    engine->config.server_url = strdup(config->server_url);
+    if (engine->config.poll_interval_ms <= 0) {
+        engine->config.poll_interval_ms = 1;
+    }
+    engine->max_in_flight = COMFYUI_JOBS_DEFAULT_MAX_IN_FLIGHT;
+    engine->timeout_ms = (uint64_t)engine->config.poll_interval_ms *
+                         (uint64_t)(config->max_poll_attempts > 0 ?
+                                    config->max_poll_attempts : 1);
+    if (options != NULL && options->max_in_flight > 0) {
+        engine->max_in_flight = options->max_in_flight;
+    }
+    if (options != NULL && options->timeout_ms > 0) {
+        engine->timeout_ms = (uint64_t)options->timeout_ms;
+    }
+    if (options != NULL) {
+        engine->poll_only = options->poll_only;
+        engine->on_progress = options->on_progress;
+    }
+    engine->next_handle = 1;
+
+    // Names this engine's socket; the server sends it the events of
+    // prompts submitted with the same id
+    snprintf(engine->client_id, sizeof(engine->client_id), "symbeline-%ld-%lx",
+             (long)getpid(), (unsigned long)(uintptr_t)engine);
+    engine->socket_fd = -1;
+    engine->socket_state = SOCKET_DOWN;
+    engine->socket_backoff_ms = SOCKET_RETRY_MS;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&engine->lock, NULL);
+    pthread_cond_init(&engine->finished_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    engine->multi = curl_multi_init();
+    engine->running = true;
+    if (engine->config.server_url == NULL || engine->multi == NULL ||
+        pthread_create(&engine->thread, NULL, driver_main, engine) != 0) {
+        if (engine->multi != NULL) {
+            curl_multi_cleanup(engine->multi);
+        }
+        pthread_cond_destroy(&engine->finished_cond);
+        pthread_mutex_destroy(&engine->lock);
+        free(engine->config.server_url);
+        free(engine);
+        return NULL;
+    }
+
+    return engine;
+}
+// }}}
+
+// {{{ comfyui_jobs_free
+void comfyui_jobs_free(ComfyUIJobEngine* engine) {
+    if (engine == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    engine->running = false;
+    curl_multi_wakeup(engine->multi);
+    pthread_mutex_unlock(&engine->lock);
+
+    pthread_join(engine->thread, NULL);
+
+    // The driver finished every job on its way out
+    comfyui_jobs_poll(engine);
+
+    curl_multi_cleanup(engine->multi);
+    pthread_cond_destroy(&engine->finished_cond);
+    pthread_mutex_destroy(&engine->lock);
+    buffer_reset(&engine->socket_in);
+    buffer_reset(&engine->socket_message);
+    for (int i = 0; i < RECENT_FINISHED; i++) {
+        free(engine->recent_finished[i]);
+    }
+    free(engine->config.server_url);
+    free(engine);
+}
+// }}}
+
+// {{{ submit_job
+// Queues job for the driver thread, or frees it if the engine stopped.
+static ComfyUIJobHandle submit_job(ComfyUIJobEngine* engine, Job* job) {
+    pthread_mutex_lock(&engine->lock);
+    if (!engine->running) {
+        pthread_mutex_unlock(&engine->lock);
+        job_free(job);
+        return COMFYUI_JOB_INVALID;
+    }
+
+    job->handle = engine->next_handle++;
+    Job** link = &engine->jobs;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = job;
+    engine->outstanding++;
+    engine->stats.submitted++;
+    engine->stats.queued++;
+    ComfyUIJobHandle handle = job->handle;
+
+    curl_multi_wakeup(engine->multi);
+    pthread_mutex_unlock(&engine->lock);
+
+    return handle;
+}
+// }}}
+
+// {{{ job_create
+static Job* job_create(const ComfyUIJobEngine* engine, const char* workflow_json,
+                       ComfyUIJobCallback callback, void* user) {
+    char* body = comfyui_build_prompt_request(workflow_json,
+                                              engine->poll_only ? NULL : engine->client_id);
+    if (body == NULL) {
+        return NULL;
+    }
+
+    Job* job = calloc(1, sizeof(Job));
+    if (job == NULL) {
+        free(body);
+        return NULL;
+    }
+    job->state = JOB_QUEUED;
+    job->body = body;
+    job->progress = -1;
+    job->callback = callback;
+    job->user = user;
+    return job;
+}
+// }}}
+
+// {{{ comfyui_jobs_submit
+ComfyUIJobHandle comfyui_jobs_submit(ComfyUIJobEngine* engine,
+                                     const char* workflow_json,
+                                     ComfyUIJobCallback callback,
+                                     void* user) {
+    if (engine == NULL) {
+        return COMFYUI_JOB_INVALID;
+    }
+
+    Job* job = job_create(engine, workflow_json, callback, user);
+    if (job == NULL) {
+        return COMFYUI_JOB_INVALID;
+    }
+    return submit_job(engine, job);
+}
+// }}}
+
+// {{{ generating
+// True if a job of engine will store prompt_hash into cache.
+// Caller holds the engine lock.
+static bool generating(ComfyUIJobEngine* engine, const ImageCache* cache,
+                       const char* prompt_hash) {
+    Job* lists[] = { engine->jobs, engine->finished };
+    for (int i = 0; i < 2; i++) {
+        for (Job* job = lists[i]; job != NULL; job = job->next) {
+            if (job->cache == cache && !job->cancelled &&
+                strcmp(job->prompt_hash, prompt_hash) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+// }}}
+
+// {{{ comfyui_jobs_submit_to_cache
+ComfyUIJobHandle comfyui_jobs_submit_to_cache(ComfyUIJobEngine* engine,
+                                              const char* workflow_json,
+                                              ImageCache* cache,
+                                              const char* prompt_hash,
+                                              uint32_t width,
+                                              uint32_t height,
+                                              const char* source_prompt,
+                                              ComfyUIJobCallback callback,
+                                              void* user) {
+    if (engine == NULL || cache == NULL || prompt_hash == NULL ||
+        image_cache_has(cache, prompt_hash)) {
+        return COMFYUI_JOB_INVALID;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    bool duplicate = generating(engine, cache, prompt_hash);
+    pthread_mutex_unlock(&engine->lock);
+    if (duplicate) {
+        return COMFYUI_JOB_INVALID;
+    }
+
+    Job* job = job_create(engine, workflow_json, callback, user);
+    if (job == NULL) {
+        return COMFYUI_JOB_INVALID;
+    }
+    job->cache = cache;
+    job->prompt_hash = strdup(prompt_hash);
+    job->source_prompt = strdup_safe(source_prompt);
+    job->width = width;
+    job->height = height;
+    if (job->prompt_hash == NULL) {
+        job_free(job);
+        return COMFYUI_JOB_INVALID;
+    }
+    return submit_job(engine, job);
+}
+// }}}
+
+// {{{ comfyui_jobs_cancel
+bool comfyui_jobs_cancel(ComfyUIJobEngine* engine, ComfyUIJobHandle handle) {
+    if (engine == NULL || handle == COMFYUI_JOB_INVALID) {
+        return false;
+    }
+
+    bool found = false;
+
+    pthread_mutex_lock(&engine->lock);
+    for (Job* job = engine->jobs; job != NULL; job = job->next) {
+        if (job->handle == handle && !job->cancelled) {
+            job->cancelled = true;
+            found = true;
+            break;
+        }
+    }
+    if (found) {
+        curl_multi_wakeup(engine->multi);
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    return found;
+}
+// }}}
+
+// {{{ ProgressNote
+// A progress change taken from a job for delivery outside the lock.
+typedef struct {
+    ComfyUIJobHandle handle;
+    int percent;
+    void* user;
+} ProgressNote;
+// }}}
+
+// {{{ comfyui_jobs_poll
+int comfyui_jobs_poll(ComfyUIJobEngine* engine) {
+    if (engine == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    Job* finished = engine->finished;
+    engine->finished = NULL;
+    engine->finished_tail = NULL;
+    ProgressNote* notes = NULL;
+    int note_count = 0;
+    if (engine->progress_pending > 0) {
+        notes = malloc(sizeof(ProgressNote) * (size_t)engine->progress_pending);
+        for (Job* job = engine->jobs; job != NULL && notes != NULL; job = job->next) {
+            if (job->progress_dirty) {
+                job->progress_dirty = false;
+                notes[note_count++] = (ProgressNote){ job->handle, job->progress,
+                                                      job->user };
+            }
+        }
+        if (notes != NULL) {
+            engine->progress_pending = 0;
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    // Delivered outside the lock so callbacks may submit more jobs
+    for (int i = 0; i < note_count; i++) {
+        engine->on_progress(notes[i].handle, notes[i].percent, notes[i].user);
+    }
+    free(notes);
+
+    int delivered = 0;
+    while (finished != NULL) {
+        Job* next = finished->next;
+        ComfyUIResponse* result = finished->result;
+        if (finished->cache != NULL && result != NULL &&
+            result->status == COMFYUI_STATUS_COMPLETED && result->image_data != NULL) {
+            image_cache_set(finished->cache, finished->prompt_hash,
+                            result->image_data, result->image_size,
+                            finished->width, finished->height,
+                            finished->source_prompt);
+        }
+        if (finished->callback != NULL) {
+            finished->callback(result, finished->user);
+        } else {
+            comfyui_response_free(result);
+        }
+        job_free(finished);
+        delivered++;
+        finished = next;
+    }
+
+    if (delivered > 0) {
+        pthread_mutex_lock(&engine->lock);
+        engine->outstanding -= delivered;
+        pthread_mutex_unlock(&engine->lock);
+    }
+    return delivered;
+}
+// }}}
+
+// {{{ comfyui_jobs_wait
+int comfyui_jobs_wait(ComfyUIJobEngine* engine, int timeout_ms) {
+    if (engine == NULL) {
+        return 0;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    int delivered = 0;
+    for (;;) {
+        delivered += comfyui_jobs_poll(engine);
+
+        pthread_mutex_lock(&engine->lock);
+        bool done = engine->outstanding == 0;
+        int rc = 0;
+        while (!done && engine->finished == NULL && engine->progress_pending == 0 &&
+               rc != ETIMEDOUT) {
+            if (timeout_ms < 0) {
+                pthread_cond_wait(&engine->finished_cond, &engine->lock);
+            } else {
+                rc = pthread_cond_timedwait(&engine->finished_cond, &engine->lock,
+                                            &deadline);
+            }
+        }
+        bool more = engine->finished != NULL || engine->progress_pending > 0;
+        pthread_mutex_unlock(&engine->lock);
+
+        if (done || !more) {
+            break;
+        }
+    }
+    return delivered;
+}
+// }}}
+
+// {{{ comfyui_jobs_outstanding
+int comfyui_jobs_outstanding(ComfyUIJobEngine* engine) {
+    if (engine == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    int outstanding = engine->outstanding;
+    pthread_mutex_unlock(&engine->lock);
+    return outstanding;
+}
+// }}}
+
+// {{{ comfyui_jobs_get_stats
+ComfyUIJobStats comfyui_jobs_get_stats(ComfyUIJobEngine* engine) {
+    ComfyUIJobStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (engine == NULL) {
+        return stats;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    stats = engine->stats;
+    stats.socket_up = engine->socket_state == SOCKET_UP;
+    pthread_mutex_unlock(&engine->lock);
+    return stats;
+}
+// }}}
@@ -0,0 +1,161 @@
+/*
+ * 04-comfyui-jobs.h - Asynchronous ComfyUI Job Engine
+ *
+ * Generates images without tying up a thread per job. Submitting
+ * returns a handle at once; one driver thread owns a curl multi handle
+ * and runs every job's requests (submit, status checks, image fetch)
+ * side by side, checking each running job every poll_interval_ms.
+ *
+ * At most max_in_flight jobs are at the server at a time, matched to
+ * the GPUs behind it; the rest wait in order of submission. A job
+ * times out timeout_ms after it reaches the server, however long it
+ * waited here first.
+ *
+ * Unless poll_only is set, the engine also keeps one WebSocket open to
+ * the server (/ws?clientId=...) and submits its prompts under that
+ * client id. The server's events report each job's progress and when it
+ * finishes, so the output is fetched as soon as it exists; while the
+ * socket is up a job's status is only checked every twentieth interval,
+ * in case an event went missing. While it is down (not yet connected,
+ * dropped, or the server has no /ws) jobs are checked every
+ * poll_interval_ms as before and the socket is reconnected with backoff.
+ *
+ * Finished jobs are delivered by comfyui_jobs_poll (or comfyui_jobs_wait)
+ * on the caller's thread, not on the driver thread: ImageCache has no
+ * lock, so callbacks may store into a cache the caller owns. Jobs
+ * submitted with comfyui_jobs_submit_to_cache store their image before
+ * the callback runs.
+ */
+
+#ifndef COMFYUI_JOBS_H
+#define COMFYUI_JOBS_H
+
+#include "01-comfyui-client.h"
+#include "03-image-cache.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Returned by the submit functions when no job was started */
+#define COMFYUI_JOB_INVALID 0
+
+#define COMFYUI_JOBS_DEFAULT_MAX_IN_FLIGHT 2
+
+// {{{ ComfyUIJobHandle
+// Identifies a job. Handles are never reused.
+typedef uint64_t ComfyUIJobHandle;
+// }}}
+
+// {{{ ComfyUIJobCallback
+// Invoked exactly once per job from comfyui_jobs_poll or
+// comfyui_jobs_wait. Takes ownership of response (free it with
+// comfyui_response_free): COMFYUI_STATUS_COMPLETED with the image, or
+// COMFYUI_STATUS_ERROR with error_message, which is "Job cancelled"
+// for cancelled jobs.
+typedef void (*ComfyUIJobCallback)(ComfyUIResponse* response, void* user);
+// }}}
+
+// {{{ ComfyUIJobProgressCallback
+// Invoked from comfyui_jobs_poll or comfyui_jobs_wait, before any
+// result, when a job's progress (0-100) changed. user is the job's.
+// Only the latest percentage is reported if several arrived between
+// polls; nothing is reported without the progress socket.
+typedef void (*ComfyUIJobProgressCallback)(ComfyUIJobHandle handle, int percent,
+                                           void* user);
+// }}}
+
+// {{{ ComfyUIJobOptions
+typedef struct {
+    int max_in_flight;      // Jobs at the server at once (default 2)
+    int timeout_ms;         // Longest a job may run at the server;
+                            // 0 = poll_interval_ms * max_poll_attempts
+    bool poll_only;         // No progress socket; poll every job
+    ComfyUIJobProgressCallback on_progress; // May be NULL
+} ComfyUIJobOptions;
+// }}}
+
+// {{{ ComfyUIJobStats
+typedef struct {
+    int submitted;          // Jobs accepted
+    int completed;          // Finished with an image
+    int failed;             // Finished with an error, timeouts included
+    int cancelled;
+    int timeouts;
+    int queued;             // Waiting for a place at the server now
+    int in_flight;          // At the server now
+    int peak_in_flight;
+    int polls;              // Status checks made
+    int socket_connects;    // Times the progress socket came up
+    int socket_events;      // Messages read from it
+    bool socket_up;         // Connected now
+} ComfyUIJobStats;
+// }}}
+
+typedef struct ComfyUIJobEngine ComfyUIJobEngine;
+
+// {{{ comfyui_jobs_create
+// Starts an engine and its driver thread for the server in config
+// (copied). options may be NULL for the defaults; fields <= 0 take
+// their default. Call comfyui_init first.
+ComfyUIJobEngine* comfyui_jobs_create(const ComfyUIConfig* config,
+                                      const ComfyUIJobOptions* options);
+// }}}
+
+// {{{ comfyui_jobs_free
+// Stops the driver, cancels unfinished jobs and delivers every job's
+// callback before freeing the engine.
+void comfyui_jobs_free(ComfyUIJobEngine* engine);
+// }}}
+
+// {{{ comfyui_jobs_submit
+// Queues a workflow and returns immediately. Returns COMFYUI_JOB_INVALID
+// if the workflow is not valid JSON (callback is not invoked).
+ComfyUIJobHandle comfyui_jobs_submit(ComfyUIJobEngine* engine,
+                                     const char* workflow_json,
+                                     ComfyUIJobCallback callback,
+                                     void* user);
+// }}}
+
+// {{{ comfyui_jobs_submit_to_cache
+// Like comfyui_jobs_submit, but the finished image is stored in cache
+// under prompt_hash (see image_cache_set) before callback, which may be
+// NULL. Returns COMFYUI_JOB_INVALID without starting a job if the image
+// is already cached or a job of this engine is generating it.
+ComfyUIJobHandle comfyui_jobs_submit_to_cache(ComfyUIJobEngine* engine,
+                                              const char* workflow_json,
+                                              ImageCache* cache,
+                                              const char* prompt_hash,
+                                              uint32_t width,
+                                              uint32_t height,
+                                              const char* source_prompt,
+                                              ComfyUIJobCallback callback,
+                                              void* user);
+// }}}
+
+// {{{ comfyui_jobs_cancel
+// Cancels a job that has not finished. Returns false if it already
+// finished or the handle is unknown. Its callback still runs.
+bool comfyui_jobs_cancel(ComfyUIJobEngine* engine, ComfyUIJobHandle handle);
+// }}}
+
+// {{{ comfyui_jobs_poll
+// Delivers jobs that have finished. Never blocks.
+// Returns the number delivered.
+int comfyui_jobs_poll(ComfyUIJobEngine* engine);
+// }}}
+
+// {{{ comfyui_jobs_wait
+// Delivers finished jobs until none is outstanding or timeout_ms pass
+// (< 0 = no limit). Returns the number delivered.
+int comfyui_jobs_wait(ComfyUIJobEngine* engine, int timeout_ms);
+// }}}
+
+// {{{ comfyui_jobs_outstanding
+// Jobs submitted whose callback has not run yet.
+int comfyui_jobs_outstanding(ComfyUIJobEngine* engine);
+// }}}
+
+// {{{ comfyui_jobs_get_stats
+ComfyUIJobStats comfyui_jobs_get_stats(ComfyUIJobEngine* engine);
+// }}}
+
+#endif /* COMFYUI_JOBS_H */
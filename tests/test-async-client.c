@@ -0,0 +1,425 @@
+/*
+ * test-async-client.c - Tests for Asynchronous LLM API Client
+ *
+ * Validates non-blocking submission, completion callbacks, timer-based
+ * retries, cancellation, and SSE streaming (sync and async). A scripted
+ * stub-server instance stands in for the model server so the success
+ * path runs offline.
+ * Run with: gcc -o test-async-client test-async-client.c ../src/llm/10-async-client.c
+ *           ../src/llm/01-api-client.c ../src/llm/19-endpoint-pool.c
+ *           ../src/llm/20-circuit-breaker.c ../src/llm/21-response-memo.c
+ *           ../src/net/09-http-pool.c ../src/tools/stub-server.c
+ *           ../libs/cJSON.c -lcurl -lm -lpthread && ./test-async-client
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/10-async-client.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ sleep_ms
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+// }}}
+
+// {{{ Stub responder
+// Answers each request with a canned chat completion after an optional
+// delay; streams arrive a word at a time, STUB_STREAM_GAP_MS apart.
+#define STUB_STREAM_GAP_MS 150
+
+static StubServer* stub = NULL;
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static int stub_delay_ms = 0;
+static bool stub_ignore_stream = false;
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)body;
+    (void)context;
+    free(reply->text);
+    reply->text = strdup("The dire bear roars.");
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 12;
+    reply->token_ms = reply->stream ? STUB_STREAM_GAP_MS : 0;
+    pthread_mutex_lock(&stub_lock);
+    if (stub_ignore_stream) {
+        reply->stream = false;
+    }
+    reply->delay_ms = reply->stream ? 0 : stub_delay_ms;
+    pthread_mutex_unlock(&stub_lock);
+}
+
+static void stub_behave(int delay_ms, bool ignore_stream) {
+    pthread_mutex_lock(&stub_lock);
+    stub_delay_ms = delay_ms;
+    stub_ignore_stream = ignore_stream;
+    pthread_mutex_unlock(&stub_lock);
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+// }}}
+
+// {{{ Callback capture
+typedef struct {
+    pthread_mutex_t lock;
+    int calls;
+    bool success;
+    char text[256];
+    char error[256];
+} Capture;
+
+static void capture_init(Capture* cap) {
+    pthread_mutex_init(&cap->lock, NULL);
+    cap->calls = 0;
+    cap->success = false;
+    cap->text[0] = '\0';
+    cap->error[0] = '\0';
+}
+
+static void capture_callback(LLMResponse* response, void* user) {
+    Capture* cap = (Capture*)user;
+    pthread_mutex_lock(&cap->lock);
+    cap->calls++;
+    cap->success = response->success;
+    if (response->text) {
+        snprintf(cap->text, sizeof(cap->text), "%s", response->text);
+    }
+    if (response->error) {
+        snprintf(cap->error, sizeof(cap->error), "%s", response->error);
+    }
+    pthread_mutex_unlock(&cap->lock);
+    llm_response_free(response);
+}
+
+static int capture_calls(Capture* cap) {
+    pthread_mutex_lock(&cap->lock);
+    int calls = cap->calls;
+    pthread_mutex_unlock(&cap->lock);
+    return calls;
+}
+
+// Waits up to timeout_ms for the callback to fire
+static bool wait_for(Capture* cap, int timeout_ms) {
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        if (capture_calls(cap) > 0) {
+            return true;
+        }
+        sleep_ms(10);
+    }
+    return capture_calls(cap) > 0;
+}
+
+static double elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static LLMConfig* stub_config(void) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->timeout_ms = 5000;
+    config->max_retries = 0;
+    return config;
+}
+
+static LLMMessage PROMPT[] = {
+    { "system", "You narrate." },
+    { "user", "Narrate the dire bear." }
+};
+// }}}
+
+// {{{ test_invalid_args
+TEST(test_invalid_args) {
+    LLMConfig* config = llm_config_create();
+    assert(llm_request_async(NULL, PROMPT, 2, NULL, NULL) == LLM_REQUEST_INVALID);
+    assert(llm_request_async(config, NULL, 2, NULL, NULL) == LLM_REQUEST_INVALID);
+    assert(llm_request_async(config, PROMPT, 0, NULL, NULL) == LLM_REQUEST_INVALID);
+    assert(llm_async_cancel(LLM_REQUEST_INVALID) == false);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_not_running
+TEST(test_not_running) {
+    // Before llm_async_init nothing can be queued
+    LLMConfig* config = stub_config();
+    assert(llm_request_async(config, PROMPT, 2, NULL, NULL) == LLM_REQUEST_INVALID);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_success_callback
+TEST(test_success_callback) {
+    LLMConfig* config = stub_config();
+    Capture cap;
+    capture_init(&cap);
+
+    LLMRequestHandle handle = llm_request_async(config, PROMPT, 2,
+                                                capture_callback, &cap);
+    assert(handle != LLM_REQUEST_INVALID);
+
+    // Config may be released immediately; the engine copied it
+    llm_config_free(config);
+
+    assert(wait_for(&cap, 3000));
+    assert(cap.calls == 1);
+    assert(cap.success == true);
+    assert(strcmp(cap.text, "The dire bear roars.") == 0);
+
+    // Cancelling a finished request is a harmless no-op
+    assert(llm_async_cancel(handle) == false);
+}
+// }}}
+
+// {{{ test_submit_does_not_block
+TEST(test_submit_does_not_block) {
+    stub_behave(300, false);
+    LLMConfig* config = stub_config();
+    Capture cap;
+    capture_init(&cap);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    LLMRequestHandle handle = llm_request_async(config, PROMPT, 2,
+                                                capture_callback, &cap);
+    double submit_ms = elapsed_ms(&start);
+    assert(handle != LLM_REQUEST_INVALID);
+    assert(submit_ms < 50.0);
+    printf(" (submit %.2fms) ", submit_ms);
+
+    assert(wait_for(&cap, 3000));
+    assert(cap.success == true);
+
+    stub_behave(0, false);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_cancel_in_flight
+TEST(test_cancel_in_flight) {
+    stub_behave(500, false);
+    LLMConfig* config = stub_config();
+    Capture cap;
+    capture_init(&cap);
+
+    LLMRequestHandle handle = llm_request_async(config, PROMPT, 2,
+                                                capture_callback, &cap);
+    assert(handle != LLM_REQUEST_INVALID);
+    sleep_ms(50);
+    assert(llm_async_cancel(handle) == true);
+
+    assert(wait_for(&cap, 1000));
+    assert(cap.calls == 1);
+    assert(cap.success == false);
+    assert(strcmp(cap.error, "Request cancelled") == 0);
+
+    stub_behave(0, false);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_timer_retry
+TEST(test_timer_retry) {
+    // Nothing listens on this port, so each attempt fails fast and the
+    // single retry is scheduled on the backoff timer.
+    LLMConfig* config = llm_config_create();
+    free(config->endpoint);
+    config->endpoint = strdup("http://127.0.0.1:59998");
+    config->max_retries = 1;
+    config->timeout_ms = 1000;
+
+    LLMAsyncStats before = llm_async_get_stats();
+    Capture cap;
+    capture_init(&cap);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    LLMRequestHandle handle = llm_request_async(config, PROMPT, 2,
+                                                capture_callback, &cap);
+    assert(handle != LLM_REQUEST_INVALID);
+    assert(elapsed_ms(&start) < 50.0);
+
+    assert(wait_for(&cap, 5000));
+    assert(cap.success == false);
+    assert(elapsed_ms(&start) >= 900.0);  // Waited for the backoff timer
+
+    LLMAsyncStats after = llm_async_get_stats();
+    assert(after.retries == before.retries + 1);
+    assert(after.failed == before.failed + 1);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ Stream capture
+typedef struct {
+    pthread_mutex_t lock;
+    int deltas;
+    char text[256];
+    double first_delta_ms;
+    struct timespec start;
+} StreamCapture;
+
+static void stream_capture_delta(const char* delta, void* user) {
+    StreamCapture* cap = (StreamCapture*)user;
+    pthread_mutex_lock(&cap->lock);
+    if (cap->deltas == 0) {
+        cap->first_delta_ms = elapsed_ms(&cap->start);
+    }
+    cap->deltas++;
+    strncat(cap->text, delta, sizeof(cap->text) - strlen(cap->text) - 1);
+    pthread_mutex_unlock(&cap->lock);
+}
+
+static void stream_capture_init(StreamCapture* cap) {
+    memset(cap, 0, sizeof(*cap));
+    pthread_mutex_init(&cap->lock, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &cap->start);
+}
+
+typedef struct {
+    StreamCapture stream;
+    Capture final;
+} AsyncStreamCapture;
+
+static void async_stream_delta(const char* delta, void* user) {
+    stream_capture_delta(delta, &((AsyncStreamCapture*)user)->stream);
+}
+
+static void async_stream_done(LLMResponse* response, void* user) {
+    capture_callback(response, &((AsyncStreamCapture*)user)->final);
+}
+// }}}
+
+// {{{ test_stream_sync_first_token
+TEST(test_stream_sync_first_token) {
+    LLMConfig* config = stub_config();
+    StreamCapture cap;
+    stream_capture_init(&cap);
+
+    LLMResponse* response = llm_request_stream(config, PROMPT, 2,
+                                               stream_capture_delta, &cap);
+    double total_ms = elapsed_ms(&cap.start);
+
+    assert(response != NULL);
+    assert(response->success == true);
+    assert(strcmp(response->text, "The dire bear roars.") == 0);
+    assert(cap.deltas == 4);
+    assert(strcmp(cap.text, "The dire bear roars.") == 0);
+
+    // First text arrives well before the generation finishes
+    assert(cap.first_delta_ms + STUB_STREAM_GAP_MS <= total_ms);
+    printf(" (first %.1fms, total %.1fms) ", cap.first_delta_ms, total_ms);
+
+    llm_response_free(response);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_stream_async
+TEST(test_stream_async) {
+    LLMConfig* config = stub_config();
+    AsyncStreamCapture cap;
+    stream_capture_init(&cap.stream);
+    capture_init(&cap.final);
+
+    LLMRequestHandle handle = llm_request_async_stream(config, PROMPT, 2,
+                                                       async_stream_delta,
+                                                       async_stream_done, &cap);
+    assert(handle != LLM_REQUEST_INVALID);
+    llm_config_free(config);
+
+    assert(wait_for(&cap.final, 3000));
+    assert(cap.final.success == true);
+    assert(strcmp(cap.final.text, "The dire bear roars.") == 0);
+    assert(cap.stream.deltas == 4);
+    assert(strcmp(cap.stream.text, "The dire bear roars.") == 0);
+}
+// }}}
+
+// {{{ test_stream_plain_fallback
+TEST(test_stream_plain_fallback) {
+    // A server that ignores "stream" answers with plain JSON; the text
+    // is then delivered as a single delta
+    stub_behave(0, true);
+    LLMConfig* config = stub_config();
+    StreamCapture cap;
+    stream_capture_init(&cap);
+
+    LLMResponse* response = llm_request_stream(config, PROMPT, 2,
+                                               stream_capture_delta, &cap);
+    assert(response->success == true);
+    assert(cap.deltas == 1);
+    assert(strcmp(cap.text, "The dire bear roars.") == 0);
+
+    llm_response_free(response);
+    llm_config_free(config);
+    stub_behave(0, false);
+}
+// }}}
+
+// {{{ test_cleanup_cancels_outstanding
+TEST(test_cleanup_cancels_outstanding) {
+    stub_behave(2000, false);
+    LLMConfig* config = stub_config();
+    Capture cap;
+    capture_init(&cap);
+
+    LLMRequestHandle handle = llm_request_async(config, PROMPT, 2,
+                                                capture_callback, &cap);
+    assert(handle != LLM_REQUEST_INVALID);
+    sleep_ms(50);
+
+    llm_async_cleanup();
+    assert(cap.calls == 1);
+    assert(strcmp(cap.error, "Request cancelled") == 0);
+
+    stub_behave(0, false);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== Async LLM Client Tests ===\n");
+
+    stub_start();
+
+    RUN_TEST(test_invalid_args);
+    RUN_TEST(test_not_running);
+
+    assert(llm_async_init());
+    RUN_TEST(test_success_callback);
+    RUN_TEST(test_submit_does_not_block);
+    RUN_TEST(test_cancel_in_flight);
+    RUN_TEST(test_timer_retry);
+    RUN_TEST(test_stream_sync_first_token);
+    RUN_TEST(test_stream_async);
+    RUN_TEST(test_stream_plain_fallback);
+    RUN_TEST(test_cleanup_cancels_outstanding);
+    stub_server_stop(stub);
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
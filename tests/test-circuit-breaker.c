@@ -0,0 +1,534 @@
+/*
+ * test-circuit-breaker.c - Tests for the LLM Circuit Breaker
+ *
+ * Trips the breaker on error rate and on p95 latency, checks that an
+ * open breaker fails requests fast and bounds their time while the
+ * model is slow, and that background and half-open probes close it
+ * again once the model recovers. With an endpoint pool, checks that a
+ * failing backend opens only its own circuit, requests fail over to
+ * the others, and each backend is probed on its own. Uses the local stub server.
+ * Run with: gcc -o test-circuit-breaker test-circuit-breaker.c
+ *           ../src/llm/20-circuit-breaker.c ../src/llm/21-response-memo.c
+ *           ../src/llm/10-async-client.c ../src/llm/01-api-client.c
+ *           ../src/llm/19-endpoint-pool.c ../src/tools/stub-server.c
+ *           ../src/net/09-http-pool.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-circuit-breaker
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/20-circuit-breaker.h"
+#include "../src/llm/10-async-client.h"
+#include "../src/llm/19-endpoint-pool.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ now_ms
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+// }}}
+
+// {{{ sleep_ms
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+// }}}
+
+// {{{ start_stub
+static StubServer* start_stub(int latency_ms, double failure_rate) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = latency_ms;
+    stub.tokens_per_second = 0;
+    stub.failure_rate = failure_rate;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    return server;
+}
+// }}}
+
+// {{{ config_for
+static LLMConfig* config_for(StubServer* server) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(server));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    return config;
+}
+// }}}
+
+// {{{ outcome
+// Reports a made-up attempt at a pool endpoint to the breaker.
+static void outcome_at(LLMBreaker* breaker, int endpoint, bool success, long status,
+                       double latency_ms) {
+    LLMResponse response = { .success = success, .http_status = status };
+    llm_breaker_record(breaker, endpoint, &response, latency_ms);
+}
+
+// Reports a made-up attempt to a breaker without a pool.
+static void outcome(LLMBreaker* breaker, bool success, long status, double latency_ms) {
+    outcome_at(breaker, -1, success, status, latency_ms);
+}
+// }}}
+
+// {{{ pool_for
+// A pool over the given stub servers; ejection is left to the breaker.
+static LLMEndpointPool* pool_for(StubServer** servers, int count) {
+    char urls[4][64];
+    LLMEndpointSpec specs[4];
+    for (int i = 0; i < count; i++) {
+        snprintf(urls[i], sizeof(urls[i]), "http://127.0.0.1:%d",
+                 stub_server_port(servers[i]));
+        specs[i] = (LLMEndpointSpec){ .url = urls[i] };
+    }
+    LLMEndpointPoolConfig options = { .failure_threshold = 1000 };
+    LLMEndpointPool* pool = llm_endpoint_pool_create(specs, count, &options);
+    assert(pool != NULL);
+    return pool;
+}
+// }}}
+
+// {{{ wait_for_state
+static bool wait_for_state(LLMBreaker* breaker, LLMBreakerState state, int timeout_ms) {
+    double deadline = now_ms() + timeout_ms;
+    while (now_ms() < deadline) {
+        if (llm_breaker_get_stats(breaker).state == state) {
+            return true;
+        }
+        llm_breaker_is_open(breaker);
+        sleep_ms(5);
+    }
+    return false;
+}
+// }}}
+
+// {{{ test_create
+TEST(test_create) {
+    LLMConfig* config = llm_config_create();
+    LLMBreaker* breaker = llm_breaker_create(config, NULL);
+    assert(breaker != NULL);
+
+    LLMBreakerStats stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_CLOSED);
+    assert(stats.samples == 0);
+    assert(llm_breaker_attempt_timeout(breaker) == 8000);
+    assert(llm_breaker_allow(breaker));
+    assert(!llm_breaker_is_open(breaker));
+    llm_breaker_free(breaker);
+
+    // No breaker lets everything through
+    assert(llm_breaker_allow(NULL));
+    assert(!llm_breaker_is_open(NULL));
+    assert(llm_breaker_attempt_timeout(NULL) == 0);
+    assert(llm_breaker_create(NULL, NULL) == NULL);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_trips_on_errors
+TEST(test_trips_on_errors) {
+    LLMConfig* config = llm_config_create();
+    LLMBreakerConfig options = { .window = 10, .min_samples = 4,
+                                 .max_error_rate = 0.5f, .open_ms = 60000 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+
+    // Client errors are the request's fault, not the endpoint's
+    for (int i = 0; i < 4; i++) {
+        outcome(breaker, false, 400, 10.0);
+    }
+    assert(llm_breaker_get_stats(breaker).state == LLM_BREAKER_CLOSED);
+
+    // Half the window failing trips it: 4 of 8
+    outcome(breaker, false, 503, 10.0);
+    outcome(breaker, false, 429, 10.0);
+    outcome(breaker, false, 0, 10.0);
+    LLMBreakerStats stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_CLOSED);
+    assert(stats.samples == 7);
+    outcome(breaker, false, 0, 10.0);
+
+    stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_OPEN);
+    assert(stats.trips == 1);
+    assert(stats.samples == 0);
+
+    // Open: requests are refused and counted, late outcomes ignored
+    assert(!llm_breaker_allow(breaker));
+    assert(!llm_breaker_allow(breaker));
+    assert(llm_breaker_is_open(breaker));
+    outcome(breaker, true, 200, 10.0);
+    stats = llm_breaker_get_stats(breaker);
+    assert(stats.rejected == 2);
+    assert(stats.state == LLM_BREAKER_OPEN);
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_trips_on_latency
+TEST(test_trips_on_latency) {
+    LLMConfig* config = llm_config_create();
+    LLMBreakerConfig options = { .window = 40, .min_samples = 20,
+                                 .latency_budget_ms = 500, .open_ms = 60000 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+    assert(llm_breaker_attempt_timeout(breaker) == 1000);
+
+    // One slow attempt in twenty stays above the 95th percentile
+    outcome(breaker, true, 200, 2000.0);
+    for (int i = 0; i < 19; i++) {
+        outcome(breaker, true, 200, 100.0);
+    }
+    LLMBreakerStats stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_CLOSED);
+    assert(stats.samples == 20);
+    assert(stats.error_rate == 0.0f);
+    assert(stats.p95_latency_ms == 100.0f);
+
+    // A second one pushes p95 over the budget
+    outcome(breaker, true, 200, 900.0);
+    stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_OPEN);
+    assert(stats.trips == 1);
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_half_open_probe
+// Without the async engine the first request after open_ms probes.
+TEST(test_half_open_probe) {
+    LLMConfig* config = llm_config_create();
+    LLMBreakerConfig options = { .min_samples = 1, .open_ms = 40,
+                                 .latency_budget_ms = 500 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+
+    outcome(breaker, false, 503, 10.0);
+    assert(!llm_breaker_allow(breaker));
+    sleep_ms(60);
+
+    // Due: one request is admitted, the rest still fail fast
+    assert(!llm_breaker_is_open(breaker));
+    assert(llm_breaker_allow(breaker));
+    assert(llm_breaker_get_stats(breaker).state == LLM_BREAKER_HALF_OPEN);
+    assert(!llm_breaker_allow(breaker));
+    assert(llm_breaker_is_open(breaker));
+
+    // A slow success is not a recovery
+    outcome(breaker, true, 200, 800.0);
+    LLMBreakerStats stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_OPEN);
+    assert(stats.probe_failures == 1);
+
+    sleep_ms(60);
+    assert(llm_breaker_allow(breaker));
+    outcome(breaker, true, 200, 50.0);
+    stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_CLOSED);
+    assert(stats.probes == 2);
+    assert(stats.recoveries == 1);
+    assert(stats.trips == 1);
+    assert(llm_breaker_allow(breaker));
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_fails_fast
+TEST(test_fails_fast) {
+    StubServer* server = start_stub(0, 1.0);
+    LLMConfig* config = config_for(server);
+    config->max_retries = 3;
+    LLMBreakerConfig options = { .min_samples = 3, .open_ms = 60000 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+    config->breaker = breaker;
+
+    // One attempt each despite max_retries: no backoff is waited out
+    double start = now_ms();
+    for (int i = 0; i < 3; i++) {
+        LLMResponse* response = llm_request(config, "Narrate.", "The bear attacks.");
+        assert(!response->success);
+        assert(response->http_status == 503);
+        llm_response_free(response);
+    }
+    assert(now_ms() - start < 900.0);
+    assert(stub_server_get_stats(server).requests == 3);
+
+    // Open: no request reaches the server
+    LLMMessage messages[1] = { { "user", "The bear attacks." } };
+    LLMResponse* response = llm_request_messages(config, messages, 1);
+    assert(!response->success);
+    assert(strcmp(response->error, "LLM circuit open") == 0);
+    llm_response_free(response);
+    response = llm_request_stream(config, messages, 1, NULL, NULL);
+    assert(strcmp(response->error, "LLM circuit open") == 0);
+    llm_response_free(response);
+    assert(stub_server_get_stats(server).requests == 3);
+    assert(llm_breaker_get_stats(breaker).rejected == 2);
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_slow_model_bounded
+TEST(test_slow_model_bounded) {
+    StubServer* server = start_stub(400, 0.0);
+    LLMConfig* config = config_for(server);
+    LLMBreakerConfig options = { .min_samples = 2, .latency_budget_ms = 50,
+                                 .attempt_timeout_ms = 100, .open_ms = 60000 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+    config->breaker = breaker;
+
+    // Each call is cut off at the attempt timeout, then refused at once
+    for (int i = 0; i < 4; i++) {
+        double start = now_ms();
+        LLMResponse* response = llm_request(config, NULL, "The bear attacks.");
+        double elapsed = now_ms() - start;
+        assert(!response->success);
+        assert(elapsed < 300.0);
+        if (i >= 2) {
+            assert(strcmp(response->error, "LLM circuit open") == 0);
+            assert(elapsed < 20.0);
+        }
+        llm_response_free(response);
+    }
+    LLMBreakerStats stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_OPEN);
+    assert(stats.trips == 1);
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_pool_failover
+// One failing backend opens only its own circuit; requests fail over.
+TEST(test_pool_failover) {
+    StubServer* servers[2] = { start_stub(0, 1.0), start_stub(0, 0.0) };
+    LLMEndpointPool* pool = pool_for(servers, 2);
+    LLMConfig* config = config_for(servers[0]);
+    config->endpoints = pool;
+    config->max_retries = 3;
+    LLMBreakerConfig options = { .min_samples = 2, .open_ms = 60000 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+    config->breaker = breaker;
+    assert(llm_breaker_max_retries(breaker) == 1);
+
+    // Every request is answered, by failing over without backoff
+    double start = now_ms();
+    for (int i = 0; i < 8; i++) {
+        LLMResponse* response = llm_request(config, NULL, "The bear attacks.");
+        assert(response->success);
+        llm_response_free(response);
+    }
+    assert(now_ms() - start < 900.0);
+
+    // The failing backend is out of routing after its two failures
+    assert(stub_server_get_stats(servers[0]).requests == 2);
+    assert(llm_breaker_get_endpoint_stats(breaker, 0).state == LLM_BREAKER_OPEN);
+    assert(llm_breaker_get_endpoint_stats(breaker, 1).state == LLM_BREAKER_CLOSED);
+    assert(llm_endpoint_pool_get_stats(pool, 0).held);
+    assert(!llm_endpoint_pool_get_stats(pool, 1).held);
+
+    LLMBreakerStats stats = llm_breaker_get_stats(breaker);
+    assert(stats.state == LLM_BREAKER_CLOSED);
+    assert(stats.open_endpoints == 1);
+    assert(stats.trips == 1);
+    assert(stats.rejected == 0);
+    assert(llm_breaker_allow(breaker));
+
+    // Once the other backend opens too, requests fail fast
+    for (int i = 0; i < 8; i++) {
+        outcome_at(breaker, 1, false, 503, 10.0);
+    }
+    assert(llm_breaker_get_stats(breaker).open_endpoints == 2);
+    assert(llm_breaker_is_open(breaker));
+    LLMResponse* response = llm_request(config, NULL, "The bear attacks.");
+    assert(strcmp(response->error, "LLM circuit open") == 0);
+    llm_response_free(response);
+
+    // A breaker without a pool never fails over
+    LLMConfig* single = config_for(servers[0]);
+    LLMBreaker* lone = llm_breaker_create(single, NULL);
+    assert(llm_breaker_max_retries(lone) == 0);
+    assert(llm_breaker_get_endpoint_stats(lone, 1).state == LLM_BREAKER_CLOSED);
+    llm_breaker_free(lone);
+    llm_config_free(single);
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+    llm_endpoint_pool_free(pool);
+    stub_server_stop(servers[0]);
+    stub_server_stop(servers[1]);
+}
+// }}}
+
+// {{{ test_async_requests
+static pthread_mutex_t failures_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void count_failure(LLMResponse* response, void* user) {
+    pthread_mutex_lock(&failures_lock);
+    if (!response->success) {
+        (*(int*)user)++;
+    }
+    pthread_mutex_unlock(&failures_lock);
+    llm_response_free(response);
+}
+
+static int failures_seen(const int* failures) {
+    pthread_mutex_lock(&failures_lock);
+    int seen = *failures;
+    pthread_mutex_unlock(&failures_lock);
+    return seen;
+}
+
+TEST(test_async_requests) {
+    StubServer* server = start_stub(0, 1.0);
+    LLMConfig* config = config_for(server);
+    LLMBreakerConfig options = { .min_samples = 1, .open_ms = 60000 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+    config->breaker = breaker;
+
+    LLMMessage messages[1] = { { "user", "The bear attacks." } };
+    int failures = 0;
+    assert(llm_request_async(config, messages, 1, count_failure, &failures) !=
+           LLM_REQUEST_INVALID);
+    assert(wait_for_state(breaker, LLM_BREAKER_OPEN, 2000));
+
+    // Refused requests still get their callback
+    assert(llm_request_async(config, messages, 1, count_failure, &failures) !=
+           LLM_REQUEST_INVALID);
+    double deadline = now_ms() + 2000;
+    while (failures_seen(&failures) < 2 && now_ms() < deadline) {
+        sleep_ms(5);
+    }
+    assert(failures_seen(&failures) == 2);
+    assert(stub_server_get_stats(server).requests == 1);
+    assert(llm_breaker_get_stats(breaker).rejected == 1);
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_background_probe
+TEST(test_background_probe) {
+    StubServer* server = start_stub(0, 0.0);
+    LLMConfig* config = config_for(server);
+    LLMBreakerConfig options = { .min_samples = 1, .open_ms = 30 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+
+    // Trip it, then let the probe find the model healthy
+    outcome(breaker, false, 0, 10.0);
+    assert(!llm_breaker_allow(breaker));
+    assert(wait_for_state(breaker, LLM_BREAKER_CLOSED, 2000));
+
+    // The probe went to the server; callers never waited on it
+    LLMBreakerStats stats = llm_breaker_get_stats(breaker);
+    assert(stats.probes == 1);
+    assert(stats.recoveries == 1);
+    assert(stub_server_get_stats(server).requests == 1);
+    llm_breaker_free(breaker);
+    stub_server_stop(server);
+
+    // A failing server keeps it open, probing again every open_ms
+    server = start_stub(0, 1.0);
+    llm_config_free(config);
+    config = config_for(server);
+    breaker = llm_breaker_create(config, &options);
+    outcome(breaker, false, 0, 10.0);
+    double deadline = now_ms() + 2000;
+    while (llm_breaker_get_stats(breaker).probe_failures < 2 && now_ms() < deadline) {
+        assert(llm_breaker_is_open(breaker));
+        sleep_ms(5);
+    }
+    stats = llm_breaker_get_stats(breaker);
+    assert(stats.probe_failures >= 2);
+    assert(stats.state == LLM_BREAKER_OPEN);
+
+    // Freed with a probe possibly in flight
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_probes_each_backend
+TEST(test_probes_each_backend) {
+    StubServer* servers[2] = { start_stub(0, 0.0), start_stub(0, 0.0) };
+    LLMEndpointPool* pool = pool_for(servers, 2);
+    LLMConfig* config = config_for(servers[0]);
+    config->endpoints = pool;
+    LLMBreakerConfig options = { .min_samples = 1, .open_ms = 30 };
+    LLMBreaker* breaker = llm_breaker_create(config, &options);
+
+    // Only the second backend trips; its probe goes to it alone
+    outcome_at(breaker, 1, false, 0, 10.0);
+    assert(llm_endpoint_pool_get_stats(pool, 1).held);
+    assert(llm_breaker_allow(breaker));
+    double deadline = now_ms() + 2000;
+    while (llm_breaker_get_endpoint_stats(breaker, 1).state != LLM_BREAKER_CLOSED &&
+           now_ms() < deadline) {
+        llm_breaker_is_open(breaker);
+        sleep_ms(5);
+    }
+
+    LLMBreakerStats stats = llm_breaker_get_endpoint_stats(breaker, 1);
+    assert(stats.state == LLM_BREAKER_CLOSED);
+    assert(stats.probes == 1 && stats.recoveries == 1);
+    assert(llm_breaker_get_endpoint_stats(breaker, 0).probes == 0);
+    assert(stub_server_get_stats(servers[0]).requests == 0);
+    assert(stub_server_get_stats(servers[1]).requests == 1);
+    assert(!llm_endpoint_pool_get_stats(pool, 1).held);
+
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+    llm_endpoint_pool_free(pool);
+    stub_server_stop(servers[0]);
+    stub_server_stop(servers[1]);
+}
+// }}}
+
+int main(void) {
+    printf("=== Circuit Breaker Tests ===\n");
+
+    assert(llm_init());
+
+    RUN_TEST(test_create);
+    RUN_TEST(test_trips_on_errors);
+    RUN_TEST(test_trips_on_latency);
+    RUN_TEST(test_half_open_probe);
+    RUN_TEST(test_fails_fast);
+    RUN_TEST(test_slow_model_bounded);
+    RUN_TEST(test_pool_failover);
+
+    assert(llm_async_init());
+    RUN_TEST(test_async_requests);
+    RUN_TEST(test_background_probe);
+    RUN_TEST(test_probes_each_backend);
+    llm_async_cleanup();
+
+    llm_cleanup();
+
+    printf("\nAll circuit breaker tests passed!\n");
+    return 0;
+}
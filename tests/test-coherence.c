@@ -462,6 +462,82 @@ TEST(consecutive_issues_tracking) {
 }
 /* }}} */
 
+/* {{{ test_patterns_single_pass */
+TEST(patterns_single_pass) {
+    Game* game = create_test_game();
+    WorldState* state = create_test_world_state(game);
+    CoherenceManager* manager = coherence_manager_create(NULL);
+
+    CardType** types = malloc(sizeof(CardType*) * 2);
+    types[0] = card_type_create("dire_bear", "Dire Bear", 4, FACTION_WILDS, CARD_KIND_SHIP);
+    types[1] = card_type_create("trade_hall", "Trade Hall", 3, FACTION_MERCHANT, CARD_KIND_BASE);
+    game_set_card_types(game, types, 2);
+
+    ASSERT_TRUE(coherence_compile_patterns(manager, game));
+    PatternSet* compiled = manager->patterns;
+    ASSERT_NOT_NULL(compiled);
+
+    /* Names match regardless of case; card names are counted */
+    const char* narrative = "LADY MORGAINE, once called Player 1, sends a dire bear "
+                            "and a Dire Bear against the Trade Hall.";
+    CoherenceCheck* check = coherence_check(manager, narrative, game, state);
+    ASSERT_TRUE(check->names_consistent);
+    ASSERT_EQ(check->card_mentions, 3);
+    coherence_check_free(check);
+
+    /* Patterns are reused across checks of the same game */
+    check = coherence_check(manager, "Player 2 strikes.", game, state);
+    ASSERT_FALSE(check->names_consistent);
+    ASSERT_EQ(check->card_mentions, 0);
+    coherence_check_free(check);
+    ASSERT_TRUE(manager->patterns == compiled);
+
+    /* The single pass agrees with the individual checks */
+    const char* samples[] = {
+        "Player 1 with 500 authority commands the Merchant Wilds on turn 50.",
+        "Turn 40 arrives; health 45 for Lord Darkon, player 2.",
+        "The kingdom artificer returns on turn 6 with 120 authority.",
+        "Lady Morgaine strikes; the Wilds roar."
+    };
+    for (int i = 0; i < 4; i++) {
+        check = coherence_check(manager, samples[i], game, state);
+        ASSERT_EQ(check->names_consistent, coherence_check_names(samples[i], game));
+        ASSERT_EQ(check->faction_consistent, coherence_check_factions(samples[i]));
+        ASSERT_EQ(check->timeline_consistent,
+                  coherence_check_timeline(samples[i], state));
+        ASSERT_EQ(check->authority_plausible,
+                  coherence_check_authority(samples[i], game));
+        coherence_check_free(check);
+    }
+
+    /* A new game recompiles */
+    Game* other = game_create(2);
+    game_add_player(other, "Sir Aldric");
+    check = coherence_check(manager, "Player 1 rides out.", other, state);
+    ASSERT_FALSE(check->names_consistent);
+    ASSERT_TRUE(manager->patterns != compiled);
+    coherence_check_free(check);
+
+    /* So do new names at the same address, as when a freed game's
+     * memory is reused; unchanged names keep the patterns */
+    free(game->players[0]->name);
+    game->players[0]->name = strdup("Sir Aldric");
+    check = coherence_check(manager, "Player 1, Sir Aldric, rides out.", game, state);
+    ASSERT_TRUE(check->names_consistent);
+    coherence_check_free(check);
+    compiled = manager->patterns;
+    check = coherence_check(manager, "Player 1, Lady Morgaine, rides out.", game, state);
+    ASSERT_FALSE(check->names_consistent);
+    coherence_check_free(check);
+    ASSERT_TRUE(manager->patterns == compiled);
+
+    game_free(other);
+    coherence_manager_free(manager);
+    world_state_free(state);
+    game_free(game);
+}
+/* }}} */
+
 /* {{{ main */
 int main(void) {
     printf("=== Coherence Recovery Tests ===\n\n");
@@ -492,6 +568,7 @@ int main(void) {
     printf("\nFull coherence check tests:\n");
     RUN_TEST(check_full_coherent);
     RUN_TEST(check_full_incoherent);
+    RUN_TEST(patterns_single_pass);
 
     printf("\nRecovery tests:\n");
     RUN_TEST(rebuild_world_state);
@@ -0,0 +1,475 @@
+/*
+ * test-comfyui-jobs.c - Tests for the Asynchronous ComfyUI Job Engine
+ *
+ * Runs jobs against the local ComfyUI stub: many jobs side by side
+ * within the in-flight bound, cancellation, timeouts, failed jobs,
+ * storing into an image cache, callbacks delivered on free, and the
+ * progress socket: events instead of polls, and polling again when the
+ * socket is missing or dropped.
+ * Run with: gcc -o test-comfyui-jobs test-comfyui-jobs.c
+ *           ../src/visual/04-comfyui-jobs.c ../src/visual/01-comfyui-client.c
+ *           ../src/visual/03-image-cache.c ../src/tools/stub-server.c
+ *           ../src/net/09-http-pool.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-comfyui-jobs
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/visual/04-comfyui-jobs.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+static const char* TEST_CACHE_DIR = "/tmp/symbeline-test-comfyui-jobs";
+static const char* WORKFLOW = "{\"3\":{\"class_type\":\"KSampler\",\"inputs\":{}}}";
+
+// {{{ Results
+// What the callbacks have seen.
+typedef struct {
+    int delivered;
+    int completed;
+    int images;
+    char last_error[128];
+} Results;
+// }}}
+
+// {{{ on_job
+static void on_job(ComfyUIResponse* response, void* user) {
+    Results* results = user;
+    results->delivered++;
+    if (response->status == COMFYUI_STATUS_COMPLETED) {
+        results->completed++;
+        if (response->image_data != NULL &&
+            memcmp(response->image_data, "\x89PNG", 4) == 0) {
+            results->images++;
+        }
+    } else if (response->error_message != NULL) {
+        snprintf(results->last_error, sizeof(results->last_error), "%s",
+                 response->error_message);
+    }
+    comfyui_response_free(response);
+}
+// }}}
+
+// {{{ elapsed_ms
+static long elapsed_ms(const struct timespec* since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 +
+           (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+// }}}
+
+// {{{ Progress
+// What the progress callback has seen.
+typedef struct {
+    int notes;
+    int last_percent;
+    bool decreased;
+} Progress;
+// }}}
+
+// {{{ on_progress
+// Progress for jobs submitted with a Progress as their user pointer.
+static void on_progress(ComfyUIJobHandle handle, int percent, void* user) {
+    Progress* progress = user;
+    assert(handle != COMFYUI_JOB_INVALID);
+    assert(percent >= 0 && percent <= 100);
+    if (progress->notes > 0 && percent < progress->last_percent) {
+        progress->decreased = true;
+    }
+    progress->notes++;
+    progress->last_percent = percent;
+}
+// }}}
+
+// {{{ on_progress_job
+static void on_progress_job(ComfyUIResponse* response, void* user) {
+    Progress* progress = user;
+    if (response->status == COMFYUI_STATUS_COMPLETED) {
+        progress->last_percent = 1000;  // Marks the result
+    }
+    comfyui_response_free(response);
+}
+// }}}
+
+// {{{ wait_for_socket
+// Waits up to two seconds for the engine's progress socket to be up
+// after coming up connects times.
+static bool wait_for_socket(ComfyUIJobEngine* engine, int connects) {
+    struct timespec start, pause = { 0, 5 * 1000000L };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (elapsed_ms(&start) < 2000) {
+        ComfyUIJobStats stats = comfyui_jobs_get_stats(engine);
+        if (stats.socket_up && stats.socket_connects >= connects) {
+            return true;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return false;
+}
+// }}}
+
+// {{{ start_stub
+// Starts a ComfyUI stub whose jobs run for run_ms and points config at it.
+static StubServer* start_stub_with(int run_ms, double failure_rate, bool websocket,
+                                   ComfyUIConfig* config) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_COMFYUI);
+    stub.latency.base_ms = run_ms;
+    stub.failure_rate = failure_rate;
+    stub.websocket = websocket;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+
+    free(config->server_url);
+    config->server_url = strdup("127.0.0.1");
+    config->port = stub_server_port(server);
+    config->poll_interval_ms = 10;
+    return server;
+}
+
+static StubServer* start_stub(int run_ms, double failure_rate, ComfyUIConfig* config) {
+    return start_stub_with(run_ms, failure_rate, true, config);
+}
+// }}}
+
+// {{{ test_concurrent_jobs
+TEST(test_concurrent_jobs) {
+    ComfyUIConfig* config = comfyui_config_create();
+    StubServer* server = start_stub(60, 0.0, config);
+    ComfyUIJobOptions options = { .max_in_flight = 3 };
+    ComfyUIJobEngine* engine = comfyui_jobs_create(config, &options);
+    assert(engine != NULL);
+
+    // Submitting never waits for the server
+    Results results;
+    memset(&results, 0, sizeof(results));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < 8; i++) {
+        assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+               COMFYUI_JOB_INVALID);
+    }
+    assert(elapsed_ms(&start) < 50);
+    assert(comfyui_jobs_outstanding(engine) == 8);
+
+    assert(comfyui_jobs_wait(engine, -1) == 8);
+    assert(results.delivered == 8);
+    assert(results.completed == 8);
+    assert(results.images == 8);
+    assert(comfyui_jobs_outstanding(engine) == 0);
+    assert(comfyui_jobs_poll(engine) == 0);
+
+    // Three at a time: 8 jobs of 60ms take three rounds, not eight
+    assert(elapsed_ms(&start) < 8 * 60);
+    ComfyUIJobStats stats = comfyui_jobs_get_stats(engine);
+    assert(stats.submitted == 8);
+    assert(stats.completed == 8);
+    assert(stats.queued == 0);
+    assert(stats.in_flight == 0);
+    assert(stats.peak_in_flight == 3);
+
+    StubServerStats served = stub_server_get_stats(server);
+    assert(served.requests == 8);
+    assert(served.images == 8);
+    assert(served.peak_active <= 3);
+
+    comfyui_jobs_free(engine);
+    comfyui_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_cancel_and_invalid
+TEST(test_cancel_and_invalid) {
+    ComfyUIConfig* config = comfyui_config_create();
+    StubServer* server = start_stub(100, 0.0, config);
+    ComfyUIJobOptions options = { .max_in_flight = 1 };
+    ComfyUIJobEngine* engine = comfyui_jobs_create(config, &options);
+
+    Results first, second;
+    memset(&first, 0, sizeof(first));
+    memset(&second, 0, sizeof(second));
+    assert(comfyui_jobs_submit(engine, "{not json", on_job, &first) ==
+           COMFYUI_JOB_INVALID);
+    assert(comfyui_jobs_submit(NULL, WORKFLOW, on_job, &first) ==
+           COMFYUI_JOB_INVALID);
+
+    ComfyUIJobHandle a = comfyui_jobs_submit(engine, WORKFLOW, on_job, &first);
+    ComfyUIJobHandle b = comfyui_jobs_submit(engine, WORKFLOW, on_job, &second);
+    assert(a != COMFYUI_JOB_INVALID && b != COMFYUI_JOB_INVALID && a != b);
+
+    // The second job is still queued behind the first
+    assert(comfyui_jobs_cancel(engine, b));
+    assert(!comfyui_jobs_cancel(engine, b));
+    assert(!comfyui_jobs_cancel(engine, 9999));
+
+    assert(comfyui_jobs_wait(engine, -1) == 2);
+    assert(first.completed == 1);
+    assert(second.delivered == 1);
+    assert(second.completed == 0);
+    assert(strcmp(second.last_error, "Job cancelled") == 0);
+    assert(!comfyui_jobs_cancel(engine, a));
+
+    ComfyUIJobStats stats = comfyui_jobs_get_stats(engine);
+    assert(stats.submitted == 2);
+    assert(stats.cancelled == 1);
+    assert(stats.completed == 1);
+    assert(stub_server_get_stats(server).requests == 1);
+
+    comfyui_jobs_free(engine);
+    comfyui_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_timeout_and_failure
+TEST(test_timeout_and_failure) {
+    ComfyUIConfig* config = comfyui_config_create();
+    StubServer* server = start_stub(1000, 0.0, config);
+    ComfyUIJobOptions options = { .timeout_ms = 100 };
+    ComfyUIJobEngine* engine = comfyui_jobs_create(config, &options);
+
+    Results results;
+    memset(&results, 0, sizeof(results));
+    assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+           COMFYUI_JOB_INVALID);
+
+    // Nothing is ready at first; a short wait returns empty-handed
+    assert(comfyui_jobs_wait(engine, 20) == 0);
+    assert(comfyui_jobs_wait(engine, -1) == 1);
+    assert(strcmp(results.last_error, "Timeout waiting for completion") == 0);
+    ComfyUIJobStats stats = comfyui_jobs_get_stats(engine);
+    assert(stats.timeouts == 1);
+    assert(stats.failed == 1);
+    comfyui_jobs_free(engine);
+    stub_server_stop(server);
+
+    // A job the server fails reports the server's message
+    server = start_stub(10, 1.0, config);
+    engine = comfyui_jobs_create(config, NULL);
+    memset(&results, 0, sizeof(results));
+    assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+           COMFYUI_JOB_INVALID);
+    assert(comfyui_jobs_wait(engine, -1) == 1);
+    assert(results.completed == 0);
+    assert(strstr(results.last_error, "injected failure") != NULL);
+    assert(comfyui_jobs_get_stats(engine).failed == 1);
+
+    comfyui_jobs_free(engine);
+    comfyui_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_submit_to_cache
+TEST(test_submit_to_cache) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", TEST_CACHE_DIR);
+    assert(system(cmd) == 0);
+
+    ComfyUIConfig* config = comfyui_config_create();
+    StubServer* server = start_stub(20, 0.0, config);
+    ComfyUIJobEngine* engine = comfyui_jobs_create(config, NULL);
+    ImageCache* cache = image_cache_create(TEST_CACHE_DIR, "jobs", 10, 0);
+    assert(cache != NULL);
+
+    const char* prompt = "A dragon over the ruined keep";
+    char* hash = image_cache_hash_prompt(prompt, 7);
+    Results results;
+    memset(&results, 0, sizeof(results));
+    assert(comfyui_jobs_submit_to_cache(engine, WORKFLOW, cache, hash, 512, 512,
+                                        prompt, on_job, &results) !=
+           COMFYUI_JOB_INVALID);
+
+    // Already being generated
+    assert(comfyui_jobs_submit_to_cache(engine, WORKFLOW, cache, hash, 512, 512,
+                                        prompt, NULL, NULL) == COMFYUI_JOB_INVALID);
+    assert(!image_cache_has(cache, hash));
+
+    assert(comfyui_jobs_wait(engine, -1) == 1);
+    assert(results.images == 1);
+    size_t size = 0;
+    const unsigned char* image = image_cache_get(cache, hash, &size);
+    assert(image != NULL && size > 8);
+    assert(memcmp(image, "\x89PNG", 4) == 0);
+
+    // Already cached
+    assert(comfyui_jobs_submit_to_cache(engine, WORKFLOW, cache, hash, 512, 512,
+                                        prompt, NULL, NULL) == COMFYUI_JOB_INVALID);
+    assert(stub_server_get_stats(server).requests == 1);
+
+    free(hash);
+    image_cache_free(cache);
+    comfyui_jobs_free(engine);
+    comfyui_config_free(config);
+    stub_server_stop(server);
+    system(cmd);
+}
+// }}}
+
+// {{{ test_free_delivers
+TEST(test_free_delivers) {
+    ComfyUIConfig* config = comfyui_config_create();
+    StubServer* server = start_stub(2000, 0.0, config);
+    ComfyUIJobEngine* engine = comfyui_jobs_create(config, NULL);
+
+    Results results;
+    memset(&results, 0, sizeof(results));
+    for (int i = 0; i < 3; i++) {
+        assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+               COMFYUI_JOB_INVALID);
+    }
+
+    // Two at the server, one queued: all three are cancelled
+    comfyui_jobs_free(engine);
+    assert(results.delivered == 3);
+    assert(results.completed == 0);
+    assert(strcmp(results.last_error, "Job cancelled") == 0);
+
+    assert(comfyui_jobs_create(NULL, NULL) == NULL);
+    comfyui_jobs_free(NULL);
+    assert(comfyui_jobs_poll(NULL) == 0);
+
+    comfyui_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_socket_progress
+TEST(test_socket_progress) {
+    ComfyUIConfig* config = comfyui_config_create();
+    StubServer* server = start_stub(80, 0.0, config);
+    ComfyUIJobOptions options = { .max_in_flight = 4, .on_progress = on_progress };
+    ComfyUIJobEngine* engine = comfyui_jobs_create(config, &options);
+    assert(wait_for_socket(engine, 1));
+
+    Progress progress[4];
+    memset(progress, 0, sizeof(progress));
+    for (int i = 0; i < 4; i++) {
+        assert(comfyui_jobs_submit(engine, WORKFLOW, on_progress_job, &progress[i]) !=
+               COMFYUI_JOB_INVALID);
+    }
+    assert(comfyui_jobs_wait(engine, -1) == 4);
+
+    // Every job reported progress in order, then completed
+    for (int i = 0; i < 4; i++) {
+        assert(progress[i].notes >= 2);
+        assert(!progress[i].decreased);
+        assert(progress[i].last_percent == 1000);
+    }
+
+    // The socket said when each job was done: no status checks at all
+    ComfyUIJobStats stats = comfyui_jobs_get_stats(engine);
+    assert(stats.completed == 4);
+    assert(stats.polls == 0);
+    assert(stats.socket_connects == 1);
+    assert(stats.socket_events > 4);
+    StubServerStats served = stub_server_get_stats(server);
+    assert(served.polls == 0);
+    assert(served.images == 4);
+    assert(served.sockets == 1);
+    assert(served.events == stats.socket_events);
+
+    // Failures arrive over the socket too
+    comfyui_jobs_free(engine);
+    stub_server_stop(server);
+    server = start_stub(10, 1.0, config);
+    engine = comfyui_jobs_create(config, NULL);
+    assert(wait_for_socket(engine, 1));
+    Results results;
+    memset(&results, 0, sizeof(results));
+    assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+           COMFYUI_JOB_INVALID);
+    assert(comfyui_jobs_wait(engine, -1) == 1);
+    assert(strstr(results.last_error, "injected failure") != NULL);
+    assert(comfyui_jobs_get_stats(engine).polls == 0);
+
+    comfyui_jobs_free(engine);
+    comfyui_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_socket_fallback
+TEST(test_socket_fallback) {
+    // No /ws at the server: jobs are polled as before
+    ComfyUIConfig* config = comfyui_config_create();
+    StubServer* server = start_stub_with(40, 0.0, false, config);
+    ComfyUIJobEngine* engine = comfyui_jobs_create(config, NULL);
+    Results results;
+    memset(&results, 0, sizeof(results));
+    for (int i = 0; i < 3; i++) {
+        assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+               COMFYUI_JOB_INVALID);
+    }
+    assert(comfyui_jobs_wait(engine, -1) == 3);
+    assert(results.images == 3);
+    ComfyUIJobStats stats = comfyui_jobs_get_stats(engine);
+    assert(stats.polls >= 3);
+    assert(stats.socket_connects == 0);
+    assert(!stats.socket_up);
+    comfyui_jobs_free(engine);
+    stub_server_stop(server);
+
+    // poll_only never opens the socket
+    server = start_stub(20, 0.0, config);
+    ComfyUIJobOptions options = { .poll_only = true };
+    engine = comfyui_jobs_create(config, &options);
+    memset(&results, 0, sizeof(results));
+    assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+           COMFYUI_JOB_INVALID);
+    assert(comfyui_jobs_wait(engine, -1) == 1);
+    assert(results.images == 1);
+    assert(comfyui_jobs_get_stats(engine).polls >= 1);
+    assert(stub_server_get_stats(server).sockets == 0);
+    comfyui_jobs_free(engine);
+    stub_server_stop(server);
+
+    // Dropped mid-job: polling finishes the jobs and the socket returns
+    server = start_stub(300, 0.0, config);
+    engine = comfyui_jobs_create(config, NULL);
+    assert(wait_for_socket(engine, 1));
+    memset(&results, 0, sizeof(results));
+    for (int i = 0; i < 2; i++) {
+        assert(comfyui_jobs_submit(engine, WORKFLOW, on_job, &results) !=
+               COMFYUI_JOB_INVALID);
+    }
+    assert(comfyui_jobs_wait(engine, 50) == 0);
+    stub_server_drop_sockets(server);
+    assert(comfyui_jobs_wait(engine, -1) == 2);
+    assert(results.images == 2);
+    assert(comfyui_jobs_get_stats(engine).polls >= 1);
+    assert(wait_for_socket(engine, 2));
+    assert(stub_server_get_stats(server).sockets == 2);
+
+    comfyui_jobs_free(engine);
+    comfyui_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+int main(void) {
+    printf("=== ComfyUI Job Engine Tests ===\n");
+
+    assert(comfyui_init());
+
+    RUN_TEST(test_concurrent_jobs);
+    RUN_TEST(test_cancel_and_invalid);
+    RUN_TEST(test_timeout_and_failure);
+    RUN_TEST(test_submit_to_cache);
+    RUN_TEST(test_free_delivers);
+    RUN_TEST(test_socket_progress);
+    RUN_TEST(test_socket_fallback);
+
+    comfyui_cleanup();
+
+    printf("\nAll ComfyUI job engine tests passed!\n");
+    return 0;
+}
@@ -3,7 +3,8 @@
  *
  * Validates config creation, endpoint formatting, and error handling.
  * Network tests require a running ComfyUI server.
- * Run with: gcc -o test-comfyui test-comfyui.c ../src/visual/01-comfyui-client.c ../libs/cJSON.c -lcurl && ./test-comfyui
+ * Run with: gcc -o test-comfyui test-comfyui.c ../src/visual/01-comfyui-client.c
+ *           ../src/net/09-http-pool.c ../libs/cJSON.c -lcurl -lpthread && ./test-comfyui
  */
 
 #include "../src/visual/01-comfyui-client.h"
@@ -207,6 +208,54 @@ TEST(test_connection_refused) {
 }
 // }}}
 
+// {{{ test_request_parsing
+TEST(test_request_parsing) {
+    char* body = comfyui_build_prompt_request("{\"3\":{\"inputs\":{}}}", NULL);
+    assert(body != NULL);
+    assert(strstr(body, "\"prompt\"") != NULL);
+    assert(strstr(body, "client_id") == NULL);
+    free(body);
+    body = comfyui_build_prompt_request("{}", "game-7");
+    assert(body != NULL && strstr(body, "\"client_id\":\"game-7\"") != NULL);
+    free(body);
+    assert(comfyui_build_prompt_request("{broken", NULL) == NULL);
+    assert(comfyui_build_prompt_request(NULL, NULL) == NULL);
+
+    char* prompt_id = comfyui_parse_prompt_id("{\"prompt_id\":\"abc-1\",\"number\":1}");
+    assert(prompt_id != NULL && strcmp(prompt_id, "abc-1") == 0);
+    free(prompt_id);
+    assert(comfyui_parse_prompt_id("{\"error\":\"bad\"}") == NULL);
+    assert(comfyui_parse_prompt_id(NULL) == NULL);
+
+    // Not in history yet
+    ComfyUIResponse* status = comfyui_parse_history("abc-1", "{}");
+    assert(status->status == COMFYUI_STATUS_PENDING);
+    comfyui_response_free(status);
+
+    // Completed: the output filename is left in error_message
+    status = comfyui_parse_history("abc-1",
+        "{\"abc-1\":{\"status\":{\"status_str\":\"success\"},"
+        "\"outputs\":{\"9\":{\"images\":[{\"filename\":\"out.png\"}]}}}}");
+    assert(status->status == COMFYUI_STATUS_COMPLETED);
+    assert(strcmp(status->error_message, "out.png") == 0);
+    comfyui_response_free(status);
+
+    status = comfyui_parse_history("abc-1",
+        "{\"abc-1\":{\"status\":{\"status_str\":\"error\","
+        "\"messages\":[[\"execution_error\",\"out of memory\"]]}}}");
+    assert(status->status == COMFYUI_STATUS_ERROR);
+    assert(strcmp(status->error_message, "out of memory") == 0);
+    comfyui_response_free(status);
+
+    ComfyUIConfig* config = comfyui_config_create();
+    char* url = comfyui_get_image_url(config, "card art.png");
+    assert(url != NULL);
+    assert(strcmp(url, "http://localhost:8188/view?filename=card%20art.png") == 0);
+    free(url);
+    comfyui_config_free(config);
+}
+// }}}
+
 // {{{ main
 int main(void) {
     printf("=== ComfyUI API Client Tests ===\n");
@@ -223,6 +272,7 @@ int main(void) {
     RUN_TEST(test_get_image_null_args);
     RUN_TEST(test_wait_null_args);
     RUN_TEST(test_connection_refused);
+    RUN_TEST(test_request_parsing);
 
     printf("\nAll tests passed!\n");
     return 0;
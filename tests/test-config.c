@@ -22,7 +22,19 @@ TEST(test_defaults) {
     assert(config->game_port == 8080);
     assert(config->ssh_port == 8022);
     assert(config->llm_timeout_ms == 30000);
+    assert(strcmp(config->llm_tokenizer_dir, "data/tokenizers") == 0);
+    assert(config->llm_max_in_flight == 4);
+    assert(config->llm_trade_select_budget_ms == 150);
+    assert(config->llm_cache_slots == 0);
+    assert(config->llm_endpoint_count == 0);
+    assert(config->llm_eject_failures == 3);
+    assert(config->llm_eject_ms == 10000);
     assert(config->comfyui_port == 8188);
+    assert(config->http_max_connections_per_host == 4);
+    assert(config->http_idle_timeout_ms == 60000);
+    assert(strcmp(config->narrative_cache_path, "data/narrative-cache.log") == 0);
+    assert(config->narrative_cache_max_entries == 4096);
+    assert(config->narrative_cache_ttl_seconds == 604800);
     assert(config->game_rules.starting_authority == 50);
     assert(config->game_rules.starting_hand_size == 5);
 
@@ -124,6 +136,52 @@ TEST(test_parse_valid_json) {
 }
 // }}}
 
+// {{{ test_parse_llm_endpoints
+TEST(test_parse_llm_endpoints) {
+    const char* test_json = "{"
+        "\"llm_endpoints\": ["
+            "{\"url\": \"gpu1:5000\", \"weight\": 2, \"max_concurrent\": 4},"
+            "{\"weight\": 5},"
+            "{\"url\": \"https://gpu2:5000\"}"
+        "],"
+        "\"llm_eject_ms\": 5000"
+    "}";
+
+    const char* temp_path = "/tmp/symbeline-test-endpoints.json";
+    FILE* f = fopen(temp_path, "w");
+    fprintf(f, "%s", test_json);
+    fclose(f);
+
+    ServerConfig* config = config_load(temp_path);
+    assert(config != NULL);
+    // The entry without a url is skipped
+    assert(config->llm_endpoint_count == 2);
+    assert(config->llm_endpoints[0].weight == 2);
+    assert(config->llm_endpoints[0].max_concurrent == 4);
+    assert(config->llm_endpoints[1].weight == 1);
+    assert(config->llm_endpoints[1].max_concurrent == 0);
+    assert(config->llm_eject_ms == 5000);
+    assert(config_validate(config, NULL));
+
+    char* url = config_get_llm_endpoint_at(config, 0);
+    assert(strcmp(url, "http://gpu1:5000") == 0);
+    free(url);
+    url = config_get_llm_endpoint_at(config, 1);
+    assert(strcmp(url, "https://gpu2:5000") == 0);
+    free(url);
+    assert(config_get_llm_endpoint_at(config, 2) == NULL);
+
+    config->llm_endpoints[1].weight = 0;
+    char* error = NULL;
+    assert(!config_validate(config, &error));
+    assert(strstr(error, "weight") != NULL);
+    free(error);
+
+    config_free(config);
+    remove(temp_path);
+}
+// }}}
+
 // {{{ test_parse_invalid_json
 TEST(test_parse_invalid_json) {
     const char* temp_path = "/tmp/symbeline-test-bad-config.json";
@@ -148,6 +206,7 @@ int main(void) {
     RUN_TEST(test_validation_invalid_port);
     RUN_TEST(test_endpoint_formatting);
     RUN_TEST(test_parse_valid_json);
+    RUN_TEST(test_parse_llm_endpoints);
     RUN_TEST(test_parse_invalid_json);
 
     printf("\nAll tests passed!\n");
@@ -5,10 +5,13 @@
  * statistics tracking, and memory management.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 #include "../src/llm/06-context-manager.h"
 
 // {{{ Test Statistics
@@ -291,7 +294,8 @@ static void test_priority_values(void) {
     tests_run++;
 
     // Verify priority ordering (lower = higher priority)
-    assert(PRIORITY_SYSTEM < PRIORITY_CURRENT_TURN);
+    assert(PRIORITY_SYSTEM < PRIORITY_SESSION);
+    assert(PRIORITY_SESSION < PRIORITY_CURRENT_TURN);
     assert(PRIORITY_CURRENT_TURN < PRIORITY_WORLD_STATE);
     assert(PRIORITY_WORLD_STATE < PRIORITY_RECENT_EVENTS);
     assert(PRIORITY_RECENT_EVENTS < PRIORITY_FORCE_DESC);
@@ -492,7 +496,7 @@ static void test_context_build_prompt_single(void) {
 
 // {{{ test_context_build_prompt_priority_order
 static void test_context_build_prompt_priority_order(void) {
-    printf("  Testing prompt builds in priority order...\n");
+    printf("  Testing prompt builds in layout order...\n");
     tests_run++;
 
     ContextManager* cm = context_init(1000);
@@ -500,16 +504,69 @@ static void test_context_build_prompt_priority_order(void) {
     // Add in reverse priority order
     context_add(cm, "Old", PRIORITY_OLD_EVENTS);
     context_add(cm, "Current", PRIORITY_CURRENT_TURN);
+    context_add(cm, "World", PRIORITY_WORLD_STATE);
+    context_add(cm, "Recent", PRIORITY_RECENT_EVENTS);
     context_add(cm, "System", PRIORITY_SYSTEM);
 
     char* prompt = context_build_prompt(cm);
     assert(prompt != NULL);
 
-    // System should come first
-    assert(strstr(prompt, "System") < strstr(prompt, "Current"));
-    assert(strstr(prompt, "Current") < strstr(prompt, "Old"));
+    // Stable entries lead, the current turn comes last
+    assert(strcmp(prompt, "System\n\nOld\n\nRecent\n\nWorld\n\nCurrent") == 0);
+
+    // Indices stay in priority order
+    char* first = context_get_entries_text(cm, (int[]){ 1 }, 1);
+    assert(strcmp(first, "Current") == 0);
+    free(first);
+
+    free(prompt);
+    context_free(cm);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_context_session_layout
+static void test_context_session_layout(void) {
+    printf("  Testing session context leads the event rings...\n");
+    tests_run++;
+
+    ContextManager* cm = context_init(1000);
 
+    context_add(cm, "System", PRIORITY_SYSTEM);
+    context_add(cm, "Old", PRIORITY_OLD_EVENTS);
+    context_add(cm, "Recent", PRIORITY_RECENT_EVENTS);
+    assert(context_set(cm, "Session", PRIORITY_SESSION));
+    assert(context_set(cm, "World 1", PRIORITY_WORLD_STATE));
+
+    char* prompt = context_build_prompt(cm);
+    assert(strcmp(prompt, "System\n\nSession\n\nOld\n\nRecent\n\nWorld 1") == 0);
     free(prompt);
+
+    // Setting unchanged text keeps the entry; new text replaces it
+    unsigned long before = 0;
+    unsigned long after = 0;
+    assert(context_get_sequence(cm, 1, &before));
+    assert(context_set(cm, "Session", PRIORITY_SESSION));
+    assert(context_get_sequence(cm, 1, &after));
+    assert(before == after);
+
+    assert(context_set(cm, "World 2", PRIORITY_WORLD_STATE));
+    assert(context_get_entry_count(cm, PRIORITY_WORLD_STATE) == 1);
+    assert(context_get_entry_count(cm, PRIORITY_SESSION) == 1);
+    prompt = context_build_prompt(cm);
+    assert(strcmp(prompt, "System\n\nSession\n\nOld\n\nRecent\n\nWorld 2") == 0);
+    free(prompt);
+
+    // The session context outlasts every event when evicting
+    assert(context_evict_lowest(cm));
+    assert(context_evict_lowest(cm));
+    assert(context_evict_lowest(cm));
+    assert(context_get_entry_count(cm, PRIORITY_SESSION) == 1);
+
+    assert(!context_set(NULL, "Session", PRIORITY_SESSION));
+    assert(!context_set(cm, NULL, PRIORITY_SESSION));
+
     context_free(cm);
     tests_passed++;
     printf("    PASSED\n");
@@ -808,6 +865,187 @@ static void test_context_mark_as_summary(void) {
 }
 // }}}
 
+// {{{ test_context_ring_wraparound
+static void test_context_ring_wraparound(void) {
+    printf("  Testing order survives ring wraparound...\n");
+    tests_run++;
+
+    ContextManager* cm = context_init(100000);
+    char text[32];
+
+    // Cycle far more entries than there are slots through one ring
+    context_add(cm, "System", PRIORITY_SYSTEM);
+    for (int i = 0; i < 1000; i++) {
+        snprintf(text, sizeof(text), "Event %d", i);
+        assert(context_add(cm, text, PRIORITY_OLD_EVENTS));
+    }
+    assert(cm->entry_count == cm->max_entries);
+    assert(context_get_entry_count(cm, PRIORITY_SYSTEM) == 1);
+
+    // The newest 99 events remain, oldest first, after the system entry
+    char* prompt = context_build_prompt(cm);
+    assert(strncmp(prompt, "System\n\nEvent 901\n\nEvent 902", 28) == 0);
+    assert(strcmp(prompt + strlen(prompt) - 9, "Event 999") == 0);
+    assert(strlen(prompt) == context_get_prompt_length(cm));
+
+    // Running totals match a recount
+    int tokens = 0;
+    for (int p = 0; p < CONTEXT_PRIORITY_LEVELS; p++) {
+        tokens += cm->rings[p].tokens;
+    }
+    assert(tokens == cm->current_tokens);
+    assert(cm->current_tokens == context_estimate_tokens("System") + 99 * 3);
+
+    free(prompt);
+    context_free(cm);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_context_update_priority_keeps_order
+static void test_context_update_priority_keeps_order(void) {
+    printf("  Testing demotion merges in order of addition...\n");
+    tests_run++;
+
+    ContextManager* cm = context_init(1000);
+    context_add(cm, "A", PRIORITY_RECENT_EVENTS);
+    context_add(cm, "B", PRIORITY_OLD_EVENTS);
+    context_add(cm, "C", PRIORITY_RECENT_EVENTS);
+    context_add(cm, "D", PRIORITY_OLD_EVENTS);
+
+    context_update_priority(cm, PRIORITY_RECENT_EVENTS, PRIORITY_OLD_EVENTS);
+
+    char* prompt = context_build_prompt(cm);
+    assert(strcmp(prompt, "A\n\nB\n\nC\n\nD") == 0);
+    assert(cm->rings[PRIORITY_OLD_EVENTS].tokens == 4);
+    assert(cm->rings[PRIORITY_RECENT_EVENTS].tokens == 0);
+
+    // Eviction still takes the oldest
+    context_evict_lowest(cm);
+    free(prompt);
+    prompt = context_build_prompt(cm);
+    assert(strcmp(prompt, "B\n\nC\n\nD") == 0);
+
+    free(prompt);
+    context_free(cm);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_context_prompt_prefix_stable
+static void test_context_prompt_prefix_stable(void) {
+    printf("  Testing a new turn keeps the prompt prefix...\n");
+    tests_run++;
+
+    ContextManager* cm = context_init(1000);
+    context_add(cm, "System", PRIORITY_SYSTEM);
+    context_add(cm, "Turn 1 opens", PRIORITY_RECENT_EVENTS);
+    context_add(cm, "Turn 1 world", PRIORITY_WORLD_STATE);
+    context_add(cm, "Turn 1 now", PRIORITY_CURRENT_TURN);
+    char* before = context_build_prompt(cm);
+
+    // Next turn: demote events, replace the volatile entries
+    context_update_priority(cm, PRIORITY_RECENT_EVENTS, PRIORITY_OLD_EVENTS);
+    context_clear_priority(cm, PRIORITY_WORLD_STATE);
+    context_clear_priority(cm, PRIORITY_CURRENT_TURN);
+    context_add(cm, "Turn 2 opens", PRIORITY_RECENT_EVENTS);
+    context_add(cm, "Turn 2 world", PRIORITY_WORLD_STATE);
+    context_add(cm, "Turn 2 now", PRIORITY_CURRENT_TURN);
+    char* after = context_build_prompt(cm);
+
+    const char* shared = "System\n\nTurn 1 opens\n\n";
+    assert(strncmp(before, shared, strlen(shared)) == 0);
+    assert(strncmp(after, shared, strlen(shared)) == 0);
+
+    free(before);
+    free(after);
+    context_free(cm);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_context_build_prompt_into
+static void test_context_build_prompt_into(void) {
+    printf("  Testing prompt build into a reused buffer...\n");
+    tests_run++;
+
+    ContextManager* cm = context_init(1000);
+    PromptBuffer buffer;
+    prompt_buffer_init(&buffer);
+
+    assert(strcmp(context_build_prompt_into(cm, &buffer), "") == 0);
+
+    context_add(cm, "Current", PRIORITY_CURRENT_TURN);
+    context_add(cm, "System", PRIORITY_SYSTEM);
+    const char* prompt = context_build_prompt_into(cm, &buffer);
+    assert(strcmp(prompt, "System\n\nCurrent") == 0);
+    assert(buffer.length == strlen(prompt));
+
+    // A shorter prompt reuses the same memory
+    char* data = buffer.data;
+    context_remove_at(cm, 1);
+    assert(context_build_prompt_into(cm, &buffer) == data);
+    assert(strcmp(buffer.data, "System") == 0);
+
+    prompt_buffer_free(&buffer);
+    context_free(cm);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_context_build_cost_flat
+static double elapsed_ns(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+static void test_context_build_cost_flat(void) {
+    printf("  Testing prompt build cost as context fills (benchmark)...\n");
+    tests_run++;
+
+    enum { ENTRY_CHARS = 3996, ROUNDS = 200 };
+    ContextManager* cm = context_init(100000);
+    char* text = malloc(ENTRY_CHARS + 1);
+    memset(text, 'x', ENTRY_CHARS);
+    text[ENTRY_CHARS] = '\0';
+
+    PromptBuffer buffer;
+    prompt_buffer_init(&buffer);
+
+    // ~1000 tokens per entry; measure at 25%, 50% and 100% of max_tokens
+    static const int targets[] = { 25, 50, 100 };
+    int fill = 0;
+    for (int t = 0; t < 3; t++) {
+        while (fill < targets[t] - 1) {
+            assert(context_add(cm, text, (ContextPriority)(1 + fill % 5)));
+            fill++;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < ROUNDS; r++) {
+            context_build_prompt_into(cm, &buffer);
+        }
+        double ns = elapsed_ns(&start) / ROUNDS;
+        assert(buffer.length == context_get_prompt_length(cm));
+        printf("    %3d%% full, %7zu bytes: %8.0f ns/build, %.3f ns/byte\n",
+               cm->current_tokens * 100 / cm->max_tokens, buffer.length,
+               ns, ns / (double)buffer.length);
+    }
+
+    free(text);
+    prompt_buffer_free(&buffer);
+    context_free(cm);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
 // {{{ main
 int main(void) {
     printf("=== Context Manager Tests ===\n\n");
@@ -858,6 +1096,7 @@ int main(void) {
 
     printf("\nEntry Count Tests:\n");
     test_context_get_entry_count();
+    test_context_session_layout();
     test_context_update_priority();
     test_context_stats_after_operations();
 
@@ -871,6 +1110,13 @@ int main(void) {
     test_context_needs_summarization();
     test_context_mark_as_summary();
 
+    printf("\nRing Buffer Tests:\n");
+    test_context_ring_wraparound();
+    test_context_update_priority_keeps_order();
+    test_context_prompt_prefix_stable();
+    test_context_build_prompt_into();
+    test_context_build_cost_flat();
+
     printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
 
     return tests_passed == tests_run ? 0 : 1;
@@ -0,0 +1,472 @@
+/*
+ * test-endpoint-pool.c - Tests for Multi-Endpoint LLM Routing
+ *
+ * Validates least-outstanding routing by weight, concurrency limits,
+ * session affinity and its spill-over, passive ejection and recovery,
+ * latency metrics, and routing through the sync and async clients
+ * against stub model servers.
+ * Run with: gcc -o test-endpoint-pool test-endpoint-pool.c
+ *           ../src/llm/19-endpoint-pool.c ../src/llm/20-circuit-breaker.c
+ *           ../src/llm/21-response-memo.c ../src/llm/10-async-client.c
+ *           ../src/llm/01-api-client.c ../src/tools/stub-server.c
+ *           ../src/net/09-http-pool.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-endpoint-pool
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/19-endpoint-pool.h"
+#include "../src/llm/10-async-client.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ sleep_ms
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+// }}}
+
+// {{{ outcome
+// A finished attempt with the given status (200 = success).
+static LLMResponse outcome(long status) {
+    LLMResponse response;
+    memset(&response, 0, sizeof(response));
+    response.success = status == 200;
+    response.http_status = status;
+    return response;
+}
+// }}}
+
+// {{{ attempt
+// Runs one attempt on endpoint index of a two-endpoint pool.
+static void attempt(LLMEndpointPool* pool, int index, const LLMResponse* response) {
+    int got = llm_endpoint_pool_acquire(pool, 0, 1 - index, 0);
+    assert(got == index);
+    llm_endpoint_pool_release(pool, got, response, 1.0);
+}
+// }}}
+
+// {{{ test_create
+TEST(test_create) {
+    LLMEndpointSpec specs[2] = {
+        { "http://a:5000", 2, 4 },
+        { "http://b:5000", 0, 2 }
+    };
+    assert(llm_endpoint_pool_create(NULL, 2, NULL) == NULL);
+    assert(llm_endpoint_pool_create(specs, 0, NULL) == NULL);
+
+    LLMEndpointSpec missing[1] = { { NULL, 1, 0 } };
+    assert(llm_endpoint_pool_create(missing, 1, NULL) == NULL);
+
+    LLMEndpointPool* pool = llm_endpoint_pool_create(specs, 2, NULL);
+    assert(pool != NULL);
+    assert(llm_endpoint_pool_count(pool) == 2);
+    assert(llm_endpoint_pool_capacity(pool) == 6);
+    assert(strcmp(llm_endpoint_pool_url(pool, 1), "http://b:5000") == 0);
+    assert(llm_endpoint_pool_url(pool, 2) == NULL);
+    assert(llm_endpoint_pool_get_stats(pool, 1).weight == 1);
+    llm_endpoint_pool_free(pool);
+
+    specs[1].max_concurrent = 0;
+    pool = llm_endpoint_pool_create(specs, 2, NULL);
+    assert(llm_endpoint_pool_capacity(pool) == 0);
+    llm_endpoint_pool_free(pool);
+
+    // NULL-safe
+    assert(llm_endpoint_pool_acquire(NULL, 0, -1, 0) == -1);
+    llm_endpoint_pool_release(NULL, 0, NULL, 0.0);
+    llm_endpoint_pool_free(NULL);
+}
+// }}}
+
+// {{{ test_least_outstanding
+TEST(test_least_outstanding) {
+    LLMEndpointSpec specs[2] = {
+        { "http://a:5000", 1, 0 },
+        { "http://b:5000", 2, 0 }
+    };
+    LLMEndpointPool* pool = llm_endpoint_pool_create(specs, 2, NULL);
+
+    // Held requests split 1:2 by weight
+    int counts[2] = { 0, 0 };
+    for (int i = 0; i < 6; i++) {
+        int index = llm_endpoint_pool_acquire(pool, 0, -1, 0);
+        assert(index >= 0);
+        counts[index]++;
+    }
+    assert(counts[0] == 2);
+    assert(counts[1] == 4);
+    assert(llm_endpoint_pool_get_stats(pool, 1).outstanding == 4);
+
+    // The next goes where a request just finished
+    llm_endpoint_pool_release(pool, 0, NULL, 0.0);
+    assert(llm_endpoint_pool_acquire(pool, 0, -1, 0) == 0);
+
+    // avoid is honoured while another endpoint can take the request
+    llm_endpoint_pool_release(pool, 0, NULL, 0.0);
+    assert(llm_endpoint_pool_acquire(pool, 0, 0, 0) == 1);
+
+    llm_endpoint_pool_free(pool);
+}
+// }}}
+
+// {{{ test_concurrency_limit
+static void* release_later(void* arg) {
+    sleep_ms(50);
+    llm_endpoint_pool_release(arg, 0, NULL, 0.0);
+    return NULL;
+}
+
+TEST(test_concurrency_limit) {
+    LLMEndpointSpec specs[2] = {
+        { "http://a:5000", 1, 1 },
+        { "http://b:5000", 1, 1 }
+    };
+    LLMEndpointPool* pool = llm_endpoint_pool_create(specs, 2, NULL);
+
+    int first = llm_endpoint_pool_acquire(pool, 0, -1, 0);
+    int second = llm_endpoint_pool_acquire(pool, 0, -1, 0);
+    assert(first >= 0 && second >= 0 && first != second);
+
+    // Full: fails at once without a wait, or after a short one
+    assert(llm_endpoint_pool_acquire(pool, 0, -1, 0) == -1);
+    assert(llm_endpoint_pool_acquire(pool, 0, -1, 20) == -1);
+
+    // A waiter gets the place freed by another thread
+    pthread_t thread;
+    pthread_create(&thread, NULL, release_later, pool);
+    assert(llm_endpoint_pool_acquire(pool, 0, -1, 2000) == 0);
+    pthread_join(thread, NULL);
+
+    llm_endpoint_pool_free(pool);
+}
+// }}}
+
+// {{{ test_affinity
+TEST(test_affinity) {
+    LLMEndpointSpec specs[3] = {
+        { "http://a:5000", 1, 0 },
+        { "http://b:5000", 1, 0 },
+        { "http://c:5000", 2, 0 }
+    };
+    LLMEndpointPoolConfig config = { 0, 0, 0, 2 };
+    LLMEndpointPool* pool = llm_endpoint_pool_create(specs, 3, &config);
+
+    // A session lands on the same endpoint every time
+    int home = llm_endpoint_pool_acquire(pool, 12345, -1, 0);
+    llm_endpoint_pool_release(pool, home, NULL, 0.0);
+    for (int i = 0; i < 10; i++) {
+        int index = llm_endpoint_pool_acquire(pool, 12345, -1, 0);
+        assert(index == home);
+        llm_endpoint_pool_release(pool, index, NULL, 0.0);
+    }
+    assert(llm_endpoint_pool_get_stats(pool, home).affinity_hits == 11);
+
+    // Sessions spread over the endpoints roughly by weight
+    int counts[3] = { 0, 0, 0 };
+    for (unsigned long key = 1; key <= 400; key++) {
+        int index = llm_endpoint_pool_acquire(pool, key * 2654435761UL, -1, 0);
+        counts[index]++;
+        llm_endpoint_pool_release(pool, index, NULL, 0.0);
+    }
+    assert(counts[0] > 50 && counts[1] > 50);
+    assert(counts[2] > counts[0] && counts[2] > counts[1]);
+    llm_endpoint_pool_free(pool);
+
+    // The home endpoint takes up to slack extra before spilling over
+    pool = llm_endpoint_pool_create(specs, 2, &config);
+    home = llm_endpoint_pool_acquire(pool, 12345, -1, 0);
+    llm_endpoint_pool_release(pool, home, NULL, 0.0);
+    int held[4];
+    for (int i = 0; i < 3; i++) {
+        held[i] = llm_endpoint_pool_acquire(pool, 12345, -1, 0);
+        assert(held[i] == home);
+    }
+    held[3] = llm_endpoint_pool_acquire(pool, 12345, -1, 0);
+    assert(held[3] != home);
+    for (int i = 0; i < 4; i++) {
+        llm_endpoint_pool_release(pool, held[i], NULL, 0.0);
+    }
+
+    llm_endpoint_pool_free(pool);
+}
+// }}}
+
+// {{{ test_ejection
+TEST(test_ejection) {
+    LLMEndpointSpec specs[2] = {
+        { "http://a:5000", 1, 0 },
+        { "http://b:5000", 1, 0 }
+    };
+    LLMEndpointPoolConfig config = { 2, 40, 60, 0 };
+    LLMEndpointPool* pool = llm_endpoint_pool_create(specs, 2, &config);
+
+    LLMResponse failed = outcome(503);
+    LLMResponse rejected = outcome(400);
+    LLMResponse ok = outcome(200);
+
+    // Client errors and failures broken by a success do not eject
+    for (int i = 0; i < 3; i++) {
+        attempt(pool, 0, &rejected);
+    }
+    attempt(pool, 0, &failed);
+    attempt(pool, 0, &ok);
+    attempt(pool, 0, &failed);
+    assert(!llm_endpoint_pool_get_stats(pool, 0).ejected);
+
+    // Two in a row eject
+    attempt(pool, 0, &failed);
+    LLMEndpointStats stats = llm_endpoint_pool_get_stats(pool, 0);
+    assert(stats.ejected);
+    assert(stats.ejections == 1);
+    assert(stats.failures == 3);
+    assert(stats.requests == 7);
+
+    for (int i = 0; i < 5; i++) {
+        int index = llm_endpoint_pool_acquire(pool, 0, -1, 0);
+        assert(index == 1);
+        llm_endpoint_pool_release(pool, index, NULL, 0.0);
+    }
+
+    // Back after eject_ms
+    sleep_ms(60);
+    assert(!llm_endpoint_pool_get_stats(pool, 0).ejected);
+
+    // With every endpoint ejected, requests are routed anyway
+    for (int e = 0; e < 2; e++) {
+        attempt(pool, e, &failed);
+        attempt(pool, e, &failed);
+    }
+    assert(llm_endpoint_pool_get_stats(pool, 0).ejected);
+    assert(llm_endpoint_pool_get_stats(pool, 1).ejected);
+    assert(llm_endpoint_pool_get_stats(pool, 0).ejections == 2);
+    int index = llm_endpoint_pool_acquire(pool, 0, -1, 0);
+    assert(index >= 0);
+    llm_endpoint_pool_release(pool, index, NULL, 0.0);
+
+    llm_endpoint_pool_free(pool);
+}
+// }}}
+
+// {{{ test_latency_metrics
+TEST(test_latency_metrics) {
+    LLMEndpointSpec specs[1] = { { "http://a:5000", 1, 0 } };
+    LLMEndpointPool* pool = llm_endpoint_pool_create(specs, 1, NULL);
+
+    LLMResponse ok = outcome(200);
+    LLMResponse failed = outcome(0);
+    double samples[3] = { 100.0, 200.0, 300.0 };
+    for (int i = 0; i < 3; i++) {
+        llm_endpoint_pool_acquire(pool, 0, -1, 0);
+        llm_endpoint_pool_release(pool, 0, &ok, samples[i]);
+    }
+    // Failed attempts do not skew latency
+    llm_endpoint_pool_acquire(pool, 0, -1, 0);
+    llm_endpoint_pool_release(pool, 0, &failed, 5000.0);
+
+    LLMEndpointStats stats = llm_endpoint_pool_get_stats(pool, 0);
+    assert(stats.requests == 4);
+    assert(stats.failures == 1);
+    assert(stats.avg_latency_ms > 199.0f && stats.avg_latency_ms < 201.0f);
+    assert(stats.max_latency_ms > 299.0f && stats.max_latency_ms < 301.0f);
+    // 100, then 0.2 * 200 + 0.8 * 100, then 0.2 * 300 + 0.8 * 120
+    assert(stats.ewma_latency_ms > 155.0f && stats.ewma_latency_ms < 157.0f);
+    assert(stats.outstanding == 0);
+
+    llm_endpoint_pool_free(pool);
+}
+// }}}
+
+// {{{ Stub endpoints
+static StubServer* start_stub(double failure_rate) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 5;
+    stub.tokens_per_second = 0;
+    stub.reply_tokens = 4;
+    stub.failure_rate = failure_rate;
+    return stub_server_start(&stub);
+}
+
+static LLMEndpointPool* pool_over(StubServer* a, StubServer* b) {
+    char url_a[64];
+    char url_b[64];
+    snprintf(url_a, sizeof(url_a), "http://127.0.0.1:%d", stub_server_port(a));
+    snprintf(url_b, sizeof(url_b), "http://127.0.0.1:%d", stub_server_port(b));
+    LLMEndpointSpec specs[2] = { { url_a, 1, 2 }, { url_b, 1, 2 } };
+    LLMEndpointPoolConfig config = { 2, 60000, 60000, 2 };
+    return llm_endpoint_pool_create(specs, 2, &config);
+}
+// }}}
+
+// {{{ test_sync_client_routing
+TEST(test_sync_client_routing) {
+    StubServer* a = start_stub(0.0);
+    StubServer* b = start_stub(0.0);
+    LLMEndpointPool* pool = pool_over(a, b);
+
+    LLMConfig* config = llm_config_create();
+    config->endpoints = pool;
+    config->max_retries = 0;
+    llm_config_set_session(config, "game-7", 0);
+    assert(config->affinity != 0);
+    assert(config->slot_id == -1);
+
+    // One session keeps to one server
+    for (int i = 0; i < 4; i++) {
+        LLMResponse* response = llm_request(config, "Narrate.", "The bear attacks.");
+        assert(response->success);
+        llm_response_free(response);
+    }
+    int on_a = stub_server_get_stats(a).requests;
+    int on_b = stub_server_get_stats(b).requests;
+    assert((on_a == 4 && on_b == 0) || (on_a == 0 && on_b == 4));
+    int home = on_a == 4 ? 0 : 1;
+    assert(llm_endpoint_pool_get_stats(pool, home).requests == 4);
+    assert(llm_endpoint_pool_get_stats(pool, home).avg_latency_ms > 0.0f);
+    assert(llm_endpoint_pool_get_stats(pool, home).outstanding == 0);
+
+    // Streaming requests are routed the same way
+    LLMMessage messages[1] = { { "user", "The bear attacks." } };
+    LLMResponse* response = llm_request_stream(config, messages, 1, NULL, NULL);
+    assert(response->success);
+    llm_response_free(response);
+    assert(llm_endpoint_pool_get_stats(pool, home).requests == 5);
+
+    llm_config_free(config);
+    llm_endpoint_pool_free(pool);
+    stub_server_stop(a);
+    stub_server_stop(b);
+}
+// }}}
+
+// {{{ test_retry_moves_endpoint
+TEST(test_retry_moves_endpoint) {
+    StubServer* bad = start_stub(1.0);
+    StubServer* good = start_stub(0.0);
+    LLMEndpointPool* pool = pool_over(bad, good);
+
+    LLMConfig* config = llm_config_create();
+    config->endpoints = pool;
+    config->max_retries = 1;
+
+    // Each request that starts on the failing server retries on the other
+    for (int i = 0; i < 4; i++) {
+        LLMResponse* response = llm_request(config, "Narrate.", "The bear attacks.");
+        assert(response->success);
+        llm_response_free(response);
+    }
+    LLMEndpointStats stats = llm_endpoint_pool_get_stats(pool, 0);
+    assert(stats.failures >= 1);
+    assert(stats.failures <= 2);
+
+    // Once ejected, the failing server gets nothing
+    if (!stats.ejected) {
+        LLMResponse failed = outcome(503);
+        attempt(pool, 0, &failed);
+    }
+    assert(llm_endpoint_pool_get_stats(pool, 0).ejected);
+    int before = stub_server_get_stats(bad).requests;
+    for (int i = 0; i < 3; i++) {
+        LLMResponse* response = llm_request(config, "Narrate.", "The bear attacks.");
+        assert(response->success);
+        llm_response_free(response);
+    }
+    assert(stub_server_get_stats(bad).requests == before);
+
+    llm_config_free(config);
+    llm_endpoint_pool_free(pool);
+    stub_server_stop(bad);
+    stub_server_stop(good);
+}
+// }}}
+
+// {{{ test_async_client_routing
+typedef struct {
+    pthread_mutex_t lock;
+    int done;
+    int succeeded;
+} AsyncTally;
+
+static void on_async_done(LLMResponse* response, void* user) {
+    AsyncTally* tally = user;
+    pthread_mutex_lock(&tally->lock);
+    tally->done++;
+    if (response != NULL && response->success) {
+        tally->succeeded++;
+    }
+    pthread_mutex_unlock(&tally->lock);
+    llm_response_free(response);
+}
+
+TEST(test_async_client_routing) {
+    StubServer* a = start_stub(0.0);
+    StubServer* b = start_stub(0.0);
+    LLMEndpointPool* pool = pool_over(a, b);
+    assert(llm_async_init());
+
+    LLMConfig* config = llm_config_create();
+    config->endpoints = pool;
+    config->max_retries = 0;
+
+    AsyncTally tally = { PTHREAD_MUTEX_INITIALIZER, 0, 0 };
+    LLMMessage messages[1] = { { "user", "The bear attacks." } };
+    for (int i = 0; i < 8; i++) {
+        assert(llm_request_async(config, messages, 1, on_async_done, &tally) !=
+               LLM_REQUEST_INVALID);
+    }
+    for (int i = 0; i < 500; i++) {
+        pthread_mutex_lock(&tally.lock);
+        int done = tally.done;
+        pthread_mutex_unlock(&tally.lock);
+        if (done == 8) {
+            break;
+        }
+        sleep_ms(10);
+    }
+    assert(tally.done == 8);
+    assert(tally.succeeded == 8);
+
+    // Without a session the load is shared
+    StubServerStats stats_a = stub_server_get_stats(a);
+    StubServerStats stats_b = stub_server_get_stats(b);
+    assert(stats_a.requests + stats_b.requests == 8);
+    assert(stats_a.requests >= 2 && stats_b.requests >= 2);
+    assert(llm_endpoint_pool_get_stats(pool, 0).outstanding == 0);
+    assert(llm_endpoint_pool_get_stats(pool, 1).outstanding == 0);
+
+    llm_async_cleanup();
+    llm_config_free(config);
+    llm_endpoint_pool_free(pool);
+    stub_server_stop(a);
+    stub_server_stop(b);
+}
+// }}}
+
+int main(void) {
+    printf("=== Endpoint Pool Tests ===\n");
+
+    RUN_TEST(test_create);
+    RUN_TEST(test_least_outstanding);
+    RUN_TEST(test_concurrency_limit);
+    RUN_TEST(test_affinity);
+    RUN_TEST(test_ejection);
+    RUN_TEST(test_latency_metrics);
+
+    assert(llm_init());
+    RUN_TEST(test_sync_client_routing);
+    RUN_TEST(test_retry_moves_endpoint);
+    RUN_TEST(test_async_client_routing);
+    llm_cleanup();
+
+    printf("\nAll endpoint pool tests passed!\n");
+    return 0;
+}
@@ -518,6 +518,62 @@ static void test_all_event_types_via_dispatch(void) {
 }
 // }}}
 
+// {{{ test_build_local
+static void test_build_local(void) {
+    printf("  Testing local narration without the model...\n");
+    tests_run++;
+
+    for (int i = 0; i < GAME_EVENT_TYPE_COUNT; i++) {
+        NarrationEvent* event = event_narration_create((GameEventType)i);
+        event->actor = &mock_player1;
+        event->target = &mock_player2;
+        event->card = &mock_card;
+        event->base = &mock_base;
+        event->damage = 5;
+        event->cost = 3;
+        event->turn = 4;
+
+        // Finished prose, the same every time
+        char* text = event_narration_build_local(event);
+        char* again = event_narration_build_local(event);
+        assert(text != NULL && again != NULL);
+        assert(strcmp(text, again) == 0);
+        assert(strlen(text) > 0);
+        assert(strstr(text, "Narrate") == NULL);
+
+        free(text);
+        free(again);
+        event_narration_free(event);
+    }
+
+    NarrationEvent* event = event_narration_create(GAME_EVENT_ATTACK_PLAYER);
+    event->actor = &mock_player1;
+    event->target = &mock_player2;
+    event->damage = 7;
+    char* text = event_narration_build_local(event);
+    assert(strstr(text, "Commander Vex") != NULL);
+    assert(strstr(text, "Admiral Thorne") != NULL);
+    assert(strstr(text, "7 damage") != NULL);
+    free(text);
+    event_narration_free(event);
+
+    event = event_narration_create(GAME_EVENT_CARD_PLAYED);
+    event->actor = &mock_player1;
+    event->card = &mock_card;
+    text = event_narration_build_local(event);
+    assert(strstr(text, "Battle Cruiser") != NULL);
+    free(text);
+    event_narration_free(event);
+
+    text = event_narration_build_local(NULL);
+    assert(text != NULL);
+    free(text);
+
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
 // {{{ main
 int main(void) {
     printf("=== Event Narration Tests ===\n\n");
@@ -556,6 +612,7 @@ int main(void) {
     test_build_attack_via_event_struct();
     test_build_null_event();
     test_all_event_types_via_dispatch();
+    test_build_local();
 
     printf("\n=== Results: %d/%d tests passed ===\n", tests_passed, tests_run);
 
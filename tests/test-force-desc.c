@@ -3,7 +3,10 @@
  *
  * Validates force descriptions, faction themes, and caching.
  * Run with: gcc -o test-force-desc test-force-desc.c ../src/llm/04-force-description.c
- *           ../src/llm/02-prompts.c -I. && ./test-force-desc
+ *           ../src/llm/03-world-state.c ../src/llm/02-prompts.c ../src/core/05-game.c
+ *           ../src/core/03-player.c ../src/core/02-deck.c ../src/core/01-card.c
+ *           ../src/core/04-trade-row.c ../src/core/06-combat.c ../src/core/07-effects.c
+ *           ../src/core/08-auto-draw.c -lm -I. && ./test-force-desc
  */
 
 #include "../src/llm/04-force-description.h"
@@ -257,6 +260,71 @@ TEST(test_build_player_forces) {
 }
 // }}}
 
+// {{{ test_build_player_forces_cached
+TEST(test_build_player_forces_cached) {
+    Player* p = create_mock_player("Lady Morgaine");
+    p->factions_played[FACTION_WILDS] = true;
+    Game game;
+    memset(&game, 0, sizeof(game));
+    game.player_count = 1;
+    game.players[0] = p;
+    WorldState state;
+    memset(&state, 0, sizeof(state));
+    state.dirty = WORLD_DIRTY_ALL;
+
+    char* first = force_desc_build_player_forces_cached(&state, &game, 0);
+    assert(first != NULL);
+    assert(strstr(first, "Wilds") != NULL);
+    assert(!(state.dirty & WORLD_DIRTY_FORCES(0)));
+
+    // Clean: the cached prompt comes back even though the player moved on
+    p->factions_played[FACTION_WILDS] = false;
+    p->factions_played[FACTION_KINGDOM] = true;
+    char* second = force_desc_build_player_forces_cached(&state, &game, 0);
+    assert(strcmp(first, second) == 0);
+
+    // Dirty: regenerated
+    state.dirty |= WORLD_DIRTY_FORCES(0);
+    char* third = force_desc_build_player_forces_cached(&state, &game, 0);
+    assert(strstr(third, "High Kingdom") != NULL);
+
+    // No listener reports a base destroyed or a card discarded; the
+    // cached build notices them by itself
+    Deck deck;
+    memset(&deck, 0, sizeof(deck));
+    deck.frontier_base_count = 1;
+    deck.hand_count = 5;
+    p->deck = &deck;
+    char* fourth = force_desc_build_player_forces_cached(&state, &game, 0);
+    assert(strstr(fourth, "5 cards in hand") != NULL);
+
+    // The faction change alone is not tracked; the lost base rebuilds it
+    p->factions_played[FACTION_KINGDOM] = false;
+    p->factions_played[FACTION_WILDS] = true;
+    deck.frontier_base_count = 0;
+    char* fifth = force_desc_build_player_forces_cached(&state, &game, 0);
+    assert(strstr(fifth, "Wilds") != NULL);
+    assert(!(state.dirty & WORLD_DIRTY_FORCES(0)));
+
+    deck.hand_count = 4;
+    char* sixth = force_desc_build_player_forces_cached(&state, &game, 0);
+    assert(strstr(sixth, "4 cards in hand") != NULL);
+    p->deck = NULL;
+
+    assert(force_desc_build_player_forces_cached(&state, &game, 1) == NULL);
+    assert(force_desc_build_player_forces_cached(NULL, &game, 0) == NULL);
+
+    free(first);
+    free(second);
+    free(third);
+    free(fourth);
+    free(fifth);
+    free(sixth);
+    free(state.forces_prompt[0]);
+    free_mock_player(p);
+}
+// }}}
+
 // {{{ test_build_card_played
 TEST(test_build_card_played) {
     Player* p = create_mock_player("Lord Theron");
@@ -333,6 +401,7 @@ int main(void) {
     RUN_TEST(test_summarize_forces_empty);
     RUN_TEST(test_summarize_forces_factions);
     RUN_TEST(test_build_player_forces);
+    RUN_TEST(test_build_player_forces_cached);
     RUN_TEST(test_build_card_played);
     RUN_TEST(test_build_base);
     RUN_TEST(test_build_attack);
@@ -0,0 +1,317 @@
+/*
+ * test-http-pool.c - Tests for Outbound HTTP Connection Pool
+ *
+ * Validates per-endpoint handle reuse, keep-alive connection reuse
+ * metrics, the per-host cap, idle expiry, limits from the server
+ * config, that one client's shutdown leaves the pool to the others, and
+ * that the LLM client rides a pooled connection. A keep-alive stub-server instance counts
+ * the TCP connections it accepts.
+ * Run with: gcc -o test-http-pool test-http-pool.c ../src/net/09-http-pool.c
+ *           ../src/llm/01-api-client.c ../src/llm/19-endpoint-pool.c
+ *           ../src/llm/20-circuit-breaker.c ../src/llm/21-response-memo.c
+ *           ../src/llm/10-async-client.c ../src/tools/stub-server.c
+ *           ../libs/cJSON.c -lcurl -lm -lpthread && ./test-http-pool
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/net/09-http-pool.h"
+#include "../src/llm/01-api-client.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ sleep_ms
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+// }}}
+
+// {{{ Keep-alive responder
+// Serves any number of requests per connection and counts accepts;
+// requests other than chat completions are answered 404.
+static StubServer* stub = NULL;
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)body;
+    (void)context;
+    free(reply->text);
+    reply->text = strdup("Steel rings on steel.");
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 7;
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.latency.base_ms = 0;
+    config.tokens_per_second = 0;
+    config.keep_alive = true;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+
+static int stub_accept_count(void) {
+    return stub_server_get_stats(stub).connections;
+}
+
+static size_t discard_body(void* contents, size_t size, size_t nmemb, void* userp) {
+    (void)contents;
+    (void)userp;
+    return size * nmemb;
+}
+
+// Performs one GET against the stub through the pool
+static void pooled_get(const char* url) {
+    CURL* curl = http_pool_acquire(url);
+    assert(curl != NULL);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard_body);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 2000L);
+    assert(curl_easy_perform(curl) == CURLE_OK);
+    http_pool_release(curl);
+}
+// }}}
+
+// {{{ test_invalid_url
+TEST(test_invalid_url) {
+    assert(http_pool_acquire(NULL) == NULL);
+    assert(http_pool_acquire("") == NULL);
+    assert(http_pool_try_acquire("http://") == NULL);
+
+    HttpPoolStats stats = http_pool_get_stats("http://nowhere.invalid:1");
+    assert(stats.acquired == 0);
+    assert(http_pool_reuse_rate(NULL) == 0.0f);
+
+    // Releasing NULL is a no-op
+    http_pool_release(NULL);
+}
+// }}}
+
+// {{{ test_connection_reuse
+TEST(test_connection_reuse) {
+    char url[128];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/history/1", stub_server_port(stub));
+
+    int accepts_before = stub_accept_count();
+    for (int i = 0; i < 5; i++) {
+        pooled_get(url);
+    }
+
+    // One TCP connection served all five requests
+    assert(stub_accept_count() - accepts_before == 1);
+
+    HttpPoolStats stats = http_pool_get_stats(url);
+    assert(stats.acquired == 5);
+    assert(stats.handles_created == 1);
+    assert(stats.handles_reused == 4);
+    assert(stats.connections_opened == 1);
+    assert(stats.connections_reused == 4);
+    assert(stats.in_use == 0);
+    assert(stats.connect_ms_saved >= 0.0);
+
+    float rate = http_pool_reuse_rate(&stats);
+    assert(rate > 0.79f && rate < 0.81f);
+    printf(" (reuse %.0f%%, saved %.3fms) ", rate * 100.0f, stats.connect_ms_saved);
+}
+// }}}
+
+// {{{ test_endpoints_are_separate
+TEST(test_endpoints_are_separate) {
+    char url_a[128];
+    char url_b[128];
+    snprintf(url_a, sizeof(url_a), "http://127.0.0.1:%d/prompt", stub_server_port(stub));
+    snprintf(url_b, sizeof(url_b), "http://localhost:%d/prompt", stub_server_port(stub));
+
+    HttpPoolStats before_b = http_pool_get_stats(url_b);
+    pooled_get(url_b);
+    HttpPoolStats after_b = http_pool_get_stats(url_b);
+    assert(after_b.acquired == before_b.acquired + 1);
+    assert(after_b.handles_created == before_b.handles_created + 1);
+
+    // Paths on the same host share one endpoint
+    HttpPoolStats a = http_pool_get_stats(url_a);
+    HttpPoolStats a_other_path = http_pool_get_stats("http://127.0.0.1:0/x");
+    assert(a.acquired >= 5);
+    assert(a_other_path.acquired == 0);
+
+    HttpPoolStats total = http_pool_get_stats(NULL);
+    assert(total.acquired >= a.acquired + after_b.acquired);
+}
+// }}}
+
+// {{{ test_per_host_cap
+static char cap_url[128];
+static volatile bool waiter_done = false;
+
+static void* blocking_acquirer(void* arg) {
+    (void)arg;
+    CURL* curl = http_pool_acquire(cap_url);
+    assert(curl != NULL);
+    waiter_done = true;
+    http_pool_release(curl);
+    return NULL;
+}
+
+TEST(test_per_host_cap) {
+    HttpPoolConfig config = { 2, 60000 };
+    http_pool_configure(&config);
+    snprintf(cap_url, sizeof(cap_url), "http://127.0.0.1:%d/cap", stub_server_port(stub));
+
+    CURL* first = http_pool_acquire(cap_url);
+    CURL* second = http_pool_acquire(cap_url);
+    assert(first != NULL && second != NULL && first != second);
+
+    // At the cap: non-blocking acquire refuses, blocking acquire waits
+    assert(http_pool_try_acquire(cap_url) == NULL);
+
+    waiter_done = false;
+    pthread_t thread;
+    pthread_create(&thread, NULL, blocking_acquirer, NULL);
+    sleep_ms(100);
+    assert(waiter_done == false);
+
+    http_pool_release(first);
+    pthread_join(thread, NULL);
+    assert(waiter_done == true);
+
+    HttpPoolStats stats = http_pool_get_stats(cap_url);
+    assert(stats.waits == 1);
+
+    http_pool_release(second);
+    http_pool_configure(NULL);
+}
+// }}}
+
+// {{{ test_idle_expiry
+TEST(test_idle_expiry) {
+    HttpPoolConfig config = { 4, 0 };
+    http_pool_configure(&config);
+
+    // Fresh host name so earlier tests' idle handles don't count
+    char url[128];
+    snprintf(url, sizeof(url), "http://[::ffff:127.0.0.1]:%d/expire", stub_server_port(stub));
+    pooled_get(url);
+
+    // A zero timeout closes the handle as soon as it goes idle
+    http_pool_expire_idle();
+    HttpPoolStats stats = http_pool_get_stats(url);
+    assert(stats.handles_created == 1);
+    assert(stats.idle_expired == 1);
+
+    // Next acquisition needs a fresh handle
+    CURL* curl = http_pool_acquire(url);
+    stats = http_pool_get_stats(url);
+    assert(stats.handles_created == 2);
+    assert(stats.handles_reused == 0);
+    http_pool_release(curl);
+
+    http_pool_configure(NULL);
+}
+// }}}
+
+// {{{ test_foreign_handle_release
+TEST(test_foreign_handle_release) {
+    // A handle the pool never issued is simply cleaned up
+    CURL* curl = curl_easy_init();
+    assert(curl != NULL);
+    http_pool_release(curl);
+}
+// }}}
+
+// {{{ test_shared_lifetime
+TEST(test_shared_lifetime) {
+    // A second client joins with the server's limits, as a server would
+    ServerConfig server;
+    memset(&server, 0, sizeof(server));
+    server.http_max_connections_per_host = 1;
+    server.http_idle_timeout_ms = 60000;
+    HttpPoolConfig config = http_pool_config_from_server(&server);
+    assert(config.max_connections_per_host == 1);
+    assert(config.idle_timeout_ms == 60000);
+    http_pool_init(&config);
+
+    char url[128];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/shared", stub_server_port(stub));
+    pooled_get(url);
+    CURL* curl = http_pool_acquire(url);
+    assert(http_pool_try_acquire(url) == NULL);
+    http_pool_release(curl);
+
+    // Its shutdown keeps the connection the LLM client's reference needs
+    int accepts_before = stub_accept_count();
+    HttpPoolStats before = http_pool_get_stats(url);
+    http_pool_shutdown();
+    pooled_get(url);
+    HttpPoolStats after = http_pool_get_stats(url);
+    assert(after.handles_reused == before.handles_reused + 1);
+    assert(after.idle_expired == before.idle_expired);
+    assert(stub_accept_count() == accepts_before);
+
+    http_pool_configure(NULL);
+    config = http_pool_config_from_server(NULL);
+    assert(config.max_connections_per_host == HTTP_POOL_DEFAULT_MAX_PER_HOST);
+    assert(config.idle_timeout_ms == HTTP_POOL_DEFAULT_IDLE_TIMEOUT_MS);
+}
+// }}}
+
+// {{{ test_llm_client_uses_pool
+TEST(test_llm_client_uses_pool) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->max_retries = 0;
+
+    char* url = llm_build_url(config);
+    HttpPoolStats before = http_pool_get_stats(url);
+
+    for (int i = 0; i < 3; i++) {
+        LLMResponse* response = llm_request(config, "You narrate.", "Clash!");
+        assert(response != NULL);
+        assert(response->success == true);
+        assert(strcmp(response->text, "Steel rings on steel.") == 0);
+        llm_response_free(response);
+    }
+
+    HttpPoolStats after = http_pool_get_stats(url);
+    assert(after.acquired == before.acquired + 3);
+    assert(after.connections_reused >= before.connections_reused + 2);
+
+    free(url);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== HTTP Connection Pool Tests ===\n");
+
+    assert(llm_init());
+    stub_start();
+
+    RUN_TEST(test_invalid_url);
+    RUN_TEST(test_connection_reuse);
+    RUN_TEST(test_endpoints_are_separate);
+    RUN_TEST(test_per_host_cap);
+    RUN_TEST(test_idle_expiry);
+    RUN_TEST(test_foreign_handle_release);
+    RUN_TEST(test_shared_lifetime);
+    RUN_TEST(test_llm_client_uses_pool);
+
+    llm_cleanup();
+    stub_server_stop(stub);
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
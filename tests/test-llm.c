@@ -2,15 +2,29 @@
  * test-llm.c - Tests for LLM API Client
  *
  * Validates config creation, message handling, and response parsing.
- * Network tests are skipped if no LLM endpoint is available.
- * Run with: gcc -o test-llm test-llm.c ../src/llm/01-api-client.c ../libs/cJSON.c -lcurl && ./test-llm
+ * Network tests are skipped if no LLM endpoint is available. A scripted
+ * stub-server instance that models a server's per-slot prompt cache
+ * measures the time to first token of the prompts the context manager
+ * builds.
+ * Run with: gcc -o test-llm test-llm.c ../src/llm/01-api-client.c
+ *           ../src/llm/06-context-manager.c ../src/llm/14-tokenizer.c
+ *           ../src/llm/19-endpoint-pool.c ../src/llm/20-circuit-breaker.c
+ *           ../src/llm/21-response-memo.c ../src/llm/10-async-client.c
+ *           ../src/net/09-http-pool.c ../src/tools/stub-server.c
+ *           ../libs/cJSON.c -lcurl -lm -lpthread && ./test-llm
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "../src/llm/01-api-client.h"
+#include "../src/llm/06-context-manager.h"
+#include "../src/tools/stub-server.h"
+#include "../libs/cJSON.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #define TEST(name) static void name(void)
 #define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
@@ -138,6 +152,363 @@ TEST(test_request_connection_refused) {
 }
 // }}}
 
+// {{{ Stream capture
+typedef struct {
+    char text[256];
+    int calls;
+} DeltaCapture;
+
+static void capture_delta(const char* delta, void* user) {
+    DeltaCapture* cap = (DeltaCapture*)user;
+    strncat(cap->text, delta, sizeof(cap->text) - strlen(cap->text) - 1);
+    cap->calls++;
+}
+// }}}
+
+// {{{ test_stream_body_flag
+TEST(test_stream_body_flag) {
+    LLMConfig* config = llm_config_create();
+    LLMMessage msg = { "user", "Narrate." };
+
+    char* plain = llm_build_request_body(config, &msg, 1);
+    char* streamed = llm_build_stream_request_body(config, &msg, 1);
+    assert(strstr(plain, "\"stream\"") == NULL);
+    assert(strstr(streamed, "\"stream\":true") != NULL);
+
+    free(plain);
+    free(streamed);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_stream_parser_split_chunks
+TEST(test_stream_parser_split_chunks) {
+    // Events split at arbitrary byte boundaries, CRLF line endings
+    const char* wire =
+        ": keep-alive comment\r\n\r\n"
+        "data: {\"choices\":[{\"delta\":{\"role\":\"assistant\"}}]}\r\n\r\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\"The dire\"}}]}\r\n\r\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\" bear roars.\"}}]}\r\n\r\n"
+        "data: {\"choices\":[],\"usage\":{\"total_tokens\":9}}\r\n\r\n"
+        "data: [DONE]\r\n\r\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\"ignored\"}}]}\n\n";
+
+    DeltaCapture cap = { "", 0 };
+    LLMStreamParser parser;
+    llm_stream_parser_init(&parser, capture_delta, &cap);
+
+    size_t len = strlen(wire);
+    for (size_t pos = 0; pos < len; pos += 7) {
+        size_t n = len - pos < 7 ? len - pos : 7;
+        assert(llm_stream_parser_feed(&parser, wire + pos, n));
+    }
+
+    assert(parser.done == true);
+    assert(cap.calls == 2);
+    assert(strcmp(cap.text, "The dire bear roars.") == 0);
+
+    LLMResponse* response = llm_stream_parser_finish(&parser);
+    assert(response->success == true);
+    assert(strcmp(response->text, "The dire bear roars.") == 0);
+    assert(response->tokens_used == 9);
+
+    llm_response_free(response);
+    llm_stream_parser_free(&parser);
+}
+// }}}
+
+// {{{ test_stream_parser_error
+TEST(test_stream_parser_error) {
+    const char* wire = "data: {\"error\":{\"message\":\"model overloaded\"}}\n\n";
+
+    LLMStreamParser parser;
+    llm_stream_parser_init(&parser, NULL, NULL);
+    assert(llm_stream_parser_feed(&parser, wire, strlen(wire)));
+
+    LLMResponse* response = llm_stream_parser_finish(&parser);
+    assert(response->success == false);
+    assert(strcmp(response->error, "model overloaded") == 0);
+
+    llm_response_free(response);
+    llm_stream_parser_free(&parser);
+}
+// }}}
+
+// {{{ test_stream_connection_refused
+TEST(test_stream_connection_refused) {
+    llm_init();
+
+    LLMConfig* config = llm_config_create();
+    free(config->endpoint);
+    config->endpoint = strdup("http://localhost:59999");
+    config->max_retries = 0;
+    config->timeout_ms = 1000;
+
+    DeltaCapture cap = { "", 0 };
+    LLMMessage msg = { "user", "test prompt" };
+    LLMResponse* response = llm_request_stream(config, &msg, 1, capture_delta, &cap);
+    assert(response != NULL);
+    assert(response->success == false);
+    assert(cap.calls == 0);
+
+    llm_response_free(response);
+    llm_config_free(config);
+    llm_cleanup();
+}
+// }}}
+
+// {{{ test_cache_prompt_body
+TEST(test_cache_prompt_body) {
+    LLMConfig* config = llm_config_create();
+    LLMMessage msg = { "user", "Narrate." };
+    assert(config->cache_prompt == false);
+    assert(config->slot_id == -1);
+
+    char* body = llm_build_request_body(config, &msg, 1);
+    assert(strstr(body, "cache_prompt") == NULL);
+    assert(strstr(body, "id_slot") == NULL);
+    free(body);
+
+    // The same session lands on the same slot every time
+    llm_config_set_session(config, "game-17", 4);
+    int slot = config->slot_id;
+    assert(slot >= 0 && slot < 4);
+    llm_config_set_session(config, "game-17", 4);
+    assert(config->slot_id == slot);
+
+    char expected[32];
+    snprintf(expected, sizeof(expected), "\"id_slot\":%d", slot);
+    body = llm_build_request_body(config, &msg, 1);
+    assert(strstr(body, "\"cache_prompt\":true") != NULL);
+    assert(strstr(body, expected) != NULL);
+    free(body);
+
+    // No slot count: cache, but let the server choose the slot
+    llm_config_set_session(config, "game-17", 0);
+    assert(config->slot_id == -1);
+    body = llm_build_request_body(config, &msg, 1);
+    assert(strstr(body, "\"cache_prompt\":true") != NULL);
+    assert(strstr(body, "id_slot") == NULL);
+    free(body);
+
+    // A per-session copy leaves the shared config untouched
+    config->slot_id = -1;
+    config->cache_prompt = false;
+    LLMConfig* session = llm_config_for_session(config, "game-17", 4);
+    assert(session != NULL);
+    assert(session->slot_id == slot && session->cache_prompt);
+    assert(session->endpoint != config->endpoint);
+    assert(strcmp(session->model, config->model) == 0);
+    assert(config->slot_id == -1 && !config->cache_prompt);
+    llm_config_free(session);
+    assert(llm_config_for_session(NULL, "x", 1) == NULL);
+
+    llm_config_set_session(NULL, "x", 1);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_temperature_body
+TEST(test_temperature_body) {
+    LLMConfig* config = llm_config_create();
+    LLMMessage msg = { "user", "Narrate." };
+    assert(config->temperature < 0.0f);
+
+    // Unset: the server's default applies
+    char* body = llm_build_request_body(config, &msg, 1);
+    assert(strstr(body, "temperature") == NULL);
+    free(body);
+
+    config->temperature = 0.0f;
+    body = llm_build_request_body(config, &msg, 1);
+    assert(strstr(body, "\"temperature\":0") != NULL);
+    free(body);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ Prefix cache stub
+// Streams a short reply after "evaluating" the prompt at STUB_US_PER_CHAR.
+// Like llama.cpp, each slot keeps its last prompt and, when the request
+// asks for cache_prompt, only the text after the shared prefix costs
+// time. Requests without id_slot take the slots in turn.
+#define STUB_SLOTS 2
+#define STUB_US_PER_CHAR 20
+
+static StubServer* stub = NULL;
+static char* stub_slot_prompt[STUB_SLOTS];
+static int stub_requests = 0;
+
+// Serialized by the stub's single slot
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)context;
+    cJSON* json = cJSON_Parse(body);
+    cJSON* cache = cJSON_GetObjectItem(json, "cache_prompt");
+    cJSON* id_slot = cJSON_GetObjectItem(json, "id_slot");
+    int slot = cJSON_IsNumber(id_slot) ? id_slot->valueint % STUB_SLOTS
+                                       : stub_requests % STUB_SLOTS;
+    stub_requests++;
+
+    char* prompt = calloc(1, strlen(body) + 1);
+    cJSON* message;
+    cJSON_ArrayForEach(message, cJSON_GetObjectItem(json, "messages")) {
+        cJSON* content = cJSON_GetObjectItem(message, "content");
+        if (cJSON_IsString(content)) {
+            strcat(prompt, content->valuestring);
+        }
+    }
+
+    size_t shared = 0;
+    const char* cached = stub_slot_prompt[slot];
+    if (cJSON_IsTrue(cache) && cached != NULL) {
+        while (cached[shared] != '\0' && cached[shared] == prompt[shared]) {
+            shared++;
+        }
+    }
+    free(stub_slot_prompt[slot]);
+    stub_slot_prompt[slot] = prompt;
+    cJSON_Delete(json);
+
+    long delay_us = (long)(strlen(prompt) - shared) * STUB_US_PER_CHAR;
+    reply->delay_ms = (int)(delay_us / 1000);
+    free(reply->text);
+    reply->text = strdup("The realm turns.");
+    reply->token_ms = 0;
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.slots = 1;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+// }}}
+
+// {{{ test_prefix_cache_ttft
+typedef struct {
+    struct timespec start;
+    double first_ms;
+} FirstToken;
+
+static double since_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void on_first_token(const char* delta, void* user) {
+    FirstToken* ft = user;
+    (void)delta;
+    if (ft->first_ms < 0) {
+        ft->first_ms = since_ms(&ft->start);
+    }
+}
+
+// Two games take turns, each building its prompt with a context manager
+// from a system prompt, the game's session context (setting, catalog), a
+// growing ring of recent events, the world state and the current turn.
+// With session_entry the session context is its own PRIORITY_SESSION
+// entry; otherwise it rides in the world state entry, behind the events.
+// Returns the summed time to first token over all requests.
+static double run_sessions(bool session_entry) {
+    enum { TURNS = 5 };
+    static const char* sessions[2] = { "game-a", "game-b" };
+
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    LLMConfig* base = llm_config_create();
+    free(base->endpoint);
+    base->endpoint = strdup(endpoint);
+    base->max_retries = 0;
+
+    LLMConfig* configs[2];
+    ContextManager* contexts[2];
+    char session_text[2][2048];
+    for (int g = 0; g < 2; g++) {
+        configs[g] = llm_config_for_session(base, sessions[g], STUB_SLOTS);
+        assert(configs[g] != NULL && configs[g]->cache_prompt);
+        assert(strcmp(configs[g]->endpoint, endpoint) == 0);
+
+        int len = snprintf(session_text[g], sizeof(session_text[g]),
+                           "The battle for %s. Cards of the realm:", sessions[g]);
+        while (len < 2000) {
+            len += snprintf(session_text[g] + len, sizeof(session_text[g]) - len,
+                            " Card %d of %s,", len, sessions[g]);
+        }
+
+        contexts[g] = context_init(8192);
+        assert(context_add(contexts[g], "You narrate a card battle.", PRIORITY_SYSTEM));
+        if (session_entry) {
+            assert(context_set(contexts[g], session_text[g], PRIORITY_SESSION));
+        }
+    }
+    assert(configs[0]->slot_id != configs[1]->slot_id);
+    llm_config_free(base);
+
+    double total = 0.0;
+    for (int turn = 1; turn <= TURNS; turn++) {
+        for (int g = 0; g < 2; g++) {
+            char text[2200];
+            snprintf(text, sizeof(text), "Turn %d: the bear strikes for %d.",
+                     turn, turn + 2);
+            assert(context_add(contexts[g], text, PRIORITY_RECENT_EVENTS));
+
+            int len = 0;
+            if (!session_entry) {
+                len = snprintf(text, sizeof(text), "%s\n\n", session_text[g]);
+            }
+            snprintf(text + len, sizeof(text) - len,
+                     "Turn %d. Authority %d to %d.", turn, 50 - turn, 50 - 2 * turn);
+            assert(context_set(contexts[g], text, PRIORITY_WORLD_STATE));
+            assert(context_set(contexts[g], "Narrate the attack.",
+                               PRIORITY_CURRENT_TURN));
+
+            char* prompt = context_build_prompt(contexts[g]);
+            assert(prompt != NULL);
+            LLMMessage msg = { "user", prompt };
+
+            FirstToken ft = { .first_ms = -1.0 };
+            clock_gettime(CLOCK_MONOTONIC, &ft.start);
+            LLMResponse* response = llm_request_stream(configs[g], &msg, 1,
+                                                       on_first_token, &ft);
+            assert(response != NULL && response->success);
+            assert(ft.first_ms >= 0.0);
+            total += ft.first_ms;
+
+            llm_response_free(response);
+            free(prompt);
+        }
+    }
+
+    for (int g = 0; g < 2; g++) {
+        context_free(contexts[g]);
+        llm_config_free(configs[g]);
+    }
+    return total;
+}
+
+TEST(test_prefix_cache_ttft) {
+    llm_init();
+    stub_start();
+
+    double in_world_state = run_sessions(false);
+    double session_entry = run_sessions(true);
+    printf("\n  time to first token over 10 turns: session in world state "
+           "%.1f ms, session entry %.1f ms ", in_world_state, session_entry);
+    assert(session_entry * 2.0 < in_world_state);
+
+    stub_server_stop(stub);
+    for (int i = 0; i < STUB_SLOTS; i++) {
+        free(stub_slot_prompt[i]);
+        stub_slot_prompt[i] = NULL;
+    }
+    llm_cleanup();
+}
+// }}}
+
 // {{{ main
 int main(void) {
     printf("=== LLM API Client Tests ===\n");
@@ -151,6 +522,13 @@ int main(void) {
     RUN_TEST(test_message_free_null);
     RUN_TEST(test_config_free_null);
     RUN_TEST(test_request_connection_refused);
+    RUN_TEST(test_stream_body_flag);
+    RUN_TEST(test_stream_parser_split_chunks);
+    RUN_TEST(test_stream_parser_error);
+    RUN_TEST(test_stream_connection_refused);
+    RUN_TEST(test_cache_prompt_body);
+    RUN_TEST(test_temperature_body);
+    RUN_TEST(test_prefix_cache_ttft);
 
     printf("\nAll tests passed!\n");
     return 0;
@@ -0,0 +1,466 @@
+/*
+ * test-narration-batch.c - Tests for Batched Event Narration
+ *
+ * Validates the numbered prompt, reply parsing, flush triggers, ordered
+ * delivery, the per-event fallback, local narration behind a circuit
+ * breaker and the step-down as a session's budget runs out, with
+ * memoized replies through the scheduler. A scripted stub-server
+ * instance answers batched requests with one section per event marker
+ * and counts the model calls a turn costs.
+ * Run with: gcc -o test-narration-batch test-narration-batch.c
+ *           ../src/llm/17-narration-batch.c ../src/llm/16-scheduler.c
+ *           ../src/llm/22-token-usage.c ../src/llm/10-async-client.c
+ *           ../src/llm/05-event-narration.c ../src/llm/04-force-description.c
+ *           ../src/llm/03-world-state.c ../src/llm/02-prompts.c
+ *           ../src/llm/01-api-client.c ../src/llm/19-endpoint-pool.c
+ *           ../src/llm/20-circuit-breaker.c ../src/llm/21-response-memo.c
+ *           ../src/net/09-http-pool.c ../src/tools/stub-server.c
+ *           ../src/core/0[1-8]-*.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-narration-batch
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/17-narration-batch.h"
+#include "../src/llm/20-circuit-breaker.h"
+#include "../src/llm/22-token-usage.h"
+#include "../src/llm/21-response-memo.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ Stub responder
+// Batched requests get "[n]\nSegment n." for every marker in the
+// prompt, except the one numbered stub_skip; single requests get
+// "Solo narration.". stub_garbage makes batched replies unparseable
+// and stub_fail answers everything with HTTP 500.
+static StubServer* stub = NULL;
+static int stub_batched = 0;
+static int stub_single = 0;
+static int stub_skip = 0;
+static bool stub_garbage = false;
+static bool stub_fail = false;
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)context;
+    char content[4096] = "";
+    if (strstr(body, "Narrate each of the following") != NULL) {
+        stub_batched++;
+        if (stub_garbage) {
+            strcpy(content, "The realm holds its breath.");
+        }
+        for (int n = 1; !stub_garbage; n++) {
+            char marker[16];
+            snprintf(marker, sizeof(marker), "[%d] ", n);
+            if (strstr(body, marker) == NULL) break;
+            if (n == stub_skip) continue;
+            size_t len = strlen(content);
+            snprintf(content + len, sizeof(content) - len, "[%d]\nSegment %d.\n", n, n);
+        }
+    } else {
+        stub_single++;
+        strcpy(content, "Solo narration.");
+    }
+
+    free(reply->text);
+    reply->text = strdup(content);
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 5;
+    if (stub_fail) {
+        reply->status = 500;
+    }
+}
+
+// One request at a time, so the counters need no lock
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.latency.base_ms = 0;
+    config.tokens_per_second = 0;
+    config.slots = 1;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+
+static void stub_reset(void) {
+    stub_batched = 0;
+    stub_single = 0;
+    stub_skip = 0;
+    stub_garbage = false;
+    stub_fail = false;
+}
+
+static LLMConfig* stub_config(void) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->timeout_ms = 5000;
+    config->max_retries = 0;
+    return config;
+}
+// }}}
+
+// {{{ Delivery recorder
+#define MAX_SEGMENTS 32
+
+typedef struct {
+    unsigned long sequences[MAX_SEGMENTS];
+    char texts[MAX_SEGMENTS][32];
+    bool batched[MAX_SEGMENTS];
+    bool local[MAX_SEGMENTS];
+    int count;
+} Recorder;
+
+static void record(const NarrationSegment* segment, void* user) {
+    Recorder* r = user;
+    if (r->count < MAX_SEGMENTS) {
+        r->sequences[r->count] = segment->sequence;
+        snprintf(r->texts[r->count], sizeof(r->texts[0]), "%s",
+                 segment->text != NULL ? segment->text : "(none)");
+        r->batched[r->count] = segment->batched;
+        r->local[r->count] = segment->local;
+    }
+    r->count++;
+}
+// }}}
+
+// {{{ A turn of events
+static Player* hero;
+static Player* rival;
+static CardType* bear_type;
+static CardInstance* bear;
+
+// Adds a typical turn: start, three plays, a purchase, an attack, end.
+static void add_turn(NarrationBatcher* batcher, int turn, bool with_end) {
+    NarrationEvent event = { .actor = hero, .target = rival, .turn = turn };
+
+    event.type = GAME_EVENT_TURN_START;
+    assert(narration_batcher_add(batcher, &event));
+    event.type = GAME_EVENT_CARD_PLAYED;
+    event.card = bear;
+    for (int i = 0; i < 3; i++) {
+        assert(narration_batcher_add(batcher, &event));
+    }
+    event.type = GAME_EVENT_CARD_PURCHASED;
+    event.cost = 5;
+    assert(narration_batcher_add(batcher, &event));
+    event.type = GAME_EVENT_ATTACK_PLAYER;
+    event.damage = 6;
+    assert(narration_batcher_add(batcher, &event));
+    if (with_end) {
+        event.type = GAME_EVENT_TURN_END;
+        assert(narration_batcher_add(batcher, &event));
+    }
+}
+// }}}
+
+// {{{ test_build_and_parse
+TEST(test_build_and_parse) {
+    const char* prompts[] = { "Narrate the bear.", "Narrate the wagon." };
+    char* prompt = narration_batch_build_prompt(prompts, 2);
+    assert(strstr(prompt, "[1] Narrate the bear.\n[2] Narrate the wagon.\n") != NULL);
+    free(prompt);
+    assert(narration_batch_build_prompt(prompts, 0) == NULL);
+
+    char* segments[3];
+    assert(narration_batch_parse("[1]\nThe bear roars.\n\n[2] Wheels creak.\n[3]\n"
+                                 "Silence.", 3, segments) == 3);
+    assert(strcmp(segments[0], "The bear roars.") == 0);
+    assert(strcmp(segments[1], "Wheels creak.") == 0);
+    assert(strcmp(segments[2], "Silence.") == 0);
+    for (int i = 0; i < 3; i++) free(segments[i]);
+
+    // A missing or empty section stays NULL
+    assert(narration_batch_parse("Intro. [2] Two. [3]", 3, segments) == 1);
+    assert(segments[0] == NULL);
+    assert(strcmp(segments[1], "Two.") == 0);
+    assert(segments[2] == NULL);
+    free(segments[1]);
+
+    // [10] does not satisfy [1]
+    assert(narration_batch_parse("[10] Ten.", 1, segments) == 0);
+    assert(narration_batch_parse(NULL, 2, segments) == 0);
+    assert(segments[0] == NULL && segments[1] == NULL);
+}
+// }}}
+
+// {{{ test_turn_is_one_call
+TEST(test_turn_is_one_call) {
+    stub_reset();
+    LLMConfig* config = stub_config();
+    Recorder r = {0};
+    NarrationBatcher* batcher = narration_batcher_create(config, NULL, NULL, record, &r);
+    assert(batcher != NULL);
+
+    add_turn(batcher, 1, true);  // Turn end flushes
+
+    assert(narration_batcher_pending(batcher) == 0);
+    assert(r.count == 7);
+    for (int i = 0; i < 7; i++) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "Segment %d.", i + 1);
+        assert(r.sequences[i] == (unsigned long)i);
+        assert(strcmp(r.texts[i], expected) == 0);
+        assert(r.batched[i]);
+    }
+    assert(stub_batched == 1);
+    assert(stub_single == 0);
+
+    NarrationBatchStats stats = narration_batcher_get_stats(batcher);
+    assert(stats.events == 7);
+    assert(stats.delivered == 7);
+    assert(stats.model_calls == 1);
+    assert(stats.fallbacks == 0);
+    printf("\n  7 events: %d model call instead of 7 ", stats.model_calls);
+
+    narration_batcher_free(batcher);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_missing_segment_falls_back
+TEST(test_missing_segment_falls_back) {
+    stub_reset();
+    stub_skip = 3;
+    LLMConfig* config = stub_config();
+    Recorder r = {0};
+    NarrationBatcher* batcher = narration_batcher_create(config, NULL, NULL, record, &r);
+
+    add_turn(batcher, 2, true);
+
+    assert(r.count == 7);
+    assert(strcmp(r.texts[1], "Segment 2.") == 0);
+    assert(strcmp(r.texts[2], "Solo narration.") == 0);  // Still in order
+    assert(!r.batched[2]);
+    assert(strcmp(r.texts[3], "Segment 4.") == 0);
+    assert(stub_batched == 1);
+    assert(stub_single == 1);
+    assert(narration_batcher_get_stats(batcher).fallbacks == 1);
+
+    // An unparseable reply narrates every event on its own
+    stub_reset();
+    stub_garbage = true;
+    memset(&r, 0, sizeof(r));
+    add_turn(batcher, 3, true);
+    assert(r.count == 7);
+    assert(strcmp(r.texts[6], "Solo narration.") == 0);
+    assert(stub_single == 7);
+
+    narration_batcher_free(batcher);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_failed_request_not_repeated
+TEST(test_failed_request_not_repeated) {
+    stub_reset();
+    stub_fail = true;
+    LLMConfig* config = stub_config();
+    Recorder r = {0};
+    NarrationBatcher* batcher = narration_batcher_create(config, NULL, NULL, record, &r);
+
+    add_turn(batcher, 4, true);
+
+    assert(r.count == 7);
+    assert(strcmp(r.texts[0], "(none)") == 0);
+    assert(stub_batched + stub_single == 1);
+
+    narration_batcher_free(batcher);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_breaker_serves_local
+TEST(test_breaker_serves_local) {
+    stub_reset();
+    stub_fail = true;
+    LLMConfig* config = stub_config();
+    LLMBreakerConfig breaker_options = { .min_samples = 1, .open_ms = 60000 };
+    LLMBreaker* breaker = llm_breaker_create(config, &breaker_options);
+    config->breaker = breaker;
+    Recorder r = {0};
+    NarrationBatcher* batcher = narration_batcher_create(config, NULL, NULL, record, &r);
+
+    // The failed call trips the breaker; the turn is narrated locally
+    add_turn(batcher, 6, true);
+    assert(r.count == 7);
+    assert(stub_batched + stub_single == 1);
+    for (int i = 0; i < 7; i++) {
+        assert(r.local[i]);
+    }
+    assert(strncmp(r.texts[0], "Turn 6 begins", 13) == 0);
+    assert(llm_breaker_get_stats(breaker).state == LLM_BREAKER_OPEN);
+
+    // While open the model is not asked at all
+    add_turn(batcher, 7, true);
+    assert(r.count == 14);
+    assert(stub_batched + stub_single == 1);
+    assert(r.local[13]);
+
+    NarrationBatchStats stats = narration_batcher_get_stats(batcher);
+    assert(stats.local == 14);
+    assert(stats.model_calls == 1);
+    assert(stats.batches == 1);
+
+    narration_batcher_free(batcher);
+    llm_breaker_free(breaker);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_budget_steps_down
+TEST(test_budget_steps_down) {
+    stub_reset();
+    LLMConfig* config = stub_config();
+    Recorder r = {0};
+    const void* session = &r;
+    NarrationBatcher* batcher = narration_batcher_create(config, NULL, session,
+                                                         record, &r);
+    assert(llm_usage_init(&(LLMUsageConfig){ .session_budget = 100 }));
+    assert(llm_memo_init(NULL));
+    assert(llm_async_init());
+    assert(llm_scheduler_init(NULL));
+
+    // Within budget: the whole turn goes to the model (5 tokens)
+    add_turn(batcher, 1, true);
+    assert(r.count == 7 && stub_batched == 1);
+    assert(llm_usage_get_session(session).total.tokens == 5);
+
+    // Past reduce_at: the batch runs on past the turn end and only the
+    // medium intensity attack is sent
+    assert(llm_usage_set_budget(session, 8));
+    assert(llm_usage_level(session) == LLM_USAGE_REDUCED);
+    NarrationEvent event = { .actor = hero, .target = rival, .turn = 2 };
+    event.type = GAME_EVENT_TURN_START;
+    assert(narration_batcher_add(batcher, &event));
+    event.type = GAME_EVENT_ATTACK_PLAYER;
+    event.damage = 4;
+    event.intensity = INTENSITY_MEDIUM;
+    assert(narration_batcher_add(batcher, &event));
+    event.type = GAME_EVENT_TURN_END;
+    event.intensity = INTENSITY_LOW;
+    assert(narration_batcher_add(batcher, &event));
+    assert(narration_batcher_pending(batcher) == 3);
+    assert(narration_batcher_flush(batcher) == 3);
+    assert(stub_single == 1);
+    assert(r.local[7] && !r.local[8] && r.local[9]);
+    assert(strcmp(r.texts[8], "Solo narration.") == 0);
+
+    // Still short of budget, the same event is answered from the memo
+    // although the narration config samples
+    assert(llm_usage_set_budget(session, 15));
+    assert(llm_usage_level(session) == LLM_USAGE_REDUCED);
+    event.type = GAME_EVENT_TURN_START;
+    assert(narration_batcher_add(batcher, &event));
+    event.type = GAME_EVENT_ATTACK_PLAYER;
+    event.intensity = INTENSITY_MEDIUM;
+    assert(narration_batcher_add(batcher, &event));
+    event.type = GAME_EVENT_TURN_END;
+    event.intensity = INTENSITY_LOW;
+    assert(narration_batcher_add(batcher, &event));
+    assert(narration_batcher_flush(batcher) == 3);
+    assert(stub_single == 1);
+    assert(strcmp(r.texts[11], "Solo narration.") == 0);
+    assert(llm_memo_get_stats().hits == 1);
+    assert(llm_usage_get_session(session).total.tokens == 10);
+    assert(llm_usage_set_budget(session, 8));
+
+    // Spent: a turn is narrated locally and delivered at its end
+    assert(llm_usage_level(session) == LLM_USAGE_EXHAUSTED);
+    add_turn(batcher, 3, true);
+    assert(r.count == 20);
+    assert(stub_batched == 1 && stub_single == 1);
+    assert(r.local[19]);
+
+    NarrationBatchStats stats = narration_batcher_get_stats(batcher);
+    assert(stats.budgeted == 11);
+    assert(stats.local == 11);
+    assert(stats.model_calls == 3);
+
+    narration_batcher_free(batcher);
+    llm_scheduler_cleanup();
+    llm_async_cleanup();
+    llm_memo_cleanup();
+    llm_usage_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_flush_triggers
+TEST(test_flush_triggers) {
+    stub_reset();
+    LLMConfig* config = stub_config();
+    Recorder r = {0};
+    NarrationBatchConfig options = { .max_events = 4, .window_ms = 50 };
+    NarrationBatcher* batcher = narration_batcher_create(config, &options, NULL,
+                                                         record, &r);
+
+    // Six events without a turn end: one flush at four
+    add_turn(batcher, 5, false);
+    assert(r.count == 4);
+    assert(narration_batcher_pending(batcher) == 2);
+
+    // The window has not passed yet
+    assert(narration_batcher_poll(batcher) == 0);
+    struct timespec ts = { 0, 80 * 1000000L };
+    nanosleep(&ts, NULL);
+    assert(narration_batcher_poll(batcher) == 2);
+    assert(r.count == 6);
+    assert(r.sequences[5] == 5);
+    assert(stub_batched == 2);
+
+    // A lone event is sent as is; free flushes what is pending
+    NarrationEvent event = { .type = GAME_EVENT_CARD_PLAYED, .actor = hero,
+                             .card = bear, .turn = 6 };
+    assert(narration_batcher_add(batcher, &event));
+    narration_batcher_free(batcher);
+    assert(r.count == 7);
+    assert(strcmp(r.texts[6], "Solo narration.") == 0);
+    assert(stub_single == 1);
+
+    assert(narration_batcher_create(NULL, NULL, NULL, record, &r) == NULL);
+    assert(narration_batcher_create(config, NULL, NULL, NULL, NULL) == NULL);
+    assert(!narration_batcher_add(NULL, &event));
+    narration_batcher_free(NULL);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== Narration Batch Tests ===\n");
+
+    llm_init();
+    stub_start();
+    hero = player_create("Lady Morgaine", 1);
+    rival = player_create("Lord Theron", 2);
+    bear_type = card_type_create("bear", "Dire Bear", 5, FACTION_WILDS, CARD_KIND_SHIP);
+    bear = card_instance_create(bear_type);
+
+    RUN_TEST(test_build_and_parse);
+    RUN_TEST(test_turn_is_one_call);
+    RUN_TEST(test_missing_segment_falls_back);
+    RUN_TEST(test_failed_request_not_repeated);
+    RUN_TEST(test_flush_triggers);
+    RUN_TEST(test_breaker_serves_local);
+    RUN_TEST(test_budget_steps_down);
+
+    card_instance_free(bear);
+    card_type_free(bear_type);
+    player_free(hero);
+    player_free(rival);
+    llm_cleanup();
+    stub_server_stop(stub);
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
@@ -2,13 +2,17 @@
  * test-narrative-cache.c - Tests for Narrative Caching Module
  *
  * Validates cache initialization, get/set operations, TTL expiration,
- * LRU eviction, and event signature generation.
+ * LRU eviction, byte limits, event signature generation, and timing
+ * at 100k entries.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 #include <unistd.h>  // For sleep()
 #include "../src/llm/07-narrative-cache.h"
 
@@ -235,6 +239,81 @@ static void test_cache_lru_eviction(void) {
 }
 // }}}
 
+// {{{ test_cache_lru_recency
+static void test_cache_lru_recency(void) {
+    printf("  Testing LRU order follows access, not insertion...\n");
+    tests_run++;
+
+    NarrativeCache* cache = narrative_cache_init(3, 0);
+
+    narrative_cache_set(cache, "sig:1", "Narrative 1");
+    narrative_cache_set(cache, "sig:2", "Narrative 2");
+    narrative_cache_set(cache, "sig:3", "Narrative 3");
+
+    // Touch sig:1 so sig:2 becomes least recently used
+    assert(narrative_cache_get(cache, "sig:1") != NULL);
+    narrative_cache_set(cache, "sig:4", "Narrative 4");
+
+    assert(narrative_cache_get(cache, "sig:2") == NULL);
+    assert(narrative_cache_get(cache, "sig:1") != NULL);
+    assert(narrative_cache_get(cache, "sig:3") != NULL);
+
+    // Freed slot is reused
+    narrative_cache_remove(cache, "sig:3");
+    assert(narrative_cache_set(cache, "sig:5", "Narrative 5"));
+    assert(cache->count == 3);
+    assert(cache->evictions == 1);
+
+    narrative_cache_free(cache);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_cache_byte_limit
+static void test_cache_byte_limit(void) {
+    printf("  Testing byte-bounded capacity...\n");
+    tests_run++;
+
+    NarrativeCache* cache = narrative_cache_init(100, 0);
+    char text[512];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    narrative_cache_set(cache, "sig:1", text);
+    size_t one_entry = cache->bytes;
+    assert(one_entry > sizeof(text));
+
+    // Room for two entries: the third evicts the least recent
+    narrative_cache_set_max_bytes(cache, one_entry * 2 + one_entry / 2);
+    narrative_cache_set(cache, "sig:2", text);
+    narrative_cache_set(cache, "sig:3", text);
+    assert(cache->count == 2);
+    assert(cache->evictions == 1);
+    assert(cache->bytes <= cache->max_bytes);
+    assert(narrative_cache_get(cache, "sig:1") == NULL);
+
+    // An entry larger than the whole budget is refused
+    char big[4096];
+    memset(big, 'y', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    assert(narrative_cache_set(cache, "sig:big", big) == false);
+    assert(cache->count == 2);
+
+    // Shrinking the budget evicts immediately
+    narrative_cache_set_max_bytes(cache, one_entry);
+    assert(cache->count == 1);
+    assert(narrative_cache_get(cache, "sig:3") != NULL);
+
+    narrative_cache_clear(cache);
+    assert(cache->bytes == 0);
+
+    narrative_cache_free(cache);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
 // {{{ test_cache_remove
 static void test_cache_remove(void) {
     printf("  Testing entry removal...\n");
@@ -385,6 +464,90 @@ static void test_cache_cleanup_expired(void) {
 }
 // }}}
 
+// {{{ test_cache_cleanup_after_update
+static void test_cache_cleanup_after_update(void) {
+    printf("  Testing cleanup keeps entries refreshed by set...\n");
+    tests_run++;
+
+    NarrativeCache* cache = narrative_cache_init(10, 1);
+
+    narrative_cache_set(cache, "sig:1", "Narrative 1");
+    narrative_cache_set(cache, "sig:2", "Narrative 2");
+
+    sleep(2);
+
+    // Regenerating sig:1 restarts its TTL
+    narrative_cache_set(cache, "sig:1", "Narrative 1b");
+
+    int removed = narrative_cache_cleanup_expired(cache);
+    assert(removed == 1);
+    assert(cache->expirations == 1);
+    assert(strcmp(narrative_cache_get(cache, "sig:1"), "Narrative 1b") == 0);
+
+    narrative_cache_free(cache);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_cache_scale_100k
+static double elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static void test_cache_scale_100k(void) {
+    printf("  Testing 100k entries (benchmark)...\n");
+    tests_run++;
+
+    enum { N = 100000 };
+    NarrativeCache* cache = narrative_cache_init(N, 3600);
+    char sig[64];
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < N; i++) {
+        snprintf(sig, sizeof(sig), "card played:Card %d:Player %d", i, i % 4);
+        narrative_cache_set(cache, sig, "The fleet surges forward.");
+    }
+    double set_ms = elapsed_ms(&start);
+    assert(cache->count == N);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < N; i++) {
+        snprintf(sig, sizeof(sig), "card played:Card %d:Player %d", i, i % 4);
+        assert(narrative_cache_get(cache, sig) != NULL);
+    }
+    double get_ms = elapsed_ms(&start);
+
+    // Every further insert evicts one entry
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = N; i < 2 * N; i++) {
+        snprintf(sig, sizeof(sig), "card played:Card %d:Player %d", i, i % 4);
+        narrative_cache_set(cache, sig, "The fleet surges forward.");
+    }
+    double evict_ms = elapsed_ms(&start);
+    assert(cache->count == N);
+    assert(cache->evictions == N);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(narrative_cache_cleanup_expired(cache) == 0);
+    double cleanup_ms = elapsed_ms(&start);
+
+    printf("    set %.1f ms, get %.1f ms, set+evict %.1f ms, cleanup %.3f ms\n",
+           set_ms, get_ms, evict_ms, cleanup_ms);
+
+    // Generous bound; a linear scan per lookup would blow well past it
+    assert(set_ms + get_ms + evict_ms < 5000.0);
+
+    narrative_cache_free(cache);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
 // {{{ test_event_signature_card_played
 static void test_event_signature_card_played(void) {
     printf("  Testing event signature for card played...\n");
@@ -465,6 +628,262 @@ static void test_event_signature_null(void) {
 }
 // }}}
 
+// {{{ test_template_signature_ignores_names
+static void test_template_signature_ignores_names(void) {
+    printf("  Testing template signature ignores player names...\n");
+    tests_run++;
+
+    Player alice = { .name = "Alice" };
+    Player bob = { .name = "Bob" };
+
+    NarrationEvent* a = event_narration_create(GAME_EVENT_CARD_PLAYED);
+    a->actor = &alice;
+    a->card = &mock_card;
+    NarrationEvent* b = event_narration_create(GAME_EVENT_CARD_PLAYED);
+    b->actor = &bob;
+    b->card = &mock_card;
+
+    char* sig_a = event_build_template_signature(a);
+    char* sig_b = event_build_template_signature(b);
+    assert(strcmp(sig_a, sig_b) == 0);
+    assert(strstr(sig_a, "Alice") == NULL);
+    assert(strstr(sig_a, "Battle Cruiser") != NULL);
+    assert(strstr(sig_a, faction_to_string(FACTION_KINGDOM)) != NULL);
+
+    // Intensity is part of the key
+    b->intensity = INTENSITY_HIGH;
+    free(sig_b);
+    sig_b = event_build_template_signature(b);
+    assert(strcmp(sig_a, sig_b) != 0);
+
+    // Damage is bucketed: 7 and 8 share, 7 and 12 do not
+    NarrationEvent* hit = event_narration_create(GAME_EVENT_ATTACK_PLAYER);
+    hit->actor = &alice;
+    hit->target = &bob;
+    hit->damage = 7;
+    char* sig_7 = event_build_template_signature(hit);
+    hit->damage = 8;
+    char* sig_8 = event_build_template_signature(hit);
+    hit->damage = 12;
+    char* sig_12 = event_build_template_signature(hit);
+    assert(strcmp(sig_7, sig_8) == 0);
+    assert(strcmp(sig_7, sig_12) != 0);
+
+    assert(event_build_template_signature(NULL) == NULL);
+
+    free(sig_a);
+    free(sig_b);
+    free(sig_7);
+    free(sig_8);
+    free(sig_12);
+    event_narration_free(a);
+    event_narration_free(b);
+    event_narration_free(hit);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_template_round_trip
+static void test_template_round_trip(void) {
+    printf("  Testing templatize and fill round trip...\n");
+    tests_run++;
+
+    Player al = { .name = "Al" };
+    Player alice = { .name = "Alice" };
+    NarrationEvent* event = event_narration_create(GAME_EVENT_ATTACK_PLAYER);
+    event->actor = &al;
+    event->target = &alice;
+
+    // The longer name is replaced first, so "Alice" is not split
+    char* template_text = narrative_templatize("Al strikes Alice; Alice reels.", event);
+    assert(strcmp(template_text, "{actor} strikes {target}; {target} reels.") == 0);
+
+    Player vex = { .name = "Commander Vex" };
+    Player thorne = { .name = "Admiral Thorne" };
+    event->actor = &vex;
+    event->target = &thorne;
+    char* filled = narrative_fill_template(template_text, event);
+    assert(strcmp(filled, "Commander Vex strikes Admiral Thorne; Admiral Thorne reels.") == 0);
+    free(filled);
+
+    event->target = NULL;
+    filled = narrative_fill_template(template_text, event);
+    assert(strcmp(filled, "Commander Vex strikes someone; someone reels.") == 0);
+    free(filled);
+
+    free(template_text);
+    event_narration_free(event);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_templatize_whole_words
+static void test_templatize_whole_words(void) {
+    printf("  Testing templatize matches whole names only...\n");
+    tests_run++;
+
+    Player al = { .name = "Al" };
+    Player to = { .name = "to" };
+    Player toma = { .name = "Toma" };
+    NarrationEvent* event = event_narration_create(GAME_EVENT_ATTACK_PLAYER);
+    event->actor = &al;
+    event->target = &toma;
+
+    // A name inside a longer word is part of that word
+    char* template_text = narrative_templatize("Always Al, never Alba.", event);
+    assert(strcmp(template_text, "Always {actor}, never Alba.") == 0);
+    free(template_text);
+
+    // A short name is never searched for inside the placeholders
+    event->target = &to;
+    template_text = narrative_templatize("Al rides to battle; Al.", event);
+    assert(strcmp(template_text, "{actor} rides {target} battle; {actor}.") == 0);
+    free(template_text);
+
+    event->actor = &to;
+    event->target = &al;
+    template_text = narrative_templatize("to hits Al (Al's last stand)", event);
+    assert(strcmp(template_text, "{actor} hits {target} ({target}'s last stand)") == 0);
+
+    // Names that look like placeholders are filled in as written
+    Player odd = { .name = "{target}" };
+    event->actor = &odd;
+    event->target = &toma;
+    char* filled = narrative_fill_template(template_text, event);
+    assert(strcmp(filled, "{target} hits Toma (Toma's last stand)") == 0);
+    free(filled);
+
+    free(template_text);
+    event_narration_free(event);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_cache_event_across_players
+static void test_cache_event_across_players(void) {
+    printf("  Testing event cache hit for different players...\n");
+    tests_run++;
+
+    NarrativeCache* cache = narrative_cache_init(10, 0);
+    Player alice = { .name = "Alice" };
+    Player bob = { .name = "Bob" };
+
+    NarrationEvent* event = event_narration_create(GAME_EVENT_CARD_PLAYED);
+    event->actor = &alice;
+    event->card = &mock_card;
+
+    assert(narrative_cache_get_event(cache, event) == NULL);
+    assert(narrative_cache_set_event(cache, event, "Alice launches the Battle Cruiser."));
+
+    event->actor = &bob;
+    char* text = narrative_cache_get_event(cache, event);
+    assert(text != NULL);
+    assert(strcmp(text, "Bob launches the Battle Cruiser.") == 0);
+    free(text);
+    assert(cache->hits == 1);
+
+    narrative_cache_free(cache);
+    event_narration_free(event);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
+// {{{ test_template_hit_rate_report
+// Simulates many short games, each between new players, over a
+// common card pool and compares hit rates of exact and template keys.
+static void test_template_hit_rate_report(void) {
+    printf("  Testing hit rate over simulated games (report)...\n");
+    tests_run++;
+
+    static const char* cards[] = {
+        "Scout", "Viper", "Explorer", "Dire Bear", "Battle Cruiser",
+        "Trade Galleon", "Orbital Station", "Wolf Pack"
+    };
+    static const Faction factions[] = {
+        FACTION_NEUTRAL, FACTION_NEUTRAL, FACTION_NEUTRAL, FACTION_WILDS,
+        FACTION_KINGDOM, FACTION_MERCHANT, FACTION_ARTIFICER, FACTION_WILDS
+    };
+    enum { CARD_KINDS = 8, GAMES = 40, EVENTS_PER_GAME = 60 };
+
+    CardType types[CARD_KINDS];
+    CardInstance instances[CARD_KINDS];
+    for (int i = 0; i < CARD_KINDS; i++) {
+        memset(&types[i], 0, sizeof(CardType));
+        types[i].name = (char*)cards[i];
+        types[i].faction = factions[i];
+        instances[i].type = &types[i];
+    }
+
+    NarrativeCache* exact = narrative_cache_init(4096, 0);
+    NarrativeCache* templated = narrative_cache_init(4096, 0);
+    srand(1234);
+
+    for (int game = 0; game < GAMES; game++) {
+        // Every game seats new players
+        char name1[32];
+        char name2[32];
+        snprintf(name1, sizeof(name1), "Commander %d", game * 2);
+        snprintf(name2, sizeof(name2), "Commander %d", game * 2 + 1);
+        Player p1 = { .name = name1 };
+        Player p2 = { .name = name2 };
+
+        for (int i = 0; i < EVENTS_PER_GAME; i++) {
+            NarrationEvent* event;
+            int roll = rand() % 10;
+            if (roll < 6) {
+                event = event_narration_create(GAME_EVENT_CARD_PLAYED);
+                event->card = &instances[rand() % CARD_KINDS];
+            } else if (roll < 8) {
+                event = event_narration_create(GAME_EVENT_CARD_PURCHASED);
+                event->card = &instances[rand() % CARD_KINDS];
+                event->cost = 1 + rand() % 6;
+            } else {
+                event = event_narration_create(GAME_EVENT_ATTACK_PLAYER);
+                event->target = (i % 2) ? &p1 : &p2;
+                event->damage = 1 + rand() % 12;
+            }
+            event->actor = (i % 2) ? &p2 : &p1;
+            event->turn = 1 + i / 2;
+            event->intensity = event_narration_calculate_intensity(NULL, event);
+
+            char* sig = event_build_signature(event);
+            if (narrative_cache_get(exact, sig) == NULL) {
+                narrative_cache_set(exact, sig, "narration");
+            }
+            free(sig);
+
+            char* text = narrative_cache_get_event(templated, event);
+            if (text == NULL) {
+                narrative_cache_set_event(templated, event, "narration");
+            }
+            free(text);
+
+            event_narration_free(event);
+        }
+    }
+
+    NarrativeCacheStats exact_stats = narrative_cache_get_stats(exact);
+    NarrativeCacheStats template_stats = narrative_cache_get_stats(templated);
+    printf("    %d games, %d events: exact keys %.1f%% hit (%d entries), "
+           "template keys %.1f%% hit (%d entries)\n",
+           GAMES, GAMES * EVENTS_PER_GAME,
+           exact_stats.hit_rate * 100.0f, exact_stats.total_entries,
+           template_stats.hit_rate * 100.0f, template_stats.total_entries);
+
+    assert(template_stats.hit_rate > 0.9f);
+    assert(template_stats.hit_rate > exact_stats.hit_rate + 0.2f);
+
+    narrative_cache_free(exact);
+    narrative_cache_free(templated);
+    tests_passed++;
+    printf("    PASSED\n");
+}
+// }}}
+
 // {{{ test_cache_null_safety
 static void test_cache_null_safety(void) {
     printf("  Testing NULL safety...\n");
@@ -509,6 +928,8 @@ int main(void) {
 
     printf("\nEviction Tests:\n");
     test_cache_lru_eviction();
+    test_cache_lru_recency();
+    test_cache_byte_limit();
     test_cache_remove();
     test_cache_clear();
 
@@ -519,6 +940,10 @@ int main(void) {
     printf("\nTTL Tests:\n");
     test_cache_ttl_expiration();
     test_cache_cleanup_expired();
+    test_cache_cleanup_after_update();
+
+    printf("\nScale Tests:\n");
+    test_cache_scale_100k();
 
     printf("\nEvent Signature Tests:\n");
     test_event_signature_card_played();
@@ -526,6 +951,13 @@ int main(void) {
     test_event_signature_game_over();
     test_event_signature_null();
 
+    printf("\nTemplate Signature Tests:\n");
+    test_template_signature_ignores_names();
+    test_template_round_trip();
+    test_templatize_whole_words();
+    test_cache_event_across_players();
+    test_template_hit_rate_report();
+
     printf("\nSafety Tests:\n");
     test_cache_null_safety();
 
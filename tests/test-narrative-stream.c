@@ -0,0 +1,318 @@
+/* test-narrative-stream.c - Streamed Narrative Delivery Tests
+ *
+ * Tests that narration deltas reach WebSocket clients as numbered
+ * MSG_NARRATIVE chunks with a final marker, reach SSH clients as raw
+ * text, and that appends from another thread are delivered in order.
+ *
+ * Run with: make test-narrative-stream
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* ========================================================================== */
+/*                              Stub Definitions                               */
+/* ========================================================================== */
+
+/* {{{ Stub structures
+ * Minimal transport stubs that record what each connection received.
+ */
+#define MAX_SENT 64
+
+typedef struct WSConnection {
+    int sent_count;
+    char* sent[MAX_SENT];
+} WSConnection;
+
+typedef struct SSHConnection {
+    int sent_count;
+    char* sent[MAX_SENT];
+} SSHConnection;
+
+bool ws_send(WSConnection* conn, const char* json) {
+    if (conn->sent_count < MAX_SENT) {
+        conn->sent[conn->sent_count++] = strdup(json);
+    }
+    return true;
+}
+
+int ssh_connection_send_string(SSHConnection* conn, const char* str) {
+    if (conn->sent_count < MAX_SENT) {
+        conn->sent[conn->sent_count++] = strdup(str);
+    }
+    return (int)strlen(str);
+}
+/* }}} */
+
+#include "../src/net/10-narrative-stream.h"
+#include "../src/net/04-protocol.h"
+
+/* ========================================================================== */
+/*                              Test Utilities                                 */
+/* ========================================================================== */
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) \
+    do { \
+        printf("  [TEST] %s... ", name); \
+        tests_run++; \
+    } while (0)
+
+#define PASS() \
+    do { \
+        printf("\033[32mPASS\033[0m\n"); \
+        tests_passed++; \
+    } while (0)
+
+#define FAIL(msg) \
+    do { \
+        printf("\033[31mFAIL\033[0m: %s\n", msg); \
+    } while (0)
+
+#define ASSERT(cond, msg) \
+    do { \
+        if (!(cond)) { \
+            FAIL(msg); \
+            return; \
+        } \
+    } while (0)
+
+/* {{{ reset_ws / reset_ssh */
+static void reset_ws(WSConnection* ws) {
+    for (int i = 0; i < ws->sent_count; i++) {
+        free(ws->sent[i]);
+    }
+    ws->sent_count = 0;
+}
+
+static void reset_ssh(SSHConnection* ssh) {
+    for (int i = 0; i < ssh->sent_count; i++) {
+        free(ssh->sent[i]);
+    }
+    ssh->sent_count = 0;
+}
+/* }}} */
+
+/* {{{ parse_chunk
+ * Parses a sent JSON chunk back into a Message.
+ */
+static Message* parse_chunk(const char* json) {
+    ProtocolError error = PROTOCOL_OK;
+    return protocol_parse(json, &error);
+}
+/* }}} */
+
+static WSConnection ws_a;
+static WSConnection ws_other_game;
+static SSHConnection ssh_a;
+
+/* {{{ setup_registry
+ * Game 1 has one WebSocket and one SSH client; game 2 has one WebSocket.
+ */
+static ConnectionRegistry* setup_registry(void) {
+    reset_ws(&ws_a);
+    reset_ws(&ws_other_game);
+    reset_ssh(&ssh_a);
+
+    ConnectionRegistry* registry = conn_registry_create();
+    int id_a = conn_register_ws(registry, &ws_a);
+    int id_ssh = conn_register_ssh(registry, &ssh_a);
+    int id_other = conn_register_ws(registry, &ws_other_game);
+    conn_assign_player(registry, id_a, 0, 1);
+    conn_assign_player(registry, id_ssh, 1, 1);
+    conn_assign_player(registry, id_other, 0, 2);
+    return registry;
+}
+/* }}} */
+
+/* ========================================================================== */
+/*                              Stream Tests                                   */
+/* ========================================================================== */
+
+/* {{{ test_begin_invalid */
+static void test_begin_invalid(void) {
+    TEST("Begin with invalid arguments");
+
+    ASSERT(narrative_stream_begin(NULL, 1) == NULL, "NULL registry accepted");
+    ConnectionRegistry* registry = conn_registry_create();
+    ASSERT(narrative_stream_begin(registry, -1) == NULL, "Negative game accepted");
+    ASSERT(narrative_stream_flush(NULL) == 0, "Flush NULL should send nothing");
+    narrative_stream_free(NULL);
+    conn_registry_destroy(registry);
+    PASS();
+}
+/* }}} */
+
+/* {{{ test_chunks_to_websocket */
+static void test_chunks_to_websocket(void) {
+    TEST("WebSocket receives numbered chunks and final marker");
+
+    ConnectionRegistry* registry = setup_registry();
+    NarrativeStream* stream = narrative_stream_begin(registry, 1);
+    ASSERT(stream != NULL, "Failed to begin stream");
+
+    narrative_stream_append(stream, "The dire bear");
+    ASSERT(narrative_stream_flush(stream) == 1, "First flush should send one chunk");
+    ASSERT(ws_a.sent_count == 1, "Chunk should arrive before generation ends");
+
+    narrative_stream_append(stream, " charges!");
+    narrative_stream_finish(stream);
+    ASSERT(!narrative_stream_is_complete(stream), "Not complete before flush");
+    ASSERT(narrative_stream_flush(stream) == 2, "Second flush should send two");
+    ASSERT(narrative_stream_is_complete(stream), "Complete after final flush");
+    ASSERT(ws_a.sent_count == 3, "WebSocket should have three chunks");
+
+    for (int i = 0; i < 3; i++) {
+        Message* msg = parse_chunk(ws_a.sent[i]);
+        ASSERT(msg != NULL && msg->type == MSG_NARRATIVE, "Chunk not a narrative");
+        cJSON* seq = cJSON_GetObjectItem(msg->payload, "seq");
+        cJSON* sid = cJSON_GetObjectItem(msg->payload, "stream_id");
+        cJSON* final = cJSON_GetObjectItem(msg->payload, "final");
+        ASSERT(seq && seq->valueint == i, "Sequence numbers out of order");
+        ASSERT(sid && sid->valueint == narrative_stream_id(stream), "Wrong stream id");
+        ASSERT(final && (cJSON_IsTrue(final) == (i == 2)), "Final marker misplaced");
+        message_free(msg);
+    }
+
+    ASSERT(ws_other_game.sent_count == 0, "Other game must not receive chunks");
+
+    char* text = narrative_stream_copy_text(stream);
+    ASSERT(text && strcmp(text, "The dire bear charges!") == 0, "Full text wrong");
+    free(text);
+
+    narrative_stream_free(stream);
+    conn_registry_destroy(registry);
+    PASS();
+}
+/* }}} */
+
+/* {{{ test_raw_text_to_ssh */
+static void test_raw_text_to_ssh(void) {
+    TEST("SSH receives raw text and a closing line break");
+
+    ConnectionRegistry* registry = setup_registry();
+    NarrativeStream* stream = narrative_stream_begin(registry, 1);
+
+    narrative_stream_on_delta("Steel", stream);
+    narrative_stream_on_delta(" rings.", stream);
+    narrative_stream_finish(stream);
+    narrative_stream_flush(stream);
+
+    ASSERT(ssh_a.sent_count == 3, "SSH should get two texts and a newline");
+    ASSERT(strcmp(ssh_a.sent[0], "Steel") == 0, "First SSH text wrong");
+    ASSERT(strcmp(ssh_a.sent[1], " rings.") == 0, "Second SSH text wrong");
+    ASSERT(strcmp(ssh_a.sent[2], "\r\n") == 0, "SSH final should end the line");
+
+    narrative_stream_free(stream);
+    conn_registry_destroy(registry);
+    PASS();
+}
+/* }}} */
+
+/* {{{ test_append_after_finish */
+static void test_append_after_finish(void) {
+    TEST("Appends after finish are rejected");
+
+    ConnectionRegistry* registry = setup_registry();
+    NarrativeStream* stream = narrative_stream_begin(registry, 1);
+
+    ASSERT(narrative_stream_append(stream, ""), "Empty delta should be accepted");
+    narrative_stream_finish(stream);
+    narrative_stream_finish(stream);
+    ASSERT(!narrative_stream_append(stream, "late"), "Late append accepted");
+    ASSERT(narrative_stream_flush(stream) == 1, "Only the final marker is sent");
+
+    narrative_stream_free(stream);
+    conn_registry_destroy(registry);
+    PASS();
+}
+/* }}} */
+
+/* {{{ test_unique_stream_ids */
+static void test_unique_stream_ids(void) {
+    TEST("Streams get distinct ids");
+
+    ConnectionRegistry* registry = setup_registry();
+    NarrativeStream* a = narrative_stream_begin(registry, 1);
+    NarrativeStream* b = narrative_stream_begin(registry, 1);
+    ASSERT(narrative_stream_id(a) != narrative_stream_id(b), "Stream ids collide");
+
+    narrative_stream_free(a);
+    narrative_stream_free(b);
+    conn_registry_destroy(registry);
+    PASS();
+}
+/* }}} */
+
+/* {{{ test_cross_thread_append */
+static void* producer(void* arg) {
+    NarrativeStream* stream = (NarrativeStream*)arg;
+    char delta[8];
+    for (int i = 0; i < 20; i++) {
+        snprintf(delta, sizeof(delta), "%c", 'a' + i);
+        narrative_stream_append(stream, delta);
+    }
+    narrative_stream_finish(stream);
+    return NULL;
+}
+
+static void test_cross_thread_append(void) {
+    TEST("Deltas appended on another thread arrive in order");
+
+    ConnectionRegistry* registry = setup_registry();
+    NarrativeStream* stream = narrative_stream_begin(registry, 1);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, stream);
+    while (!narrative_stream_is_complete(stream)) {
+        narrative_stream_flush(stream);
+    }
+    pthread_join(thread, NULL);
+
+    ASSERT(ssh_a.sent_count == 21, "SSH should get 20 deltas and a newline");
+    for (int i = 0; i < 20; i++) {
+        ASSERT(ssh_a.sent[i][0] == 'a' + i, "Deltas out of order");
+    }
+
+    narrative_stream_free(stream);
+    conn_registry_destroy(registry);
+    PASS();
+}
+/* }}} */
+
+/* ========================================================================== */
+/*                              Main                                           */
+/* ========================================================================== */
+
+int main(void) {
+    printf("\n");
+    printf("==========================================\n");
+    printf("  Narrative Stream Tests\n");
+    printf("==========================================\n\n");
+
+    printf("Streaming:\n");
+    test_begin_invalid();
+    test_chunks_to_websocket();
+    test_raw_text_to_ssh();
+    test_append_after_finish();
+    test_unique_stream_ids();
+    test_cross_thread_append();
+    printf("\n");
+
+    reset_ws(&ws_a);
+    reset_ws(&ws_other_game);
+    reset_ssh(&ssh_a);
+
+    printf("==========================================\n");
+    printf("  Results: %d/%d tests passed\n", tests_passed, tests_run);
+    printf("==========================================\n\n");
+
+    return (tests_passed == tests_run) ? 0 : 1;
+}
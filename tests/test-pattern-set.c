@@ -0,0 +1,241 @@
+/*
+ * test-pattern-set.c - Tests for the Multi-Pattern Matcher
+ *
+ * Validates case-folded matching, overlapping and nested matches,
+ * early stop and error handling, and compares one scan against a
+ * substring search per pattern.
+ * Run with: gcc -o test-pattern-set test-pattern-set.c ../src/llm/15-pattern-set.c && ./test-pattern-set
+ */
+
+#define _GNU_SOURCE
+
+#include "../src/llm/15-pattern-set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ Match recorder
+#define MAX_RECORDED 64
+
+typedef struct {
+    int ids[MAX_RECORDED];
+    size_t starts[MAX_RECORDED];
+    size_t lengths[MAX_RECORDED];
+    int count;
+    int stop_after;          // 0 = never stop
+} Recorder;
+
+static bool record_match(int id, size_t start, size_t length, void* user_data) {
+    Recorder* r = user_data;
+    if (r->count < MAX_RECORDED) {
+        r->ids[r->count] = id;
+        r->starts[r->count] = start;
+        r->lengths[r->count] = length;
+    }
+    r->count++;
+    return r->stop_after == 0 || r->count < r->stop_after;
+}
+
+static bool recorded(const Recorder* r, int id, size_t start) {
+    for (int i = 0; i < r->count && i < MAX_RECORDED; i++) {
+        if (r->ids[i] == id && r->starts[i] == start) {
+            return true;
+        }
+    }
+    return false;
+}
+// }}}
+
+// {{{ test_basic_match
+TEST(test_basic_match) {
+    PatternSet* set = pattern_set_create();
+    assert(set != NULL);
+    assert(pattern_set_add(set, "wilds", 1));
+    assert(pattern_set_add(set, "Lady Morgaine", 2));
+    assert(pattern_set_count(set) == 2);
+    assert(pattern_set_compile(set));
+
+    Recorder r = {0};
+    int n = pattern_set_scan(set, "LADY MORGAINE calls the Wilds.", record_match, &r);
+    assert(n == 2);
+    assert(r.count == 2);
+    assert(recorded(&r, 2, 0));
+    assert(recorded(&r, 1, 24));
+    assert(r.lengths[1] == 5);
+
+    assert(pattern_set_scan(set, "nothing here", NULL, NULL) == 0);
+    assert(pattern_set_scan(set, "", NULL, NULL) == 0);
+    assert(pattern_set_scan(set, NULL, NULL, NULL) == 0);
+
+    pattern_set_free(set);
+}
+// }}}
+
+// {{{ test_overlapping_matches
+TEST(test_overlapping_matches) {
+    PatternSet* set = pattern_set_create();
+    assert(pattern_set_add(set, "he", 1));
+    assert(pattern_set_add(set, "she", 2));
+    assert(pattern_set_add(set, "his", 3));
+    assert(pattern_set_add(set, "hers", 4));
+    assert(pattern_set_add(set, "player 1", 5));
+    assert(pattern_set_add(set, "player 10", 6));
+    assert(pattern_set_add(set, "he", 7));  // Same text, second id
+    assert(pattern_set_compile(set));
+
+    Recorder r = {0};
+    assert(pattern_set_scan(set, "ushers", record_match, &r) == 4);
+    assert(recorded(&r, 2, 1));
+    assert(recorded(&r, 1, 2));
+    assert(recorded(&r, 7, 2));
+    assert(recorded(&r, 4, 2));
+
+    memset(&r, 0, sizeof(r));
+    assert(pattern_set_scan(set, "Player 10 and player 1", record_match, &r) == 3);
+    assert(recorded(&r, 5, 0));
+    assert(recorded(&r, 6, 0));
+    assert(recorded(&r, 5, 14));
+
+    pattern_set_free(set);
+}
+// }}}
+
+// {{{ test_stop_early
+TEST(test_stop_early) {
+    PatternSet* set = pattern_set_create();
+    assert(pattern_set_add(set, "a", 1));
+    assert(pattern_set_compile(set));
+
+    Recorder r = { .stop_after = 2 };
+    assert(pattern_set_scan(set, "aaaaa", record_match, &r) == 2);
+    assert(r.count == 2);
+
+    pattern_set_free(set);
+}
+// }}}
+
+// {{{ test_invalid_use
+TEST(test_invalid_use) {
+    PatternSet* set = pattern_set_create();
+    assert(!pattern_set_add(set, "", 1));
+    assert(!pattern_set_add(set, NULL, 1));
+    assert(pattern_set_scan(set, "text", NULL, NULL) == -1);  // Not compiled
+
+    assert(pattern_set_compile(set));                          // Empty set
+    assert(pattern_set_scan(set, "text", NULL, NULL) == 0);
+    assert(!pattern_set_add(set, "late", 2));
+    assert(!pattern_set_compile(set));
+
+    pattern_set_free(set);
+    pattern_set_free(NULL);
+    assert(pattern_set_count(NULL) == 0);
+    assert(!pattern_set_add(NULL, "x", 1));
+}
+// }}}
+
+// {{{ test_matches_substring_search
+// Every pattern found by the scan is found by strcasestr and vice versa.
+TEST(test_matches_substring_search) {
+    const char* patterns[] = {
+        "merchant", "guild", "merchant wilds", "wilds", "kingdom", "king",
+        "turn", "authority", "Dire Bear", "bear", "player 2", "ing"
+    };
+    int count = (int)(sizeof(patterns) / sizeof(patterns[0]));
+
+    PatternSet* set = pattern_set_create();
+    for (int i = 0; i < count; i++) {
+        assert(pattern_set_add(set, patterns[i], i));
+    }
+    assert(pattern_set_compile(set));
+
+    const char* texts[] = {
+        "The Merchant Wilds gather as the King's guild turns.",
+        "Player 2 unleashes a DIRE BEAR with 40 authority on turn 7.",
+        "Nothing relevant.",
+        "kingkingdomkingdom"
+    };
+    for (int t = 0; t < 4; t++) {
+        Recorder r = {0};
+        pattern_set_scan(set, texts[t], record_match, &r);
+        for (int i = 0; i < count; i++) {
+            bool found = false;
+            for (int m = 0; m < r.count; m++) {
+                found = found || r.ids[m] == i;
+            }
+            assert(found == (strcasestr(texts[t], patterns[i]) != NULL));
+        }
+    }
+
+    pattern_set_free(set);
+}
+// }}}
+
+// {{{ test_benchmark_scan
+static double elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+TEST(test_benchmark_scan) {
+    enum { PATTERNS = 200, ROUNDS = 200 };
+    char names[PATTERNS][24];
+    PatternSet* set = pattern_set_create();
+    for (int i = 0; i < PATTERNS; i++) {
+        snprintf(names[i], sizeof(names[i]), "Card Name %03d", i);
+        assert(pattern_set_add(set, names[i], i));
+    }
+    assert(pattern_set_compile(set));
+
+    const char* narrative =
+        "Lady Morgaine plays Card Name 042 and the Merchant Guild answers, "
+        "while Lord Darkon holds the line with 38 authority on turn 12. "
+        "The wilds stir as Card Name 117 enters the fray.";
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int naive = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < PATTERNS; i++) {
+            naive += strcasestr(narrative, names[i]) != NULL;
+        }
+    }
+    double naive_ms = elapsed_ms(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int scanned = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        scanned += pattern_set_scan(set, narrative, NULL, NULL);
+    }
+    double scan_ms = elapsed_ms(&start);
+
+    assert(naive == scanned);
+    printf("\n  %d patterns x %d narratives: per-pattern search %.2f ms, "
+           "one scan %.2f ms ", PATTERNS, ROUNDS, naive_ms, scan_ms);
+
+    pattern_set_free(set);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== Multi-Pattern Matcher Tests ===\n");
+
+    RUN_TEST(test_basic_match);
+    RUN_TEST(test_overlapping_matches);
+    RUN_TEST(test_stop_early);
+    RUN_TEST(test_invalid_use);
+    RUN_TEST(test_matches_substring_search);
+    RUN_TEST(test_benchmark_scan);
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
@@ -0,0 +1,382 @@
+/*
+ * test-prefetch.c - Tests for Speculative Narration Prefetch
+ *
+ * Validates event prediction from hand, combat and trade row, that
+ * prefetched narration serves the real action under another player's
+ * name, the in-flight, window and token budgets, cancellation on the
+ * real action, the accuracy counters and submission through the
+ * scheduler's prefetch class. A scripted stub-server instance stands
+ * in for the model server.
+ * Run with: gcc -o test-prefetch test-prefetch.c ../src/llm/13-prefetch.c
+ *           ../src/llm/12-shared-cache.c ../src/llm/10-async-client.c
+ *           ../src/llm/07-narrative-cache.c ../src/llm/05-event-narration.c
+ *           ../src/llm/04-force-description.c ../src/llm/03-world-state.c
+ *           ../src/llm/02-prompts.c ../src/llm/01-api-client.c
+ *           ../src/llm/19-endpoint-pool.c ../src/llm/20-circuit-breaker.c
+ *           ../src/llm/21-response-memo.c ../src/llm/16-scheduler.c
+ *           ../src/llm/22-token-usage.c ../src/net/09-http-pool.c
+ *           ../src/tools/stub-server.c
+ *           ../src/core/0[1-8]-*.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-prefetch
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/13-prefetch.h"
+#include "../src/llm/12-shared-cache.h"
+#include "../src/llm/16-scheduler.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+#define STUB_DELAY_MS 100
+
+// {{{ sleep_ms
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+// }}}
+
+// {{{ Stub responder
+// Answers every request with a canned 12-token completion naming Alice
+// after STUB_DELAY_MS, counting requests and the most served at once.
+static StubServer* stub = NULL;
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)body;
+    (void)context;
+    free(reply->text);
+    reply->text = strdup("Alice presses on.");
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 12;
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.latency.base_ms = STUB_DELAY_MS;
+    config.tokens_per_second = 0;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+
+static void stub_reset(void) {
+    stub_server_reset_stats(stub);
+}
+
+static int stub_hits(void) {
+    return stub_server_get_stats(stub).requests;
+}
+
+static int stub_max_active(void) {
+    return stub_server_get_stats(stub).peak_active;
+}
+
+static LLMConfig* stub_config(void) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->timeout_ms = 5000;
+    config->max_retries = 0;
+    return config;
+}
+// }}}
+
+// {{{ Game fixture
+// Alice to act in PHASE_MAIN holding three scouts (1 trade each) and
+// two vipers (1 combat each): 3 trade and 2 combat in reach. The trade
+// row holds cards costing 2, 3, 4, 6 and 8.
+static CardType* make_type(const char* id, int cost, EffectType effect, int value) {
+    CardType* type = card_type_create(id, id, cost, FACTION_NEUTRAL, CARD_KIND_SHIP);
+    if (value > 0) {
+        type->effects = effect_array_create(1);
+        type->effects[0].type = effect;
+        type->effects[0].value = value;
+        type->effect_count = 1;
+    }
+    return type;
+}
+
+static Game* make_game(const char* actor, const char* opponent) {
+    Game* game = game_create(2);
+    game_add_player(game, actor);
+    game_add_player(game, opponent);
+
+    CardType* scout = make_type("Scout", 0, EFFECT_TRADE, 1);
+    CardType* viper = make_type("Viper", 0, EFFECT_COMBAT, 1);
+    CardType* explorer = make_type("Explorer", 2, EFFECT_TRADE, 2);
+    game_register_card_type(game, scout);
+    game_register_card_type(game, viper);
+    game_register_card_type(game, explorer);
+
+    static const char* names[] = { "Pike", "Lancer", "Warden", "Drake", "Titan" };
+    static const int costs[] = { 2, 3, 4, 6, 8 };
+    CardType* row[5];
+    for (int i = 0; i < 5; i++) {
+        row[i] = make_type(names[i], costs[i], EFFECT_COMBAT, 2);
+        game_register_card_type(game, row[i]);
+    }
+    game->trade_row = trade_row_create(row, 5, explorer);
+
+    Deck* deck = game->players[0]->deck;
+    for (int i = 0; i < 3; i++) {
+        deck_add_to_hand(deck, card_instance_create(scout));
+    }
+    for (int i = 0; i < 2; i++) {
+        deck_add_to_hand(deck, card_instance_create(viper));
+    }
+
+    game->active_player = 0;
+    game->turn_number = 3;
+    game->phase = PHASE_MAIN;
+    return game;
+}
+
+static void start_cache(void) {
+    SharedCacheConfig config = { 256, 0, 0, NULL };
+    assert(shared_cache_init(&config));
+}
+
+// Waits until nothing is queued or running
+static PrefetchStats settle(NarrationPrefetcher* p) {
+    PrefetchStats stats = prefetch_get_stats(p);
+    for (int waited = 0; waited < 5000; waited += 10) {
+        stats = prefetch_get_stats(p);
+        int done = stats.completed + stats.cancelled + stats.failed;
+        if (done >= stats.issued && llm_async_get_stats().in_flight == 0) {
+            break;
+        }
+        sleep_ms(10);
+    }
+    return prefetch_get_stats(p);
+}
+// }}}
+
+// {{{ test_predict
+TEST(test_predict) {
+    LLMConfig* llm = stub_config();
+    NarrationPrefetcher* p = prefetch_create(llm, NULL);
+    assert(p != NULL);
+    assert(prefetch_create(NULL, NULL) == NULL);
+
+    Game* game = make_game("Alice", "Bob");
+    NarrationEvent events[16];
+    int count = prefetch_predict(p, game, NULL, events, 16);
+
+    // Two hand types, the attack, two affordable buys and the explorer
+    assert(count == 6);
+    assert(events[0].type == GAME_EVENT_CARD_PLAYED);
+    assert(strcmp(events[0].card->type->name, "Scout") == 0);
+    assert(strcmp(events[1].card->type->name, "Viper") == 0);
+    assert(events[2].type == GAME_EVENT_ATTACK_PLAYER);
+    assert(events[2].damage == 2);
+    assert(events[2].target == game->players[1]);
+    assert(events[3].type == GAME_EVENT_CARD_PURCHASED && events[3].cost == 3);
+    assert(events[4].type == GAME_EVENT_CARD_PURCHASED && events[4].cost == 2);
+    assert(strcmp(events[5].card->type->name, "Explorer") == 0);
+    assert(events[2].intensity == INTENSITY_LOW);
+
+    // Truncated to max, and nothing to predict outside the main phase
+    assert(prefetch_predict(p, game, NULL, events, 3) == 3);
+    game->phase = PHASE_END;
+    assert(prefetch_predict(p, game, NULL, events, 16) == 0);
+
+    game_free(game);
+    prefetch_free(p);
+    llm_config_free(llm);
+}
+// }}}
+
+// {{{ test_prefetch_serves_action
+TEST(test_prefetch_serves_action) {
+    start_cache();
+    stub_reset();
+    LLMConfig* llm = stub_config();
+    NarrationPrefetcher* p = prefetch_create(llm, NULL);
+
+    // Without the shared cache nothing is issued
+    shared_cache_cleanup();
+    Game* game = make_game("Alice", "Bob");
+    assert(prefetch_begin(p, game, NULL) == 0);
+    start_cache();
+
+    assert(prefetch_begin(p, game, NULL) == 6);
+    PrefetchStats stats = settle(p);
+    assert(stats.issued == 6);
+    assert(stats.completed == 6);
+    assert(stats.tokens_used == 72);
+    assert(stub_max_active() <= 2);
+
+    // Another game, another player: Carol's scout play is already narrated
+    Game* other = make_game("Carol", "Dave");
+    NarrationEvent events[16];
+    prefetch_predict(p, other, NULL, events, 16);
+    char* text = prefetch_on_action(p, &events[0]);
+    assert(text != NULL && strcmp(text, "Carol presses on.") == 0);
+    free(text);
+
+    // A second scout play is served, but only the first counts as a hit
+    text = prefetch_on_action(p, &events[0]);
+    assert(text != NULL);
+    free(text);
+
+    stats = prefetch_get_stats(p);
+    assert(stats.actions == 2);
+    assert(stats.hits == 1);
+    assert(stats.accuracy > 0.16f && stats.accuracy < 0.17f);
+    assert(stats.hit_rate == 0.5f);
+    assert(stats.capacity_share > 0.0f && stats.capacity_share <= 1.0f);
+
+    // Everything predicted is cached now; a new window has nothing to do
+    stub_reset();
+    assert(prefetch_begin(p, other, NULL) == 0);
+    assert(prefetch_get_stats(p).already_cached == 6);
+    assert(stub_hits() == 0);
+
+    game_free(game);
+    game_free(other);
+    prefetch_free(p);
+    llm_config_free(llm);
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_cancel_on_action
+TEST(test_cancel_on_action) {
+    start_cache();
+    stub_reset();
+    LLMConfig* llm = stub_config();
+    NarrationPrefetcher* p = prefetch_create(llm, NULL);
+    Game* game = make_game("Alice", "Bob");
+
+    assert(prefetch_begin(p, game, NULL) == 6);
+    NarrationEvent events[16];
+    prefetch_predict(p, game, NULL, events, 16);
+    char* text = prefetch_on_action(p, &events[5]);
+    assert(text == NULL);
+
+    PrefetchStats stats = settle(p);
+    assert(stats.issued == 2);
+    assert(stats.cancelled >= 4);
+    assert(stats.hits == 0);
+    assert(stub_hits() <= 2);
+
+    // Freeing with requests in flight waits for their callbacks
+    assert(prefetch_begin(p, game, NULL) > 0);
+    prefetch_free(p);
+
+    game_free(game);
+    llm_config_free(llm);
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_budgets
+TEST(test_budgets) {
+    start_cache();
+    LLMConfig* llm = stub_config();
+    Game* game = make_game("Alice", "Bob");
+
+    // Window budget
+    PrefetchConfig window = { 4, 3, 0 };
+    NarrationPrefetcher* p = prefetch_create(llm, &window);
+    assert(prefetch_begin(p, game, NULL) == 3);
+    PrefetchStats stats = settle(p);
+    assert(stats.issued == 3 && stats.completed == 3);
+    prefetch_free(p);
+    shared_cache_cleanup();
+
+    // Token budget: the first answer spends it and the rest is dropped
+    start_cache();
+    PrefetchConfig tokens = { 1, 6, 12 };
+    p = prefetch_create(llm, &tokens);
+    assert(prefetch_begin(p, game, NULL) == 6);
+    stats = settle(p);
+    assert(stats.issued == 1);
+    assert(stats.completed == 1);
+    assert(stats.cancelled == 5);
+    assert(prefetch_begin(p, game, NULL) == 0);
+    prefetch_free(p);
+
+    game_free(game);
+    llm_config_free(llm);
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_scheduled
+TEST(test_scheduled) {
+    start_cache();
+    stub_reset();
+    LLMSchedulerConfig sched = { 1 };
+    assert(llm_scheduler_init(&sched));
+    LLMConfig* llm = stub_config();
+    PrefetchConfig config = { 3, 6, 0 };
+    NarrationPrefetcher* p = prefetch_create(llm, &config);
+    Game* game = make_game("Alice", "Bob");
+
+    // Speculation waits in the lowest class behind one model slot
+    assert(prefetch_begin(p, game, NULL) == 6);
+    LLMClassStats prefetch = llm_scheduler_get_stats().classes[LLM_CLASS_PREFETCH];
+    assert(prefetch.submitted == 3);
+    assert(prefetch.dispatched == 1);
+    assert(prefetch.queued == 2);
+
+    // Cancelling drops the queued requests, whose callbacks run on this
+    // thread, and the one at the model
+    prefetch_cancel(p);
+    prefetch = llm_scheduler_get_stats().classes[LLM_CLASS_PREFETCH];
+    assert(prefetch.cancelled == 2);
+    PrefetchStats stats = settle(p);
+    assert(stats.issued == 3);
+    assert(stats.cancelled >= 5);
+    assert(stats.completed <= 1);
+
+    // A full window runs through the scheduler to completion
+    assert(prefetch_begin(p, game, NULL) > 0);
+    stats = settle(p);
+    assert(stats.completed >= 5);
+    assert(stub_max_active() <= 1);
+
+    // Freeing with requests queued in the scheduler returns
+    shared_cache_cleanup();
+    start_cache();
+    assert(prefetch_begin(p, game, NULL) == 6);
+    prefetch_free(p);
+
+    game_free(game);
+    llm_config_free(llm);
+    llm_scheduler_cleanup();
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== Narration Prefetch Tests ===\n");
+
+    stub_start();
+    assert(llm_async_init());
+
+    RUN_TEST(test_predict);
+    RUN_TEST(test_prefetch_serves_action);
+    RUN_TEST(test_cancel_on_action);
+    RUN_TEST(test_budgets);
+    RUN_TEST(test_scheduled);
+
+    llm_async_cleanup();
+    stub_server_stop(stub);
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
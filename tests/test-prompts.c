@@ -1,15 +1,20 @@
 /*
  * test-prompts.c - Tests for Prompt Network Structure
  *
- * Validates prompt templates, variable interpolation, and chain creation.
- * Run with: gcc -o test-prompts test-prompts.c ../src/llm/02-prompts.c && ./test-prompts
+ * Validates prompt templates, variable interpolation, chain creation and
+ * compiled templates, and benchmarks compiled rendering against the
+ * previous replace-per-occurrence builder.
+ * Run with: gcc -o test-prompts test-prompts.c ../src/llm/02-prompts.c -lpthread && ./test-prompts
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "../src/llm/02-prompts.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #define TEST(name) static void name(void)
 #define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
@@ -248,6 +253,201 @@ TEST(test_world_state_prompt) {
 }
 // }}}
 
+// {{{ test_compile_segments
+TEST(test_compile_segments) {
+    static const char* names[] = { "who", "what" };
+    CompiledPrompt* compiled = prompt_compile("{who} draws {what}, {who} {smiles}.",
+                                              names, 2);
+    assert(compiled != NULL);
+
+    // who, " draws ", what, ", ", who, " {smiles}."
+    assert(compiled->segment_count == 6);
+    assert(compiled->segments[0].var == 0);
+    assert(compiled->segments[2].var == 1);
+    assert(compiled->segments[4].var == 0);
+    assert(compiled->segments[5].var == -1);
+    assert(compiled->literal_length == strlen(" draws ") + strlen(", ") +
+                                       strlen(" {smiles}."));
+
+    PromptBuffer buffer;
+    prompt_buffer_init(&buffer);
+    const char* values[] = { "Aldric", "a blade" };
+    const char* out = prompt_render(compiled, values, &buffer);
+    assert(out != NULL);
+    assert(strcmp(out, "Aldric draws a blade, Aldric {smiles}.") == 0);
+    assert(buffer.length == strlen(out));
+
+    // Missing values fail; unterminated braces are literal
+    const char* partial[] = { "Aldric", NULL };
+    assert(prompt_render(compiled, partial, &buffer) == NULL);
+    prompt_compiled_free(compiled);
+
+    compiled = prompt_compile("{what} costs {2", names, 2);
+    out = prompt_render(compiled, values, &buffer);
+    assert(strcmp(out, "a blade costs {2") == 0);
+
+    prompt_compiled_free(compiled);
+    prompt_buffer_free(&buffer);
+    assert(prompt_compile(NULL, names, 2) == NULL);
+}
+// }}}
+
+// {{{ test_render_reuses_buffer
+TEST(test_render_reuses_buffer) {
+    const CompiledPrompt* compiled = prompt_get_compiled(PROMPT_ATTACK);
+    assert(compiled != NULL);
+    assert(compiled == prompt_get_compiled(PROMPT_ATTACK));
+    assert(prompt_get_compiled(PROMPT_COUNT) == NULL);
+
+    PromptBuffer buffer;
+    prompt_buffer_init(&buffer);
+    const char* first[] = { "Aldric", "Belinda", "5", "45" };
+    const char* out = prompt_render(compiled, first, &buffer);
+    assert(strcmp(out, "Aldric strikes at Belinda for 5 damage! "
+                       "Belinda now has 45 authority remaining.") == 0);
+    char* data = buffer.data;
+
+    // A shorter render fits the buffer already allocated
+    const char* second[] = { "Al", "Bo", "1", "9" };
+    out = prompt_render(compiled, second, &buffer);
+    assert(out == data);
+    assert(strcmp(out, "Al strikes at Bo for 1 damage! Bo now has 9 authority remaining.") == 0);
+
+    prompt_buffer_free(&buffer);
+}
+// }}}
+
+// {{{ test_values_not_expanded
+TEST(test_values_not_expanded) {
+    // A player named after a placeholder is printed as-is
+    PromptVars* vars = prompt_vars_create();
+    prompt_vars_add(vars, "attacker", "{defender}");
+    prompt_vars_add(vars, "defender", "Belinda");
+    prompt_vars_add(vars, "damage", "{damage}");
+    prompt_vars_add(vars, "remaining_authority", "45");
+
+    PromptBuffer buffer;
+    prompt_buffer_init(&buffer);
+    const char* out = prompt_build_into(PROMPT_ATTACK, vars, &buffer);
+    assert(out != NULL);
+    assert(strncmp(out, "{defender} strikes at Belinda for {damage} damage!", 50) == 0);
+
+    prompt_buffer_free(&buffer);
+    prompt_vars_free(vars);
+}
+// }}}
+
+// {{{ Previous builder (benchmark reference)
+// The builder prompt_build used before templates were compiled: one
+// strstr and full-string copy per occurrence, recursing per variable.
+static char* legacy_replace_var(const char* text, const char* name, const char* value) {
+    size_t placeholder_len = strlen(name) + 2;
+    char* placeholder = malloc(placeholder_len + 1);
+    snprintf(placeholder, placeholder_len + 1, "{%s}", name);
+
+    const char* pos = strstr(text, placeholder);
+    if (pos == NULL) {
+        free(placeholder);
+        return strdup(text);
+    }
+
+    size_t text_len = strlen(text);
+    size_t value_len = strlen(value);
+    char* result = malloc(text_len - placeholder_len + value_len + 1);
+    size_t before_len = pos - text;
+    memcpy(result, text, before_len);
+    memcpy(result + before_len, value, value_len);
+    strcpy(result + before_len + value_len, pos + placeholder_len);
+    free(placeholder);
+
+    char* temp = legacy_replace_var(result, name, value);
+    free(result);
+    return temp;
+}
+
+static char* legacy_build(const char* template_text, const char** names,
+                          const char** values, int count) {
+    char* result = strdup(template_text);
+    for (int i = 0; i < count; i++) {
+        char* temp = legacy_replace_var(result, names[i], values[i]);
+        free(result);
+        result = temp;
+    }
+    return result;
+}
+
+static double elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+// }}}
+
+// {{{ test_benchmark_large_prompt
+TEST(test_benchmark_large_prompt) {
+    // A world-state prompt covering a long game: one section per turn,
+    // each naming both players, with long descriptive values
+    enum { TURNS = 300, ROUNDS = 5 };
+    static const char* names[] = {
+        "turn", "player1_name", "player1_authority",
+        "player2_name", "player2_authority", "phase"
+    };
+    static const char* SECTION =
+        "Turn {turn} of the battle for Symbeline. "
+        "{player1_name} commands {player1_authority} authority. "
+        "{player2_name} commands {player2_authority} authority. "
+        "The current phase is {phase}.\n";
+
+    size_t section_len = strlen(SECTION);
+    char* template_text = malloc(section_len * TURNS + 1);
+    for (int i = 0; i < TURNS; i++) {
+        memcpy(template_text + i * section_len, SECTION, section_len);
+    }
+    template_text[section_len * TURNS] = '\0';
+
+    const char* values[] = {
+        "the long night",
+        "Aldric of the Merchant Guilds, Warden of the Southern Docks",
+        "forty-two",
+        "Belinda of the High Elves, Keeper of the Thornwood Gate",
+        "thirty-eight",
+        "the main phase, with the trade row freshly dealt"
+    };
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char* legacy = NULL;
+    for (int r = 0; r < ROUNDS; r++) {
+        free(legacy);
+        legacy = legacy_build(template_text, names, values, 6);
+    }
+    double legacy_ms = elapsed_ms(&start) / ROUNDS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CompiledPrompt* compiled = prompt_compile(template_text, names, 6);
+    double compile_ms = elapsed_ms(&start);
+
+    PromptBuffer buffer;
+    prompt_buffer_init(&buffer);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const char* out = NULL;
+    for (int r = 0; r < ROUNDS; r++) {
+        out = prompt_render(compiled, values, &buffer);
+    }
+    double render_ms = elapsed_ms(&start) / ROUNDS;
+
+    assert(out != NULL && strcmp(out, legacy) == 0);
+    printf("\n  %zu-byte prompt: previous builder %.3f ms, compile %.3f ms, "
+           "render %.3f ms ", strlen(out), legacy_ms, compile_ms, render_ms);
+
+    free(legacy);
+    free(template_text);
+    prompt_compiled_free(compiled);
+    prompt_buffer_free(&buffer);
+}
+// }}}
+
 // {{{ main
 int main(void) {
     printf("=== Prompt Network Structure Tests ===\n");
@@ -267,6 +467,10 @@ int main(void) {
     RUN_TEST(test_vars_free_null);
     RUN_TEST(test_chain_free_null);
     RUN_TEST(test_world_state_prompt);
+    RUN_TEST(test_compile_segments);
+    RUN_TEST(test_render_reuses_buffer);
+    RUN_TEST(test_values_not_expanded);
+    RUN_TEST(test_benchmark_large_prompt);
 
     printf("\nAll tests passed!\n");
     return 0;
@@ -294,6 +294,27 @@ static void test_server_messages(void) {
          strcmp(text->valuestring, "The dire bear charges!") == 0);
     message_free(msg);
 
+    /* Test streamed narrative chunk */
+    msg = protocol_create_narrative_chunk(7, 2, " roars", false);
+    TEST("Narrative chunk created", msg != NULL);
+    TEST("Narrative chunk type correct", msg && msg->type == MSG_NARRATIVE);
+    cJSON* stream_id = msg ? cJSON_GetObjectItem(msg->payload, "stream_id") : NULL;
+    cJSON* seq = msg ? cJSON_GetObjectItem(msg->payload, "seq") : NULL;
+    cJSON* final = msg ? cJSON_GetObjectItem(msg->payload, "final") : NULL;
+    text = msg ? cJSON_GetObjectItem(msg->payload, "text") : NULL;
+    TEST("Narrative chunk stream_id", stream_id && stream_id->valueint == 7);
+    TEST("Narrative chunk seq", seq && seq->valueint == 2);
+    TEST("Narrative chunk not final", final && cJSON_IsFalse(final));
+    TEST("Narrative chunk text", text && strcmp(text->valuestring, " roars") == 0);
+    message_free(msg);
+
+    msg = protocol_create_narrative_chunk(7, 3, NULL, true);
+    final = msg ? cJSON_GetObjectItem(msg->payload, "final") : NULL;
+    text = msg ? cJSON_GetObjectItem(msg->payload, "text") : NULL;
+    TEST("Final chunk marked final", final && cJSON_IsTrue(final));
+    TEST("Final chunk text empty", text && strcmp(text->valuestring, "") == 0);
+    message_free(msg);
+
     /* Test error message */
     msg = protocol_create_error(PROTOCOL_ERROR_NOT_YOUR_TURN, "Wait for Alice");
     TEST("Error created", msg != NULL);
@@ -357,6 +378,20 @@ static void test_server_messages(void) {
     cJSON* reason = msg ? cJSON_GetObjectItem(msg->payload, "reason") : NULL;
     TEST("Reason present", reason && strstr(reason->valuestring, "authority") != NULL);
     message_free(msg);
+
+    /* Test image progress */
+    msg = protocol_create_image_progress("card_dire_bear", 40);
+    TEST("Image progress created", msg != NULL);
+    TEST("Image progress type", msg && msg->type == MSG_IMAGE_PROGRESS);
+    cJSON* image_id = msg ? cJSON_GetObjectItem(msg->payload, "image_id") : NULL;
+    TEST("Image ID present", image_id && strcmp(image_id->valuestring, "card_dire_bear") == 0);
+    cJSON* percent = msg ? cJSON_GetObjectItem(msg->payload, "percent") : NULL;
+    TEST("Percent present", percent && percent->valueint == 40);
+    message_free(msg);
+    msg = protocol_create_image_progress("card_dire_bear", 140);
+    percent = msg ? cJSON_GetObjectItem(msg->payload, "percent") : NULL;
+    TEST("Percent clamped", percent && percent->valueint == 100);
+    message_free(msg);
 }
 /* }}} */
 
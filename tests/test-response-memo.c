@@ -0,0 +1,428 @@
+/*
+ * test-response-memo.c - Tests for Exact-Prompt Response Memoization
+ *
+ * Checks which requests get a key, that an exact deterministic repeat
+ * is answered without reaching the model, also when it goes through
+ * the scheduler and async client, that sampled requests and
+ * failures pass through, that the memo stays within its entry and byte
+ * budgets, and that a snapshot restores replies in recency order.
+ * Uses the local stub server.
+ * Run with: gcc -o test-response-memo test-response-memo.c
+ *           ../src/llm/21-response-memo.c ../src/llm/01-api-client.c
+ *           ../src/llm/19-endpoint-pool.c ../src/llm/20-circuit-breaker.c
+ *           ../src/llm/10-async-client.c ../src/llm/16-scheduler.c
+ *           ../src/llm/22-token-usage.c ../src/tools/stub-server.c
+ *           ../src/net/09-http-pool.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-response-memo
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/21-response-memo.h"
+#include "../src/llm/16-scheduler.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+#define SNAPSHOT_PATH "/tmp/test-response-memo.snapshot"
+
+// {{{ start_stub
+static StubServer* start_stub(double failure_rate) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 0;
+    stub.tokens_per_second = 0;
+    stub.failure_rate = failure_rate;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    return server;
+}
+// }}}
+
+// {{{ config_for
+static LLMConfig* config_for(StubServer* server, float temperature) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(server));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->temperature = temperature;
+    config->max_retries = 0;
+    return config;
+}
+// }}}
+
+// {{{ key_for
+static LLMMemoKey key_for(const char* prompt) {
+    LLMConfig* config = llm_config_create();
+    config->temperature = 0.0f;
+    LLMMessage message = { .role = "user", .content = (char*)prompt };
+    LLMMemoKey key;
+    assert(llm_memo_key(config, &message, 1, &key));
+    llm_config_free(config);
+    return key;
+}
+// }}}
+
+// {{{ put_text
+static void put_text(const char* prompt, const char* text, int tokens) {
+    LLMMemoKey key = key_for(prompt);
+    LLMResponse response = { .text = (char*)text, .success = true,
+                             .http_status = 200, .tokens_used = tokens };
+    llm_memo_put(&key, &response);
+}
+// }}}
+
+// {{{ has_text
+static bool has_text(const char* prompt, const char* text) {
+    LLMMemoKey key = key_for(prompt);
+    LLMResponse* response = llm_memo_get(&key);
+    bool found = response != NULL && strcmp(response->text, text) == 0;
+    llm_response_free(response);
+    return found;
+}
+// }}}
+
+// {{{ test_key
+TEST(test_key) {
+    LLMConfig* config = llm_config_create();
+    LLMMessage messages[2] = {
+        { .role = "system", .content = "You narrate." },
+        { .role = "user", .content = "Describe the Wild." }
+    };
+    LLMMemoKey a, b;
+
+    // Nothing is keyed before init
+    config->temperature = 0.0f;
+    assert(!llm_memo_key(config, messages, 2, &a));
+    assert(llm_memo_init(NULL));
+    assert(llm_memo_is_ready());
+    assert(!llm_memo_init(NULL));
+
+    // Same request, same key
+    assert(llm_memo_key(config, messages, 2, &a));
+    assert(llm_memo_key(config, messages, 2, &b));
+    assert(a.hi == b.hi && a.lo == b.lo);
+
+    // Any change to model, role or content changes it
+    messages[1].content = "Describe the Wild!";
+    assert(llm_memo_key(config, messages, 2, &b));
+    assert(a.hi != b.hi && a.lo != b.lo);
+    messages[1].content = "Describe the Wild.";
+    messages[0].role = "user";
+    assert(llm_memo_key(config, messages, 2, &b));
+    assert(a.hi != b.hi);
+    messages[0].role = "system";
+    free(config->model);
+    config->model = strdup("another-model");
+    assert(llm_memo_key(config, messages, 2, &b));
+    assert(a.hi != b.hi);
+    assert(llm_memo_key(config, messages, 1, &b));
+    assert(a.hi != b.hi);
+
+    // Sampled requests, and the server default, are passed through
+    config->temperature = 0.7f;
+    assert(!llm_memo_key(config, messages, 2, &b));
+    config->temperature = -1.0f;
+    assert(!llm_memo_key(config, messages, 2, &b));
+    assert(llm_memo_get_stats().bypassed == 2);
+
+    // ...unless the caller opts in; the temperature is part of the key
+    config->memoize_sampled = true;
+    config->temperature = 0.7f;
+    assert(llm_memo_key(config, messages, 2, &a));
+    config->temperature = 0.9f;
+    assert(llm_memo_key(config, messages, 2, &b));
+    assert(a.hi != b.hi);
+
+    assert(!llm_memo_key(NULL, messages, 2, &a));
+    assert(!llm_memo_key(config, messages, 0, &a));
+    assert(llm_memo_get(NULL) == NULL);
+    llm_memo_put(NULL, NULL);
+
+    llm_memo_cleanup();
+    assert(!llm_memo_is_ready());
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_repeat_skips_model
+TEST(test_repeat_skips_model) {
+    StubServer* server = start_stub(0.0);
+    LLMConfig* config = config_for(server, 0.0f);
+    assert(llm_memo_init(NULL));
+
+    LLMResponse* first = llm_request(config, "You narrate.", "Describe the Wild.");
+    assert(first != NULL && first->success);
+    assert(first->tokens_used > 0);
+    LLMResponse* second = llm_request(config, "You narrate.", "Describe the Wild.");
+    assert(second != NULL && second->success);
+    assert(strcmp(first->text, second->text) == 0);
+    assert(second->tokens_used == 0);
+    assert(stub_server_get_stats(server).requests == 1);
+
+    LLMMemoStats stats = llm_memo_get_stats();
+    assert(stats.entries == 1);
+    assert(stats.lookups == 2);
+    assert(stats.hits == 1);
+    assert(stats.misses == 1);
+    assert(stats.stored == 1);
+    assert(stats.tokens_saved == first->tokens_used);
+    assert(stats.hit_rate > 0.49f && stats.hit_rate < 0.51f);
+
+    // A different prompt still goes to the model
+    LLMResponse* other = llm_request(config, "You narrate.", "Describe the Kingdom.");
+    assert(other != NULL && other->success);
+    assert(stub_server_get_stats(server).requests == 2);
+
+    llm_response_free(first);
+    llm_response_free(second);
+    llm_response_free(other);
+    llm_memo_cleanup();
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_scheduled_repeat
+TEST(test_scheduled_repeat) {
+    StubServer* server = start_stub(0.0);
+    LLMConfig* config = config_for(server, 0.0f);
+    assert(llm_memo_init(NULL));
+    assert(llm_async_init());
+    assert(llm_scheduler_init(NULL));
+
+    // Trade selection and recovery are queued through the scheduler,
+    // which sends them with llm_request_async
+    LLMScheduleOptions options = { .request_class = LLM_CLASS_TRADE_SELECT,
+                                   .turn = -1 };
+    LLMResponse* first = llm_schedule_request(config, "You choose cards.",
+                                              "Pick three.", &options);
+    assert(first != NULL && first->success && first->tokens_used > 0);
+    LLMResponse* second = llm_schedule_request(config, "You choose cards.",
+                                               "Pick three.", &options);
+    assert(second != NULL && second->success);
+    assert(strcmp(first->text, second->text) == 0);
+    assert(second->tokens_used == 0);
+    assert(stub_server_get_stats(server).requests == 1);
+
+    LLMMemoStats stats = llm_memo_get_stats();
+    assert(stats.hits == 1);
+    assert(stats.stored == 1);
+    assert(llm_async_get_stats().completed == 2);
+
+    // Sampled requests still reach the model each time
+    config->temperature = 0.7f;
+    LLMResponse* sampled = llm_schedule_request(config, "You choose cards.",
+                                                "Pick three.", &options);
+    assert(sampled != NULL && sampled->success);
+    assert(stub_server_get_stats(server).requests == 2);
+
+    llm_response_free(first);
+    llm_response_free(second);
+    llm_response_free(sampled);
+    llm_scheduler_cleanup();
+    llm_async_cleanup();
+    llm_memo_cleanup();
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_sampled_passes_through
+TEST(test_sampled_passes_through) {
+    StubServer* server = start_stub(0.0);
+    LLMConfig* config = config_for(server, -1.0f);
+    assert(llm_memo_init(NULL));
+
+    for (int i = 0; i < 2; i++) {
+        LLMResponse* response = llm_request(config, "You narrate.", "Describe the Wild.");
+        assert(response != NULL && response->success);
+        llm_response_free(response);
+    }
+    config->temperature = 0.8f;
+    for (int i = 0; i < 2; i++) {
+        LLMResponse* response = llm_request(config, "You narrate.", "Describe the Wild.");
+        assert(response != NULL && response->success);
+        llm_response_free(response);
+    }
+    assert(stub_server_get_stats(server).requests == 4);
+    LLMMemoStats stats = llm_memo_get_stats();
+    assert(stats.bypassed == 4);
+    assert(stats.entries == 0);
+
+    // Opting in memoizes even a sampled config
+    config->memoize_sampled = true;
+    for (int i = 0; i < 2; i++) {
+        LLMResponse* response = llm_request(config, "You narrate.", "Describe the Wild.");
+        assert(response != NULL && response->success);
+        llm_response_free(response);
+    }
+    assert(stub_server_get_stats(server).requests == 5);
+
+    llm_memo_cleanup();
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_failures_not_stored
+TEST(test_failures_not_stored) {
+    StubServer* server = start_stub(1.0);
+    LLMConfig* config = config_for(server, 0.0f);
+    assert(llm_memo_init(NULL));
+
+    for (int i = 0; i < 2; i++) {
+        LLMResponse* response = llm_request(config, "You narrate.", "Describe the Wild.");
+        assert(response != NULL && !response->success);
+        llm_response_free(response);
+    }
+    assert(stub_server_get_stats(server).requests == 2);
+    LLMMemoStats stats = llm_memo_get_stats();
+    assert(stats.entries == 0);
+    assert(stats.stored == 0);
+    assert(stats.misses == 2);
+
+    llm_memo_cleanup();
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_entry_limit
+TEST(test_entry_limit) {
+    LLMMemoConfig options = { .max_entries = 2 };
+    assert(llm_memo_init(&options));
+
+    put_text("a", "alpha", 10);
+    put_text("b", "beta", 10);
+    assert(has_text("a", "alpha"));   // "b" is now the least recent
+    put_text("c", "gamma", 10);
+
+    assert(has_text("a", "alpha"));
+    assert(!has_text("b", "beta"));
+    assert(has_text("c", "gamma"));
+    LLMMemoStats stats = llm_memo_get_stats();
+    assert(stats.entries == 2);
+    assert(stats.evictions == 1);
+
+    // Storing a key again replaces its reply
+    put_text("a", "alef", 10);
+    assert(has_text("a", "alef"));
+    assert(llm_memo_get_stats().entries == 2);
+
+    llm_memo_clear();
+    stats = llm_memo_get_stats();
+    assert(stats.entries == 0);
+    assert(stats.bytes == 0);
+    assert(stats.stored == 4);
+    llm_memo_reset_stats();
+    assert(llm_memo_get_stats().stored == 0);
+
+    llm_memo_cleanup();
+}
+// }}}
+
+// {{{ test_byte_limit
+TEST(test_byte_limit) {
+    char text[200];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    LLMMemoConfig options = { .max_bytes = 3 * (sizeof(text) + 64) };
+    assert(llm_memo_init(&options));
+
+    char prompt[16];
+    for (int i = 0; i < 10; i++) {
+        snprintf(prompt, sizeof(prompt), "p%d", i);
+        put_text(prompt, text, 1);
+        assert(llm_memo_get_stats().bytes <= options.max_bytes);
+    }
+    LLMMemoStats stats = llm_memo_get_stats();
+    assert(stats.entries >= 1 && stats.entries < 10);
+    assert(stats.evictions == 10 - stats.entries);
+    assert(has_text("p9", text));
+    assert(!has_text("p0", text));
+
+    // A reply larger than the whole budget is not kept
+    char* huge = malloc(options.max_bytes + 1);
+    memset(huge, 'y', options.max_bytes);
+    huge[options.max_bytes] = '\0';
+    put_text("huge", huge, 1);
+    assert(!has_text("huge", huge));
+    free(huge);
+
+    llm_memo_cleanup();
+}
+// }}}
+
+// {{{ test_snapshot
+TEST(test_snapshot) {
+    remove(SNAPSHOT_PATH);
+    LLMMemoConfig options = { .max_entries = 3, .path = SNAPSHOT_PATH };
+    assert(llm_memo_init(&options));
+    assert(llm_memo_get_stats().loaded == 0);
+
+    put_text("a", "alpha", 11);
+    put_text("b", "line one\nline two", 12);
+    put_text("c", "", 13);
+    assert(has_text("a", "alpha"));   // Recency now b, c, a
+    llm_memo_cleanup();               // Writes the snapshot
+
+    assert(llm_memo_init(&options));
+    LLMMemoStats stats = llm_memo_get_stats();
+    assert(stats.loaded == 3);
+    assert(stats.entries == 3);
+
+    // The least recent reply before the restart is evicted first
+    put_text("d", "delta", 14);
+    assert(!has_text("b", "line one\nline two"));
+    assert(has_text("c", ""));
+    assert(has_text("a", "alpha"));
+    assert(has_text("d", "delta"));
+    assert(llm_memo_get_stats().tokens_saved == 13 + 11 + 14);
+    assert(llm_memo_save());
+    llm_memo_cleanup();
+
+    // A damaged tail keeps the records before it
+    FILE* f = fopen(SNAPSHOT_PATH, "ab");
+    assert(f != NULL);
+    fputs("0000 nonsense\n", f);
+    fclose(f);
+    assert(llm_memo_init(&options));
+    assert(llm_memo_get_stats().loaded == 3);
+    llm_memo_clear();
+    llm_memo_cleanup();
+
+    // An in-memory memo has nothing to save
+    assert(llm_memo_init(NULL));
+    assert(!llm_memo_save());
+    llm_memo_cleanup();
+    remove(SNAPSHOT_PATH);
+}
+// }}}
+
+int main(void) {
+    printf("=== Response Memo Tests ===\n");
+
+    assert(llm_init());
+
+    RUN_TEST(test_key);
+    RUN_TEST(test_repeat_skips_model);
+    RUN_TEST(test_scheduled_repeat);
+    RUN_TEST(test_sampled_passes_through);
+    RUN_TEST(test_failures_not_stored);
+    RUN_TEST(test_entry_limit);
+    RUN_TEST(test_byte_limit);
+    RUN_TEST(test_snapshot);
+
+    llm_cleanup();
+
+    printf("\nAll response memo tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,396 @@
+/*
+ * test-scheduler.c - Tests for the LLM Request Scheduler
+ *
+ * Validates class priority, round-robin between sessions, the global
+ * in-flight limit, deadline expiry, superseding by turn, cancellation
+ * and the blocking request path. A scripted stub-server instance
+ * records the order in which requests reach the model.
+ * Run with: gcc -o test-scheduler test-scheduler.c ../src/llm/16-scheduler.c
+ *           ../src/llm/22-token-usage.c ../src/llm/10-async-client.c
+ *           ../src/llm/01-api-client.c ../src/llm/19-endpoint-pool.c
+ *           ../src/llm/20-circuit-breaker.c ../src/llm/21-response-memo.c
+ *           ../src/net/09-http-pool.c ../src/tools/stub-server.c
+ *           ../libs/cJSON.c -lcurl -lm -lpthread && ./test-scheduler
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/16-scheduler.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+#define STUB_DELAY_MS 60
+#define MAX_ARRIVALS 32
+
+// {{{ Stub responder
+// Answers every request after STUB_DELAY_MS and records the marker
+// ("REQ-<name>") of each request in order of arrival.
+static StubServer* stub = NULL;
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static char arrivals[MAX_ARRIVALS][16];
+static int arrival_count = 0;
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)context;
+    pthread_mutex_lock(&stub_lock);
+    const char* marker = strstr(body, "REQ-");
+    if (marker != NULL && arrival_count < MAX_ARRIVALS) {
+        sscanf(marker + 4, "%15[A-Za-z0-9]", arrivals[arrival_count++]);
+    }
+    pthread_mutex_unlock(&stub_lock);
+
+    free(reply->text);
+    reply->text = strdup("The realm turns.");
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 5;
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.latency.base_ms = STUB_DELAY_MS;
+    config.tokens_per_second = 0;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+
+static void stub_reset(void) {
+    pthread_mutex_lock(&stub_lock);
+    arrival_count = 0;
+    pthread_mutex_unlock(&stub_lock);
+    stub_server_reset_stats(stub);
+}
+
+static LLMConfig* stub_config(void) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->timeout_ms = 5000;
+    config->max_retries = 0;
+    return config;
+}
+// }}}
+
+// {{{ Completion tracking
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int done_count = 0;
+
+typedef struct {
+    bool done;
+    bool success;
+    char error[64];
+} Outcome;
+
+static void on_done(LLMResponse* response, void* user) {
+    Outcome* outcome = user;
+    pthread_mutex_lock(&done_lock);
+    outcome->done = true;
+    outcome->success = response->success;
+    snprintf(outcome->error, sizeof(outcome->error), "%s",
+             response->error != NULL ? response->error : "");
+    done_count++;
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&done_lock);
+    llm_response_free(response);
+}
+
+static void wait_done(int count) {
+    pthread_mutex_lock(&done_lock);
+    while (done_count < count) {
+        pthread_cond_wait(&done_cond, &done_lock);
+    }
+    pthread_mutex_unlock(&done_lock);
+}
+
+static void reset_done(void) {
+    pthread_mutex_lock(&done_lock);
+    done_count = 0;
+    pthread_mutex_unlock(&done_lock);
+}
+
+static LLMRequestHandle submit(LLMConfig* config, const char* name,
+                               LLMRequestClass request_class, const void* session,
+                               int turn, int deadline_ms, Outcome* outcome) {
+    char user[64];
+    snprintf(user, sizeof(user), "Narrate REQ-%s now.", name);
+    LLMMessage messages[2] = {
+        { "system", "You narrate." },
+        { "user", user }
+    };
+    LLMScheduleOptions options = { request_class, session, turn, deadline_ms };
+    return llm_schedule(config, messages, 2, &options, on_done, outcome);
+}
+
+static int arrival_index(const char* name) {
+    pthread_mutex_lock(&stub_lock);
+    int index = -1;
+    for (int i = 0; i < arrival_count; i++) {
+        if (strcmp(arrivals[i], name) == 0) {
+            index = i;
+        }
+    }
+    pthread_mutex_unlock(&stub_lock);
+    return index;
+}
+
+static void start(int max_in_flight) {
+    LLMSchedulerConfig config = { max_in_flight };
+    assert(llm_scheduler_init(&config));
+    stub_reset();
+    reset_done();
+}
+// }}}
+
+// {{{ test_priority_order
+TEST(test_priority_order) {
+    LLMConfig* config = stub_config();
+    start(1);
+
+    Outcome o[5] = {0};
+    int session = 0;
+    assert(submit(config, "blocker", LLM_CLASS_SUMMARY, &session, -1, 0, &o[0]));
+    assert(submit(config, "prefetch", LLM_CLASS_PREFETCH, &session, -1, 0, &o[1]));
+    assert(submit(config, "summary", LLM_CLASS_SUMMARY, &session, -1, 0, &o[2]));
+    assert(submit(config, "trade", LLM_CLASS_TRADE_SELECT, &session, -1, 0, &o[3]));
+    assert(submit(config, "narration", LLM_CLASS_NARRATION, &session, -1, 0, &o[4]));
+    wait_done(5);
+
+    assert(arrival_index("blocker") == 0);
+    assert(arrival_index("narration") == 1);
+    assert(arrival_index("trade") == 2);
+    assert(arrival_index("summary") == 3);
+    assert(arrival_index("prefetch") == 4);
+    for (int i = 0; i < 5; i++) {
+        assert(o[i].success);
+    }
+
+    LLMSchedulerStats stats = llm_scheduler_get_stats();
+    assert(stats.classes[LLM_CLASS_PREFETCH].dispatched == 1);
+    assert(stats.classes[LLM_CLASS_PREFETCH].max_wait_ms >= STUB_DELAY_MS * 3);
+    assert(stats.classes[LLM_CLASS_NARRATION].avg_wait_ms <
+           stats.classes[LLM_CLASS_PREFETCH].avg_wait_ms);
+    assert(stats.classes[LLM_CLASS_SUMMARY].completed == 2);
+
+    llm_scheduler_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_sessions_take_turns
+TEST(test_sessions_take_turns) {
+    LLMConfig* config = stub_config();
+    start(1);
+
+    int game_a = 0;
+    int game_b = 0;
+    Outcome o[6] = {0};
+    assert(submit(config, "blocker", LLM_CLASS_NARRATION, NULL, -1, 0, &o[0]));
+    assert(submit(config, "a1", LLM_CLASS_NARRATION, &game_a, -1, 0, &o[1]));
+    assert(submit(config, "a2", LLM_CLASS_NARRATION, &game_a, -1, 0, &o[2]));
+    assert(submit(config, "a3", LLM_CLASS_NARRATION, &game_a, -1, 0, &o[3]));
+    assert(submit(config, "b1", LLM_CLASS_NARRATION, &game_b, -1, 0, &o[4]));
+    assert(submit(config, "b2", LLM_CLASS_NARRATION, &game_b, -1, 0, &o[5]));
+    wait_done(6);
+
+    // Game A queued three first, yet B is served every other slot
+    assert(arrival_index("a1") == 1);
+    assert(arrival_index("b1") == 2);
+    assert(arrival_index("a2") == 3);
+    assert(arrival_index("b2") == 4);
+    assert(arrival_index("a3") == 5);
+
+    llm_scheduler_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_in_flight_limit
+TEST(test_in_flight_limit) {
+    LLMConfig* config = stub_config();
+    start(2);
+
+    Outcome o[6] = {0};
+    for (int i = 0; i < 6; i++) {
+        char name[8];
+        snprintf(name, sizeof(name), "r%d", i);
+        assert(submit(config, name, LLM_CLASS_NARRATION, NULL, -1, 0, &o[i]));
+    }
+    assert(llm_scheduler_get_stats().in_flight == 2);
+    wait_done(6);
+
+    assert(stub_server_get_stats(stub).peak_active == 2);
+    LLMSchedulerStats stats = llm_scheduler_get_stats();
+    assert(stats.classes[LLM_CLASS_NARRATION].completed == 6);
+    assert(stats.classes[LLM_CLASS_NARRATION].queued == 0);
+
+    llm_scheduler_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_deadline_expires
+TEST(test_deadline_expires) {
+    LLMConfig* config = stub_config();
+    start(1);
+
+    Outcome o[3] = {0};
+    assert(submit(config, "blocker", LLM_CLASS_NARRATION, NULL, -1, 0, &o[0]));
+    assert(submit(config, "late", LLM_CLASS_NARRATION, NULL, -1, STUB_DELAY_MS / 3, &o[1]));
+    assert(submit(config, "patient", LLM_CLASS_NARRATION, NULL, -1, STUB_DELAY_MS * 10, &o[2]));
+    wait_done(3);
+
+    assert(!o[1].success);
+    assert(strcmp(o[1].error, "Request expired") == 0);
+    assert(o[2].success);
+    assert(arrival_index("late") == -1);
+
+    LLMSchedulerStats stats = llm_scheduler_get_stats();
+    assert(stats.classes[LLM_CLASS_NARRATION].expired == 1);
+    assert(stats.classes[LLM_CLASS_NARRATION].dispatched == 2);
+
+    llm_scheduler_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_supersede_by_turn
+TEST(test_supersede_by_turn) {
+    LLMConfig* config = stub_config();
+    start(1);
+
+    int game = 0;
+    int other = 0;
+    Outcome o[5] = {0};
+    assert(submit(config, "blocker", LLM_CLASS_NARRATION, &game, -1, 0, &o[0]));
+    assert(submit(config, "turn3", LLM_CLASS_NARRATION, &game, 3, 0, &o[1]));
+    assert(submit(config, "turn4", LLM_CLASS_NARRATION, &game, 4, 0, &o[2]));
+    assert(submit(config, "unbound", LLM_CLASS_SUMMARY, &game, -1, 0, &o[3]));
+    assert(submit(config, "other3", LLM_CLASS_NARRATION, &other, 3, 0, &o[4]));
+
+    assert(llm_scheduler_supersede(&game, 4) == 1);
+    wait_done(5);
+
+    assert(strcmp(o[1].error, "Request superseded") == 0);
+    assert(o[2].success && o[3].success && o[4].success);
+    assert(arrival_index("turn3") == -1);
+
+    LLMSchedulerStats stats = llm_scheduler_get_stats();
+    assert(stats.classes[LLM_CLASS_NARRATION].superseded == 1);
+
+    llm_scheduler_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_cancel
+TEST(test_cancel) {
+    LLMConfig* config = stub_config();
+    start(1);
+
+    Outcome o[3] = {0};
+    LLMRequestHandle running = submit(config, "running", LLM_CLASS_NARRATION, NULL, -1, 0, &o[0]);
+    LLMRequestHandle queued = submit(config, "queued", LLM_CLASS_NARRATION, NULL, -1, 0, &o[1]);
+    assert(submit(config, "kept", LLM_CLASS_NARRATION, NULL, -1, 0, &o[2]));
+
+    assert(llm_scheduler_cancel(queued));
+    assert(o[1].done);  // Dropped callbacks run before cancel returns
+    assert(strcmp(o[1].error, "Request cancelled") == 0);
+    assert(!llm_scheduler_cancel(queued));
+
+    assert(llm_scheduler_cancel(running));
+    wait_done(3);
+    assert(!o[0].success);
+    assert(o[2].success);
+    assert(llm_scheduler_get_stats().classes[LLM_CLASS_NARRATION].cancelled == 1);
+
+    llm_scheduler_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_blocking_request
+TEST(test_blocking_request) {
+    LLMConfig* config = stub_config();
+
+    // Without the scheduler the request goes straight to the client
+    LLMResponse* direct = llm_schedule_request(config, "You narrate.", "REQ-direct", NULL);
+    assert(direct != NULL && direct->success);
+    llm_response_free(direct);
+
+    start(1);
+    Outcome o = {0};
+    assert(submit(config, "blocker", LLM_CLASS_NARRATION, NULL, -1, 0, &o));
+
+    LLMScheduleOptions options = { LLM_CLASS_TRADE_SELECT, NULL, -1, 0 };
+    LLMResponse* response = llm_schedule_request(config, "You choose.", "REQ-sync", &options);
+    assert(response != NULL && response->success);
+    assert(strcmp(response->text, "The realm turns.") == 0);
+    llm_response_free(response);
+
+    assert(arrival_index("sync") == 1);
+    LLMSchedulerStats stats = llm_scheduler_get_stats();
+    assert(stats.classes[LLM_CLASS_TRADE_SELECT].avg_wait_ms > 0.0f);
+
+    wait_done(1);
+    llm_scheduler_cleanup();
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_cleanup_cancels_queued
+TEST(test_cleanup_cancels_queued) {
+    LLMConfig* config = stub_config();
+    start(1);
+
+    Outcome o[3] = {0};
+    for (int i = 0; i < 3; i++) {
+        assert(submit(config, "drain", LLM_CLASS_SUMMARY, NULL, -1, 0, &o[i]));
+    }
+    llm_scheduler_cleanup();
+
+    // Every callback ran before cleanup returned
+    assert(o[0].done && o[1].done && o[2].done);
+    assert(strcmp(o[2].error, "Request cancelled") == 0);
+    assert(!llm_scheduler_running());
+    assert(submit(config, "late", LLM_CLASS_NARRATION, NULL, -1, 0, &o[0]) ==
+           LLM_REQUEST_INVALID);
+
+    assert(strcmp(llm_request_class_name(LLM_CLASS_RECOVERY), "recovery") == 0);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== LLM Scheduler Tests ===\n");
+
+    stub_start();
+    assert(llm_async_init());
+
+    RUN_TEST(test_priority_order);
+    RUN_TEST(test_sessions_take_turns);
+    RUN_TEST(test_in_flight_limit);
+    RUN_TEST(test_deadline_expires);
+    RUN_TEST(test_supersede_by_turn);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_blocking_request);
+    RUN_TEST(test_cleanup_cancels_queued);
+
+    llm_async_cleanup();
+    stub_server_stop(stub);
+    llm_cleanup();
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
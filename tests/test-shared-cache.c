@@ -0,0 +1,290 @@
+/*
+ * test-shared-cache.c - Tests for the Process-wide Narrative Cache
+ *
+ * Validates shared get/set across threads, warm start from the log,
+ * removal records, compaction, damaged-tail recovery, TTL on replay and
+ * template lookups across players.
+ * Run with: gcc -o test-shared-cache test-shared-cache.c ../src/llm/12-shared-cache.c
+ *           ../src/llm/07-narrative-cache.c ../src/llm/05-event-narration.c
+ *           ../src/llm/04-force-description.c ../src/llm/03-world-state.c
+ *           ../src/llm/02-prompts.c ../src/core/0[1-8]-*.c -lm -lpthread && ./test-shared-cache
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/12-shared-cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+static char log_path[64];
+
+// {{{ Helpers
+static SharedCacheConfig make_config(const char* path) {
+    SharedCacheConfig config = { 1024, 0, 0, path };
+    return config;
+}
+
+static long file_size(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static void expect(const char* signature, const char* narrative) {
+    char* got = shared_cache_get(signature);
+    if (narrative == NULL) {
+        assert(got == NULL);
+    } else {
+        assert(got != NULL && strcmp(got, narrative) == 0);
+    }
+    free(got);
+}
+// }}}
+
+// {{{ test_not_ready
+TEST(test_not_ready) {
+    assert(!shared_cache_is_ready());
+    assert(shared_cache_get("sig") == NULL);
+    assert(!shared_cache_set("sig", "text"));
+    assert(!shared_cache_compact());
+    shared_cache_cleanup();
+
+    SharedCacheConfig bad = { 0, 0, 0, NULL };
+    assert(!shared_cache_init(&bad));
+    assert(!shared_cache_init(NULL));
+}
+// }}}
+
+// {{{ test_memory_only
+TEST(test_memory_only) {
+    SharedCacheConfig config = make_config(NULL);
+    assert(shared_cache_init(&config));
+    assert(!shared_cache_init(&config));
+
+    assert(shared_cache_set("card played:Scout", "The scout slips ahead."));
+    expect("card played:Scout", "The scout slips ahead.");
+    expect("card played:Viper", NULL);
+    assert(shared_cache_remove("card played:Scout"));
+    assert(!shared_cache_remove("card played:Scout"));
+    assert(!shared_cache_compact());
+
+    SharedCacheStats stats = shared_cache_get_stats();
+    assert(stats.cache.hits == 1);
+    assert(stats.cache.misses == 1);
+    assert(stats.log_records == 0);
+
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_warm_start
+TEST(test_warm_start) {
+    remove(log_path);
+    SharedCacheConfig config = make_config(log_path);
+
+    assert(shared_cache_init(&config));
+    assert(shared_cache_set("card played:Scout", "The scout slips ahead."));
+    assert(shared_cache_set("card played:Viper", "A viper strikes\nfrom the dark."));
+    assert(shared_cache_set("card purchased:Explorer", "An explorer signs on."));
+    assert(shared_cache_set("card played:Viper", "The viper coils."));
+    assert(shared_cache_remove("card purchased:Explorer"));
+    assert(shared_cache_get_stats().log_records == 5);
+    shared_cache_cleanup();
+
+    // Restart: live entries come back, dead records are compacted away
+    assert(shared_cache_init(&config));
+    SharedCacheStats stats = shared_cache_get_stats();
+    assert(stats.loaded == 2);
+    assert(stats.log_records == 2);
+    assert(stats.cache.hits == 0 && stats.cache.misses == 0);
+
+    expect("card played:Scout", "The scout slips ahead.");
+    expect("card played:Viper", "The viper coils.");
+    expect("card purchased:Explorer", NULL);
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_compaction
+TEST(test_compaction) {
+    remove(log_path);
+    SharedCacheConfig config = make_config(log_path);
+    assert(shared_cache_init(&config));
+
+    // Rewriting one signature many times triggers automatic compaction
+    char text[64];
+    for (int i = 0; i < 3000; i++) {
+        snprintf(text, sizeof(text), "Narration take %d", i);
+        assert(shared_cache_set("turn start:1", text));
+    }
+
+    SharedCacheStats stats = shared_cache_get_stats();
+    assert(stats.compactions >= 1);
+    assert(stats.log_records < 1100);
+
+    assert(shared_cache_compact());
+    stats = shared_cache_get_stats();
+    assert(stats.log_records == 1);
+    assert(file_size(log_path) < 64);
+    expect("turn start:1", "Narration take 2999");
+
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_damaged_tail
+TEST(test_damaged_tail) {
+    remove(log_path);
+    SharedCacheConfig config = make_config(log_path);
+    assert(shared_cache_init(&config));
+    assert(shared_cache_set("card played:Scout", "The scout slips ahead."));
+    shared_cache_cleanup();
+
+    // Simulate a write cut short by a crash
+    FILE* f = fopen(log_path, "ab");
+    fputs("S 0 20 400\ncard played:Vi", f);
+    fclose(f);
+
+    assert(shared_cache_init(&config));
+    assert(shared_cache_get_stats().loaded == 1);
+    expect("card played:Scout", "The scout slips ahead.");
+    shared_cache_cleanup();
+
+    // The damaged tail was dropped from the file
+    assert(shared_cache_init(&config));
+    assert(shared_cache_get_stats().log_records == 1);
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_ttl_on_replay
+TEST(test_ttl_on_replay) {
+    remove(log_path);
+    time_t now = time(NULL);
+
+    FILE* f = fopen(log_path, "wb");
+    fprintf(f, "S %lld 3 5\noldstale\n", (long long)(now - 7200));
+    fprintf(f, "S %lld 3 5\nnewfresh\n", (long long)(now - 10));
+    fclose(f);
+
+    SharedCacheConfig config = make_config(log_path);
+    config.ttl_seconds = 3600;
+    assert(shared_cache_init(&config));
+    assert(shared_cache_get_stats().loaded == 1);
+    expect("old", NULL);
+    expect("new", "fresh");
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_event_templates
+TEST(test_event_templates) {
+    SharedCacheConfig config = make_config(NULL);
+    assert(shared_cache_init(&config));
+
+    CardType scout_type = { .name = "Scout", .faction = FACTION_NEUTRAL };
+    CardInstance scout = { .type = &scout_type };
+    Player alice = { .name = "Alice" };
+    Player bob = { .name = "Bob" };
+
+    NarrationEvent* event = event_narration_create(GAME_EVENT_CARD_PLAYED);
+    event->actor = &alice;
+    event->card = &scout;
+    assert(shared_cache_get_event(event) == NULL);
+    assert(shared_cache_set_event(event, "Alice sends a scout ahead."));
+
+    // Another session, another player: served from the same entry
+    event->actor = &bob;
+    char* text = shared_cache_get_event(event);
+    assert(text != NULL && strcmp(text, "Bob sends a scout ahead.") == 0);
+    free(text);
+
+    event_narration_free(event);
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ test_concurrent_sessions
+typedef struct {
+    int id;
+} Worker;
+
+static void* worker_thread(void* arg) {
+    Worker* worker = (Worker*)arg;
+    char sig[64];
+    char text[64];
+    for (int i = 0; i < 500; i++) {
+        snprintf(sig, sizeof(sig), "card played:Card %d", i % 50);
+        snprintf(text, sizeof(text), "Card %d enters play.", i % 50);
+        if (i % 3 == worker->id % 3) {
+            shared_cache_set(sig, text);
+        } else {
+            char* got = shared_cache_get(sig);
+            assert(got == NULL || strcmp(got, text) == 0);
+            free(got);
+        }
+    }
+    return NULL;
+}
+
+TEST(test_concurrent_sessions) {
+    remove(log_path);
+    SharedCacheConfig config = make_config(log_path);
+    assert(shared_cache_init(&config));
+
+    enum { WORKERS = 8 };
+    pthread_t threads[WORKERS];
+    Worker workers[WORKERS];
+    for (int i = 0; i < WORKERS; i++) {
+        workers[i].id = i;
+        pthread_create(&threads[i], NULL, worker_thread, &workers[i]);
+    }
+    for (int i = 0; i < WORKERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    SharedCacheStats stats = shared_cache_get_stats();
+    assert(stats.cache.total_entries == 50);
+    assert(stats.cache.hits > 0);
+    shared_cache_cleanup();
+
+    // Everything written under contention replays cleanly
+    assert(shared_cache_init(&config));
+    assert(shared_cache_get_stats().loaded == 50);
+    expect("card played:Card 7", "Card 7 enters play.");
+    shared_cache_cleanup();
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== Shared Narrative Cache Tests ===\n");
+
+    snprintf(log_path, sizeof(log_path), "/tmp/test-shared-cache-%d.log", (int)getpid());
+
+    RUN_TEST(test_not_ready);
+    RUN_TEST(test_memory_only);
+    RUN_TEST(test_warm_start);
+    RUN_TEST(test_compaction);
+    RUN_TEST(test_damaged_tail);
+    RUN_TEST(test_ttl_on_replay);
+    RUN_TEST(test_event_templates);
+    RUN_TEST(test_concurrent_sessions);
+
+    remove(log_path);
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
@@ -0,0 +1,338 @@
+/*
+ * test-singleflight.c - Tests for LLM Request Coalescing
+ *
+ * Validates that concurrent identical prompts share one upstream call,
+ * that distinct prompts do not, key normalization, async joins and the
+ * coalescing counters. A scripted stub-server instance stands in
+ * for the model server.
+ * Run with: gcc -o test-singleflight test-singleflight.c ../src/llm/11-singleflight.c
+ *           ../src/llm/10-async-client.c ../src/llm/01-api-client.c
+ *           ../src/llm/19-endpoint-pool.c ../src/llm/20-circuit-breaker.c
+ *           ../src/llm/21-response-memo.c ../src/net/09-http-pool.c
+ *           ../src/tools/stub-server.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-singleflight
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/11-singleflight.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+#define STUB_DELAY_MS 200
+#define CALLERS 8
+
+// {{{ sleep_ms
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+// }}}
+
+// {{{ Stub responder
+// Answers every request with a canned completion after STUB_DELAY_MS
+// and counts how many requests reached it.
+static StubServer* stub = NULL;
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)body;
+    (void)context;
+    free(reply->text);
+    reply->text = strdup("The dire bear roars.");
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 12;
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.latency.base_ms = STUB_DELAY_MS;
+    config.tokens_per_second = 0;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+
+static int stub_hits_reset(void) {
+    int hits = stub_server_get_stats(stub).requests;
+    stub_server_reset_stats(stub);
+    return hits;
+}
+
+static LLMConfig* stub_config(void) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->timeout_ms = 5000;
+    config->max_retries = 0;
+    return config;
+}
+
+static LLMMessage PROMPT[] = {
+    { "system", "You narrate." },
+    { "user", "Narrate the dire bear." }
+};
+// }}}
+
+// {{{ Concurrent callers
+typedef struct {
+    LLMConfig* config;
+    LLMMessage* messages;
+    size_t count;
+    bool success;
+    char text[128];
+} Caller;
+
+static void* caller_thread(void* arg) {
+    Caller* caller = (Caller*)arg;
+    LLMResponse* response = llm_request_shared(caller->config, caller->messages,
+                                               caller->count, NULL);
+    caller->success = response->success;
+    if (response->text) {
+        snprintf(caller->text, sizeof(caller->text), "%s", response->text);
+    }
+    llm_response_free(response);
+    return NULL;
+}
+// }}}
+
+// {{{ Async capture
+typedef struct {
+    pthread_mutex_t lock;
+    int calls;
+    int successes;
+} Capture;
+
+static void capture_callback(LLMResponse* response, void* user) {
+    Capture* cap = (Capture*)user;
+    pthread_mutex_lock(&cap->lock);
+    cap->calls++;
+    if (response->success && strcmp(response->text, "The dire bear roars.") == 0) {
+        cap->successes++;
+    }
+    pthread_mutex_unlock(&cap->lock);
+    llm_response_free(response);
+}
+
+static int capture_calls(Capture* cap) {
+    pthread_mutex_lock(&cap->lock);
+    int calls = cap->calls;
+    pthread_mutex_unlock(&cap->lock);
+    return calls;
+}
+// }}}
+
+// {{{ test_key_normalization
+TEST(test_key_normalization) {
+    LLMConfig* config = stub_config();
+    LLMMessage spaced[] = {
+        { "system", "  You   narrate.\n" },
+        { "user", "Narrate the\tdire  bear." }
+    };
+    LLMMessage other[] = {
+        { "system", "You narrate." },
+        { "user", "Narrate the goblin." }
+    };
+
+    char* a = llm_singleflight_key(config, PROMPT, 2);
+    char* b = llm_singleflight_key(config, spaced, 2);
+    char* c = llm_singleflight_key(config, other, 2);
+    assert(a != NULL && b != NULL && c != NULL);
+    assert(strcmp(a, b) == 0);
+    assert(strcmp(a, c) != 0);
+
+    // Moving text between messages changes the key
+    LLMMessage merged[] = { { "system", "You narrate. Narrate the dire bear." } };
+    char* d = llm_singleflight_key(config, merged, 1);
+    assert(strcmp(a, d) != 0);
+
+    assert(llm_singleflight_key(NULL, PROMPT, 2) == NULL);
+    assert(llm_singleflight_key(config, PROMPT, 0) == NULL);
+
+    free(a);
+    free(b);
+    free(c);
+    free(d);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_concurrent_identical
+TEST(test_concurrent_identical) {
+    LLMConfig* config = stub_config();
+    stub_hits_reset();
+    llm_singleflight_reset_stats();
+
+    pthread_t threads[CALLERS];
+    Caller callers[CALLERS];
+    for (int i = 0; i < CALLERS; i++) {
+        callers[i] = (Caller){ config, PROMPT, 2, false, "" };
+        pthread_create(&threads[i], NULL, caller_thread, &callers[i]);
+    }
+    for (int i = 0; i < CALLERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < CALLERS; i++) {
+        assert(callers[i].success);
+        assert(strcmp(callers[i].text, "The dire bear roars.") == 0);
+    }
+    assert(stub_hits_reset() == 1);
+
+    LLMSingleflightStats stats = llm_singleflight_get_stats();
+    assert(stats.requests == CALLERS);
+    assert(stats.upstream == 1);
+    assert(stats.coalesced == CALLERS - 1);
+    assert(stats.max_waiters == CALLERS);
+    assert(stats.in_flight == 0);
+    assert(stats.hit_rate > 0.8f);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_distinct_not_coalesced
+TEST(test_distinct_not_coalesced) {
+    LLMConfig* config = stub_config();
+    stub_hits_reset();
+    llm_singleflight_reset_stats();
+
+    LLMMessage goblin[] = {
+        { "system", "You narrate." },
+        { "user", "Narrate the goblin." }
+    };
+    Caller a = { config, PROMPT, 2, false, "" };
+    Caller b = { config, goblin, 2, false, "" };
+    pthread_t ta, tb;
+    pthread_create(&ta, NULL, caller_thread, &a);
+    pthread_create(&tb, NULL, caller_thread, &b);
+    pthread_join(ta, NULL);
+    pthread_join(tb, NULL);
+
+    assert(a.success && b.success);
+    assert(stub_hits_reset() == 2);
+    assert(llm_singleflight_get_stats().coalesced == 0);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_sequential_not_cached
+TEST(test_sequential_not_cached) {
+    // A landed flight is gone; the next identical call goes upstream
+    LLMConfig* config = stub_config();
+    stub_hits_reset();
+
+    for (int i = 0; i < 2; i++) {
+        LLMResponse* response = llm_request_shared(config, PROMPT, 2, NULL);
+        assert(response->success);
+        llm_response_free(response);
+    }
+    assert(stub_hits_reset() == 2);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_explicit_key
+TEST(test_explicit_key) {
+    // Different wording, same caller-supplied signature: one call
+    LLMConfig* config = stub_config();
+    stub_hits_reset();
+    llm_singleflight_reset_stats();
+
+    Capture cap = { PTHREAD_MUTEX_INITIALIZER, 0, 0 };
+    LLMMessage goblin[] = { { "user", "Narrate the goblin." } };
+    assert(llm_request_async_shared(config, PROMPT, 2, "attack:bear",
+                                    capture_callback, &cap));
+    assert(llm_request_async_shared(config, goblin, 1, "attack:bear",
+                                    capture_callback, &cap));
+
+    for (int waited = 0; waited < 3000 && capture_calls(&cap) < 2; waited += 10) {
+        sleep_ms(10);
+    }
+    assert(cap.calls == 2);
+    assert(cap.successes == 2);
+    assert(stub_hits_reset() == 1);
+    assert(llm_singleflight_get_stats().coalesced == 1);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_async_joins_sync
+TEST(test_async_joins_sync) {
+    LLMConfig* config = stub_config();
+    stub_hits_reset();
+    llm_singleflight_reset_stats();
+
+    Caller leader = { config, PROMPT, 2, false, "" };
+    pthread_t thread;
+    pthread_create(&thread, NULL, caller_thread, &leader);
+    sleep_ms(STUB_DELAY_MS / 4);
+
+    Capture cap = { PTHREAD_MUTEX_INITIALIZER, 0, 0 };
+    assert(llm_request_async_shared(config, PROMPT, 2, NULL,
+                                    capture_callback, &cap));
+    assert(llm_singleflight_get_stats().in_flight == 1);
+
+    pthread_join(thread, NULL);
+    assert(leader.success);
+    assert(cap.calls == 1 && cap.successes == 1);
+    assert(stub_hits_reset() == 1);
+
+    LLMSingleflightStats stats = llm_singleflight_get_stats();
+    assert(stats.requests == 2);
+    assert(stats.coalesced == 1);
+    assert(stats.in_flight == 0);
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_invalid_args
+TEST(test_invalid_args) {
+    LLMConfig* config = stub_config();
+
+    LLMResponse* response = llm_request_shared(NULL, PROMPT, 2, NULL);
+    assert(response != NULL && !response->success);
+    llm_response_free(response);
+
+    assert(!llm_request_async_shared(config, PROMPT, 2, NULL, NULL, NULL));
+    assert(!llm_request_async_shared(config, NULL, 2, NULL, capture_callback, NULL));
+
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== Singleflight Tests ===\n");
+
+    stub_start();
+    assert(llm_async_init());
+
+    RUN_TEST(test_invalid_args);
+    RUN_TEST(test_key_normalization);
+    RUN_TEST(test_concurrent_identical);
+    RUN_TEST(test_distinct_not_coalesced);
+    RUN_TEST(test_sequential_not_cached);
+    RUN_TEST(test_explicit_key);
+    RUN_TEST(test_async_joins_sync);
+
+    llm_async_cleanup();
+    stub_server_stop(stub);
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
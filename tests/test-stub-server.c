@@ -0,0 +1,408 @@
+/*
+ * test-stub-server.c - Tests for the Local LLM and ComfyUI Stub Servers
+ *
+ * Drives the stubs through the real clients: plain and streamed chat
+ * completions, deterministic replies and latencies, injected failures,
+ * concurrency slots, scripted replies, keep-alive connections and the
+ * ComfyUI submit/history/view cycle.
+ * Run with: gcc -o test-stub-server test-stub-server.c
+ *           ../src/tools/stub-server.c ../src/llm/01-api-client.c
+ *           ../src/llm/19-endpoint-pool.c ../src/llm/20-circuit-breaker.c
+ *           ../src/llm/21-response-memo.c ../src/llm/10-async-client.c
+ *           ../src/visual/01-comfyui-client.c ../src/net/09-http-pool.c
+ *           ../libs/cJSON.c -lcurl -lm -lpthread && ./test-stub-server
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/tools/stub-server.h"
+#include "../src/llm/01-api-client.h"
+#include "../src/visual/01-comfyui-client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ now_ms
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+// }}}
+
+// {{{ config_for
+static LLMConfig* config_for(StubServer* server) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(server));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->max_retries = 0;
+    return config;
+}
+// }}}
+
+// {{{ test_latency_sample
+TEST(test_latency_sample) {
+    StubLatency fixed = { STUB_LATENCY_FIXED, 40, 100 };
+    assert(stub_latency_sample(&fixed, 1, 0) == 40);
+    assert(stub_latency_sample(&fixed, 7, 99) == 40);
+
+    StubLatency uniform = { STUB_LATENCY_UNIFORM, 10, 50 };
+    StubLatency tail = { STUB_LATENCY_EXPONENTIAL, 10, 50 };
+    bool varied = false;
+    for (unsigned long i = 0; i < 100; i++) {
+        int u = stub_latency_sample(&uniform, 3, i);
+        assert(u >= 10 && u <= 60);
+        assert(u == stub_latency_sample(&uniform, 3, i));
+        int e = stub_latency_sample(&tail, 3, i);
+        assert(e >= 10);
+        assert(e == stub_latency_sample(&tail, 3, i));
+        if (u != stub_latency_sample(&uniform, 3, 0)) {
+            varied = true;
+        }
+    }
+    assert(varied);
+
+    assert(stub_latency_sample(NULL, 1, 0) == 0);
+}
+// }}}
+
+// {{{ test_reply_text
+TEST(test_reply_text) {
+    char* a = stub_server_reply_text(5, "The bear attacks.", 12);
+    char* b = stub_server_reply_text(5, "The bear attacks.", 12);
+    char* c = stub_server_reply_text(5, "The wolf attacks.", 12);
+    assert(a != NULL && b != NULL && c != NULL);
+    assert(strcmp(a, b) == 0);
+    assert(strcmp(a, c) != 0);
+
+    int words = 1;
+    for (const char* p = a; *p != '\0'; p++) {
+        if (*p == ' ') {
+            words++;
+        }
+    }
+    assert(words == 12);
+
+    free(a);
+    free(b);
+    free(c);
+}
+// }}}
+
+// {{{ test_chat_completion
+TEST(test_chat_completion) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 0;
+    stub.tokens_per_second = 0;
+    stub.reply_tokens = 8;
+    stub.seed = 11;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    assert(stub_server_port(server) > 0);
+    LLMConfig* config = config_for(server);
+
+    LLMResponse* response = llm_request(config, "Narrate.", "The bear attacks.");
+    assert(response != NULL);
+    assert(response->success);
+    assert(response->http_status == 200);
+    assert(response->tokens_used > 0);
+
+    // The reply depends only on the seed and the prompt
+    LLMResponse* again = llm_request(config, "Narrate.", "The bear attacks.");
+    assert(again->success);
+    assert(strcmp(response->text, again->text) == 0);
+
+    StubServerStats stats = stub_server_get_stats(server);
+    assert(stats.requests == 2);
+    assert(stats.streamed == 0);
+    assert(stats.failures == 0);
+    assert(stats.tokens == 16);
+
+    stub_server_reset_stats(server);
+    assert(stub_server_get_stats(server).requests == 0);
+
+    llm_response_free(response);
+    llm_response_free(again);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_streaming
+static void count_delta(const char* delta, void* user) {
+    (void)delta;
+    (*(int*)user)++;
+}
+
+TEST(test_streaming) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 0;
+    stub.tokens_per_second = 100;
+    stub.reply_tokens = 6;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    LLMConfig* config = config_for(server);
+
+    LLMMessage messages[1] = { { "user", "The bear attacks." } };
+    int deltas = 0;
+    double start = now_ms();
+    LLMResponse* response = llm_request_stream(config, messages, 1, count_delta, &deltas);
+    double elapsed = now_ms() - start;
+
+    assert(response != NULL);
+    assert(response->success);
+    assert(deltas == 6);
+    // Six words at 100 per second take at least 50 ms to arrive
+    assert(elapsed >= 50.0);
+
+    LLMResponse* plain = llm_request_messages(config, messages, 1);
+    assert(plain->success);
+    assert(strcmp(plain->text, response->text) == 0);
+
+    StubServerStats stats = stub_server_get_stats(server);
+    assert(stats.streamed == 1);
+    assert(stats.requests == 2);
+
+    llm_response_free(response);
+    llm_response_free(plain);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_failure_injection
+TEST(test_failure_injection) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 0;
+    stub.failure_rate = 1.0;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    LLMConfig* config = config_for(server);
+
+    LLMResponse* response = llm_request(config, "Narrate.", "The bear attacks.");
+    assert(response != NULL);
+    assert(!response->success);
+    assert(response->http_status == 503);
+    assert(llm_response_is_retryable(response));
+    assert(stub_server_get_stats(server).failures == 1);
+
+    llm_response_free(response);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_slots
+typedef struct {
+    LLMConfig* config;
+    bool success;
+} SlotCall;
+
+static void* slot_call(void* arg) {
+    SlotCall* call = arg;
+    LLMResponse* response = llm_request(call->config, "Narrate.", "The bear attacks.");
+    call->success = response != NULL && response->success;
+    llm_response_free(response);
+    return NULL;
+}
+
+TEST(test_slots) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 60;
+    stub.tokens_per_second = 0;
+    stub.slots = 2;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    LLMConfig* config = config_for(server);
+
+    pthread_t threads[6];
+    SlotCall calls[6];
+    double start = now_ms();
+    for (int i = 0; i < 6; i++) {
+        calls[i].config = config;
+        calls[i].success = false;
+        pthread_create(&threads[i], NULL, slot_call, &calls[i]);
+    }
+    for (int i = 0; i < 6; i++) {
+        pthread_join(threads[i], NULL);
+        assert(calls[i].success);
+    }
+    double elapsed = now_ms() - start;
+
+    // Six requests two at a time take three rounds of 60 ms
+    StubServerStats stats = stub_server_get_stats(server);
+    assert(stats.requests == 6);
+    assert(stats.peak_active <= 2);
+    assert(elapsed >= 170.0);
+
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_reply_hook
+// Echoes "ECHO" prompts, fails "FAIL" ones and leaves the rest alone
+static void script_reply(const char* body, StubReply* reply, void* context) {
+    (*(int*)context)++;
+    if (strstr(body, "FAIL") != NULL) {
+        reply->status = 500;
+    } else if (strstr(body, "ECHO") != NULL) {
+        free(reply->text);
+        reply->text = strdup("Echo of the realm.");
+        reply->prompt_tokens = 0;
+        reply->reply_tokens = 4;
+        reply->token_ms = 0;
+    }
+}
+
+TEST(test_reply_hook) {
+    int calls = 0;
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 0;
+    stub.tokens_per_second = 0;
+    stub.reply = script_reply;
+    stub.reply_context = &calls;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    LLMConfig* config = config_for(server);
+
+    LLMResponse* echo = llm_request(config, "Narrate.", "ECHO");
+    assert(echo->success);
+    assert(strcmp(echo->text, "Echo of the realm.") == 0);
+    assert(echo->tokens_used == 4);
+
+    LLMMessage messages[1] = { { "user", "ECHO" } };
+    int deltas = 0;
+    LLMResponse* streamed = llm_request_stream(config, messages, 1, count_delta, &deltas);
+    assert(streamed->success);
+    assert(deltas == 4);
+    assert(strcmp(streamed->text, "Echo of the realm.") == 0);
+
+    LLMResponse* failed = llm_request(config, "Narrate.", "FAIL");
+    assert(!failed->success);
+    assert(failed->http_status == 500);
+
+    LLMResponse* seeded = llm_request(config, "Narrate.", "The bear attacks.");
+    assert(seeded->success);
+    assert(strcmp(seeded->text, "Echo of the realm.") != 0);
+    assert(calls == 4);
+
+    llm_response_free(echo);
+    llm_response_free(streamed);
+    llm_response_free(failed);
+    llm_response_free(seeded);
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_keep_alive
+TEST(test_keep_alive) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 0;
+    stub.tokens_per_second = 0;
+    stub.keep_alive = true;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+    LLMConfig* config = config_for(server);
+
+    // Plain replies share one connection
+    for (int i = 0; i < 3; i++) {
+        LLMResponse* response = llm_request(config, "Narrate.", "The bear attacks.");
+        assert(response->success);
+        llm_response_free(response);
+    }
+    StubServerStats stats = stub_server_get_stats(server);
+    assert(stats.requests == 3);
+    assert(stats.connections == 1);
+
+    // A stream ends its connection
+    LLMMessage messages[1] = { { "user", "The bear attacks." } };
+    int deltas = 0;
+    LLMResponse* streamed = llm_request_stream(config, messages, 1, count_delta, &deltas);
+    assert(streamed->success);
+    llm_response_free(streamed);
+    LLMResponse* after = llm_request(config, "Narrate.", "The bear attacks.");
+    assert(after->success);
+    llm_response_free(after);
+    assert(stub_server_get_stats(server).connections == 2);
+
+    llm_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+// {{{ test_comfyui_cycle
+TEST(test_comfyui_cycle) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_COMFYUI);
+    stub.latency.base_ms = 50;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+
+    ComfyUIConfig* config = comfyui_config_create();
+    free(config->server_url);
+    config->server_url = strdup("127.0.0.1");
+    config->port = stub_server_port(server);
+    config->poll_interval_ms = 10;
+
+    const char* workflow = "{\"3\":{\"class_type\":\"KSampler\",\"inputs\":{}}}";
+    ComfyUIResponse* response = comfyui_wait_for_completion(config, workflow);
+    assert(response->status == COMFYUI_STATUS_COMPLETED);
+    assert(response->prompt_id != NULL);
+    assert(response->image_data != NULL);
+    assert(response->image_size > 8);
+    assert(memcmp(response->image_data, "\x89PNG", 4) == 0);
+
+    StubServerStats stats = stub_server_get_stats(server);
+    assert(stats.requests == 1);
+    assert(stats.polls >= 2);
+    assert(stats.images == 1);
+    comfyui_response_free(response);
+    stub_server_stop(server);
+
+    // A failed job is reported through the history
+    stub.failure_rate = 1.0;
+    server = stub_server_start(&stub);
+    assert(server != NULL);
+    config->port = stub_server_port(server);
+
+    response = comfyui_wait_for_completion(config, workflow);
+    assert(response->status == COMFYUI_STATUS_ERROR);
+    assert(stub_server_get_stats(server).failures == 1);
+
+    comfyui_response_free(response);
+    comfyui_config_free(config);
+    stub_server_stop(server);
+}
+// }}}
+
+int main(void) {
+    printf("=== Stub Server Tests ===\n");
+
+    assert(llm_init());
+    assert(comfyui_init());
+
+    RUN_TEST(test_latency_sample);
+    RUN_TEST(test_reply_text);
+    RUN_TEST(test_chat_completion);
+    RUN_TEST(test_streaming);
+    RUN_TEST(test_failure_injection);
+    RUN_TEST(test_slots);
+    RUN_TEST(test_reply_hook);
+    RUN_TEST(test_keep_alive);
+    RUN_TEST(test_comfyui_cycle);
+
+    comfyui_cleanup();
+    llm_cleanup();
+
+    printf("\nAll stub server tests passed!\n");
+    return 0;
+}
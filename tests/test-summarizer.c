@@ -0,0 +1,296 @@
+/*
+ * test-summarizer.c - Tests for Background Context Summarization
+ *
+ * Validates the trigger threshold, non-blocking maintenance, the swap
+ * of a finished summary, entries that change while the model writes,
+ * the eviction fallback and freeing with a summary in flight. A
+ * scripted stub-server instance stands in for the model.
+ * Run with: gcc -o test-summarizer test-summarizer.c ../src/llm/18-summarizer.c
+ *           ../src/llm/16-scheduler.c ../src/llm/22-token-usage.c
+ *           ../src/llm/10-async-client.c ../src/llm/06-context-manager.c
+ *           ../src/llm/14-tokenizer.c ../src/llm/02-prompts.c
+ *           ../src/llm/01-api-client.c ../src/llm/19-endpoint-pool.c
+ *           ../src/llm/20-circuit-breaker.c ../src/llm/21-response-memo.c
+ *           ../src/net/09-http-pool.c ../src/tools/stub-server.c
+ *           ../libs/cJSON.c -lcurl -lm -lpthread && ./test-summarizer
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/18-summarizer.h"
+#include "../src/llm/10-async-client.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ sleep_ms
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+// }}}
+
+// {{{ Stub responder
+// Answers every request with a short summary after stub_delay_ms.
+static StubServer* stub = NULL;
+static volatile int stub_delay_ms = 0;
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)body;
+    (void)context;
+    free(reply->text);
+    reply->text = strdup("Summary of the war.");
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 5;
+    reply->delay_ms = stub_delay_ms;
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.tokens_per_second = 0;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    assert(stub != NULL);
+}
+
+static LLMConfig* stub_config(void) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->timeout_ms = 5000;
+    config->max_retries = 0;
+    return config;
+}
+// }}}
+
+// {{{ Helpers
+// Each event is 40 characters, 10 estimated tokens.
+static void add_events(ContextManager* cm, int first, int count) {
+    for (int i = first; i < first + count; i++) {
+        char text[64];
+        snprintf(text, sizeof(text), "Turn %02d: the Dire Bear mauls a scout!!!", i);
+        assert(context_add(cm, text, PRIORITY_OLD_EVENTS));
+    }
+}
+
+static int summary_entries(ContextManager* cm) {
+    int count = 0;
+    for (int i = 0; i < cm->entry_count; i++) {
+        char* text = context_get_entries_text(cm, &i, 1);
+        count += strcmp(text, "Summary of the war.") == 0;
+        free(text);
+    }
+    return count;
+}
+
+// Polls maintain until a summary is applied or timeout_ms pass.
+static bool wait_applied(ContextSummarizer* s, int applied, int timeout_ms) {
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        context_summarizer_maintain(s);
+        if (context_summarizer_get_stats(s).applied >= applied) {
+            return true;
+        }
+        sleep_ms(10);
+    }
+    return false;
+}
+
+static double elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+// }}}
+
+// {{{ test_summary_swapped_in
+TEST(test_summary_swapped_in) {
+    stub_delay_ms = 150;
+    LLMConfig* config = stub_config();
+    ContextManager* cm = context_init(200);
+    context_add(cm, "System", PRIORITY_SYSTEM);
+    SummarizerConfig options = context_summarizer_default_config();
+    options.max_entries = 6;
+    ContextSummarizer* s = context_summarizer_create(cm, config, &options, NULL);
+    assert(s != NULL);
+
+    // Below the trigger nothing happens
+    add_events(cm, 1, 10);  // 102 of 200 tokens
+    assert(!context_summarizer_maintain(s));
+    assert(context_summarizer_get_stats(s).started == 0);
+
+    // Past it a summary starts without waiting for the model
+    add_events(cm, 11, 2);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(!context_summarizer_maintain(s));
+    assert(elapsed_ms(&start) < 50.0);
+    SummarizerStats stats = context_summarizer_get_stats(s);
+    assert(stats.started == 1);
+    assert(stats.in_flight);
+    assert(cm->entry_count == 13);
+
+    // Narration goes on meanwhile
+    add_events(cm, 13, 1);
+    assert(context_summarizer_get_stats(s).started == 1);
+
+    assert(wait_applied(s, 1, 3000));
+    assert(summary_entries(cm) == 1);
+    assert(cm->entry_count == 14 - 6 + 1);
+    assert(context_get_stats(cm).summary_count == 1);
+    assert(!context_summarizer_get_stats(s).in_flight);
+
+    // The oldest six are gone; turn 07 onwards remain
+    char* prompt = context_build_prompt(cm);
+    assert(strstr(prompt, "Turn 06") == NULL);
+    assert(strstr(prompt, "Turn 07") != NULL);
+    assert(strstr(prompt, "Summary of the war.") != NULL);
+    free(prompt);
+
+    context_summarizer_free(s);
+    context_free(cm);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_entries_change_while_writing
+TEST(test_entries_change_while_writing) {
+    stub_delay_ms = 150;
+    LLMConfig* config = stub_config();
+    ContextManager* cm = context_init(200);
+    SummarizerConfig options = context_summarizer_default_config();
+    options.max_entries = 4;
+    ContextSummarizer* s = context_summarizer_create(cm, config, &options, NULL);
+
+    add_events(cm, 1, 13);
+    context_summarizer_maintain(s);
+    assert(context_summarizer_get_stats(s).started == 1);
+
+    // Two of the four snapshotted entries disappear
+    context_evict_lowest(cm);
+    context_evict_lowest(cm);
+    assert(wait_applied(s, 1, 3000));
+    assert(summary_entries(cm) == 1);
+    assert(cm->entry_count == 13 - 2 - 2 + 1);
+
+    // A summary whose entries are all gone is dropped
+    add_events(cm, 14, 3);
+    while (context_summarizer_get_stats(s).started < 2) {
+        context_summarizer_maintain(s);
+    }
+    context_clear_priority(cm, PRIORITY_OLD_EVENTS);
+    add_events(cm, 20, 1);
+    for (int i = 0; i < 300 && context_summarizer_get_stats(s).discarded == 0; i++) {
+        context_summarizer_maintain(s);
+        sleep_ms(10);
+    }
+    assert(context_summarizer_get_stats(s).discarded == 1);
+    assert(summary_entries(cm) == 0);
+
+    context_summarizer_free(s);
+    context_free(cm);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_evicts_when_behind
+TEST(test_evicts_when_behind) {
+    stub_delay_ms = 400;
+    LLMConfig* config = stub_config();
+    ContextManager* cm = context_init(200);
+    context_add(cm, "System", PRIORITY_SYSTEM);
+    context_add(cm, "Current turn", PRIORITY_CURRENT_TURN);
+    ContextSummarizer* s = context_summarizer_create(cm, config, NULL, NULL);
+
+    add_events(cm, 1, 13);
+    context_summarizer_maintain(s);
+    assert(context_summarizer_get_stats(s).in_flight);
+
+    // The model is slow and the context keeps filling up
+    add_events(cm, 14, 5);
+    assert(context_needs_summarization(cm, 0.9f));
+    assert(context_summarizer_maintain(s));
+    SummarizerStats stats = context_summarizer_get_stats(s);
+    assert(stats.evicted > 0);
+    assert(!context_needs_summarization(cm, 0.9f));
+    assert(context_get_entry_count(cm, PRIORITY_CURRENT_TURN) == 1);
+
+    // Freeing with the summary still in flight cancels it
+    context_summarizer_free(s);
+    context_free(cm);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_without_engine
+TEST(test_without_engine) {
+    LLMConfig* config = llm_config_create();
+    ContextManager* cm = context_init(200);
+    ContextSummarizer* s = context_summarizer_create(cm, config, NULL, NULL);
+
+    add_events(cm, 1, 19);  // 190 of 200 tokens
+    assert(context_summarizer_maintain(s));
+    SummarizerStats stats = context_summarizer_get_stats(s);
+    assert(stats.started == 0);
+    assert(stats.evicted == 2);
+
+    assert(context_summarizer_create(NULL, config, NULL, NULL) == NULL);
+    assert(!context_summarizer_maintain(NULL));
+    context_summarizer_free(NULL);
+
+    context_summarizer_free(s);
+    context_free(cm);
+    llm_config_free(config);
+}
+// }}}
+
+// {{{ test_sequence_lookup
+TEST(test_sequence_lookup) {
+    ContextManager* cm = context_init(1000);
+    context_add(cm, "Old", PRIORITY_OLD_EVENTS);
+    context_add(cm, "System", PRIORITY_SYSTEM);
+
+    unsigned long old_seq = 0, system_seq = 0;
+    assert(context_get_sequence(cm, 1, &old_seq));
+    assert(context_get_sequence(cm, 0, &system_seq));
+    assert(old_seq == 0 && system_seq == 1);
+    assert(!context_get_sequence(cm, 2, &old_seq));
+
+    context_add(cm, "Current", PRIORITY_CURRENT_TURN);
+    assert(context_find_sequence(cm, 0) == 2);
+    context_remove_at(cm, 2);
+    assert(context_find_sequence(cm, 0) == -1);
+    assert(context_find_sequence(NULL, 0) == -1);
+
+    context_free(cm);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== Context Summarizer Tests ===\n");
+
+    RUN_TEST(test_sequence_lookup);
+    RUN_TEST(test_without_engine);
+
+    stub_start();
+    assert(llm_async_init());
+    RUN_TEST(test_summary_swapped_in);
+    RUN_TEST(test_entries_change_while_writing);
+    RUN_TEST(test_evicts_when_behind);
+    llm_async_cleanup();
+    stub_server_stop(stub);
+    llm_cleanup();
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
@@ -0,0 +1,200 @@
+/*
+ * test-token-usage.c - Tests for Token Accounting and Session Budgets
+ *
+ * Checks the per-session and per-class totals, budget levels and
+ * per-session overrides, and that requests through the scheduler are
+ * counted under their session and class while the endpoint pool counts
+ * the same tokens per endpoint. Uses the local stub server.
+ * Run with: gcc -o test-token-usage test-token-usage.c
+ *           ../src/llm/22-token-usage.c ../src/llm/16-scheduler.c
+ *           ../src/llm/10-async-client.c ../src/llm/01-api-client.c
+ *           ../src/llm/19-endpoint-pool.c ../src/llm/20-circuit-breaker.c
+ *           ../src/llm/21-response-memo.c ../src/tools/stub-server.c
+ *           ../src/net/09-http-pool.c ../libs/cJSON.c
+ *           -lcurl -lm -lpthread && ./test-token-usage
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/22-token-usage.h"
+#include "../src/llm/19-endpoint-pool.h"
+#include "../src/tools/stub-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ spend
+// Records a made-up request of the given cost.
+static void spend(const void* session, LLMRequestClass request_class,
+                  int tokens, bool success) {
+    LLMResponse response = { .success = success, .tokens_used = tokens,
+                             .http_status = success ? 200 : 500 };
+    llm_usage_record(session, request_class, &response);
+}
+// }}}
+
+// {{{ test_not_running
+TEST(test_not_running) {
+    int game;
+    assert(!llm_usage_running());
+    spend(&game, LLM_CLASS_NARRATION, 50, true);
+    assert(llm_usage_level(&game) == LLM_USAGE_NORMAL);
+    assert(!llm_usage_set_budget(&game, 10));
+    assert(llm_usage_get_stats().total.requests == 0);
+    assert(strcmp(llm_usage_level_name(LLM_USAGE_MINIMAL), "minimal") == 0);
+}
+// }}}
+
+// {{{ test_totals
+TEST(test_totals) {
+    int game_a, game_b;
+    assert(llm_usage_init(NULL));
+    assert(!llm_usage_init(NULL));
+
+    spend(&game_a, LLM_CLASS_NARRATION, 120, true);
+    spend(&game_a, LLM_CLASS_SUMMARY, 300, true);
+    spend(&game_b, LLM_CLASS_NARRATION, 80, true);
+    spend(&game_b, LLM_CLASS_TRADE_SELECT, 0, false);
+    spend(NULL, LLM_CLASS_PREFETCH, 40, true);
+    llm_usage_record(&game_a, LLM_CLASS_COUNT, NULL);
+
+    LLMSessionUsage a = llm_usage_get_session(&game_a);
+    assert(a.total.requests == 2);
+    assert(a.total.tokens == 420);
+    assert(a.class_tokens[LLM_CLASS_SUMMARY] == 300);
+    assert(a.budget == 0);
+    assert(a.level == LLM_USAGE_NORMAL);
+    LLMSessionUsage b = llm_usage_get_session(&game_b);
+    assert(b.total.tokens == 80);
+    assert(b.total.failures == 1);
+
+    LLMUsageStats stats = llm_usage_get_stats();
+    assert(stats.total.requests == 5);
+    assert(stats.total.tokens == 540);
+    assert(stats.total.failures == 1);
+    assert(stats.classes[LLM_CLASS_NARRATION].tokens == 200);
+    assert(stats.classes[LLM_CLASS_PREFETCH].tokens == 40);
+    assert(stats.sessions == 2);
+    assert(stats.sessions_limited == 0);
+
+    // Ending a session forgets it; the totals stay
+    llm_usage_end_session(&game_a);
+    assert(llm_usage_get_session(&game_a).total.tokens == 0);
+    stats = llm_usage_get_stats();
+    assert(stats.sessions == 1);
+    assert(stats.total.tokens == 540);
+
+    llm_usage_cleanup();
+    assert(llm_usage_get_stats().sessions == 0);
+}
+// }}}
+
+// {{{ test_levels
+TEST(test_levels) {
+    int game, small_game;
+    LLMUsageConfig config = { .session_budget = 1000 };
+    assert(llm_usage_init(&config));
+
+    spend(&game, LLM_CLASS_NARRATION, 599, true);
+    assert(llm_usage_level(&game) == LLM_USAGE_NORMAL);
+    spend(&game, LLM_CLASS_NARRATION, 1, true);
+    assert(llm_usage_level(&game) == LLM_USAGE_REDUCED);
+    spend(&game, LLM_CLASS_NARRATION, 250, true);
+    assert(llm_usage_level(&game) == LLM_USAGE_MINIMAL);
+    spend(&game, LLM_CLASS_NARRATION, 150, true);
+    assert(llm_usage_level(&game) == LLM_USAGE_EXHAUSTED);
+    assert(llm_usage_get_stats().sessions_limited == 1);
+
+    // A session may be given more, or no limit at all
+    assert(llm_usage_set_budget(&game, 2000));
+    assert(llm_usage_level(&game) == LLM_USAGE_NORMAL);
+    assert(llm_usage_get_session(&game).budget == 2000);
+    assert(llm_usage_set_budget(&game, 0));
+    spend(&game, LLM_CLASS_NARRATION, 5000, true);
+    assert(llm_usage_level(&game) == LLM_USAGE_NORMAL);
+    assert(llm_usage_set_budget(&game, -1));
+    assert(llm_usage_level(&game) == LLM_USAGE_EXHAUSTED);
+
+    // A budget set before the session spends anything applies at once
+    assert(llm_usage_set_budget(&small_game, 10));
+    spend(&small_game, LLM_CLASS_RECOVERY, 9, true);
+    assert(llm_usage_level(&small_game) == LLM_USAGE_MINIMAL);
+    assert(!llm_usage_set_budget(NULL, 10));
+    assert(llm_usage_level(NULL) == LLM_USAGE_NORMAL);
+
+    llm_usage_cleanup();
+}
+// }}}
+
+// {{{ test_scheduled_requests
+TEST(test_scheduled_requests) {
+    StubServerConfig stub = stub_server_default_config(STUB_SERVER_LLM);
+    stub.latency.base_ms = 0;
+    stub.tokens_per_second = 0;
+    StubServer* server = stub_server_start(&stub);
+    assert(server != NULL);
+
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d", stub_server_port(server));
+    LLMEndpointSpec spec = { .url = url };
+    LLMEndpointPool* pool = llm_endpoint_pool_create(&spec, 1, NULL);
+    LLMConfig* config = llm_config_create();
+    config->endpoints = pool;
+
+    assert(llm_usage_init(NULL));
+    int game;
+    long spent = 0;
+
+    // Queued through the scheduler and sent directly without it
+    assert(llm_async_init());
+    assert(llm_scheduler_init(NULL));
+    LLMScheduleOptions options = { .request_class = LLM_CLASS_TRADE_SELECT,
+                                   .session = &game, .turn = -1 };
+    LLMResponse* response = llm_schedule_request(config, "You choose cards.",
+                                                 "Pick three.", &options);
+    assert(response != NULL && response->success && response->tokens_used > 0);
+    spent += response->tokens_used;
+    llm_response_free(response);
+    llm_scheduler_cleanup();
+    llm_async_cleanup();
+
+    options.request_class = LLM_CLASS_RECOVERY;
+    response = llm_schedule_request(config, "You narrate.", "Mend the story.", &options);
+    assert(response != NULL && response->success);
+    long recovery = response->tokens_used;
+    spent += recovery;
+    llm_response_free(response);
+
+    LLMSessionUsage usage = llm_usage_get_session(&game);
+    assert(usage.total.requests == 2);
+    assert(usage.total.tokens == spent);
+    assert(usage.class_tokens[LLM_CLASS_RECOVERY] == recovery);
+    assert(usage.class_tokens[LLM_CLASS_TRADE_SELECT] == spent - recovery);
+    assert(llm_endpoint_pool_get_stats(pool, 0).tokens == spent);
+
+    llm_usage_cleanup();
+    llm_config_free(config);
+    llm_endpoint_pool_free(pool);
+    stub_server_stop(server);
+}
+// }}}
+
+int main(void) {
+    printf("=== Token Usage Tests ===\n");
+
+    assert(llm_init());
+
+    RUN_TEST(test_not_running);
+    RUN_TEST(test_totals);
+    RUN_TEST(test_levels);
+    RUN_TEST(test_scheduled_requests);
+
+    llm_cleanup();
+
+    printf("\nAll token usage tests passed!\n");
+    return 0;
+}
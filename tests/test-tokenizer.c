@@ -0,0 +1,308 @@
+/*
+ * test-tokenizer.c - Tests for the BPE Tokenizer
+ *
+ * Validates vocabulary loading, piece splitting, merging, cached prefix
+ * counting and context manager integration, and reports throughput.
+ * Run with: gcc -o test-tokenizer test-tokenizer.c ../src/llm/14-tokenizer.c ../src/llm/06-context-manager.c ../src/llm/02-prompts.c -lpthread && ./test-tokenizer
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/llm/14-tokenizer.h"
+#include "../src/llm/06-context-manager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST(name) static void name(void)
+#define RUN_TEST(name) do { printf("Running %s...", #name); name(); printf(" PASS\n"); } while(0)
+
+// {{{ Vocabulary fixture
+static char vocab_dir[] = "/tmp/test-tokenizer-XXXXXX";
+static char vocab_path[256];
+
+static const char* merges[] = {
+    "he", "th", "the", " the", "in", "ing", "e ", "  ", "1234", "n'"
+};
+#define MERGE_COUNT (int)(sizeof(merges) / sizeof(merges[0]))
+#define RANK_THE 258
+#define RANK_SPACE_THE 259
+#define RANK_ING 261
+#define RANK_TWO_SPACES 263
+
+static void write_base64(FILE* f, const unsigned char* data, size_t len) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (size_t i = 0; i < len; i += 3) {
+        unsigned int v = data[i] << 16;
+        if (i + 1 < len) v |= data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        fputc(alphabet[(v >> 18) & 63], f);
+        fputc(alphabet[(v >> 12) & 63], f);
+        fputc(i + 1 < len ? alphabet[(v >> 6) & 63] : '=', f);
+        fputc(i + 2 < len ? alphabet[v & 63] : '=', f);
+    }
+}
+
+// Writes all 256 bytes (ranks 0-255) then the merges, skipping byte
+// skip_byte when it is in range.
+static void write_vocab(const char* path, int skip_byte) {
+    FILE* f = fopen(path, "w");
+    assert(f != NULL);
+    for (int b = 0; b < 256; b++) {
+        if (b == skip_byte) {
+            continue;
+        }
+        unsigned char c = (unsigned char)b;
+        write_base64(f, &c, 1);
+        fprintf(f, " %d\n", b);
+    }
+    for (int i = 0; i < MERGE_COUNT; i++) {
+        write_base64(f, (const unsigned char*)merges[i], strlen(merges[i]));
+        fprintf(f, " %d\n", 256 + i);
+    }
+    fclose(f);
+}
+
+static Tokenizer* load_fixture(void) {
+    Tokenizer* tok = tokenizer_load(vocab_path);
+    assert(tok != NULL);
+    return tok;
+}
+// }}}
+
+// {{{ test_load
+TEST(test_load) {
+    Tokenizer* tok = load_fixture();
+    assert(tokenizer_vocab_size(tok) == 256 + MERGE_COUNT);
+    tokenizer_free(tok);
+}
+// }}}
+
+// {{{ test_load_invalid
+TEST(test_load_invalid) {
+    assert(tokenizer_load(NULL) == NULL);
+    assert(tokenizer_load("/nonexistent/vocab.tiktoken") == NULL);
+
+    char path[300];
+    snprintf(path, sizeof(path), "%s/missing-byte.tiktoken", vocab_dir);
+    write_vocab(path, 'q');
+    assert(tokenizer_load(path) == NULL);
+
+    snprintf(path, sizeof(path), "%s/garbage.tiktoken", vocab_dir);
+    FILE* f = fopen(path, "w");
+    fputs("not base64! 12\n", f);
+    fclose(f);
+    assert(tokenizer_load(path) == NULL);
+
+    tokenizer_free(NULL);
+    assert(tokenizer_count(NULL, "text") == 0);
+}
+// }}}
+
+// {{{ test_load_for_model
+TEST(test_load_for_model) {
+    Tokenizer* tok = tokenizer_load_for_model(vocab_dir, "fixture");
+    assert(tok != NULL);
+    tokenizer_free(tok);
+
+    assert(tokenizer_load_for_model(vocab_dir, "no-such-model") == NULL);
+    assert(tokenizer_load_for_model(vocab_dir, "../fixture") == NULL);
+    assert(tokenizer_load_for_model(NULL, "fixture") == NULL);
+}
+// }}}
+
+// {{{ test_merges
+TEST(test_merges) {
+    Tokenizer* tok = load_fixture();
+
+    assert(tokenizer_count(tok, "") == 0);
+    assert(tokenizer_count(tok, "the") == 1);
+    assert(tokenizer_count(tok, " the") == 1);
+    assert(tokenizer_count(tok, "thing") == 2);  // th + in -> th + ing
+    assert(tokenizer_count(tok, "heat") == 3);   // he a t
+
+    // "the" + " king", and " king" merges to " " k "ing"
+    int ids[8];
+    int n = tokenizer_encode(tok, "the king", ids, 8);
+    assert(n == 4);
+    assert(ids[0] == RANK_THE);
+    assert(ids[1] == ' ');
+    assert(ids[2] == 'k');
+    assert(ids[3] == RANK_ING);
+
+    // Truncated output still reports the full count
+    assert(tokenizer_encode(tok, "the king", ids, 2) == 4);
+    assert(ids[0] == RANK_THE && ids[1] == ' ');
+
+    tokenizer_free(tok);
+}
+// }}}
+
+// {{{ test_pieces
+TEST(test_pieces) {
+    Tokenizer* tok = load_fixture();
+    int ids[16];
+
+    // The space belongs to the next word, so "e " never merges
+    assert(tokenizer_encode(tok, "the the", ids, 16) == 2);
+    assert(ids[0] == RANK_THE && ids[1] == RANK_SPACE_THE);
+
+    // Extra spaces stay apart from the word's leading space
+    assert(tokenizer_encode(tok, "a   the", ids, 16) == 3);
+    assert(ids[0] == 'a' && ids[1] == RANK_TWO_SPACES && ids[2] == RANK_SPACE_THE);
+
+    // Digits split in runs of three, so "1234" is never reached
+    assert(tokenizer_count(tok, "1234") == 4);
+    assert(tokenizer_count(tok, "12345") == 5);
+
+    // Contractions are their own piece
+    assert(tokenizer_count(tok, "don't") == 5);
+
+    // Non-ASCII bytes are letters; punctuation keeps trailing newlines
+    assert(tokenizer_count(tok, "caf\xc3\xa9!\n\nthe") == 5 + 3 + 1);
+
+    tokenizer_free(tok);
+}
+// }}}
+
+// {{{ test_prefixed_matches_full
+TEST(test_prefixed_matches_full) {
+    Tokenizer* tok = load_fixture();
+
+    const char* text =
+        "You are the narrator of the game.\n\n"
+        "Rules: the king's   1234567 thing, then   \n  the end!\n"
+        "\t the\n\nthe realm  ";
+    size_t len = strlen(text);
+    int full = tokenizer_count(tok, text);
+
+    for (size_t split = 0; split <= len; split++) {
+        assert(tokenizer_count_prefixed(tok, text, split) == full);
+        assert(tokenizer_count_prefixed(tok, text, split) == full);  // Cached
+    }
+
+    // A cached prefix followed by different text
+    char combined[256];
+    const char* prefix = "You are the narrator.\n\n";
+    const char* tails[] = { "the", " the", "\n", "ing", "", "   x" };
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 6; i++) {
+            snprintf(combined, sizeof(combined), "%s%s", prefix, tails[i]);
+            assert(tokenizer_count_prefixed(tok, combined, strlen(prefix)) ==
+                   tokenizer_count(tok, combined));
+        }
+    }
+
+    // Prefix longer than text is clamped
+    assert(tokenizer_count_prefixed(tok, "the", 100) == 1);
+
+    tokenizer_free(tok);
+}
+// }}}
+
+// {{{ test_context_integration
+TEST(test_context_integration) {
+    Tokenizer* tok = load_fixture();
+    ContextManager* cm = context_init(1000);
+
+    context_set_tokenizer(cm, tok);
+    assert(context_add(cm, "You narrate the game.", PRIORITY_SYSTEM));
+    assert(context_add(cm, "the king", PRIORITY_CURRENT_TURN));
+    assert(context_add(cm, "thing", PRIORITY_OLD_EVENTS));
+
+    int expected = tokenizer_count(tok, "You narrate the game.") +
+                   tokenizer_count(tok, "the king") +
+                   tokenizer_count(tok, "thing");
+    assert(cm->current_tokens == expected);
+    assert(context_count_tokens(cm, "the king") == 4);
+
+    // Detaching reverts to estimates
+    context_set_tokenizer(cm, NULL);
+    assert(cm->current_tokens == context_estimate_tokens("You narrate the game.") +
+                                 context_estimate_tokens("the king") +
+                                 context_estimate_tokens("thing"));
+    context_free(cm);
+
+    // Entries that no longer fit once counted exactly are evicted
+    cm = context_init(10);
+    assert(context_add(cm, "aaaaaaaa", PRIORITY_OLD_EVENTS));     // Estimate 2
+    assert(context_add(cm, "bbbbbbbb", PRIORITY_RECENT_EVENTS));  // Estimate 2
+    context_set_tokenizer(cm, tok);                               // 8 each
+    assert(cm->entry_count == 1);
+    assert(cm->eviction_count == 1);
+    assert(cm->current_tokens == 8);
+    assert(context_get_entry_count(cm, PRIORITY_RECENT_EVENTS) == 1);
+
+    context_free(cm);
+    tokenizer_free(tok);
+}
+// }}}
+
+// {{{ test_benchmark_throughput
+static double elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+TEST(test_benchmark_throughput) {
+    Tokenizer* tok = load_fixture();
+
+    const char* line = "The Merchant Guild's trade fleet docks at the 3rd harbor; "
+                       "the king is watching the thing unfold.\n";
+    size_t line_len = strlen(line);
+    size_t total = 1 << 20;
+    char* text = malloc(total + 1);
+    for (size_t i = 0; i < total; i++) {
+        text[i] = line[i % line_len];
+    }
+    text[total] = '\0';
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int tokens = tokenizer_count(tok, text);
+    double ms = elapsed_ms(&start);
+
+    assert(tokens > 0);
+    printf("\n  %zu bytes -> %d tokens in %.1f ms (%.1f MB/s), estimate %d ",
+           total, tokens, ms, total / (ms * 1000.0), context_estimate_tokens(text));
+
+    free(text);
+    tokenizer_free(tok);
+}
+// }}}
+
+// {{{ main
+int main(void) {
+    printf("=== BPE Tokenizer Tests ===\n");
+
+    assert(mkdtemp(vocab_dir) != NULL);
+    snprintf(vocab_path, sizeof(vocab_path), "%s/fixture.tiktoken", vocab_dir);
+    write_vocab(vocab_path, -1);
+
+    RUN_TEST(test_load);
+    RUN_TEST(test_load_invalid);
+    RUN_TEST(test_load_for_model);
+    RUN_TEST(test_merges);
+    RUN_TEST(test_pieces);
+    RUN_TEST(test_prefixed_matches_full);
+    RUN_TEST(test_context_integration);
+    RUN_TEST(test_benchmark_throughput);
+
+    char path[300];
+    snprintf(path, sizeof(path), "%s/missing-byte.tiktoken", vocab_dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/garbage.tiktoken", vocab_dir);
+    unlink(path);
+    unlink(vocab_path);
+    rmdir(vocab_dir);
+
+    printf("\nAll tests passed!\n");
+    return 0;
+}
+// }}}
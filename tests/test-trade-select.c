@@ -2,14 +2,21 @@
  * test-trade-select.c - Unit Tests for LLM Trade Row Selection
  *
  * Tests faction balance tracking, candidate scoring, prompt building,
- * response parsing, and the complete selection callback.
+ * response parsing, and the complete selection callback. A scripted
+ * stub-server instance stands in for the model to check the latency
+ * budget.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "../src/llm/08-trade-select.h"
+#include "../src/llm/10-async-client.h"
+#include "../src/tools/stub-server.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 /* Test counters */
 static int tests_passed = 0;
@@ -76,6 +83,70 @@ static TradeRow* create_test_trade_row(void) {
 }
 /* }}} */
 
+/* {{{ Stub model
+ * Answers every request with stub_answer after stub_delay_ms.
+ */
+static StubServer* stub = NULL;
+static volatile int stub_delay_ms = 0;
+static char stub_answer[64] = "";
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void stub_reply(const char* body, StubReply* reply, void* context) {
+    (void)body;
+    (void)context;
+    free(reply->text);
+    reply->text = strdup(stub_answer);
+    reply->prompt_tokens = 0;
+    reply->reply_tokens = 5;
+    reply->delay_ms = stub_delay_ms;
+}
+
+static void stub_start(void) {
+    StubServerConfig config = stub_server_default_config(STUB_SERVER_LLM);
+    config.tokens_per_second = 0;
+    config.reply = stub_reply;
+    stub = stub_server_start(&config);
+    ASSERT_NOT_NULL(stub);
+}
+
+static LLMConfig* stub_config(void) {
+    LLMConfig* config = llm_config_create();
+    char endpoint[64];
+    snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", stub_server_port(stub));
+    free(config->endpoint);
+    config->endpoint = strdup(endpoint);
+    config->timeout_ms = 5000;
+    config->max_retries = 0;
+    return config;
+}
+
+/* Points the stub at a deck card the heuristics would not pick */
+static CardType* stub_answer_other_than_heuristic(TradeRow* row) {
+    TradeSelectContext* plain = trade_select_context_create(NULL, NULL, NULL);
+    CardType* heuristic = trade_select_dm_callback(row, plain);
+    trade_select_context_free(plain);
+
+    for (int i = 0; i < row->trade_deck_count; i++) {
+        if (row->trade_deck[i] != heuristic) {
+            snprintf(stub_answer, sizeof(stub_answer), "%s",
+                     row->trade_deck[i]->name);
+            return row->trade_deck[i];
+        }
+    }
+    return NULL;
+}
+/* }}} */
+
 /* {{{ test_context_create_free */
 TEST(context_create_free) {
     TradeSelectContext* ctx = trade_select_context_create(NULL, NULL, NULL);
@@ -460,6 +531,111 @@ TEST(dm_callback_selects_from_deck) {
 }
 /* }}} */
 
+/* {{{ test_dm_callback_llm_unavailable */
+TEST(dm_callback_llm_unavailable) {
+    /* No async engine: selection falls back to the heuristics */
+    TradeRow* row = create_test_trade_row();
+    LLMConfig* config = llm_config_create();
+    TradeSelectContext* ctx = trade_select_context_create(NULL, NULL, config);
+
+    ASSERT_NOT_NULL(trade_select_dm_callback(row, ctx));
+    ASSERT_NULL(ctx->pending);
+    ASSERT_EQ(ctx->stats.heuristic, 1);
+
+    trade_select_context_free(ctx);
+    llm_config_free(config);
+    trade_row_free(row);
+}
+/* }}} */
+
+/* {{{ test_dm_callback_llm_in_budget */
+TEST(dm_callback_llm_in_budget) {
+    TradeRow* row = create_test_trade_row();
+    CardType* wanted = stub_answer_other_than_heuristic(row);
+    ASSERT_NOT_NULL(wanted);
+    stub_delay_ms = 0;
+
+    LLMConfig* config = stub_config();
+    TradeSelectContext* ctx = trade_select_context_create(NULL, NULL, config);
+    ctx->llm_budget_ms = 3000;
+    ctx->llm_weight = 1.0f;  /* LLM choice outranks any heuristic score */
+
+    CardType* selected = trade_select_dm_callback(row, ctx);
+    ASSERT_TRUE(selected == wanted);
+    ASSERT_EQ(ctx->stats.llm_in_budget, 1);
+    ASSERT_EQ(ctx->stats.heuristic, 0);
+    ASSERT_NULL(ctx->pending);
+
+    trade_select_context_free(ctx);
+    llm_config_free(config);
+    trade_row_free(row);
+}
+/* }}} */
+
+/* {{{ test_dm_callback_llm_late */
+TEST(dm_callback_llm_late) {
+    TradeRow* row = create_test_trade_row();
+    CardType* wanted = stub_answer_other_than_heuristic(row);
+    ASSERT_NOT_NULL(wanted);
+    stub_delay_ms = 300;
+
+    LLMConfig* config = stub_config();
+    TradeSelectContext* ctx = trade_select_context_create(NULL, NULL, config);
+    ctx->llm_budget_ms = 20;
+    ctx->llm_weight = 1.0f;
+
+    /* The refill does not wait for the slow model */
+    double start = now_ms();
+    CardType* selected = trade_select_dm_callback(row, ctx);
+    ASSERT_LT(now_ms() - start, 200.0);
+    ASSERT_TRUE(selected != wanted);
+    ASSERT_EQ(ctx->stats.heuristic, 1);
+    ASSERT_NOT_NULL(ctx->pending);
+
+    /* Still thinking: the next refill does not wait either */
+    selected = trade_select_dm_callback(row, ctx);
+    ASSERT_TRUE(selected != wanted);
+    ASSERT_EQ(ctx->stats.heuristic, 2);
+
+    /* The late answer is applied to the following refill */
+    sleep_ms(600);
+    start = now_ms();
+    selected = trade_select_dm_callback(row, ctx);
+    ASSERT_LT(now_ms() - start, 200.0);
+    ASSERT_TRUE(selected == wanted);
+    ASSERT_EQ(ctx->stats.llm_precomputed, 1);
+
+    /* A request for the next refill is running; freeing cancels it */
+    ASSERT_NOT_NULL(ctx->pending);
+    trade_select_context_free(ctx);
+    llm_config_free(config);
+    trade_row_free(row);
+}
+/* }}} */
+
+/* {{{ test_dm_callback_llm_stale_answer */
+TEST(dm_callback_llm_stale_answer) {
+    TradeRow* row = create_test_trade_row();
+    ASSERT_NOT_NULL(stub_answer_other_than_heuristic(row));
+    snprintf(stub_answer, sizeof(stub_answer), "Card Long Gone");
+    stub_delay_ms = 100;
+
+    LLMConfig* config = stub_config();
+    TradeSelectContext* ctx = trade_select_context_create(NULL, NULL, config);
+    ctx->llm_budget_ms = 0;  /* Never wait */
+
+    ASSERT_NOT_NULL(trade_select_dm_callback(row, ctx));
+    sleep_ms(400);
+    ASSERT_NOT_NULL(trade_select_dm_callback(row, ctx));
+    ASSERT_EQ(ctx->stats.llm_discarded, 1);
+    ASSERT_EQ(ctx->stats.heuristic, 2);
+
+    trade_select_context_free(ctx);
+    llm_config_free(config);
+    trade_row_free(row);
+}
+/* }}} */
+
 /* {{{ main */
 int main(void) {
     printf("=== Trade Selection Tests ===\n\n");
@@ -510,6 +686,16 @@ int main(void) {
     RUN_TEST(dm_callback_no_llm);
     RUN_TEST(dm_callback_null);
     RUN_TEST(dm_callback_selects_from_deck);
+    RUN_TEST(dm_callback_llm_unavailable);
+
+    printf("\nLatency budget tests:\n");
+    stub_start();
+    llm_async_init();
+    RUN_TEST(dm_callback_llm_in_budget);
+    RUN_TEST(dm_callback_llm_late);
+    RUN_TEST(dm_callback_llm_stale_answer);
+    llm_async_cleanup();
+    stub_server_stop(stub);
 
     llm_cleanup();
 
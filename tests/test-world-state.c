@@ -42,17 +42,21 @@ static Game* create_mock_game(void) {
     game->phase = PHASE_MAIN;
     game->game_over = false;
     game->active_player = 0;
+    game->card_types = NULL;
+    game->card_type_count = 0;
 
     // Create mock players
     game->players[0] = malloc(sizeof(Player));
     game->players[0]->name = strdup("Lady Morgaine");
     game->players[0]->authority = 42;
     game->players[0]->id = 1;
+    game->players[0]->deck = NULL;
 
     game->players[1] = malloc(sizeof(Player));
     game->players[1]->name = strdup("Lord Theron");
     game->players[1]->authority = 38;
     game->players[1]->id = 2;
+    game->players[1]->deck = NULL;
 
     for (int i = 2; i < MAX_PLAYERS; i++) {
         game->players[i] = NULL;
@@ -281,6 +285,179 @@ TEST(test_build_context) {
 }
 // }}}
 
+// {{{ test_session_context_stable
+TEST(test_session_context_stable) {
+    WorldState* state = world_state_create();
+    Game* game = create_mock_game();
+
+    CardType bear = { .name = "Dire Bear", .faction = FACTION_WILDS };
+    CardType wolf = { .name = "Forest Wolf", .faction = FACTION_WILDS };
+    CardType wagon = { .name = "Trade Wagon", .faction = FACTION_MERCHANT };
+    CardType* catalog[] = { &bear, &wagon, &wolf };
+    game->card_types = catalog;
+    game->card_type_count = 3;
+
+    char* session = world_state_build_session_context(game);
+    assert(session != NULL);
+    assert(strstr(session, "Lady Morgaine") != NULL);
+    assert(strstr(session, "the High Kingdom") != NULL);
+    assert(strstr(session, "Cards of the forces of the Wilds: Dire Bear, Forest Wolf") != NULL);
+    assert(strstr(session, "Trade Wagon") != NULL);
+    assert(strstr(session, "Turn") == NULL);
+    assert(strstr(session, "42") == NULL);
+
+    // The full context leads with the session text on every turn
+    world_state_init_from_game(state, game);
+    char* first = world_state_build_context(state, game);
+    assert(strncmp(first, session, strlen(session)) == 0);
+
+    game->turn_number = 6;
+    game->players[0]->authority = 30;
+    world_state_record_event(state, "attack", "The bear strikes", 0, 6);
+    world_state_update(state, game);
+    char* second = world_state_build_context(state, game);
+    assert(strncmp(second, session, strlen(session)) == 0);
+    assert(strstr(second, "Turn 6") != NULL);
+
+    char* turn = world_state_build_turn_context(state, game);
+    assert(strstr(turn, "Turn 6") != NULL);
+    assert(strstr(turn, "The bear strikes") != NULL);
+    assert(strcmp(second + strlen(session) + 2, turn) == 0);
+
+    assert(world_state_build_session_context(NULL) == NULL);
+    assert(world_state_build_turn_context(NULL, game) == NULL);
+
+    free(session);
+    free(first);
+    free(second);
+    free(turn);
+    game->card_types = NULL;
+    world_state_free(state);
+    free_mock_game(game);
+}
+// }}}
+
+// {{{ test_incremental_updates
+TEST(test_incremental_updates) {
+    WorldState* state = world_state_create();
+    Game* game = create_mock_game();
+    world_state_init_from_game(state, game);
+    world_state_update(state, game);
+
+    // Clean: the cached turn context is returned as built
+    char* first = world_state_build_turn_context(state, game);
+    assert(!(state->dirty & WORLD_DIRTY_TURN));
+    free(game->players[0]->name);
+    game->players[0]->name = strdup("Lady Vivienne");
+    char* cached = world_state_build_turn_context(state, game);
+    assert(strcmp(first, cached) == 0);
+
+    // A recorded event dirties the turn context
+    world_state_record_event(state, "play", "A mighty beast appears", 0, 5);
+    char* rebuilt = world_state_build_turn_context(state, game);
+    assert(strstr(rebuilt, "Vivienne") != NULL);
+    assert(strstr(rebuilt, "A mighty beast appears") != NULL);
+
+    // Effects of a card: the first one notes the play, authority recomputes
+    Effect effects[2] = {
+        { .type = EFFECT_COMBAT, .value = 4 },
+        { .type = EFFECT_AUTHORITY, .value = 3 }
+    };
+    CardType bear = { .name = "Dire Bear", .faction = FACTION_WILDS,
+                      .kind = CARD_KIND_SHIP, .effects = effects,
+                      .effect_count = 2 };
+    CardInstance card = { .type = &bear };
+    state->dirty = 0;
+
+    world_state_effect_listener(game, game->players[1], &card, &effects[0], state);
+    assert(state->faction_card_counts[FACTION_WILDS] == 1);
+    assert(state->dirty & WORLD_DIRTY_FORCES(1));
+    assert(!(state->dirty & WORLD_DIRTY_FORCES(0)));
+    assert(!(state->dirty & WORLD_DIRTY_TURN));
+
+    game->players[1]->authority = 2;
+    world_state_effect_listener(game, game->players[1], &card, &effects[1], state);
+    assert(state->faction_card_counts[FACTION_WILDS] == 1);
+    assert(state->tension > 0.5f);
+    assert(state->dirty & WORLD_DIRTY_TURN);
+    assert(!(state->dirty & WORLD_DIRTY_TENSION));
+    assert(strstr(state->battlefield_description, "Symbeline") == NULL);
+
+    world_state_update(state, game);
+    assert(state->dominant_faction == FACTION_WILDS);
+    char* updated = world_state_build_turn_context(state, game);
+    assert(strstr(updated, "Lord Theron commands 2 authority") != NULL);
+    assert(strcmp(updated, rebuilt) != 0);
+
+    // Cards drawn by auto-draw dirty only the drawing player's forces
+    state->dirty = 0;
+    AutoDrawEvent drawn = { .type = AUTODRAW_EVENT_CARD };
+    world_state_autodraw_listener(game, game->players[0], &drawn, state);
+    assert(state->dirty == WORLD_DIRTY_FORCES(0));
+
+    // A new turn dirties tension, the turn context and every hand
+    state->dirty = 0;
+    game->turn_number = 6;
+    world_state_update(state, game);
+    assert(state->turn_number == 6);
+    assert((state->dirty & WORLD_DIRTY_ALL_FORCES) == WORLD_DIRTY_ALL_FORCES);
+    assert(state->dirty & WORLD_DIRTY_TURN);
+
+    world_state_note_card_played(NULL, 0, &card);
+    world_state_effect_listener(game, game->players[0], &card, &effects[0], NULL);
+
+    free(first);
+    free(cached);
+    free(rebuilt);
+    free(updated);
+    world_state_free(state);
+    free_mock_game(game);
+}
+// }}}
+
+// {{{ test_base_removal
+TEST(test_base_removal) {
+    WorldState* state = world_state_create();
+    Game* game = create_mock_game();
+    Deck deck;
+    memset(&deck, 0, sizeof(deck));
+    deck.frontier_base_count = 1;
+    deck.interior_base_count = 1;
+    game->players[1]->deck = &deck;
+    world_state_init_from_game(state, game);
+    world_state_update(state, game);
+    assert(state->base_count[1] == 2);
+
+    // A base destroyed in combat fires no effect; the update notices
+    state->dirty = 0;
+    deck.frontier_base_count = 0;
+    world_state_update(state, game);
+    assert(state->dirty == WORLD_DIRTY_FORCES(1));
+    assert(state->base_count[1] == 1);
+
+    // A reported removal is not counted again by the next update
+    CardInstance base = { 0 };
+    world_state_note_base(state, 1, &base, false);
+    assert(state->dirty & WORLD_DIRTY_FORCES(1));
+    deck.interior_base_count = 0;
+    state->dirty = 0;
+    world_state_update(state, game);
+    assert(state->dirty == 0);
+
+    // A discard fires nothing either; a refresh alone notices it
+    deck.hand_count = 3;
+    world_state_refresh(state, game);
+    assert(state->dirty == WORLD_DIRTY_FORCES(1));
+    assert(state->hand_count[1] == 3);
+    world_state_refresh(NULL, game);
+    world_state_refresh(state, NULL);
+
+    game->players[1]->deck = NULL;
+    world_state_free(state);
+    free_mock_game(game);
+}
+// }}}
+
 // {{{ test_get_faction_name
 TEST(test_get_faction_name) {
     const char* name = world_state_get_faction_name(FACTION_MERCHANT);
@@ -312,6 +489,9 @@ int main(void) {
     RUN_TEST(test_update);
     RUN_TEST(test_to_prompt_vars);
     RUN_TEST(test_build_context);
+    RUN_TEST(test_session_context_stable);
+    RUN_TEST(test_incremental_updates);
+    RUN_TEST(test_base_removal);
     RUN_TEST(test_get_faction_name);
 
     printf("\nAll tests passed!\n");